@@ -8,16 +8,14 @@
 #define AMBIENT_LIGHT_H_INCLUDED
 
 #include "Defines.h"
+#include "ShaderConstants.h"
 
 class CAmbientLight
 {
 private:
 	D3DXVECTOR3 m_Colour;
-	static ID3D10EffectVectorVariable* m_ColourVar;
 
 public:
-	static void SetColourVar(ID3D10EffectVectorVariable* colourVar);
-
 	CAmbientLight(D3DXVECTOR3 colour = D3DXVECTOR3(0.0f, 0.0f, 0.0f));
 
 	// Getters
@@ -32,6 +30,7 @@ public:
 		m_Colour = colour;
 	}
 
+	// Write the colour into the light set constants, uploaded once all the lights are written
 	void LightRender();
 
 };
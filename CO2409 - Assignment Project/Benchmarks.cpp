@@ -0,0 +1,934 @@
+//--------------------------------------------------------------------------------------
+//	Benchmarks.cpp
+//
+//	Headless benchmarks of the math library's batch and structure-of-arrays code against
+//	the simpler code it replaced. Each one times both versions on the same generated data,
+//	checks they give the same results and writes a report, without creating a window or device
+//--------------------------------------------------------------------------------------
+
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+using namespace std;
+
+#include "Defines.h"			// General definitions shared by all source files
+#include "Camera.h"
+#include "CTimer.h"
+#include "BatchCulling.h"
+#include "BatchQuaternion.h"
+#include "CBVH.h"
+#include "CTransformHierarchy.h"
+#include "CTransformStore.h"
+#include "CCone.h"
+#include "CJobSystem.h"
+
+
+//--------------------------------------------------------------------------------------
+// Culling
+//--------------------------------------------------------------------------------------
+
+// Spheres and boxes are scattered at random around the camera, from the same seed each run. Smaller lists are culled repeatedly
+// so every size makes about the same number of tests in total
+const unsigned int CullBenchmarkSizes[] = { 10000, 100000, 1000000 };
+const unsigned int NumCullBenchmarkSizes = sizeof(CullBenchmarkSizes) / sizeof(CullBenchmarkSizes[0]);
+const unsigned int CullBenchmarkTests = 10000000;
+const float        CullBenchmarkSpread = 1000.0f;
+const float        CullBenchmarkMinRadius = 1.0f;
+const float        CullBenchmarkMaxRadius = 10.0f;
+
+// Single volume tests, as used before the batch culling
+template <class TVolume> bool IsVisible(const gen::CFrustum& frustum, const TVolume& volume)
+{
+	return frustum.Test(volume) != gen::kOutside;
+}
+template <class TVolume> bool IsVisible(const gen::CCone& cone, const TVolume& volume)
+{
+	return cone.Intersects(volume);
+}
+
+// Batch tests, chosen by list type
+template <class TShape> unsigned int BatchCull(const TShape& shape, const gen::CSphereList& spheres, gen::TUInt32* pVisible)
+{
+	return gen::CullSpheres(shape, spheres, pVisible);
+}
+template <class TShape> unsigned int BatchCull(const TShape& shape, const gen::CAABBList& boxes, gen::TUInt32* pVisible)
+{
+	return gen::CullAABBs(shape, boxes, pVisible);
+}
+
+// Cull the same volumes repeatedly with the single volume tests then the batch tests, writing the average time of each to the file.
+// Returns false if the two gave different results
+template <class TShape, class TVolume, class TList>
+bool CompareCulls(ofstream& file, const char* name, const TShape& shape, const vector<TVolume>& volumes, const TList& list,
+                  unsigned int repeats)
+{
+	const unsigned int numVolumes = static_cast<unsigned int>(volumes.size());
+	vector<gen::TUInt32> scalarVisible(numVolumes);
+	vector<gen::TUInt32> batchVisible(numVolumes);
+	unsigned int numScalar = 0, numBatch = 0;
+
+	CTimer timer;
+	timer.Start();
+	for (unsigned int repeat = 0; repeat < repeats; repeat++)
+	{
+		numScalar = 0;
+		for (unsigned int i = 0; i < numVolumes; i++)
+		{
+			if (IsVisible(shape, volumes[i]))
+			{
+				scalarVisible[numScalar++] = i;
+			}
+		}
+	}
+	float scalarTime = timer.GetLapTime() * 1000.0f / repeats;
+	for (unsigned int repeat = 0; repeat < repeats; repeat++)
+	{
+		numBatch = BatchCull(shape, list, &batchVisible[0]);
+	}
+	float batchTime = timer.GetLapTime() * 1000.0f / repeats;
+
+	bool resultsMatch = numScalar == numBatch && equal(scalarVisible.begin(), scalarVisible.begin() + numScalar, batchVisible.begin());
+	file << "  " << name << "  scalar: " << scalarTime << "  batch: " << batchTime << "  visible: " << numBatch << "\n";
+	if (!resultsMatch)
+	{
+		file << "ERROR: scalar and batch tests found different visible volumes (" << numScalar << ")\n";
+	}
+	return resultsMatch;
+}
+
+// Run the culling benchmark, comparing the frustum and cone tests of single spheres and boxes with the batch tests over lists of
+// them, and write the results to the given text file. Returns false if the file could not be written or the results differed
+bool RunCullingBenchmark(const char* fileName)
+{
+	CCamera camera(D3DXVECTOR3(0.0f, 0.0f, 0.0f), D3DXVECTOR3(0.0f, 0.0f, 0.0f));
+	camera.UpdateMatrices();
+	const gen::CFrustum& frustum = camera.GetFrustum();
+	gen::CCone cone(gen::CVector3(0.0f, 0.0f, 0.0f), gen::CVector3(0.0f, 0.0f, 1.0f), ToRadians(30.0f), CullBenchmarkSpread);
+
+	ofstream file(fileName);
+	if (!file)
+	{
+		return false;
+	}
+	file << "Average time per cull (ms)\n";
+
+	bool resultsMatch = true;
+	for (unsigned int size = 0; size < NumCullBenchmarkSizes; size++)
+	{
+		const unsigned int numVolumes = CullBenchmarkSizes[size];
+		const unsigned int repeats = (numVolumes < CullBenchmarkTests) ? CullBenchmarkTests / numVolumes : 1;
+
+		srand(numVolumes);
+		vector<gen::CSphere> spheres;
+		vector<gen::CAABB> boxes;
+		gen::CSphereList sphereList;
+		gen::CAABBList boxList;
+		spheres.reserve(numVolumes);
+		boxes.reserve(numVolumes);
+		sphereList.Reserve(numVolumes);
+		boxList.Reserve(numVolumes);
+		for (unsigned int i = 0; i < numVolumes; i++)
+		{
+			gen::CVector3 centre(gen::Random(-CullBenchmarkSpread, CullBenchmarkSpread), gen::Random(-CullBenchmarkSpread, CullBenchmarkSpread),
+			                     gen::Random(-CullBenchmarkSpread, CullBenchmarkSpread));
+			float radius = gen::Random(CullBenchmarkMinRadius, CullBenchmarkMaxRadius);
+			gen::CVector3 extents(radius, gen::Random(CullBenchmarkMinRadius, radius), radius);
+			spheres.push_back(gen::CSphere(centre, radius));
+			boxes.push_back(gen::CAABB(centre - extents, centre + extents));
+			sphereList.Add(spheres.back());
+			boxList.Add(boxes.back());
+		}
+
+		file << numVolumes << " volumes, " << repeats << " runs\n";
+		resultsMatch &= CompareCulls(file, "frustum spheres", frustum, spheres, sphereList, repeats);
+		resultsMatch &= CompareCulls(file, "frustum boxes  ", frustum, boxes, boxList, repeats);
+		resultsMatch &= CompareCulls(file, "cone spheres   ", cone, spheres, sphereList, repeats);
+		resultsMatch &= CompareCulls(file, "cone boxes     ", cone, boxes, boxList, repeats);
+	}
+	return !file.fail() && resultsMatch;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Quaternions
+//--------------------------------------------------------------------------------------
+
+// Pairs of random unit quaternions are interpolated and converted to matrices, from the same seed each run. The second of each
+// pair is on the same side as the first (positive dot product), so the scalar functions take the shorter route between them as
+// the batch functions always do. The batch Slerp uses approximations, so is allowed a small error
+const unsigned int QuatBenchmarkSizes[] = { 10000, 100000, 1000000 };
+const unsigned int NumQuatBenchmarkSizes = sizeof(QuatBenchmarkSizes) / sizeof(QuatBenchmarkSizes[0]);
+const unsigned int QuatBenchmarkOperations = 4000000;
+const float        QuatBenchmarkT = 0.3f;
+const float        QuatBenchmarkMaxError = 1e-5f; // As 1 - |dot product| of the scalar and batch results
+
+// Return a random unit quaternion
+gen::CQuaternion RandomQuaternion()
+{
+	gen::CQuaternion quat;
+	do
+	{
+		quat = gen::CQuaternion(gen::Random(-1.0f, 1.0f), gen::Random(-1.0f, 1.0f), gen::Random(-1.0f, 1.0f), gen::Random(-1.0f, 1.0f));
+	} while (gen::Dot(quat, quat) < 0.01f);
+	return gen::Normalise(quat);
+}
+
+// Return the largest difference between the quaternions in an array and a list, measured as 1 - |dot product|
+float MaxQuaternionError(const vector<gen::CQuaternion>& expected, const gen::CQuaternionList& actual)
+{
+	float maxError = 0.0f;
+	for (unsigned int i = 0; i < expected.size(); i++)
+	{
+		float error = 1.0f - gen::Abs(gen::Dot(expected[i], actual.Get(i)));
+		if (error > maxError)
+		{
+			maxError = error;
+		}
+	}
+	return maxError;
+}
+
+// Run the quaternion benchmark, comparing the scalar NLerp, Slerp and matrix conversion with the batch versions (on this thread
+// alone and with the job system), and write the results to the given text file. Returns false if the file could not be written or
+// the batch results were not close enough
+bool RunQuaternionBenchmark(const char* fileName)
+{
+	ofstream file(fileName);
+	if (!file)
+	{
+		return false;
+	}
+	gen::CJobSystem jobs;
+	file << "Average time per pass (ms) - scalar, batch, batch with " << jobs.GetNumThreads() << " threads\n";
+
+	bool resultsMatch = true;
+	for (unsigned int size = 0; size < NumQuatBenchmarkSizes; size++)
+	{
+		const unsigned int numQuats = QuatBenchmarkSizes[size];
+		const unsigned int repeats = (numQuats < QuatBenchmarkOperations) ? QuatBenchmarkOperations / numQuats : 1;
+
+		srand(numQuats);
+		gen::CQuaternionList list0, list1;
+		vector<gen::CQuaternion> quats0, quats1;
+		vector<gen::CVector3> positions;
+		for (unsigned int i = 0; i < numQuats; i++)
+		{
+			gen::CQuaternion q0 = RandomQuaternion();
+			gen::CQuaternion q1 = RandomQuaternion();
+			if (gen::Dot(q0, q1) < 0.0f)
+			{
+				q1 = gen::CQuaternion(-q1.w, -q1.x, -q1.y, -q1.z);
+			}
+			quats0.push_back(q0);
+			quats1.push_back(q1);
+			list0.Add(q0);
+			list1.Add(q1);
+			positions.push_back(gen::CVector3(gen::Random(-100.0f, 100.0f), gen::Random(-100.0f, 100.0f), gen::Random(-100.0f, 100.0f)));
+		}
+		vector<gen::CQuaternion> scalarResults(numQuats);
+		gen::CQuaternionList batchResults(numQuats);
+		vector<gen::CMatrix4x4> scalarMatrices(numQuats);
+		vector<gen::CMatrix4x4> batchMatrices(numQuats);
+		file << numQuats << " quaternions, " << repeats << " runs\n";
+
+		// NLerp
+		CTimer timer;
+		timer.Start();
+		for (unsigned int repeat = 0; repeat < repeats; repeat++)
+		{
+			for (unsigned int i = 0; i < numQuats; i++)
+			{
+				gen::NLerp(quats0[i], quats1[i], QuatBenchmarkT, scalarResults[i]);
+			}
+		}
+		float scalarTime = timer.GetLapTime() * 1000.0f / repeats;
+		for (unsigned int repeat = 0; repeat < repeats; repeat++)
+		{
+			gen::NLerp(list0, list1, QuatBenchmarkT, batchResults);
+		}
+		float batchTime = timer.GetLapTime() * 1000.0f / repeats;
+		for (unsigned int repeat = 0; repeat < repeats; repeat++)
+		{
+			gen::NLerp(list0, list1, QuatBenchmarkT, batchResults, &jobs);
+		}
+		float jobsTime = timer.GetLapTime() * 1000.0f / repeats;
+		float nlerpError = MaxQuaternionError(scalarResults, batchResults);
+		file << "  NLerp        " << scalarTime << "  " << batchTime << "  " << jobsTime << "  max error: " << nlerpError << "\n";
+
+		// Slerp
+		timer.GetLapTime();
+		for (unsigned int repeat = 0; repeat < repeats; repeat++)
+		{
+			for (unsigned int i = 0; i < numQuats; i++)
+			{
+				gen::Slerp(quats0[i], quats1[i], QuatBenchmarkT, scalarResults[i]);
+			}
+		}
+		scalarTime = timer.GetLapTime() * 1000.0f / repeats;
+		for (unsigned int repeat = 0; repeat < repeats; repeat++)
+		{
+			gen::Slerp(list0, list1, QuatBenchmarkT, batchResults);
+		}
+		batchTime = timer.GetLapTime() * 1000.0f / repeats;
+		for (unsigned int repeat = 0; repeat < repeats; repeat++)
+		{
+			gen::Slerp(list0, list1, QuatBenchmarkT, batchResults, &jobs);
+		}
+		jobsTime = timer.GetLapTime() * 1000.0f / repeats;
+		float slerpError = MaxQuaternionError(scalarResults, batchResults);
+		file << "  Slerp        " << scalarTime << "  " << batchTime << "  " << jobsTime << "  max error: " << slerpError << "\n";
+
+		// Matrix conversion
+		timer.GetLapTime();
+		for (unsigned int repeat = 0; repeat < repeats; repeat++)
+		{
+			for (unsigned int i = 0; i < numQuats; i++)
+			{
+				scalarMatrices[i].MakeAffineQuaternion(quats0[i], positions[i]);
+			}
+		}
+		scalarTime = timer.GetLapTime() * 1000.0f / repeats;
+		for (unsigned int repeat = 0; repeat < repeats; repeat++)
+		{
+			gen::ToMatrices(list0, &positions[0], &batchMatrices[0]);
+		}
+		batchTime = timer.GetLapTime() * 1000.0f / repeats;
+		for (unsigned int repeat = 0; repeat < repeats; repeat++)
+		{
+			gen::ToMatrices(list0, &positions[0], &batchMatrices[0], &jobs);
+		}
+		jobsTime = timer.GetLapTime() * 1000.0f / repeats;
+		bool matricesMatch = memcmp(&scalarMatrices[0], &batchMatrices[0], numQuats * sizeof(gen::CMatrix4x4)) == 0;
+		file << "  ToMatrices   " << scalarTime << "  " << batchTime << "  " << jobsTime << (matricesMatch ? "  identical\n" : "\n");
+
+		if (nlerpError > QuatBenchmarkMaxError || slerpError > QuatBenchmarkMaxError || !matricesMatch)
+		{
+			file << "ERROR: batch results differ from the scalar functions\n";
+			resultsMatch = false;
+		}
+	}
+	return !file.fail() && resultsMatch;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Bounding Volume Hierarchy
+//--------------------------------------------------------------------------------------
+
+// Random boxes are put in a tree, then a tenth of them are moved a short way and the tree refitted, from the same seed each run.
+// Culls of the refitted tree are compared with testing every box in turn
+const unsigned int BVHBenchmarkSizes[] = { 10000, 100000 };
+const unsigned int NumBVHBenchmarkSizes = sizeof(BVHBenchmarkSizes) / sizeof(BVHBenchmarkSizes[0]);
+const unsigned int BVHBenchmarkBuilds = 5;
+const unsigned int BVHBenchmarkRefits = 20;
+const unsigned int BVHBenchmarkCulls = 100;
+const unsigned int BVHBenchmarkMoveFraction = 10; // One in this many boxes is moved
+const float        BVHBenchmarkSpread = 1000.0f;
+const float        BVHBenchmarkMaxSize = 10.0f;
+const float        BVHBenchmarkMaxMove = 20.0f;
+
+// Return a random box in the benchmark area
+gen::CAABB RandomBox()
+{
+	gen::CVector3 minPt(gen::Random(-BVHBenchmarkSpread, BVHBenchmarkSpread), gen::Random(-BVHBenchmarkSpread, BVHBenchmarkSpread),
+	                    gen::Random(-BVHBenchmarkSpread, BVHBenchmarkSpread));
+	gen::CVector3 size(gen::Random(1.0f, BVHBenchmarkMaxSize), gen::Random(1.0f, BVHBenchmarkMaxSize), gen::Random(1.0f, BVHBenchmarkMaxSize));
+	return gen::CAABB(minPt, minPt + size);
+}
+
+// Run the bounding volume hierarchy benchmark, timing building and refitting a tree and comparing frustum culls of the tree with
+// testing each box, and write the results to the given text file. Returns false if the file could not be written or the tree
+// found different boxes
+bool RunBVHBenchmark(const char* fileName)
+{
+	CCamera camera(D3DXVECTOR3(0.0f, 0.0f, 0.0f), D3DXVECTOR3(0.0f, 0.0f, 0.0f));
+	camera.UpdateMatrices();
+	const gen::CFrustum& frustum = camera.GetFrustum();
+
+	ofstream file(fileName);
+	if (!file)
+	{
+		return false;
+	}
+	file << "Average times (ms)\n";
+
+	bool resultsMatch = true;
+	for (unsigned int size = 0; size < NumBVHBenchmarkSizes; size++)
+	{
+		const unsigned int numBoxes = BVHBenchmarkSizes[size];
+		srand(numBoxes);
+		vector<gen::CAABB> boxes(numBoxes);
+		for (unsigned int i = 0; i < numBoxes; i++)
+		{
+			boxes[i] = RandomBox();
+		}
+
+		// Build
+		gen::CBVH tree;
+		CTimer timer;
+		timer.Start();
+		for (unsigned int build = 0; build < BVHBenchmarkBuilds; build++)
+		{
+			tree.Build(&boxes[0], numBoxes);
+		}
+		float buildTime = timer.GetLapTime() * 1000.0f / BVHBenchmarkBuilds;
+
+		// Move some boxes and refit
+		for (unsigned int i = 0; i < numBoxes; i += BVHBenchmarkMoveFraction)
+		{
+			gen::CVector3 move(gen::Random(-BVHBenchmarkMaxMove, BVHBenchmarkMaxMove), gen::Random(-BVHBenchmarkMaxMove, BVHBenchmarkMaxMove),
+			                   gen::Random(-BVHBenchmarkMaxMove, BVHBenchmarkMaxMove));
+			boxes[i] = gen::CAABB(boxes[i].minPt + move, boxes[i].maxPt + move);
+			tree.SetItemBox(i, boxes[i]);
+		}
+		timer.GetLapTime();
+		for (unsigned int refit = 0; refit < BVHBenchmarkRefits; refit++)
+		{
+			tree.Refit();
+		}
+		float refitTime = timer.GetLapTime() * 1000.0f / BVHBenchmarkRefits;
+
+		// Cull the tree, then test every box
+		vector<gen::TUInt32> treeVisible, linearVisible;
+		timer.GetLapTime();
+		for (unsigned int cull = 0; cull < BVHBenchmarkCulls; cull++)
+		{
+			treeVisible.clear();
+			tree.Cull(frustum, treeVisible);
+		}
+		float treeTime = timer.GetLapTime() * 1000.0f / BVHBenchmarkCulls;
+		for (unsigned int cull = 0; cull < BVHBenchmarkCulls; cull++)
+		{
+			linearVisible.clear();
+			for (unsigned int i = 0; i < numBoxes; i++)
+			{
+				if (frustum.Test(boxes[i]) != gen::kOutside)
+				{
+					linearVisible.push_back(i);
+				}
+			}
+		}
+		float linearTime = timer.GetLapTime() * 1000.0f / BVHBenchmarkCulls;
+
+		// The tree returns its results in no particular order
+		sort(treeVisible.begin(), treeVisible.end());
+		bool cullsMatch = treeVisible == linearVisible;
+
+		file << numBoxes << " boxes, " << tree.GetNumNodes() << " nodes\n";
+		file << "  build: " << buildTime << "  refit after moving 1 in " << BVHBenchmarkMoveFraction << ": " << refitTime
+		     << "  degradation: " << tree.GetDegradation() << "\n";
+		file << "  frustum cull  tree: " << treeTime << "  linear: " << linearTime << "  visible: " << linearVisible.size() << "\n";
+		if (!cullsMatch)
+		{
+			file << "ERROR: tree and linear culls found different boxes (" << treeVisible.size() << ")\n";
+			resultsMatch = false;
+		}
+	}
+	return !file.fail() && resultsMatch;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Transform Hierarchy
+//--------------------------------------------------------------------------------------
+
+// Each root has an equal share of the nodes below it, each node's parent being a random earlier node under the same root. Two
+// copies of the hierarchy get the same changes, one updated on this thread alone and one with the job system, from the same seed
+// each run. Both must give exactly the world matrices of a simple reference calculation
+const unsigned int HierarchyBenchmarkNodes = 100000;
+const unsigned int HierarchyBenchmarkRoots = 1000;
+const unsigned int HierarchyBenchmarkEdits = 100;
+const unsigned int HierarchyBenchmarkRepeats = 20;
+
+// Return a random index less than count. Uses two calls to rand as RAND_MAX may be as low as 32767
+unsigned int RandomIndex(unsigned int count)
+{
+	return (((rand() & 0x7fff) << 15) | (rand() & 0x7fff)) % count;
+}
+
+// Return a random affine matrix
+gen::CMatrix4x4 RandomAffineMatrix()
+{
+	gen::CMatrix4x4 matrix;
+	gen::CVector3 position(gen::Random(-10.0f, 10.0f), gen::Random(-10.0f, 10.0f), gen::Random(-10.0f, 10.0f));
+	gen::CVector3 angles(gen::Random(-gen::kfPi, gen::kfPi), gen::Random(-gen::kfPi, gen::kfPi), gen::Random(-gen::kfPi, gen::kfPi));
+	matrix.MakeAffineEuler(position, angles, gen::kZXY);
+	return matrix;
+}
+
+// Times (ms) and node counts of each kind of hierarchy update
+struct SHierarchyTimes
+{
+	float        FullTime, EditsTime, NoChangeTime;
+	unsigned int FullUpdated, EditsUpdated, NoChangeUpdated;
+};
+
+// Change the local matrices of the given nodes and update the hierarchy, returning the time taken by the update (ms)
+float TimeHierarchyUpdate(gen::CTransformHierarchy& hierarchy, const vector<gen::TUInt32>& nodes, const vector<gen::CMatrix4x4>& localMatrices,
+                          gen::CJobSystem* jobs, unsigned int& numUpdated)
+{
+	for (unsigned int i = 0; i < nodes.size(); i++)
+	{
+		hierarchy.SetLocalMatrix(nodes[i], localMatrices[nodes[i]]);
+	}
+	CTimer timer;
+	timer.Start();
+	numUpdated = hierarchy.Update(jobs);
+	return timer.GetLapTime() * 1000.0f;
+}
+
+// Run the transform hierarchy benchmark, timing full updates, updates after a few edits and updates with no changes, on this thread
+// alone and with the job system, and write the results to the given text file. Returns false if the file could not be written or
+// the world matrices were not exactly right
+bool RunHierarchyBenchmark(const char* fileName)
+{
+	ofstream file(fileName);
+	if (!file)
+	{
+		return false;
+	}
+
+	// Same nodes in both hierarchies
+	srand(HierarchyBenchmarkNodes);
+	const unsigned int nodesPerRoot = HierarchyBenchmarkNodes / HierarchyBenchmarkRoots;
+	vector<gen::CMatrix4x4> localMatrices;
+	vector<gen::TUInt32> parents, roots;
+	gen::CTransformHierarchy hierarchies[2];
+	for (unsigned int root = 0; root < HierarchyBenchmarkRoots; root++)
+	{
+		const unsigned int rootNode = static_cast<unsigned int>(parents.size());
+		for (unsigned int i = 0; i < nodesPerRoot; i++)
+		{
+			gen::TUInt32 parent = (i == 0) ? gen::CTransformHierarchy::kNoParent : rootNode + RandomIndex(i);
+			localMatrices.push_back(RandomAffineMatrix());
+			parents.push_back(parent);
+			hierarchies[0].AddNode(localMatrices.back(), parent);
+			hierarchies[1].AddNode(localMatrices.back(), parent);
+		}
+		roots.push_back(rootNode);
+	}
+	hierarchies[0].Update();
+	hierarchies[1].Update();
+
+	// The same changes for each run
+	vector< vector<gen::TUInt32> > edits(HierarchyBenchmarkRepeats);
+	for (unsigned int repeat = 0; repeat < HierarchyBenchmarkRepeats; repeat++)
+	{
+		for (unsigned int edit = 0; edit < HierarchyBenchmarkEdits; edit++)
+		{
+			gen::TUInt32 node = RandomIndex(HierarchyBenchmarkNodes);
+			localMatrices[node] = RandomAffineMatrix();
+			edits[repeat].push_back(node);
+		}
+	}
+	const vector<gen::TUInt32> noChanges;
+
+	gen::CJobSystem jobs;
+	gen::CJobSystem* jobSystems[2] = { NULL, &jobs };
+	SHierarchyTimes times[2];
+	for (unsigned int run = 0; run < 2; run++)
+	{
+		SHierarchyTimes& time = times[run];
+		time.FullTime = time.EditsTime = time.NoChangeTime = 0.0f;
+		for (unsigned int repeat = 0; repeat < HierarchyBenchmarkRepeats; repeat++)
+		{
+			time.FullTime += TimeHierarchyUpdate(hierarchies[run], roots, localMatrices, jobSystems[run], time.FullUpdated);
+			time.EditsTime += TimeHierarchyUpdate(hierarchies[run], edits[repeat], localMatrices, jobSystems[run], time.EditsUpdated);
+			time.NoChangeTime += TimeHierarchyUpdate(hierarchies[run], noChanges, localMatrices, jobSystems[run], time.NoChangeUpdated);
+		}
+	}
+
+	// Reference world matrices - parents were always added before their children
+	vector<gen::CMatrix4x4> worldMatrices(HierarchyBenchmarkNodes);
+	unsigned int numWrong[2] = { 0, 0 };
+	for (unsigned int node = 0; node < HierarchyBenchmarkNodes; node++)
+	{
+		worldMatrices[node] = (parents[node] == gen::CTransformHierarchy::kNoParent) ? localMatrices[node] :
+		                      gen::MultiplyAffine(localMatrices[node], worldMatrices[parents[node]]);
+		for (unsigned int run = 0; run < 2; run++)
+		{
+			if (memcmp(&hierarchies[run].GetWorldMatrix(node), &worldMatrices[node], sizeof(gen::CMatrix4x4)) != 0)
+			{
+				numWrong[run]++;
+			}
+		}
+	}
+
+	file << HierarchyBenchmarkNodes << " nodes, " << HierarchyBenchmarkRoots << " roots\n";
+	file << "Average update times over " << HierarchyBenchmarkRepeats << " runs (ms)\n";
+	for (unsigned int run = 0; run < 2; run++)
+	{
+		const SHierarchyTimes& time = times[run];
+		if (run == 0)
+		{
+			file << "  single thread\n";
+		}
+		else
+		{
+			file << "  " << jobs.GetNumThreads() << " threads\n";
+		}
+		file << "    full update:           " << time.FullTime / HierarchyBenchmarkRepeats << "  (" << time.FullUpdated << " nodes)\n";
+		file << "    after " << HierarchyBenchmarkEdits << " edits:       " << time.EditsTime / HierarchyBenchmarkRepeats << "  ("
+		     << time.EditsUpdated << " nodes)\n";
+		file << "    no changes:            " << time.NoChangeTime / HierarchyBenchmarkRepeats << "  (" << time.NoChangeUpdated << " nodes)\n";
+		if (numWrong[run] > 0)
+		{
+			file << "ERROR: " << numWrong[run] << " world matrices differ from the reference\n";
+		}
+	}
+	return !file.fail() && numWrong[0] == 0 && numWrong[1] == 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Transform Store
+//--------------------------------------------------------------------------------------
+
+// Objects are scattered at random around the camera and a tenth of them move each frame, from the same seed each run. They are
+// updated and culled both as separately allocated objects holding their own transform and bounds (as models did before the
+// transform store), visited in shuffled order as if spread through the heap, and through a transform store. The caches are
+// flushed before each pass by writing to a buffer larger than them
+const unsigned int TransformBenchmarkObjects = 100000;
+const unsigned int TransformBenchmarkFrames = 20;
+const unsigned int TransformBenchmarkMoveFraction = 10; // One in this many objects moves each frame
+const float        TransformBenchmarkSpread = 1000.0f;
+const unsigned int TransformBenchmarkFlushSize = 32 * 1024 * 1024;
+const unsigned int AoSObjectSize = 816;                 // Size of a model before the transform store
+
+// Transform and bounds data of an object without the transform store
+struct SAoSTransform
+{
+	unsigned int    Id;
+	gen::CVector3   Position, Rotation, Scale;
+	gen::CMatrix4x4 Matrix;
+	bool            MatrixDirty, BoundsDirty;
+	gen::CAABB      LocalBox, WorldBox;
+	gen::CSphere    LocalSphere, WorldSphere;
+};
+
+// Object without the transform store - the transform is surrounded by render data (buffers, material and so on), represented
+// here by padding
+struct SAoSObject
+{
+	SAoSTransform Transform;
+	char          RenderData[AoSObjectSize - sizeof(SAoSTransform)];
+};
+
+// Write to every cache line of the given buffer, so the next pass starts with none of its data cached
+void FlushCaches(vector<char>& buffer)
+{
+	for (unsigned int i = 0; i < buffer.size(); i += 64)
+	{
+		buffer[i]++;
+	}
+}
+
+// Run the transform store benchmark, timing the matrix, bounds and culling passes over separately allocated objects and over a
+// transform store, and write the results to the given text file. Returns false if the file could not be written or the two
+// layouts gave different results
+bool RunTransformBenchmark(const char* fileName)
+{
+	CCamera camera(D3DXVECTOR3(0.0f, 0.0f, 0.0f), D3DXVECTOR3(0.0f, 0.0f, 0.0f));
+	camera.UpdateMatrices();
+	const gen::CFrustum& frustum = camera.GetFrustum();
+
+	ofstream file(fileName);
+	if (!file)
+	{
+		return false;
+	}
+
+	// Same objects in both layouts
+	srand(TransformBenchmarkObjects);
+	vector<SAoSObject*> objects(TransformBenchmarkObjects);
+	gen::CTransformStore store;
+	vector<gen::TUInt32> handles(TransformBenchmarkObjects);
+	store.Reserve(TransformBenchmarkObjects);
+	for (unsigned int i = 0; i < TransformBenchmarkObjects; i++)
+	{
+		SAoSTransform& object = (objects[i] = new SAoSObject)->Transform;
+		object.Id = i;
+		object.Position = gen::CVector3(gen::Random(-TransformBenchmarkSpread, TransformBenchmarkSpread),
+		                                gen::Random(-TransformBenchmarkSpread, TransformBenchmarkSpread),
+		                                gen::Random(-TransformBenchmarkSpread, TransformBenchmarkSpread));
+		object.Rotation = gen::CVector3(gen::Random(-gen::kfPi, gen::kfPi), gen::Random(-gen::kfPi, gen::kfPi), gen::Random(-gen::kfPi, gen::kfPi));
+		object.Scale = gen::CVector3::kOne;
+		object.LocalBox = gen::CAABB(gen::CVector3(-1.0f, 0.0f, -1.0f), gen::CVector3(1.0f, gen::Random(1.0f, 4.0f), 1.0f));
+		object.LocalSphere = object.LocalBox.GetBoundingSphere();
+		object.MatrixDirty = true;
+		handles[i] = store.Add(object.Position, object.Rotation, object.Scale);
+		store.SetLocalBounds(handles[i], object.LocalBox, object.LocalSphere);
+	}
+	vector<unsigned int> handleIds(TransformBenchmarkObjects);
+	for (unsigned int i = 0; i < TransformBenchmarkObjects; i++)
+	{
+		handleIds[handles[i]] = i;
+	}
+
+	// Shuffle the order the separate objects are visited in
+	vector<SAoSObject*> visitOrder(objects);
+	for (unsigned int i = TransformBenchmarkObjects - 1; i > 0; i--)
+	{
+		swap(visitOrder[i], visitOrder[RandomIndex(i + 1)]);
+	}
+
+	vector<char> flushBuffer(TransformBenchmarkFlushSize);
+	vector<unsigned int> aosVisible, storeVisible;
+	float aosMatrices = 0.0f, aosBounds = 0.0f, aosCull = 0.0f;
+	float storeMatrices = 0.0f, storeBounds = 0.0f, storeCull = 0.0f;
+	CTimer timer;
+	timer.Start();
+	for (unsigned int frame = 0; frame <= TransformBenchmarkFrames; frame++)
+	{
+		// Move some objects, except in the first frame where everything is new
+		if (frame > 0)
+		{
+			for (unsigned int i = frame % TransformBenchmarkMoveFraction; i < TransformBenchmarkObjects; i += TransformBenchmarkMoveFraction)
+			{
+				SAoSTransform& object = objects[i]->Transform;
+				object.Position.y += gen::Random(-1.0f, 1.0f);
+				object.MatrixDirty = true;
+				store.SetPosition(handles[i], object.Position);
+			}
+		}
+
+		// Separate objects
+		FlushCaches(flushBuffer);
+		timer.GetLapTime();
+		for (unsigned int i = 0; i < TransformBenchmarkObjects; i++)
+		{
+			SAoSTransform& object = visitOrder[i]->Transform;
+			if (object.MatrixDirty)
+			{
+				object.Matrix.MakeAffineEuler(object.Position, object.Rotation, gen::kZXY, object.Scale);
+				object.MatrixDirty = false;
+				object.BoundsDirty = true;
+			}
+		}
+		float matricesTime = timer.GetLapTime();
+		FlushCaches(flushBuffer);
+		timer.GetLapTime();
+		for (unsigned int i = 0; i < TransformBenchmarkObjects; i++)
+		{
+			SAoSTransform& object = visitOrder[i]->Transform;
+			if (object.BoundsDirty)
+			{
+				object.WorldBox = object.LocalBox.Transform(object.Matrix);
+				object.WorldSphere = object.LocalSphere.Transform(object.Matrix);
+				object.BoundsDirty = false;
+			}
+		}
+		float boundsTime = timer.GetLapTime();
+		FlushCaches(flushBuffer);
+		timer.GetLapTime();
+		aosVisible.clear();
+		for (unsigned int i = 0; i < TransformBenchmarkObjects; i++)
+		{
+			const SAoSTransform& object = visitOrder[i]->Transform;
+			if (frustum.Test(object.WorldBox) != gen::kOutside)
+			{
+				aosVisible.push_back(object.Id);
+			}
+		}
+		float cullTime = timer.GetLapTime();
+		if (frame > 0)
+		{
+			aosMatrices += matricesTime;
+			aosBounds += boundsTime;
+			aosCull += cullTime;
+		}
+
+		// Transform store
+		FlushCaches(flushBuffer);
+		timer.GetLapTime();
+		store.UpdateMatrices();
+		matricesTime = timer.GetLapTime();
+		FlushCaches(flushBuffer);
+		timer.GetLapTime();
+		store.UpdateBounds();
+		boundsTime = timer.GetLapTime();
+		FlushCaches(flushBuffer);
+		timer.GetLapTime();
+		storeVisible.clear();
+		const gen::CAABB* worldBoxes = store.GetWorldBoxes();
+		for (unsigned int index = 0; index < TransformBenchmarkObjects; index++)
+		{
+			if (frustum.Test(worldBoxes[index]) != gen::kOutside)
+			{
+				storeVisible.push_back(handleIds[store.GetHandle(index)]);
+			}
+		}
+		cullTime = timer.GetLapTime();
+		if (frame > 0)
+		{
+			storeMatrices += matricesTime;
+			storeBounds += boundsTime;
+			storeCull += cullTime;
+		}
+	}
+
+	// Compare the final state of the two layouts
+	sort(aosVisible.begin(), aosVisible.end());
+	sort(storeVisible.begin(), storeVisible.end());
+	unsigned int numWrong = 0;
+	for (unsigned int i = 0; i < TransformBenchmarkObjects; i++)
+	{
+		if (memcmp(&objects[i]->Transform.WorldBox, &store.GetWorldBox(handles[i]), sizeof(gen::CAABB)) != 0)
+		{
+			numWrong++;
+		}
+		delete objects[i];
+	}
+	bool resultsMatch = numWrong == 0 && aosVisible == storeVisible;
+
+	const float toAverageMs = 1000.0f / TransformBenchmarkFrames;
+	file << TransformBenchmarkObjects << " objects, 1 in " << TransformBenchmarkMoveFraction << " moving each frame, caches flushed before each pass\n";
+	file << "Average times over " << TransformBenchmarkFrames << " frames (ms)\n";
+	file << "  separate objects (" << AoSObjectSize << " bytes)  matrices: " << aosMatrices * toAverageMs << "  bounds: "
+	     << aosBounds * toAverageMs << "  cull: " << aosCull * toAverageMs << "\n";
+	file << "  transform store              matrices: " << storeMatrices * toAverageMs << "  bounds: " << storeBounds * toAverageMs
+	     << "  cull: " << storeCull * toAverageMs << "\n";
+	file << "Visible: " << storeVisible.size() << "\n";
+	if (!resultsMatch)
+	{
+		file << "ERROR: " << numWrong << " world boxes differ, separate objects found " << aosVisible.size() << " visible\n";
+	}
+	return !file.fail() && resultsMatch;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Job System
+//--------------------------------------------------------------------------------------
+
+// The frame update of a large scene - matrices, hierarchy and bounds - is run on this thread alone, then on job systems with an
+// increasing number of threads. Each run rebuilds the scene and makes the same moves, and must end with exactly the same world
+// bounds as the run without jobs
+const unsigned int JobBenchmarkRoots = 25000;
+const unsigned int JobBenchmarkChildren = 3;          // Children of each root
+const unsigned int JobBenchmarkMoveFraction = 5;      // One in this many transforms moves each frame
+const unsigned int JobBenchmarkFrames = 20;
+const unsigned int JobBenchmarkMinThreads = 4;        // Highest thread count tried, if there are fewer hardware threads
+
+// Scene for the job system benchmark - a transform store linked to a hierarchy
+struct SJobBenchmarkScene
+{
+	gen::CTransformHierarchy Hierarchy;
+	gen::CTransformStore     Store;
+	vector<gen::TUInt32>     Handles;
+};
+
+// Fill the benchmark scene with roots spread over a grid, each with children around it
+void BuildJobBenchmarkScene(SJobBenchmarkScene& scene)
+{
+	const unsigned int gridSize = static_cast<unsigned int>(sqrt(static_cast<float>(JobBenchmarkRoots))) + 1;
+	const gen::CAABB localBox(gen::CVector3(-1.0f, 0.0f, -1.0f), gen::CVector3(1.0f, 2.0f, 1.0f));
+	scene.Store.SetHierarchy(&scene.Hierarchy);
+	scene.Store.Reserve(JobBenchmarkRoots * (1 + JobBenchmarkChildren));
+	for (unsigned int root = 0; root < JobBenchmarkRoots; root++)
+	{
+		gen::TUInt32 parentNode = gen::CTransformHierarchy::kNoParent;
+		for (unsigned int i = 0; i <= JobBenchmarkChildren; i++)
+		{
+			gen::CVector3 position = (i == 0) ? gen::CVector3(10.0f * (root % gridSize), 0.0f, 10.0f * (root / gridSize)) :
+			                                    gen::CVector3(2.0f * i, 0.0f, 0.0f);
+			gen::TUInt32 handle = scene.Store.Add(position, gen::CVector3(0.0f, 0.5f * i, 0.0f));
+			scene.Store.SetLocalBounds(handle, localBox, localBox.GetBoundingSphere());
+			scene.Store.UpdateMatrix(handle);
+			gen::TUInt32 node = scene.Hierarchy.AddNode(scene.Store.GetMatrix(handle), parentNode);
+			scene.Store.SetHierarchyNode(handle, node, node);
+			scene.Handles.push_back(handle);
+			if (i == 0)
+			{
+				parentNode = node;
+			}
+		}
+	}
+}
+
+// Run the frames of the job system benchmark on a new scene, adding the time taken by each pass (ms) and returning the world
+// boxes at the end
+void RunJobBenchmarkFrames(gen::CJobSystem* jobs, vector<gen::CAABB>& worldBoxes, float& matricesTime, float& hierarchyTime,
+                           float& boundsTime)
+{
+	SJobBenchmarkScene scene;
+	BuildJobBenchmarkScene(scene);
+	scene.Store.UpdateMatrices(jobs);
+	scene.Hierarchy.Update(jobs);
+	scene.Store.UpdateBounds(jobs);
+
+	const unsigned int numTransforms = static_cast<unsigned int>(scene.Handles.size());
+	CTimer timer;
+	timer.Start();
+	for (unsigned int frame = 0; frame < JobBenchmarkFrames; frame++)
+	{
+		// Roots and children both move, so some changes are inside subtrees that are also changed from above
+		for (unsigned int i = frame % JobBenchmarkMoveFraction; i < numTransforms; i += JobBenchmarkMoveFraction)
+		{
+			gen::TUInt32 handle = scene.Handles[i];
+			scene.Store.SetPosition(handle, scene.Store.GetPosition(handle) + gen::CVector3(0.0f, 0.1f, 0.0f));
+			scene.Store.SetRotation(handle, scene.Store.GetRotation(handle) + gen::CVector3(0.0f, 0.01f, 0.0f));
+		}
+
+		timer.GetLapTime();
+		scene.Store.UpdateMatrices(jobs);
+		matricesTime += timer.GetLapTime() * 1000.0f;
+		scene.Hierarchy.Update(jobs);
+		hierarchyTime += timer.GetLapTime() * 1000.0f;
+		scene.Store.UpdateBounds(jobs);
+		boundsTime += timer.GetLapTime() * 1000.0f;
+	}
+
+	worldBoxes.resize(numTransforms);
+	for (unsigned int i = 0; i < numTransforms; i++)
+	{
+		worldBoxes[i] = scene.Store.GetWorldBox(scene.Handles[i]);
+	}
+}
+
+// Run the job system benchmark, timing the frame update of a large scene with different numbers of threads, and write the results
+// to the given text file. Returns false if the file could not be written or any run gave different results
+bool RunJobBenchmark(const char* fileName)
+{
+	ofstream file(fileName);
+	if (!file)
+	{
+		return false;
+	}
+	file << JobBenchmarkRoots * (1 + JobBenchmarkChildren) << " transforms (" << JobBenchmarkRoots << " roots with " << JobBenchmarkChildren
+	     << " children), 1 in " << JobBenchmarkMoveFraction << " moving each frame\n";
+	file << "Average times over " << JobBenchmarkFrames << " frames (ms)\n";
+
+	// Run without jobs first, for the results to compare with
+	vector<gen::CAABB> expectedBoxes, worldBoxes;
+	float matricesTime = 0.0f, hierarchyTime = 0.0f, boundsTime = 0.0f;
+	RunJobBenchmarkFrames(NULL, expectedBoxes, matricesTime, hierarchyTime, boundsTime);
+	file << "  no jobs     matrices: " << matricesTime / JobBenchmarkFrames << "  hierarchy: " << hierarchyTime / JobBenchmarkFrames
+	     << "  bounds: " << boundsTime / JobBenchmarkFrames << "  total: " << (matricesTime + hierarchyTime + boundsTime) / JobBenchmarkFrames << "\n";
+
+	unsigned int hardwareThreads;
+	{
+		gen::CJobSystem jobs;
+		hardwareThreads = jobs.GetNumThreads();
+	}
+	const unsigned int maxThreads = gen::Max(hardwareThreads, JobBenchmarkMinThreads);
+	bool resultsMatch = true;
+	for (unsigned int numThreads = 1; numThreads <= maxThreads; numThreads++)
+	{
+		gen::CJobSystem jobs(numThreads);
+		matricesTime = hierarchyTime = boundsTime = 0.0f;
+		RunJobBenchmarkFrames(&jobs, worldBoxes, matricesTime, hierarchyTime, boundsTime);
+		file << "  " << numThreads << (numThreads == 1 ? " thread    " : " threads   ") << "matrices: " << matricesTime / JobBenchmarkFrames
+		     << "  hierarchy: " << hierarchyTime / JobBenchmarkFrames << "  bounds: " << boundsTime / JobBenchmarkFrames << "  total: "
+		     << (matricesTime + hierarchyTime + boundsTime) / JobBenchmarkFrames << "\n";
+		if (memcmp(&worldBoxes[0], &expectedBoxes[0], expectedBoxes.size() * sizeof(gen::CAABB)) != 0)
+		{
+			file << "ERROR: world bounds with " << numThreads << " threads differ from the run without jobs\n";
+			resultsMatch = false;
+		}
+	}
+	file << "Hardware threads: " << hardwareThreads << "\n";
+	return !file.fail() && resultsMatch;
+}
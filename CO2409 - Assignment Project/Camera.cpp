@@ -6,6 +6,7 @@
 
 #include "Defines.h" // General definitions shared by all source files
 #include "Camera.h"  // Declaration of this class
+#include "MathDX.h"  // Conversions between math classes and DirectX types
 
 ///////////////////////////////
 // Constructors / Destructors
@@ -14,32 +15,65 @@
 CCamera::CCamera( D3DXVECTOR3 position, D3DXVECTOR3 rotation, float fov, float nearClip, float farClip )
 {
 	m_Position = position;
-	m_Rotation = rotation;
-	UpdateMatrices();
-
+	m_UseQuaternion = false;
+	SetRotation( rotation );
 	SetFOV( fov );
 	SetNearClip( nearClip );
 	SetFarClip( farClip );
+	UpdateMatrices();
 }
 
 
 ///////////////////////////////
 // Camera Usage
 
+// Select whether the camera's orientation is held as Euler angles (default) or a quaternion
+void CCamera::SetUseQuaternion( bool useQuaternion )
+{
+	if (useQuaternion == m_UseQuaternion)
+	{
+		return;
+	}
+
+	// Convert the current orientation to the new representation so the camera doesn't jump
+	if (useQuaternion)
+	{
+		m_Orientation = gen::QuaternionRotation(gen::CVector3(m_Rotation), gen::kZXY);
+	}
+	else
+	{
+		UpdateMatrices();
+		gen::ToCMatrix4x4(m_WorldMatrix).DecomposeAffineEuler(NULL, gen::ToCVector3Ptr(&m_Rotation), NULL);
+	}
+	m_UseQuaternion = useQuaternion;
+	m_MatricesDirty = true;
+}
+
 // Update the matrices used for the camera in the rendering pipeline. Treat the camera like a model and create a world matrix for it. Then convert that into
 // the view matrix that the rendering pipeline actually uses. Also create the projection matrix, a second matrix that only cameras have
 void CCamera::UpdateMatrices()
 {
-	// Make matrices for position and rotations, then multiply together to get a "camera world matrix"
-	D3DXMATRIX matrixXRot, matrixYRot, matrixZRot, matrixTranslation;
-	D3DXMatrixRotationX( &matrixXRot, m_Rotation.x );
-	D3DXMatrixRotationY( &matrixYRot, m_Rotation.y );
-	D3DXMatrixRotationZ( &matrixZRot, m_Rotation.z );
-	D3DXMatrixTranslation( &matrixTranslation, m_Position.x, m_Position.y, m_Position.z);
-	m_WorldMatrix = matrixZRot * matrixXRot * matrixYRot * matrixTranslation;
+	if (!m_MatricesDirty)
+	{
+		g_TransformStats.CameraMatrices.Skipped++;
+		return;
+	}
 
-	// The rendering pipeline actually needs the inverse of the camera world matrix - called the view matrix. Creating an inverse is easy with DirectX:
-	D3DXMatrixInverse( &m_ViewMatrix, NULL, &m_WorldMatrix );
+	// Build the "camera world matrix" directly from position and rotations - same result as ZRot * XRot * YRot * Translation
+	gen::CMatrix4x4& worldMatrix = gen::ToCMatrix4x4(m_WorldMatrix);
+	if (m_UseQuaternion)
+	{
+		worldMatrix.MakeAffineQuaternion(m_Orientation, gen::ToCVector3(m_Position));
+	}
+	else
+	{
+		worldMatrix.MakeAffineEuler(gen::ToCVector3(m_Position), gen::ToCVector3(m_Rotation), gen::kZXY);
+	}
+
+	// The rendering pipeline actually needs the inverse of the camera world matrix - called the view matrix. The camera world matrix
+	// only contains rotation and translation, so the inverse is a simple transpose of the rotation and a transformed translation,
+	// much cheaper than a general matrix inverse
+	gen::ToCMatrix4x4(m_ViewMatrix) = gen::InverseRotTrans(worldMatrix);
 
 	// Initialize the projection matrix. This determines viewing properties of the camera such as field of view (FOV) and near clip distance
 	// One other factor in the projection matrix is the aspect ratio of screen (width/height) - used to adjust FOV between horizontal and vertical
@@ -48,6 +82,12 @@ void CCamera::UpdateMatrices()
 
 	// Combine the view and projection matrix into a single matrix - which can (optionally) be used in the vertex shaders to save one matrix multiply per vertex
 	m_ViewProjMatrix = m_ViewMatrix * m_ProjMatrix;
+
+	// Frustum planes for culling also come from the view-projection matrix
+	m_Frustum.Set(gen::ToCMatrix4x4(m_ViewProjMatrix));
+
+	m_MatricesDirty = false;
+	g_TransformStats.CameraMatrices.Updated++;
 }
 
 
@@ -55,21 +95,42 @@ void CCamera::UpdateMatrices()
 void CCamera::Control( float frameTime, EKeyCode turnUp, EKeyCode turnDown, EKeyCode turnLeft, EKeyCode turnRight,  
 					   EKeyCode moveForward, EKeyCode moveBackward, EKeyCode moveLeft, EKeyCode moveRight)
 {
+	// Amount of rotation around each axis this frame
+	float rotationX = 0.0f;
+	float rotationY = 0.0f;
 	if (KeyHeld( turnDown ))
 	{
-		m_Rotation.x += RotSpeed * frameTime;
+		rotationX += RotSpeed * frameTime;
 	}
 	if (KeyHeld( turnUp ))
 	{
-		m_Rotation.x -= RotSpeed * frameTime;
+		rotationX -= RotSpeed * frameTime;
 	}
 	if (KeyHeld( turnRight ))
 	{
-		m_Rotation.y += RotSpeed * frameTime;
+		rotationY += RotSpeed * frameTime;
 	}
 	if (KeyHeld( turnLeft ))
 	{
-		m_Rotation.y -= RotSpeed * frameTime;
+		rotationY -= RotSpeed * frameTime;
+	}
+
+	if (m_UseQuaternion)
+	{
+		// Match the Euler control - pitch around the camera's local X axis (pre-multiply), yaw around the world Y axis
+		// (post-multiply) so the horizon stays level. Renormalise to prevent drift building up over many frames
+		if (rotationX != 0.0f) m_Orientation = gen::QuaternionRotationX( rotationX ) * m_Orientation;
+		if (rotationY != 0.0f) m_Orientation = m_Orientation * gen::QuaternionRotationY( rotationY );
+		m_Orientation.Normalise();
+	}
+	else
+	{
+		m_Rotation.x += rotationX;
+		m_Rotation.y += rotationY;
+	}
+	if (rotationX != 0.0f || rotationY != 0.0f)
+	{
+		m_MatricesDirty = true;
 	}
 
 	// Local X movement - move in the direction of the X axis, get axis from camera's "world" matrix
@@ -78,12 +139,14 @@ void CCamera::Control( float frameTime, EKeyCode turnUp, EKeyCode turnDown, EKey
 		m_Position.x += m_WorldMatrix._11 * MoveSpeed * frameTime;
 		m_Position.y += m_WorldMatrix._12 * MoveSpeed * frameTime;
 		m_Position.z += m_WorldMatrix._13 * MoveSpeed * frameTime;
+		m_MatricesDirty = true;
 	}
 	if (KeyHeld( moveLeft ))
 	{
 		m_Position.x -= m_WorldMatrix._11 * MoveSpeed * frameTime;
 		m_Position.y -= m_WorldMatrix._12 * MoveSpeed * frameTime;
 		m_Position.z -= m_WorldMatrix._13 * MoveSpeed * frameTime;
+		m_MatricesDirty = true;
 	}
 
 	// Local Z movement - move in the direction of the Z axis, get axis from view matrix
@@ -92,11 +155,13 @@ void CCamera::Control( float frameTime, EKeyCode turnUp, EKeyCode turnDown, EKey
 		m_Position.x += m_WorldMatrix._31 * MoveSpeed * frameTime;
 		m_Position.y += m_WorldMatrix._32 * MoveSpeed * frameTime;
 		m_Position.z += m_WorldMatrix._33 * MoveSpeed * frameTime;
+		m_MatricesDirty = true;
 	}
 	if (KeyHeld( moveBackward ))
 	{
 		m_Position.x -= m_WorldMatrix._31 * MoveSpeed * frameTime;
 		m_Position.y -= m_WorldMatrix._32 * MoveSpeed * frameTime;
 		m_Position.z -= m_WorldMatrix._33 * MoveSpeed * frameTime;
+		m_MatricesDirty = true;
 	}
 }
@@ -8,6 +8,8 @@
 #define CAMERA_H_INCLUDED
 
 #include "Input.h"
+#include "CQuaternion.h"
+#include "CFrustum.h"
 
 //-----------------------------------------------------------------------------
 // DirectX Camera Class Defintition
@@ -23,6 +25,10 @@ private:
 	D3DXVECTOR3 m_Position;
 	D3DXVECTOR3 m_Rotation;
 
+	// Optional quaternion orientation - used instead of the Euler angles in m_Rotation when m_UseQuaternion is set
+	gen::CQuaternion m_Orientation;
+	bool             m_UseQuaternion;
+
 	// Camera settings: field of view, near and far clip plane distances. Note that the FOV angle is measured in radians (radians = degrees * PI/180)
 	float m_FOV;
 	float m_NearClip;
@@ -34,6 +40,12 @@ private:
 	D3DXMATRIX m_ProjMatrix;     // Projection matrix to set field of view and near/far clip distances
 	D3DXMATRIX m_ViewProjMatrix; // Combine (multiply) the view and projection matrices together - saves a matrix multiply in the shader (optional optimisation)
 
+	// Frustum planes in world space, from the view-projection matrix
+	gen::CFrustum m_Frustum;
+
+	// The matrices above are only rebuilt when a setter or control function has changed the camera since the last update
+	bool m_MatricesDirty;
+
 
 /////////////////////////////
 // Public member functions
@@ -54,23 +66,35 @@ public:
 	{
 		return m_Position;
 	}
-	D3DXVECTOR3 GetRotation()
+	D3DXVECTOR3 GetRotation() // Euler angles - not kept up to date when using a quaternion orientation
 	{
 		return m_Rotation;
 	}
+	gen::CQuaternion GetOrientation()
+	{
+		return m_Orientation;
+	}
+	bool UsesQuaternion()
+	{
+		return m_UseQuaternion;
+	}
 
-	D3DXMATRIX GetViewMatrix()
+	const D3DXMATRIX& GetViewMatrix()
 	{
 		return m_ViewMatrix;
 	}
-	D3DXMATRIX GetProjectionMatrix()
+	const D3DXMATRIX& GetProjectionMatrix()
 	{
 		return m_ProjMatrix;
 	}
-	D3DXMATRIX GetViewProjectionMatrix()
+	const D3DXMATRIX& GetViewProjectionMatrix()
 	{
 		return m_ViewProjMatrix;
 	}
+	const gen::CFrustum& GetFrustum()
+	{
+		return m_Frustum;
+	}
 
 	float GetFOV()
 	{
@@ -90,29 +114,45 @@ public:
 	void SetPosition( D3DXVECTOR3 position )
 	{
 		m_Position = position;
+		m_MatricesDirty = true;
 	}
 	void SetRotation( D3DXVECTOR3 rotation )
 	{
 		m_Rotation = rotation;
+		m_Orientation = gen::QuaternionRotation(gen::CVector3(rotation), gen::kZXY); // Keep quaternion in step in case it is in use
+		m_MatricesDirty = true;
+	}
+	void SetOrientation( const gen::CQuaternion& orientation ) // Also switches the camera to quaternion orientation
+	{
+		m_Orientation = orientation;
+		m_UseQuaternion = true;
+		m_MatricesDirty = true;
 	}
 	void SetFOV( float fov )
 	{
 		m_FOV = fov;
+		m_MatricesDirty = true;
 	}
 	void SetNearClip( float nearClip )
 	{
 		m_NearClip = nearClip;
+		m_MatricesDirty = true;
 	}
 	void SetFarClip( float farClip )
 	{
 		m_FarClip = farClip;
+		m_MatricesDirty = true;
 	}
 
 
 	/////////////////////////////
 	// Camera Usage
 
-	// Update the matrices used for the camera in the rendering pipeline
+	// Select whether the camera's orientation is held as Euler angles (default) or a quaternion. Switching from quaternion
+	// back to Euler angles recovers the angles from the current world matrix
+	void SetUseQuaternion( bool useQuaternion );
+
+	// Update the matrices used for the camera in the rendering pipeline. Does nothing if the camera hasn't changed since the last update
 	void UpdateMatrices();
 
 	// Control the camera's position and rotation using keys provided
@@ -0,0 +1,504 @@
+//--------------------------------------------------------------------------------------
+//	D3D10Backend.cpp
+//
+//	The D3D10 backend renders through a Direct3D 10 device, with the techniques' effects
+//	providing the shaders, states and the variables that textures and constants go to
+//--------------------------------------------------------------------------------------
+
+#include <string.h> // memcpy
+
+#include "D3D10Backend.h"		// Declaration of this class
+#include "Technique.h"
+#include "InputLayoutCache.h"	// Vertex layouts shared between models and techniques
+
+// Name of the effect variable for each texture slot, in the order of ETextureSlot
+const char* TextureVariableNames[NumTextureSlots] = { "DiffuseMap", "NormalMap", "CelGradient", "SpotLight1ShadowMap" };
+
+// Name of each group's cbuffer in the effect file, in the order of EConstantGroup
+const char* ConstantBufferNames[NumConstantGroups] = { "PerFrame", "PerLightSet", "PerMaterial", "PerObject" };
+
+
+///////////////////////////////
+// Constructors / Destructors
+
+CD3D10Backend::CD3D10Backend()
+{
+	m_Device = NULL;
+	m_SwapChain = NULL;
+	m_RenderTargetView = NULL;
+	m_DepthStencil = NULL;
+	m_DepthStencilView = NULL;
+	m_TargetColourView = NULL;
+	m_TargetDepthView = NULL;
+	for (unsigned int slot = 0; slot < NumTextureSlots; slot++)
+	{
+		m_TextureVars[slot] = NULL;
+	}
+	for (unsigned int group = 0; group < NumConstantGroups; group++)
+	{
+		m_ConstantVars[group] = NULL;
+		m_ConstantBuffers[group] = NULL;
+		m_ConstantSizes[group] = 0;
+	}
+}
+
+CD3D10Backend::~CD3D10Backend()
+{
+	Release();
+}
+
+
+/////////////////////////////
+// Setup
+
+// Create the device, and a swap chain and depth buffer of the given size for the window. Returns false on failure
+bool CD3D10Backend::Create(HWND hWnd, unsigned int width, unsigned int height)
+{
+	Release();
+
+	// Create a Direct3D device (i.e. initialise D3D), and create a swap-chain (create a back buffer to render to)
+	DXGI_SWAP_CHAIN_DESC sd;         // Structure to contain all the information needed
+	ZeroMemory( &sd, sizeof( sd ) ); // Clear the structure to 0 - common Microsoft practice, not really good style
+	sd.BufferCount = 1;
+	sd.BufferDesc.Width = width;                       // Target window size
+	sd.BufferDesc.Height = height;                     // --"--
+	sd.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM; // Pixel format of target window
+	sd.BufferDesc.RefreshRate.Numerator = 60;          // Refresh rate of monitor
+	sd.BufferDesc.RefreshRate.Denominator = 1;         // --"--
+	sd.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+	sd.SampleDesc.Count = 1;
+	sd.SampleDesc.Quality = 0;
+	sd.OutputWindow = hWnd;                            // Target window
+	sd.Windowed = TRUE;                                // Whether to render in a window (TRUE) or go fullscreen (FALSE)
+	if (FAILED( D3D10CreateDeviceAndSwapChain( NULL, D3D10_DRIVER_TYPE_HARDWARE, NULL, 0, D3D10_SDK_VERSION, &sd, &m_SwapChain,
+	                                           &m_Device ) ))
+	{
+		m_SwapChain = NULL;
+		m_Device = NULL;
+		return false;
+	}
+	g_InputLayoutCache.SetDevice( m_Device );
+
+	// Specify the render target as the back-buffer - this is an advanced topic. This code almost always occurs in the standard D3D setup
+	ID3D10Texture2D* backBuffer;
+	if (FAILED( m_SwapChain->GetBuffer( 0, __uuidof( ID3D10Texture2D ), ( LPVOID* )&backBuffer ) ))
+	{
+		return false;
+	}
+	HRESULT hr = m_Device->CreateRenderTargetView( backBuffer, NULL, &m_RenderTargetView );
+	backBuffer->Release();
+	if (FAILED( hr ))
+	{
+		m_RenderTargetView = NULL;
+		return false;
+	}
+
+	// Create a texture (bitmap) to use for a depth buffer
+	D3D10_TEXTURE2D_DESC descDepth;
+	descDepth.Width = width;
+	descDepth.Height = height;
+	descDepth.MipLevels = 1;
+	descDepth.ArraySize = 1;
+	descDepth.Format = DXGI_FORMAT_D32_FLOAT;
+	descDepth.SampleDesc.Count = 1;
+	descDepth.SampleDesc.Quality = 0;
+	descDepth.Usage = D3D10_USAGE_DEFAULT;
+	descDepth.BindFlags = D3D10_BIND_DEPTH_STENCIL;
+	descDepth.CPUAccessFlags = 0;
+	descDepth.MiscFlags = 0;
+	if (FAILED( m_Device->CreateTexture2D( &descDepth, NULL, &m_DepthStencil ) ))
+	{
+		m_DepthStencil = NULL;
+		return false;
+	}
+
+	// Create the depth stencil view, i.e. indicate that the texture just created is to be used as a depth buffer
+	D3D10_DEPTH_STENCIL_VIEW_DESC descDSV;
+	descDSV.Format = descDepth.Format;
+	descDSV.ViewDimension = D3D10_DSV_DIMENSION_TEXTURE2D;
+	descDSV.Texture2D.MipSlice = 0;
+	if (FAILED( m_Device->CreateDepthStencilView( m_DepthStencil, &descDSV, &m_DepthStencilView ) ))
+	{
+		m_DepthStencilView = NULL;
+		return false;
+	}
+
+	// Select the back buffer and depth buffer, and the whole window, to render to now
+	SetRenderTarget( NULL );
+	SetViewport( width, height );
+	return true;
+}
+
+// Release everything created by the backend, after the rendering code has released its buffers and textures
+void CD3D10Backend::Release()
+{
+	if (m_Device)  m_Device->ClearState();
+	ReleaseEffectVariables();
+
+	// The layouts are released with the device they were created on
+	if (m_Device)  g_InputLayoutCache.SetDevice( NULL );
+
+	m_TargetColourView = NULL;
+	m_TargetDepthView = NULL;
+	SAFE_RELEASE( m_DepthStencilView );
+	SAFE_RELEASE( m_RenderTargetView );
+	SAFE_RELEASE( m_DepthStencil );
+	SAFE_RELEASE( m_SwapChain );
+	SAFE_RELEASE( m_Device );
+}
+
+// Connect the texture slots and constant groups to the variables of the effect that every technique shares variables with, or NULL
+// to disconnect them. Returns false if the effect is missing any of the variables
+bool CD3D10Backend::SetSharedEffect(ID3D10Effect* effect)
+{
+	ReleaseEffectVariables();
+	if (!effect)
+	{
+		return true;
+	}
+
+	// The effect returns invalid variables rather than NULL for names it doesn't have
+	for (unsigned int slot = 0; slot < NumTextureSlots; slot++)
+	{
+		m_TextureVars[slot] = effect->GetVariableByName( TextureVariableNames[slot] )->AsShaderResource();
+		if (!m_TextureVars[slot]->IsValid())
+		{
+			ReleaseEffectVariables();
+			return false;
+		}
+	}
+	for (unsigned int group = 0; group < NumConstantGroups; group++)
+	{
+		m_ConstantVars[group] = effect->GetConstantBufferByName( ConstantBufferNames[group] );
+		if (!m_ConstantVars[group]->IsValid())
+		{
+			ReleaseEffectVariables();
+			return false;
+		}
+	}
+	return true;
+}
+
+
+/////////////////////////////
+// Buffers
+
+TBufferHandle CD3D10Backend::CreateBuffer(EBufferType type, unsigned int size, const void* data)
+{
+	D3D10_BUFFER_DESC bufferDesc;
+	bufferDesc.BindFlags = (type == BufferIndex) ? D3D10_BIND_INDEX_BUFFER : D3D10_BIND_VERTEX_BUFFER;
+	bufferDesc.ByteWidth = size;
+	bufferDesc.MiscFlags = 0;
+	if (type == BufferInstance)
+	{
+		bufferDesc.Usage = D3D10_USAGE_DYNAMIC; // Rewritten for each instanced draw
+		bufferDesc.CPUAccessFlags = D3D10_CPU_ACCESS_WRITE;
+	}
+	else
+	{
+		bufferDesc.Usage = D3D10_USAGE_DEFAULT; // Not a dynamic buffer
+		bufferDesc.CPUAccessFlags = 0;          // Indicates that CPU won't access this buffer at all after creation
+	}
+	D3D10_SUBRESOURCE_DATA initData; // Initial data
+	initData.pSysMem = data;
+
+	ID3D10Buffer* buffer;
+	if (FAILED( m_Device->CreateBuffer( &bufferDesc, data ? &initData : NULL, &buffer ) ))
+	{
+		return NULL;
+	}
+	return reinterpret_cast<TBufferHandle>(buffer);
+}
+
+void CD3D10Backend::AddRef(TBufferHandle buffer)
+{
+	reinterpret_cast<ID3D10Buffer*>(buffer)->AddRef();
+}
+
+void CD3D10Backend::Release(TBufferHandle buffer)
+{
+	reinterpret_cast<ID3D10Buffer*>(buffer)->Release();
+}
+
+void* CD3D10Backend::Map(TBufferHandle buffer)
+{
+	// Discarding the previous contents lets the driver give a fresh buffer while the GPU may still be reading the last ones
+	void* contents;
+	if (FAILED( reinterpret_cast<ID3D10Buffer*>(buffer)->Map( D3D10_MAP_WRITE_DISCARD, 0, &contents ) ))
+	{
+		return NULL;
+	}
+	return contents;
+}
+
+void CD3D10Backend::Unmap(TBufferHandle buffer)
+{
+	reinterpret_cast<ID3D10Buffer*>(buffer)->Unmap();
+}
+
+
+/////////////////////////////
+// Textures
+
+TTextureHandle CD3D10Backend::LoadTexture(const string& fileName)
+{
+	ID3D10ShaderResourceView* view;
+	if (FAILED( D3DX10CreateShaderResourceViewFromFileA( m_Device, fileName.c_str(), NULL, NULL, &view, NULL ) ))
+	{
+		return NULL;
+	}
+	STexture* texture = new STexture;
+	texture->ResourceView = view;
+	texture->DepthView = NULL;
+	texture->RefCount = 1;
+	return reinterpret_cast<TTextureHandle>(texture);
+}
+
+TTextureHandle CD3D10Backend::CreateDepthTexture(unsigned int width, unsigned int height)
+{
+	D3D10_TEXTURE2D_DESC texDesc;
+	texDesc.Width = width;
+	texDesc.Height = height;
+	texDesc.MipLevels = 1; // 1 level, means just the main texture, no additional mip-maps. Usually don't use mip-maps when rendering to textures (or we would have to render every level)
+	texDesc.ArraySize = 1;
+	texDesc.Format = DXGI_FORMAT_R32_TYPELESS; // The texture contains a single 32-bit value [tech gotcha: have to say typeless because depth buffer and texture see things slightly differently]
+	texDesc.SampleDesc.Count = 1;
+	texDesc.SampleDesc.Quality = 0;
+	texDesc.Usage = D3D10_USAGE_DEFAULT;
+	texDesc.BindFlags = D3D10_BIND_DEPTH_STENCIL | D3D10_BIND_SHADER_RESOURCE; // Indicate we will use texture as a depth buffer, and will also pass it to shaders
+	texDesc.CPUAccessFlags = 0;
+	texDesc.MiscFlags = 0;
+	ID3D10Texture2D* depthTexture;
+	if (FAILED( m_Device->CreateTexture2D( &texDesc, NULL, &depthTexture ) ))
+	{
+		return NULL;
+	}
+
+	// Create the depth stencil view, i.e. indicate that the texture just created is to be used as a depth buffer
+	D3D10_DEPTH_STENCIL_VIEW_DESC descDSV;
+	descDSV.Format = DXGI_FORMAT_D32_FLOAT; // See "tech gotcha" above
+	descDSV.ViewDimension = D3D10_DSV_DIMENSION_TEXTURE2D;
+	descDSV.Texture2D.MipSlice = 0;
+
+	// We also need to send this texture (a GPU memory resource) to the shaders. To do that we must create a shader-resource "view"
+	D3D10_SHADER_RESOURCE_VIEW_DESC srDesc;
+	srDesc.Format = DXGI_FORMAT_R32_FLOAT; // See "tech gotcha" above
+	srDesc.ViewDimension = D3D10_SRV_DIMENSION_TEXTURE2D;
+	srDesc.Texture2D.MostDetailedMip = 0;
+	srDesc.Texture2D.MipLevels = 1;
+
+	// The views hold their own references to the texture
+	STexture* texture = new STexture;
+	texture->ResourceView = NULL;
+	texture->DepthView = NULL;
+	texture->RefCount = 1;
+	if (FAILED( m_Device->CreateDepthStencilView( depthTexture, &descDSV, &texture->DepthView ) ) ||
+	    FAILED( m_Device->CreateShaderResourceView( depthTexture, &srDesc, &texture->ResourceView ) ))
+	{
+		depthTexture->Release();
+		Release(reinterpret_cast<TTextureHandle>(texture));
+		return NULL;
+	}
+	depthTexture->Release();
+	return reinterpret_cast<TTextureHandle>(texture);
+}
+
+void CD3D10Backend::AddRef(TTextureHandle texture)
+{
+	reinterpret_cast<STexture*>(texture)->RefCount++;
+}
+
+void CD3D10Backend::Release(TTextureHandle texture)
+{
+	STexture* d3dTexture = reinterpret_cast<STexture*>(texture);
+	if (--d3dTexture->RefCount == 0)
+	{
+		SAFE_RELEASE( d3dTexture->ResourceView );
+		SAFE_RELEASE( d3dTexture->DepthView );
+		delete d3dTexture;
+	}
+}
+
+
+/////////////////////////////
+// Pipeline state
+
+TLayoutHandle CD3D10Backend::GetInputLayout(const D3D10_INPUT_ELEMENT_DESC* elements, unsigned int numElements,
+                                            CTechnique* technique, bool instanced)
+{
+	ID3D10EffectTechnique* effectTechnique = instanced ? technique->GetInstancedTechnique() : technique->GetTechnique();
+	if (!effectTechnique)
+	{
+		return NULL;
+	}
+
+	// The cache keeps its own reference until the backend is released, so the one returned isn't needed
+	ID3D10InputLayout* layout = g_InputLayoutCache.GetLayout( elements, numElements, effectTechnique );
+	if (layout)  layout->Release();
+	return reinterpret_cast<TLayoutHandle>(layout);
+}
+
+void CD3D10Backend::SetVertexBuffer(TBufferHandle buffer, unsigned int stride, unsigned int offset, unsigned int slot)
+{
+	ID3D10Buffer* d3dBuffer = reinterpret_cast<ID3D10Buffer*>(buffer);
+	m_Device->IASetVertexBuffers( slot, 1, &d3dBuffer, &stride, &offset );
+}
+
+void CD3D10Backend::SetInputLayout(TLayoutHandle layout)
+{
+	m_Device->IASetInputLayout( reinterpret_cast<ID3D10InputLayout*>(layout) );
+}
+
+void CD3D10Backend::SetIndexBuffer(TBufferHandle buffer, DXGI_FORMAT format, unsigned int offset)
+{
+	m_Device->IASetIndexBuffer( reinterpret_cast<ID3D10Buffer*>(buffer), format, offset );
+}
+
+void CD3D10Backend::SetTopology(D3D10_PRIMITIVE_TOPOLOGY topology)
+{
+	m_Device->IASetPrimitiveTopology( topology );
+}
+
+// Effect variables are only sent to the GPU when a pass is applied
+void CD3D10Backend::SetTexture(ETextureSlot slot, TTextureHandle texture)
+{
+	if (m_TextureVars[slot])
+	{
+		m_TextureVars[slot]->SetResource( texture ? reinterpret_cast<STexture*>(texture)->ResourceView : NULL );
+	}
+}
+
+void CD3D10Backend::ApplyPass(CTechnique* technique, unsigned int pass, bool instanced)
+{
+	ID3D10EffectTechnique* effectTechnique = instanced ? technique->GetInstancedTechnique() : technique->GetTechnique();
+	effectTechnique->GetPassByIndex( pass )->Apply( 0 );
+}
+
+
+/////////////////////////////
+// Constants
+
+// Each buffer is given to the effect in place of the one it would manage itself. It is written from the CPU each time it changes -
+// discarding the old contents lets the driver give a fresh buffer while the GPU may still be reading the last one
+bool CD3D10Backend::UpdateConstants(EConstantGroup group, const void* data, unsigned int size)
+{
+	if (!m_ConstantVars[group])
+	{
+		return false;
+	}
+	if (!m_ConstantBuffers[group])
+	{
+		D3D10_BUFFER_DESC bufferDesc;
+		bufferDesc.ByteWidth = size;
+		bufferDesc.Usage = D3D10_USAGE_DYNAMIC;
+		bufferDesc.BindFlags = D3D10_BIND_CONSTANT_BUFFER;
+		bufferDesc.CPUAccessFlags = D3D10_CPU_ACCESS_WRITE;
+		bufferDesc.MiscFlags = 0;
+		if (FAILED( m_Device->CreateBuffer( &bufferDesc, NULL, &m_ConstantBuffers[group] ) ))
+		{
+			m_ConstantBuffers[group] = NULL;
+			return false;
+		}
+		if (FAILED( m_ConstantVars[group]->SetConstantBuffer( m_ConstantBuffers[group] ) ))
+		{
+			SAFE_RELEASE( m_ConstantBuffers[group] );
+			return false;
+		}
+		m_ConstantSizes[group] = size;
+	}
+	if (size != m_ConstantSizes[group])
+	{
+		return false;
+	}
+
+	void* contents;
+	if (FAILED( m_ConstantBuffers[group]->Map( D3D10_MAP_WRITE_DISCARD, 0, &contents ) ))
+	{
+		return false;
+	}
+	memcpy(contents, data, size);
+	m_ConstantBuffers[group]->Unmap();
+	return true;
+}
+
+
+/////////////////////////////
+// Render targets and draws
+
+void CD3D10Backend::SetRenderTarget(TTextureHandle depthTexture)
+{
+	if (depthTexture)
+	{
+		// Depth alone, no pixel colours are rendered
+		m_TargetColourView = NULL;
+		m_TargetDepthView = reinterpret_cast<STexture*>(depthTexture)->DepthView;
+		m_Device->OMSetRenderTargets( 0, 0, m_TargetDepthView );
+	}
+	else
+	{
+		m_TargetColourView = m_RenderTargetView;
+		m_TargetDepthView = m_DepthStencilView;
+		m_Device->OMSetRenderTargets( 1, &m_RenderTargetView, m_DepthStencilView );
+	}
+}
+
+// The viewport defines which part of the render target is rendered to, almost always all of it
+void CD3D10Backend::SetViewport(unsigned int width, unsigned int height)
+{
+	D3D10_VIEWPORT vp;
+	vp.Width = width;
+	vp.Height = height;
+	vp.MinDepth = 0.0f;
+	vp.MaxDepth = 1.0f;
+	vp.TopLeftX = 0;
+	vp.TopLeftY = 0;
+	m_Device->RSSetViewports( 1, &vp );
+}
+
+void CD3D10Backend::ClearColour(const float colour[4])
+{
+	if (m_TargetColourView)
+	{
+		m_Device->ClearRenderTargetView( m_TargetColourView, colour );
+	}
+}
+
+void CD3D10Backend::ClearDepth()
+{
+	m_Device->ClearDepthStencilView( m_TargetDepthView, D3D10_CLEAR_DEPTH, 1.0f, 0 );
+}
+
+void CD3D10Backend::DrawIndexed(unsigned int numIndices)
+{
+	m_Device->DrawIndexed( numIndices, 0, 0 );
+}
+
+void CD3D10Backend::DrawIndexedInstanced(unsigned int numIndices, unsigned int numInstances)
+{
+	m_Device->DrawIndexedInstanced( numIndices, numInstances, 0, 0, 0 );
+}
+
+// After we've finished drawing to the off-screen back buffer, we "present" it to the front buffer (the screen)
+void CD3D10Backend::Present()
+{
+	m_SwapChain->Present( 0, 0 );
+}
+
+
+/////////////////////////////
+// Private member functions
+
+// Release the constant buffers and forget the effect variables
+void CD3D10Backend::ReleaseEffectVariables()
+{
+	for (unsigned int slot = 0; slot < NumTextureSlots; slot++)
+	{
+		m_TextureVars[slot] = NULL;
+	}
+	for (unsigned int group = 0; group < NumConstantGroups; group++)
+	{
+		m_ConstantVars[group] = NULL;
+		SAFE_RELEASE( m_ConstantBuffers[group] );
+		m_ConstantSizes[group] = 0;
+	}
+}
@@ -0,0 +1,148 @@
+//--------------------------------------------------------------------------------------
+//	D3D10Backend.h
+//
+//	The D3D10 backend renders through a Direct3D 10 device, with the techniques' effects
+//	providing the shaders, states and the variables that textures and constants go to
+//--------------------------------------------------------------------------------------
+
+#ifndef D3D10_BACKEND_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define D3D10_BACKEND_H_INCLUDED
+
+#include "Defines.h"
+#include "RenderBackend.h"
+
+// The device, swap chain and main depth buffer are created by the backend. The textures and constant buffers are connected to the
+// effect variables shared by every technique permutation (see TechniqueLibrary.h), which are given to SetSharedEffect once the
+// technique library is created. Input layouts come from the input layout cache (InputLayoutCache.h), which keeps them until the
+// backend is released
+//
+// Texture handles point to an STexture holding the views of the texture, buffer handles and layout handles are the D3D10 objects
+// themselves
+
+class CD3D10Backend : public CRenderBackend
+{
+/////////////////////////////
+// Private member variables
+private:
+
+	ID3D10Device*           m_Device;
+	IDXGISwapChain*         m_SwapChain;
+	ID3D10RenderTargetView* m_RenderTargetView;
+	ID3D10Texture2D*        m_DepthStencil;
+	ID3D10DepthStencilView* m_DepthStencilView;
+
+	// Views of a texture - a depth texture has both, a loaded texture only the shader resource view
+	struct STexture
+	{
+		ID3D10ShaderResourceView* ResourceView;
+		ID3D10DepthStencilView*   DepthView;
+		unsigned int              RefCount;
+	};
+
+	// Views of the current render target, for clearing
+	ID3D10RenderTargetView* m_TargetColourView; // NULL when rendering depth alone
+	ID3D10DepthStencilView* m_TargetDepthView;
+
+	// Effect variable for each texture slot, and the buffer for each group of constants with the effect's cbuffer it is given to.
+	// Buffers are created when first updated, at the size given
+	ID3D10EffectShaderResourceVariable* m_TextureVars[NumTextureSlots];
+	ID3D10EffectConstantBuffer*         m_ConstantVars[NumConstantGroups];
+	ID3D10Buffer*                       m_ConstantBuffers[NumConstantGroups];
+	unsigned int                        m_ConstantSizes[NumConstantGroups];
+
+	// The device is owned by the backend, so it is not copied
+	CD3D10Backend(const CD3D10Backend&);
+	CD3D10Backend& operator=(const CD3D10Backend&);
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	///////////////////////////////
+	// Constructors / Destructors
+
+	CD3D10Backend();
+	~CD3D10Backend();
+
+
+	/////////////////////////////
+	// Setup
+
+	// Create the device, and a swap chain and depth buffer of the given size for the window. Returns false on failure
+	bool Create(HWND hWnd, unsigned int width, unsigned int height);
+
+	// Release everything created by the backend, after the rendering code has released its buffers and textures
+	void Release();
+
+	// Connect the texture slots and constant groups to the variables of the effect that every technique shares variables with, or
+	// NULL to disconnect them. Returns false if the effect is missing any of the variables
+	bool SetSharedEffect(ID3D10Effect* effect);
+
+	// The device, for creating the techniques' effects
+	ID3D10Device* GetDevice()
+	{
+		return m_Device;
+	}
+
+
+	/////////////////////////////
+	// Buffers
+
+	TBufferHandle CreateBuffer(EBufferType type, unsigned int size, const void* data);
+	void AddRef(TBufferHandle buffer);
+	void Release(TBufferHandle buffer);
+	void* Map(TBufferHandle buffer);
+	void Unmap(TBufferHandle buffer);
+
+
+	/////////////////////////////
+	// Textures
+
+	TTextureHandle LoadTexture(const string& fileName);
+	TTextureHandle CreateDepthTexture(unsigned int width, unsigned int height);
+	void AddRef(TTextureHandle texture);
+	void Release(TTextureHandle texture);
+
+
+	/////////////////////////////
+	// Pipeline state
+
+	TLayoutHandle GetInputLayout(const D3D10_INPUT_ELEMENT_DESC* elements, unsigned int numElements, CTechnique* technique,
+	                             bool instanced);
+	void SetVertexBuffer(TBufferHandle buffer, unsigned int stride, unsigned int offset, unsigned int slot);
+	void SetInputLayout(TLayoutHandle layout);
+	void SetIndexBuffer(TBufferHandle buffer, DXGI_FORMAT format, unsigned int offset);
+	void SetTopology(D3D10_PRIMITIVE_TOPOLOGY topology);
+	void SetTexture(ETextureSlot slot, TTextureHandle texture);
+	void ApplyPass(CTechnique* technique, unsigned int pass, bool instanced);
+
+
+	/////////////////////////////
+	// Constants
+
+	bool UpdateConstants(EConstantGroup group, const void* data, unsigned int size);
+
+
+	/////////////////////////////
+	// Render targets and draws
+
+	void SetRenderTarget(TTextureHandle depthTexture);
+	void SetViewport(unsigned int width, unsigned int height);
+	void ClearColour(const float colour[4]);
+	void ClearDepth();
+	void DrawIndexed(unsigned int numIndices);
+	void DrawIndexedInstanced(unsigned int numIndices, unsigned int numInstances);
+	void Present();
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	// Release the constant buffers and forget the effect variables
+	void ReleaseEffectVariables();
+};
+
+
+#endif // End of header guard - see top of file
@@ -11,6 +11,8 @@
 #include <d3d10.h>
 #include <d3dx10.h>
 
+#include "MSDefines.h" // TUInt64
+
 //-----------------------------------------------------------------------------
 // Constants
 //-----------------------------------------------------------------------------
@@ -31,20 +33,46 @@ const float RotSpeed = 2.0f;
 inline float ToRadians( float deg ) { return deg * (float)D3DX_PI / 180.0f; }
 inline float ToDegrees( float rad ) { return rad * 180.0f / (float)D3DX_PI; }
 
+// FNV-1a hash of the bytes [data, data + size), continuing from the given hash. Start a new hash with HashStart
+const gen::TUInt64 HashStart = 14695981039346656037ull;
+inline gen::TUInt64 HashBytes(gen::TUInt64 hash, const void* data, SIZE_T size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (SIZE_T i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
 
 //-----------------------------------------------------------------------------
 // Global variables
 //-----------------------------------------------------------------------------
 
-// Make DirectX render device available to other source files. We declare this
-// variable global in one file, then make it "extern" to all others. In general
-// this is not good practice - this is a kind of super-global variable. Would
-// be better to have a Device class responsible for this data. However, this
-// example aims for a minimum of code to help demonstrate the focus topic
-extern ID3D10Device* g_pd3dDevice;
+// The DirectX device is owned by the D3D10 render backend - other source files
+// create resources and draw through g_RenderBackend (see RenderBackend.h)
 
 // Dimensions of viewport - shared between setup code and camera class (which needs this to create the projection matrix - see code there)
 extern int g_ViewportWidth, g_ViewportHeight;
 
+// Counts of how often transforms are recalculated. Models, lights and the camera only rebuild their matrices (and data derived from
+// them, such as bounds and inverses) when a setter or control function has changed them. "Updated" counts the rebuilds, "Skipped" the
+// requests that found nothing had changed. The scene resets the counts each frame
+struct SUpdateCount
+{
+	unsigned int Updated;
+	unsigned int Skipped;
+};
+struct STransformStats
+{
+	SUpdateCount ModelMatrices;     // Model world matrices
+	SUpdateCount ModelBounds;       // Model world bounding volumes
+	SUpdateCount SpotLightMatrices; // Spotlight view, projection and view-projection matrices
+	SUpdateCount CameraMatrices;    // Camera view, projection and view-projection matrices and frustum
+};
+extern STransformStats g_TransformStats;
+
 
 #endif // End of header guard - see top of file
@@ -0,0 +1,291 @@
+//--------------------------------------------------------------------------------------
+//	DrawStats.cpp
+//
+//	The draw statistics registry counts the draw calls, indices, triangles and effect pass
+//	applies made each frame, broken down by technique and model, and checks for models
+//	drawn more than once in the same pass
+//--------------------------------------------------------------------------------------
+
+#include <fstream>
+#include <stdio.h> // sprintf_s
+
+#include "DrawStats.h"	// Declaration of this class
+#include "Model.h"
+#include "Technique.h"
+
+// Order draw keys so they can be used in a map
+bool CDrawStats::SDrawKey::operator<(const SDrawKey& other) const
+{
+	if (Pass != other.Pass)             return Pass < other.Pass;
+	if (PassIndex != other.PassIndex)   return PassIndex < other.PassIndex;
+	if (Technique != other.Technique)   return Technique < other.Technique;
+	if (EffectPass != other.EffectPass) return EffectPass < other.EffectPass;
+	return Model < other.Model;
+}
+
+// Names of the render passes used in the exports and debug output
+const char* DrawPassName(EDrawPass pass)
+{
+	return (pass == DrawPassShadow) ? "shadow" : "scene";
+}
+
+// Return a string with the characters that are special in JSON strings escaped
+string JSONEscape(const string& text)
+{
+	string escaped;
+	for (unsigned int i = 0; i < text.size(); i++)
+	{
+		if (text[i] == '"' || text[i] == '\\')
+		{
+			escaped += '\\';
+		}
+		escaped += text[i];
+	}
+	return escaped;
+}
+
+
+///////////////////////////////
+// Constructors / Destructors
+
+CDrawStats::CDrawStats()
+{
+	m_Frame = 0;
+	m_AssertNoDuplicates = false;
+	m_NumDuplicates = 0;
+	BeginFrame();
+	m_Frame = 0; // Construction doesn't count as a frame
+}
+
+
+/////////////////////////////
+// Frame control
+
+// Reset the counts for a new frame. Starts in the scene render pass
+void CDrawStats::BeginFrame()
+{
+	m_Frame++;
+	m_Pass = DrawPassScene;
+	m_PassIndex = 0;
+	m_Technique = NULL;
+	m_EffectPass = 0;
+
+	SDrawCounts clearCounts = { 0, 0, 0, 0, 0, 0 };
+	m_Totals = clearCounts;
+	m_Binds = 0;
+	m_TechniqueCounts.clear();
+	m_ModelCounts.clear();
+	m_TechniqueIndex.clear();
+	m_ModelIndex.clear();
+	m_DrawsPerPass.clear();
+}
+
+// Take the resource binds for the frame from the state cache counts - buffers, layouts and textures passed on to the backend
+void CDrawStats::EndFrame(const SStateCounts& stateCounts)
+{
+	m_Binds = stateCounts.Issued[StateVertexBuffer] + stateCounts.Issued[StateInputLayout] +
+	          stateCounts.Issued[StateIndexBuffer] + stateCounts.Issued[StateTexture];
+}
+
+// Select the render pass following draws belong to. Shadow passes are numbered by shadow map
+void CDrawStats::BeginPass(EDrawPass pass, unsigned int passIndex /*= 0*/)
+{
+	m_Pass = pass;
+	m_PassIndex = passIndex;
+	m_Technique = NULL;
+	m_EffectPass = 0;
+}
+
+
+/////////////////////////////
+// Recording
+
+// An effect pass of a technique has been applied
+void CDrawStats::RecordApply(CTechnique* technique, unsigned int effectPass)
+{
+	m_Technique = technique;
+	m_EffectPass = effectPass;
+	m_Totals.Applies++;
+	TechniqueCounts(technique).Applies++;
+}
+
+// A model has been drawn with the last applied pass. For an instanced call record each instance's model without counting the call,
+// then the call itself
+void CDrawStats::RecordDraw(CModel* model, unsigned int numIndices, bool countCall /*= true*/)
+{
+	AddDraw(m_Totals, numIndices);
+	AddDraw(TechniqueCounts(m_Technique), numIndices);
+	AddDraw(ModelCounts(model), numIndices);
+	if (countCall)
+	{
+		RecordDrawCall();
+		ModelCounts(model).DrawCalls++;
+	}
+
+	// Check for a repeated draw of this model with the same pass
+	SDrawKey key = { m_Pass, m_PassIndex, m_Technique, m_EffectPass, model };
+	unsigned int count = ++m_DrawsPerPass[key];
+	if (count < 2)
+	{
+		return;
+	}
+	m_NumDuplicates++;
+	if (m_Duplicates.size() < MaxDuplicatesListed)
+	{
+		SDuplicateDraw duplicate;
+		duplicate.Frame = m_Frame;
+		duplicate.Pass = m_Pass;
+		duplicate.PassIndex = m_PassIndex;
+		duplicate.Model = model->GetFileName();
+		duplicate.Technique = m_Technique ? m_Technique->GetName() : "";
+		duplicate.EffectPass = m_EffectPass;
+		duplicate.Count = count;
+		m_Duplicates.push_back(duplicate);
+	}
+	if (m_AssertNoDuplicates)
+	{
+		char message[512];
+		sprintf_s(message, "Duplicate draw: frame %u, %s pass %u, model %s drawn %u times with pass %u of %s\n", m_Frame,
+		          DrawPassName(m_Pass), m_PassIndex, model->GetFileName().c_str(), count, m_EffectPass,
+		          m_Technique ? m_Technique->GetName() : "");
+		OutputDebugStringA(message);
+		if (IsDebuggerPresent())
+		{
+			DebugBreak();
+		}
+	}
+}
+
+// A draw call has been made with the last applied pass (the models drawn are recorded separately with RecordDraw)
+void CDrawStats::RecordDrawCall()
+{
+	m_Totals.DrawCalls++;
+	TechniqueCounts(m_Technique).DrawCalls++;
+}
+
+
+/////////////////////////////
+// Checking and results
+
+// Write the counts for the frame to a CSV file, one row for the totals, then one for each technique and model. Columns that don't
+// apply to a row are left empty. Returns false if the file could not be written
+bool CDrawStats::ExportCSV(const char* fileName)
+{
+	ofstream file(fileName);
+	if (!file)
+	{
+		return false;
+	}
+
+	file << "frame,kind,name,draw_calls,draws,indices,triangles,applies,shadow_draws,binds,duplicates\n";
+	const SDrawCounts& t = m_Totals;
+	file << m_Frame << ",total,," << t.DrawCalls << "," << t.Draws << "," << t.Indices << "," << t.Triangles << "," << t.Applies
+	     << "," << t.ShadowDraws << "," << m_Binds << "," << m_NumDuplicates << "\n";
+	for (unsigned int i = 0; i < m_TechniqueCounts.size(); i++)
+	{
+		const SDrawCounts& c = m_TechniqueCounts[i].Counts;
+		CTechnique* technique = m_TechniqueCounts[i].Technique;
+		file << m_Frame << ",technique," << (technique ? technique->GetName() : "") << "," << c.DrawCalls << "," << c.Draws << ","
+		     << c.Indices << "," << c.Triangles << "," << c.Applies << "," << c.ShadowDraws << ",,\n";
+	}
+	for (unsigned int i = 0; i < m_ModelCounts.size(); i++)
+	{
+		const SDrawCounts& c = m_ModelCounts[i].Counts;
+		file << m_Frame << ",model," << m_ModelCounts[i].Model->GetFileName() << "," << c.DrawCalls << "," << c.Draws << ","
+		     << c.Indices << "," << c.Triangles << ",," << c.ShadowDraws << ",,\n"; // Applies belong to techniques, not models
+	}
+	return !file.fail();
+}
+
+// Write the counts for the frame and the duplicates seen to a JSON file. Returns false if the file could not be written
+bool CDrawStats::ExportJSON(const char* fileName)
+{
+	ofstream file(fileName);
+	if (!file)
+	{
+		return false;
+	}
+
+	const SDrawCounts& t = m_Totals;
+	file << "{\n  \"frame\": " << m_Frame << ",\n";
+	file << "  \"totals\": { \"draw_calls\": " << t.DrawCalls << ", \"draws\": " << t.Draws << ", \"indices\": " << t.Indices
+	     << ", \"triangles\": " << t.Triangles << ", \"applies\": " << t.Applies << ", \"shadow_draws\": " << t.ShadowDraws
+	     << ", \"binds\": " << m_Binds << " },\n";
+
+	file << "  \"techniques\": [";
+	for (unsigned int i = 0; i < m_TechniqueCounts.size(); i++)
+	{
+		const SDrawCounts& c = m_TechniqueCounts[i].Counts;
+		CTechnique* technique = m_TechniqueCounts[i].Technique;
+		file << (i > 0 ? ",\n" : "\n") << "    { \"name\": \"" << JSONEscape(technique ? technique->GetName() : "") << "\", \"draw_calls\": "
+		     << c.DrawCalls << ", \"draws\": " << c.Draws << ", \"indices\": " << c.Indices << ", \"triangles\": " << c.Triangles
+		     << ", \"applies\": " << c.Applies << ", \"shadow_draws\": " << c.ShadowDraws << " }";
+	}
+	file << "\n  ],\n";
+
+	file << "  \"models\": [";
+	for (unsigned int i = 0; i < m_ModelCounts.size(); i++)
+	{
+		const SDrawCounts& c = m_ModelCounts[i].Counts;
+		file << (i > 0 ? ",\n" : "\n") << "    { \"name\": \"" << JSONEscape(m_ModelCounts[i].Model->GetFileName()) << "\", \"draw_calls\": "
+		     << c.DrawCalls << ", \"draws\": " << c.Draws << ", \"indices\": " << c.Indices << ", \"triangles\": " << c.Triangles
+		     << ", \"shadow_draws\": " << c.ShadowDraws << " }";
+	}
+	file << "\n  ],\n";
+
+	file << "  \"duplicate_count\": " << m_NumDuplicates << ",\n";
+	file << "  \"duplicates\": [";
+	for (unsigned int i = 0; i < m_Duplicates.size(); i++)
+	{
+		const SDuplicateDraw& d = m_Duplicates[i];
+		file << (i > 0 ? ",\n" : "\n") << "    { \"frame\": " << d.Frame << ", \"pass\": \"" << DrawPassName(d.Pass) << "\", \"pass_index\": "
+		     << d.PassIndex << ", \"model\": \"" << JSONEscape(d.Model) << "\", \"technique\": \"" << JSONEscape(d.Technique)
+		     << "\", \"effect_pass\": " << d.EffectPass << ", \"count\": " << d.Count << " }";
+	}
+	file << "\n  ]\n}\n";
+	return !file.fail();
+}
+
+
+/////////////////////////////
+// Private member functions
+
+// Add a draw to a set of counts. All geometry is triangle lists
+void CDrawStats::AddDraw(SDrawCounts& counts, unsigned int numIndices)
+{
+	counts.Draws++;
+	counts.Indices += numIndices;
+	counts.Triangles += numIndices / 3;
+	if (m_Pass == DrawPassShadow)
+	{
+		counts.ShadowDraws++;
+	}
+}
+
+// Counts for a technique this frame, added if not seen yet
+SDrawCounts& CDrawStats::TechniqueCounts(CTechnique* technique)
+{
+	map<CTechnique*, unsigned int>::iterator found = m_TechniqueIndex.find(technique);
+	if (found != m_TechniqueIndex.end())
+	{
+		return m_TechniqueCounts[found->second].Counts;
+	}
+	STechniqueCounts entry = { technique, { 0, 0, 0, 0, 0, 0 } };
+	m_TechniqueIndex[technique] = static_cast<unsigned int>(m_TechniqueCounts.size());
+	m_TechniqueCounts.push_back(entry);
+	return m_TechniqueCounts.back().Counts;
+}
+
+// Counts for a model this frame, added if not seen yet
+SDrawCounts& CDrawStats::ModelCounts(CModel* model)
+{
+	map<CModel*, unsigned int>::iterator found = m_ModelIndex.find(model);
+	if (found != m_ModelIndex.end())
+	{
+		return m_ModelCounts[found->second].Counts;
+	}
+	SModelCounts entry = { model, { 0, 0, 0, 0, 0, 0 } };
+	m_ModelIndex[model] = static_cast<unsigned int>(m_ModelCounts.size());
+	m_ModelCounts.push_back(entry);
+	return m_ModelCounts.back().Counts;
+}
@@ -0,0 +1,197 @@
+//--------------------------------------------------------------------------------------
+//	DrawStats.h
+//
+//	The draw statistics registry counts the draw calls, indices, triangles and effect pass
+//	applies made each frame, broken down by technique and model, and checks for models
+//	drawn more than once in the same pass
+//--------------------------------------------------------------------------------------
+
+#ifndef DRAW_STATS_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define DRAW_STATS_H_INCLUDED
+
+#include <vector>
+#include <map>
+#include <string>
+using namespace std;
+
+#include "Defines.h"
+#include "StateCache.h"
+
+class CModel;
+class CTechnique;
+
+// Rendering code reports each effect pass it applies (RecordApply) and each model it draws with that pass (RecordDraw). Draws are
+// grouped into render passes - the main scene and each shadow map - selected with BeginPass. Within a render pass, each model should
+// be drawn at most once with each pass of a technique. A second draw is a duplicate: the model is rasterised twice for no visible
+// change. Duplicates are always counted and listed. In assertion mode they are also written to the debug output and break into the
+// debugger if one is attached, so a scripted run can stop at the first one.
+//
+// Counts are for the current frame (reset by BeginFrame), except the list of duplicates, which is kept for the whole run so a
+// scripted check can report any seen. Resource binds are taken from the state cache's issued calls at the end of the frame
+
+// Kinds of render pass, counted separately
+enum EDrawPass
+{
+	DrawPassScene,
+	DrawPassShadow
+};
+
+// Counts for a frame, in total or for one technique or model
+struct SDrawCounts
+{
+	unsigned int DrawCalls;   // Draw calls made - an instanced call counts once
+	unsigned int Draws;       // Models drawn - each instance counts
+	unsigned int Indices;     // Indices drawn, over all instances
+	unsigned int Triangles;   // Triangles drawn, over all instances
+	unsigned int Applies;     // Effect pass applies
+	unsigned int ShadowDraws; // Models drawn into shadow maps (included in Draws)
+};
+
+// A model drawn more than once with the same pass of a technique in one render pass
+struct SDuplicateDraw
+{
+	unsigned int Frame;
+	EDrawPass    Pass;
+	unsigned int PassIndex;  // Shadow map number for shadow passes
+	string       Model;      // Model file name
+	string       Technique;
+	unsigned int EffectPass; // Pass of the technique
+	unsigned int Count;      // Number of draws so far this frame
+};
+
+class CDrawStats
+{
+/////////////////////////////
+// Private member variables
+private:
+
+	// Number of frames begun, so the first frame is 1
+	unsigned int m_Frame;
+
+	// Render pass and effect pass draws are currently recorded against
+	EDrawPass    m_Pass;
+	unsigned int m_PassIndex;
+	CTechnique*  m_Technique;
+	unsigned int m_EffectPass;
+
+	// Counts for the frame. Techniques and models are listed in the order first seen in the frame, so exports are in a stable order
+	SDrawCounts m_Totals;
+	unsigned int m_Binds;
+	struct STechniqueCounts
+	{
+		CTechnique* Technique;
+		SDrawCounts Counts;
+	};
+	struct SModelCounts
+	{
+		CModel*     Model;
+		SDrawCounts Counts;
+	};
+	vector<STechniqueCounts>       m_TechniqueCounts;
+	vector<SModelCounts>           m_ModelCounts;
+	map<CTechnique*, unsigned int> m_TechniqueIndex;
+	map<CModel*, unsigned int>     m_ModelIndex;
+
+	// Draws this frame for each render pass / technique pass / model, to spot duplicates
+	struct SDrawKey
+	{
+		EDrawPass    Pass;
+		unsigned int PassIndex;
+		CTechnique*  Technique;
+		unsigned int EffectPass;
+		CModel*      Model;
+
+		bool operator<(const SDrawKey& other) const;
+	};
+	map<SDrawKey, unsigned int> m_DrawsPerPass;
+
+	// Duplicates seen over the whole run. Only the first MaxDuplicatesListed are kept in the list
+	static const unsigned int MaxDuplicatesListed = 256;
+	bool                   m_AssertNoDuplicates;
+	unsigned int           m_NumDuplicates;
+	vector<SDuplicateDraw> m_Duplicates;
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	///////////////////////////////
+	// Constructors / Destructors
+
+	CDrawStats();
+
+
+	/////////////////////////////
+	// Frame control
+
+	// Reset the counts for a new frame. Starts in the scene render pass
+	void BeginFrame();
+
+	// Take the resource binds for the frame from the state cache counts
+	void EndFrame(const SStateCounts& stateCounts);
+
+	// Select the render pass following draws belong to. Shadow passes are numbered by shadow map
+	void BeginPass(EDrawPass pass, unsigned int passIndex = 0);
+
+
+	/////////////////////////////
+	// Recording
+
+	// An effect pass of a technique has been applied
+	void RecordApply(CTechnique* technique, unsigned int effectPass);
+
+	// A model has been drawn with the last applied pass. For an instanced call record each instance's model, then the call itself
+	void RecordDraw(CModel* model, unsigned int numIndices, bool countCall = true);
+	void RecordDrawCall();
+
+
+	/////////////////////////////
+	// Checking and results
+
+	// In assertion mode a duplicate draw is also written to the debug output and breaks into the debugger if one is attached
+	void SetAssertNoDuplicates(bool assertNoDuplicates)
+	{
+		m_AssertNoDuplicates = assertNoDuplicates;
+	}
+
+	const SDrawCounts& GetTotals()
+	{
+		return m_Totals;
+	}
+	unsigned int GetBinds()
+	{
+		return m_Binds;
+	}
+	unsigned int GetNumDuplicates()
+	{
+		return m_NumDuplicates;
+	}
+	const vector<SDuplicateDraw>& GetDuplicates()
+	{
+		return m_Duplicates;
+	}
+
+	// Write the counts for the frame (totals, then each technique, then each model) to a file. Returns false if the file could not
+	// be written. The JSON export also lists the duplicates seen
+	bool ExportCSV(const char* fileName);
+	bool ExportJSON(const char* fileName);
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	// Add a draw to a set of counts
+	void AddDraw(SDrawCounts& counts, unsigned int numIndices);
+
+	// Counts for a technique or model this frame, added if not seen yet
+	SDrawCounts& TechniqueCounts(CTechnique* technique);
+	SDrawCounts& ModelCounts(CModel* model);
+};
+
+// Single draw statistics registry used for all rendering - declared in GraphicsAssign1.cpp
+extern CDrawStats g_DrawStats;
+
+
+#endif // End of header guard - see top of file
@@ -0,0 +1,236 @@
+//--------------------------------------------------------------------------------------
+//	EffectCache.cpp
+//
+//	The effect cache keeps compiled effects on disk, so the effect file is only compiled
+//	again when it, the files it includes, its defines or the compiler flags change
+//--------------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h> // strlen, memcmp
+
+#include "EffectCache.h"	// Declaration of this class
+
+// Files of compiled code start with this id and the key they were compiled for, then the size of the code
+const char         EffectCodeFileId[4] = { 'F', 'X', 'C', 'C' };
+const char*        EffectTarget = "fx_4_0";
+
+// Includes nested deeper than this are not followed when hashing (the compiler would reject them anyway)
+const unsigned int MaxIncludeDepth = 16;
+
+
+//--------------------------------------------------------------------------------------
+// File helpers
+//--------------------------------------------------------------------------------------
+
+// Read a whole file, returns false if it can't be read
+bool ReadWholeFile(const wstring& fileName, vector<char>* contents)
+{
+	FILE* file;
+	if (_wfopen_s(&file, fileName.c_str(), L"rb") != 0)
+	{
+		return false;
+	}
+	contents->clear();
+	char buffer[4096];
+	size_t bytesRead;
+	while ((bytesRead = fread(buffer, 1, sizeof(buffer), file)) > 0)
+	{
+		contents->insert(contents->end(), buffer, buffer + bytesRead);
+	}
+	bool succeeded = !ferror(file);
+	fclose(file);
+	return succeeded;
+}
+
+
+///////////////////////////////
+// Constructors / Destructors
+
+CEffectCache::CEffectCache()
+{
+	m_HLSLFlags = 0;
+	m_SourceHash = HashStart;
+}
+
+
+/////////////////////////////
+// Setup
+
+// Set the effect file, its compiler flags and the folder to keep compiled code in (created if needed, or NULL to always compile).
+// Reads the effect file and the files it includes to hash them. Returns false if the effect file can't be read
+bool CEffectCache::SetSource(const wchar_t* fileName, UINT hlslFlags, const wchar_t* folder)
+{
+	m_FileName = fileName;
+	m_HLSLFlags = hlslFlags;
+	m_Folder = folder ? folder : L"";
+	if (!m_Folder.empty())
+	{
+		CreateDirectory(m_Folder.c_str(), NULL); // Fails harmlessly if the folder is already there
+	}
+
+	m_SourceHash = HashStart;
+	return HashSourceFile(m_FileName, &m_SourceHash);
+}
+
+
+/////////////////////////////
+// Compiled code
+
+// Get the effect file compiled with the given defines (ending with a NULL entry) and effect flags (D3D10_EFFECT_...) - loaded if it
+// has been compiled before, otherwise compiled and stored. Returns false with the compiler messages in error if it doesn't compile.
+// If fromCache is given it is set to whether the code was loaded
+bool CEffectCache::GetCode(const D3D10_SHADER_MACRO* defines, UINT fxFlags, TEffectCode* code, string* error,
+                           bool* fromCache /*= NULL*/) const
+{
+	bool loaded = !m_Folder.empty() && Load(GetKey(defines, fxFlags), code);
+	if (fromCache)  *fromCache = loaded;
+	return loaded || Compile(defines, fxFlags, code, error);
+}
+
+// Compile and store the code as above without looking in the cache first, for when code from the cache can't be used
+bool CEffectCache::Compile(const D3D10_SHADER_MACRO* defines, UINT fxFlags, TEffectCode* code, string* error) const
+{
+	ID3D10Blob* compiled = NULL;
+	ID3D10Blob* errors = NULL;
+	if (FAILED( D3DX10CompileFromFile( m_FileName.c_str(), defines, NULL, NULL, EffectTarget, m_HLSLFlags, fxFlags, NULL,
+	                                   &compiled, &errors, NULL ) ))
+	{
+		if (errors)
+		{
+			*error = static_cast<const char*>(errors->GetBufferPointer());
+			errors->Release();
+		}
+		else
+		{
+			*error = "Cannot read the FX file. Ensure it is in the same folder as this executable.";
+		}
+		return false;
+	}
+	SAFE_RELEASE( errors ); // Warnings
+
+	const char* bytes = static_cast<const char*>(compiled->GetBufferPointer());
+	code->assign(bytes, bytes + compiled->GetBufferSize());
+	compiled->Release();
+
+	if (!m_Folder.empty())
+	{
+		Store(GetKey(defines, fxFlags), *code);
+	}
+	return true;
+}
+
+
+/////////////////////////////
+// Private member functions
+
+// Hash of everything a compile depends on
+gen::TUInt64 CEffectCache::GetKey(const D3D10_SHADER_MACRO* defines, UINT fxFlags) const
+{
+	// Names and definitions are hashed with their terminating zeros so that e.g. "AB","C" differs from "A","BC"
+	gen::TUInt64 key = m_SourceHash;
+	for (const D3D10_SHADER_MACRO* define = defines; define && define->Name; define++)
+	{
+		key = HashBytes(key, define->Name, strlen(define->Name) + 1);
+		const char* definition = define->Definition ? define->Definition : "";
+		key = HashBytes(key, definition, strlen(definition) + 1);
+	}
+	key = HashBytes(key, &m_HLSLFlags, sizeof(m_HLSLFlags));
+	key = HashBytes(key, &fxFlags, sizeof(fxFlags));
+	return HashBytes(key, EffectTarget, strlen(EffectTarget));
+}
+
+// Name of the file holding the code for a key
+wstring CEffectCache::GetCodeFileName(gen::TUInt64 key) const
+{
+	wchar_t name[32];
+	swprintf_s(name, L"\\%016llx.fxo", key);
+	return m_Folder + name;
+}
+
+// Load the code for a key, returns false if there is no file for it or it is damaged
+bool CEffectCache::Load(gen::TUInt64 key, TEffectCode* code) const
+{
+	vector<char> contents;
+	if (!ReadWholeFile(GetCodeFileName(key), &contents))
+	{
+		return false;
+	}
+
+	// Check the id, key and size, a file cut short by a failed write is compiled again
+	const size_t headerSize = sizeof(EffectCodeFileId) + sizeof(gen::TUInt64) + sizeof(gen::TUInt32);
+	if (contents.size() < headerSize || memcmp(&contents[0], EffectCodeFileId, sizeof(EffectCodeFileId)) != 0)
+	{
+		return false;
+	}
+	gen::TUInt64 fileKey;
+	gen::TUInt32 size;
+	memcpy(&fileKey, &contents[sizeof(EffectCodeFileId)], sizeof(fileKey));
+	memcpy(&size, &contents[sizeof(EffectCodeFileId) + sizeof(fileKey)], sizeof(size));
+	if (fileKey != key || size == 0 || contents.size() - headerSize != size)
+	{
+		return false;
+	}
+
+	code->assign(contents.begin() + headerSize, contents.end());
+	return true;
+}
+
+// Store the code for a key, a failure only means the next run compiles again
+void CEffectCache::Store(gen::TUInt64 key, const TEffectCode& code) const
+{
+	if (code.empty())
+	{
+		return;
+	}
+	FILE* file;
+	if (_wfopen_s(&file, GetCodeFileName(key).c_str(), L"wb") != 0)
+	{
+		return;
+	}
+	gen::TUInt32 size = static_cast<gen::TUInt32>(code.size());
+	fwrite(EffectCodeFileId, sizeof(EffectCodeFileId), 1, file);
+	fwrite(&key, sizeof(key), 1, file);
+	fwrite(&size, sizeof(size), 1, file);
+	fwrite(&code[0], 1, code.size(), file);
+	fclose(file);
+}
+
+// Add the contents of a file, and of the files it #includes, to a hash. Returns false if the file can't be read
+bool CEffectCache::HashSourceFile(const wstring& fileName, gen::TUInt64* hash, unsigned int depth /*= 0*/)
+{
+	vector<char> source;
+	if (depth > MaxIncludeDepth || !ReadWholeFile(fileName, &source))
+	{
+		return false;
+	}
+	if (source.empty())
+	{
+		return true;
+	}
+	*hash = HashBytes(*hash, &source[0], source.size());
+
+	// Includes are found relative to the including file, as the compiler does. One that can't be read is left for the compiler
+	// to report
+	wstring folder = fileName.substr(0, fileName.find_last_of(L"\\/") + 1);
+	string text(source.begin(), source.end());
+	string::size_type lineStart = 0;
+	while (lineStart < text.size())
+	{
+		string::size_type lineEnd = text.find('\n', lineStart);
+		if (lineEnd == string::npos)  lineEnd = text.size();
+
+		string::size_type directive = text.find_first_not_of(" \t", lineStart);
+		if (directive < lineEnd && text.compare(directive, 8, "#include") == 0)
+		{
+			string::size_type nameStart = text.find_first_of("\"<", directive + 8);
+			string::size_type nameEnd = nameStart < lineEnd ? text.find_first_of("\">", nameStart + 1) : string::npos;
+			if (nameEnd < lineEnd)
+			{
+				string includeName = text.substr(nameStart + 1, nameEnd - nameStart - 1);
+				HashSourceFile(folder + wstring(includeName.begin(), includeName.end()), hash, depth + 1);
+			}
+		}
+		lineStart = lineEnd + 1;
+	}
+	return true;
+}
@@ -0,0 +1,91 @@
+//--------------------------------------------------------------------------------------
+//	EffectCache.h
+//
+//	The effect cache keeps compiled effects on disk, so the effect file is only compiled
+//	again when it, the files it includes, its defines or the compiler flags change
+//--------------------------------------------------------------------------------------
+
+#ifndef EFFECT_CACHE_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define EFFECT_CACHE_H_INCLUDED
+
+#include <vector>
+#include <string>
+using namespace std;
+
+#include "Defines.h"
+
+// Compiling the effect file is a large part of startup, and is the same work every run. The cache stores the code from each compile
+// in a file named by a hash of everything the compile depends on - the effect file and the files it includes, the defines, the
+// compiler flags and the target. Later runs create effects from the stored code in memory and only compile on a miss: when there is
+// no file for the key, or the file is damaged. A change to the source gives new keys, so files for old versions are never used again
+//
+// GetCode can be called from several threads at once (e.g. jobs compiling permutations in parallel) - it only reads what SetSource
+// set up, and each key has its own file
+
+// Compiled effect code
+typedef vector<char> TEffectCode;
+
+class CEffectCache
+{
+/////////////////////////////
+// Private member variables
+private:
+
+	wstring      m_FileName;   // Effect file compiled
+	wstring      m_Folder;     // Folder for the compiled code, empty to not store it
+	UINT         m_HLSLFlags;  // Compiler flags, D3D10_SHADER_...
+	gen::TUInt64 m_SourceHash; // Hash of the effect file and the files it includes
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	///////////////////////////////
+	// Constructors / Destructors
+
+	CEffectCache();
+
+
+	/////////////////////////////
+	// Setup
+
+	// Set the effect file, its compiler flags and the folder to keep compiled code in (created if needed, or NULL to always
+	// compile). Reads the effect file and the files it includes to hash them. Returns false if the effect file can't be read
+	bool SetSource(const wchar_t* fileName, UINT hlslFlags, const wchar_t* folder);
+
+
+	/////////////////////////////
+	// Compiled code
+
+	// Get the effect file compiled with the given defines (ending with a NULL entry) and effect flags (D3D10_EFFECT_...) - loaded
+	// if it has been compiled before, otherwise compiled and stored. Returns false with the compiler messages in error if it
+	// doesn't compile. If fromCache is given it is set to whether the code was loaded
+	bool GetCode(const D3D10_SHADER_MACRO* defines, UINT fxFlags, TEffectCode* code, string* error, bool* fromCache = NULL) const;
+
+	// Compile and store the code as above without looking in the cache first, for when code from the cache can't be used
+	bool Compile(const D3D10_SHADER_MACRO* defines, UINT fxFlags, TEffectCode* code, string* error) const;
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	// Hash of everything a compile depends on
+	gen::TUInt64 GetKey(const D3D10_SHADER_MACRO* defines, UINT fxFlags) const;
+
+	// Name of the file holding the code for a key
+	wstring GetCodeFileName(gen::TUInt64 key) const;
+
+	// Load the code for a key, returns false if there is no file for it or it is damaged
+	bool Load(gen::TUInt64 key, TEffectCode* code) const;
+
+	// Store the code for a key, a failure only means the next run compiles again
+	void Store(gen::TUInt64 key, const TEffectCode& code) const;
+
+	// Add the contents of a file, and of the files it #includes, to a hash. Returns false if the file can't be read
+	static bool HashSourceFile(const wstring& fileName, gen::TUInt64* hash, unsigned int depth = 0);
+};
+
+
+#endif // End of header guard - see top of file
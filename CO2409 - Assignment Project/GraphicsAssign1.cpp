@@ -36,6 +36,10 @@
 #include "resource.h"
 
 #include <vector>
+#include <map>
+#include <stdio.h> // swprintf_s
+#include <algorithm> // sort
+#include <fstream>
 
 #include "Defines.h"			// General definitions shared by all source files
 #include "Model.h"				// Model class - encapsulates working with vertex/index data and world matrix
@@ -46,7 +50,25 @@
 #include "Material.h"
 #include "ColourConversion.h"
 #include "Technique.h"
+#include "TechniqueLibrary.h"	// Compiles the effect file once for each combination of shader features used
 #include "SpotLight.h"
+#include "StateCache.h"			// Drops repeated binds of the same device state / effect variable values
+#include "ShaderConstants.h"	// Constant buffers grouped by update frequency
+#include "InputLayoutCache.h"	// Shares vertex layouts between models and techniques
+#include "RenderBackend.h"		// Interface all resources are created and drawn through
+#include "D3D10Backend.h"		// Renders with a Direct3D 10 device
+#include "RecordingBackend.h"	// Counts and records the commands of a frame without a device
+#include "SoftwareBackend.h"	// Renders the frame on the CPU with a tiled rasteriser
+#include "ImageFile.h"			// Reads and writes images for the software backend
+#include "RenderQueue.h"		// Sorts the models to draw by technique, material, geometry and depth
+#include "DrawStats.h"			// Counts draws, triangles and effect pass applies, and checks for duplicate draws
+#include "StaticBatcher.h"		// Merges stationary models drawn the same way into pre-transformed chunks
+#include "SceneFile.h"			// Reads the scene description from text or binary scene files
+#include "CBVH.h"				// Bounding volume hierarchy for culling and ray queries
+#include "COcclusionBuffer.h"	// CPU depth buffer for occlusion culling
+#include "CTimer.h"				// Times the occlusion culling stages
+#include "CJobSystem.h"			// Work-stealing job scheduler for the per-frame update and culling
+#include "MathDX.h"				// Conversions between math classes and DirectX types
 //--------------------------------------------------------------------------------------
 // Global Scene Variables
 //--------------------------------------------------------------------------------------
@@ -59,6 +81,14 @@ const unsigned int NO_OF_SPOT_LIGHTS = 1;
 
 vector<CModel*> g_Models;
 
+// All the models and light models are nodes in one transform hierarchy, which calculates their world matrices. Models are roots
+// unless attached to a parent, e.g. the orbiting light is a child of the cube
+gen::CTransformHierarchy SceneHierarchy;
+
+// Job system shared by the per-frame update and culling work - runs jobs on the main thread plus one worker for each other hardware
+// thread. Created in InitScene
+gen::CJobSystem* Jobs = NULL;
+
 CCamera* Camera = NULL; 
 
 // Additional Light data
@@ -67,11 +97,74 @@ D3DXVECTOR3 PulsingLightColour = D3DXVECTOR3(0.0f, 0.0f, 0.0f);
 // Light Class and orbit data
 CPositionalLight* Lights[NO_OF_LIGHTS];
 CSpotLight* SpotLight[NO_OF_SPOT_LIGHTS];
+static_assert(NO_OF_LIGHTS <= kNumPointLightConstants, "The light set constants have no room for all the point lights");
+static_assert(NO_OF_SPOT_LIGHTS <= kNumSpotLightConstants, "The light set constants have no room for all the spotlights");
 
 CAmbientLight* AmbientLight = NULL;
 const float LightOrbitRadius = 20.0f;
 const float LightOrbitSpeed  = 0.5f;
 
+// Culling - every scene model and light model is a "culling object", numbered with the scene models first, then the light models, then the
+// spotlight models. The world bounding boxes of the objects are held in two bounding volume hierarchies (BVHs): one for stationary objects,
+// built once, and one for moving objects, refitted each frame. The trees are used to find the objects in the camera frustum (the render
+// loop only visits these) and the shadow casters for each spotlight
+gen::CBVH            StaticTree;
+gen::CBVH            DynamicTree;
+vector<unsigned int> StaticTreeObjects;    // Culling object for each item in the static tree
+vector<unsigned int> DynamicTreeObjects;   // Culling object for each item in the dynamic tree
+vector<gen::CAABB>   CullingBoxes;         // Temporary list of world bounding boxes used when building trees
+vector<CModel*>      VisibleModels;        // Scene models that passed culling, in the same order as g_Models
+vector<CModel*>      ShadowCasters[NO_OF_SPOT_LIGHTS]; // Scene models inside each spotlight's cone, in the same order as g_Models
+bool                 LightVisible[NO_OF_LIGHTS];
+bool                 SpotLightVisible[NO_OF_SPOT_LIGHTS];
+
+// Temporary lists for a culling query. The camera and spotlight queries run as parallel jobs so each has its own
+struct SCullingQuery
+{
+	vector<gen::TUInt32> Items;   // Tree items returned by the query
+	vector<unsigned int> Results; // Culling objects found by the query
+};
+SCullingQuery CameraQuery;
+SCullingQuery SpotLightQueries[NO_OF_SPOT_LIGHTS];
+
+// Rebuild the dynamic tree when refitting has made it this much worse than a freshly built tree
+const float DynamicTreeMaxDegradation = 1.5f;
+
+// Occlusion culling - after frustum culling, the visible occluder models (large models marked with SetOccluder) are rasterised
+// into a low resolution depth buffer on the CPU, then the bounding box of each visible model is tested against it and models
+// hidden behind the occluders are dropped. Shadow casters and lights are not occlusion culled. Toggle with F6
+gen::COcclusionBuffer OcclusionBuffer;
+const unsigned int    OcclusionBufferWidth = 256; // Height is set from the viewport's aspect ratio
+bool                  OcclusionCulling = true;
+vector<gen::CAABB>    OccludeeBoxes;  // World bounding box of each visible model, gathered before the parallel tests
+vector<unsigned char> OccludeeHidden; // Result of the test for each visible model
+
+// Per-frame culling counters: models tested against the frustum, models culled, models hidden by occluders and models actually
+// rendered. Times for the two occlusion culling stages are in milliseconds
+struct SCullingStats
+{
+	unsigned int Tested;
+	unsigned int Culled;
+	unsigned int Occluded;
+	unsigned int Drawn;
+	float        RasteriseTime;
+	float        OcclusionTestTime;
+};
+SCullingStats CullingStats = { 0, 0, 0, 0, 0.0f, 0.0f };
+
+// Models to draw this frame, sorted to minimise state changes (opaque models front to back, then blended models back to front)
+CRenderQueue RenderQueue;
+
+// The scene is loaded from the binary scene file if there is one (made from the text file with the "-convertscene" command line
+// option), otherwise from the text file. Instances are read from the file in blocks of this many
+const char*        SceneTextFile = "Scene.txt";
+const char*        SceneBinaryFile = "Scene.scn";
+const unsigned int SceneInstanceBlockSize = 4096;
+
+// Stationary models sharing technique, material and colour are merged at load time into chunks of this size (on the ground)
+const float       StaticBatchChunkSize = 64.0f;
+SStaticBatchStats StaticBatchStats = { 0, 0, 0 };
+
 //Misc values
 float Wiggle = 0.0f;
 float PulseTime = 0.0f;
@@ -83,69 +176,97 @@ float PulseTime = 0.0f;
 //--------------------------------------------------------------------------------------
 // Variables to connect C++ code to HLSL shaders
 
-// Effects / techniques
-ID3D10Effect* Effect = NULL;
-
-CTechnique* PlainColourTechnique = NULL;
-CTechnique* DiffuseTexturedTechnique = NULL;
-CTechnique* WiggleAndScrollTechnique = NULL;
-CTechnique* PixelLightingTechnique = NULL;
-CTechnique* NormalMapTechnique = NULL;
-CTechnique* ParallaxMapTechnique = NULL;
-CTechnique* NoireShadingTechnique = NULL;
-CTechnique* AdditiveTexTintTechnique = NULL;
-CTechnique* ParallaxNoireShadeTechnique = NULL;
-CTechnique* AlphaCutoutTechnique = NULL;
-CTechnique* ParallaxOutlinedTechnique = NULL;
-CTechnique* PixelLitOutlinedTechnique = NULL;
-CTechnique* ShadowMapPixelLitTechnique = NULL;
-CTechnique* ShadowMapParallaxLitTechnique = NULL;
-CTechnique* DepthOnlyTechnique = NULL;
-CTechnique* CelShadingTechnique = NULL;
-CTechnique* ParallaxCelShadingTechnique = NULL;
-
-// Matrices
-ID3D10EffectMatrixVariable* ViewMatrixVar = NULL;
-ID3D10EffectMatrixVariable* ProjMatrixVar = NULL;
-ID3D10EffectMatrixVariable* ViewProjMatrixVar = NULL;
-
-// Lighting
-ID3D10EffectVectorVariable* CameraPositionVar = NULL;
-
-// Miscellaneous
-ID3D10EffectScalarVariable* WiggleVar = NULL;
+// Techniques are compiled from the effect file when first asked for, by their combination of features (see TechniqueLibrary.h).
+// Compiled code is kept in this folder so later runs only compile what has changed
+CTechniqueLibrary Techniques;
+const wchar_t* EffectCacheFolder = L"EffectCache";
+
+// The technique each number key switches every model to - the features for models without tangents, then for models with them
+// (i.e. with normal maps, so they can use parallax mapping)
+struct SRenderMode
+{
+	EKeyCode     Key;
+	unsigned int Features;
+	unsigned int TangentFeatures;
+};
+const SRenderMode RenderModes[] =
+{
+	{ Key_1, 0,                                        0 },                                                          // Plain model colour
+	{ Key_2, FeatureTexture,                           FeatureTexture },                                             // Basic material, no lighting
+	{ Key_3, FeatureTint | FeatureWiggle,              FeatureTint | FeatureWiggle },                                // Wiggle and scroll texture
+	{ Key_4, FeaturePixelLighting,                     FeaturePixelLighting },                                       // Per pixel lighting, no bump maps
+	{ Key_5, FeatureNormalMap,                         FeatureNormalMap },                                           // Normal mapping, no parallax
+	{ Key_6, FeatureParallax,                          FeatureParallax },                                            // Parallax mapping
+	{ Key_7, FeaturePixelLighting | FeatureOutline,    FeatureParallax | FeatureOutline },                           // Outlined
+	{ Key_8, FeatureNoirShading | FeatureOutline,      FeatureParallax | FeatureNoirShading | FeatureOutline },      // Black and white noire shading, outlined
+	{ Key_9, FeatureCelShading | FeatureOutline,       FeatureParallax | FeatureCelShading | FeatureOutline },       // Cel shading, outlined
+	{ Key_0, FeatureShadows,                           FeatureParallax | FeatureShadows },                           // Shadows from the spotlight
+};
+const unsigned int NumRenderModes = sizeof(RenderModes) / sizeof(RenderModes[0]);
 
 
 //--------------------------------------------------------------------------------------
 // DirectX Variables
 //--------------------------------------------------------------------------------------
 
-// The main D3D interface, this pointer is used to access most D3D functions (and is shared across all cpp files through Defines.h)
-ID3D10Device* g_pd3dDevice = NULL;
+// All resources are created and drawn through this backend (shared across all cpp files through RenderBackend.h). It is one of
+// the three below - the D3D10 backend when rendering to the window, the recording backend when running headless, the software
+// backend when rendering reference images on the CPU
+CRenderBackend* g_RenderBackend = NULL;
+CD3D10Backend* D3D10Backend = NULL;
+CRecordingBackend* RecordingBackend = NULL;
+CSoftwareBackend* SoftwareBackend = NULL;
+
+// Model, material and render queue state goes through this cache, which drops binds that repeat the current state (shared
+// across cpp files through StateCache.h)
+CStateCache g_StateCache;
+
+// The effect's constants are written through these buffers, grouped by how often they change (shared across cpp files through
+// ShaderConstants.h)
+CShaderConstants g_ShaderConstants;
+
+// The D3D10 backend gets its vertex layouts from this cache, so each vertex format and shader input signature has one layout (shared
+// across cpp files through InputLayoutCache.h)
+CInputLayoutCache g_InputLayoutCache;
+
+// All model draws are reported to this registry, which counts them by technique and model and spots models drawn twice in a pass
+// (shared across cpp files through DrawStats.h)
+CDrawStats g_DrawStats;
+
+// Files the draw statistics are exported to
+const char* DrawStatsCSVFile = "DrawStats.csv";
+const char* DrawStatsJSONFile = "DrawStats.json";
+
+// Headless runs render at this size with a fixed update time, so each run of the same scene gives the same commands. The report and
+// the commands of the last frame are written to these files
+const int          HeadlessWidth = 1280;
+const int          HeadlessHeight = 960;
+const float        HeadlessFrameTime = 1.0f / 60.0f;
+const char*        HeadlessReportFile = "Headless.txt";
+const char*        HeadlessCommandsFile = "HeadlessCommands.txt";
+
+// Software renders are the same size as headless runs. The last frame and the spotlight's shadow map are written to image files,
+// and the frame is compared with the reference image if there is one - channels may differ by the tolerance. The frame is then
+// rendered again, on one thread and then on all of them, to time the rasteriser
+const char*        SoftwareImageFile = "SoftwareFrame.bmp";
+const char*        SoftwareShadowMapFile = "SoftwareShadowMap.bmp";
+const char*        SoftwareReferenceFile = "SoftwareReference.bmp";
+const char*        SoftwareReportFile = "SoftwareRender.txt";
+const unsigned int SoftwareReferenceTolerance = 2;
+const unsigned int SoftwareBenchmarkFrames = 20;
 
 // Width and height of the window viewport
 int g_ViewportWidth;
 int g_ViewportHeight;
 
-// Variables used to setup D3D
-IDXGISwapChain*         SwapChain = NULL;
-ID3D10Texture2D*        DepthStencil = NULL;
-ID3D10DepthStencilView* DepthStencilView = NULL;
-ID3D10RenderTargetView* RenderTargetView = NULL;
+// Transform recalculation counters (shared across all cpp files through Defines.h)
+STransformStats g_TransformStats = { { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 } };
 
 //--------------------------------------------------------------------------------------
 // Create Direct3D device and swap chain
 //--------------------------------------------------------------------------------------
 bool InitDevice(HWND hWnd)
 {
-	// Many DirectX functions return a "HRESULT" variable to indicate success or failure. Microsoft code often uses
-	// the FAILED macro to test this variable, you'll see it throughout the code - it's fairly self explanatory.
-	HRESULT hr = S_OK;
-
-
-	////////////////////////////////a
-	// Initialise Direct3D
-
 	// Calculate the visible area the window we are using - the "client rectangle" refered to in the first function is the 
 	// size of the interior of the window, i.e. excluding the frame and title
 	RECT rc;
@@ -153,75 +274,52 @@ bool InitDevice(HWND hWnd)
 	g_ViewportWidth = rc.right - rc.left;
 	g_ViewportHeight = rc.bottom - rc.top;
 
-	// Create a Direct3D device (i.e. initialise D3D), and create a swap-chain (create a back buffer to render to)
-	DXGI_SWAP_CHAIN_DESC sd;         // Structure to contain all the information needed
-	ZeroMemory( &sd, sizeof( sd ) ); // Clear the structure to 0 - common Microsoft practice, not really good style
-	sd.BufferCount = 1;
-	sd.BufferDesc.Width = g_ViewportWidth;             // Target window size
-	sd.BufferDesc.Height = g_ViewportHeight;           // --"--
-	sd.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM; // Pixel format of target window
-	sd.BufferDesc.RefreshRate.Numerator = 60;          // Refresh rate of monitor
-	sd.BufferDesc.RefreshRate.Denominator = 1;         // --"--
-	sd.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-	sd.SampleDesc.Count = 1;
-	sd.SampleDesc.Quality = 0;
-	sd.OutputWindow = hWnd;                            // Target window
-	sd.Windowed = TRUE;                                 // Whether to render in a window (TRUE) or go fullscreen (FALSE)
-	hr = D3D10CreateDeviceAndSwapChain( NULL, D3D10_DRIVER_TYPE_HARDWARE, NULL, 0,
-										D3D10_SDK_VERSION, &sd, &SwapChain, &g_pd3dDevice );
-	if( FAILED( hr ) ) return false;
-
-
-	// Specify the render target as the back-buffer - this is an advanced topic. This code almost always occurs in the standard D3D setup
-	ID3D10Texture2D* pBackBuffer;
-	hr = SwapChain->GetBuffer( 0, __uuidof( ID3D10Texture2D ), ( LPVOID* )&pBackBuffer );
-	if( FAILED( hr ) ) return false;
-	hr = g_pd3dDevice->CreateRenderTargetView( pBackBuffer, NULL, &RenderTargetView );
-	pBackBuffer->Release();
-	if( FAILED( hr ) ) return false;
-
-
-	// Create a texture (bitmap) to use for a depth buffer
-	D3D10_TEXTURE2D_DESC descDepth;
-	descDepth.Width = g_ViewportWidth;
-	descDepth.Height = g_ViewportHeight;
-	descDepth.MipLevels = 1;
-	descDepth.ArraySize = 1;
-	descDepth.Format = DXGI_FORMAT_D32_FLOAT;
-	descDepth.SampleDesc.Count = 1;
-	descDepth.SampleDesc.Quality = 0;
-	descDepth.Usage = D3D10_USAGE_DEFAULT;
-	descDepth.BindFlags = D3D10_BIND_DEPTH_STENCIL;
-	descDepth.CPUAccessFlags = 0;
-	descDepth.MiscFlags = 0;
-	hr = g_pd3dDevice->CreateTexture2D( &descDepth, NULL, &DepthStencil );
-	if( FAILED( hr ) ) return false;
-
-	// Create the depth stencil view, i.e. indicate that the texture just created is to be used as a depth buffer
-	D3D10_DEPTH_STENCIL_VIEW_DESC descDSV;
-	descDSV.Format = descDepth.Format;
-	descDSV.ViewDimension = D3D10_DSV_DIMENSION_TEXTURE2D;
-	descDSV.Texture2D.MipSlice = 0;
-	hr = g_pd3dDevice->CreateDepthStencilView( DepthStencil, &descDSV, &DepthStencilView );
-	if( FAILED( hr ) ) return false;
-
-	// Select the back buffer and depth buffer to use for rendering now
-	g_pd3dDevice->OMSetRenderTargets( 1, &RenderTargetView, DepthStencilView );
-
-
-	// Setup the viewport - defines which part of the window we will render to, almost always the whole window
-	D3D10_VIEWPORT vp;
-	vp.Width  = g_ViewportWidth;
-	vp.Height = g_ViewportHeight;
-	vp.MinDepth = 0.0f;
-	vp.MaxDepth = 1.0f;
-	vp.TopLeftX = 0;
-	vp.TopLeftY = 0;
-	g_pd3dDevice->RSSetViewports( 1, &vp );
+	// The backend creates the device, swap chain and depth buffer, and selects them for rendering
+	D3D10Backend = new CD3D10Backend;
+	if (!D3D10Backend->Create( hWnd, g_ViewportWidth, g_ViewportHeight ))
+	{
+		return false;
+	}
+	g_RenderBackend = D3D10Backend;
+	g_StateCache.SetBackend( g_RenderBackend );
+	g_ShaderConstants.SetBackend( g_RenderBackend );
 
 	return true;
 }
 
+//--------------------------------------------------------------------------------------
+// Create the recording backend instead of a device, to update and render the scene without a window
+//--------------------------------------------------------------------------------------
+void InitHeadless(int width, int height)
+{
+	g_ViewportWidth = width;
+	g_ViewportHeight = height;
+
+	RecordingBackend = new CRecordingBackend;
+	g_RenderBackend = RecordingBackend;
+	g_StateCache.SetBackend( g_RenderBackend );
+	g_ShaderConstants.SetBackend( g_RenderBackend );
+}
+
+//--------------------------------------------------------------------------------------
+// Create the software backend instead of a device, to render the scene on the CPU without a window
+//--------------------------------------------------------------------------------------
+bool InitSoftware(int width, int height)
+{
+	g_ViewportWidth = width;
+	g_ViewportHeight = height;
+
+	SoftwareBackend = new CSoftwareBackend;
+	if (!SoftwareBackend->Create( width, height ))
+	{
+		return false;
+	}
+	g_RenderBackend = SoftwareBackend;
+	g_StateCache.SetBackend( g_RenderBackend );
+	g_ShaderConstants.SetBackend( g_RenderBackend );
+	return true;
+}
+
 //--------------------------------------------------------------------------------------
 // Load and compile Effect file (.fx file containing shaders)
 //--------------------------------------------------------------------------------------
@@ -231,94 +329,44 @@ bool InitDevice(HWND hWnd)
 //
 bool LoadEffectFile()
 {
-	// Compile and link the effect file
-	ID3D10Blob* pErrors; // This strangely typed variable collects any errors when compiling the effect file
 	DWORD dwShaderFlags = 0; // These "flags" are used to set the compiler options
 #if defined(DEBUG)|| defined(_DEBUG)
 	//dwShaderFlags |= D3D10_SHADER_DEBUG;
 	//dwShaderFlags |= D3D10_SHADER_SKIP_OPTIMIZATION;
 #endif
 
-	// Load and compile the effect file
-	HRESULT hr = D3DX10CreateEffectFromFile( L"GraphicsAssign1.fx", NULL, NULL, "fx_4_0", dwShaderFlags, 0, g_pd3dDevice, NULL, NULL, &Effect, &pErrors, NULL );
-	if( FAILED( hr ) )
+	// Create the variables shared by every technique, the techniques themselves are created when first used. Running headless there
+	// is no device, so nothing is compiled
+	ID3D10Device* device = D3D10Backend ? D3D10Backend->GetDevice() : NULL;
+	if (!Techniques.Create( device, L"GraphicsAssign1.fx", NO_OF_LIGHTS, NO_OF_SPOT_LIGHTS, dwShaderFlags, EffectCacheFolder ))
 	{
-		if (pErrors != 0)  MessageBox( NULL, CA2CT(reinterpret_cast<char*>(pErrors->GetBufferPointer())), L"Error", MB_OK ); // Compiler error: display error message
-		else               MessageBox( NULL, L"Error loading FX file. Ensure your FX file is in the same folder as this executable.", L"Error", MB_OK );  // No error message - probably file not found
+		MessageBox( NULL, CA2CT(Techniques.GetError().c_str()), L"Error", MB_OK );
 		return false;
 	}
 
-	// Select techniques from compiled effect file
-	PlainColourTechnique =			new CTechnique(Effect->GetTechniqueByName("PlainColour"), false, false, false);
-	DiffuseTexturedTechnique =		new CTechnique(Effect->GetTechniqueByName("DiffuseTex"), true, false, false);
-	WiggleAndScrollTechnique =		new CTechnique(Effect->GetTechniqueByName("WiggleAndScroll"), true, false, false);
-	PixelLightingTechnique =		new CTechnique(Effect->GetTechniqueByName("PixDiffSpec"), true, false, false);
-	NormalMapTechnique =			new CTechnique(Effect->GetTechniqueByName("NormalMapping"), true, true, false);
-	ParallaxMapTechnique =			new CTechnique(Effect->GetTechniqueByName("ParallaxMapping"), true, true, false);
-	NoireShadingTechnique =			new CTechnique(Effect->GetTechniqueByName("NoireShading"), false, false, true);
-	AdditiveTexTintTechnique =		new CTechnique(Effect->GetTechniqueByName("AdditiveTexTint"), true, false, false);
-	ParallaxNoireShadeTechnique =	new CTechnique(Effect->GetTechniqueByName("ParallaxNoireShaded"), true, true, true);
-	AlphaCutoutTechnique =			new CTechnique(Effect->GetTechniqueByName("AlphaCutout"), true, false, false);
-	ParallaxOutlinedTechnique =		new CTechnique(Effect->GetTechniqueByName("ParallaxOutlined"), true, true, false);
-	PixelLitOutlinedTechnique =		new CTechnique(Effect->GetTechniqueByName("PixelLitOutlined"), true, false, false);
-	ShadowMapPixelLitTechnique =	new CTechnique(Effect->GetTechniqueByName("ShadowMappingPixelLit"), true, false, false);
-	ShadowMapParallaxLitTechnique = new CTechnique(Effect->GetTechniqueByName("ShadowMappingParallaxLit"), true, true, true);
-	DepthOnlyTechnique =			new CTechnique(Effect->GetTechniqueByName("DepthOnly"), false, false, false);
-	CelShadingTechnique =			new CTechnique(Effect->GetTechniqueByName("CelShading"), true, false, true);
-	ParallaxCelShadingTechnique =	new CTechnique(Effect->GetTechniqueByName("ParallaxCelShading"), true, true, true);
-
-	// Push techniques onto the model technique list
-	CModel::m_TechniqueList.push_back(PlainColourTechnique);
-	CModel::m_TechniqueList.push_back(DiffuseTexturedTechnique);
-	CModel::m_TechniqueList.push_back(WiggleAndScrollTechnique);
-	CModel::m_TechniqueList.push_back(PixelLightingTechnique);
-	CModel::m_TechniqueList.push_back(NormalMapTechnique);
-	CModel::m_TechniqueList.push_back(ParallaxMapTechnique);
-	CModel::m_TechniqueList.push_back(NoireShadingTechnique);
-	CModel::m_TechniqueList.push_back(AdditiveTexTintTechnique);
-	CModel::m_TechniqueList.push_back(ParallaxNoireShadeTechnique);
-	CModel::m_TechniqueList.push_back(AlphaCutoutTechnique);
-	CModel::m_TechniqueList.push_back(ParallaxOutlinedTechnique);
-	CModel::m_TechniqueList.push_back(PixelLitOutlinedTechnique);
-	CModel::m_TechniqueList.push_back(ShadowMapPixelLitTechnique);
-	CModel::m_TechniqueList.push_back(ShadowMapParallaxLitTechnique);
-	CModel::m_TechniqueList.push_back(DepthOnlyTechnique);
-	CModel::m_TechniqueList.push_back(CelShadingTechnique);
-	CModel::m_TechniqueList.push_back(ParallaxCelShadingTechnique);
-
-	CModel::SetShadowRenderTechnique(DepthOnlyTechnique);
+	// Shadow maps are always rendered, so their technique is compiled now - any error in the effect file shows here
+	CTechnique* depthOnlyTechnique = Techniques.GetTechnique(FeatureDepthOnly);
+	if (!depthOnlyTechnique)
+	{
+		MessageBox( NULL, CA2CT(Techniques.GetError().c_str()), L"Error", MB_OK );
+		return false;
+	}
+	CModel::SetShadowRenderTechnique(depthOnlyTechnique);
 	
 	//--------------------------------------------
 	// Create links to effect file globals
 	//--------------------------------------------
-	
-	// Matrix data
-	CModel::SetMatrixShaderVariable(Effect->GetVariableByName( "WorldMatrix" )->AsMatrix());
-	ViewProjMatrixVar =				Effect->GetVariableByName("ViewProjMatrix")->AsMatrix();
-	ViewMatrixVar =					Effect->GetVariableByName("ViewMatrix")->AsMatrix();
-	ProjMatrixVar =					Effect->GetVariableByName("ProjMatrix")->AsMatrix();
-
-	// Material data
-	CMaterial::SetDiffuseSpecularShaderVariable(	Effect->GetVariableByName("DiffuseMap")->AsShaderResource());
-	CMaterial::SetSpecularPowerShaderVariable(		Effect->GetVariableByName("SpecularPower")->AsScalar());
-	CMaterial::SetNormalMapShaderVariable(			Effect->GetVariableByName("NormalMap")->AsShaderResource());
-	CMaterial::SetParallaxDepthShaderVariable(		Effect->GetVariableByName("ParallaxDepth")->AsScalar());
-	CMaterial::SetCelGradientShaderVariable(		Effect->GetVariableByName("CelGradient")->AsShaderResource());
-	CMaterial::SetOutlineThicknessShaderVariable(	Effect->GetVariableByName("OutlineThickness")->AsScalar());
 
-	// Camera data
-	CameraPositionVar = Effect->GetVariableByName("CameraPos")->AsVector();
-	
-	// Main Lighting data is Assigned in InitScene (So the lighting objects can first be created) - due to there being multiple lighting
-	
-	// Ambient light data
-	CAmbientLight::SetColourVar(Effect->GetVariableByName("AmbientColour")->AsVector());
+	// The globals are shared by all the techniques, so the D3D10 backend connects its texture slots and constant buffers to the
+	// effect they are shared from. Matrices, camera, lighting, material values and model data are in the constant buffers, which
+	// are written as a whole
+	if (D3D10Backend && !D3D10Backend->SetSharedEffect( Techniques.GetSharedEffect() ))
+	{
+		MessageBox( NULL, L"Error finding the effect's textures and constant buffers. Ensure the cbuffers in the FX file match ShaderConstants.h.", L"Error", MB_OK );
+		return false;
+	}
 
-	// Model data
-	CModel::SetColourShaderVariable(Effect->GetVariableByName("ModelColour")->AsVector());
-	
-	// Other shader variables
-	WiggleVar = Effect->GetVariableByName("Wiggle")->AsScalar();
+	// Each light is given its place in the light set constants in InitScene (So the lighting objects can first be created)
 
 	return true;
 }
@@ -327,405 +375,327 @@ bool LoadEffectFile()
 // Scene Setup / Update / Rendering
 //--------------------------------------------------------------------------------------
 
-// Create / load the camera, models and Materials for the scene
-bool InitScene()
-{
-	// Create camera
-	Camera = new CCamera();
-	Camera->SetPosition(D3DXVECTOR3(30.0f, 30.0f, -75.0f));
-	Camera->SetRotation( D3DXVECTOR3(ToRadians(0.0f), ToRadians(-30.0f), 0.0f));
-
-	// Material initialisation
-
-	// Create Material objects
-	CMaterial* StoneMaterial		= new CMaterial();
-	CMaterial* WoodMaterial			= new CMaterial();
-	CMaterial* GrassMaterial		= new CMaterial();
-	CMaterial* BrainMaterial		= new CMaterial();
-	CMaterial* PatternMaterial		= new CMaterial();
-	CMaterial* CobbleMaterial		= new CMaterial();
-	CMaterial* TechMaterial			= new CMaterial();
-	CMaterial* WallMaterial			= new CMaterial();
-	CMaterial* Troll1Material		= new CMaterial();
-	CMaterial* LightMaterial		= new CMaterial();
-	CMaterial* ThunderboltMaterial	= new CMaterial();
-	CMaterial* FlamesMaterial		= new CMaterial();
-	CMaterial* GreenMaterial		= new CMaterial();
-
-	// Push Material objects onto Material list
-	CModel::m_MaterialList.push_back(StoneMaterial);
-	CModel::m_MaterialList.push_back(WoodMaterial);
-	CModel::m_MaterialList.push_back(GrassMaterial);
-	CModel::m_MaterialList.push_back(BrainMaterial);
-	CModel::m_MaterialList.push_back(PatternMaterial);
-	CModel::m_MaterialList.push_back(CobbleMaterial);
-	CModel::m_MaterialList.push_back(TechMaterial);
-	CModel::m_MaterialList.push_back(WallMaterial);
-	CModel::m_MaterialList.push_back(Troll1Material);
-	CModel::m_MaterialList.push_back(LightMaterial);
-	CModel::m_MaterialList.push_back(ThunderboltMaterial);
-	CModel::m_MaterialList.push_back(FlamesMaterial);
-
-	
-	// Load Texture maps from file and set other material variables
-	if (!StoneMaterial->LoadDiffSpecMap(TEXT("StoneDiffuseSpecular.dds")))		return false;
-	StoneMaterial->SetSpecularPower(64.0f);
-	if (!StoneMaterial->LoadCelGradient(TEXT("CelGradient.png")))				return false;
-	StoneMaterial->SetOutlineThickness(0.035f);
-
-	if (!WoodMaterial->LoadDiffSpecMap(TEXT("WoodDiffuseSpecular.dds")))		return false;
-	WoodMaterial->SetSpecularPower(64.0f);
-	if (!WoodMaterial->LoadNormalMap(TEXT("WoodNormal.dds")))					return false;
-	WoodMaterial->SetParallaxDepth(0.08f);
-	if (!WoodMaterial->LoadCelGradient(TEXT("CelGradient.png")))				return false;
-	WoodMaterial->SetOutlineThickness(0.035f);
-
-	if (!GrassMaterial->LoadDiffSpecMap(TEXT("GrassDiffuseSpecular.dds")))		return false;
-	GrassMaterial->SetSpecularPower(64.0f);
-	if (!GrassMaterial->LoadCelGradient(TEXT("CelGradient.png")))				return false;
-	GrassMaterial->SetOutlineThickness(0.035f);
-
-	if (!BrainMaterial->LoadDiffSpecMap(TEXT("BrainDiffuseSpecular.dds")))		return false;
-	BrainMaterial->SetSpecularPower(16.0f);
-	if (!BrainMaterial->LoadNormalMap(TEXT("BrainNormalDepth.dds")))			return false;
-	BrainMaterial->SetParallaxDepth(0.08f);
-	if (!BrainMaterial->LoadCelGradient(TEXT("CelGradient.png")))				return false;
-	BrainMaterial->SetOutlineThickness(0.035f);
-
-	if (!PatternMaterial->LoadDiffSpecMap(TEXT("PatternDiffuseSpecular.dds")))	return false;
-	PatternMaterial->SetSpecularPower(8.0f);
-	if (!PatternMaterial->LoadNormalMap(TEXT("PatternNormalDepth.dds")))		return false;
-	PatternMaterial->SetParallaxDepth(0.08f);
-	if (!PatternMaterial->LoadCelGradient(TEXT("CelGradient.png")))				return false;
-	PatternMaterial->SetOutlineThickness(0.035f);
-
-	if (!CobbleMaterial->LoadDiffSpecMap(TEXT("CobbleDiffuseSpecular.dds")))	return false;
-	CobbleMaterial->SetSpecularPower(64.0f);
-	if (!CobbleMaterial->LoadNormalMap(TEXT("CobbleNormalDepth.dds")))			return false;
-	CobbleMaterial->SetParallaxDepth(0.08f);
-	if (!CobbleMaterial->LoadCelGradient(TEXT("CelGradient.png")))				return false;
-	CobbleMaterial->SetOutlineThickness(0.035f);
-
-	if (!TechMaterial->LoadDiffSpecMap(TEXT("TechDiffuseSpecular.dds")))		return false;
-	TechMaterial->SetSpecularPower(64.0f);
-	if (!TechMaterial->LoadNormalMap(TEXT("TechNormalDepth.dds")))				return false;
-	TechMaterial->SetParallaxDepth(0.08f);
-	if (!TechMaterial->LoadCelGradient(TEXT("CelGradient.png")))				return false;
-	TechMaterial->SetOutlineThickness(0.035f);
-
-	if (!WallMaterial->LoadDiffSpecMap(TEXT("WallDiffuseSpecular.dds")))		return false;
-	WallMaterial->SetSpecularPower(128.0f);
-	if (!WallMaterial->LoadNormalMap(TEXT("WallNormalDepth.dds")))				return false;
-	WallMaterial->SetParallaxDepth(0.08f);
-	if (!WallMaterial->LoadCelGradient(TEXT("CelGradient.png")))				return false;
-	WallMaterial->SetOutlineThickness(0.035f);
-
-	if (!Troll1Material->LoadDiffSpecMap(TEXT("Troll3DiffuseSpecular.dds")))	return false;
-	Troll1Material->SetSpecularPower(16.0f);
-	if (!Troll1Material->LoadCelGradient(TEXT("CelGradient.png")))				return false;
-	Troll1Material->SetOutlineThickness(0.035f);
-		
-	if (!ThunderboltMaterial->LoadDiffSpecMap(TEXT("thdbolt.jpg")))				return false;
-	ThunderboltMaterial->SetSpecularPower(2.0f);
-	if (!ThunderboltMaterial->LoadCelGradient(TEXT("CelGradient.png")))			return false;
-
-	if (!LightMaterial->LoadDiffSpecMap(TEXT("Flare.jpg")))						return false;
-	LightMaterial->SetSpecularPower(64.0f);
-
-	if (!FlamesMaterial->LoadDiffSpecMap(TEXT("flames4.png")))					return false;
-	FlamesMaterial->SetSpecularPower(64.0f);
-
-	if (!GreenMaterial->LoadDiffSpecMap(TEXT("Green.png")))						return false;
-	GreenMaterial->SetSpecularPower(64.0f);
-
-	// Model initialisation
-
-	// Load/Create models
-	for (int i = 0; i < 8; i++)
-	{
-		g_Models.push_back(new CModel);
-	}
-
-	// Set Model Materials 
-
-	g_Models[0]->SetMaterial(WallMaterial);
-	g_Models[1]->SetMaterial(PatternMaterial);
-	g_Models[2]->SetMaterial(WoodMaterial);
-	g_Models[3]->SetMaterial(StoneMaterial);
-	g_Models[4]->SetMaterial(Troll1Material);
-	g_Models[5]->SetMaterial(BrainMaterial);
-	g_Models[6]->SetMaterial(ThunderboltMaterial);
-	g_Models[7]->SetMaterial(GreenMaterial);
-	
-	// Set Model Colours
-	
-	// Constant colours used for models in initial shaders
-	D3DXVECTOR3 Black(0.0f, 0.0f, 0.0f);
-	D3DXVECTOR3 Blue(0.0f, 0.0f, 1.0f);
-	D3DXVECTOR3 Yellow(1.0f, 1.0f, 0.0f);
-	D3DXVECTOR3 Red(1.0f, 0.0f, 0.0f);
-	D3DXVECTOR3 Green(0.0f, 1.0f, 0.0f);
-
-	g_Models[0]->SetColour(Red);
-	g_Models[1]->SetColour(Green);
-	g_Models[2]->SetColour(Blue);
-	g_Models[3]->SetColour(Yellow);
-	g_Models[4]->SetColour(Black);
-	g_Models[5]->SetColour(Red);
-	g_Models[6]->SetColour(Yellow);	
-	g_Models[7]->SetColour(Green);
-
-	
-	// Set Render Techniques and load models
-
-	// The model class can load ".X" files. It encapsulates (i.e. hides away from this code) the file loading/parsing and creation of vertex/index buffers
-	// We must pass an example technique used for each model. We can then only render models with techniques that uses matching vertex input data
-	if (!g_Models[0]->Load(	"Cube.x",			NormalMapTechnique			))	return false;
-	if (!g_Models[1]->Load(	"Teapot.x",			ParallaxMapTechnique		))	return false;
-	if (!g_Models[2]->Load(	"Floor.x",			ParallaxMapTechnique		))	return false;
-	if (!g_Models[3]->Load(	"Sphere.x",			WiggleAndScrollTechnique	))	return false;		
-	if (!g_Models[4]->Load(	"Troll.x",			NoireShadingTechnique		))	return false;
-	if (!g_Models[5]->Load(	"Hills.x",			ParallaxOutlinedTechnique	))	return false;
-	if (!g_Models[6]->Load( "A10Thunderbolt.x",	PixelLitOutlinedTechnique	))	return false;
-	if (!g_Models[7]->Load( "Troll.x",			CelShadingTechnique			))	return false;
-	
-	
-	// Set Initial Positions/Scales of models
-	g_Models[0]->SetPosition(D3DXVECTOR3(0.0f, 10.0f, 0.0f));
-
-	g_Models[1]->SetPosition(D3DXVECTOR3(10.0f, 20.0f, 50.0f));
+void BuildCullingTrees();
+void ExportDrawStats();
 
-	g_Models[2]->SetPosition(D3DXVECTOR3(0.0f, 0.0f, 0.0f));
-	
-	g_Models[3]->SetPosition(D3DXVECTOR3(-40.0f, 15.0f, 20.0f));
-	g_Models[3]->SetScale(0.7f);
-
-	g_Models[4]->SetPosition(D3DXVECTOR3(-120.0f, 0.0f, 140.0f));
-	g_Models[4]->SetScale(50.0f);
-	g_Models[4]->SetRotation(D3DXVECTOR3(0.0f, ToRadians(-45.0f), 0.0f));
-
-	g_Models[5]->SetPosition(D3DXVECTOR3(0.0f, 0.0f, 400.0f));
-	g_Models[5]->SetRotation(D3DXVECTOR3(ToRadians(-20.0f), 0.0f, 0.0f));
+// Show a scene loading error, returns false to pass on the failure
+bool SceneError(const string& message)
+{
+	MessageBox( NULL, CA2CT(message.c_str()), L"Error", MB_OK );
+	return false;
+}
 
-	g_Models[6]->SetPosition(D3DXVECTOR3(-128.0f, 32.5f, 45.0f));
-	g_Models[6]->SetScale(5.0f);
-	g_Models[6]->SetRotation(D3DXVECTOR3(ToRadians(15.0f), ToRadians(120.0f), 0.0f));
+bool FileExists(const char* fileName)
+{
+	return GetFileAttributesA(fileName) != INVALID_FILE_ATTRIBUTES;
+}
 
-	g_Models[7]->SetPosition(D3DXVECTOR3(-25.0f, 1.0f, 80.0f));
-	g_Models[7]->SetScale(10.0f);
+// Angles in scene files are in degrees
+D3DXVECTOR3 SceneAngles(const gen::CVector3& degrees)
+{
+	return D3DXVECTOR3(ToRadians(degrees.x), ToRadians(degrees.y), ToRadians(degrees.z));
+}
 
-	// Load/Create lights and light models
+// Textures loaded for the scene's materials by file name, so materials using the same texture share it
+typedef map<string, TTextureHandle> TTextureCache;
 
-	AmbientLight =	new CAmbientLight(D3DXVECTOR3(0.2f, 0.2f, 0.2f));
-	
-	for (unsigned int i = 0; i < NO_OF_LIGHTS; i++)
+// Get a texture from the cache, loading it if this is its first use. The caller gets its own reference. An empty file name gives
+// NULL. Returns false if the file could not be loaded
+bool LoadCachedTexture(TTextureCache& textures, const string& fileName, TTextureHandle* texture)
+{
+	*texture = NULL;
+	if (fileName.empty())
 	{
-		Lights[i] = new CPositionalLight;
+		return true;
 	}
-	for (unsigned int i = 0; i < NO_OF_SPOT_LIGHTS; i++)
+	TTextureCache::iterator cached = textures.find(fileName);
+	if (cached == textures.end())
 	{
-		SpotLight[i] = new CSpotLight;
-
+		TTextureHandle loaded = g_RenderBackend->LoadTexture(fileName);
+		if (!loaded)
+		{
+			return false;
+		}
+		cached = textures.insert(make_pair(fileName, loaded)).first;
 	}
+	*texture = cached->second;
+	g_RenderBackend->AddRef(*texture);
+	return true;
+}
 
-	SpotLight[0]->SetDiffuseColourVar(Effect->GetVariableByName("SpotLight1DiffuseCol")->AsVector());
-	SpotLight[0]->SetSpecularColourVar(Effect->GetVariableByName("SpotLight1SpecularCol")->AsVector());
-	SpotLight[0]->SetPositionVar(Effect->GetVariableByName("SpotLight1Position")->AsVector());
-	SpotLight[0]->SetFacingVectorVar(Effect->GetVariableByName("SpotLight1Facing")->AsVector());
-	SpotLight[0]->SetViewMatrixVar(Effect->GetVariableByName("SpotLight1ViewMatrix")->AsMatrix());
-	SpotLight[0]->SetProjMatrixVar(Effect->GetVariableByName("SpotLight1ProjMatrix")->AsMatrix());
-	SpotLight[0]->SetViewProjMatrixVar(Effect->GetVariableByName("SpotLight1ViewProjMatrix")->AsMatrix());
-	SpotLight[0]->SetConeAngleVar(Effect->GetVariableByName("SpotLight1CosHalfAngle")->AsScalar());
-	SpotLight[0]->SetShadowMapVar(Effect->GetVariableByName("SpotLight1ShadowMap")->AsShaderResource());
-
-	for (unsigned int i = 0; i < NO_OF_SPOT_LIGHTS; i++)
+// Create the camera, ambient light, materials and models described by a scene file (text or binary), and place the lights. The
+// lights must already exist. Each texture is loaded once however many materials use it, and each mesh file once for each technique
+// it is used with - the other instances share that model's geometry. Instances are read from the file a block at a time, each
+// model going straight into the transform store as it is created. Shows a message and returns false on any error
+bool LoadScene(const char* fileName)
+{
+	CSceneFile scene;
+	if (!scene.Open(fileName))
 	{
-		if (!SpotLight[i]->CreateShadowMap(g_pd3dDevice))	return false;
+		return SceneError(scene.GetError());
 	}
 
-	// Set light shader variables
+	// Camera and ambient light
+	Camera = new CCamera(gen::ToD3DXVECTOR(scene.GetCameraPosition()), SceneAngles(scene.GetCameraRotation()));
+	AmbientLight = new CAmbientLight(gen::ToD3DXVECTOR(scene.GetAmbientColour()));
 
-	//Light Colours
-	Lights[0]->SetDiffuseColourVar(Effect->GetVariableByName("Light1DiffuseCol")->AsVector());
-	Lights[1]->SetDiffuseColourVar(Effect->GetVariableByName("Light2DiffuseCol")->AsVector());
-	Lights[2]->SetDiffuseColourVar(Effect->GetVariableByName("Light3DiffuseCol")->AsVector());
-	Lights[0]->SetSpecularColourVar(Effect->GetVariableByName("Light1SpecularCol")->AsVector());
-	Lights[1]->SetSpecularColourVar(Effect->GetVariableByName("Light2SpecularCol")->AsVector());
-	Lights[2]->SetSpecularColourVar(Effect->GetVariableByName("Light3SpecularCol")->AsVector());
+	// Get the code for the scene's techniques and those the number keys switch to, compiling any that aren't in the effect cache
+	// in parallel. Names that aren't recognised are reported below
+	const vector<string>& techniqueNames = scene.GetTechniques();
+	vector<unsigned int> featureSets;
+	for (unsigned int i = 0; i < techniqueNames.size(); i++)
+	{
+		unsigned int features;
+		if (CTechniqueLibrary::ParseName(techniqueNames[i], &features))
+		{
+			featureSets.push_back(features);
+		}
+	}
+	for (unsigned int mode = 0; mode < NumRenderModes; mode++)
+	{
+		featureSets.push_back(RenderModes[mode].Features);
+		featureSets.push_back(RenderModes[mode].TangentFeatures);
+	}
+	Techniques.Precompile(featureSets, Jobs);
 
-	//Light Positions
-	Lights[0]->SetPositionVar(Effect->GetVariableByName("Light1Position")->AsVector());
-	Lights[1]->SetPositionVar(Effect->GetVariableByName("Light2Position")->AsVector());
-	Lights[2]->SetPositionVar(Effect->GetVariableByName("Light3Position")->AsVector());
-	
-	
+	// Techniques are found by name
+	vector<CTechnique*> techniques(techniqueNames.size(), NULL);
+	for (unsigned int i = 0; i < techniqueNames.size(); i++)
+	{
+		techniques[i] = Techniques.GetTechnique(techniqueNames[i]);
+		if (!techniques[i])
+		{
+			return SceneError(string(fileName) + " uses technique " + techniqueNames[i] + ": " + Techniques.GetError());
+		}
+	}
 
-	
-	// Light Positioning, colour data etc
-
-	Lights[0]->SetPosition(D3DXVECTOR3(30.0f, 10.0f, 0.0f));
-	Lights[0]->SetScale(4.0f);
-	Lights[0]->SetIsStationary(false);
-	Lights[0]->SetDiffuseColour(D3DXVECTOR3(1.0f, 0.0f, 0.0f) * 10.0f);
-	Lights[0]->SetSpecularColour(D3DXVECTOR3(1.0f, 0.0f, 0.0f) * 1.5f);
-
-	Lights[1]->SetPosition( D3DXVECTOR3(-20.0f, 30.0f, 50.0f) );			
-	Lights[1]->SetScale( 4.0f );
-	Lights[1]->SetIsStationary(true);
-	Lights[1]->SetSpecularColour( D3DXVECTOR3(1.0f, 0.0f, 0.7f) * 15.0f);
-	Lights[1]->SetDiffuseColour(  D3DXVECTOR3(1.0f, 0.0f, 0.7f) * 15.f);
-
-	Lights[2]->SetPosition(D3DXVECTOR3(-90.0f, 21.0f, 23.1f));
-	Lights[2]->SetScale(4.0f);
-	Lights[2]->SetRotation(D3DXVECTOR3(ToRadians(-15.0f), ToRadians(300.0f), 0.0f));
-	Lights[2]->SetIsStationary(true);
-	Lights[2]->SetDiffuseColour(D3DXVECTOR3(1.0f, 0.2f, 0.0f) * 20.0f);
-	Lights[2]->SetSpecularColour(D3DXVECTOR3(1.0f, 0.2f, 0.0f) * 15.0f);
-
-	SpotLight[0]->SetPosition(D3DXVECTOR3(20.0f, 20.0f, 20.0f));
-	SpotLight[0]->FacePoint(D3DXVECTOR3(0.0f, 0.0f, 50.0f));
-	SpotLight[0]->SetConeAngle(90.0f);
-	SpotLight[0]->SetScale(4.0f); 
-	SpotLight[0]->SetIsStationary(false);
-	SpotLight[0]->SetDiffuseColour(D3DXVECTOR3(1.0f, 0.0f, 0.0f) * 50.0f);
-	SpotLight[0]->SetSpecularColour(D3DXVECTOR3(1.0f, 0.0f, 0.0f) * 1.5f);
+	// Materials, added to the material list which owns them
+	const vector<SSceneMaterial>& sceneMaterials = scene.GetMaterials();
+	vector<CMaterial*> materials;
+	TTextureCache textures;
+	string missingTexture;
+	for (unsigned int i = 0; i < sceneMaterials.size() && missingTexture.empty(); i++)
+	{
+		const SSceneMaterial& sceneMaterial = sceneMaterials[i];
+		TTextureHandle diffuseSpecularMap;
+		TTextureHandle normalMap = NULL;
+		TTextureHandle celGradient = NULL;
+		if (!LoadCachedTexture(textures, sceneMaterial.DiffuseSpecularMap, &diffuseSpecularMap))	missingTexture = sceneMaterial.DiffuseSpecularMap;
+		else if (!LoadCachedTexture(textures, sceneMaterial.NormalMap, &normalMap))				missingTexture = sceneMaterial.NormalMap;
+		else if (!LoadCachedTexture(textures, sceneMaterial.CelGradient, &celGradient))			missingTexture = sceneMaterial.CelGradient;
+
+		CMaterial* material = new CMaterial(diffuseSpecularMap, sceneMaterial.SpecularPower, normalMap, sceneMaterial.ParallaxDepth,
+		                                    celGradient, sceneMaterial.OutlineThickness);
+		CModel::m_MaterialList.push_back(material);
+		materials.push_back(material);
+	}
+	for (TTextureCache::iterator texture = textures.begin(); texture != textures.end(); ++texture)
+	{
+		g_RenderBackend->Release(texture->second); // The materials hold their own references
+	}
+	if (!missingTexture.empty())
+	{
+		return SceneError("Cannot load texture " + missingTexture);
+	}
 
-	// Update the matrices of lights that will be stationary (dont need to update them in update scene) 
-	for (unsigned int i = 0; i < NO_OF_LIGHTS; i++)
+	// Lights - the scene sets up the lights that already exist
+	const vector<SSceneMesh>& meshes = scene.GetMeshes();
+	const vector<SSceneLight>& sceneLights = scene.GetLights();
+	for (unsigned int i = 0; i < sceneLights.size(); i++)
 	{
-		if (Lights[i]->IsStationary())
+		const SSceneLight& sceneLight = sceneLights[i];
+		bool isSpotLight = (sceneLight.Type == SceneLightSpot);
+		if (sceneLight.Number >= (isSpotLight ? NO_OF_SPOT_LIGHTS : NO_OF_LIGHTS))
 		{
-			Lights[i]->UpdateMatrix();
+			return SceneError(string(fileName) + " has more lights than the application");
+		}
+		CPositionalLight* light = isSpotLight ? SpotLight[sceneLight.Number] : Lights[sceneLight.Number];
+		light->SetPosition(gen::ToD3DXVECTOR(sceneLight.Position));
+		if (isSpotLight)
+		{
+			SpotLight[sceneLight.Number]->FacePoint(gen::ToD3DXVECTOR(sceneLight.FacePoint));
+			SpotLight[sceneLight.Number]->SetConeAngle(sceneLight.ConeAngle);
+		}
+		else
+		{
+			light->SetRotation(SceneAngles(sceneLight.Rotation));
+		}
+		light->SetScale(sceneLight.Scale);
+		light->SetIsStationary(sceneLight.IsStationary);
+		light->SetDiffuseColour(gen::ToD3DXVECTOR(sceneLight.DiffuseColour));
+		light->SetSpecularColour(gen::ToD3DXVECTOR(sceneLight.SpecularColour));
+		light->SetMaterial(materials[sceneLight.Material]);
+		if (!light->LoadModel(meshes[sceneLight.Mesh].FileName, techniques[sceneLight.Technique]))
+		{
+			return SceneError("Cannot load mesh " + meshes[sceneLight.Mesh].FileName);
 		}
 	}
-	for (unsigned int i = 0; i < NO_OF_SPOT_LIGHTS; i++)
+
+	// Models. The first model loaded for each mesh and technique (and whether its material needs tangents) reads the mesh file,
+	// later instances share its geometry
+	CModel::ReserveModels(scene.GetNumInstances());
+	vector<CModel*> loadedModels(meshes.size() * techniques.size() * 2, NULL);
+	vector<SSceneInstance> instances(SceneInstanceBlockSize);
+	unsigned int numRead;
+	while ((numRead = scene.ReadInstances(&instances[0], SceneInstanceBlockSize)) > 0)
 	{
-		if (SpotLight[i]->IsStationary())
+		for (unsigned int i = 0; i < numRead; i++)
 		{
-			SpotLight[i]->UpdateMatrix();
+			const SSceneInstance& instance = instances[i];
+
+			// The first model is moved with the keys, so must never be merged into a static batch
+			if (g_Models.empty() && (instance.Flags & kSceneInstanceStationary) != 0)
+			{
+				return SceneError("The first model in " + string(fileName) + " is controlled with the keys, so must be dynamic");
+			}
+			CModel* model = new CModel(gen::ToD3DXVECTOR(instance.Position), SceneAngles(instance.Rotation), instance.Scale,
+			                           gen::ToD3DXVECTOR(instance.Colour));
+			g_Models.push_back(model);
+			model->SetMaterial(materials[instance.Material]);
+			model->SetIsStationary((instance.Flags & kSceneInstanceStationary) != 0);
+
+			CModel*& loadedModel = loadedModels[(instance.Mesh * techniques.size() + instance.Technique) * 2 + (model->UseTangents() ? 1 : 0)];
+			if (loadedModel)
+			{
+				model->LoadInstance(loadedModel);
+			}
+			else
+			{
+				const SSceneMesh& mesh = meshes[instance.Mesh];
+				model->SetOccluder(mesh.IsOccluder, mesh.OccluderCellSize);
+				if (!model->Load(mesh.FileName, techniques[instance.Technique]))
+				{
+					return SceneError("Cannot load mesh " + mesh.FileName);
+				}
+				loadedModel = model;
+			}
 		}
 	}
-	
-	
-
-	// Create Light models#
-	for (unsigned int i = 0; i < NO_OF_SPOT_LIGHTS; i++)
+	if (!scene.GetError().empty())
 	{
-		SpotLight[i]->SetMaterial(LightMaterial);
-		if (!SpotLight[i]->LoadModel("Light.x", AdditiveTexTintTechnique))	return false;
+		return SceneError(scene.GetError());
 	}
 
-	for (unsigned int i = 0; i < 2; i++)
+	// The first model is the one controlled with the keys, which the first light orbits
+	if (g_Models.empty())
 	{
-		Lights[i]->SetMaterial(LightMaterial);
-		if (!Lights[i]->LoadModel( "Light.x", AdditiveTexTintTechnique ))	return false;
+		return SceneError(string(fileName) + " has no models");
 	}
+	return true;
+}
 
-	Lights[2]->SetMaterial(FlamesMaterial);
-	if (!Lights[2]->LoadModel("FlameShell.x", AlphaCutoutTechnique)) return false;
-
+// Convert the text scene file to the binary one loaded in its place, for the "-convertscene" command line option. Returns false on
+// an error (after showing it)
+bool ConvertScene()
+{
+	string error;
+	if (!ConvertSceneFile(SceneTextFile, SceneBinaryFile, error))
+	{
+		return SceneError(error);
+	}
 	return true;
 }
 
-void SwitchMaterialsAndRenderModes()
+// Create / load the camera, models and Materials for the scene
+bool InitScene()
 {
-	if (KeyHit(Key_1))	//Set all to plain model colour
+	// Start the worker threads, one for each hardware thread besides this one
+	Jobs = new gen::CJobSystem();
+
+	// Occlusion buffer pixels are the same shape as the viewport's
+	OcclusionBuffer.SetSize(OcclusionBufferWidth, OcclusionBufferWidth * g_ViewportHeight / g_ViewportWidth);
+
+	// Create lights and connect them to their shader variables
+	for (unsigned int i = 0; i < NO_OF_LIGHTS; i++)
 	{
-		for (unsigned int i = 0; i < g_Models.size(); i++)
-		{
-			g_Models[i]->SetRenderTechnique(PlainColourTechnique);
-		}
+		Lights[i] = new CPositionalLight;
 	}
-	if (KeyHit(Key_2))	//Set all to basic Material (No lighting)
+	for (unsigned int i = 0; i < NO_OF_SPOT_LIGHTS; i++)
 	{
-		for (unsigned int i = 0; i < g_Models.size(); i++)
-		{
-			g_Models[i]->SetRenderTechnique(DiffuseTexturedTechnique);
-		}
+		SpotLight[i] = new CSpotLight;
+
 	}
-	if (KeyHit(Key_3))	//Set all to wiggle and scroll texture
+
+	SpotLight[0]->SetConstants(&g_ShaderConstants.LightSet().SpotLights[0]);
+
+	for (unsigned int i = 0; i < NO_OF_SPOT_LIGHTS; i++)
 	{
-		for (unsigned int i = 0; i < g_Models.size(); i++)
-		{
-			g_Models[i]->SetRenderTechnique(WiggleAndScrollTechnique);
-		}
+		if (!SpotLight[i]->CreateShadowMap())	return false;
 	}
-	if (KeyHit(Key_4))	//Set all to have per pixel lighting (no bump maps)
+
+	// Set light shader constants - colours and positions
+	for (unsigned int i = 0; i < NO_OF_LIGHTS; i++)
 	{
-		for (unsigned int i = 0; i < g_Models.size(); i++)
-		{
-			g_Models[i]->SetRenderTechnique(PixelLightingTechnique);
-		}
+		Lights[i]->SetConstants(&g_ShaderConstants.LightSet().PointLights[i]);
 	}
-	if (KeyHit(Key_5))	//Set all to have normal mapping (no parallax)
+
+	// Camera, materials, models and the placement of the lights come from the scene file
+	if (!LoadScene(FileExists(SceneBinaryFile) ? SceneBinaryFile : SceneTextFile))	return false;
+
+	// Update the matrices of lights that will be stationary (dont need to update them in update scene) 
+	for (unsigned int i = 0; i < NO_OF_LIGHTS; i++)
 	{
-		for (unsigned int i = 0; i < g_Models.size(); i++)
+		if (Lights[i]->IsStationary())
 		{
-			g_Models[i]->SetRenderTechnique(NormalMapTechnique);
+			Lights[i]->UpdateMatrix();
 		}
 	}
-	if (KeyHit(Key_6))	//Set all to have parallax mapping
+	for (unsigned int i = 0; i < NO_OF_SPOT_LIGHTS; i++)
 	{
-		for (unsigned int i = 0; i < g_Models.size(); i++)
+		if (SpotLight[i]->IsStationary())
 		{
-			g_Models[i]->SetRenderTechnique(ParallaxMapTechnique);
+			SpotLight[i]->UpdateMatrix();
 		}
 	}
-	if (KeyHit(Key_7))	//Set all to have Parallax mapping (if supported) and/or an outline
-	{
-		for (unsigned int i = 0; i < g_Models.size(); i++)
-		{
-			if (g_Models[i]->UseTangents())
-			{
-				g_Models[i]->SetRenderTechnique(ParallaxOutlinedTechnique);
-			}
-			else // does not use tangents
-			{
-				g_Models[i]->SetRenderTechnique(PixelLitOutlinedTechnique);
 
-			}
-		}
+	// Merge the stationary models drawn the same way into pre-transformed chunks, which replace them at the end of the model list
+	CModel::UpdateAllMatrices(Jobs);
+	if (!BuildStaticBatches(g_Models, StaticBatchChunkSize, &StaticBatchStats))	return false;
+
+	// Build the scene hierarchy. The first light orbits the cube so is its child, everything else is a root
+	for (unsigned int i = 0; i < g_Models.size(); i++)
+	{
+		g_Models[i]->AttachToHierarchy(&SceneHierarchy);
 	}
-	if (KeyHit(Key_8))	//Set all to have black and white noire style shading and an outline (with parallax mapping if supported)
+	Lights[0]->AttachToHierarchy(&SceneHierarchy, g_Models[0]);
+	for (unsigned int i = 1; i < NO_OF_LIGHTS; i++)
 	{
-		for (unsigned int i = 0; i < g_Models.size(); i++)
-		{
-			if (g_Models[i]->UseTangents())
-			{
-				g_Models[i]->SetRenderTechnique(ParallaxNoireShadeTechnique);
-			}
-			else // does not use tangents
-			{
-				g_Models[i]->SetRenderTechnique(NoireShadingTechnique);
-			}
-		}
+		Lights[i]->AttachToHierarchy(&SceneHierarchy);
 	}
-	if (KeyHit(Key_9))	//Set all to have black and white noire style shading and an outline (with parallax mapping if supported)
+	for (unsigned int i = 0; i < NO_OF_SPOT_LIGHTS; i++)
 	{
-		for (unsigned int i = 0; i < g_Models.size(); i++)
+		SpotLight[i]->AttachToHierarchy(&SceneHierarchy);
+	}
+
+	CModel::UpdateAllMatrices(Jobs);
+	SceneHierarchy.Update(Jobs);
+	CModel::UpdateAllBounds(Jobs);
+	BuildCullingTrees();
+
+	return true;
+}
+
+// Set every model to the technique with the given features, or with tangentFeatures for models with tangents (i.e. with normal
+// maps). Each technique is only created if a model uses it, and models whose material doesn't suit it keep their technique
+void SetAllRenderTechniques(unsigned int features, unsigned int tangentFeatures)
+{
+	for (unsigned int i = 0; i < g_Models.size(); i++)
+	{
+		CTechnique* technique = Techniques.GetTechnique(g_Models[i]->UseTangents() ? tangentFeatures : features);
+		if (technique)
 		{
-			if (g_Models[i]->UseTangents())
-			{
-				g_Models[i]->SetRenderTechnique(ParallaxCelShadingTechnique);
-			}
-			else // does not use tangents
-			{
-				g_Models[i]->SetRenderTechnique(CelShadingTechnique);
-			}
+			g_Models[i]->SetRenderTechnique(technique);
 		}
 	}
-	if (KeyHit(Key_0))	//Set all to have black and white noire style shading and an outline (with parallax mapping if supported)
+}
+
+void SwitchMaterialsAndRenderModes()
+{
+	for (unsigned int mode = 0; mode < NumRenderModes; mode++)
 	{
-		for (unsigned int i = 0; i < g_Models.size(); i++)
+		if (KeyHit(RenderModes[mode].Key))
 		{
-			if (g_Models[i]->UseTangents())
-			{
-				g_Models[i]->SetRenderTechnique(ShadowMapParallaxLitTechnique);
-			}
-			else // does not use tangents
-			{
-				g_Models[i]->SetRenderTechnique(ShadowMapPixelLitTechnique);
-			}
+			SetAllRenderTechniques(RenderModes[mode].Features, RenderModes[mode].TangentFeatures);
 		}
 	}
 }
@@ -735,6 +705,18 @@ void UpdateScene(float frameTime)
 {
 	SwitchMaterialsAndRenderModes();	//Call function to handle real time switching of Materials and rendering techniques for each model
 
+	// Export the draw statistics for the last frame
+	if (KeyHit(Key_F5))
+	{
+		ExportDrawStats();
+	}
+
+	// Toggle occlusion culling
+	if (KeyHit(Key_F6))
+	{
+		OcclusionCulling = !OcclusionCulling;
+	}
+
 	// Control camera position and update its matrices (view matrix, projection matrix) each frame
 	// Don't be deceived into thinking that this is a new method to control models - the same code we used previously is in the camera class
 	Camera->Control( frameTime, Key_Up, Key_Down, Key_Left, Key_Right, Key_W, Key_S, Key_A, Key_D );
@@ -745,12 +727,6 @@ void UpdateScene(float frameTime)
 	
 	SpotLight[0]->Control(frameTime, Key_Numpad8, Key_Numpad2, Key_Numpad4, Key_Numpad6, Key_Numpad7, Key_Numpad9, Key_Numpad3, Key_Numpad1);
 
-	// Update model matrices
-	for (unsigned int i = 0; i < g_Models.size(); i++)
-	{
-		g_Models[i]->UpdateMatrix();
-	}
-
 	// Update wiggle value
 	Wiggle += 15.0f * frameTime;
 
@@ -783,69 +759,389 @@ void UpdateScene(float frameTime)
 		Lights[0]->SetSpecularColour(changingLightColour);
 	}
 	
-	// Update the orbiting light position - a bit of a cheat with the static variable [ask the tutor if you want to know what this is]
+	// Update the orbiting light position, relative to the cube it is attached to - a bit of a cheat with the static variable [ask the tutor if you want to know what this is]
 	static float Rotate = 0.0f;
-	Lights[0]->SetPosition(g_Models[0]->GetPosition() + D3DXVECTOR3(cos(Rotate)*LightOrbitRadius, 0.0f, sin(Rotate)*LightOrbitRadius));
+	Lights[0]->SetPosition(D3DXVECTOR3(cos(Rotate)*LightOrbitRadius, 0.0f, sin(Rotate)*LightOrbitRadius));
 	Rotate -= LightOrbitSpeed * frameTime;
 	
-	// Update non stationary matrices
+	// Update the matrices of all models (including light models) in one pass over the transform store - only the ones
+	// that have moved are rebuilt. Each of these passes is split into parallel jobs, which only pays off on large scenes
+	CModel::UpdateAllMatrices(Jobs);
+
+	// All the local matrices are set, now calculate world matrices in one pass over the hierarchy. Only the branches below
+	// nodes that changed this frame are visited
+	SceneHierarchy.Update(Jobs);
+
+	// Then bring the world bounding volumes up to date for culling, again in one pass
+	CModel::UpdateAllBounds(Jobs);
+}
+
+//--------------------------------------------------------------------------------------
+// Culling
+//--------------------------------------------------------------------------------------
+
+// Number of culling objects (see the culling variables at the top of the file)
+unsigned int NumCullingObjects()
+{
+	return static_cast<unsigned int>(g_Models.size()) + NO_OF_LIGHTS + NO_OF_SPOT_LIGHTS;
+}
+
+// World bounding box of a culling object
+gen::CAABB GetCullingObjectBox(unsigned int object)
+{
+	const unsigned int firstLight = static_cast<unsigned int>(g_Models.size());
+	const unsigned int firstSpotLight = firstLight + NO_OF_LIGHTS;
+	if (object < firstLight)      return g_Models[object]->GetWorldBoundingBox();
+	if (object < firstSpotLight)  return Lights[object - firstLight]->GetWorldBoundingBox();
+	return SpotLight[object - firstSpotLight]->GetWorldBoundingBox();
+}
+
+// Check if a culling object never moves
+bool IsCullingObjectStationary(unsigned int object)
+{
+	const unsigned int firstLight = static_cast<unsigned int>(g_Models.size());
+	const unsigned int firstSpotLight = firstLight + NO_OF_LIGHTS;
+	if (object < firstLight)      return g_Models[object]->IsStationary();
+	if (object < firstSpotLight)  return Lights[object - firstLight]->IsStationary();
+	return SpotLight[object - firstSpotLight]->IsStationary();
+}
+
+// Build a tree over the given culling objects from their current bounding boxes
+void BuildCullingTree(gen::CBVH& tree, const vector<unsigned int>& objects)
+{
+	CullingBoxes.resize(objects.size());
+	for (unsigned int i = 0; i < objects.size(); i++)
+	{
+		CullingBoxes[i] = GetCullingObjectBox(objects[i]);
+	}
+	tree.Build(CullingBoxes.empty() ? NULL : &CullingBoxes[0], static_cast<gen::TUInt32>(CullingBoxes.size()));
+}
+
+// Sort the culling objects into the static and dynamic trees and build both. Call again if a stationary object is moved
+void BuildCullingTrees()
+{
+	StaticTreeObjects.clear();
+	DynamicTreeObjects.clear();
+	for (unsigned int object = 0; object < NumCullingObjects(); object++)
+	{
+		if (IsCullingObjectStationary(object))
+		{
+			StaticTreeObjects.push_back(object);
+		}
+		else
+		{
+			DynamicTreeObjects.push_back(object);
+		}
+	}
+	BuildCullingTree(StaticTree, StaticTreeObjects);
+	BuildCullingTree(DynamicTree, DynamicTreeObjects);
+}
+
+// Bring the dynamic tree up to date with the current positions of the moving objects. Refitting is cheap but the tree gets less efficient
+// as objects move away from where they were when it was built, so rebuild it once it has degraded too far
+void UpdateDynamicTree()
+{
+	for (unsigned int i = 0; i < DynamicTreeObjects.size(); i++)
+	{
+		DynamicTree.SetItemBox(i, GetCullingObjectBox(DynamicTreeObjects[i]));
+	}
+	DynamicTree.Refit();
+	if (DynamicTree.GetDegradation() > DynamicTreeMaxDegradation)
+	{
+		BuildCullingTree(DynamicTree, DynamicTreeObjects);
+	}
+}
+
+// Convert the tree items found by a query to culling objects and add them to its results
+void AddCullingResults(const vector<unsigned int>& treeObjects, SCullingQuery& query)
+{
+	for (unsigned int i = 0; i < query.Items.size(); i++)
+	{
+		query.Results.push_back(treeObjects[query.Items[i]]);
+	}
+	query.Items.clear();
+}
+
+// Find the culling objects inside the given frustum or cone, result in the query's results sorted in object order. Only reads the
+// trees, so several queries can run at once
+template <class TVolume>
+void FindCullingObjects(const TVolume& volume, SCullingQuery& query)
+{
+	query.Results.clear();
+	query.Items.clear();
+	StaticTree.Cull(volume, query.Items);
+	AddCullingResults(StaticTreeObjects, query);
+	DynamicTree.Cull(volume, query.Items);
+	AddCullingResults(DynamicTreeObjects, query);
+	sort(query.Results.begin(), query.Results.end());
+}
+
+// Find the scene models that can cast shadows from the given spotlight - those inside its cone - result in ShadowCasters[spotLight]
+void FindShadowCasters(unsigned int spotLight, const gen::CCone& cone)
+{
+	SCullingQuery& query = SpotLightQueries[spotLight];
+	FindCullingObjects(cone, query);
+	ShadowCasters[spotLight].clear();
+	for (unsigned int i = 0; i < query.Results.size() && query.Results[i] < g_Models.size(); i++)
+	{
+		ShadowCasters[spotLight].push_back(g_Models[query.Results[i]]);
+	}
+}
+
+// Find the objects in the camera frustum and sort them back into the visible models and lights
+void FindVisibleObjects(const gen::CFrustum& frustum)
+{
+	FindCullingObjects(frustum, CameraQuery);
+
+	const unsigned int firstLight = static_cast<unsigned int>(g_Models.size());
+	const unsigned int firstSpotLight = firstLight + NO_OF_LIGHTS;
+	VisibleModels.clear();
 	for (unsigned int i = 0; i < NO_OF_LIGHTS; i++)
-	{	//Update matrices of lights that are not stationary
-		if (!Lights[i]->IsStationary())
+	{
+		LightVisible[i] = false;
+	}
+	for (unsigned int i = 0; i < NO_OF_SPOT_LIGHTS; i++)
+	{
+		SpotLightVisible[i] = false;
+	}
+	for (unsigned int i = 0; i < CameraQuery.Results.size(); i++)
+	{
+		unsigned int object = CameraQuery.Results[i];
+		if (object < firstLight)
 		{
-			Lights[i]->UpdateMatrix();
+			VisibleModels.push_back(g_Models[object]);
 		}
+		else if (object < firstSpotLight)
+		{
+			LightVisible[object - firstLight] = true;
+		}
+		else
+		{
+			SpotLightVisible[object - firstSpotLight] = true;
+		}
+	}
+}
+
+// Find a ray's first hit on the bounding box of a scene model. Returns NULL if no model was hit
+CModel* RayCastModels(D3DXVECTOR3 origin, D3DXVECTOR3 direction, float* pDistance = NULL)
+{
+	// Check both trees, keep the nearer hit. Light models are not included
+	CModel* hitModel = NULL;
+	float nearest = Camera->GetFarClip();
+	gen::TUInt32 item;
+	float distance;
+	if (StaticTree.RayCast(gen::ToCVector3(origin), gen::ToCVector3(direction), nearest, &item, &distance) &&
+	    StaticTreeObjects[item] < g_Models.size())
+	{
+		hitModel = g_Models[StaticTreeObjects[item]];
+		nearest = distance;
+	}
+	if (DynamicTree.RayCast(gen::ToCVector3(origin), gen::ToCVector3(direction), nearest, &item, &distance) &&
+	    DynamicTreeObjects[item] < g_Models.size())
+	{
+		hitModel = g_Models[DynamicTreeObjects[item]];
+		nearest = distance;
 	}
+	if (hitModel && pDistance)
+	{
+		*pDistance = nearest;
+	}
+	return hitModel;
+}
+
+// Remove the visible models hidden behind occluders from VisibleModels. Rasterises the visible occluders into the occlusion buffer
+// then tests the bounding box of each visible model against it, both in parallel jobs
+void OccludeScene()
+{
+	CullingStats.Occluded = 0;
+	CullingStats.RasteriseTime = 0.0f;
+	CullingStats.OcclusionTestTime = 0.0f;
+	if (!OcclusionCulling)
+	{
+		return;
+	}
+
+	CTimer timer;
+	timer.Start();
+	OcclusionBuffer.Begin(gen::ToCMatrix4x4(Camera->GetViewProjectionMatrix()));
+	for (unsigned int i = 0; i < VisibleModels.size(); i++)
+	{
+		if (VisibleModels[i]->IsOccluder())
+		{
+			OcclusionBuffer.AddOccluder(VisibleModels[i]->GetOccluderMesh(), gen::ToCMatrix4x4(VisibleModels[i]->GetMeshWorldMatrix()));
+		}
+	}
+	OcclusionBuffer.Rasterise(Jobs);
+	CullingStats.RasteriseTime = timer.GetLapTime() * 1000.0f;
+
+	// The bounds are gathered first as getting them may update them, which the jobs mustn't do
+	const unsigned int numVisible = static_cast<unsigned int>(VisibleModels.size());
+	OccludeeBoxes.resize(numVisible);
+	OccludeeHidden.resize(numVisible);
+	for (unsigned int i = 0; i < numVisible; i++)
+	{
+		OccludeeBoxes[i] = VisibleModels[i]->GetWorldBoundingBox();
+	}
+	Jobs->ParallelFor(numVisible, 8, [](gen::TUInt32 first, gen::TUInt32 end)
+	{
+		for (unsigned int i = first; i < end; i++)
+		{
+			OccludeeHidden[i] = !OcclusionBuffer.IsVisible(OccludeeBoxes[i]);
+		}
+	});
+
+	// Remove the hidden models, keeping the rest in order
+	unsigned int numKept = 0;
+	for (unsigned int i = 0; i < numVisible; i++)
+	{
+		if (!OccludeeHidden[i])
+		{
+			VisibleModels[numKept++] = VisibleModels[i];
+		}
+	}
+	VisibleModels.resize(numKept);
+	CullingStats.Occluded = numVisible - numKept;
+	CullingStats.OcclusionTestTime = timer.GetLapTime() * 1000.0f;
+}
+
+// Cull the scene against the camera frustum, building the lists of visible models used by RenderScene. Call after UpdateScene
+void CullScene()
+{
+	// Culling is the first stage of each frame, start counting transform updates for the new frame here
+	STransformStats clearStats = { { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 } };
+	g_TransformStats = clearStats;
+
+	// Get the camera frustum and spotlight cones here - getting them may update cached matrices, which the jobs mustn't do
+	const gen::CFrustum& frustum = Camera->GetFrustum();
+	gen::CCone cones[NO_OF_SPOT_LIGHTS];
 	for (unsigned int i = 0; i < NO_OF_SPOT_LIGHTS; i++)
 	{
-		if (!SpotLight[i]->IsStationary())
+		cones[i] = SpotLight[i]->GetCone();
+	}
+
+	// The dynamic tree must be brought up to date before any query. The camera query and the shadow caster query for each spotlight
+	// only read the trees, so they then run in parallel. This thread runs jobs too while it waits
+	gen::CJobGroup refitJob;
+	gen::CJobGroup queryJobs;
+	Jobs->Run([](gen::TUInt32, gen::TUInt32) { UpdateDynamicTree(); }, refitJob);
+	Jobs->Run([&](gen::TUInt32, gen::TUInt32) { FindVisibleObjects(frustum); }, queryJobs, &refitJob);
+	Jobs->ParallelFor(NO_OF_SPOT_LIGHTS, 1, [&](gen::TUInt32 first, gen::TUInt32 end)
+	{
+		for (unsigned int i = first; i < end; i++)
 		{
-			SpotLight[i]->UpdateMatrix();
+			FindShadowCasters(i, cones[i]);
 		}
+	}, queryJobs, &refitJob);
+	Jobs->Wait(queryJobs);
+
+	CullingStats.Tested = NumCullingObjects();
+	CullingStats.Culled = NumCullingObjects() - static_cast<unsigned int>(CameraQuery.Results.size());
+	CullingStats.Drawn = 0; // Counted as models are rendered
+
+	OccludeScene();
+}
+
+// Write the culling, transform update and render queue counters for the last frame into the given string
+void GetCullingStatsText(wchar_t* text, unsigned int maxLength)
+{
+	// Transform updates are shown as the number actually rebuilt out of the number requested
+	// Triangles, applies and binds are for the whole frame, shadow maps included. Duplicates are models drawn more than once with the
+	// same pass, over the whole run
+	// Render queue draw calls count one per instanced group, and instanced is the number of models drawn that way. State changes are
+	// the number of times the technique, material and geometry were set for the drawn models. State calls are those passed on to the
+	// device / effect by the state cache, and those it dropped as repeats
+	// Constant uploads are the constant buffers written and the bytes they held, against the bytes the frame would have uploaded with
+	// every constant in the single $Globals buffer of the effect. Layout lookups are since the start, a miss creates a layout. Techniques
+	// are the shader permutations created so far, and how many of them were loaded from the effect cache or compiled
+	const STransformStats& ts = g_TransformStats;
+	const SRenderQueueStats& qs = RenderQueue.GetStats();
+	const SConstantCounts& cs = g_ShaderConstants.GetCounts();
+	const SInputLayoutCacheStats& ls = g_InputLayoutCache.GetStats();
+	const STechniqueLibraryStats& es = Techniques.GetStats();
+	unsigned int constantUploads = 0;
+	for (unsigned int group = 0; group < NumConstantGroups; group++)
+	{
+		constantUploads += cs.Uploads[group];
 	}
+	swprintf_s(text, maxLength, L"Models tested: %u  culled: %u  occluded: %u  drawn: %u   Occlusion raster: %.2fms  test: %.2fms   Matrices: %u/%u  nodes: %u/%u  bounds: %u/%u  spotlight: %u/%u  camera: %u/%u   Draw calls: %u  instanced: %u  static chunks: %u (from %u models)   Changes technique: %u  material: %u  geometry: %u   State calls: %u  elided: %u   Constant uploads: %u  bytes: %u (single buffer: %u)   Layouts: %u  hits: %u  misses: %u   Techniques: %u  loaded: %u  compiled: %u   Triangles: %u  applies: %u  binds: %u  duplicate draws: %u",
+	           CullingStats.Tested, CullingStats.Culled, CullingStats.Occluded, CullingStats.Drawn,
+	           CullingStats.RasteriseTime, CullingStats.OcclusionTestTime,
+	           ts.ModelMatrices.Updated, ts.ModelMatrices.Updated + ts.ModelMatrices.Skipped,
+	           SceneHierarchy.GetNumUpdated(), SceneHierarchy.GetNumNodes(),
+	           ts.ModelBounds.Updated, ts.ModelBounds.Updated + ts.ModelBounds.Skipped,
+	           ts.SpotLightMatrices.Updated, ts.SpotLightMatrices.Updated + ts.SpotLightMatrices.Skipped,
+	           ts.CameraMatrices.Updated, ts.CameraMatrices.Updated + ts.CameraMatrices.Skipped,
+	           qs.DrawCalls, qs.InstancedDraws, StaticBatchStats.Chunks, StaticBatchStats.ModelsMerged,
+	           qs.TechniqueChanges, qs.MaterialChanges, qs.GeometryChanges,
+	           g_StateCache.GetTotalIssued(), g_StateCache.GetTotalElided(),
+	           constantUploads, cs.BytesUploaded, cs.GlobalsBytes,
+	           ls.Layouts, ls.Hits, ls.Misses, es.Created, es.Loaded, es.Compiled,
+	           g_DrawStats.GetTotals().Triangles, g_DrawStats.GetTotals().Applies, g_DrawStats.GetBinds(), g_DrawStats.GetNumDuplicates());
+}
+
+// Write the draw statistics for the last frame to CSV and JSON files
+void ExportDrawStats()
+{
+	g_DrawStats.ExportCSV(DrawStatsCSVFile);
+	g_DrawStats.ExportJSON(DrawStatsJSONFile);
+}
+
+// Select whether a model drawn more than once in a pass is reported to the debugger as it happens (for scripted checks)
+void SetDrawAssertions(bool assertNoDuplicates)
+{
+	g_DrawStats.SetAssertNoDuplicates(assertNoDuplicates);
+}
+
+// Number of models drawn more than once in a pass since the program started
+unsigned int GetNumDuplicateDraws()
+{
+	return g_DrawStats.GetNumDuplicates();
 }
 
 // Render everything in the scene
 void RenderScene()
 {
-	//Render shadow maps from each spotlight
+	// Start counting state changes and draws for this frame
+	g_StateCache.BeginFrame();
+	g_ShaderConstants.BeginFrame();
+	g_DrawStats.BeginFrame();
+
+	//Render shadow maps from each spotlight, only passing the models CullScene found inside its cone
 	for (unsigned int i = 0; i < NO_OF_SPOT_LIGHTS; i++)
 	{
-		SpotLight[i]->RenderShadowMap(g_pd3dDevice, g_Models, ViewProjMatrixVar);
+		g_DrawStats.BeginPass(DrawPassShadow, i);
+		SpotLight[i]->RenderShadowMap(ShadowCasters[i]);
 	}
 
 	//---------------------------
 	// Reset the render target back to the screen
 
-	D3D10_VIEWPORT vp;
-	vp.Width = g_ViewportWidth;
-	vp.Height = g_ViewportHeight;
-	vp.MinDepth = 0.0f;
-	vp.MaxDepth = 1.0f;
-	vp.TopLeftX = 0;
-	vp.TopLeftY = 0;
-	g_pd3dDevice->RSSetViewports(1, &vp);
+	g_RenderBackend->SetViewport(g_ViewportWidth, g_ViewportHeight);
 
 	// Select the back buffer and depth buffer to use for rendering
-	g_pd3dDevice->OMSetRenderTargets(1, &RenderTargetView, DepthStencilView);
+	g_RenderBackend->SetRenderTarget(NULL);
 
 	// Clear the back buffer - before drawing the geometry clear the entire window to a fixed colour
 	float ClearColor[4] = { AmbientLight->GetColour().x, AmbientLight->GetColour().y, AmbientLight->GetColour().z, 1.0f }; // Good idea to match background to ambient colour
-	g_pd3dDevice->ClearRenderTargetView( RenderTargetView, ClearColor );
-	g_pd3dDevice->ClearDepthStencilView( DepthStencilView, D3D10_CLEAR_DEPTH, 1.0f, 0 ); // Clear the depth buffer too
+	g_RenderBackend->ClearColour( ClearColor );
+	g_RenderBackend->ClearDepth(); // Clear the depth buffer too
 
 	//-------------------------
 
 	// Common rendering settings
 
 	// Camera data
-	ViewMatrixVar->SetMatrix( (float*)&Camera->GetViewMatrix() );
-	ProjMatrixVar->SetMatrix( (float*)&Camera->GetProjectionMatrix() );  
-	ViewProjMatrixVar->SetMatrix((float*)&Camera->GetViewProjectionMatrix());
-		
-	CameraPositionVar->SetRawValue(Camera->GetPosition(), 0, sizeof(D3DXVECTOR3));
+	SPerFrameConstants& frameConstants = g_ShaderConstants.Frame();
+	frameConstants.ViewMatrix = Camera->GetViewMatrix();
+	frameConstants.ProjMatrix = Camera->GetProjectionMatrix();
+	frameConstants.ViewProjMatrix = Camera->GetViewProjectionMatrix();
+	frameConstants.CameraPosition = Camera->GetPosition();
 
-	// Lighting data
+	// Misc
+	frameConstants.Wiggle = Wiggle;
+	g_ShaderConstants.UploadFrame();
+
+	// Lighting data - each light writes its part of the light set, which is then uploaded together
 	Lights[0]->LightRender();
 	Lights[1]->LightRender(PulsingLightColour, PulsingLightColour);
 	Lights[2]->LightRender();
@@ -855,52 +1151,68 @@ void RenderScene()
 	}
 
 	AmbientLight->LightRender();
-
-	// Misc
-	WiggleVar->SetFloat(Wiggle);	
+	g_ShaderConstants.UploadLightSet();
 	
 	// Render each model - individial model data for shader (Materials etc) is encapsulated in the class
 	
-	// Render models in vector
-	for (unsigned int i = 0; i < g_Models.size(); i++)
+	// Queue the models that passed culling (see CullScene) and the light models that passed culling, then draw them all in the
+	// queue's sorted order
+	RenderQueue.Clear();
+	for (unsigned int i = 0; i < VisibleModels.size(); i++)
 	{
-		g_Models[i]->Render();
+		RenderQueue.Add(VisibleModels[i]);
 	}
-	
-	// Render light models
 	// Light 0
-	Lights[0]->ModelRender(Lights[0]->GetDiffuseColour());
+	if (LightVisible[0])
+	{
+		Lights[0]->QueueModel(RenderQueue, Lights[0]->GetDiffuseColour());
+	}
 	// Light 1
-	Lights[1]->ModelRender(PulsingLightColour);
+	if (LightVisible[1])
+	{
+		Lights[1]->QueueModel(RenderQueue, PulsingLightColour);
+	}
 	// Light 2
-	Lights[2]->ModelRender(Lights[2]->GetDiffuseColour());
+	if (LightVisible[2])
+	{
+		Lights[2]->QueueModel(RenderQueue, Lights[2]->GetDiffuseColour());
+	}
 	// SpotLight
 	for (unsigned int i = 0; i < NO_OF_SPOT_LIGHTS; i++)
 	{
-		SpotLight[i]->ModelRender(SpotLight[i]->GetDiffuseColour());
+		if (SpotLightVisible[i])
+		{
+			SpotLight[i]->QueueModel(RenderQueue, SpotLight[i]->GetDiffuseColour());
+		}
 	}
+	RenderQueue.Sort(Camera->GetViewMatrix(), Camera->GetFarClip(), Jobs);
+	g_DrawStats.BeginPass(DrawPassScene);
+	RenderQueue.Render();
+	CullingStats.Drawn += RenderQueue.GetStats().Draws;
+	g_DrawStats.EndFrame(g_StateCache.GetCounts());
 
 	//Render shadow maps from each spotlight (DEBUGGING TOOL) - show shadow map on screen
-	//SpotLight[0]->RenderShadowMap(g_pd3dDevice, g_Models, ViewProjMatrixVar, false);
+	//SpotLight[0]->RenderShadowMap(g_Models, false);
 
 
 	// Display the Scene
 
 	// After we've finished drawing to the off-screen back buffer, we "present" it to the front buffer (the screen)
-	SwapChain->Present( 0, 0 );
+	g_RenderBackend->Present();
 
 }
 
 //--------------------------------------------------------------------------------------
 // Release the memory held by all objects created
 //--------------------------------------------------------------------------------------
-void ReleaseResources()
+
+// Release the scene, leaving the backend - every buffer and texture the scene created should now be released
+void ReleaseScene()
 {
 	// The D3D setup and preparation of the geometry created several objects that use up memory (e.g. textures, vertex/index buffers etc.)
 	// Each object that allocates memory (or hardware resources) needs to be "released" when we exit the program
 	// There is similar code in every D3D program, but the list of objects that need to be released depends on what was created
 	// Test each variable to see if it exists before deletion
-	if( g_pd3dDevice )     g_pd3dDevice->ClearState();
 
 	// Deallocate lighting data
 	for (unsigned int i = 0; i < NO_OF_LIGHTS; i++)
@@ -919,6 +1231,8 @@ void ReleaseResources()
 		if (g_Models.back()) { delete g_Models.back(); }
 		g_Models.pop_back();
 	}
+	CModel::ReleaseSharedGeometry();
+	RenderQueue.ReleaseResources();
 	
 	// Deallocate Material data
 	while (!CModel::m_MaterialList.empty())
@@ -927,22 +1241,288 @@ void ReleaseResources()
 		CModel::m_MaterialList.pop_back();
 	}
 
-	// Empty the technique list
-	while (!CModel::m_TechniqueList.empty())
-	{
-		if (CModel::m_TechniqueList.back()) delete CModel::m_TechniqueList.back();
-		CModel::m_TechniqueList.pop_back();
-	}
+	// Release the techniques and the variables they share, disconnecting the backend from them first
+	CModel::SetShadowRenderTechnique(NULL);
+	if (D3D10Backend)  D3D10Backend->SetSharedEffect(NULL);
+	Techniques.Release();
 
 	// Deallocate the camera
 	if (Camera)  {delete Camera; Camera = NULL;}
 
-	// Deallocate other directx variables
-	if( Effect )			Effect->Release();
-	if( DepthStencilView )	DepthStencilView->Release();
-	if( RenderTargetView )	RenderTargetView->Release();
-	if( DepthStencil )		DepthStencil->Release();
-	if( SwapChain )			SwapChain->Release();
-	if( g_pd3dDevice )		g_pd3dDevice->Release();
+	// Stop the job system's worker threads
+	if (Jobs)  {delete Jobs; Jobs = NULL;}
+}
+
+// Release the backend, which releases the device and the vertex layouts if it has them
+void ReleaseBackend()
+{
+	g_StateCache.SetBackend( NULL );
+	g_ShaderConstants.SetBackend( NULL );
+	g_RenderBackend = NULL;
+	if (D3D10Backend)  {D3D10Backend->Release(); delete D3D10Backend; D3D10Backend = NULL;}
+	if (RecordingBackend)  {delete RecordingBackend; RecordingBackend = NULL;}
+	if (SoftwareBackend)  {SoftwareBackend->Release(); delete SoftwareBackend; SoftwareBackend = NULL;}
+}
+
+void ReleaseResources()
+{
+	ReleaseScene();
+	ReleaseBackend();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Headless run
+//--------------------------------------------------------------------------------------
+
+// Make a fixed sequence of state changes with dummy handles through a state cache with no backend, and check that repeated binds are
+// elided, changed ones are issued, and the recorded calls match the counters. Writes any failures to the given file
+bool CheckStateCacheElides(ofstream& file)
+{
+	TBufferHandle buffer = reinterpret_cast<TBufferHandle>(1);
+	TTextureHandle texture = reinterpret_cast<TTextureHandle>(2);
+
+	CStateCache cache;
+	cache.BeginFrame();
+	cache.SetRecording(true);
+	cache.IASetVertexBuffer(buffer, 32);
+	cache.IASetVertexBuffer(buffer, 32);   // Same - elided
+	cache.IASetVertexBuffer(buffer, 64);   // Stride changed - issued
+	cache.IASetPrimitiveTopology(D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	cache.IASetPrimitiveTopology(D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	cache.SetTexture(TextureDiffuseSpecular, texture);
+	cache.SetTexture(TextureDiffuseSpecular, texture);
+	cache.SetTexture(TextureDiffuseSpecular, NULL);
+
+	const SStateCounts& counts = cache.GetCounts();
+	const vector<SStateCall>& calls = cache.GetRecordedCalls();
+	bool ok = counts.Issued[StateVertexBuffer] == 2 && counts.Elided[StateVertexBuffer] == 1 &&
+	          counts.Issued[StateTopology] == 1 && counts.Elided[StateTopology] == 1 &&
+	          counts.Issued[StateTexture] == 2 && counts.Elided[StateTexture] == 1 &&
+	          calls.size() == 5 &&
+	          calls[0].Type == StateVertexBuffer && calls[0].Param == 32 &&
+	          calls[1].Type == StateVertexBuffer && calls[1].Param == 64 &&
+	          calls[2].Type == StateTopology &&
+	          calls[3].Type == StateTexture && calls[3].Object == texture &&
+	          calls[4].Type == StateTexture && calls[4].Object == NULL;
+	if (!ok)
+	{
+		file << "ERROR: state cache did not elide repeated binds as expected\n";
+	}
+	return ok;
+}
+
+// Update and render the scene for the given number of frames through the recording backend, with no window or device. Writes the
+// average time of a frame's cull, render and update, the commands given to the backend per frame, and any buffers or textures the
+// scene failed to release to a report file, and the commands of the last frame to a second file, one per line. The state cache also
+// records the last frame's calls, which must match its issued counts and the draw statistics' binds, and is checked to elide repeated
+// binds. Two runs can be compared to see how a change affects the CPU cost of a frame and the work it gives the GPU. Returns false if
+// the scene could not be set up, the scene did not release all its resources, a state cache check failed or a file could not be
+// written, or if asked for no frames
+bool RunHeadless(unsigned int frames)
+{
+	if (frames == 0)
+	{
+		return false;
+	}
+
+	InitHeadless(HeadlessWidth, HeadlessHeight);
+	if (!LoadEffectFile() || !InitScene())
+	{
+		ReleaseResources();
+		return false;
+	}
+	InitInput();
+
+	// Only the last frame's commands are recorded, the others are just counted
+	g_StateCache.ClearRecordedCalls();
+	CTimer timer;
+	timer.Start();
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		RecordingBackend->SetRecording(frame == frames - 1);
+		g_StateCache.SetRecording(frame == frames - 1);
+		CullScene();
+		RenderScene();
+		UpdateScene(HeadlessFrameTime);
+	}
+	float time = timer.GetTime();
+	bool commandsWritten = RecordingBackend->WriteRecordedCommands(HeadlessCommandsFile);
+
+	// Counts are copied before the scene is released, the release itself gives no commands
+	SRenderCommandCounts total = RecordingBackend->GetTotalCounts();
+	SRenderCommandCounts last = RecordingBackend->GetFrameCounts();
+	unsigned int numFrames = RecordingBackend->GetNumFrames();
+
+	// Each call the state cache recorded must have been counted as issued, and the binds among them counted by the draw statistics
+	SStateCounts stateCounts = g_StateCache.GetCounts();
+	unsigned int recordedCalls[NumStateCalls] = { 0 };
+	const vector<SStateCall>& calls = g_StateCache.GetRecordedCalls();
+	for (unsigned int call = 0; call < calls.size(); call++)
+	{
+		recordedCalls[calls[call].Type]++;
+	}
+	bool stateCallsMatch = recordedCalls[StateVertexBuffer] + recordedCalls[StateInputLayout] + recordedCalls[StateIndexBuffer] +
+	                       recordedCalls[StateTexture] == g_DrawStats.GetBinds();
+	for (unsigned int type = 0; type < NumStateCalls; type++)
+	{
+		stateCallsMatch = stateCallsMatch && recordedCalls[type] == stateCounts.Issued[type];
+	}
+	unsigned int stateIssued = g_StateCache.GetTotalIssued();
+	unsigned int stateElided = g_StateCache.GetTotalElided();
+	unsigned int stateRecorded = static_cast<unsigned int>(calls.size());
+	g_StateCache.SetRecording(false);
+	g_StateCache.ClearRecordedCalls();
+
+	ReleaseScene();
+	unsigned int leakedBuffers = RecordingBackend->GetNumBuffers();
+	unsigned int leakedTextures = RecordingBackend->GetNumTextures();
+	ReleaseBackend();
+
+	ofstream file(HeadlessReportFile);
+	if (!file)
+	{
+		return false;
+	}
+	file << "Frames: " << numFrames << " at " << HeadlessWidth << " x " << HeadlessHeight << "\n";
+	file << "Average frame time (ms): " << time * 1000.0f / frames << "\n";
+	file << "Commands          per frame   last frame\n";
+	for (unsigned int command = 0; command < NumRenderCommands; command++)
+	{
+		file << "  " << CRecordingBackend::GetCommandName(static_cast<ERenderCommand>(command)) << ": "
+		     << static_cast<float>(total.Commands[command]) / numFrames << "  " << last.Commands[command] << "\n";
+	}
+	file << "  Indices: " << static_cast<float>(total.Indices) / numFrames << "  " << last.Indices << "\n";
+	file << "  Instances: " << static_cast<float>(total.Instances) / numFrames << "  " << last.Instances << "\n";
+	file << "  Constant bytes: " << static_cast<float>(total.ConstantBytes) / numFrames << "  " << last.ConstantBytes << "\n";
+	file << "State calls in last frame: issued " << stateIssued << "  elided " << stateElided << "  recorded " << stateRecorded << "\n";
+	if (leakedBuffers > 0 || leakedTextures > 0)
+	{
+		file << "ERROR: buffers not released: " << leakedBuffers << "  textures not released: " << leakedTextures << "\n";
+	}
+	if (!stateCallsMatch)
+	{
+		file << "ERROR: state calls recorded do not match the state cache's counts or the draw statistics' binds\n";
+	}
+	bool stateCacheElides = CheckStateCacheElides(file);
+	return !file.fail() && commandsWritten && leakedBuffers == 0 && leakedTextures == 0 && stateCallsMatch && stateCacheElides;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Software render
+//--------------------------------------------------------------------------------------
+
+// Render the frame once with the software backend's current threads, the shadow maps included, and return the time taken
+float TimeSoftwareFrame()
+{
+	for (unsigned int i = 0; i < NO_OF_SPOT_LIGHTS; i++)
+	{
+		SpotLight[i]->InvalidateShadowMap();
+	}
+	CTimer timer;
+	timer.Start();
+	RenderScene();
+	return timer.GetTime();
+}
+
+// Update and render the scene for the given number of frames through the software backend, with no window or device, and write the
+// last frame and the spotlight's shadow map to image files. The frame is compared with the reference image if there is one, then
+// rendered again on one thread and on all threads to measure the rasteriser's throughput - pixels output and pixels shaded per
+// second. Each of these frames must match the first exactly, as tiles are always drawn in the same order. Returns false if the scene
+// could not be set up, a file could not be written, a frame did not match, or if asked for no frames
+bool RunSoftwareRender(unsigned int frames)
+{
+	if (frames == 0)
+	{
+		return false;
+	}
 
-}
\ No newline at end of file
+	if (!InitSoftware(HeadlessWidth, HeadlessHeight) || !LoadEffectFile() || !InitScene())
+	{
+		ReleaseResources();
+		return false;
+	}
+	InitInput();
+
+	// The scene is not updated after the last frame, so it can be rendered again exactly
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		if (frame > 0)  UpdateScene(HeadlessFrameTime);
+		CullScene();
+		RenderScene();
+	}
+	SImage image;
+	SoftwareBackend->GetBackBuffer(&image);
+	bool imagesWritten = WriteImageFile(SoftwareImageFile, image) &&
+	                     SoftwareBackend->WriteDepthTexture(SpotLight[0]->GetShadowMap(), SoftwareShadowMapFile);
+
+	// Compare with the reference image, if there is one
+	bool hasReference = FileExists(SoftwareReferenceFile);
+	unsigned int referenceDifferences = 0;
+	if (hasReference)
+	{
+		SImage reference;
+		referenceDifferences = LoadImageFile(SoftwareReferenceFile, &reference) ?
+		                       CountImageDifferences(image, reference, SoftwareReferenceTolerance) : image.Width * image.Height;
+	}
+
+	// Time the same frame on one thread then all of them
+	unsigned int threadCounts[2] = { 1, 0 };
+	unsigned int numThreads[2];
+	float frameTimes[2];
+	SSoftwareRenderStats stats[2];
+	unsigned int threadDifferences[2];
+	for (unsigned int run = 0; run < 2; run++)
+	{
+		SoftwareBackend->SetNumThreads(threadCounts[run]);
+		numThreads[run] = SoftwareBackend->GetNumThreads();
+		TimeSoftwareFrame(); // Warm up
+		SoftwareBackend->ResetStats();
+		float time = 0.0f;
+		for (unsigned int frame = 0; frame < SoftwareBenchmarkFrames; frame++)
+		{
+			time += TimeSoftwareFrame();
+		}
+		frameTimes[run] = time / SoftwareBenchmarkFrames;
+		stats[run] = SoftwareBackend->GetStats();
+
+		SImage benchmarkImage;
+		SoftwareBackend->GetBackBuffer(&benchmarkImage);
+		threadDifferences[run] = CountImageDifferences(image, benchmarkImage, 0);
+	}
+
+	ReleaseResources();
+
+	ofstream file(SoftwareReportFile);
+	if (!file)
+	{
+		return false;
+	}
+	float megaPixels = static_cast<float>(HeadlessWidth * HeadlessHeight) / 1000000.0f;
+	file << "Frames: " << frames << " at " << HeadlessWidth << " x " << HeadlessHeight << ", image written to " << SoftwareImageFile
+	     << "\n";
+	if (hasReference)
+	{
+		file << "Pixels differing from " << SoftwareReferenceFile << ": " << referenceDifferences << "\n";
+	}
+	for (unsigned int run = 0; run < 2; run++)
+	{
+		const SSoftwareRenderStats& runStats = stats[run];
+		float frameCount = static_cast<float>(runStats.Frames);
+		file << "Threads: " << numThreads[run] << "\n";
+		file << "  Frame time (ms): " << frameTimes[run] * 1000.0f << "\n";
+		file << "  Geometry time (ms): " << runStats.GeometryTime * 1000.0f / frameCount
+		     << "  rasterise time (ms): " << runStats.RasteriseTime * 1000.0f / frameCount << "\n";
+		file << "  Draws: " << runStats.Draws / frameCount << "  vertices: " << runStats.Vertices / frameCount
+		     << "  triangles: " << runStats.Triangles / frameCount << "  binned: " << runStats.TrianglesBinned / frameCount << "\n";
+		file << "  Output Mpixels/s: " << megaPixels / frameTimes[run] << "\n";
+		file << "  Shaded Mpixels/s: " << static_cast<float>(runStats.PixelsShaded) / 1000000.0f / runStats.RasteriseTime << "\n";
+		if (threadDifferences[run] > 0)
+		{
+			file << "ERROR: pixels differing from the first render: " << threadDifferences[run] << "\n";
+		}
+	}
+	file << "Speed up on " << numThreads[1] << " threads: " << frameTimes[0] / frameTimes[1] << "\n";
+	return !file.fail() && imagesWritten && referenceDifferences == 0 && threadDifferences[0] == 0 && threadDifferences[1] == 0;
+}
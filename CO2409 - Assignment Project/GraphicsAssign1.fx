@@ -7,52 +7,207 @@
 //--------------------------------------------------------------------------------------
 
 //--------------------------------------------------------------------------------------
-// Structures
+// Permutations
+//--------------------------------------------------------------------------------------
+// This file is compiled once for each combination of features the application uses (see TechniqueLibrary.h). The C++ code
+// defines a FEATURE_ macro for each feature in the combination and takes the technique "Main" (and "MainInstanced", where there
+// is one) from the result. Code for features that are not defined is left out of the shaders altogether rather than branched
+// around. Features that others depend on have already been added by the C++ code - e.g. FEATURE_PARALLAX always comes with
+// FEATURE_NORMAL_MAP, and every lit combination has FEATURE_PIXEL_LIGHTING and FEATURE_TEXTURE
+//
+//	FEATURE_TEXTURE        - Diffuse map, with the specular map in its alpha channel
+//	FEATURE_TINT           - Colour multiplied by the model colour
+//	FEATURE_PIXEL_LIGHTING - Per-pixel diffuse and specular lighting from the point lights and spotlights
+//	FEATURE_NORMAL_MAP     - Normals from the normal map (needs tangents in the vertex data)
+//	FEATURE_PARALLAX       - Parallax mapping from the depth in the normal map's alpha channel
+//	FEATURE_CEL_SHADING    - Light levels stepped by the cel gradient
+//	FEATURE_NOIR_SHADING   - Black and white light levels and material, stepped by the cel gradient
+//	FEATURE_OUTLINE        - Extra pass drawing a black outline around the model
+//	FEATURE_SHADOWS        - Spotlights tested against their shadow maps
+//	FEATURE_WIGGLE         - Vertices wiggle and the texture scrolls
+//	FEATURE_ADDITIVE       - Additive blending with both sides drawn and no depth writes
+//	FEATURE_ALPHA_CUTOUT   - Pixels with low texture alpha discarded, the rest drawn at half brightness
+//	FEATURE_DEPTH_ONLY     - Only the depth of each pixel, for shadow maps
+//
+// The shared constants and textures are also compiled on their own (with EFFECT_POOL defined) into an effect pool that every
+// permutation is a child of, so they are set once for all of them
+
+// Number of lights used in the lighting loops - also defined by the C++ code. The constant buffer always has room for three
+// point lights and one spotlight, a loop with no lights is left out
+#ifndef NO_OF_LIGHTS
+#define NO_OF_LIGHTS 3
+#endif
+#ifndef NO_OF_SPOT_LIGHTS
+#define NO_OF_SPOT_LIGHTS 1
+#endif
+
+//--------------------------------------------------------------------------------------
+// Global Variables
 //--------------------------------------------------------------------------------------
+// All these variables are created & manipulated in the C++ code and passed into the shader here
+//
+// The constants are grouped into buffers by how often they change, so changing one (e.g. the world matrix for each model) only
+// uploads its own small buffer rather than every constant in the file. The C++ side writes each buffer whole from a matching
+// struct (see ShaderConstants.h) - any change to a buffer's layout must be made to its struct too. Matrices are row major, as they
+// are stored by D3DX
+//
+// The variables are shared - they belong to the effect pool and are seen by every permutation
+
+//-------------------------
+// Per-frame Data - also changed for each shadow map, which is rendered with the light's view-projection matrix
+
+shared cbuffer PerFrame
+{
+	// The matrices (4x4 matrix of floats) for transforming from 3D model to 2D projection (used in vertex shader)
+	row_major float4x4 ViewMatrix;
+	row_major float4x4 ProjMatrix;
+	row_major float4x4 ViewProjMatrix;
+
+	// Camera Data
+	float3 CameraPos;
+
+	// Misc
+	float Wiggle;
+};
+
+//-------------------------
+// Lighting Data - set once a frame for all the lights together
+
+shared cbuffer PerLightSet
+{
+	float3 Light1DiffuseCol;
+	float3 Light1SpecularCol;
+	float3 Light1Position;
+	float3 Light2DiffuseCol;
+	float3 Light2SpecularCol;
+	float3 Light2Position;
+	float3 Light3DiffuseCol;
+	float3 Light3SpecularCol;
+	float3 Light3Position;
+
+	float3 SpotLight1DiffuseCol;
+	float3 SpotLight1SpecularCol;
+	float3 SpotLight1Position;
+	float3 SpotLight1Facing;
+	float  SpotLight1CosHalfAngle;
+	row_major float4x4 SpotLight1ViewMatrix;
+	row_major float4x4 SpotLight1ProjMatrix;
+	row_major float4x4 SpotLight1ViewProjMatrix;
+
+	float3 AmbientColour;
+};
+
+shared Texture2D SpotLight1ShadowMap;
+
+//--------------------------
+// Model Material Data - set when the material changes
+
+shared cbuffer PerMaterial
+{
+	float SpecularPower;
+	float ParallaxDepth;
+	float OutlineThickness;
+};
+
+// Diffuse texture map (the main texture colour) - may contain specular map in alpha channel
+shared Texture2D DiffuseMap;
+// Normal map - may contain parallax map in alpha channel
+shared Texture2D NormalMap;
+//Gradient for clamping Cel shading colours
+shared Texture2D CelGradient;
+
+//--------------------------
+// Model Data - set for each model drawn
 
-// Standard input geometry data, more complex techniques (e.g. normal mapping) may need more
-struct VS_BASIC_INPUT
+shared cbuffer PerObject
 {
-	float3 Pos    : POSITION;
-	float3 Normal : NORMAL;
-	float2 UV     : TEXCOORD0;
+	row_major float4x4 WorldMatrix;
+
+	// A single colour for an entire model - used for light models and the intial basic shader
+	float3 ModelColour;
 };
 
-//Normal Mapping vertex shader output
-struct VS_NORMALMAP_INPUT
+
+// The effect pool has only the shared variables above, the rest of the file is compiled for each permutation
+#if !defined(EFFECT_POOL)
+
+#if NO_OF_LIGHTS > 3 || NO_OF_SPOT_LIGHTS > 1
+#error More lights than the PerLightSet buffer has room for
+#endif
+
+// Untextured pixels are the model colour, tinted ones are multiplied by it. Instanced techniques use the instance colour instead
+#if !defined(FEATURE_DEPTH_ONLY) && (defined(FEATURE_TINT) || !defined(FEATURE_TEXTURE))
+#define USES_MODEL_COLOUR
+#endif
+
+// Per-instance world matrices are only available in the vertex shader, so permutations that use the world matrix elsewhere (the
+// normal map and the outline) have no instanced technique. Shadow maps are never drawn instanced
+#if !defined(FEATURE_NORMAL_MAP) && !defined(FEATURE_OUTLINE) && !defined(FEATURE_DEPTH_ONLY)
+#define HAS_INSTANCED_TECHNIQUE
+#endif
+
+// The original cel and noir shaded techniques drew the outline before the model, the ones with normal maps drew it after. The C++
+// code expects the same order (see CTechnique::IsOutlinePass)
+#if defined(FEATURE_OUTLINE) && (defined(FEATURE_CEL_SHADING) || defined(FEATURE_NOIR_SHADING)) && !defined(FEATURE_NORMAL_MAP)
+#define OUTLINE_FIRST
+#endif
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+
+// Input geometry data, with tangents for normal mapping
+struct VS_INPUT
 {
 	float3 Pos     : POSITION;
 	float3 Normal  : NORMAL;
 	float2 UV      : TEXCOORD0;
+#if defined(FEATURE_NORMAL_MAP)
 	float3 Tangent : TANGENT;
+#endif
 };
 
-// Data output from vertex shader to pixel shader for simple techniques. Again different techniques have different requirements
-struct VS_BASIC_OUTPUT
-{
-	float4 ProjPos : SV_POSITION;
-	float2 UV      : TEXCOORD0;
+// Input for instanced techniques - the basic geometry data from the model's vertex buffer, plus the world matrix (one row per
+// element) and colour of the instance from a second, per-instance, vertex buffer
+struct VS_INSTANCED_INPUT
+{
+	float3 Pos            : POSITION;
+	float3 Normal         : NORMAL;
+	float2 UV             : TEXCOORD0;
+	float4 WorldRow0      : WORLD0;
+	float4 WorldRow1      : WORLD1;
+	float4 WorldRow2      : WORLD2;
+	float4 WorldRow3      : WORLD3;
+	float3 InstanceColour : INSTANCECOLOUR;
 };
 
-//Alternate Vertex Shader Output - needed values for pixel Lighting
-struct VS_LIGHTING_OUTPUT
+// Data output from vertex shader to pixel shader - only what the permutation's features use
+struct VS_OUTPUT
 {
-	float4 ProjPos		: SV_POSITION;  // 2D "projected" position for vertex (required output for vertex shader)
-	float3 WorldPos		: POSITION;
-	float3 WorldNormal	: NORMAL;
-	float2 UV			: TEXCOORD0;
+	float4 ProjPos : SV_POSITION;  // 2D "projected" position for vertex (required output for vertex shader)
+	float2 UV      : TEXCOORD0;
+#if defined(FEATURE_PIXEL_LIGHTING)
+	float3 WorldPos : POSITION;
+#if defined(FEATURE_NORMAL_MAP)
+	// The model's normal and tangent in model space (Pixel shader transforms them to world space)
+	float3 ModelNormal  : NORMAL;
+	float3 ModelTangent : TANGENT;
+#else
+	float3 WorldNormal  : NORMAL;
+#endif
+#endif
+#if defined(USES_MODEL_COLOUR)
+	float3 Colour : COLOR0;
+#endif
 };
 
-//Normal Mapping vertex shader output
-struct VS_NORMALMAP_OUTPUT
+// Output of the outline vertex shader, the outline is a single colour
+struct VS_OUTLINE_OUTPUT
 {
-	float4 ProjPos      : SV_POSITION;
-	float3 WorldPos     : POSITION;
-	float3 ModelNormal  : NORMAL;
-	float3 ModelTangent : TANGENT;
-	float2 UV           : TEXCOORD0;
+	float4 ProjPos : SV_POSITION;
 };
 
+#if defined(FEATURE_PIXEL_LIGHTING)
 struct LIGHT_DATA
 {
 	float3 diffuseColour;
@@ -72,69 +227,7 @@ struct SPOT_LIGHT_DATA
 	float cosHalfAngle;
 	Texture2D shadowMap;
 };
-
-//--------------------------------------------------------------------------------------
-// Global Variables
-//--------------------------------------------------------------------------------------
-// All these variables are created & manipulated in the C++ code and passed into the shader here
-
-// The matrices (4x4 matrix of floats) for transforming from 3D model to 2D projection (used in vertex shader)
-float4x4 WorldMatrix;
-float4x4 ViewMatrix;
-float4x4 ProjMatrix;
-float4x4 ViewProjMatrix;
-
-// Misc
-float Wiggle;
-
-//--------------------------
-// Model Material Data
-
-// A single colour for an entire model - used for light models and the intial basic shader
-float3		ModelColour;
-// Diffuse texture map (the main texture colour) - may contain specular map in alpha channel
-Texture2D	DiffuseMap;
-float		SpecularPower;
-// Normal map - may contain parallax map in alpha channel
-Texture2D	NormalMap;
-float		ParallaxDepth;
-//Gradient for clamping Cel shading colours
-Texture2D CelGradient;
-float OutlineThickness;
-
-//-------------------------
-// Camera Data
-
-float3 CameraPos;
-
-//-------------------------
-// Lighting Data
-static const unsigned int NO_OF_LIGHTS = 3;	
-
-float3 Light1DiffuseCol;
-float3 Light2DiffuseCol;
-float3 Light3DiffuseCol;
-float3 Light1SpecularCol;
-float3 Light2SpecularCol;
-float3 Light3SpecularCol;
-float3 Light1Position;
-float3 Light2Position;
-float3 Light3Position;
-
-static const unsigned int NO_OF_SPOT_LIGHTS = 1;
-
-float3		SpotLight1DiffuseCol;
-float3		SpotLight1SpecularCol;
-float3		SpotLight1Position;
-float3		SpotLight1Facing;
-float4x4	SpotLight1ViewMatrix;
-float4x4	SpotLight1ProjMatrix;
-float4x4	SpotLight1ViewProjMatrix;
-float		SpotLight1CosHalfAngle;
-Texture2D	SpotLight1ShadowMap;
-
-
-float3 AmbientColour;
+#endif
 
 //--------------------------------------------------------------------------------------
 // Texture Samplers
@@ -167,92 +260,72 @@ SamplerState PointSampleClamp
 // Vertex Shaders
 //--------------------------------------------------------------------------------------
 
-// Basic vertex shader to transform 3D model vertices to 2D and pass UVs to the pixel shader
+// Transform 3D model vertices to 2D with the given world matrix, and pass on what the pixel shader needs. Used by both the
+// ordinary and the instanced vertex shader
 //
-VS_BASIC_OUTPUT BasicTransform( VS_BASIC_INPUT vIn )
-{
-	VS_BASIC_OUTPUT vOut;
-	
-	// Use world matrix passed from C++ to transform the input model vertex position into world space
-	float4 modelPos = float4(vIn.Pos, 1.0f); // Promote to 1x4 so we can multiply by 4x4 matrix, put 1.0 in 4th element for a point (0.0 for a vector)
-	float4 worldPos = mul( modelPos, WorldMatrix );
-	vOut.ProjPos    = mul( worldPos,  ViewProjMatrix );
-	
-	// Pass texture coordinates (UVs) on to the pixel shader
-	vOut.UV = vIn.UV;
-
-	return vOut;
-}
-
-VS_BASIC_OUTPUT WiggleTransform(VS_BASIC_INPUT vIn)
+VS_OUTPUT TransformVertex(VS_INPUT vIn, float4x4 worldMatrix, float3 colour)
 {
-	VS_BASIC_OUTPUT vOut;
+	VS_OUTPUT vOut;
 
-	// Use world matrix passed from C++ to transform the input model vertex position into world space
+	// Use the world matrix to transform the input model vertex position into world space
 	float4 modelPos = float4(vIn.Pos, 1.0f); // Promote to 1x4 so we can multiply by 4x4 matrix, put 1.0 in 4th element for a point (0.0 for a vector)
-	float4 worldPos = mul(modelPos, WorldMatrix);
-
-	//****Make the vertices wiggle
-	float4 normal = float4(vIn.Normal, 0.0f);	//Promote normal to a float4 for calculations
-	float4 worldNormal = mul(normal, WorldMatrix);	//Put normal in world space
-	worldNormal = normalize(worldNormal);			//Ensure the normal is normalised
+	float4 worldPos = mul(modelPos, worldMatrix);
 
+#if defined(FEATURE_WIGGLE)
 	//Make the vertices wiggle
 	worldPos.x += cos(modelPos.z + Wiggle) * 0.15f;
 	worldPos.y += cos(modelPos.x + Wiggle) * 0.15f;
 	worldPos.z += cos(modelPos.y + Wiggle) * 0.15f;
-	//*****************************
+#endif
 
 	vOut.ProjPos = mul(worldPos, ViewProjMatrix);
 
+#if defined(FEATURE_PIXEL_LIGHTING)
+	vOut.WorldPos = worldPos.xyz;
+#if defined(FEATURE_NORMAL_MAP)
+	// Send the model's normal and tangent in model space. (Pixel shader transforms them to world space)
+	vOut.ModelNormal = vIn.Normal;
+	vOut.ModelTangent = vIn.Tangent;
+#else
+	float4 modelNormal = float4(vIn.Normal, 0.0f);
+	vOut.WorldNormal = normalize(mul(modelNormal, worldMatrix)).xyz;
+#endif
+#endif
+
+#if defined(USES_MODEL_COLOUR)
+	vOut.Colour = colour;
+#endif
+
 	// Pass texture coordinates (UVs) on to the pixel shader
 	vOut.UV = vIn.UV;
 
 	return vOut;
 }
 
-VS_LIGHTING_OUTPUT PixelLightingTransform(VS_BASIC_INPUT vIn)
+VS_OUTPUT MainTransform(VS_INPUT vIn)
 {
-	VS_LIGHTING_OUTPUT vOut;
-
-	float4 modelPos = float4(vIn.Pos, 1.0f); 
-	float4 worldPos = mul(modelPos, WorldMatrix);
-	vOut.WorldPos = worldPos.xyz;
-
-	vOut.ProjPos = mul(worldPos, ViewProjMatrix);
-
-	float4 modelNormal = float4(vIn.Normal, 0.0f);
-	vOut.WorldNormal = normalize(mul(modelNormal, WorldMatrix)).xyz;
-
-	vOut.UV = vIn.UV;
-	return vOut;
+	return TransformVertex(vIn, WorldMatrix, ModelColour);
 }
 
-VS_NORMALMAP_OUTPUT NormalMapTransform(VS_NORMALMAP_INPUT vIn)
+#if defined(HAS_INSTANCED_TECHNIQUE)
+// Takes the world matrix and colour from the instance data instead of WorldMatrix and ModelColour, so many copies of a model
+// can be drawn in one call
+VS_OUTPUT MainTransformInstanced(VS_INSTANCED_INPUT vIn)
 {
-	VS_NORMALMAP_OUTPUT vOut;
-
-	// Transform model position into world space
-	float4 modelPos = float4(vIn.Pos, 1.0f);
-	float4 worldPos = mul(modelPos, WorldMatrix);
-	vOut.WorldPos = worldPos.xyz;
-
-	// Transform vertex from world space to view space
-	vOut.ProjPos = mul(worldPos, ViewProjMatrix);
-
-	// Send the model's normal and tangent in model space. (Pixel shader transforms them to world space)
-	vOut.ModelNormal = vIn.Normal;
-	vOut.ModelTangent = vIn.Tangent;
-
-	// Pass texture coordinates (UVs) on to the pixel shader, the vertex shader doesn't need them
-	vOut.UV = vIn.UV;
+	VS_INPUT vertex;
+	vertex.Pos = vIn.Pos;
+	vertex.Normal = vIn.Normal;
+	vertex.UV = vIn.UV;
 
-	return vOut;
+	float4x4 worldMatrix = float4x4(vIn.WorldRow0, vIn.WorldRow1, vIn.WorldRow2, vIn.WorldRow3);
+	return TransformVertex(vertex, worldMatrix, vIn.InstanceColour);
 }
+#endif
 
-VS_BASIC_OUTPUT ExpandOutline(VS_BASIC_INPUT vIn)
+#if defined(FEATURE_OUTLINE)
+VS_OUTLINE_OUTPUT ExpandOutline(VS_INPUT vIn)
 {
-	VS_BASIC_OUTPUT vOut;
+	VS_OUTLINE_OUTPUT vOut;
 
 	// Transform model-space vertex position to world-space
 	float4 modelPos = float4(vIn.Pos, 1.0f); // Promote to 1x4 so we can multiply by 4x4 matrix, put 1.0 in 4th element for a point (0.0 for a vector)
@@ -267,7 +340,7 @@ VS_BASIC_OUTPUT ExpandOutline(VS_BASIC_INPUT vIn)
 	float4 worldNormal = normalize(mul(modelNormal, WorldMatrix)); // Normalise in case of world matrix scaling
 
 	// Expand the vertex outwards
-	// World position is modified (use a general Thickness, modify it by the square root of the distance to the camera then scale the normal by that value 
+	// World position is modified (use a general Thickness, modify it by the square root of the distance to the camera then scale the normal by that value
 	// this makes the new world position of the dark version bigger than the 'main version' of the model
 	worldPos += OutlineThickness * sqrt(viewPos.z) * worldNormal;
 
@@ -277,26 +350,35 @@ VS_BASIC_OUTPUT ExpandOutline(VS_BASIC_INPUT vIn)
 
 	return vOut;
 }
+#endif
 
 //-------------------------------------------------------------------------------------
 // Pixel Shader Component Functions
 //-------------------------------------------------------------------------------------
 
+#if defined(FEATURE_PIXEL_LIGHTING)
+
+#if NO_OF_LIGHTS > 0
 void AssembleLightData(out LIGHT_DATA Lights[NO_OF_LIGHTS])
 {
 	//Initialise Lighting Array
 	Lights[0].diffuseColour =	Light1DiffuseCol;
 	Lights[0].specularColour =	Light1SpecularCol;
 	Lights[0].position =		Light1Position;
+#if NO_OF_LIGHTS > 1
 	Lights[1].diffuseColour =	Light2DiffuseCol;
 	Lights[1].specularColour =	Light2SpecularCol;
 	Lights[1].position =		Light2Position;
+#endif
+#if NO_OF_LIGHTS > 2
 	Lights[2].diffuseColour =	Light3DiffuseCol;
 	Lights[2].specularColour =	Light3SpecularCol;
 	Lights[2].position =		Light3Position;
-
+#endif
 }
+#endif
 
+#if NO_OF_SPOT_LIGHTS > 0
 void AssembleSpotLightData(out SPOT_LIGHT_DATA SpotLights[NO_OF_SPOT_LIGHTS])
 {
 	SpotLights[0].diffuseColour =	SpotLight1DiffuseCol;
@@ -309,166 +391,13 @@ void AssembleSpotLightData(out SPOT_LIGHT_DATA SpotLights[NO_OF_SPOT_LIGHTS])
 	SpotLights[0].cosHalfAngle =	SpotLight1CosHalfAngle;
 	SpotLights[0].shadowMap =		SpotLight1ShadowMap;
 }
+#endif
 
-//--------------------------------------------------------------------------------------
-// Pixel Shaders
-//--------------------------------------------------------------------------------------
-
-// A pixel shader that just outputs a single fixed colour
-//
-float4 OneColour(VS_BASIC_OUTPUT vOut) : SV_Target
-{
-	return float4( ModelColour, 1.0f ); // Set alpha channel to 1.0 (opaque)
-}
-
-float4 CelShadeOneColour(VS_BASIC_OUTPUT vOut) : SV_Target
-{
-	return float4(0.0f, 0.0f, 0.0f, 1.0f); // Set alpha channel to 1.0 (opaque)
-}
-
-float4 DiffuseTextured(VS_BASIC_OUTPUT vOut) : SV_Target
-{
-	return DiffuseMap.Sample(Anisotropic16, vOut.UV);	//Return the texture colour of this pixel
-}
-
-float4 ScrollAndTint(VS_BASIC_OUTPUT vOut) : SV_Target
-{
-	float4 diffuseMapColour = DiffuseMap.Sample(Anisotropic16, (vOut.UV + Wiggle / 200));	//set the map colour of this pixel to an offset UV based on the wiggle value passed from c++
-
-	float4 combinedColour;
-	combinedColour.rgb = diffuseMapColour.rgb * ModelColour;		//Combine the map colour with the model colour using multiplicative blending - this adds a tint to the map colour
-	combinedColour.a = 1.0f;										//No alpha channel
-
-	return combinedColour;
-}
-
-float4 PixelLighting(VS_LIGHTING_OUTPUT vOut) : SV_Target
-{
-	LIGHT_DATA Lights[NO_OF_LIGHTS];
-	AssembleLightData(Lights);
-
-	//*********************************************************************************************
-	// Calculate direction of light and camera
-	float3 CameraDir = normalize(CameraPos - vOut.WorldPos.xyz); // Position of camera - position of current pixel (in world space)
-	
-	float3 LightDirs[NO_OF_LIGHTS];
-	float3 LightDist[NO_OF_LIGHTS];
-
-	float3 diffuseLight = AmbientColour;	//Begin with just ambient light
-	
-	float3 halfwayNormal = 0.0f;
-	float3 specularLight = 0.0f;
-	
-
-	//Perform Lighting Equations for the main lights
-	for (unsigned int i = 0; i < NO_OF_LIGHTS; i++)	//Perform calculations on lights, one light at a time
-	{
-		LightDirs[i] = Lights[i].position - vOut.WorldPos.xyz;	//Dont normalise yet (need to calculate length for attenuated light first)
-		LightDist[i] = length(LightDirs[i]);
-		LightDirs[i] = normalize(LightDirs[i]); //Can now normalise
-
-		//Calculate Diffuse Light
-		diffuseLight += Lights[i].diffuseColour * saturate(dot(vOut.WorldNormal.xyz, LightDirs[i])) / LightDist[i];	//Add each light's diffuse value one at a time
-		//Calculate specular light
-		halfwayNormal = normalize(LightDirs[i] + CameraDir);	//Calculate halfway normal for this light
-		specularLight += Lights[i].specularColour * pow(saturate(dot(vOut.WorldNormal.xyz, halfwayNormal)), SpecularPower) / LightDist[i];	//Add Specular light for this light onto the current total 
-
-	}
-	
-	//Perform Lighting Equations for the spot lights
-
-	SPOT_LIGHT_DATA SpotLights[NO_OF_SPOT_LIGHTS];
-	AssembleSpotLightData(SpotLights);
-
-	float3 SpotLightDirs[NO_OF_SPOT_LIGHTS];
-	float3 SpotLightDist[NO_OF_SPOT_LIGHTS];
-
-	for (unsigned int i = 0; i < NO_OF_SPOT_LIGHTS; i++)
-	{
-		SpotLightDirs[i] = SpotLights[i].position - vOut.WorldPos.xyz;	//Dont normalise yet (need to calculate length for attenuated light first)
-		SpotLightDist[i] = length(SpotLightDirs[i]);
-		SpotLightDirs[i] = normalize(SpotLightDirs[i]); //Can now normalise		
-		SpotLights[i].facingVector = normalize(SpotLights[i].facingVector);
-
-		if (SpotLights[i].cosHalfAngle < dot(SpotLights[i].facingVector, -SpotLightDirs[i]))
-		{
-			//Calculate Diffuse Light
-			diffuseLight += SpotLights[i].diffuseColour * saturate(dot(vOut.WorldNormal.xyz, SpotLightDirs[i])) / SpotLightDist[i];	//Add each light's diffuse value one at a time
-			//Calculate specular light
-			halfwayNormal = normalize(SpotLightDirs[i] + CameraDir);	//Calculate halfway normal for this ligh
-			specularLight += SpotLights[i].specularColour * pow(saturate(dot(vOut.WorldNormal.xyz, halfwayNormal)), SpecularPower) / SpotLightDist[i];	//Add Specular light for this light onto the current total 
-		}
-	}
-
-
-	//diffuseLight = 0.0f;	//Set Diffuse to 0 (DEBUGGING ONLY)
-	//specularLight = 0.0f; //Set Specular to 0 (DEBUGGING ONLY)
-
-	//*********************************************************************************************
-	// Get colours from texture maps
-
-	// Extract diffuse material colour for this pixel from a texture (using float3, so we get RGB - i.e. ignore any alpha in the texture)
-	float3 DiffuseMaterial = DiffuseMap.Sample(TrilinearWrap, vOut.UV).rgb;
-
-	// Sample specular material colour from alpha channel of the diffusemap
-	float SpecularMaterial = DiffuseMap.Sample(TrilinearWrap, vOut.UV).a;
-	//*********************************************************************************************
-	// Combine colours (lighting, textures) for final pixel colour
-
-	float4 combinedColour;
-	
-	//combinedColour.rgb = diffuseLight + specularLight;	//Light - without material
-	combinedColour.rgb = (DiffuseMaterial * diffuseLight) + (SpecularMaterial * specularLight); //Light - with material
-	
-	combinedColour.a = 1.0f; // No alpha processing in this shader, so just set it to 1
-
-	return combinedColour;
-}
-
-float4 NormalMapLighting(VS_NORMALMAP_OUTPUT vOut) : SV_Target
-{
-	//************************
-	// Normal Map Extraction
-	//************************
-
-	//Normalise interpolated model normal and tangent
-	float3 modelNormal = normalize(vOut.ModelNormal);
-	float3 modelTangent = normalize(vOut.ModelTangent);
-
-	// Calculate bi-tangent to complete the three axes of tangent space - then create the *inverse* tangent matrix to convert *from*
-	// tangent space into model space.
-	float3 modelBiTangent = cross(modelNormal, modelTangent);
-	float3x3 invTangentMatrix = float3x3(modelTangent, modelBiTangent, modelNormal);
-
-	// Get the texture normal from the normal map and convert from rgb range to xyz range (colour of normal map to the normal itself)
-	float3 textureNormal = 2.0f * NormalMap.Sample(TrilinearWrap, vOut.UV) - 1.0f; 	//range 0->1, to range 1->1.
-
-	/*Exaggerate the normal provided by the texture*/
-	textureNormal.z /= 5.0f;
-	normalize(textureNormal);
-	/*---------------------------------------------*/
-
-	// Convert from texture space to model space using invTangentMatrix, then convert to world space using worldmatrix - then normalize (to accomodate world scaling etc..)
-	float3 worldNormal = normalize(mul(mul(textureNormal, invTangentMatrix), WorldMatrix));
-
-	// The world normal is now the version from the file rather than the automatically generated one
-	//This means we can use the ordinary diffuse/specular lighting equations/shader to perform the lighting calculation
-	
-	// Create a VS_LIGHTING_OUTPUT to send to PixelLighting to perform the relevant lighting calculations
-	VS_LIGHTING_OUTPUT diffSpecOut;
-	diffSpecOut.ProjPos = vOut.ProjPos;
-	diffSpecOut.WorldPos = vOut.WorldPos;
-	diffSpecOut.WorldNormal = worldNormal;
-	diffSpecOut.UV = vOut.UV;
-	return PixelLighting(diffSpecOut);	//Return the value given by the PixelLighting pixel shader
-}
-
-float4 ParallaxMapLighting(VS_NORMALMAP_OUTPUT vOut) : SV_Target
+#if defined(FEATURE_NORMAL_MAP)
+// Get the world normal of a pixel from the normal map. With parallax mapping the texture coordinate is offset first, and the
+// offset coordinate is used from then on
+float3 NormalMapNormal(VS_OUTPUT vOut, inout float2 uv)
 {
-	//************************
-	// Normal Map Extraction
-	//************************
-
 	//Normalise interpolated model normal and tangent
 	float3 modelNormal = normalize(vOut.ModelNormal);
 	float3 modelTangent = normalize(vOut.ModelTangent);
@@ -478,598 +407,270 @@ float4 ParallaxMapLighting(VS_NORMALMAP_OUTPUT vOut) : SV_Target
 	float3 modelBiTangent = cross(modelNormal, modelTangent);
 	float3x3 invTangentMatrix = float3x3(modelTangent, modelBiTangent, modelNormal);
 
+#if defined(FEATURE_PARALLAX)
 	//--------------------------------------------
 	// Parallax Mapping - Calculate alternate texture coordinate for this pixel
 	//--------------------------------------------
 
-	// Get normalised vector to camera for parallax mapping and specular equation (this vector was calculated later in previous shaders)
+	// Get normalised vector to camera for parallax mapping
 	float3 CameraDir = normalize(CameraPos - vOut.WorldPos.xyz);
 
-	float3x3 invWorldMatrix = transpose( WorldMatrix );						// Flip matrix over its diagonal - need this to move camera vector from world space 'backwards' into the model space of this model
-	float3 cameraModelDir = normalize( mul( CameraDir, invWorldMatrix ) );	// Normalise in case world matrix is scaled
+	float3x3 invWorldMatrix = transpose((float3x3)WorldMatrix);				// Flip matrix over its diagonal - need this to move camera vector from world space 'backwards' into the model space of this model
+	float3 cameraModelDir = normalize(mul(CameraDir, invWorldMatrix));	// Normalise in case world matrix is scaled
 
 	// Then transform model-space camera vector into tangent space (texture coordinate space) to give the direction to offset texture
 	// coordinate, only interested in x and y components. Calculated inverse tangent matrix above, so invert it back for this step
-	float3x3 tangentMatrix = transpose( invTangentMatrix ); 
-	float2 textureOffsetDir = mul( cameraModelDir, tangentMatrix );
+	float3x3 tangentMatrix = transpose(invTangentMatrix);
+	float2 textureOffsetDir = mul(cameraModelDir, tangentMatrix).xy;
 
 	// Get the depth info from the normal map's alpha channel at the given texture coordinate
 	// Rescale from 0->1 range to -x->+x range, x determined by ParallaxDepth setting
-	float texDepth = ParallaxDepth * (NormalMap.Sample(TrilinearWrap, vOut.UV).a - 0.5f);
+	float texDepth = ParallaxDepth * (NormalMap.Sample(TrilinearWrap, uv).a - 0.5f);
 
 	// Use the depth of the texture to offset the given texture coordinate - this corrected texture coordinate will be used from here on
-	float2 offsetTexCoord = vOut.UV + texDepth * textureOffsetDir;
-
-	//--------------------------------------------
-	// End parallax mapping
-	//--------------------------------------------
+	uv += texDepth * textureOffsetDir;
+#endif
 
 	// Get the texture normal from the normal map and convert from rgb range to xyz range (colour of normal map to the normal itself)
-	float3 textureNormal = 2.0f * NormalMap.Sample(TrilinearWrap, offsetTexCoord) - 1.0f; 	//range 0->1, to range 1->1. // Using new offsetTexCoord (parallax effected texture coordinate) instead of standard UV
+	float3 textureNormal = 2.0f * NormalMap.Sample(TrilinearWrap, uv).xyz - 1.0f; 	//range 0->1, to range 1->1.
 
-	// Calculate Lighting for specular/diffuse as usual
+#if !defined(FEATURE_PARALLAX)
+	/*Exaggerate the normal provided by the texture*/
+	textureNormal.z /= 5.0f;
+#endif
 
 	// Convert from texture space to model space using invTangentMatrix, then convert to world space using worldmatrix - then normalize (to accomodate world scaling etc..)
-	float3 worldNormal = normalize(mul(mul(textureNormal, invTangentMatrix), WorldMatrix));
-
-	// The world normal is now the version from the file rather than the automatically generated one
-	//This means we can use the ordinary diffuse/specular lighting equations/shader to perform the lighting calculation
-
-	// Create a VS_LIGHTING_OUTPUT to send to PixelLighting to perform the relevant lighting calculations
-	VS_LIGHTING_OUTPUT diffSpecOut;
-	diffSpecOut.ProjPos = vOut.ProjPos;
-	diffSpecOut.WorldPos = vOut.WorldPos;
-	diffSpecOut.WorldNormal = worldNormal;
-	diffSpecOut.UV = offsetTexCoord;
-	return PixelLighting(diffSpecOut);	//Return the value given by the PixelLighting pixel shader
+	return normalize(mul(mul(textureNormal, invTangentMatrix), (float3x3)WorldMatrix));
 }
+#endif
 
-float4 NoireShade(VS_LIGHTING_OUTPUT vOut) : SV_Target  // The ": SV_Target" bit just indicates that the returned float4 colour goes to the render target (i.e. it's a colour to render)
+#if defined(FEATURE_SHADOWS) && NO_OF_SPOT_LIGHTS > 0
+// Check if a pixel is in a spotlight's shadow, i.e. something nearer to the light is in its shadow map
+bool InShadow(float3 worldPos, float4x4 lightViewMatrix, float4x4 lightProjMatrix, Texture2D shadowMap)
 {
-	// Can't guarantee the normals are length 1, interpolation from vertex shader to pixel shader will rescale normals
-	float3 worldNormal = normalize(vOut.WorldNormal);
+	// Slight adjustment to calculated depth of pixels so they don't shadow themselves
+	const float DepthAdjust = 0.0005f;
 
-	//Initialise Lighting Array
-	LIGHT_DATA Lights[NO_OF_LIGHTS];
-	AssembleLightData(Lights);
+	// Using the world position of the current pixel and the matrices of the light (as a camera), find the 2D position of the
+	// pixel *as seen from the light*. Will use this to find which part of the shadow map to look at.
+	float4 LightViewPos = mul(float4(worldPos, 1.0f), lightViewMatrix);
+	float4 LightProjPos = mul(LightViewPos, lightProjMatrix);
+
+	// Convert 2D pixel position as viewed from light into texture coordinates for shadow map
+	// Detail: 2D position x & y get perspective divide, then converted from range -1->1 to UV range 0->1. Also flip V axis
+	float2 shadowUV = 0.5f * LightProjPos.xy / (LightProjPos.w + float2(0.5f, 0.5f));
+	shadowUV.y = 1.0f - shadowUV.y;
+
+	// Get depth of this pixel if it were visible from the light
+	float depthFromLight = LightProjPos.z / LightProjPos.w - DepthAdjust;	// Adjustment so polygons don't shadow themselves
+	float depthFromShadowMap = shadowMap.Sample(PointSampleClamp, shadowUV).r;
+
+	// Compare pixel depth from light with depth held in shadow map of the light. If shadow map depth is less then something is nearer
+	// to the light than this pixel - so the pixel gets no effect from this light
+	return depthFromLight >= depthFromShadowMap;
+}
+#endif
+
+// Add the diffuse and specular light from one light to the totals. The light direction is normalised, the distance attenuates
+// the light
+void AddLight(float3 diffuseColour, float3 specularColour, float3 lightDir, float lightDist, float3 worldNormal, float3 cameraDir,
+              inout float3 diffuseLight, inout float3 specularLight)
+{
+	float3 halfwayNormal = normalize(lightDir + cameraDir);	//Calculate halfway normal for this light
+	float diffuseLevel = saturate(dot(worldNormal, lightDir));
+	float specularLevel = pow(saturate(dot(worldNormal, halfwayNormal)), SpecularPower);
+
+#if defined(FEATURE_CEL_SHADING)
+	// Take the light colour and multiply it by the light level for this point (clamped based on the Celgradient texture), divided
+	// by the distance of the light (for attenuation). Specular light is the diffuse light scaled by the clamped specular level
+	float3 celDiffuseLight = diffuseColour * CelGradient.Sample(PointSampleClamp, diffuseLevel).r / lightDist;
+	specularLight += celDiffuseLight * CelGradient.Sample(PointSampleClamp, specularLevel).r;
+	diffuseLight += celDiffuseLight;
+#elif defined(FEATURE_NOIR_SHADING)
+	// As cel shading, but with a strong specular from the clamped specular light
+	float3 noirDiffuseLight = diffuseColour * CelGradient.Sample(PointSampleClamp, diffuseLevel).r / lightDist;
+	specularLight += 30.0f * noirDiffuseLight * CelGradient.Sample(PointSampleClamp, (specularColour * specularLevel).xy).r / lightDist;
+	diffuseLight += noirDiffuseLight;
+#else
+	diffuseLight += diffuseColour * diffuseLevel / lightDist;
+	specularLight += specularColour * specularLevel / lightDist;
+#endif
+}
+
+#if defined(FEATURE_NOIR_SHADING) && NO_OF_SPOT_LIGHTS > 0
+// Add the light from one spotlight to the noir shading's specular total. As in the original noir technique, spotlights give no
+// diffuse light, and the strength of their specular comes from the noir diffuse light of the point light with the same number
+void AddNoirSpotLight(float3 specularColour, float3 lightDir, float lightDist, unsigned int number, float3 worldNormal,
+                      float3 worldPos, float3 cameraDir, inout float3 specularLight)
+{
+#if NO_OF_LIGHTS > 0
+	if (number < NO_OF_LIGHTS)
+	{
+		LIGHT_DATA Lights[NO_OF_LIGHTS];
+		AssembleLightData(Lights);
+		float3 pointLightDir = Lights[number].position - worldPos;
+		float pointLightDist = length(pointLightDir);
+		float3 pointDiffuseLight = Lights[number].diffuseColour *
+		                           CelGradient.Sample(PointSampleClamp, saturate(dot(worldNormal, pointLightDir / pointLightDist))).r /
+		                           pointLightDist;
+
+		float3 halfwayNormal = normalize(lightDir + cameraDir);
+		float specularLevel = pow(saturate(dot(worldNormal, halfwayNormal)), SpecularPower);
+		specularLight += 30.0f * pointDiffuseLight * CelGradient.Sample(PointSampleClamp, (specularColour * specularLevel).xy).r / lightDist;
+	}
+#endif
+}
+#endif
+
+#endif // FEATURE_PIXEL_LIGHTING
+
+//--------------------------------------------------------------------------------------
+// Pixel Shaders
+//--------------------------------------------------------------------------------------
+
+float4 MainPixel(VS_OUTPUT vOut) : SV_Target
+{
+#if defined(FEATURE_DEPTH_ONLY)
+	// Rendering a shadow map. In fact a pixel shader isn't needed, we are only writing to the depth buffer. However, needed to
+	// display what's in a shadow map - output the value that would go in the depth puffer to the pixel colour (greyscale)
+	return vOut.ProjPos.z / vOut.ProjPos.w;
+#else
+
+	float2 uv = vOut.UV;
+#if defined(FEATURE_WIGGLE)
+	uv += Wiggle / 200;	//Offset the UV based on the wiggle value passed from c++
+#endif
+
+#if defined(FEATURE_PIXEL_LIGHTING)
+	// Normal from the normal map (which may also move the texture coordinate), or the interpolated vertex normal. Can't guarantee
+	// the interpolated normals are length 1, so re-normalise
+#if defined(FEATURE_NORMAL_MAP)
+	float3 worldNormal = NormalMapNormal(vOut, uv);
+#elif defined(FEATURE_NOIR_SHADING)
+	float3 worldNormal = vOut.WorldNormal; // Noir shading has always used the interpolated normal as it is
+#else
+	float3 worldNormal = normalize(vOut.WorldNormal);
+#endif
+#endif
 
 	//*********************************************************************************************
-	// Calculate direction of light and camera
-	float3 CameraDir = normalize(CameraPos - vOut.WorldPos.xyz); // Position of camera - position of current pixel (in world space)
+	// Get colours from texture maps
 
-	float3 LightDirs[NO_OF_LIGHTS];
-	float3 LightDist[NO_OF_LIGHTS];
+#if defined(FEATURE_TEXTURE)
+	// Diffuse material colour for this pixel, may have the specular material in the alpha channel
+#if defined(FEATURE_PIXEL_LIGHTING)
+	float4 textureColour = DiffuseMap.Sample(TrilinearWrap, uv);
+#else
+	float4 textureColour = DiffuseMap.Sample(Anisotropic16, uv);
+#endif
+#if defined(FEATURE_ALPHA_CUTOUT)
+	if (textureColour.a < 0.5f)
+		discard;
+#endif
+#endif
 
-	float3 DiffuseLights[NO_OF_LIGHTS];
+	float4 combinedColour;
 
-	float3 combinedDiffuse = AmbientColour;	//Begin with just ambient light
+#if defined(FEATURE_PIXEL_LIGHTING)
+	//*********************************************************************************************
+	// Calculate direction of light and camera
+	float3 CameraDir = normalize(CameraPos - vOut.WorldPos.xyz); // Position of camera - position of current pixel (in world space)
 
-	float3 halfwayNormal = 0.0f;
+	float3 diffuseLight = AmbientColour;	//Begin with just ambient light
 	float3 specularLight = 0.0f;
 
+#if NO_OF_LIGHTS > 0
+	//Perform Lighting Equations for the main lights
+	LIGHT_DATA Lights[NO_OF_LIGHTS];
+	AssembleLightData(Lights);
+
 	for (unsigned int i = 0; i < NO_OF_LIGHTS; i++)	//Perform calculations on lights, one light at a time
 	{
-		LightDirs[i] = Lights[i].position - vOut.WorldPos.xyz;	//Dont normalise yet (need to calculate length for attenuated light first)
-		LightDist[i] = length(LightDirs[i]);
-		LightDirs[i] = normalize(LightDirs[i]); //Can now normalise
-		
-		//Calculate Diffuse Light
-		DiffuseLights[i] = Lights[i].diffuseColour *																//Take the light colour and multiply it by
-			CelGradient.Sample(PointSampleClamp, saturate(dot(vOut.WorldNormal.xyz, LightDirs[i]))).r		//the light level for this point (clamped based on the Celgradient texture)
-			/ LightDist[i];																					//Divided by the distance of the light (for attenuation)
-		
-		//Calculate specular light
-		halfwayNormal = normalize(LightDirs[i] + CameraDir);	//Calculate halfway normal for this light
-				
-		//specularLight += Lights[i].specularColour * CelGradient.Sample(PointSampleClamp, pow(saturate(dot(vOut.WorldNormal.xyz, halfwayNormal)), SpecularPower)).r / LightDist[i];	//Add Specular light for this light onto the current total 
-
-		specularLight += 30.0f * DiffuseLights[i] * 
-			CelGradient.Sample(PointSampleClamp, Lights[i].specularColour * pow(saturate(dot(vOut.WorldNormal.xyz, halfwayNormal)), SpecularPower)).r / LightDist[i];	//Add Specular light for this light onto the current total 
-
+		float3 lightDir = Lights[i].position - vOut.WorldPos.xyz;	//Dont normalise yet (need to calculate length for attenuated light first)
+		float lightDist = length(lightDir);
+		AddLight(Lights[i].diffuseColour, Lights[i].specularColour, lightDir / lightDist, lightDist, worldNormal, CameraDir,
+		         diffuseLight, specularLight);
 	}
+#endif
 
+#if NO_OF_SPOT_LIGHTS > 0
 	//Perform Lighting Equations for the spot lights
-
 	SPOT_LIGHT_DATA SpotLights[NO_OF_SPOT_LIGHTS];
 	AssembleSpotLightData(SpotLights);
 
-	float3 SpotLightDirs[NO_OF_SPOT_LIGHTS];
-	float3 SpotLightDist[NO_OF_SPOT_LIGHTS];
-	
-	float3 SpotDiffuseLights[NO_OF_SPOT_LIGHTS];
-
-	for (unsigned int i = 0; i < NO_OF_SPOT_LIGHTS; i++)
+	for (unsigned int j = 0; j < NO_OF_SPOT_LIGHTS; j++)
 	{
-		SpotLightDirs[i] = SpotLights[i].position - vOut.WorldPos.xyz;	//Dont normalise yet (need to calculate length for attenuated light first)
-		SpotLightDist[i] = length(SpotLightDirs[i]);
-		SpotLightDirs[i] = normalize(SpotLightDirs[i]); //Can now normalise
-		SpotLights[i].facingVector = normalize(SpotLights[i].facingVector);
+		float3 lightDir = SpotLights[j].position - vOut.WorldPos.xyz;	//Dont normalise yet (need to calculate length for attenuated light first)
+		float lightDist = length(lightDir);
+		lightDir /= lightDist;
 
-		if (SpotLights[i].cosHalfAngle < dot(SpotLights[i].facingVector, -SpotLightDirs[i]))
+		// Only pixels inside the cone of the spotlight are lit by it
+		if (SpotLights[j].cosHalfAngle < dot(normalize(SpotLights[j].facingVector), -lightDir))
 		{
-			//Calculate Diffuse Light
-			SpotDiffuseLights[i] = SpotLights[i].diffuseColour * 
-				CelGradient.Sample(PointSampleClamp, saturate(dot(vOut.WorldNormal.xyz, SpotLightDirs[i]))).r / SpotLightDist[i];	//Add each light's diffuse value one at a time
-			//Calculate specular light
-			halfwayNormal = normalize(SpotLightDirs[i] + CameraDir);	//Calculate halfway normal for this ligh
-			specularLight += 30.0f * DiffuseLights[i] *
-				CelGradient.Sample(PointSampleClamp, SpotLights[i].specularColour * pow(saturate(dot(vOut.WorldNormal.xyz, halfwayNormal)), SpecularPower)).r / SpotLightDist[i];	//Add Specular light for this light onto the current total 
+#if defined(FEATURE_SHADOWS)
+			if (!InShadow(vOut.WorldPos, SpotLights[j].viewMatrix, SpotLights[j].projMatrix, SpotLights[j].shadowMap))
+#endif
+			{
+#if defined(FEATURE_NOIR_SHADING)
+				AddNoirSpotLight(SpotLights[j].specularColour, lightDir, lightDist, j, worldNormal, vOut.WorldPos.xyz, CameraDir,
+				                 specularLight);
+#else
+				AddLight(SpotLights[j].diffuseColour, SpotLights[j].specularColour, lightDir, lightDist, worldNormal, CameraDir,
+				         diffuseLight, specularLight);
+#endif
+			}
 		}
 	}
+#endif
 
-	for (int i = 0; i < NO_OF_LIGHTS; i++)
-	{
-		combinedDiffuse += DiffuseLights[i];
-	}
-
-	//combinedDiffuse = 0.0f;	//Set Diffuse to 0 (DEBUGGING ONLY)
+	//diffuseLight = 0.0f;	//Set Diffuse to 0 (DEBUGGING ONLY)
 	//specularLight = 0.0f; //Set Specular to 0 (DEBUGGING ONLY)
 
-	////////////////////
-	// Sample texture
+	float4 DiffuseMaterial = textureColour;
+#if defined(FEATURE_NOIR_SHADING)
+	// Clamp the material colour to the levels of the cel gradient too
+	DiffuseMaterial *= CelGradient.Sample(PointSampleClamp, textureColour.xy).r;
+#endif
+
+	// Sample specular material colour from alpha channel of the diffusemap
+	float SpecularMaterial = DiffuseMaterial.a;
 
-	// Extract diffuse material colour for this pixel from a texture (using float3, so we get RGB - i.e. ignore any alpha in the texture)
-	float4 DiffuseMaterial = DiffuseMap.Sample(TrilinearWrap, vOut.UV) * CelGradient.Sample(PointSampleClamp, DiffuseMap.Sample(TrilinearWrap, vOut.UV)).r;
+	//*********************************************************************************************
+	// Combine colours (lighting, textures) for final pixel colour
 
-	// Assume specular material colour is white (i.e. highlights are a full, untinted reflection of light)
-	float3 SpecularMaterial = DiffuseMaterial.a;
+	combinedColour.rgb = (DiffuseMaterial.rgb * diffuseLight) + (SpecularMaterial * specularLight); //Light - with material
+	combinedColour.a = 1.0f; // No alpha processing for lit pixels, so just set it to 1
 
+#elif defined(FEATURE_TEXTURE)
+	combinedColour = textureColour;	//Return the texture colour of this pixel
+#else
+	combinedColour = 1.0f;	//Colour comes from the model colour alone
+#endif
 
-	////////////////////
-	// Combine colours 
+#if defined(USES_MODEL_COLOUR)
+	// Combine with the model colour using multiplicative blending - this adds a tint to the texture colour
+	combinedColour.rgb *= vOut.Colour;
+#endif
 
-	// Combine maps and lighting for final pixel colour
-	float4 combinedColour;
-	combinedColour.rgb = DiffuseMaterial * combinedDiffuse + SpecularMaterial * specularLight;
-	combinedColour.a = 1.0f; // No alpha processing in this shader, so just set it to 1
+#if defined(FEATURE_ALPHA_CUTOUT)
+	combinedColour *= 0.5f;
+#endif
 
 	return combinedColour;
+#endif // FEATURE_DEPTH_ONLY
 }
 
-float4 CelShade(VS_LIGHTING_OUTPUT vOut) : SV_Target  // The ": SV_Target" bit just indicates that the returned float4 colour goes to the render target (i.e. it's a colour to render)
+#if defined(FEATURE_OUTLINE)
+// Pixel shader for the outline, just outputs black
+float4 OutlineColour(VS_OUTLINE_OUTPUT vOut) : SV_Target
 {
-	// Can't guarantee the normals are length 1, interpolation from vertex shader to pixel shader will rescale normals
-	float3 worldNormal = normalize(vOut.WorldNormal);
+	return float4(0.0f, 0.0f, 0.0f, 1.0f); // Set alpha channel to 1.0 (opaque)
+}
+#endif
 
-	//Initialise Lighting Array
-	LIGHT_DATA Lights[NO_OF_LIGHTS];
-	AssembleLightData(Lights);
-
-	//*********************************************************************************************
-	// Calculate direction of light and camera
-	float3 CameraDir = normalize(CameraPos - vOut.WorldPos.xyz); // Position of camera - position of current pixel (in world space)
-
-	float3 LightDirs[NO_OF_LIGHTS];
-	float3 LightDist[NO_OF_LIGHTS];
-
-	float3 DiffuseLight;
-
-	float3 combinedDiffuse = AmbientColour;	//Begin with just ambient light
-
-	float3 halfwayNormal = 0.0f;
-	float3 specularLight = 0.0f;
-
-	float DiffuseLevel;
-	float CelDiffuseLevel;
-	float SpecularLevel;
-	float CelSpecularLevel;
-
-	for (unsigned int i = 0; i < NO_OF_LIGHTS; i++)	//Perform calculations on lights, one light at a time
-	{
-
-		LightDirs[i] = Lights[i].position - vOut.WorldPos.xyz;	//Dont normalise yet (need to calculate length for attenuated light first)
-		LightDist[i] = length(LightDirs[i]);
-		LightDirs[i] = normalize(LightDirs[i]); //Can now normalise
-
-		DiffuseLevel = saturate(dot(worldNormal.xyz, LightDirs[i]));
-		CelDiffuseLevel = CelGradient.Sample(PointSampleClamp, DiffuseLevel).r;
-
-		//Calculate Diffuse Light
-		DiffuseLight = Lights[i].diffuseColour * CelDiffuseLevel / LightDist[i];					//Take the light colour and multiply it by
-																									//the light level for this point (clamped based on the Celgradient texture)
-																									//Divided by the distance of the light (for attenuation)
-
-		//Calculate specular light
-		halfwayNormal = normalize(LightDirs[i] + CameraDir);	//Calculate halfway normal for this light
-		SpecularLevel = pow(saturate(dot(worldNormal.xyz, halfwayNormal)), SpecularPower);
-		CelSpecularLevel = CelGradient.Sample(PointSampleClamp, SpecularLevel).r;
-		specularLight += DiffuseLight * CelSpecularLevel;
-		
-		combinedDiffuse += DiffuseLight;
-	}
-
-
-	//Perform Lighting Equations for the spot lights
-
-	SPOT_LIGHT_DATA SpotLights[NO_OF_SPOT_LIGHTS];
-	AssembleSpotLightData(SpotLights);
-
-	float3 SpotLightDirs[NO_OF_SPOT_LIGHTS];
-	float3 SpotLightDist[NO_OF_SPOT_LIGHTS];
-
-	float3 SpotDiffuseLights[NO_OF_SPOT_LIGHTS];
-
-	for (unsigned int i = 0; i < NO_OF_SPOT_LIGHTS; i++)
-	{
-		SpotLightDirs[i] = SpotLights[i].position - vOut.WorldPos.xyz;	//Dont normalise yet (need to calculate length for attenuated light first)
-		SpotLightDist[i] = length(SpotLightDirs[i]);
-		SpotLightDirs[i] = normalize(SpotLightDirs[i]); //Can now normalise
-		SpotLights[i].facingVector = normalize(SpotLights[i].facingVector);
-
-		if (SpotLights[i].cosHalfAngle < dot(SpotLights[i].facingVector, -SpotLightDirs[i]))
-		{
-			DiffuseLevel = saturate(dot(worldNormal.xyz, SpotLightDirs[i]));
-			CelDiffuseLevel = CelGradient.Sample(PointSampleClamp, DiffuseLevel).r;
-
-			//Calculate Diffuse Light
-			DiffuseLight = SpotLights[i].diffuseColour * CelDiffuseLevel / SpotLightDist[i];					//Take the light colour and multiply it by
-			//the light level for this point (clamped based on the Celgradient texture)
-			//Divided by the distance of the light (for attenuation)
-
-			//Calculate specular light
-			halfwayNormal = normalize(SpotLightDirs[i] + CameraDir);	//Calculate halfway normal for this light
-			SpecularLevel = pow(saturate(dot(worldNormal.xyz, halfwayNormal)), SpecularPower);
-			CelSpecularLevel = CelGradient.Sample(PointSampleClamp, SpecularLevel).r;
-			specularLight += DiffuseLight * CelSpecularLevel;
-
-			combinedDiffuse += DiffuseLight;
-		}
-	}
-
-	//combinedDiffuse = 0.0f;	//Set Diffuse to 0 (DEBUGGING ONLY)
-	//specularLight = 0.0f;		//Set Specular to 0 (DEBUGGING ONLY)
-
-	////////////////////
-	// Sample texture
-
-	// Extract diffuse material colour for this pixel from a texture (using float3, so we get RGB - i.e. ignore any alpha in the texture)
-	float4 DiffuseMaterial = DiffuseMap.Sample(TrilinearWrap, vOut.UV);
-
-	// Assume specular material colour is white (i.e. highlights are a full, untinted reflection of light)
-	float3 SpecularMaterial = DiffuseMaterial.a;
-
-
-	////////////////////
-	// Combine colours 
-
-	// Combine maps and lighting for final pixel colour
-	float4 combinedColour;
-	combinedColour.rgb = DiffuseMaterial * combinedDiffuse + SpecularMaterial * specularLight;
-	combinedColour.a = 1.0f; // No alpha processing in this shader, so just set it to 1
-
-	return combinedColour;
-}
-
-float4 ParallaxCelShade(VS_NORMALMAP_OUTPUT vOut) : SV_Target
-{
-	//************************
-	// Normal Map Extraction
-	//************************
-
-	//Normalise interpolated model normal and tangent
-	float3 modelNormal = normalize(vOut.ModelNormal);
-	float3 modelTangent = normalize(vOut.ModelTangent);
-
-	// Calculate bi-tangent to complete the three axes of tangent space - then create the *inverse* tangent matrix to convert *from*
-	// tangent space into model space.
-	float3 modelBiTangent = cross(modelNormal, modelTangent);
-	float3x3 invTangentMatrix = float3x3(modelTangent, modelBiTangent, modelNormal);
-
-	//--------------------------------------------
-	// Parallax Mapping - Calculate alternate texture coordinate for this pixel
-	//--------------------------------------------
-
-	// Get normalised vector to camera for parallax mapping and specular equation (this vector was calculated later in previous shaders)
-	float3 CameraDir = normalize(CameraPos - vOut.WorldPos.xyz);
-
-	float3x3 invWorldMatrix = transpose(WorldMatrix);						// Flip matrix over its diagonal - need this to move camera vector from world space 'backwards' into the model space of this model
-	float3 cameraModelDir = normalize(mul(CameraDir, invWorldMatrix));	// Normalise in case world matrix is scaled
-
-	// Then transform model-space camera vector into tangent space (texture coordinate space) to give the direction to offset texture
-	// coordinate, only interested in x and y components. Calculated inverse tangent matrix above, so invert it back for this step
-	float3x3 tangentMatrix = transpose(invTangentMatrix);
-	float2 textureOffsetDir = mul(cameraModelDir, tangentMatrix);
-
-	// Get the depth info from the normal map's alpha channel at the given texture coordinate
-	// Rescale from 0->1 range to -x->+x range, x determined by ParallaxDepth setting
-	float texDepth = ParallaxDepth * (NormalMap.Sample(TrilinearWrap, vOut.UV).a - 0.5f);
-
-	// Use the depth of the texture to offset the given texture coordinate - this corrected texture coordinate will be used from here on
-	float2 offsetTexCoord = vOut.UV + texDepth * textureOffsetDir;
-
-	//--------------------------------------------
-	// End parallax mapping
-	//--------------------------------------------
-
-	// Get the texture normal from the normal map and convert from rgb range to xyz range (colour of normal map to the normal itself)
-	float3 textureNormal = 2.0f * NormalMap.Sample(TrilinearWrap, offsetTexCoord) - 1.0f; 	//range 0->1, to range 1->1. // Using new offsetTexCoord (parallax effected texture coordinate) instead of standard UV
-
-	// Calculate Lighting for specular/diffuse as usual
-
-	// Convert from texture space to model space using invTangentMatrix, then convert to world space using worldmatrix - then normalize (to accomodate world scaling etc..)
-	float3 worldNormal = normalize(mul(mul(textureNormal, invTangentMatrix), WorldMatrix));
-
-	// The world normal is now the version from the file rather than the automatically generated one
-	//This means we can use the ordinary diffuse/specular lighting equations/shader to perform the lighting calculation
-
-	// Create a VS_LIGHTING_OUTPUT to send to PixelLighting to perform the relevant lighting calculations
-	VS_LIGHTING_OUTPUT diffSpecOut;
-	diffSpecOut.ProjPos = vOut.ProjPos;
-	diffSpecOut.WorldPos = vOut.WorldPos;
-	diffSpecOut.WorldNormal = worldNormal;
-	diffSpecOut.UV = offsetTexCoord;
-	return CelShade(diffSpecOut);	//Return the value given by the PixelLighting pixel shader
-}
-
-float4 TintDiffuseMap(VS_BASIC_OUTPUT vOut) : SV_Target
-{
-	// Sample the material colour for this pixel from the texture
-	float4 diffuseMapColour = DiffuseMap.Sample(TrilinearWrap, vOut.UV);
-
-	// Tint the pixel colour by the colour of the model
-	diffuseMapColour.rgb *= ModelColour;
-
-	return diffuseMapColour;
-}
-
-float4 CutoutTextured(VS_LIGHTING_OUTPUT vOut) : SV_Target
-{
-	float4 colour = DiffuseMap.Sample(Anisotropic16, vOut.UV);	//Return the texture colour of this pixel
-
-	if (colour.a < 0.5f)
-		discard;
-
-	return colour * 0.5f;
-}
-
-float4 NoireParallaxMapLighting(VS_NORMALMAP_OUTPUT vOut) : SV_Target
-{
-	//************************
-	// Normal Map Extraction
-	//************************
-
-	//Normalise interpolated model normal and tangent
-	float3 modelNormal = normalize(vOut.ModelNormal);
-	float3 modelTangent = normalize(vOut.ModelTangent);
-
-	// Calculate bi-tangent to complete the three axes of tangent space - then create the *inverse* tangent matrix to convert *from*
-	// tangent space into model space.
-	float3 modelBiTangent = cross(modelNormal, modelTangent);
-	float3x3 invTangentMatrix = float3x3(modelTangent, modelBiTangent, modelNormal);
-
-	//--------------------------------------------
-	// Parallax Mapping - Calculate alternate texture coordinate for this pixel
-	//--------------------------------------------
-
-	// Get normalised vector to camera for parallax mapping and specular equation (this vector was calculated later in previous shaders)
-	float3 CameraDir = normalize(CameraPos - vOut.WorldPos.xyz);
-
-	float3x3 invWorldMatrix = transpose(WorldMatrix);						// Flip matrix over its diagonal - need this to move camera vector from world space 'backwards' into the model space of this model
-	float3 cameraModelDir = normalize(mul(CameraDir, invWorldMatrix));	// Normalise in case world matrix is scaled
-
-	// Then transform model-space camera vector into tangent space (texture coordinate space) to give the direction to offset texture
-	// coordinate, only interested in x and y components. Calculated inverse tangent matrix above, so invert it back for this step
-	float3x3 tangentMatrix = transpose(invTangentMatrix);
-	float2 textureOffsetDir = mul(cameraModelDir, tangentMatrix);
-
-	// Get the depth info from the normal map's alpha channel at the given texture coordinate
-	// Rescale from 0->1 range to -x->+x range, x determined by ParallaxDepth setting
-	float texDepth = ParallaxDepth * (NormalMap.Sample(TrilinearWrap, vOut.UV).a - 0.5f);
-
-	// Use the depth of the texture to offset the given texture coordinate - this corrected texture coordinate will be used from here on
-	float2 offsetTexCoord = vOut.UV + texDepth * textureOffsetDir;
-
-	//--------------------------------------------
-	// End parallax mapping
-	//--------------------------------------------
-
-	// Get the texture normal from the normal map and convert from rgb range to xyz range (colour of normal map to the normal itself)
-	float3 textureNormal = 2.0f * NormalMap.Sample(TrilinearWrap, offsetTexCoord) - 1.0f; 	//range 0->1, to range 1->1. // Using new offsetTexCoord (parallax effected texture coordinate) instead of standard UV
-
-	// Calculate Lighting for specular/diffuse as usual
-
-	// Convert from texture space to model space using invTangentMatrix, then convert to world space using worldmatrix - then normalize (to accomodate world scaling etc..)
-	float3 worldNormal = normalize(mul(mul(textureNormal, invTangentMatrix), WorldMatrix));
-
-	// The world normal is now the version from the file rather than the automatically generated one
-	//This means we can use the ordinary diffuse/specular lighting equations/shader to perform the lighting calculation
-
-	// Create a VS_LIGHTING_OUTPUT to send to PixelLighting to perform the relevant lighting calculations
-	VS_LIGHTING_OUTPUT diffSpecOut;
-	diffSpecOut.ProjPos = vOut.ProjPos;
-	diffSpecOut.WorldPos = vOut.WorldPos;
-	diffSpecOut.WorldNormal = worldNormal;
-	diffSpecOut.UV = offsetTexCoord;
-	return NoireShade(diffSpecOut);	//Return the value given by the PixelLighting pixel shader
-}
-
-// Shader used when rendering the shadow map depths. In fact a pixel shader isn't needed, we are
-// only writing to the depth buffer. However, needed to display what's in a shadow map
-float4 PixelDepth(VS_BASIC_OUTPUT vOut) : SV_Target
-{
-	// Output the value that would go in the depth puffer to the pixel colour (greyscale)
-	return vOut.ProjPos.z / vOut.ProjPos.w;
-}
-
-float4 ShadowMapPix(VS_LIGHTING_OUTPUT vOut) : SV_Target
-{
-	//Calculate lighting for non-directional lights
-	LIGHT_DATA Lights[NO_OF_LIGHTS];
-	AssembleLightData(Lights);
-
-	// Can't guarantee the normals are length 1, so re-normalise
-	float3 worldNormal = normalize(vOut.WorldNormal);
-
-	//*********************************************************************************************
-	// Calculate direction of light and camera
-	float3 CameraDir = normalize(CameraPos - vOut.WorldPos.xyz); // Position of camera - position of current pixel (in world space)
-
-	float3 LightDirs[NO_OF_LIGHTS];
-	float3 LightDist[NO_OF_LIGHTS];
-
-	float3 diffuseLight = AmbientColour;	//Begin with just ambient light
-
-	float3 halfwayNormal = 0.0f;
-	float3 specularLight = 0.0f;
-
-
-	//Perform Lighting Equations for the main lights
-	for (unsigned int i = 0; i < NO_OF_LIGHTS; i++)	//Perform calculations on lights, one light at a time
-	{
-		LightDirs[i] = Lights[i].position - vOut.WorldPos.xyz;	//Dont normalise yet (need to calculate length for attenuated light first)
-		LightDist[i] = length(LightDirs[i]);
-		LightDirs[i] = normalize(LightDirs[i]); //Can now normalise
-	
-		//Calculate Diffuse Light
-		diffuseLight += Lights[i].diffuseColour * saturate(dot(vOut.WorldNormal.xyz, LightDirs[i])) / LightDist[i];	//Add each light's diffuse value one at a time
-		//Calculate specular light
-		halfwayNormal = normalize(LightDirs[i] + CameraDir);	//Calculate halfway normal for this light
-		specularLight += Lights[i].specularColour * pow(saturate(dot(vOut.WorldNormal.xyz, halfwayNormal)), SpecularPower) / LightDist[i];	//Add Specular light for this light onto the current total 
-	
-	}
-
-	//Calculate lighting for directional lights (This is where the shadows come in)
-
-	// Slight adjustment to calculated depth of pixels so they don't shadow themselves
-	const float DepthAdjust = 0.0005f;
-
-	SPOT_LIGHT_DATA SpotLights[NO_OF_SPOT_LIGHTS];
-	AssembleSpotLightData(SpotLights);
-
-	float3 SpotLightDirection;
-	float3 SpotLightDistance;
-	float4 LightViewPos;
-	float4 LightProjPos;
-	float2 shadowUV;
-	float depthFromLight;
-	float depthFromShadowMap;
-
-	for (unsigned int i = 0; i < NO_OF_SPOT_LIGHTS; i++)
-	{
-		// Using the world position of the current pixel and the matrices of the light (as a camera), find the 2D position of the
-		// pixel *as seen from the light*. Will use this to find which part of the shadow map to look at.
-		SpotLightDirection = SpotLights[i].position - vOut.WorldPos.xyz;	//Dont normalise yet (need to calculate length for attenuated light first)
-		SpotLightDistance = length(SpotLightDirection);
-		SpotLightDirection = normalize(SpotLightDirection); //Can now normalise
-		SpotLights[i].facingVector = normalize(SpotLights[i].facingVector);
-
-		if (SpotLights[i].cosHalfAngle < dot(SpotLights[i].facingVector, -SpotLightDirection))
-		{ 
-			LightViewPos = mul(float4(vOut.WorldPos, 1.0f), SpotLights[i].viewMatrix);
-			LightProjPos = mul(LightViewPos, SpotLights[i].projMatrix);
-
-			// Convert 2D pixel position as viewed from light into texture coordinates for shadow map
-			// Detail: 2D position x & y get perspective divide, then converted from range -1->1 to UV range 0->1. Also flip V axis
-			shadowUV = 0.5f * LightProjPos.xy / (LightProjPos.w + float2(0.5f, 0.5f));
-			shadowUV.y = 1.0f - shadowUV.y;
-			
-			// Get depth of this pixel if it were visible from the light
-			depthFromLight = LightProjPos.z / LightProjPos.w - DepthAdjust;	// Adjustment so polygons don't shadow themselves
-			depthFromShadowMap = SpotLights[i].shadowMap.Sample(PointSampleClamp, shadowUV).r;
-			// Compare pixel depth from light with depth held in shadow map of the light. If shadow map depth is less then something is nearer
-			// to the light than this pixel - so the pixel gets no effect from this light
-
-			if (depthFromLight < depthFromShadowMap)
-			{
-				//Calculate Diffuse Light
-				diffuseLight += SpotLights[i].diffuseColour * saturate(dot(vOut.WorldNormal.xyz, SpotLightDirection)) / SpotLightDistance;	//Add each light's diffuse value one at a time
-				//Calculate specular light
-				halfwayNormal = normalize(SpotLightDirection + CameraDir);	//Calculate halfway normal for this light
-				specularLight += SpotLights[i].specularColour * pow(saturate(dot(vOut.WorldNormal.xyz, halfwayNormal)), SpecularPower) / SpotLightDistance;	//Add Specular light for this light onto the current total 
-			}
-		}
-	}
-
-	//diffuseLight = 0.0f;	//Set Diffuse to 0 (DEBUGGING ONLY)
-	//specularLight = 0.0f; //Set Specular to 0 (DEBUGGING ONLY)
-
-	//*********************************************************************************************
-	// Get colours from texture maps
-
-	// Extract diffuse material colour for this pixel from a texture (using float3, so we get RGB - i.e. ignore any alpha in the texture)
-	float3 DiffuseMaterial = DiffuseMap.Sample(TrilinearWrap, vOut.UV).rgb;
-
-	// Sample specular material colour from alpha channel of the diffusemap
-	float SpecularMaterial = DiffuseMap.Sample(TrilinearWrap, vOut.UV).a;
-	//*********************************************************************************************
-	// Combine colours (lighting, textures) for final pixel colour
-
-	float4 combinedColour;
-
-	//combinedColour.rgb = diffuseLight + specularLight;	//Light - without material
-	combinedColour.rgb = (DiffuseMaterial * diffuseLight) + (SpecularMaterial * specularLight); //Light - with material
-	combinedColour.a = 1.0f; // No alpha processing in this shader, so just set it to 1
-
-	//Debug tool - view shadow map on uv's
-	//combinedColour.rgb = SpotLights[0].shadowMap.Sample(TrilinearWrap, vOut.UV).r;
-	return combinedColour; 
-}
-
-float4 ShadowMapParallax(VS_NORMALMAP_OUTPUT vOut) : SV_Target
-{
-	//************************
-	// Normal Map Extraction
-	//************************
-
-	//Normalise interpolated model normal and tangent
-	float3 modelNormal = normalize(vOut.ModelNormal);
-	float3 modelTangent = normalize(vOut.ModelTangent);
-
-	// Calculate bi-tangent to complete the three axes of tangent space - then create the *inverse* tangent matrix to convert *from*
-	// tangent space into model space.
-	float3 modelBiTangent = cross(modelNormal, modelTangent);
-	float3x3 invTangentMatrix = float3x3(modelTangent, modelBiTangent, modelNormal);
-
-	//--------------------------------------------
-	// Parallax Mapping - Calculate alternate texture coordinate for this pixel
-	//--------------------------------------------
-
-	// Get normalised vector to camera for parallax mapping and specular equation (this vector was calculated later in previous shaders)
-	float3 CameraDir = normalize(CameraPos - vOut.WorldPos.xyz);
-
-	float3x3 invWorldMatrix = transpose(WorldMatrix);						// Flip matrix over its diagonal - need this to move camera vector from world space 'backwards' into the model space of this model
-	float3 cameraModelDir = normalize(mul(CameraDir, invWorldMatrix));	// Normalise in case world matrix is scaled
-
-	// Then transform model-space camera vector into tangent space (texture coordinate space) to give the direction to offset texture
-	// coordinate, only interested in x and y components. Calculated inverse tangent matrix above, so invert it back for this step
-	float3x3 tangentMatrix = transpose(invTangentMatrix);
-	float2 textureOffsetDir = mul(cameraModelDir, tangentMatrix);
-
-	// Get the depth info from the normal map's alpha channel at the given texture coordinate
-	// Rescale from 0->1 range to -x->+x range, x determined by ParallaxDepth setting
-	float texDepth = ParallaxDepth * (NormalMap.Sample(TrilinearWrap, vOut.UV).a - 0.5f);
-
-	// Use the depth of the texture to offset the given texture coordinate - this corrected texture coordinate will be used from here on
-	float2 offsetTexCoord = vOut.UV + texDepth * textureOffsetDir;
-
-	//--------------------------------------------
-	// End parallax mapping
-	//--------------------------------------------
-
-	// Get the texture normal from the normal map and convert from rgb range to xyz range (colour of normal map to the normal itself)
-	float3 textureNormal = 2.0f * NormalMap.Sample(TrilinearWrap, offsetTexCoord) - 1.0f; 	//range 0->1, to range 1->1. // Using new offsetTexCoord (parallax effected texture coordinate) instead of standard UV
-
-	// Calculate Lighting for specular/diffuse as usual
-
-	// Convert from texture space to model space using invTangentMatrix, then convert to world space using worldmatrix - then normalize (to accomodate world scaling etc..)
-	float3 worldNormal = normalize(mul(mul(textureNormal, invTangentMatrix), WorldMatrix));
-
-	// The world normal is now the version from the file rather than the automatically generated one
-	//This means we can use the ordinary diffuse/specular lighting equations/shader to perform the lighting calculation
-
-	// Create a VS_LIGHTING_OUTPUT to send to PixelLighting to perform the relevant lighting calculations
-	VS_LIGHTING_OUTPUT diffSpecOut;
-	diffSpecOut.ProjPos = vOut.ProjPos;
-	diffSpecOut.WorldPos = vOut.WorldPos;
-	diffSpecOut.WorldNormal = worldNormal;
-	diffSpecOut.UV = offsetTexCoord;
-
-	return ShadowMapPix(diffSpecOut);
-}
-
-//-------------------------------------------------------------------------------------
-// Rasteriser States
-//-------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------
+// Rasteriser States
+//-------------------------------------------------------------------------------------
 
 RasterizerState CullNone  // Cull none of the polygons, i.e. show both sides
 {
@@ -1115,335 +716,78 @@ DepthStencilState DepthWritesOff // Don't write to the depth buffer - polygons r
 {
 	DepthWriteMask = ZERO;
 };
-DepthStencilState DepthWritesOn  // Write to the depth buffer - normal behaviour 
+DepthStencilState DepthWritesOn  // Write to the depth buffer - normal behaviour
 {
 	DepthWriteMask = ALL;
 };
 
+// Additive models are drawn over the scene from both sides, and don't hide what is drawn after them
+#if defined(FEATURE_ADDITIVE)
+#define MAIN_BLEND_STATE      AdditiveBlending
+#define MAIN_RASTERIZER_STATE CullNone
+#define MAIN_DEPTH_STATE      DepthWritesOff
+#else
+#define MAIN_BLEND_STATE      NoBlending
+#define MAIN_RASTERIZER_STATE CullBack
+#define MAIN_DEPTH_STATE      DepthWritesOn
+#endif
+
 //--------------------------------------------------------------------------------------
 // Techniques
 //--------------------------------------------------------------------------------------
 
-// Techniques are used to render models in our scene. They select a combination of vertex, geometry and pixel shader from those provided above. Can also set states.
-
-// Render models unlit in a single colour
-technique10 PlainColour
-{
-	pass P0
-	{
-		SetVertexShader( CompileShader( vs_4_0, BasicTransform() ) );
-		SetGeometryShader( NULL );                                   
-		SetPixelShader( CompileShader( ps_4_0, OneColour() ) );
-
-		SetBlendState(NoBlending, float4(0.0f, 0.0f, 0.0f, 0.0f), 0xFFFFFFFF);
-		SetRasterizerState(CullBack);
-		SetDepthStencilState(DepthWritesOn, 0);
-	}
-}
-
-technique10 DiffuseTex
-{
-	pass P0
-	{
-		SetVertexShader(CompileShader(vs_4_0, BasicTransform()));
-		SetGeometryShader(NULL);
-		SetPixelShader(CompileShader(ps_4_0, DiffuseTextured()));
-
-		SetBlendState(NoBlending, float4(0.0f, 0.0f, 0.0f, 0.0f), 0xFFFFFFFF);
-		SetRasterizerState(CullBack);
-		SetDepthStencilState(DepthWritesOn, 0);
-	}
-}
-
-technique10 WiggleAndScroll
-{
-	pass P0
-	{
-		SetVertexShader(CompileShader(vs_4_0, WiggleTransform()));
-		SetGeometryShader(NULL);
-		SetPixelShader(CompileShader(ps_4_0, ScrollAndTint()));
-
-		SetBlendState(NoBlending, float4(0.0f, 0.0f, 0.0f, 0.0f), 0xFFFFFFFF);
-		SetRasterizerState(CullBack);
-		SetDepthStencilState(DepthWritesOn, 0);
-	}
-}
-
-technique10 PixDiffSpec
-{
-	pass P0
-	{
-		SetVertexShader(CompileShader(vs_4_0, PixelLightingTransform()));
-		SetGeometryShader(NULL);
-		SetPixelShader(CompileShader(ps_4_0, PixelLighting()));
+// The pixel shader is compiled once here and used by both techniques
+PixelShader MainPS = CompileShader(ps_4_0, MainPixel());
 
-		SetBlendState(NoBlending, float4(0.0f, 0.0f, 0.0f, 0.0f), 0xFFFFFFFF);
-		SetRasterizerState(CullBack);
-		SetDepthStencilState(DepthWritesOn, 0);
+// Pass drawing the darkened outline of the 'Cel shading', before or after the model as given by OUTLINE_FIRST
+#define OUTLINE_PASS \
+	pass Outline \
+	{ \
+		SetVertexShader(CompileShader(vs_4_0, ExpandOutline())); \
+		SetGeometryShader(NULL); \
+		SetPixelShader(CompileShader(ps_4_0, OutlineColour())); \
+		SetRasterizerState(CullFront); /* Draw the inside of the model */ \
+		SetBlendState(NoBlending, float4(0.0f, 0.0f, 0.0f, 0.0f), 0xFFFFFFFF); \
+		SetDepthStencilState(DepthWritesOn, 0); \
 	}
-}
 
-technique10 NormalMapping
+// The technique for this permutation's features
+technique10 Main
 {
-	pass p0
+#if defined(OUTLINE_FIRST)
+	OUTLINE_PASS
+#endif
+	pass Model		//Draw the model itself
 	{
-		SetVertexShader(CompileShader(vs_4_0, NormalMapTransform()));
+		SetVertexShader(CompileShader(vs_4_0, MainTransform()));
 		SetGeometryShader(NULL);
-		SetPixelShader(CompileShader(ps_4_0, NormalMapLighting()));
+		SetPixelShader(MainPS);
 
-		SetBlendState(NoBlending, float4(0.0f, 0.0f, 0.0f, 0.0f), 0xFFFFFFFF);
-		SetRasterizerState(CullBack);
-		SetDepthStencilState(DepthWritesOn, 0);
+		SetBlendState(MAIN_BLEND_STATE, float4(0.0f, 0.0f, 0.0f, 0.0f), 0xFFFFFFFF);
+		SetRasterizerState(MAIN_RASTERIZER_STATE);
+		SetDepthStencilState(MAIN_DEPTH_STATE, 0);
 	}
+#if defined(FEATURE_OUTLINE) && !defined(OUTLINE_FIRST)
+	OUTLINE_PASS
+#endif
 }
 
-technique10 ParallaxMapping
+#if defined(HAS_INSTANCED_TECHNIQUE)
+// Draws many instances of a model in one call, with a world matrix and colour per instance. Uses the same pixel shader and states
+// as the main technique
+technique10 MainInstanced
 {
 	pass P0
 	{
-		SetVertexShader(CompileShader(vs_4_0, NormalMapTransform()));
+		SetVertexShader(CompileShader(vs_4_0, MainTransformInstanced()));
 		SetGeometryShader(NULL);
-		SetPixelShader(CompileShader(ps_4_0, ParallaxMapLighting()));
+		SetPixelShader(MainPS);
 
-		// Switch off blending states
-		SetBlendState(NoBlending, float4(0.0f, 0.0f, 0.0f, 0.0f), 0xFFFFFFFF);
-		SetRasterizerState(CullBack);
-		SetDepthStencilState(DepthWritesOn, 0);
+		SetBlendState(MAIN_BLEND_STATE, float4(0.0f, 0.0f, 0.0f, 0.0f), 0xFFFFFFFF);
+		SetRasterizerState(MAIN_RASTERIZER_STATE);
+		SetDepthStencilState(MAIN_DEPTH_STATE, 0);
 	}
 }
+#endif
 
-technique10 NoireShading
-{
-	pass P0		//Draw the darkened outline of the 'Cel shading'
-	{
-		SetVertexShader(CompileShader(vs_4_0, ExpandOutline()));
-		SetGeometryShader(NULL);
-		SetPixelShader(CompileShader(ps_4_0, CelShadeOneColour()));
-
-		// Draw the inside of the model
-		SetRasterizerState(CullFront);
-
-		// Switch off other blending states
-		SetBlendState(NoBlending, float4(0.0f, 0.0f, 0.0f, 0.0f), 0xFFFFFFFF);
-		SetDepthStencilState(DepthWritesOn, 0);
-	}
-	pass P1		//Draw the model itself - with a colour range clamp
-	{
-		SetVertexShader(CompileShader(vs_4_0, PixelLightingTransform()));
-		SetGeometryShader(NULL);
-		SetPixelShader(CompileShader(ps_4_0, NoireShade()));
-
-		// Return to standard culling (draw only the outside of the model)
-		SetRasterizerState(CullBack);
-	}
-}
-
-technique10 ParallaxNoireShaded
-{
-	pass P0		//Draw the model itself
-	{
-		SetVertexShader(CompileShader(vs_4_0, NormalMapTransform()));
-		SetGeometryShader(NULL);
-		SetPixelShader(CompileShader(ps_4_0, NoireParallaxMapLighting()));
-
-		// Switch off blending states
-		SetBlendState(NoBlending, float4(0.0f, 0.0f, 0.0f, 0.0f), 0xFFFFFFFF);
-		SetRasterizerState(CullBack);
-		SetDepthStencilState(DepthWritesOn, 0);
-	}
-	pass P1		//Draw the darkened outline of the 'Cel shading'
-	{
-		SetVertexShader(CompileShader(vs_4_0, ExpandOutline()));
-		SetGeometryShader(NULL);
-		SetPixelShader(CompileShader(ps_4_0, CelShadeOneColour()));
-
-		// Draw the inside of the model
-		SetRasterizerState(CullFront);
-
-		// Switch off other blending states
-		SetBlendState(NoBlending, float4(0.0f, 0.0f, 0.0f, 0.0f), 0xFFFFFFFF);
-		SetDepthStencilState(DepthWritesOn, 0);
-	}
-}
-
-technique10 CelShading
-{
-	pass P0		//Draw the darkened outline of the 'Cel shading'
-	{
-		SetVertexShader(CompileShader(vs_4_0, ExpandOutline()));
-		SetGeometryShader(NULL);
-		SetPixelShader(CompileShader(ps_4_0, CelShadeOneColour()));
-
-		// Draw the inside of the model
-		SetRasterizerState(CullFront);
-
-		// Switch off other blending states
-		SetBlendState(NoBlending, float4(0.0f, 0.0f, 0.0f, 0.0f), 0xFFFFFFFF);
-		SetDepthStencilState(DepthWritesOn, 0);
-	}
-	pass P1		//Draw the model itself - with a colour range clamp
-	{
-		SetVertexShader(CompileShader(vs_4_0, PixelLightingTransform()));
-		SetGeometryShader(NULL);
-		SetPixelShader(CompileShader(ps_4_0, CelShade()));
-
-		// Return to standard culling (draw only the outside of the model)
-		SetRasterizerState(CullBack);
-	}
-};
-
-technique10 ParallaxCelShading
-{
-	pass P0		//Draw the model itself - with a colour range clamp
-	{
-		SetVertexShader(CompileShader(vs_4_0, NormalMapTransform()));
-		SetGeometryShader(NULL);
-		SetPixelShader(CompileShader(ps_4_0, ParallaxCelShade()));
-
-		// Return to standard culling (draw only the outside of the model)
-		SetRasterizerState(CullBack);
-	}
-	pass P1		//Draw the darkened outline of the 'Cel shading'
-	{
-		SetVertexShader(CompileShader(vs_4_0, ExpandOutline()));
-		SetGeometryShader(NULL);
-		SetPixelShader(CompileShader(ps_4_0, CelShadeOneColour()));
-
-		// Draw the inside of the model
-		SetRasterizerState(CullFront);
-
-		// Switch off other blending states
-		SetBlendState(NoBlending, float4(0.0f, 0.0f, 0.0f, 0.0f), 0xFFFFFFFF);
-		SetDepthStencilState(DepthWritesOn, 0);
-	}
-};
-
-technique10 ParallaxOutlined
-{
-	pass P0		//Draw the model itself
-	{
-		SetVertexShader(CompileShader(vs_4_0, NormalMapTransform()));
-		SetGeometryShader(NULL);
-		SetPixelShader(CompileShader(ps_4_0, ParallaxMapLighting()));
-
-		// Switch off blending states
-		SetBlendState(NoBlending, float4(0.0f, 0.0f, 0.0f, 0.0f), 0xFFFFFFFF);
-		SetRasterizerState(CullBack);
-		SetDepthStencilState(DepthWritesOn, 0);
-	}
-	pass P1		//Draw the darkened outline of the 'Cel shading'
-	{
-		SetVertexShader(CompileShader(vs_4_0, ExpandOutline()));
-		SetGeometryShader(NULL);
-		SetPixelShader(CompileShader(ps_4_0, CelShadeOneColour()));
-
-		// Draw the inside of the model
-		SetRasterizerState(CullFront);
-
-		// Switch off other blending states
-		SetBlendState(NoBlending, float4(0.0f, 0.0f, 0.0f, 0.0f), 0xFFFFFFFF);
-		SetDepthStencilState(DepthWritesOn, 0);
-	}
-}
-
-technique10 PixelLitOutlined
-{
-	pass P0		//Draw the model itself
-	{
-		SetVertexShader(CompileShader(vs_4_0, PixelLightingTransform()));
-		SetGeometryShader(NULL);
-		SetPixelShader(CompileShader(ps_4_0, PixelLighting()));
-
-		// Switch off blending states
-		SetBlendState(NoBlending, float4(0.0f, 0.0f, 0.0f, 0.0f), 0xFFFFFFFF);
-		SetRasterizerState(CullBack);
-		SetDepthStencilState(DepthWritesOn, 0);
-	}
-	pass P1		//Draw the darkened outline of the 'Cel shading'
-	{
-		SetVertexShader(CompileShader(vs_4_0, ExpandOutline()));
-		SetGeometryShader(NULL);
-		SetPixelShader(CompileShader(ps_4_0, CelShadeOneColour()));
-
-		// Draw the inside of the model
-		SetRasterizerState(CullFront);
-
-		// Switch off other blending states
-		SetBlendState(NoBlending, float4(0.0f, 0.0f, 0.0f, 0.0f), 0xFFFFFFFF);
-		SetDepthStencilState(DepthWritesOn, 0);
-	}
-}
-
-technique10 AdditiveTexTint
-{
-	pass P0
-	{
-		SetVertexShader(CompileShader(vs_4_0, BasicTransform()));
-		SetGeometryShader(NULL);
-		SetPixelShader(CompileShader(ps_4_0, TintDiffuseMap()));
-
-		SetBlendState(AdditiveBlending, float4(0.0f, 0.0f, 0.0f, 0.0f), 0xFFFFFFFF);
-		SetRasterizerState(CullNone);
-		SetDepthStencilState(DepthWritesOff, 0);
-	}
-}
-
-technique10 AlphaCutout
-{
-	pass P0
-	{
-		SetVertexShader(CompileShader(vs_4_0, PixelLightingTransform()));
-		SetGeometryShader(NULL);
-		SetPixelShader(CompileShader(ps_4_0, CutoutTextured()));
-
-		SetBlendState(AdditiveBlending, float4(0.0f, 0.0f, 0.0f, 0.0f), 0xFFFFFFFF);
-		SetRasterizerState(CullNone);
-		SetDepthStencilState(DepthWritesOff, 0);
-	}
-}
-
-technique10 DepthOnly
-{
-	// Rendering a shadow map. Only outputs the depth of each pixel
-	pass P0
-	{
-		SetVertexShader(CompileShader(vs_4_0, BasicTransform()));
-		SetGeometryShader(NULL);
-		SetPixelShader(CompileShader(ps_4_0, PixelDepth()));
-
-		// Switch off blending states
-		SetBlendState(NoBlending, float4(0.0f, 0.0f, 0.0f, 0.0f), 0xFFFFFFFF);
-		SetRasterizerState(CullBack);
-		SetDepthStencilState(DepthWritesOn, 0);
-	}
-}
-
-technique10 ShadowMappingPixelLit
-{
-	pass P0
-	{
-		SetVertexShader(CompileShader(vs_4_0, PixelLightingTransform()));
-		SetGeometryShader(NULL);
-		SetPixelShader(CompileShader(ps_4_0, ShadowMapPix()));
-
-		// Switch off blending states
-		SetBlendState(NoBlending, float4(0.0f, 0.0f, 0.0f, 0.0f), 0xFFFFFFFF);
-		SetRasterizerState(CullBack);
-		SetDepthStencilState(DepthWritesOn, 0);
-	}
-}
-
-technique10 ShadowMappingParallaxLit
-{
-	pass P0
-	{
-		SetVertexShader(CompileShader(vs_4_0, NormalMapTransform()));
-		SetGeometryShader(NULL);
-		SetPixelShader(CompileShader(ps_4_0, ShadowMapParallax()));
-
-		// Switch off blending states
-		SetBlendState(NoBlending, float4(0.0f, 0.0f, 0.0f, 0.0f), 0xFFFFFFFF);
-		SetRasterizerState(CullBack);
-		SetDepthStencilState(DepthWritesOn, 0);
-	}
-}
\ No newline at end of file
+#endif // EFFECT_POOL
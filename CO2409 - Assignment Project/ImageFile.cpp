@@ -0,0 +1,429 @@
+//--------------------------------------------------------------------------------------
+//	ImageFile.cpp
+//
+//	Loading and writing images in memory, without a device - for the software backend's
+//	textures and the frames it renders
+//--------------------------------------------------------------------------------------
+
+#include <stdio.h>    // fopen_s
+#include <stdlib.h>   // abs
+#include <string.h>   // memcpy, memcmp
+
+#include "ImageFile.h"	// Declarations of these functions
+#include <wincodec.h>	// Windows Imaging Component, after Windows.h
+
+// Flags of a DDS pixel format
+const unsigned int DDSAlphaPixels = 0x1;
+const unsigned int DDSAlpha       = 0x2;
+const unsigned int DDSFourCC      = 0x4;
+const unsigned int DDSRGB         = 0x40;
+const unsigned int DDSLuminance   = 0x20000;
+
+// Largest width or height of DDS image decoded - larger than any texture Direct3D accepts, and small enough that sizes and offsets
+// within the image fit in an unsigned int
+const unsigned int DDSMaxDimension = 16384;
+
+// The header that follows the "DDS " at the start of a DDS file
+struct SDDSHeader
+{
+	unsigned int Size;
+	unsigned int Flags;
+	unsigned int Height;
+	unsigned int Width;
+	unsigned int PitchOrLinearSize;
+	unsigned int Depth;
+	unsigned int MipMapCount;
+	unsigned int Reserved1[11];
+	unsigned int FormatSize;
+	unsigned int FormatFlags;
+	unsigned int FourCC;
+	unsigned int RGBBitCount;
+	unsigned int RBitMask;
+	unsigned int GBitMask;
+	unsigned int BBitMask;
+	unsigned int ABitMask;
+	unsigned int Caps[4];
+	unsigned int Reserved2;
+};
+static_assert(sizeof(SDDSHeader) == 124, "SDDSHeader must match the DDS file header");
+
+// Four character code as stored in a file
+inline unsigned int FourCC(char c0, char c1, char c2, char c3)
+{
+	return static_cast<unsigned int>(c0) | (static_cast<unsigned int>(c1) << 8) | (static_cast<unsigned int>(c2) << 16) |
+	       (static_cast<unsigned int>(c3) << 24);
+}
+
+// Pack a pixel as in SImage
+inline unsigned int PackPixel(unsigned int r, unsigned int g, unsigned int b, unsigned int a)
+{
+	return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+
+//-----------------------------------------------------------------------------
+// DDS files
+//-----------------------------------------------------------------------------
+
+// Read the whole of a file. Returns false if it can't be read
+bool ReadWholeFile(const string& fileName, vector<unsigned char>* contents)
+{
+	FILE* file;
+	if (fopen_s(&file, fileName.c_str(), "rb") != 0)
+	{
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	contents->resize(size > 0 ? size : 0);
+	bool read = size > 0 && fread(&(*contents)[0], 1, size, file) == static_cast<size_t>(size);
+	fclose(file);
+	return read;
+}
+
+// Value of the bits of a pixel selected by a mask, scaled to 0-255
+inline unsigned int MaskedChannel(unsigned int pixel, unsigned int mask)
+{
+	if (mask == 0)
+	{
+		return 0;
+	}
+	unsigned int shift = 0;
+	while (((mask >> shift) & 1) == 0)
+	{
+		shift++;
+	}
+	// Calculated in 64 bits, as a channel of up to 32 bits times 255 can overflow
+	gen::TUInt64 maxValue = mask >> shift;
+	return static_cast<unsigned int>(static_cast<gen::TUInt64>((pixel & mask) >> shift) * 255 / maxValue);
+}
+
+// Expand a 5:6:5 colour from a DXT block to 8 bits per channel
+inline void Expand565(unsigned int colour, unsigned int rgb[3])
+{
+	unsigned int r = (colour >> 11) & 31, g = (colour >> 5) & 63, b = colour & 31;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+// Decode the colours of a DXT colour block (8 bytes) into a 4x4 block of pixels, with the alpha given for each pixel. DXT1 blocks
+// with the first colour not above the second have three colours and transparent black
+void DecodeColourBlock(const unsigned char* block, const unsigned int alphas[16], bool allowTransparent, unsigned int pixels[16])
+{
+	unsigned int colour0 = block[0] | (block[1] << 8);
+	unsigned int colour1 = block[2] | (block[3] << 8);
+	unsigned int palette[4][4];
+	Expand565(colour0, palette[0]);
+	Expand565(colour1, palette[1]);
+	palette[0][3] = palette[1][3] = 255;
+	for (unsigned int c = 0; c < 3; c++)
+	{
+		if (colour0 > colour1 || !allowTransparent)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		else
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+	palette[2][3] = 255;
+	palette[3][3] = (colour0 > colour1 || !allowTransparent) ? 255 : 0;
+
+	unsigned int indices = block[4] | (block[5] << 8) | (block[6] << 16) | (block[7] << 24);
+	for (unsigned int i = 0; i < 16; i++)
+	{
+		const unsigned int* colour = palette[(indices >> (i * 2)) & 3];
+		unsigned int alpha = (colour[3] == 0) ? 0 : alphas[i];
+		pixels[i] = PackPixel(colour[0], colour[1], colour[2], alpha);
+	}
+}
+
+// Decode the alpha of a DXT5 alpha block (8 bytes) - two end values and a 3-bit index for each pixel
+void DecodeInterpolatedAlpha(const unsigned char* block, unsigned int alphas[16])
+{
+	unsigned int palette[8];
+	palette[0] = block[0];
+	palette[1] = block[1];
+	if (palette[0] > palette[1])
+	{
+		for (unsigned int i = 1; i < 7; i++)
+		{
+			palette[i + 1] = ((7 - i) * palette[0] + i * palette[1]) / 7;
+		}
+	}
+	else
+	{
+		for (unsigned int i = 1; i < 5; i++)
+		{
+			palette[i + 1] = ((5 - i) * palette[0] + i * palette[1]) / 5;
+		}
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	gen::TUInt64 indices = 0;
+	for (unsigned int i = 0; i < 6; i++)
+	{
+		indices |= static_cast<gen::TUInt64>(block[2 + i]) << (i * 8);
+	}
+	for (unsigned int i = 0; i < 16; i++)
+	{
+		alphas[i] = palette[(indices >> (i * 3)) & 7];
+	}
+}
+
+// Decode the top level of a DDS file in memory. Returns false if the format or size isn't supported or the file is too short
+bool DecodeDDS(const vector<unsigned char>& contents, SImage* image)
+{
+	if (contents.size() < 4 + sizeof(SDDSHeader) || memcmp(&contents[0], "DDS ", 4) != 0)
+	{
+		return false;
+	}
+	SDDSHeader header;
+	memcpy(&header, &contents[4], sizeof(header));
+	const unsigned char* data = &contents[4 + sizeof(header)];
+	size_t dataSize = contents.size() - 4 - sizeof(header);
+	if (header.Width == 0 || header.Height == 0 || header.Width > DDSMaxDimension || header.Height > DDSMaxDimension)
+	{
+		return false;
+	}
+
+	if (header.FormatFlags & DDSFourCC)
+	{
+		// Compressed in 4x4 blocks
+		bool dxt1 = header.FourCC == FourCC('D', 'X', 'T', '1');
+		bool dxt3 = header.FourCC == FourCC('D', 'X', 'T', '3');
+		bool dxt5 = header.FourCC == FourCC('D', 'X', 'T', '5');
+		if (!dxt1 && !dxt3 && !dxt5)
+		{
+			return false;
+		}
+		unsigned int blockSize = dxt1 ? 8 : 16;
+		unsigned int blocksX = (header.Width + 3) / 4;
+		unsigned int blocksY = (header.Height + 3) / 4;
+		if (dataSize < static_cast<size_t>(blocksX) * blocksY * blockSize)
+		{
+			return false;
+		}
+		image->Width = header.Width;
+		image->Height = header.Height;
+		image->Pixels.resize(static_cast<size_t>(header.Width) * header.Height);
+		for (unsigned int by = 0; by < blocksY; by++)
+		{
+			for (unsigned int bx = 0; bx < blocksX; bx++)
+			{
+				const unsigned char* block = data + (by * blocksX + bx) * blockSize;
+				unsigned int alphas[16];
+				if (dxt3)
+				{
+					for (unsigned int i = 0; i < 16; i++)
+					{
+						alphas[i] = ((block[i / 2] >> ((i & 1) * 4)) & 15) * 17;
+					}
+				}
+				else if (dxt5)
+				{
+					DecodeInterpolatedAlpha(block, alphas);
+				}
+				else
+				{
+					for (unsigned int i = 0; i < 16; i++)
+					{
+						alphas[i] = 255;
+					}
+				}
+				unsigned int pixels[16];
+				DecodeColourBlock(dxt1 ? block : block + 8, alphas, dxt1, pixels);
+
+				// Blocks at the right and bottom edges may hang over the image
+				for (unsigned int y = 0; y < 4 && by * 4 + y < header.Height; y++)
+				{
+					for (unsigned int x = 0; x < 4 && bx * 4 + x < header.Width; x++)
+					{
+						image->Pixels[(by * 4 + y) * header.Width + bx * 4 + x] = pixels[y * 4 + x];
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+	// Uncompressed, with each channel given by a bit mask
+	if (!(header.FormatFlags & (DDSRGB | DDSLuminance | DDSAlpha)) || header.RGBBitCount == 0 || header.RGBBitCount % 8 != 0 ||
+	    header.RGBBitCount > 32)
+	{
+		return false;
+	}
+	unsigned int bytesPerPixel = header.RGBBitCount / 8;
+	if (dataSize < static_cast<size_t>(header.Width) * header.Height * bytesPerPixel)
+	{
+		return false;
+	}
+	image->Width = header.Width;
+	image->Height = header.Height;
+	image->Pixels.resize(static_cast<size_t>(header.Width) * header.Height);
+	bool hasAlpha = (header.FormatFlags & (DDSAlphaPixels | DDSAlpha)) != 0;
+	for (unsigned int i = 0; i < header.Width * header.Height; i++)
+	{
+		unsigned int pixel = 0;
+		for (unsigned int byte = 0; byte < bytesPerPixel; byte++)
+		{
+			pixel |= static_cast<unsigned int>(data[i * bytesPerPixel + byte]) << (byte * 8);
+		}
+		unsigned int r, g, b;
+		if (header.FormatFlags & DDSLuminance)
+		{
+			r = g = b = MaskedChannel(pixel, header.RBitMask);
+		}
+		else
+		{
+			r = MaskedChannel(pixel, header.RBitMask);
+			g = MaskedChannel(pixel, header.GBitMask);
+			b = MaskedChannel(pixel, header.BBitMask);
+		}
+		unsigned int a = hasAlpha ? MaskedChannel(pixel, header.ABitMask) : 255;
+		image->Pixels[i] = PackPixel(r, g, b, a);
+	}
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Other formats
+//-----------------------------------------------------------------------------
+
+// Decode an image with the Windows Imaging Component, converted to 32-bit RGBA. Returns false if it can't be decoded
+bool DecodeWIC(const string& fileName, SImage* image)
+{
+	// COM may already be initialised on this thread, possibly in another mode - either way it can be used
+	HRESULT initResult = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+	bool uninitialise = SUCCEEDED(initResult);
+
+	wchar_t wideName[MAX_PATH];
+	bool decoded = false;
+	IWICImagingFactory* factory = NULL;
+	IWICBitmapDecoder* decoder = NULL;
+	IWICBitmapFrameDecode* frame = NULL;
+	IWICFormatConverter* converter = NULL;
+	if (MultiByteToWideChar(CP_ACP, 0, fileName.c_str(), -1, wideName, MAX_PATH) != 0 &&
+	    SUCCEEDED(CoCreateInstance(CLSID_WICImagingFactory, NULL, CLSCTX_INPROC_SERVER, IID_IWICImagingFactory,
+	                               reinterpret_cast<void**>(&factory))) &&
+	    SUCCEEDED(factory->CreateDecoderFromFilename(wideName, NULL, GENERIC_READ, WICDecodeMetadataCacheOnDemand, &decoder)) &&
+	    SUCCEEDED(decoder->GetFrame(0, &frame)) &&
+	    SUCCEEDED(factory->CreateFormatConverter(&converter)) &&
+	    SUCCEEDED(converter->Initialize(frame, GUID_WICPixelFormat32bppRGBA, WICBitmapDitherTypeNone, NULL, 0.0,
+	                                    WICBitmapPaletteTypeCustom)) &&
+	    SUCCEEDED(converter->GetSize(&image->Width, &image->Height)))
+	{
+		image->Pixels.resize(image->Width * image->Height);
+		UINT stride = image->Width * 4;
+		decoded = image->Pixels.empty() ||
+		          SUCCEEDED(converter->CopyPixels(NULL, stride, stride * image->Height, reinterpret_cast<BYTE*>(&image->Pixels[0])));
+	}
+
+	SAFE_RELEASE(converter);
+	SAFE_RELEASE(frame);
+	SAFE_RELEASE(decoder);
+	SAFE_RELEASE(factory);
+	if (uninitialise)  CoUninitialize();
+	return decoded;
+}
+
+
+//-----------------------------------------------------------------------------
+// Public functions
+//-----------------------------------------------------------------------------
+
+// Load an image from a DDS file or any format the Windows Imaging Component can decode. Returns false if the file can't be read or
+// its format isn't supported
+bool LoadImageFile(const string& fileName, SImage* image)
+{
+	vector<unsigned char> contents;
+	if (!ReadWholeFile(fileName, &contents))
+	{
+		return false;
+	}
+	if (contents.size() >= 4 && memcmp(&contents[0], "DDS ", 4) == 0)
+	{
+		return DecodeDDS(contents, image);
+	}
+	return DecodeWIC(fileName, image);
+}
+
+// Write an image to a 24-bit BMP file, dropping alpha. Returns false if the file can't be written
+bool WriteImageFile(const string& fileName, const SImage& image)
+{
+	// BMP rows are stored bottom up in BGR order, each padded to a multiple of four bytes
+	unsigned int rowSize = (image.Width * 3 + 3) & ~3u;
+	unsigned int imageSize = rowSize * image.Height;
+
+	BITMAPFILEHEADER fileHeader;
+	fileHeader.bfType = 0x4d42; // "BM"
+	fileHeader.bfSize = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + imageSize;
+	fileHeader.bfReserved1 = 0;
+	fileHeader.bfReserved2 = 0;
+	fileHeader.bfOffBits = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER);
+
+	BITMAPINFOHEADER infoHeader;
+	ZeroMemory(&infoHeader, sizeof(infoHeader));
+	infoHeader.biSize = sizeof(BITMAPINFOHEADER);
+	infoHeader.biWidth = image.Width;
+	infoHeader.biHeight = image.Height;
+	infoHeader.biPlanes = 1;
+	infoHeader.biBitCount = 24;
+	infoHeader.biCompression = BI_RGB;
+	infoHeader.biSizeImage = imageSize;
+
+	vector<unsigned char> rows(imageSize, 0);
+	for (unsigned int y = 0; y < image.Height; y++)
+	{
+		unsigned char* row = &rows[(image.Height - 1 - y) * rowSize];
+		for (unsigned int x = 0; x < image.Width; x++)
+		{
+			unsigned int pixel = image.Pixels[y * image.Width + x];
+			row[x * 3]     = static_cast<unsigned char>(pixel >> 16);
+			row[x * 3 + 1] = static_cast<unsigned char>(pixel >> 8);
+			row[x * 3 + 2] = static_cast<unsigned char>(pixel);
+		}
+	}
+
+	FILE* file;
+	if (fopen_s(&file, fileName.c_str(), "wb") != 0)
+	{
+		return false;
+	}
+	bool written = fwrite(&fileHeader, sizeof(fileHeader), 1, file) == 1 && fwrite(&infoHeader, sizeof(infoHeader), 1, file) == 1 &&
+	               (rows.empty() || fwrite(&rows[0], rows.size(), 1, file) == 1);
+	return fclose(file) == 0 && written;
+}
+
+// Count the pixels where any colour channel of two images differs by more than the tolerance
+unsigned int CountImageDifferences(const SImage& image1, const SImage& image2, unsigned int tolerance)
+{
+	if (image1.Width != image2.Width || image1.Height != image2.Height)
+	{
+		unsigned int size1 = image1.Width * image1.Height, size2 = image2.Width * image2.Height;
+		return (size1 > size2) ? size1 : size2;
+	}
+
+	unsigned int differences = 0;
+	for (unsigned int i = 0; i < image1.Pixels.size(); i++)
+	{
+		for (unsigned int channel = 0; channel < 3; channel++)
+		{
+			int value1 = (image1.Pixels[i] >> (channel * 8)) & 0xff;
+			int value2 = (image2.Pixels[i] >> (channel * 8)) & 0xff;
+			if (abs(value1 - value2) > static_cast<int>(tolerance))
+			{
+				differences++;
+				break;
+			}
+		}
+	}
+	return differences;
+}
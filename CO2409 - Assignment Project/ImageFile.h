@@ -0,0 +1,42 @@
+//--------------------------------------------------------------------------------------
+//	ImageFile.h
+//
+//	Loading and writing images in memory, without a device - for the software backend's
+//	textures and the frames it renders
+//--------------------------------------------------------------------------------------
+
+#ifndef IMAGE_FILE_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define IMAGE_FILE_H_INCLUDED
+
+#include <vector>
+#include <string>
+using namespace std;
+
+#include "Defines.h"
+
+// DDS files are read directly: uncompressed RGB, RGBA and luminance formats described by bit masks, and DXT1, DXT3 and DXT5
+// compressed ones. Only the top mip level is read. Other formats (PNG, JPG, BMP...) are decoded by the Windows Imaging Component.
+// Images are written as 24-bit BMP files, which need no compression code and open in any viewer
+
+// An image with 8 bits per channel. Each pixel is packed as in DXGI_FORMAT_R8G8B8A8_UNORM - red in the lowest byte, alpha in the
+// highest. Rows run from the top of the image
+struct SImage
+{
+	unsigned int         Width;
+	unsigned int         Height;
+	vector<unsigned int> Pixels;
+};
+
+// Load an image from a DDS file or any format the Windows Imaging Component can decode. Returns false if the file can't be read or
+// its format isn't supported
+bool LoadImageFile(const string& fileName, SImage* image);
+
+// Write an image to a 24-bit BMP file, dropping alpha. Returns false if the file can't be written
+bool WriteImageFile(const string& fileName, const SImage& image);
+
+// Count the pixels where any colour channel of two images differs by more than the tolerance. Images of different sizes differ in
+// every pixel of the larger
+unsigned int CountImageDifferences(const SImage& image1, const SImage& image2, unsigned int tolerance);
+
+
+#endif // End of header guard - see top of file
@@ -19,6 +19,7 @@ using namespace std;
 #include <d3d9.h>
 #include <d3dx9.h>
 
+#include "AlignedAllocator.h"
 #include "CVector3.h"
 #include "CMatrix4x4.h"
 #include "MeshData.h"
@@ -176,16 +177,17 @@ private:
 	/////////////////////////////////////
 	// X-File types
 
-	// Container types used
-	typedef vector<TUInt32>  TXFileInts;
-	typedef vector<CVector3> TXFileVectors;
+	// Container types used. All X-file lists use an aligned allocator - allows aligned SIMD loads
+	// on the vertex data, and containers of structures holding aligned matrices
+	typedef vector<TUInt32, CAlignedAllocator<TUInt32> >   TXFileInts;
+	typedef vector<CVector3, CAlignedAllocator<CVector3> > TXFileVectors;
 
 	// Single face in an X-file - three vertex indices (will convert all faces to triangles)
 	struct SXFileFace
 	{
 		TUInt32 aiVertex[3];
 	};
-	typedef vector<SXFileFace> TXFileFaces;
+	typedef vector<SXFileFace, CAlignedAllocator<SXFileFace> > TXFileFaces;
 
 
 	// 2D texture coordinate in an X-file
@@ -194,7 +196,7 @@ private:
 		TFloat32 fU;
 		TFloat32 fV;
 	};
-	typedef vector<SXFileUV> TXFileUVs;
+	typedef vector<SXFileUV, CAlignedAllocator<SXFileUV> > TXFileUVs;
 
 
 	// RGB colour used in structures below
@@ -213,7 +215,7 @@ private:
 		TFloat32 fBlue;
 		TFloat32 fAlpha;
 	};
-	typedef vector<SXFileRGBAColour> TXFileRGBAColours;
+	typedef vector<SXFileRGBAColour, CAlignedAllocator<SXFileRGBAColour> > TXFileRGBAColours;
 
 
 	// Material used in an X-file, material name, diffuse, specular and emmisive colours and a
@@ -227,7 +229,7 @@ private:
 		SXFileRGBColour  emmisiveColour;
 		string           sTextureName;
 	};
-	typedef vector<SXFileMaterial> TXFileMaterials;
+	typedef vector<SXFileMaterial, CAlignedAllocator<SXFileMaterial> > TXFileMaterials;
 
 	// Equality operator for SXFileMaterial structure (needed for searching material lists)
 	friend bool operator==
@@ -244,7 +246,7 @@ private:
 		TUInt32  iVertexIndex;
 		TFloat32 fWeight;
 	};
-	typedef vector<SXFileBoneWeight> TXFileBoneWeights;
+	typedef vector<SXFileBoneWeight, CAlignedAllocator<SXFileBoneWeight> > TXFileBoneWeights;
 
 	// Bone structure in an X-file
 	struct SXFileBone
@@ -254,10 +256,10 @@ private:
 		string            sFrameName;   // Name of the frame that drives this bone
 		TUInt32           iFrame;       // Index of the frame that drives this bone
 		TXFileBoneWeights weights;
-		CMatrix4x4        offsetMatrix; // TODO: Would like aligned matrices - but vector can't do it
+		CMatrix4x4A16     offsetMatrix;
 
 	};
-	typedef vector<SXFileBone>       TXFileBones;
+	typedef vector<SXFileBone, CAlignedAllocator<SXFileBone> > TXFileBones;
 
 
 	// Frame in an X-file hierarchy
@@ -267,10 +269,10 @@ private:
 		TUInt32    iDepth;
 		TUInt32    iParentIndex;
 		TUInt32    iNumChildren;
-		CMatrix4x4 defaultMatrix; // TODO: Would like aligned matrices - but vector can't do it
-		CMatrix4x4 offsetMatrix;
+		CMatrix4x4A16 defaultMatrix;
+		CMatrix4x4A16 offsetMatrix;
 	};
-	typedef vector<SXFileFrame> TXFileFrames;
+	typedef vector<SXFileFrame, CAlignedAllocator<SXFileFrame> > TXFileFrames;
 
 
 	// A single mesh in an X-File
@@ -335,7 +337,7 @@ private:
 		TUInt16           iMaxBonesPerFace;
 		TXFileBones       bones;
 	};
-	typedef vector<SXFileMesh> TXFileMeshes;
+	typedef vector<SXFileMesh, CAlignedAllocator<SXFileMesh> > TXFileMeshes;
 
 
 	/////////////////////////////////////
@@ -0,0 +1,149 @@
+/*******************************************
+	AlignedAllocator.h
+
+	STL allocator that returns memory aligned
+	to a given boundary, allowing containers
+	of aligned types (e.g. CMatrix4x4A16)
+********************************************/
+
+// The default std::allocator only guarantees alignment suitable for the fundamental types (8
+// bytes on Win32), so a vector of 16-byte aligned matrices may not actually be aligned. Use this
+// allocator as the second template parameter of an STL container to fix that, e.g.:
+//     vector<CMatrix4x4A16, CAlignedAllocator<CMatrix4x4A16> > matrices;
+// The alignment defaults to the alignment of the contained type (minimum 16 bytes - which also
+// allows aligned SIMD loads on arrays of unaligned types such as CVector3)
+
+#ifndef GEN_ALIGNED_ALLOCATOR_H_INCLUDED
+#define GEN_ALIGNED_ALLOCATOR_H_INCLUDED
+
+#include <malloc.h> // _aligned_malloc
+#include <new>      // std::bad_alloc
+#include <cstddef>  // size_t, ptrdiff_t
+
+#include "GenDefines.h"
+
+namespace gen
+{
+
+// Default alignment used by the allocator below - the larger of 16 bytes or the type's alignment
+template <class T>
+struct SDefaultAlignment
+{
+	static const size_t kValue = (__alignof(T) > 16) ? __alignof(T) : 16;
+};
+
+
+// STL allocator returning memory aligned to the given boundary (must be a power of 2)
+template <class T, size_t Alignment = SDefaultAlignment<T>::kValue>
+class CAlignedAllocator
+{
+public:
+	/*-----------------------------------------------------------------------------------------
+		Allocator types
+	-----------------------------------------------------------------------------------------*/
+
+	typedef T              value_type;
+	typedef T*             pointer;
+	typedef const T*       const_pointer;
+	typedef T&             reference;
+	typedef const T&       const_reference;
+	typedef size_t         size_type;
+	typedef ptrdiff_t      difference_type;
+
+	// Allocator for another type with the same alignment - used by containers to allocate
+	// internal nodes
+	template <class U>
+	struct rebind
+	{
+		typedef CAlignedAllocator<U, Alignment> other;
+	};
+
+
+	/*-----------------------------------------------------------------------------------------
+		Constructors
+	-----------------------------------------------------------------------------------------*/
+
+	// Allocator is stateless - all constructors are trivial
+	CAlignedAllocator() {}
+	CAlignedAllocator( const CAlignedAllocator& ) {}
+	template <class U>
+	CAlignedAllocator( const CAlignedAllocator<U, Alignment>& ) {}
+
+
+	/*-----------------------------------------------------------------------------------------
+		Allocation
+	-----------------------------------------------------------------------------------------*/
+
+	// Allocate aligned, uninitialised memory for the given number of objects
+	pointer allocate( size_type count, const void* /*hint*/ = 0 )
+	{
+		if (count == 0)
+		{
+			return 0;
+		}
+		if (count > max_size())
+		{
+			throw std::bad_alloc();
+		}
+		void* p = _aligned_malloc( count * sizeof(T), Alignment );
+		if (!p)
+		{
+			throw std::bad_alloc();
+		}
+		return static_cast<pointer>(p);
+	}
+
+	// Free memory returned from allocate
+	void deallocate( pointer p, size_type /*count*/ )
+	{
+		_aligned_free( p );
+	}
+
+	// Maximum number of objects that could be allocated
+	size_type max_size() const
+	{
+		return static_cast<size_type>(-1) / sizeof(T);
+	}
+
+
+	/*-----------------------------------------------------------------------------------------
+		Construction (pre-C++11 containers)
+	-----------------------------------------------------------------------------------------*/
+
+	pointer address( reference r ) const
+	{
+		return &r;
+	}
+	const_pointer address( const_reference r ) const
+	{
+		return &r;
+	}
+
+	void construct( pointer p, const T& value )
+	{
+		new (p) T( value );
+	}
+	void destroy( pointer p )
+	{
+		(void)p; // Unreferenced when T has a trivial destructor
+		p->~T();
+	}
+};
+
+// All instances of a stateless allocator are interchangeable
+template <class T, class U, size_t Alignment>
+inline bool operator==( const CAlignedAllocator<T, Alignment>&, const CAlignedAllocator<U, Alignment>& )
+{
+	return true;
+}
+
+template <class T, class U, size_t Alignment>
+inline bool operator!=( const CAlignedAllocator<T, Alignment>&, const CAlignedAllocator<U, Alignment>& )
+{
+	return false;
+}
+
+
+} // namespace gen
+
+#endif // GEN_ALIGNED_ALLOCATOR_H_INCLUDED
@@ -0,0 +1,324 @@
+/*******************************************
+	CJobSystem.cpp
+
+	Work-stealing job scheduler - a pool of
+	worker threads running short jobs, with
+	parallel-for and job dependencies
+********************************************/
+
+#include "CJobSystem.h"
+
+namespace gen
+{
+
+/*---------------------------------------------------------------------------------------------
+	Thread identity
+---------------------------------------------------------------------------------------------*/
+
+// Each worker records which system it belongs to and the index of its queue
+namespace
+{
+	thread_local const CJobSystem* t_pJobSystem = 0;
+	thread_local TUInt32           t_ThreadIndex = 0;
+}
+
+// Index of the calling thread's queue - threads outside the system use the main thread's queue
+TUInt32 CJobSystem::GetThreadIndex() const
+{
+	return (t_pJobSystem == this) ? t_ThreadIndex : 0;
+}
+
+
+/*---------------------------------------------------------------------------------------------
+	Constructors / Destructors
+---------------------------------------------------------------------------------------------*/
+
+// Constructor - starts numThreads - 1 worker threads, the calling thread making up the total
+CJobSystem::CJobSystem( TUInt32 numThreads /*= 0*/ ) : m_NumQueued( 0 ), m_Stop( false )
+{
+	if (numThreads == 0)
+	{
+		numThreads = thread::hardware_concurrency();
+		if (numThreads == 0)
+		{
+			numThreads = 1; // Hardware thread count not available
+		}
+	}
+
+	for (TUInt32 index = 0; index < numThreads; ++index)
+	{
+		m_Queues.push_back( new SQueue );
+	}
+	m_Workers.reserve( numThreads - 1 );
+	for (TUInt32 index = 1; index < numThreads; ++index)
+	{
+		m_Workers.push_back( thread( &CJobSystem::WorkerLoop, this, index ) );
+	}
+}
+
+// Destructor - stops the workers once the queues are empty, then runs any jobs still queued
+CJobSystem::~CJobSystem()
+{
+	{
+		lock_guard<mutex> lock( m_SleepMutex );
+		m_Stop = true;
+	}
+	m_WakeSignal.notify_all();
+	for (TUInt32 index = 0; index < m_Workers.size(); ++index)
+	{
+		m_Workers[index].join();
+	}
+
+	// With a single thread there are no workers, and a job finishing on a worker just before it
+	// stopped may have queued dependents. Run anything left here rather than drop it
+	SJob job;
+	while (Pop( &job ))
+	{
+		Execute( job );
+	}
+
+	for (TUInt32 index = 0; index < m_Queues.size(); ++index)
+	{
+		delete m_Queues[index];
+	}
+}
+
+
+/*---------------------------------------------------------------------------------------------
+	Jobs
+---------------------------------------------------------------------------------------------*/
+
+// Add a single job that calls kernel( 0, 1 ), optionally after all the jobs in another group
+void CJobSystem::Run
+(
+	const TJobKernel& kernel,
+	CJobGroup&        group,
+	CJobGroup*        pDependency /*= 0*/
+)
+{
+	const TJobKernel* pKernel;
+	{
+		lock_guard<mutex> lock( group.m_Mutex );
+		group.m_Kernels.push_back( kernel );
+		pKernel = &group.m_Kernels.back();
+	}
+	AddJobs( pKernel, 1, 1, group, pDependency );
+}
+
+// Add jobs that together call kernel over the indices [0, count), grainSize indices per job
+void CJobSystem::ParallelFor
+(
+	const TUInt32     count,
+	const TUInt32     grainSize,
+	const TJobKernel& kernel,
+	CJobGroup&        group,
+	CJobGroup*        pDependency /*= 0*/
+)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	const TJobKernel* pKernel;
+	{
+		lock_guard<mutex> lock( group.m_Mutex );
+		group.m_Kernels.push_back( kernel );
+		pKernel = &group.m_Kernels.back();
+	}
+	AddJobs( pKernel, count, grainSize, group, pDependency );
+}
+
+// Call kernel over the indices [0, count) split into jobs, returning when finished
+void CJobSystem::ParallelFor
+(
+	const TUInt32     count,
+	const TUInt32     grainSize,
+	const TJobKernel& kernel
+)
+{
+	// Not worth queuing anything if there is only one job's worth of work or no other threads
+	if (count <= grainSize || GetNumThreads() == 1)
+	{
+		if (count > 0)
+		{
+			kernel( 0, count );
+		}
+		return;
+	}
+	CJobGroup group;
+	ParallelFor( count, grainSize, kernel, group );
+	Wait( group );
+}
+
+// Wait for all the jobs in a group to finish, running queued jobs while waiting
+void CJobSystem::Wait( CJobGroup& group )
+{
+	SJob job;
+	while (group.m_NumPending.load() != 0)
+	{
+		if (Pop( &job ))
+		{
+			Execute( job );
+		}
+		else
+		{
+			// Remaining jobs are running on other threads, or waiting on a dependency
+			this_thread::yield();
+		}
+	}
+
+	// The thread that finished the last job may still hold the group's lock - taking it here
+	// ensures it has let go before the caller is free to destroy the group
+	lock_guard<mutex> lock( group.m_Mutex );
+	group.m_Kernels.clear();
+}
+
+
+/*---------------------------------------------------------------------------------------------
+	Private functions
+---------------------------------------------------------------------------------------------*/
+
+// Add jobs over [0, count) for a kernel already stored in the group
+void CJobSystem::AddJobs
+(
+	const TJobKernel* pKernel,
+	const TUInt32     count,
+	TUInt32           grainSize,
+	CJobGroup&        group,
+	CJobGroup*        pDependency
+)
+{
+	if (grainSize == 0)
+	{
+		grainSize = 1;
+	}
+	TUInt32 numJobs = (count + grainSize - 1) / grainSize;
+	group.m_NumPending += numJobs; // Before any job can start, so the group can't appear finished early
+
+	SJob job;
+	job.pKernel = pKernel;
+	job.pGroup = &group;
+
+	// A dependency's count only reaches zero while its lock is held, so either the jobs are put
+	// on its list before it finishes, or it has already finished and they can be queued now
+	if (pDependency)
+	{
+		lock_guard<mutex> lock( pDependency->m_Mutex );
+		if (pDependency->m_NumPending.load() != 0)
+		{
+			for (TUInt32 first = 0; first < count; first += grainSize)
+			{
+				job.first = first;
+				job.end = (count - first > grainSize) ? first + grainSize : count;
+				pDependency->m_Dependents.push_back( job );
+			}
+			return;
+		}
+	}
+
+	for (TUInt32 first = 0; first < count; first += grainSize)
+	{
+		job.first = first;
+		job.end = (count - first > grainSize) ? first + grainSize : count;
+		Push( job );
+	}
+}
+
+// Put a job in the calling thread's queue and wake a worker
+void CJobSystem::Push( const SJob& job )
+{
+	SQueue& queue = *m_Queues[GetThreadIndex()];
+	{
+		lock_guard<mutex> lock( queue.lock );
+		queue.jobs.push_back( job );
+	}
+	++m_NumQueued;
+
+	// Take the sleep lock so a worker can't miss the signal between checking the count and waiting
+	{
+		lock_guard<mutex> lock( m_SleepMutex );
+	}
+	m_WakeSignal.notify_one();
+}
+
+// Take a job from the back of the calling thread's queue, or steal one from the front of
+// another thread's queue. Returns false if there are no jobs anywhere
+bool CJobSystem::Pop( SJob* pJob )
+{
+	TUInt32 numQueues = GetNumThreads();
+	TUInt32 index = GetThreadIndex();
+	{
+		SQueue& queue = *m_Queues[index];
+		lock_guard<mutex> lock( queue.lock );
+		if (!queue.jobs.empty())
+		{
+			*pJob = queue.jobs.back();
+			queue.jobs.pop_back();
+			--m_NumQueued;
+			return true;
+		}
+	}
+
+	// Try the other queues in turn, starting with the next thread's so that idle threads spread
+	// out over different victims
+	for (TUInt32 offset = 1; offset < numQueues; ++offset)
+	{
+		SQueue& queue = *m_Queues[(index + offset) % numQueues];
+		lock_guard<mutex> lock( queue.lock );
+		if (!queue.jobs.empty())
+		{
+			*pJob = queue.jobs.front();
+			queue.jobs.pop_front();
+			--m_NumQueued;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Run a job and update its group, queuing any jobs that were waiting for the group
+void CJobSystem::Execute( const SJob& job )
+{
+	(*job.pKernel)( job.first, job.end );
+
+	vector<SJob> dependents;
+	{
+		lock_guard<mutex> lock( job.pGroup->m_Mutex );
+		if (--job.pGroup->m_NumPending == 0)
+		{
+			dependents.swap( job.pGroup->m_Dependents );
+		}
+	}
+	for (TUInt32 index = 0; index < dependents.size(); ++index)
+	{
+		Push( dependents[index] );
+	}
+}
+
+// Main function of the worker threads - run jobs until there are none, then sleep until more
+// are queued
+void CJobSystem::WorkerLoop( const TUInt32 index )
+{
+	t_pJobSystem = this;
+	t_ThreadIndex = index;
+
+	SJob job;
+	while (true)
+	{
+		if (Pop( &job ))
+		{
+			Execute( job );
+			continue;
+		}
+
+		unique_lock<mutex> lock( m_SleepMutex );
+		m_WakeSignal.wait( lock, [this]() { return m_Stop || m_NumQueued.load() != 0; } );
+		if (m_Stop && m_NumQueued.load() == 0)
+		{
+			return;
+		}
+	}
+}
+
+
+} // namespace gen
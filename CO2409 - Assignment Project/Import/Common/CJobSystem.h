@@ -0,0 +1,212 @@
+/*******************************************
+	CJobSystem.h
+
+	Work-stealing job scheduler - a pool of
+	worker threads running short jobs, with
+	parallel-for and job dependencies
+********************************************/
+
+// Work is submitted as jobs, each a call to a kernel function over a range of indices. Every thread
+// (the workers and the thread that created the system, called the main thread here) has its own
+// queue. Threads add new jobs to the back of their own queue and take jobs from the back as well,
+// so related work stays on one thread while its data is still in cache. A thread with an empty
+// queue steals from the front of another thread's queue - the oldest, usually largest, jobs.
+//
+// Jobs are added to a CJobGroup, which counts the group's unfinished jobs. Wait on a group to
+// block until all its jobs are done - the waiting thread runs jobs itself rather than sleeping,
+// so the main thread takes part in the work. A job can also be given another group as a
+// dependency, in which case it is only queued once every job in that group has finished.
+//
+// ParallelFor splits an index range into jobs of grainSize indices. Choose the grain so that each
+// job does enough work to outweigh the cost of queuing it (a few microseconds at least), but small
+// enough that there are several jobs per thread to balance the load
+
+#ifndef GEN_C_JOB_SYSTEM_H_INCLUDED
+#define GEN_C_JOB_SYSTEM_H_INCLUDED
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+using namespace std;
+
+#include "GenDefines.h"
+
+namespace gen
+{
+
+// Kernel function for a job - processes the indices [first, end)
+typedef function<void( TUInt32 first, TUInt32 end )> TJobKernel;
+
+class CJobGroup;
+
+// A queued job - a kernel call over a range of indices. The kernel is held by the job's group.
+// Only used inside the job system
+struct SJob
+{
+	const TJobKernel* pKernel;
+	TUInt32           first;
+	TUInt32           end;
+	CJobGroup*        pGroup;
+};
+
+
+// A set of jobs that can be waited for together, or used as a dependency of later jobs. Must
+// not be destroyed while any of its jobs are still to run
+class CJobGroup
+{
+// Concrete class - public access
+public:
+	// Default constructor - empty group
+	CJobGroup() : m_NumPending( 0 ) {}
+
+	// Check if all the jobs added to the group so far have finished
+	bool IsFinished() const
+	{
+		return m_NumPending.load() == 0;
+	}
+
+	// Remove the kernels of finished jobs, ready to reuse the group. Only call when finished
+	void Reset()
+	{
+		m_Kernels.clear();
+	}
+
+private:
+	friend class CJobSystem;
+
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CJobGroup( const CJobGroup& );
+	CJobGroup& operator=( const CJobGroup& );
+
+	atomic<TUInt32>   m_NumPending; // Jobs added but not finished
+	deque<TJobKernel> m_Kernels;    // Kernels used by the group's jobs (deque so they never move)
+	mutex             m_Mutex;      // Protects the two lists
+	vector<SJob>      m_Dependents; // Jobs waiting for this group to finish
+};
+
+
+class CJobSystem
+{
+// Concrete class - public access
+public:
+	/*-----------------------------------------------------------------------------------------
+		Constructors / Destructors
+	-----------------------------------------------------------------------------------------*/
+
+	// Constructor - starts numThreads - 1 worker threads, the calling thread making up the total
+	// (0 = one thread per hardware thread)
+	CJobSystem( TUInt32 numThreads = 0 );
+
+	// Destructor - stops the workers once the queues are empty, then runs any jobs still queued
+	// on the calling thread (all of them if there are no workers)
+	~CJobSystem();
+
+
+	/*-----------------------------------------------------------------------------------------
+		Jobs
+	-----------------------------------------------------------------------------------------*/
+
+	// Total number of threads that run jobs, including the main thread
+	TUInt32 GetNumThreads() const
+	{
+		return static_cast<TUInt32>(m_Queues.size());
+	}
+
+	// Add a single job that calls kernel( 0, 1 ). If a dependency is given the job is not started
+	// until all the jobs already added to that group have finished
+	void Run
+	(
+		const TJobKernel& kernel,
+		CJobGroup&        group,
+		CJobGroup*        pDependency = 0
+	);
+
+	// Add jobs that together call kernel over the indices [0, count), each covering up to
+	// grainSize indices. The dependency works as for Run
+	void ParallelFor
+	(
+		const TUInt32     count,
+		const TUInt32     grainSize,
+		const TJobKernel& kernel,
+		CJobGroup&        group,
+		CJobGroup*        pDependency = 0
+	);
+
+	// Call kernel over the indices [0, count) split into jobs as above, returning when finished
+	void ParallelFor
+	(
+		const TUInt32     count,
+		const TUInt32     grainSize,
+		const TJobKernel& kernel
+	);
+
+	// Wait for all the jobs in a group to finish, running queued jobs while waiting
+	void Wait( CJobGroup& group );
+
+
+/*-----------------------------------------------------------------------------------------
+	Private types / functions
+-----------------------------------------------------------------------------------------*/
+private:
+
+	// Job queue for one thread - the owner uses the back, other threads steal from the front
+	struct SQueue
+	{
+		mutex        lock;
+		deque<SJob>  jobs;
+	};
+
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CJobSystem( const CJobSystem& );
+	CJobSystem& operator=( const CJobSystem& );
+
+	// Add jobs over [0, count) for a kernel already stored in the group
+	void AddJobs
+	(
+		const TJobKernel* pKernel,
+		const TUInt32     count,
+		TUInt32           grainSize,
+		CJobGroup&        group,
+		CJobGroup*        pDependency
+	);
+
+	// Put a job in the calling thread's queue and wake a worker
+	void Push( const SJob& job );
+
+	// Take a job from the calling thread's queue, or steal one from another thread. Returns
+	// false if there are no jobs anywhere
+	bool Pop( SJob* pJob );
+
+	// Run a job and update its group, queuing any jobs that were waiting for the group
+	void Execute( const SJob& job );
+
+	// Index of the calling thread's queue - the main thread (or any thread outside the system)
+	// uses queue 0
+	TUInt32 GetThreadIndex() const;
+
+	// Main function of the worker threads
+	void WorkerLoop( const TUInt32 index );
+
+
+/*-----------------------------------------------------------------------------------------
+	Data
+-----------------------------------------------------------------------------------------*/
+private:
+
+	vector<SQueue*>    m_Queues;     // One per thread, main thread first
+	vector<thread>     m_Workers;
+
+	atomic<TUInt32>    m_NumQueued;  // Jobs in all queues, lets idle workers sleep
+	mutex              m_SleepMutex;
+	condition_variable m_WakeSignal;
+	bool               m_Stop;
+};
+
+
+} // namespace gen
+
+#endif // GEN_C_JOB_SYSTEM_H_INCLUDED
@@ -0,0 +1,409 @@
+/*******************************************
+	BatchCulling.cpp
+
+	Structure-of-arrays lists of bounding
+	volumes, and SIMD tests of whole lists
+	against a frustum or cone
+********************************************/
+
+#include "BatchCulling.h"
+
+#include <xmmintrin.h> // SSE intrinsics
+
+namespace gen
+{
+
+/*---------------------------------------------------------------------------------------------
+	Volume Lists
+---------------------------------------------------------------------------------------------*/
+
+// Round a count up to a multiple of four - the number of volumes tested in each SIMD step
+inline TUInt32 PaddedSize( const TUInt32 count )
+{
+	return (count + 3) & ~3u;
+}
+
+
+// Remove all spheres
+void CSphereList::Clear()
+{
+	m_CentreX.clear();
+	m_CentreY.clear();
+	m_CentreZ.clear();
+	m_Radius.clear();
+	m_Count = 0;
+}
+
+// Reserve space for the given number of spheres
+void CSphereList::Reserve( const TUInt32 count )
+{
+	m_CentreX.reserve( PaddedSize( count ) );
+	m_CentreY.reserve( PaddedSize( count ) );
+	m_CentreZ.reserve( PaddedSize( count ) );
+	m_Radius.reserve( PaddedSize( count ) );
+}
+
+// Add a sphere, returns its index
+TUInt32 CSphereList::Add( const CSphere& sphere )
+{
+	// Grow arrays four entries at a time so they are always padded
+	if (m_Count == m_CentreX.size())
+	{
+		m_CentreX.resize( m_Count + 4, 0.0f );
+		m_CentreY.resize( m_Count + 4, 0.0f );
+		m_CentreZ.resize( m_Count + 4, 0.0f );
+		m_Radius.resize( m_Count + 4, 0.0f );
+	}
+	Set( m_Count, sphere );
+	return m_Count++;
+}
+
+// Replace the sphere at the given index
+void CSphereList::Set( const TUInt32 index, const CSphere& sphere )
+{
+	m_CentreX[index] = sphere.centre.x;
+	m_CentreY[index] = sphere.centre.y;
+	m_CentreZ[index] = sphere.centre.z;
+	m_Radius[index] = sphere.radius;
+}
+
+
+// Remove all boxes
+void CAABBList::Clear()
+{
+	m_CentreX.clear();
+	m_CentreY.clear();
+	m_CentreZ.clear();
+	m_ExtentX.clear();
+	m_ExtentY.clear();
+	m_ExtentZ.clear();
+	m_Count = 0;
+}
+
+// Reserve space for the given number of boxes
+void CAABBList::Reserve( const TUInt32 count )
+{
+	m_CentreX.reserve( PaddedSize( count ) );
+	m_CentreY.reserve( PaddedSize( count ) );
+	m_CentreZ.reserve( PaddedSize( count ) );
+	m_ExtentX.reserve( PaddedSize( count ) );
+	m_ExtentY.reserve( PaddedSize( count ) );
+	m_ExtentZ.reserve( PaddedSize( count ) );
+}
+
+// Add a box, returns its index
+TUInt32 CAABBList::Add( const CAABB& box )
+{
+	// Grow arrays four entries at a time so they are always padded
+	if (m_Count == m_CentreX.size())
+	{
+		m_CentreX.resize( m_Count + 4, 0.0f );
+		m_CentreY.resize( m_Count + 4, 0.0f );
+		m_CentreZ.resize( m_Count + 4, 0.0f );
+		m_ExtentX.resize( m_Count + 4, 0.0f );
+		m_ExtentY.resize( m_Count + 4, 0.0f );
+		m_ExtentZ.resize( m_Count + 4, 0.0f );
+	}
+	Set( m_Count, box );
+	return m_Count++;
+}
+
+// Replace the box at the given index
+void CAABBList::Set( const TUInt32 index, const CAABB& box )
+{
+	CVector3 centre = box.GetCentre();
+	CVector3 extents = box.GetExtents();
+	m_CentreX[index] = centre.x;
+	m_CentreY[index] = centre.y;
+	m_CentreZ[index] = centre.z;
+	m_ExtentX[index] = extents.x;
+	m_ExtentY[index] = extents.y;
+	m_ExtentZ[index] = extents.z;
+}
+
+
+/*---------------------------------------------------------------------------------------------
+	Batch Tests
+---------------------------------------------------------------------------------------------*/
+// The SIMD expressions deliberately follow the same order of operations as the single-volume
+// tests in CFrustum / CCone so the results are identical
+
+// Append the indices of the visible volumes in a group of four to the visible list, given a
+// 4-bit mask of visible volumes (bit n set if volume firstIndex + n is visible). Only the first
+// numValid bits are used - the rest are padding
+inline TUInt32 AppendVisible
+(
+	const int     visibleMask,
+	const TUInt32 firstIndex,
+	const TUInt32 numValid,
+	TUInt32*      pVisible,
+	TUInt32       numVisible
+)
+{
+	// Write every candidate index but only advance past the visible ones - avoids branches
+	for (TUInt32 bit = 0; bit < numValid; ++bit)
+	{
+		pVisible[numVisible] = firstIndex + bit;
+		numVisible += (visibleMask >> bit) & 1;
+	}
+	return numVisible;
+}
+
+// Number of real (non-padding) volumes in the group of four starting at the given index
+inline TUInt32 NumValid( const TUInt32 firstIndex, const TUInt32 count )
+{
+	return (count - firstIndex < 4) ? count - firstIndex : 4;
+}
+
+
+// Cull a list of spheres against a frustum
+TUInt32 CullSpheres
+(
+	const CFrustum&    frustum,
+	const CSphereList& spheres,
+	TUInt32*           pVisible
+)
+{
+	const TUInt32 count = spheres.Size();
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	// Copy each plane component into all four lanes of a SIMD register
+	__m128 normalX[kNumFrustumPlanes], normalY[kNumFrustumPlanes], normalZ[kNumFrustumPlanes], planeD[kNumFrustumPlanes];
+	for (TUInt32 plane = 0; plane < kNumFrustumPlanes; ++plane)
+	{
+		normalX[plane] = _mm_set1_ps( frustum.planes[plane].normal.x );
+		normalY[plane] = _mm_set1_ps( frustum.planes[plane].normal.y );
+		normalZ[plane] = _mm_set1_ps( frustum.planes[plane].normal.z );
+		planeD[plane]  = _mm_set1_ps( frustum.planes[plane].d );
+	}
+
+	const TFloat32* pCentreX = spheres.CentreX();
+	const TFloat32* pCentreY = spheres.CentreY();
+	const TFloat32* pCentreZ = spheres.CentreZ();
+	const TFloat32* pRadius = spheres.Radius();
+	const __m128 zero = _mm_setzero_ps();
+
+	TUInt32 numVisible = 0;
+	for (TUInt32 i = 0; i < count; i += 4)
+	{
+		__m128 x = _mm_load_ps( pCentreX + i );
+		__m128 y = _mm_load_ps( pCentreY + i );
+		__m128 z = _mm_load_ps( pCentreZ + i );
+		__m128 negRadius = _mm_sub_ps( zero, _mm_load_ps( pRadius + i ) );
+
+		// Sphere is outside if it is entirely behind any plane: distance < -radius
+		__m128 outside = zero;
+		for (TUInt32 plane = 0; plane < kNumFrustumPlanes; ++plane)
+		{
+			__m128 distance = _mm_add_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( normalX[plane], x ),
+			                                                      _mm_mul_ps( normalY[plane], y ) ),
+			                                          _mm_mul_ps( normalZ[plane], z ) ),
+			                              planeD[plane] );
+			outside = _mm_or_ps( outside, _mm_cmplt_ps( distance, negRadius ) );
+		}
+		numVisible = AppendVisible( ~_mm_movemask_ps( outside ), i, NumValid( i, count ), pVisible, numVisible );
+	}
+	return numVisible;
+}
+
+// Cull a list of boxes against a frustum
+TUInt32 CullAABBs
+(
+	const CFrustum&  frustum,
+	const CAABBList& boxes,
+	TUInt32*         pVisible
+)
+{
+	const TUInt32 count = boxes.Size();
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	// Copy each plane component into all four lanes of a SIMD register. The absolute normal
+	// values are used to find the box's extent along the normal
+	__m128 normalX[kNumFrustumPlanes], normalY[kNumFrustumPlanes], normalZ[kNumFrustumPlanes], planeD[kNumFrustumPlanes];
+	__m128 absNormalX[kNumFrustumPlanes], absNormalY[kNumFrustumPlanes], absNormalZ[kNumFrustumPlanes];
+	for (TUInt32 plane = 0; plane < kNumFrustumPlanes; ++plane)
+	{
+		const CVector3& normal = frustum.planes[plane].normal;
+		normalX[plane] = _mm_set1_ps( normal.x );
+		normalY[plane] = _mm_set1_ps( normal.y );
+		normalZ[plane] = _mm_set1_ps( normal.z );
+		planeD[plane]  = _mm_set1_ps( frustum.planes[plane].d );
+		absNormalX[plane] = _mm_set1_ps( Abs( normal.x ) );
+		absNormalY[plane] = _mm_set1_ps( Abs( normal.y ) );
+		absNormalZ[plane] = _mm_set1_ps( Abs( normal.z ) );
+	}
+
+	const TFloat32* pCentreX = boxes.CentreX();
+	const TFloat32* pCentreY = boxes.CentreY();
+	const TFloat32* pCentreZ = boxes.CentreZ();
+	const TFloat32* pExtentX = boxes.ExtentX();
+	const TFloat32* pExtentY = boxes.ExtentY();
+	const TFloat32* pExtentZ = boxes.ExtentZ();
+	const __m128 zero = _mm_setzero_ps();
+
+	TUInt32 numVisible = 0;
+	for (TUInt32 i = 0; i < count; i += 4)
+	{
+		__m128 x = _mm_load_ps( pCentreX + i );
+		__m128 y = _mm_load_ps( pCentreY + i );
+		__m128 z = _mm_load_ps( pCentreZ + i );
+		__m128 extentX = _mm_load_ps( pExtentX + i );
+		__m128 extentY = _mm_load_ps( pExtentY + i );
+		__m128 extentZ = _mm_load_ps( pExtentZ + i );
+
+		// Box is outside if it is entirely behind any plane: distance < -(extent along normal)
+		__m128 outside = zero;
+		for (TUInt32 plane = 0; plane < kNumFrustumPlanes; ++plane)
+		{
+			__m128 radius = _mm_add_ps( _mm_add_ps( _mm_mul_ps( absNormalX[plane], extentX ),
+			                                        _mm_mul_ps( absNormalY[plane], extentY ) ),
+			                            _mm_mul_ps( absNormalZ[plane], extentZ ) );
+			__m128 distance = _mm_add_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( normalX[plane], x ),
+			                                                      _mm_mul_ps( normalY[plane], y ) ),
+			                                          _mm_mul_ps( normalZ[plane], z ) ),
+			                              planeD[plane] );
+			outside = _mm_or_ps( outside, _mm_cmplt_ps( distance, _mm_sub_ps( zero, radius ) ) );
+		}
+		numVisible = AppendVisible( ~_mm_movemask_ps( outside ), i, NumValid( i, count ), pVisible, numVisible );
+	}
+	return numVisible;
+}
+
+
+// Test four spheres against a cone, returns a SIMD mask with all bits set for each intersecting
+// sphere. See CCone::Intersects for the method
+inline __m128 ConeIntersects4
+(
+	const __m128& x,
+	const __m128& y,
+	const __m128& z,
+	const __m128& radius,
+	const __m128* pCone // Apex x,y,z, direction x,y,z, range, sin, cos^2, sin^2
+)
+{
+	const __m128 zero = _mm_setzero_ps();
+
+	__m128 toCentreX = _mm_sub_ps( x, pCone[0] );
+	__m128 toCentreY = _mm_sub_ps( y, pCone[1] );
+	__m128 toCentreZ = _mm_sub_ps( z, pCone[2] );
+	__m128 along = _mm_add_ps( _mm_add_ps( _mm_mul_ps( pCone[3], toCentreX ), _mm_mul_ps( pCone[4], toCentreY ) ),
+	                           _mm_mul_ps( pCone[5], toCentreZ ) );
+	__m128 distSq = _mm_add_ps( _mm_add_ps( _mm_mul_ps( toCentreX, toCentreX ), _mm_mul_ps( toCentreY, toCentreY ) ),
+	                            _mm_mul_ps( toCentreZ, toCentreZ ) );
+
+	// Range test against the flat end of the cone
+	__m128 inRange = _mm_cmple_ps( _mm_sub_ps( along, radius ), pCone[6] );
+
+	// Test against expanded cone
+	__m128 offset = _mm_div_ps( radius, pCone[7] );
+	__m128 expandedAlong = _mm_add_ps( along, offset );
+	__m128 expandedDistSq = _mm_add_ps( _mm_add_ps( distSq, _mm_mul_ps( _mm_mul_ps( _mm_set1_ps( 2.0f ), along ), offset ) ),
+	                                    _mm_mul_ps( offset, offset ) );
+	__m128 inExpanded = _mm_and_ps( _mm_cmpgt_ps( expandedAlong, zero ),
+	                                _mm_cmpge_ps( _mm_mul_ps( expandedAlong, expandedAlong ), _mm_mul_ps( expandedDistSq, pCone[8] ) ) );
+
+	// Region behind the apex - only intersects if sphere contains apex
+	__m128 behindApex = _mm_and_ps( _mm_cmplt_ps( along, zero ),
+	                                _mm_cmpge_ps( _mm_mul_ps( along, along ), _mm_mul_ps( distSq, pCone[9] ) ) );
+	__m128 containsApex = _mm_cmple_ps( distSq, _mm_mul_ps( radius, radius ) );
+
+	// inRange && inExpanded && (!behindApex || containsApex)
+	return _mm_and_ps( _mm_and_ps( inRange, inExpanded ), _mm_or_ps( _mm_andnot_ps( behindApex, _mm_cmpeq_ps( zero, zero ) ), containsApex ) );
+}
+
+// Copy the cone values into SIMD registers in the order used by ConeIntersects4
+inline void SetConeRegisters( const CCone& cone, __m128* pCone )
+{
+	pCone[0] = _mm_set1_ps( cone.apex.x );
+	pCone[1] = _mm_set1_ps( cone.apex.y );
+	pCone[2] = _mm_set1_ps( cone.apex.z );
+	pCone[3] = _mm_set1_ps( cone.direction.x );
+	pCone[4] = _mm_set1_ps( cone.direction.y );
+	pCone[5] = _mm_set1_ps( cone.direction.z );
+	pCone[6] = _mm_set1_ps( cone.range );
+	pCone[7] = _mm_set1_ps( cone.sinAngle );
+	pCone[8] = _mm_set1_ps( cone.cosAngle * cone.cosAngle );
+	pCone[9] = _mm_set1_ps( cone.sinAngle * cone.sinAngle );
+}
+
+// Cull a list of spheres against a cone
+TUInt32 CullSpheres
+(
+	const CCone&       cone,
+	const CSphereList& spheres,
+	TUInt32*           pVisible
+)
+{
+	const TUInt32 count = spheres.Size();
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	__m128 coneRegisters[10];
+	SetConeRegisters( cone, coneRegisters );
+
+	const TFloat32* pCentreX = spheres.CentreX();
+	const TFloat32* pCentreY = spheres.CentreY();
+	const TFloat32* pCentreZ = spheres.CentreZ();
+	const TFloat32* pRadius = spheres.Radius();
+
+	TUInt32 numVisible = 0;
+	for (TUInt32 i = 0; i < count; i += 4)
+	{
+		__m128 visible = ConeIntersects4( _mm_load_ps( pCentreX + i ), _mm_load_ps( pCentreY + i ),
+		                                  _mm_load_ps( pCentreZ + i ), _mm_load_ps( pRadius + i ), coneRegisters );
+		numVisible = AppendVisible( _mm_movemask_ps( visible ), i, NumValid( i, count ), pVisible, numVisible );
+	}
+	return numVisible;
+}
+
+// Cull a list of boxes against a cone - conservative, uses each box's bounding sphere
+TUInt32 CullAABBs
+(
+	const CCone&     cone,
+	const CAABBList& boxes,
+	TUInt32*         pVisible
+)
+{
+	const TUInt32 count = boxes.Size();
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	__m128 coneRegisters[10];
+	SetConeRegisters( cone, coneRegisters );
+
+	const TFloat32* pCentreX = boxes.CentreX();
+	const TFloat32* pCentreY = boxes.CentreY();
+	const TFloat32* pCentreZ = boxes.CentreZ();
+	const TFloat32* pExtentX = boxes.ExtentX();
+	const TFloat32* pExtentY = boxes.ExtentY();
+	const TFloat32* pExtentZ = boxes.ExtentZ();
+
+	TUInt32 numVisible = 0;
+	for (TUInt32 i = 0; i < count; i += 4)
+	{
+		// Bounding sphere radius is the length of the extents
+		__m128 extentX = _mm_load_ps( pExtentX + i );
+		__m128 extentY = _mm_load_ps( pExtentY + i );
+		__m128 extentZ = _mm_load_ps( pExtentZ + i );
+		__m128 radius = _mm_sqrt_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( extentX, extentX ), _mm_mul_ps( extentY, extentY ) ),
+		                                         _mm_mul_ps( extentZ, extentZ ) ) );
+
+		__m128 visible = ConeIntersects4( _mm_load_ps( pCentreX + i ), _mm_load_ps( pCentreY + i ),
+		                                  _mm_load_ps( pCentreZ + i ), radius, coneRegisters );
+		numVisible = AppendVisible( _mm_movemask_ps( visible ), i, NumValid( i, count ), pVisible, numVisible );
+	}
+	return numVisible;
+}
+
+
+} // namespace gen
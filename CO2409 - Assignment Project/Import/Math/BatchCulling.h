@@ -0,0 +1,165 @@
+/*******************************************
+	BatchCulling.h
+
+	Structure-of-arrays lists of bounding
+	volumes, and SIMD tests of whole lists
+	against a frustum or cone
+********************************************/
+
+// Testing volumes one at a time (CFrustum::Test etc.) spends most of its time loading data and
+// branching. These lists store each component in its own 16-byte aligned array (all centre x
+// values together, then all y values...) so four volumes can be tested at once with SSE and no
+// branches. The culling functions write the indices of the volumes that pass into a caller
+// supplied array - the compact list of visible objects - and return how many there are
+
+#ifndef GEN_BATCH_CULLING_H_INCLUDED
+#define GEN_BATCH_CULLING_H_INCLUDED
+
+#include <vector>
+using namespace std;
+
+#include "GenDefines.h"
+#include "AlignedAllocator.h"
+#include "BoundingVolumes.h"
+#include "CFrustum.h"
+#include "CCone.h"
+
+namespace gen
+{
+
+// Aligned float array used by the lists below
+typedef vector<TFloat32, CAlignedAllocator<TFloat32> > TAlignedFloats;
+
+
+/*---------------------------------------------------------------------------------------------
+	Volume Lists
+---------------------------------------------------------------------------------------------*/
+
+// List of spheres in structure-of-arrays form. Arrays are padded to a multiple of four entries
+class CSphereList
+{
+// Concrete class - public access
+public:
+	CSphereList() : m_Count( 0 ) {}
+
+	// Number of spheres in the list
+	TUInt32 Size() const
+	{
+		return m_Count;
+	}
+
+	// Remove all spheres
+	void Clear();
+
+	// Reserve space for the given number of spheres
+	void Reserve( const TUInt32 count );
+
+	// Add a sphere, returns its index
+	TUInt32 Add( const CSphere& sphere );
+
+	// Replace the sphere at the given index
+	void Set( const TUInt32 index, const CSphere& sphere );
+
+	// Component arrays - 16-byte aligned and padded to a multiple of four (not valid if list is empty)
+	const TFloat32* CentreX() const { return m_CentreX.data(); }
+	const TFloat32* CentreY() const { return m_CentreY.data(); }
+	const TFloat32* CentreZ() const { return m_CentreZ.data(); }
+	const TFloat32* Radius() const  { return m_Radius.data(); }
+
+private:
+	TAlignedFloats m_CentreX;
+	TAlignedFloats m_CentreY;
+	TAlignedFloats m_CentreZ;
+	TAlignedFloats m_Radius;
+	TUInt32        m_Count;
+};
+
+
+// List of axis-aligned boxes in structure-of-arrays form, stored as centre and extents (half-
+// size). Arrays are padded to a multiple of four entries
+class CAABBList
+{
+// Concrete class - public access
+public:
+	CAABBList() : m_Count( 0 ) {}
+
+	// Number of boxes in the list
+	TUInt32 Size() const
+	{
+		return m_Count;
+	}
+
+	// Remove all boxes
+	void Clear();
+
+	// Reserve space for the given number of boxes
+	void Reserve( const TUInt32 count );
+
+	// Add a box, returns its index
+	TUInt32 Add( const CAABB& box );
+
+	// Replace the box at the given index
+	void Set( const TUInt32 index, const CAABB& box );
+
+	// Component arrays - 16-byte aligned and padded to a multiple of four (not valid if list is empty)
+	const TFloat32* CentreX() const { return m_CentreX.data(); }
+	const TFloat32* CentreY() const { return m_CentreY.data(); }
+	const TFloat32* CentreZ() const { return m_CentreZ.data(); }
+	const TFloat32* ExtentX() const { return m_ExtentX.data(); }
+	const TFloat32* ExtentY() const { return m_ExtentY.data(); }
+	const TFloat32* ExtentZ() const { return m_ExtentZ.data(); }
+
+private:
+	TAlignedFloats m_CentreX;
+	TAlignedFloats m_CentreY;
+	TAlignedFloats m_CentreZ;
+	TAlignedFloats m_ExtentX;
+	TAlignedFloats m_ExtentY;
+	TAlignedFloats m_ExtentZ;
+	TUInt32        m_Count;
+};
+
+
+/*---------------------------------------------------------------------------------------------
+	Batch Tests
+---------------------------------------------------------------------------------------------*/
+// Each function writes the indices of the volumes that are inside or intersecting the frustum /
+// cone to pVisible (which must have space for Size() entries), in increasing order, and returns
+// the number written. Results match the single-volume tests in CFrustum and CCone
+
+// Cull a list of spheres against a frustum
+TUInt32 CullSpheres
+(
+	const CFrustum&    frustum,
+	const CSphereList& spheres,
+	TUInt32*           pVisible
+);
+
+// Cull a list of boxes against a frustum
+TUInt32 CullAABBs
+(
+	const CFrustum&  frustum,
+	const CAABBList& boxes,
+	TUInt32*         pVisible
+);
+
+// Cull a list of spheres against a cone
+TUInt32 CullSpheres
+(
+	const CCone&       cone,
+	const CSphereList& spheres,
+	TUInt32*           pVisible
+);
+
+// Cull a list of boxes against a cone - conservative, uses each box's bounding sphere
+TUInt32 CullAABBs
+(
+	const CCone&     cone,
+	const CAABBList& boxes,
+	TUInt32*         pVisible
+);
+
+
+} // namespace gen
+
+#endif // GEN_BATCH_CULLING_H_INCLUDED
@@ -0,0 +1,435 @@
+/*******************************************
+	BatchQuaternion.cpp
+
+	Structure-of-arrays lists of quaternions,
+	and SIMD interpolation, blending and matrix
+	conversion of whole lists at once
+********************************************/
+
+#include "BatchQuaternion.h"
+
+#include <xmmintrin.h> // SSE intrinsics
+
+#include "Error.h"
+#include "CJobSystem.h"
+
+namespace gen
+{
+
+/*---------------------------------------------------------------------------------------------
+	Quaternion List
+---------------------------------------------------------------------------------------------*/
+
+// Remove all quaternions
+void CQuaternionList::Clear()
+{
+	m_W.clear();
+	m_X.clear();
+	m_Y.clear();
+	m_Z.clear();
+	m_Count = 0;
+}
+
+// Reserve space for the given number of quaternions
+void CQuaternionList::Reserve( const TUInt32 count )
+{
+	TUInt32 paddedCount = (count + 3) & ~3u;
+	m_W.reserve( paddedCount );
+	m_X.reserve( paddedCount );
+	m_Y.reserve( paddedCount );
+	m_Z.reserve( paddedCount );
+}
+
+// Change the number of quaternions, new entries are set to the identity
+void CQuaternionList::Resize( const TUInt32 count )
+{
+	// Reset any padding or removed entries to identity first, so new entries are identity too
+	for (TUInt32 index = count; index < m_W.size(); ++index)
+	{
+		Set( index, CQuaternion::kIdentity );
+	}
+	TUInt32 paddedCount = (count + 3) & ~3u;
+	m_W.resize( paddedCount, 1.0f );
+	m_X.resize( paddedCount, 0.0f );
+	m_Y.resize( paddedCount, 0.0f );
+	m_Z.resize( paddedCount, 0.0f );
+	m_Count = count;
+}
+
+// Add a quaternion, returns its index
+TUInt32 CQuaternionList::Add( const CQuaternion& quat )
+{
+	// Grow arrays four entries at a time so they are always padded
+	if (m_Count == m_W.size())
+	{
+		m_W.resize( m_Count + 4, 1.0f );
+		m_X.resize( m_Count + 4, 0.0f );
+		m_Y.resize( m_Count + 4, 0.0f );
+		m_Z.resize( m_Count + 4, 0.0f );
+	}
+	Set( m_Count, quat );
+	return m_Count++;
+}
+
+
+/*---------------------------------------------------------------------------------------------
+	Helpers
+---------------------------------------------------------------------------------------------*/
+
+// Quaternions per job when a list is split over a job system - fewer are not worth queuing
+const TUInt32 kQuatsPerJob = 4096;
+
+// When the cosine of the angle between two quaternions is above this, slerp uses linear
+// interpolation to avoid dividing by a tiny sin(theta)
+const TFloat32 kSlerpLerpThreshold = 0.9999f;
+
+
+// Call kernel( first, end ) to process the quaternions in [first, end). With a job system, lists
+// large enough to be worth splitting are run as parallel jobs of kQuatsPerJob quaternions - a
+// multiple of four, so each job begins on a SIMD group. Otherwise the calling thread does it all
+template <class TKernel>
+void RunBatch
+(
+	const TUInt32  count,
+	CJobSystem*    pJobs,
+	const TKernel& kernel
+)
+{
+	if (!pJobs || count < 2 * kQuatsPerJob)
+	{
+		kernel( 0, count );
+		return;
+	}
+	pJobs->ParallelFor( count, kQuatsPerJob, kernel );
+}
+
+
+// Four quaternions in SIMD registers, one component per register
+struct SQuat4
+{
+	__m128 w, x, y, z;
+};
+
+inline SQuat4 LoadQuat4( const CQuaternionList& quats, const TUInt32 index )
+{
+	SQuat4 q;
+	q.w = _mm_load_ps( quats.W() + index );
+	q.x = _mm_load_ps( quats.X() + index );
+	q.y = _mm_load_ps( quats.Y() + index );
+	q.z = _mm_load_ps( quats.Z() + index );
+	return q;
+}
+
+inline void StoreQuat4( CQuaternionList& quats, const TUInt32 index, const SQuat4& q )
+{
+	_mm_store_ps( quats.W() + index, q.w );
+	_mm_store_ps( quats.X() + index, q.x );
+	_mm_store_ps( quats.Y() + index, q.y );
+	_mm_store_ps( quats.Z() + index, q.z );
+}
+
+inline __m128 Dot4( const SQuat4& q0, const SQuat4& q1 )
+{
+	return _mm_add_ps( _mm_add_ps( _mm_mul_ps( q0.w, q1.w ), _mm_mul_ps( q0.x, q1.x ) ),
+	                   _mm_add_ps( _mm_mul_ps( q0.y, q1.y ), _mm_mul_ps( q0.z, q1.z ) ) );
+}
+
+// Flip the sign of each quaternion in q where the matching lane of sign has its sign bit set
+inline SQuat4 FlipSign4( const SQuat4& q, const __m128 sign )
+{
+	SQuat4 result;
+	result.w = _mm_xor_ps( q.w, sign );
+	result.x = _mm_xor_ps( q.x, sign );
+	result.y = _mm_xor_ps( q.y, sign );
+	result.z = _mm_xor_ps( q.z, sign );
+	return result;
+}
+
+// Return w0*q0 + w1*q1
+inline SQuat4 WeightedSum4
+(
+	const SQuat4& q0,
+	const __m128  w0,
+	const SQuat4& q1,
+	const __m128  w1
+)
+{
+	SQuat4 result;
+	result.w = _mm_add_ps( _mm_mul_ps( q0.w, w0 ), _mm_mul_ps( q1.w, w1 ) );
+	result.x = _mm_add_ps( _mm_mul_ps( q0.x, w0 ), _mm_mul_ps( q1.x, w1 ) );
+	result.y = _mm_add_ps( _mm_mul_ps( q0.y, w0 ), _mm_mul_ps( q1.y, w1 ) );
+	result.z = _mm_add_ps( _mm_mul_ps( q0.z, w0 ), _mm_mul_ps( q1.z, w1 ) );
+	return result;
+}
+
+inline SQuat4 Normalise4( const SQuat4& q )
+{
+	__m128 invLength = _mm_div_ps( _mm_set1_ps( 1.0f ), _mm_sqrt_ps( Dot4( q, q ) ) );
+	SQuat4 result;
+	result.w = _mm_mul_ps( q.w, invLength );
+	result.x = _mm_mul_ps( q.x, invLength );
+	result.y = _mm_mul_ps( q.y, invLength );
+	result.z = _mm_mul_ps( q.z, invLength );
+	return result;
+}
+
+// Approximate acos for x in [0,1], maximum error 2e-8 (Abramowitz & Stegun 4.4.46)
+inline __m128 FastACos4( const __m128 x )
+{
+	__m128 poly = _mm_set1_ps( -0.0012624911f );
+	poly = _mm_add_ps( _mm_mul_ps( poly, x ), _mm_set1_ps(  0.0066700901f ) );
+	poly = _mm_add_ps( _mm_mul_ps( poly, x ), _mm_set1_ps( -0.0170881256f ) );
+	poly = _mm_add_ps( _mm_mul_ps( poly, x ), _mm_set1_ps(  0.0308918810f ) );
+	poly = _mm_add_ps( _mm_mul_ps( poly, x ), _mm_set1_ps( -0.0501743046f ) );
+	poly = _mm_add_ps( _mm_mul_ps( poly, x ), _mm_set1_ps(  0.0889789874f ) );
+	poly = _mm_add_ps( _mm_mul_ps( poly, x ), _mm_set1_ps( -0.2145988016f ) );
+	poly = _mm_add_ps( _mm_mul_ps( poly, x ), _mm_set1_ps(  1.5707963050f ) );
+	return _mm_mul_ps( _mm_sqrt_ps( _mm_sub_ps( _mm_set1_ps( 1.0f ), x ) ), poly );
+}
+
+// Approximate sin for x in [0,pi/2], maximum error 4e-6 (Taylor series to the x^9 term)
+inline __m128 FastSin4( const __m128 x )
+{
+	__m128 xSq = _mm_mul_ps( x, x );
+	__m128 poly = _mm_set1_ps( 1.0f / 362880.0f );
+	poly = _mm_add_ps( _mm_mul_ps( poly, xSq ), _mm_set1_ps( -1.0f / 5040.0f ) );
+	poly = _mm_add_ps( _mm_mul_ps( poly, xSq ), _mm_set1_ps(  1.0f / 120.0f ) );
+	poly = _mm_add_ps( _mm_mul_ps( poly, xSq ), _mm_set1_ps( -1.0f / 6.0f ) );
+	poly = _mm_add_ps( _mm_mul_ps( poly, xSq ), _mm_set1_ps(  1.0f ) );
+	return _mm_mul_ps( poly, x );
+}
+
+// Select a where mask is set, otherwise b
+inline __m128 Select4
+(
+	const __m128 mask,
+	const __m128 a,
+	const __m128 b
+)
+{
+	return _mm_or_ps( _mm_and_ps( mask, a ), _mm_andnot_ps( mask, b ) );
+}
+
+
+/*---------------------------------------------------------------------------------------------
+	Batch Operations
+---------------------------------------------------------------------------------------------*/
+
+// Normalised linear interpolation of each pair of quaternions from q0 and q1, with parameter t
+void NLerp
+(
+	const CQuaternionList& q0,
+	const CQuaternionList& q1,
+	const TFloat32         t,
+	CQuaternionList&       qt,
+	CJobSystem*            pJobs /*= 0*/
+)
+{
+	GEN_GUARD_OPT;
+	GEN_ASSERT_OPT( q0.Size() == q1.Size(), "Quaternion lists are different sizes" );
+
+	const TUInt32 count = q0.Size();
+	qt.Resize( count );
+
+	const __m128 t0 = _mm_set1_ps( 1.0f - t );
+	const __m128 t1 = _mm_set1_ps( t );
+	const __m128 signMask = _mm_set1_ps( -0.0f );
+	RunBatch( count, pJobs, [&]( const TUInt32 first, const TUInt32 end )
+	{
+		for (TUInt32 i = first; i < end; i += 4)
+		{
+			SQuat4 a = LoadQuat4( q0, i );
+			SQuat4 b = LoadQuat4( q1, i );
+
+			// Take the shorter route - negate b where the dot product is negative
+			b = FlipSign4( b, _mm_and_ps( Dot4( a, b ), signMask ) );
+
+			StoreQuat4( qt, i, Normalise4( WeightedSum4( a, t0, b, t1 ) ) );
+		}
+	} );
+
+	GEN_ENDGUARD_OPT;
+}
+
+// Spherical linear interpolation of each pair of quaternions from q0 and q1, with parameter t
+void Slerp
+(
+	const CQuaternionList& q0,
+	const CQuaternionList& q1,
+	const TFloat32         t,
+	CQuaternionList&       qt,
+	CJobSystem*            pJobs /*= 0*/
+)
+{
+	GEN_GUARD_OPT;
+	GEN_ASSERT_OPT( q0.Size() == q1.Size(), "Quaternion lists are different sizes" );
+
+	const TUInt32 count = q0.Size();
+	qt.Resize( count );
+
+	const __m128 one = _mm_set1_ps( 1.0f );
+	const __m128 t0 = _mm_set1_ps( 1.0f - t );
+	const __m128 t1 = _mm_set1_ps( t );
+	const __m128 signMask = _mm_set1_ps( -0.0f );
+	const __m128 lerpThreshold = _mm_set1_ps( kSlerpLerpThreshold );
+	RunBatch( count, pJobs, [&]( const TUInt32 first, const TUInt32 end )
+	{
+		for (TUInt32 i = first; i < end; i += 4)
+		{
+			SQuat4 a = LoadQuat4( q0, i );
+			SQuat4 b = LoadQuat4( q1, i );
+
+			// Take the shorter route - negate b where the dot product is negative, which also
+			// makes the cosine positive so theta is in [0,pi/2] for the approximations
+			__m128 cosTheta = Dot4( a, b );
+			__m128 sign = _mm_and_ps( cosTheta, signMask );
+			b = FlipSign4( b, sign );
+			cosTheta = _mm_min_ps( _mm_xor_ps( cosTheta, sign ), one );
+
+			// Slerp weights: sin((1-t)*theta) / sin(theta) and sin(t*theta) / sin(theta)
+			__m128 theta = FastACos4( cosTheta );
+			__m128 invSinTheta = _mm_div_ps( one, FastSin4( theta ) );
+			__m128 w0 = _mm_mul_ps( FastSin4( _mm_mul_ps( t0, theta ) ), invSinTheta );
+			__m128 w1 = _mm_mul_ps( FastSin4( _mm_mul_ps( t1, theta ) ), invSinTheta );
+
+			// Small angles - use lerp weights instead (also replaces any infinities from above)
+			__m128 useLerp = _mm_cmpgt_ps( cosTheta, lerpThreshold );
+			w0 = Select4( useLerp, t0, w0 );
+			w1 = Select4( useLerp, t1, w1 );
+
+			StoreQuat4( qt, i, Normalise4( WeightedSum4( a, w0, b, w1 ) ) );
+		}
+	} );
+
+	GEN_ENDGUARD_OPT;
+}
+
+// Weighted blend of several lists of quaternions, normalised
+void Blend
+(
+	const CQuaternionList* const* ppSources,
+	const TFloat32*               pWeights,
+	const TUInt32                 numSources,
+	CQuaternionList&              result,
+	CJobSystem*                   pJobs /*= 0*/
+)
+{
+	GEN_GUARD_OPT;
+	GEN_ASSERT_OPT( ppSources && pWeights && numSources > 0, "Invalid parameter" );
+
+	const TUInt32 count = ppSources[0]->Size();
+	for (TUInt32 source = 1; source < numSources; ++source)
+	{
+		GEN_ASSERT_OPT( ppSources[source]->Size() == count, "Quaternion lists are different sizes" );
+		GEN_ASSERT_OPT( ppSources[source] != &result, "Result list can only be the first source" );
+	}
+	result.Resize( count );
+
+	const __m128 signMask = _mm_set1_ps( -0.0f );
+	const __m128 zero = _mm_setzero_ps();
+	RunBatch( count, pJobs, [&]( const TUInt32 first, const TUInt32 end )
+	{
+		for (TUInt32 i = first; i < end; i += 4)
+		{
+			SQuat4 base = LoadQuat4( *ppSources[0], i );
+			SQuat4 sum = WeightedSum4( base, _mm_set1_ps( pWeights[0] ), base, zero );
+			for (TUInt32 source = 1; source < numSources; ++source)
+			{
+				// Align each source with the first before adding it
+				SQuat4 q = LoadQuat4( *ppSources[source], i );
+				q = FlipSign4( q, _mm_and_ps( Dot4( base, q ), signMask ) );
+				sum = WeightedSum4( sum, _mm_set1_ps( 1.0f ), q, _mm_set1_ps( pWeights[source] ) );
+			}
+			StoreQuat4( result, i, Normalise4( sum ) );
+		}
+	} );
+
+	GEN_ENDGUARD_OPT;
+}
+
+// Convert each quaternion to a rotation matrix with optional translation
+void ToMatrices
+(
+	const CQuaternionList& quats,
+	const CVector3*        pPositions,
+	CMatrix4x4*            pMatrices,
+	CJobSystem*            pJobs /*= 0*/
+)
+{
+	GEN_GUARD_OPT;
+	GEN_ASSERT_OPT( pMatrices, "Invalid parameter" );
+
+	const TUInt32 count = quats.Size();
+	const __m128 one = _mm_set1_ps( 1.0f );
+	const __m128 two = _mm_set1_ps( 2.0f );
+	RunBatch( count, pJobs, [&]( const TUInt32 first, const TUInt32 end )
+	{
+		for (TUInt32 i = first; i < end; i += 4)
+		{
+			// Same calculation as CMatrix4x4::MakeAffineQuaternion, four quaternions at a time
+			SQuat4 q = LoadQuat4( quats, i );
+			__m128 xx = _mm_mul_ps( two, q.x );
+			__m128 yy = _mm_mul_ps( two, q.y );
+			__m128 zz = _mm_mul_ps( two, q.z );
+			__m128 xy = _mm_mul_ps( xx, q.y );
+			__m128 yz = _mm_mul_ps( yy, q.z );
+			__m128 zx = _mm_mul_ps( zz, q.x );
+			__m128 wx = _mm_mul_ps( q.w, xx );
+			__m128 wy = _mm_mul_ps( q.w, yy );
+			__m128 wz = _mm_mul_ps( q.w, zz );
+			xx = _mm_mul_ps( xx, q.x );
+			yy = _mm_mul_ps( yy, q.y );
+			zz = _mm_mul_ps( zz, q.z );
+
+			// Each register holds one matrix element for four matrices. Transposing each set of
+			// four gives a matrix row for each of the four matrices
+			__m128 row0 = _mm_sub_ps( _mm_sub_ps( one, yy ), zz );
+			__m128 row1 = _mm_add_ps( xy, wz );
+			__m128 row2 = _mm_sub_ps( zx, wy );
+			__m128 row3 = _mm_setzero_ps();
+			_MM_TRANSPOSE4_PS( row0, row1, row2, row3 );
+			__m128 rows0[4] = { row0, row1, row2, row3 };
+
+			row0 = _mm_sub_ps( xy, wz );
+			row1 = _mm_sub_ps( _mm_sub_ps( one, xx ), zz );
+			row2 = _mm_add_ps( yz, wx );
+			row3 = _mm_setzero_ps();
+			_MM_TRANSPOSE4_PS( row0, row1, row2, row3 );
+			__m128 rows1[4] = { row0, row1, row2, row3 };
+
+			row0 = _mm_add_ps( zx, wy );
+			row1 = _mm_sub_ps( yz, wx );
+			row2 = _mm_sub_ps( _mm_sub_ps( one, xx ), yy );
+			row3 = _mm_setzero_ps();
+			_MM_TRANSPOSE4_PS( row0, row1, row2, row3 );
+			__m128 rows2[4] = { row0, row1, row2, row3 };
+
+			// Write only the real matrices, not the padding
+			TUInt32 numValid = (end - i < 4) ? end - i : 4;
+			for (TUInt32 matrix = 0; matrix < numValid; ++matrix)
+			{
+				CMatrix4x4& m = pMatrices[i + matrix];
+				_mm_storeu_ps( &m.e00, rows0[matrix] );
+				_mm_storeu_ps( &m.e10, rows1[matrix] );
+				_mm_storeu_ps( &m.e20, rows2[matrix] );
+				if (pPositions)
+				{
+					const CVector3& position = pPositions[i + matrix];
+					m.e30 = position.x;
+					m.e31 = position.y;
+					m.e32 = position.z;
+				}
+				else
+				{
+					m.e30 = m.e31 = m.e32 = 0.0f;
+				}
+				m.e33 = 1.0f;
+			}
+		}
+	} );
+
+	GEN_ENDGUARD_OPT;
+}
+
+
+} // namespace gen
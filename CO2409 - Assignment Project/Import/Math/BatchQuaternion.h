@@ -0,0 +1,160 @@
+/*******************************************
+	BatchQuaternion.h
+
+	Structure-of-arrays lists of quaternions,
+	and SIMD interpolation, blending and matrix
+	conversion of whole lists at once
+********************************************/
+
+// Animating many characters means blending thousands of bone rotations each frame. These
+// functions do the same job as Lerp/NLerp/Slerp in CQuaternion.h but for whole arrays of bones,
+// four quaternions per SSE step. Large lists can also be split into jobs on a job system. Slerp
+// uses polynomial approximations to acos and sin (maximum error 4e-6, from the sin) rather than
+// the C library functions, and all results are normalised
+
+#ifndef GEN_BATCH_QUATERNION_H_INCLUDED
+#define GEN_BATCH_QUATERNION_H_INCLUDED
+
+#include <vector>
+using namespace std;
+
+#include "GenDefines.h"
+#include "AlignedAllocator.h"
+#include "CQuaternion.h"
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+#include "BatchCulling.h" // TAlignedFloats
+
+namespace gen
+{
+
+class CJobSystem;
+
+/*---------------------------------------------------------------------------------------------
+	Quaternion List
+---------------------------------------------------------------------------------------------*/
+
+// List of quaternions in structure-of-arrays form. Arrays are padded to a multiple of four
+// entries - the padding holds identity quaternions
+class CQuaternionList
+{
+// Concrete class - public access
+public:
+	CQuaternionList() : m_Count( 0 ) {}
+
+	// Construct with the given number of identity quaternions
+	explicit CQuaternionList( const TUInt32 count ) : m_Count( 0 )
+	{
+		Resize( count );
+	}
+
+	// Number of quaternions in the list
+	TUInt32 Size() const
+	{
+		return m_Count;
+	}
+
+	// Remove all quaternions
+	void Clear();
+
+	// Reserve space for the given number of quaternions
+	void Reserve( const TUInt32 count );
+
+	// Change the number of quaternions, new entries are set to the identity
+	void Resize( const TUInt32 count );
+
+	// Add a quaternion, returns its index
+	TUInt32 Add( const CQuaternion& quat );
+
+	// Replace the quaternion at the given index
+	void Set( const TUInt32 index, const CQuaternion& quat )
+	{
+		m_W[index] = quat.w;
+		m_X[index] = quat.x;
+		m_Y[index] = quat.y;
+		m_Z[index] = quat.z;
+	}
+
+	// Return the quaternion at the given index
+	CQuaternion Get( const TUInt32 index ) const
+	{
+		return CQuaternion( m_W[index], m_X[index], m_Y[index], m_Z[index] );
+	}
+
+	// Component arrays - 16-byte aligned and padded to a multiple of four (not valid if list is empty)
+	const TFloat32* W() const { return m_W.data(); }
+	const TFloat32* X() const { return m_X.data(); }
+	const TFloat32* Y() const { return m_Y.data(); }
+	const TFloat32* Z() const { return m_Z.data(); }
+	TFloat32* W() { return m_W.data(); }
+	TFloat32* X() { return m_X.data(); }
+	TFloat32* Y() { return m_Y.data(); }
+	TFloat32* Z() { return m_Z.data(); }
+
+private:
+	TAlignedFloats m_W;
+	TAlignedFloats m_X;
+	TAlignedFloats m_Y;
+	TAlignedFloats m_Z;
+	TUInt32        m_Count;
+};
+
+
+/*---------------------------------------------------------------------------------------------
+	Batch Operations
+---------------------------------------------------------------------------------------------*/
+// Each function processes every quaternion in its input lists, which must all be the same size.
+// The result list is resized to match and may be the same object as an input. The input
+// quaternions must be normalised. Unlike the scalar NLerp, all these functions take the shorter
+// route between each pair of quaternions, which is what animation blending needs.
+//
+// If a job system is given, large lists are split into parallel jobs. Without one, or for small
+// lists, the calling thread does all the work
+
+// Normalised linear interpolation of each pair of quaternions from q0 and q1, with parameter t
+void NLerp
+(
+	const CQuaternionList& q0,
+	const CQuaternionList& q1,
+	const TFloat32         t,
+	CQuaternionList&       qt,
+	CJobSystem*            pJobs = 0
+);
+
+// Spherical linear interpolation of each pair of quaternions from q0 and q1, with parameter t
+void Slerp
+(
+	const CQuaternionList& q0,
+	const CQuaternionList& q1,
+	const TFloat32         t,
+	CQuaternionList&       qt,
+	CJobSystem*            pJobs = 0
+);
+
+// Weighted blend of several lists of quaternions (e.g. several animations playing at once),
+// normalised. Each list is aligned to the same hemisphere as the first before it is added. The
+// weights need not sum to one
+void Blend
+(
+	const CQuaternionList* const* ppSources,
+	const TFloat32*               pWeights,
+	const TUInt32                 numSources,
+	CQuaternionList&              result,
+	CJobSystem*                   pJobs = 0
+);
+
+// Convert each quaternion to a rotation matrix, written to the given array (which must have
+// space for Size() matrices). If pPositions is not NULL, each matrix also gets the matching
+// position as its translation - see CMatrix4x4::MakeAffineQuaternion
+void ToMatrices
+(
+	const CQuaternionList& quats,
+	const CVector3*        pPositions,
+	CMatrix4x4*            pMatrices,
+	CJobSystem*            pJobs = 0
+);
+
+
+} // namespace gen
+
+#endif // GEN_BATCH_QUATERNION_H_INCLUDED
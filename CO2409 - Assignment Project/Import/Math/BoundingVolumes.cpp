@@ -0,0 +1,133 @@
+/*******************************************
+	BoundingVolumes.cpp
+
+	Planes and simple bounding volumes -
+	spheres, axis-aligned boxes and oriented
+	boxes - for culling and intersection tests
+********************************************/
+
+#include "BoundingVolumes.h"
+
+#include "Error.h"
+
+namespace gen
+{
+
+/*---------------------------------------------------------------------------------------------
+	CPlane
+---------------------------------------------------------------------------------------------*/
+
+// Make the normal unit length, scaling the distance to match
+void CPlane::Normalise()
+{
+	GEN_GUARD_OPT;
+
+	TFloat32 lengthSq = normal.LengthSquared();
+	GEN_ASSERT_OPT( !IsZero( lengthSq ), "Zero length plane normal" );
+
+	TFloat32 invLength = InvSqrt( lengthSq );
+	normal *= invLength;
+	d *= invLength;
+
+	GEN_ENDGUARD_OPT;
+}
+
+
+/*---------------------------------------------------------------------------------------------
+	CSphere
+---------------------------------------------------------------------------------------------*/
+
+// Return this sphere transformed by the given affine matrix
+CSphere CSphere::Transform( const CMatrix4x4& m ) const
+{
+	TFloat32 maxScaleSq = Max( Max( m.e00*m.e00 + m.e01*m.e01 + m.e02*m.e02,
+	                                m.e10*m.e10 + m.e11*m.e11 + m.e12*m.e12 ),
+	                                m.e20*m.e20 + m.e21*m.e21 + m.e22*m.e22 );
+	return CSphere( m.TransformPoint( centre ), radius * Sqrt( maxScaleSq ) );
+}
+
+
+/*---------------------------------------------------------------------------------------------
+	CAABB
+---------------------------------------------------------------------------------------------*/
+
+// Construct the smallest box enclosing the given array of points
+CAABB::CAABB
+(
+	const CVector3* pPoints,
+	const TUInt32   numPoints
+)
+{
+	GEN_GUARD_OPT;
+	GEN_ASSERT_OPT( pPoints && numPoints > 0, "Invalid parameter" );
+
+	minPt = maxPt = pPoints[0];
+	for (TUInt32 point = 1; point < numPoints; ++point)
+	{
+		Expand( pPoints[point] );
+	}
+
+	GEN_ENDGUARD_OPT;
+}
+
+// Grow the box to include the given point
+void CAABB::Expand( const CVector3& p )
+{
+	if (p.x < minPt.x) minPt.x = p.x;
+	if (p.y < minPt.y) minPt.y = p.y;
+	if (p.z < minPt.z) minPt.z = p.z;
+	if (p.x > maxPt.x) maxPt.x = p.x;
+	if (p.y > maxPt.y) maxPt.y = p.y;
+	if (p.z > maxPt.z) maxPt.z = p.z;
+}
+
+// Grow the box to include another box
+void CAABB::Merge( const CAABB& box )
+{
+	Expand( box.minPt );
+	Expand( box.maxPt );
+}
+
+// Return the axis-aligned box enclosing this box transformed by the given affine matrix
+CAABB CAABB::Transform( const CMatrix4x4& m ) const
+{
+	// Method: transform the centre, then the world-space extent along each axis is the sum of the
+	// absolute contributions of each (scaled) local axis - avoids transforming all eight corners
+	CVector3 centre = m.TransformPoint( GetCentre() );
+	CVector3 localExtents = GetExtents();
+	CVector3 extents
+	(
+		Abs( m.e00 ) * localExtents.x + Abs( m.e10 ) * localExtents.y + Abs( m.e20 ) * localExtents.z,
+		Abs( m.e01 ) * localExtents.x + Abs( m.e11 ) * localExtents.y + Abs( m.e21 ) * localExtents.z,
+		Abs( m.e02 ) * localExtents.x + Abs( m.e12 ) * localExtents.y + Abs( m.e22 ) * localExtents.z
+	);
+	return CAABB( centre - extents, centre + extents );
+}
+
+
+/*---------------------------------------------------------------------------------------------
+	COBB
+---------------------------------------------------------------------------------------------*/
+
+// Construct from an axis-aligned box in model space and an affine world matrix
+COBB::COBB
+(
+	const CAABB&      box,
+	const CMatrix4x4& m
+)
+{
+	centre = m.TransformPoint( box.GetCentre() );
+
+	// Matrix rows are the (scaled) world axes of the box - separate into unit axes and scale
+	CVector3 localExtents = box.GetExtents();
+	TFloat32 scaleX = Sqrt( m.e00*m.e00 + m.e01*m.e01 + m.e02*m.e02 );
+	TFloat32 scaleY = Sqrt( m.e10*m.e10 + m.e11*m.e11 + m.e12*m.e12 );
+	TFloat32 scaleZ = Sqrt( m.e20*m.e20 + m.e21*m.e21 + m.e22*m.e22 );
+	axes[0] = CVector3( m.e00, m.e01, m.e02 ) / scaleX;
+	axes[1] = CVector3( m.e10, m.e11, m.e12 ) / scaleY;
+	axes[2] = CVector3( m.e20, m.e21, m.e22 ) / scaleZ;
+	extents = CVector3( localExtents.x * scaleX, localExtents.y * scaleY, localExtents.z * scaleZ );
+}
+
+
+} // namespace gen
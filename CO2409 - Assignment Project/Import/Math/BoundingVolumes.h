@@ -0,0 +1,233 @@
+/*******************************************
+	BoundingVolumes.h
+
+	Planes and simple bounding volumes -
+	spheres, axis-aligned boxes and oriented
+	boxes - for culling and intersection tests
+********************************************/
+
+// Conventions: a plane is stored as a normal and distance such that points p on the plane satisfy
+// Dot( normal, p ) + d = 0. Points with a positive distance are on the "inside" of the plane - the
+// side the normal points to. Frustum and cone volumes are in CFrustum.h and CCone.h
+
+#ifndef GEN_BOUNDING_VOLUMES_H_INCLUDED
+#define GEN_BOUNDING_VOLUMES_H_INCLUDED
+
+#include "GenDefines.h"
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+
+namespace gen
+{
+
+// Result of testing a volume against another (e.g. a sphere against a frustum)
+enum EIntersection
+{
+	kOutside      = 0,
+	kIntersecting = 1,
+	kInside       = 2,
+};
+
+
+/*---------------------------------------------------------------------------------------------
+	CPlane
+---------------------------------------------------------------------------------------------*/
+
+class CPlane
+{
+// Concrete class - public access
+public:
+	// Default constructor - leaves values uninitialised (for performance)
+	CPlane() {}
+
+	// Construct from normal and distance - normal need not be unit length but must be for the
+	// Distance function to return true distances
+	CPlane
+	(
+		const CVector3& normalIn,
+		const TFloat32  dIn
+	) : normal( normalIn ), d( dIn ) {}
+
+	// Construct from a point on the plane and a normal
+	CPlane
+	(
+		const CVector3& normalIn,
+		const CVector3& point
+	) : normal( normalIn ), d( -Dot( normalIn, point ) ) {}
+
+
+	// Make the normal unit length, scaling the distance to match
+	void Normalise();
+
+	// Signed distance from the plane to the given point, positive on the side the normal faces
+	TFloat32 Distance( const CVector3& p ) const
+	{
+		return normal.x*p.x + normal.y*p.y + normal.z*p.z + d;
+	}
+
+
+	// Plane normal and distance
+	CVector3 normal;
+	TFloat32 d;
+};
+
+
+/*---------------------------------------------------------------------------------------------
+	CSphere
+---------------------------------------------------------------------------------------------*/
+
+class CSphere
+{
+// Concrete class - public access
+public:
+	// Default constructor - leaves values uninitialised (for performance)
+	CSphere() {}
+
+	// Construct by value
+	CSphere
+	(
+		const CVector3& centreIn,
+		const TFloat32  radiusIn
+	) : centre( centreIn ), radius( radiusIn ) {}
+
+
+	// Return this sphere transformed by the given affine matrix. A non-uniform scale makes the
+	// result an ellipsoid, so the largest scale is used to give an enclosing sphere
+	CSphere Transform( const CMatrix4x4& m ) const;
+
+	// Test if this sphere intersects another
+	bool Intersects( const CSphere& s ) const
+	{
+		TFloat32 radii = radius + s.radius;
+		return DistanceSquared( centre, s.centre ) <= radii * radii;
+	}
+
+
+	// Sphere centre and radius
+	CVector3 centre;
+	TFloat32 radius;
+};
+
+
+/*---------------------------------------------------------------------------------------------
+	CAABB
+---------------------------------------------------------------------------------------------*/
+
+// Axis-aligned bounding box
+class CAABB
+{
+// Concrete class - public access
+public:
+	// Default constructor - leaves values uninitialised (for performance)
+	CAABB() {}
+
+	// Construct from minimum and maximum corners
+	CAABB
+	(
+		const CVector3& minIn,
+		const CVector3& maxIn
+	) : minPt( minIn ), maxPt( maxIn ) {}
+
+	// Construct the smallest box enclosing the given array of points
+	CAABB
+	(
+		const CVector3* pPoints,
+		const TUInt32   numPoints
+	);
+
+
+	// Centre of the box
+	CVector3 GetCentre() const
+	{
+		return (minPt + maxPt) * 0.5f;
+	}
+
+	// Half-size of the box along each axis
+	CVector3 GetExtents() const
+	{
+		return (maxPt - minPt) * 0.5f;
+	}
+
+	// Sphere enclosing this box
+	CSphere GetBoundingSphere() const
+	{
+		return CSphere( GetCentre(), Length( GetExtents() ) );
+	}
+
+	// Total area of the box's faces
+	TFloat32 GetSurfaceArea() const
+	{
+		CVector3 size = maxPt - minPt;
+		return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+
+	// Grow the box to include the given point
+	void Expand( const CVector3& p );
+
+	// Grow the box to include another box
+	void Merge( const CAABB& box );
+
+	// Return the axis-aligned box enclosing this box transformed by the given affine matrix
+	CAABB Transform( const CMatrix4x4& m ) const;
+
+	// Test if this box intersects another
+	bool Intersects( const CAABB& box ) const
+	{
+		return minPt.x <= box.maxPt.x && maxPt.x >= box.minPt.x &&
+		       minPt.y <= box.maxPt.y && maxPt.y >= box.minPt.y &&
+		       minPt.z <= box.maxPt.z && maxPt.z >= box.minPt.z;
+	}
+
+
+	// Minimum and maximum corners
+	CVector3 minPt;
+	CVector3 maxPt;
+};
+
+
+/*---------------------------------------------------------------------------------------------
+	COBB
+---------------------------------------------------------------------------------------------*/
+
+// Oriented bounding box
+class COBB
+{
+// Concrete class - public access
+public:
+	// Default constructor - leaves values uninitialised (for performance)
+	COBB() {}
+
+	// Construct from an axis-aligned box in model space and an affine world matrix
+	COBB
+	(
+		const CAABB&      box,
+		const CMatrix4x4& m
+	);
+
+
+	// Half-length of the box's projection onto the given (unit) direction
+	TFloat32 ProjectedRadius( const CVector3& dir ) const
+	{
+		return Abs( Dot( axes[0], dir ) ) * extents.x +
+		       Abs( Dot( axes[1], dir ) ) * extents.y +
+		       Abs( Dot( axes[2], dir ) ) * extents.z;
+	}
+
+	// Sphere enclosing this box
+	CSphere GetBoundingSphere() const
+	{
+		return CSphere( centre, Length( extents ) );
+	}
+
+
+	// Centre, unit axes and half-size along each axis
+	CVector3 centre;
+	CVector3 axes[3];
+	CVector3 extents;
+};
+
+
+} // namespace gen
+
+#endif // GEN_BOUNDING_VOLUMES_H_INCLUDED
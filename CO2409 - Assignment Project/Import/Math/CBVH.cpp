@@ -0,0 +1,551 @@
+/*******************************************
+	CBVH.cpp
+
+	Bounding volume hierarchy - a binary tree
+	of axis-aligned boxes over a set of items,
+	for culling and ray queries
+********************************************/
+
+#include "CBVH.h"
+
+#include <algorithm> // partition
+
+namespace gen
+{
+
+/*---------------------------------------------------------------------------------------------
+	Constants / Helpers
+---------------------------------------------------------------------------------------------*/
+
+// Relative costs of visiting a node and testing an item, used by the surface area heuristic
+const TFloat32 kNodeCost = 1.0f;
+const TFloat32 kItemCost = 1.0f;
+
+// Number of bins along each axis when choosing a split - the heuristic is evaluated at each bin
+// boundary rather than at every item
+const TUInt32 kNumSplitBins = 12;
+
+// Nodes with more items than this are always split, even if the heuristic prefers a leaf
+const TUInt32 kMaxLeafItems = 8;
+
+
+// Test a ray against a box using the slab method. Takes the reciprocal of the ray direction.
+// Returns the distance along the ray to the box (0 if starting inside) if hit within maxDistance
+inline bool RayHitsBox
+(
+	const CAABB&    box,
+	const CVector3& origin,
+	const CVector3& invDirection,
+	const TFloat32  maxDistance,
+	TFloat32*       pDistance
+)
+{
+	TFloat32 tMin = 0.0f;
+	TFloat32 tMax = maxDistance;
+	for (TUInt32 axis = 0; axis < 3; ++axis)
+	{
+		TFloat32 t1 = (box.minPt[axis] - origin[axis]) * invDirection[axis];
+		TFloat32 t2 = (box.maxPt[axis] - origin[axis]) * invDirection[axis];
+		if (t1 > t2)
+		{
+			TFloat32 temp = t1;
+			t1 = t2;
+			t2 = temp;
+		}
+		tMin = Max( tMin, t1 );
+		tMax = Min( tMax, t2 );
+		if (tMin > tMax)
+		{
+			return false;
+		}
+	}
+	*pDistance = tMin;
+	return true;
+}
+
+// Reciprocal of a ray direction for RayHitsBox. Zero components give infinities, which the slab
+// test handles correctly
+inline CVector3 InverseDirection( const CVector3& direction )
+{
+	return CVector3( 1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z );
+}
+
+
+/*---------------------------------------------------------------------------------------------
+	Construction / Update
+---------------------------------------------------------------------------------------------*/
+
+// Build the tree from scratch over the given item boxes
+void CBVH::Build
+(
+	const CAABB*  pBoxes,
+	const TUInt32 numItems
+)
+{
+	Clear();
+	if (numItems == 0)
+	{
+		return;
+	}
+
+	m_ItemBoxes.assign( pBoxes, pBoxes + numItems );
+	m_ItemOrder.resize( numItems );
+	vector<CVector3> centres( numItems );
+	for (TUInt32 item = 0; item < numItems; ++item)
+	{
+		m_ItemOrder[item] = item;
+		centres[item] = pBoxes[item].GetCentre();
+	}
+
+	// A binary tree with one item per leaf has 2n - 1 nodes, so this reserve avoids reallocation
+	m_Nodes.reserve( 2 * numItems - 1 );
+	SNode root;
+	root.first = 0;
+	root.count = numItems;
+	m_Nodes.push_back( root );
+
+	// Split nodes top-down, using a stack of nodes still to be processed
+	vector<TUInt32> stack;
+	stack.push_back( 0 );
+	while (!stack.empty())
+	{
+		TUInt32 nodeIndex = stack.back();
+		stack.pop_back();
+		const TUInt32 first = m_Nodes[nodeIndex].first;
+		const TUInt32 count = m_Nodes[nodeIndex].count;
+
+		// Get bounds of the node's items, and of their centres (used to place the split bins)
+		CAABB box = m_ItemBoxes[m_ItemOrder[first]];
+		CAABB centreBounds( centres[m_ItemOrder[first]], centres[m_ItemOrder[first]] );
+		for (TUInt32 i = first + 1; i < first + count; ++i)
+		{
+			box.Merge( m_ItemBoxes[m_ItemOrder[i]] );
+			centreBounds.Expand( centres[m_ItemOrder[i]] );
+		}
+		m_Nodes[nodeIndex].box = box;
+		if (count == 1)
+		{
+			continue;
+		}
+
+		// Surface area heuristic: the cost of a split is the node cost plus the cost of testing
+		// the items in each child weighted by the chance of a query reaching that child (which
+		// is proportional to its surface area). Find the cheapest split at any bin boundary
+		TFloat32 bestCost = kItemCost * count * box.GetSurfaceArea(); // Cost of not splitting
+		TUInt32  bestAxis = 3;
+		TUInt32  bestBin = 0;
+		for (TUInt32 axis = 0; axis < 3; ++axis)
+		{
+			TFloat32 axisMin = centreBounds.minPt[axis];
+			TFloat32 axisExtent = centreBounds.maxPt[axis] - axisMin;
+			if (axisExtent <= 0.0f)
+			{
+				continue; // All centres the same along this axis - can't split it
+			}
+
+			// Put each item in a bin by its centre
+			CAABB   binBoxes[kNumSplitBins];
+			TUInt32 binCounts[kNumSplitBins] = { 0 };
+			TFloat32 binScale = kNumSplitBins / axisExtent;
+			for (TUInt32 i = first; i < first + count; ++i)
+			{
+				TUInt32 item = m_ItemOrder[i];
+				TUInt32 bin = Min( static_cast<TUInt32>((centres[item][axis] - axisMin) * binScale), kNumSplitBins - 1 );
+				if (binCounts[bin] == 0)
+				{
+					binBoxes[bin] = m_ItemBoxes[item];
+				}
+				else
+				{
+					binBoxes[bin].Merge( m_ItemBoxes[item] );
+				}
+				++binCounts[bin];
+			}
+
+			// Sweep from the right to get the area and count of everything above each boundary...
+			TFloat32 rightAreas[kNumSplitBins];
+			TUInt32  rightCounts[kNumSplitBins];
+			CAABB    rightBox;
+			TUInt32  rightCount = 0;
+			for (TUInt32 bin = kNumSplitBins - 1; bin > 0; --bin)
+			{
+				if (binCounts[bin] > 0)
+				{
+					if (rightCount == 0)  rightBox = binBoxes[bin];
+					else                  rightBox.Merge( binBoxes[bin] );
+					rightCount += binCounts[bin];
+				}
+				rightAreas[bin] = (rightCount > 0) ? rightBox.GetSurfaceArea() : 0.0f;
+				rightCounts[bin] = rightCount;
+			}
+
+			// ...then from the left, evaluating the cost of splitting below each boundary
+			CAABB   leftBox;
+			TUInt32 leftCount = 0;
+			for (TUInt32 bin = 0; bin < kNumSplitBins - 1; ++bin)
+			{
+				if (binCounts[bin] > 0)
+				{
+					if (leftCount == 0)  leftBox = binBoxes[bin];
+					else                 leftBox.Merge( binBoxes[bin] );
+					leftCount += binCounts[bin];
+				}
+				if (leftCount == 0 || rightCounts[bin + 1] == 0)
+				{
+					continue;
+				}
+				TFloat32 cost = kNodeCost * box.GetSurfaceArea() +
+				                kItemCost * (leftCount * leftBox.GetSurfaceArea() + rightCounts[bin + 1] * rightAreas[bin + 1]);
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = bin;
+				}
+			}
+		}
+
+		// Split the items into two ranges
+		TUInt32 middle;
+		if (bestAxis < 3)
+		{
+			const TUInt32  axis = bestAxis;
+			const TFloat32 axisMin = centreBounds.minPt[axis];
+			const TFloat32 binScale = kNumSplitBins / (centreBounds.maxPt[axis] - axisMin);
+			const TUInt32  lastLeftBin = bestBin;
+			TUInt32* pMiddle = std::partition( &m_ItemOrder[0] + first, &m_ItemOrder[0] + first + count, [&]( const TUInt32 item )
+			{
+				return Min( static_cast<TUInt32>((centres[item][axis] - axisMin) * binScale), kNumSplitBins - 1 ) <= lastLeftBin;
+			} );
+			middle = static_cast<TUInt32>(pMiddle - &m_ItemOrder[0]);
+		}
+		else if (count > kMaxLeafItems)
+		{
+			// A leaf is cheapest (or the items can't be separated) but there are too many items -
+			// split the range in half
+			middle = first + count / 2;
+		}
+		else
+		{
+			continue; // Leave as a leaf
+		}
+
+		// Create child nodes, this node no longer holds items directly
+		SNode child;
+		child.first = first;
+		child.count = middle - first;
+		m_Nodes.push_back( child );
+		child.first = middle;
+		child.count = first + count - middle;
+		m_Nodes.push_back( child );
+
+		m_Nodes[nodeIndex].first = static_cast<TUInt32>(m_Nodes.size()) - 2;
+		m_Nodes[nodeIndex].count = 0;
+		stack.push_back( m_Nodes[nodeIndex].first );
+		stack.push_back( m_Nodes[nodeIndex].first + 1 );
+	}
+
+	m_BuildCost = GetSAHCost();
+}
+
+// Remove all items
+void CBVH::Clear()
+{
+	m_Nodes.clear();
+	m_ItemOrder.clear();
+	m_ItemBoxes.clear();
+	m_BuildCost = 0.0f;
+}
+
+// Recalculate all node boxes from the item boxes, keeping the current tree structure
+void CBVH::Refit()
+{
+	// Children are always stored after their parent, so working backwards visits every child
+	// before its parent
+	for (TUInt32 nodeIndex = GetNumNodes(); nodeIndex-- > 0;)
+	{
+		SNode& node = m_Nodes[nodeIndex];
+		if (node.count > 0)
+		{
+			node.box = m_ItemBoxes[m_ItemOrder[node.first]];
+			for (TUInt32 i = node.first + 1; i < node.first + node.count; ++i)
+			{
+				node.box.Merge( m_ItemBoxes[m_ItemOrder[i]] );
+			}
+		}
+		else
+		{
+			node.box = m_Nodes[node.first].box;
+			node.box.Merge( m_Nodes[node.first + 1].box );
+		}
+	}
+}
+
+
+/*---------------------------------------------------------------------------------------------
+	Getters
+---------------------------------------------------------------------------------------------*/
+
+// Expected cost of a query on the current tree using the surface area heuristic
+TFloat32 CBVH::GetSAHCost() const
+{
+	if (m_Nodes.empty())
+	{
+		return 0.0f;
+	}
+
+	TFloat32 cost = 0.0f;
+	for (TUInt32 nodeIndex = 0; nodeIndex < GetNumNodes(); ++nodeIndex)
+	{
+		const SNode& node = m_Nodes[nodeIndex];
+		TFloat32 area = node.box.GetSurfaceArea();
+		cost += (node.count > 0) ? kItemCost * node.count * area : kNodeCost * area;
+	}
+	TFloat32 rootArea = m_Nodes[0].box.GetSurfaceArea();
+	return (rootArea > 0.0f) ? cost / rootArea : cost;
+}
+
+
+/*---------------------------------------------------------------------------------------------
+	Queries
+---------------------------------------------------------------------------------------------*/
+
+// Append all the items below the given node to the list, without any tests
+void CBVH::AddSubtree
+(
+	const TUInt32    node,
+	vector<TUInt32>& items
+) const
+{
+	// Inner nodes don't store the range of items below them, so recurse down to each leaf and
+	// append its items from m_ItemOrder
+	const SNode& n = m_Nodes[node];
+	if (n.count > 0)
+	{
+		items.insert( items.end(), m_ItemOrder.begin() + n.first, m_ItemOrder.begin() + n.first + n.count );
+	}
+	else
+	{
+		AddSubtree( n.first, items );
+		AddSubtree( n.first + 1, items );
+	}
+}
+
+// Find the items whose boxes are inside or intersecting the frustum
+void CBVH::Cull
+(
+	const CFrustum&  frustum,
+	vector<TUInt32>& items
+) const
+{
+	if (m_Nodes.empty())
+	{
+		return;
+	}
+
+	vector<TUInt32> stack;
+	stack.push_back( 0 );
+	while (!stack.empty())
+	{
+		const SNode& node = m_Nodes[stack.back()];
+		TUInt32 nodeIndex = stack.back();
+		stack.pop_back();
+
+		EIntersection result = frustum.Test( node.box );
+		if (result == kOutside)
+		{
+			continue;
+		}
+		if (result == kInside)
+		{
+			// Everything below is inside too
+			AddSubtree( nodeIndex, items );
+		}
+		else if (node.count > 0)
+		{
+			for (TUInt32 i = node.first; i < node.first + node.count; ++i)
+			{
+				if (frustum.Test( m_ItemBoxes[m_ItemOrder[i]] ) != kOutside)
+				{
+					items.push_back( m_ItemOrder[i] );
+				}
+			}
+		}
+		else
+		{
+			stack.push_back( node.first );
+			stack.push_back( node.first + 1 );
+		}
+	}
+}
+
+// Find the items whose boxes intersect the cone
+void CBVH::Cull
+(
+	const CCone&     cone,
+	vector<TUInt32>& items
+) const
+{
+	if (m_Nodes.empty())
+	{
+		return;
+	}
+
+	vector<TUInt32> stack;
+	stack.push_back( 0 );
+	while (!stack.empty())
+	{
+		const SNode& node = m_Nodes[stack.back()];
+		stack.pop_back();
+
+		if (!cone.Intersects( node.box ))
+		{
+			continue;
+		}
+		if (node.count > 0)
+		{
+			for (TUInt32 i = node.first; i < node.first + node.count; ++i)
+			{
+				if (cone.Intersects( m_ItemBoxes[m_ItemOrder[i]] ))
+				{
+					items.push_back( m_ItemOrder[i] );
+				}
+			}
+		}
+		else
+		{
+			stack.push_back( node.first );
+			stack.push_back( node.first + 1 );
+		}
+	}
+}
+
+// Find the item whose box is hit first by a ray, within the given distance
+bool CBVH::RayCast
+(
+	const CVector3& origin,
+	const CVector3& direction,
+	const TFloat32  maxDistance,
+	TUInt32*        pItem,
+	TFloat32*       pDistance
+) const
+{
+	const CVector3 invDirection = InverseDirection( direction );
+	TFloat32 distance;
+	if (m_Nodes.empty() || !RayHitsBox( m_Nodes[0].box, origin, invDirection, maxDistance, &distance ))
+	{
+		return false;
+	}
+
+	TFloat32 nearest = maxDistance;
+	bool hit = false;
+
+	// Stack holds nodes with their entry distance, so nodes further than the nearest hit found so
+	// far can be skipped. The nearer child is pushed last so it is visited first
+	vector< pair<TUInt32, TFloat32> > stack;
+	stack.push_back( make_pair( 0u, distance ) );
+	while (!stack.empty())
+	{
+		const SNode& node = m_Nodes[stack.back().first];
+		TFloat32 entryDistance = stack.back().second;
+		stack.pop_back();
+		if (entryDistance > nearest)
+		{
+			continue;
+		}
+
+		if (node.count > 0)
+		{
+			for (TUInt32 i = node.first; i < node.first + node.count; ++i)
+			{
+				if (RayHitsBox( m_ItemBoxes[m_ItemOrder[i]], origin, invDirection, nearest, &distance ))
+				{
+					nearest = distance;
+					*pItem = m_ItemOrder[i];
+					hit = true;
+				}
+			}
+		}
+		else
+		{
+			TFloat32 leftDistance, rightDistance;
+			bool hitLeft = RayHitsBox( m_Nodes[node.first].box, origin, invDirection, nearest, &leftDistance );
+			bool hitRight = RayHitsBox( m_Nodes[node.first + 1].box, origin, invDirection, nearest, &rightDistance );
+			if (hitLeft && hitRight)
+			{
+				if (leftDistance < rightDistance)
+				{
+					stack.push_back( make_pair( node.first + 1, rightDistance ) );
+					stack.push_back( make_pair( node.first, leftDistance ) );
+				}
+				else
+				{
+					stack.push_back( make_pair( node.first, leftDistance ) );
+					stack.push_back( make_pair( node.first + 1, rightDistance ) );
+				}
+			}
+			else if (hitLeft)
+			{
+				stack.push_back( make_pair( node.first, leftDistance ) );
+			}
+			else if (hitRight)
+			{
+				stack.push_back( make_pair( node.first + 1, rightDistance ) );
+			}
+		}
+	}
+
+	if (hit)
+	{
+		*pDistance = nearest;
+	}
+	return hit;
+}
+
+// Find all the items whose boxes are hit by a ray, within the given distance
+void CBVH::RayQuery
+(
+	const CVector3&  origin,
+	const CVector3&  direction,
+	const TFloat32   maxDistance,
+	vector<TUInt32>& items
+) const
+{
+	if (m_Nodes.empty())
+	{
+		return;
+	}
+
+	const CVector3 invDirection = InverseDirection( direction );
+	TFloat32 distance;
+	vector<TUInt32> stack;
+	stack.push_back( 0 );
+	while (!stack.empty())
+	{
+		const SNode& node = m_Nodes[stack.back()];
+		stack.pop_back();
+
+		if (!RayHitsBox( node.box, origin, invDirection, maxDistance, &distance ))
+		{
+			continue;
+		}
+		if (node.count > 0)
+		{
+			for (TUInt32 i = node.first; i < node.first + node.count; ++i)
+			{
+				if (RayHitsBox( m_ItemBoxes[m_ItemOrder[i]], origin, invDirection, maxDistance, &distance ))
+				{
+					items.push_back( m_ItemOrder[i] );
+				}
+			}
+		}
+		else
+		{
+			stack.push_back( node.first );
+			stack.push_back( node.first + 1 );
+		}
+	}
+}
+
+
+} // namespace gen
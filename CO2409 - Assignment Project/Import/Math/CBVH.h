@@ -0,0 +1,182 @@
+/*******************************************
+	CBVH.h
+
+	Bounding volume hierarchy - a binary tree
+	of axis-aligned boxes over a set of items,
+	for culling and ray queries
+********************************************/
+
+// Items are identified by their index in the array of boxes passed to Build. The tree is built
+// with the surface area heuristic (SAH), which gives good trees for culling and ray casting but
+// is relatively expensive. When items move, update their boxes with SetItemBox then call Refit,
+// which recalculates the node boxes bottom-up without changing the tree structure. Refitting is
+// much cheaper than building, but the tree gets worse as items move away from where they were
+// when it was built - GetDegradation measures this so the caller can choose when to rebuild.
+// Scenes typically keep static items in one tree (built once) and moving items in another
+
+#ifndef GEN_C_BVH_H_INCLUDED
+#define GEN_C_BVH_H_INCLUDED
+
+#include <vector>
+using namespace std;
+
+#include "GenDefines.h"
+#include "CVector3.h"
+#include "BoundingVolumes.h"
+#include "CFrustum.h"
+#include "CCone.h"
+
+namespace gen
+{
+
+class CBVH
+{
+// Concrete class - public access
+public:
+	/*-----------------------------------------------------------------------------------------
+		Constructors
+	-----------------------------------------------------------------------------------------*/
+
+	// Default constructor - empty tree
+	CBVH() : m_BuildCost( 0.0f ) {}
+
+
+	/*-----------------------------------------------------------------------------------------
+		Construction / Update
+	-----------------------------------------------------------------------------------------*/
+
+	// Build the tree from scratch over the given item boxes, replacing any existing tree
+	void Build
+	(
+		const CAABB*  pBoxes,
+		const TUInt32 numItems
+	);
+
+	// Remove all items
+	void Clear();
+
+	// Change the box of an item - call Refit after changing boxes to update the tree
+	void SetItemBox
+	(
+		const TUInt32 item,
+		const CAABB&  box
+	)
+	{
+		m_ItemBoxes[item] = box;
+	}
+
+	// Recalculate all node boxes from the item boxes, keeping the current tree structure
+	void Refit();
+
+
+	/*-----------------------------------------------------------------------------------------
+		Getters
+	-----------------------------------------------------------------------------------------*/
+
+	TUInt32 GetNumItems() const
+	{
+		return static_cast<TUInt32>(m_ItemBoxes.size());
+	}
+
+	TUInt32 GetNumNodes() const
+	{
+		return static_cast<TUInt32>(m_Nodes.size());
+	}
+
+	const CAABB& GetItemBox( const TUInt32 item ) const
+	{
+		return m_ItemBoxes[item];
+	}
+
+	// Expected cost of a query on the current tree using the surface area heuristic (relative
+	// value - only useful for comparing trees over the same items)
+	TFloat32 GetSAHCost() const;
+
+	// Current SAH cost divided by the cost when the tree was built. Starts at 1 and grows as
+	// refitted items move away from their original positions
+	TFloat32 GetDegradation() const
+	{
+		return (m_BuildCost > 0.0f) ? GetSAHCost() / m_BuildCost : 1.0f;
+	}
+
+
+	/*-----------------------------------------------------------------------------------------
+		Queries
+	-----------------------------------------------------------------------------------------*/
+	// Each query appends the indices of the matching items to the given list (it is not cleared
+	// first, so results from several trees can be collected together). Order is not defined
+
+	// Find the items whose boxes are inside or intersecting the frustum
+	void Cull
+	(
+		const CFrustum&  frustum,
+		vector<TUInt32>& items
+	) const;
+
+	// Find the items whose boxes intersect the cone (conservative - see CCone::Intersects)
+	void Cull
+	(
+		const CCone&     cone,
+		vector<TUInt32>& items
+	) const;
+
+	// Find the item whose box is hit first by a ray, within the given distance. The direction
+	// need not be unit length, distances are measured in multiples of it. Returns false if no
+	// item is hit, otherwise returns the item and distance to its box (0 if the ray starts inside)
+	bool RayCast
+	(
+		const CVector3& origin,
+		const CVector3& direction,
+		const TFloat32  maxDistance,
+		TUInt32*        pItem,
+		TFloat32*       pDistance
+	) const;
+
+	// Find all the items whose boxes are hit by a ray, within the given distance
+	void RayQuery
+	(
+		const CVector3&  origin,
+		const CVector3&  direction,
+		const TFloat32   maxDistance,
+		vector<TUInt32>& items
+	) const;
+
+
+/*-----------------------------------------------------------------------------------------
+	Private types / functions
+-----------------------------------------------------------------------------------------*/
+private:
+
+	// Tree node. Leaf nodes have count > 0 and hold items m_ItemOrder[first] to
+	// m_ItemOrder[first + count - 1]. Other nodes have count == 0 and two child nodes at indices
+	// first and first + 1. Children are always stored after their parent
+	struct SNode
+	{
+		CAABB   box;
+		TUInt32 first;
+		TUInt32 count;
+	};
+
+	// Append all the items below the given node to the list, without any tests
+	void AddSubtree
+	(
+		const TUInt32    node,
+		vector<TUInt32>& items
+	) const;
+
+
+/*-----------------------------------------------------------------------------------------
+	Data
+-----------------------------------------------------------------------------------------*/
+private:
+
+	vector<SNode>   m_Nodes;     // Root is node 0
+	vector<TUInt32> m_ItemOrder; // Item indices in leaf order
+	vector<CAABB>   m_ItemBoxes; // Indexed by item
+	TFloat32        m_BuildCost; // SAH cost when last built
+};
+
+
+} // namespace gen
+
+#endif // GEN_C_BVH_H_INCLUDED
@@ -0,0 +1,101 @@
+/*******************************************
+	CCone.cpp
+
+	Finite cone (e.g. the volume lit by a
+	spotlight) with tests against bounding
+	volumes
+********************************************/
+
+#include "CCone.h"
+
+#include "Error.h"
+
+namespace gen
+{
+
+/*-----------------------------------------------------------------------------------------
+	Constructors
+-----------------------------------------------------------------------------------------*/
+
+// Construct from apex, direction, half-angle and range
+CCone::CCone
+(
+	const CVector3& apexIn,
+	const CVector3& directionIn,
+	const TFloat32  fHalfAngle,
+	const TFloat32  fRange
+)
+{
+	Set( apexIn, directionIn, fHalfAngle, fRange );
+}
+
+// Set all cone values
+void CCone::Set
+(
+	const CVector3& apexIn,
+	const CVector3& directionIn,
+	const TFloat32  fHalfAngle,
+	const TFloat32  fRange
+)
+{
+	GEN_GUARD_OPT;
+	GEN_ASSERT_OPT( fHalfAngle > 0.0f && fHalfAngle < kfPi * 0.5f, "Cone angle out of range" );
+
+	apex = apexIn;
+	direction = Normalise( directionIn );
+	halfAngle = fHalfAngle;
+	range = fRange;
+	SinCos( fHalfAngle, &sinAngle, &cosAngle );
+
+	GEN_ENDGUARD_OPT;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+	Tests
+-----------------------------------------------------------------------------------------*/
+
+// Test if a point is inside the cone
+bool CCone::Contains( const CVector3& p ) const
+{
+	CVector3 toPoint = p - apex;
+	TFloat32 along = Dot( direction, toPoint );
+	return along >= 0.0f && along <= range && along * along >= toPoint.LengthSquared() * (cosAngle * cosAngle);
+}
+
+// Test if a sphere intersects the cone
+bool CCone::Intersects( const CSphere& sphere ) const
+{
+	// Method (Eberly, "Intersection of a Sphere and a Cone"): move the apex back along the axis
+	// so the cone's sides are pushed out by the sphere radius, then test the sphere centre
+	// against this larger cone. That is exact except behind the original apex, where the sphere
+	// must actually contain the apex to intersect
+	CVector3 toCentre = sphere.centre - apex;
+	TFloat32 along = Dot( direction, toCentre );
+
+	// Range test against the flat end of the cone
+	if (along - sphere.radius > range)
+	{
+		return false;
+	}
+
+	// Test against expanded cone, apex moved back by radius / sin(angle)
+	TFloat32 offset = sphere.radius / sinAngle;
+	TFloat32 expandedAlong = along + offset;
+	TFloat32 expandedDistSq = toCentre.LengthSquared() + 2.0f * along * offset + offset * offset;
+	if (expandedAlong <= 0.0f || expandedAlong * expandedAlong < expandedDistSq * (cosAngle * cosAngle))
+	{
+		return false;
+	}
+
+	// Region behind the apex (within the "anti-cone") - only intersects if sphere contains apex
+	TFloat32 distSq = toCentre.LengthSquared();
+	if (along < 0.0f && along * along >= distSq * (sinAngle * sinAngle))
+	{
+		return distSq <= sphere.radius * sphere.radius;
+	}
+	return true;
+}
+
+
+} // namespace gen
@@ -0,0 +1,86 @@
+/*******************************************
+	CCone.h
+
+	Finite cone (e.g. the volume lit by a
+	spotlight) with tests against bounding
+	volumes
+********************************************/
+
+#ifndef GEN_C_CONE_H_INCLUDED
+#define GEN_C_CONE_H_INCLUDED
+
+#include "GenDefines.h"
+#include "CVector3.h"
+#include "BoundingVolumes.h"
+
+namespace gen
+{
+
+class CCone
+{
+// Concrete class - public access
+public:
+	/*-----------------------------------------------------------------------------------------
+		Constructors
+	-----------------------------------------------------------------------------------------*/
+
+	// Default constructor - leaves values uninitialised (for performance)
+	CCone() {}
+
+	// Construct from apex, direction (need not be unit length), half-angle (radians, less than
+	// 90 degrees) and range (distance from apex to the flat end of the cone)
+	CCone
+	(
+		const CVector3& apex,
+		const CVector3& direction,
+		const TFloat32  fHalfAngle,
+		const TFloat32  fRange
+	);
+
+	// Set all cone values - see constructor
+	void Set
+	(
+		const CVector3& apex,
+		const CVector3& direction,
+		const TFloat32  fHalfAngle,
+		const TFloat32  fRange
+	);
+
+
+	/*-----------------------------------------------------------------------------------------
+		Tests
+	-----------------------------------------------------------------------------------------*/
+	// See BatchCulling.h for testing many volumes at once
+
+	// Test if a point is inside the cone
+	bool Contains( const CVector3& p ) const;
+
+	// Test if a sphere intersects the cone
+	bool Intersects( const CSphere& sphere ) const;
+
+	// Test if an axis-aligned box intersects the cone. Uses the box's bounding sphere, so is
+	// conservative - may return true for boxes near to but outside the cone
+	bool Intersects( const CAABB& box ) const
+	{
+		return Intersects( box.GetBoundingSphere() );
+	}
+
+
+	/*-----------------------------------------------------------------------------------------
+		Data
+	-----------------------------------------------------------------------------------------*/
+
+	CVector3 apex;
+	CVector3 direction; // Unit length
+	TFloat32 halfAngle;
+	TFloat32 range;
+
+	// Values derived from the half-angle, used in the tests
+	TFloat32 sinAngle;
+	TFloat32 cosAngle;
+};
+
+
+} // namespace gen
+
+#endif // GEN_C_CONE_H_INCLUDED
@@ -0,0 +1,131 @@
+/*******************************************
+	CFrustum.cpp
+
+	View frustum - six planes facing inwards,
+	extracted from a view-projection matrix,
+	with tests against bounding volumes
+********************************************/
+
+#include "CFrustum.h"
+
+namespace gen
+{
+
+/*-----------------------------------------------------------------------------------------
+	Constructors
+-----------------------------------------------------------------------------------------*/
+
+// Construct from a combined view-projection matrix
+CFrustum::CFrustum( const CMatrix4x4& viewProj )
+{
+	Set( viewProj );
+}
+
+// Extract the planes from a view-projection matrix
+void CFrustum::Set( const CMatrix4x4& m )
+{
+	// Method (Gribb & Hartmann): a point p transforms to clip space (x,y,z,w) = p*M, so each clip
+	// coordinate is the dot product of p with a matrix column. The point is inside the frustum
+	// if -w <= x <= w, -w <= y <= w and 0 <= z <= w. Each inequality is a plane, e.g. x >= -w
+	// gives Dot( p, column3 + column0 ) >= 0
+	planes[kFrustumLeft]   = CPlane( CVector3( m.e03 + m.e00, m.e13 + m.e10, m.e23 + m.e20 ), m.e33 + m.e30 );
+	planes[kFrustumRight]  = CPlane( CVector3( m.e03 - m.e00, m.e13 - m.e10, m.e23 - m.e20 ), m.e33 - m.e30 );
+	planes[kFrustumBottom] = CPlane( CVector3( m.e03 + m.e01, m.e13 + m.e11, m.e23 + m.e21 ), m.e33 + m.e31 );
+	planes[kFrustumTop]    = CPlane( CVector3( m.e03 - m.e01, m.e13 - m.e11, m.e23 - m.e21 ), m.e33 - m.e31 );
+	planes[kFrustumNear]   = CPlane( CVector3( m.e02, m.e12, m.e22 ), m.e32 );
+	planes[kFrustumFar]    = CPlane( CVector3( m.e03 - m.e02, m.e13 - m.e12, m.e23 - m.e22 ), m.e33 - m.e32 );
+
+	// Normalise so distances are true distances, needed for sphere and box tests. Not using
+	// CPlane::Normalise - with a distant far clip the far plane normal is very short (about
+	// near / far times the length of the others), which is valid but fails its zero length check
+	for (TUInt32 plane = 0; plane < kNumFrustumPlanes; ++plane)
+	{
+		TFloat32 invLength = InvSqrt( planes[plane].normal.LengthSquared() );
+		planes[plane].normal *= invLength;
+		planes[plane].d *= invLength;
+	}
+}
+
+
+/*-----------------------------------------------------------------------------------------
+	Tests
+-----------------------------------------------------------------------------------------*/
+
+// Test if a point is inside the frustum
+bool CFrustum::Contains( const CVector3& p ) const
+{
+	for (TUInt32 plane = 0; plane < kNumFrustumPlanes; ++plane)
+	{
+		if (planes[plane].Distance( p ) < 0.0f)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Test a sphere against the frustum
+EIntersection CFrustum::Test( const CSphere& sphere ) const
+{
+	EIntersection result = kInside;
+	for (TUInt32 plane = 0; plane < kNumFrustumPlanes; ++plane)
+	{
+		TFloat32 distance = planes[plane].Distance( sphere.centre );
+		if (distance < -sphere.radius)
+		{
+			return kOutside;
+		}
+		if (distance < sphere.radius)
+		{
+			result = kIntersecting;
+		}
+	}
+	return result;
+}
+
+// Test an axis-aligned box against the frustum
+EIntersection CFrustum::Test( const CAABB& box ) const
+{
+	// Same as the sphere test, but the "radius" is the box's extent projected onto each normal
+	CVector3 centre = box.GetCentre();
+	CVector3 extents = box.GetExtents();
+	EIntersection result = kInside;
+	for (TUInt32 plane = 0; plane < kNumFrustumPlanes; ++plane)
+	{
+		const CVector3& normal = planes[plane].normal;
+		TFloat32 radius = Abs( normal.x ) * extents.x + Abs( normal.y ) * extents.y + Abs( normal.z ) * extents.z;
+		TFloat32 distance = planes[plane].Distance( centre );
+		if (distance < -radius)
+		{
+			return kOutside;
+		}
+		if (distance < radius)
+		{
+			result = kIntersecting;
+		}
+	}
+	return result;
+}
+
+// Test an oriented box against the frustum
+EIntersection CFrustum::Test( const COBB& box ) const
+{
+	EIntersection result = kInside;
+	for (TUInt32 plane = 0; plane < kNumFrustumPlanes; ++plane)
+	{
+		TFloat32 radius = box.ProjectedRadius( planes[plane].normal );
+		TFloat32 distance = planes[plane].Distance( box.centre );
+		if (distance < -radius)
+		{
+			return kOutside;
+		}
+		if (distance < radius)
+		{
+			result = kIntersecting;
+		}
+	}
+	return result;
+}
+
+
+} // namespace gen
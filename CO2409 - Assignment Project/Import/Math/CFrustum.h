@@ -0,0 +1,83 @@
+/*******************************************
+	CFrustum.h
+
+	View frustum - six planes facing inwards,
+	extracted from a view-projection matrix,
+	with tests against bounding volumes
+********************************************/
+
+#ifndef GEN_C_FRUSTUM_H_INCLUDED
+#define GEN_C_FRUSTUM_H_INCLUDED
+
+#include "GenDefines.h"
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+#include "BoundingVolumes.h"
+
+namespace gen
+{
+
+// Frustum planes
+enum EFrustumPlane
+{
+	kFrustumLeft   = 0,
+	kFrustumRight  = 1,
+	kFrustumBottom = 2,
+	kFrustumTop    = 3,
+	kFrustumNear   = 4,
+	kFrustumFar    = 5,
+	kNumFrustumPlanes
+};
+
+
+class CFrustum
+{
+// Concrete class - public access
+public:
+	/*-----------------------------------------------------------------------------------------
+		Constructors
+	-----------------------------------------------------------------------------------------*/
+
+	// Default constructor - leaves planes uninitialised (for performance)
+	CFrustum() {}
+
+	// Construct from a combined view-projection matrix (DirectX conventions: row vectors and
+	// clip space z from 0 to w). Planes are in world space. Pass a world-view-projection matrix
+	// to get the frustum in that model's space instead
+	explicit CFrustum( const CMatrix4x4& viewProj );
+
+	// Extract the planes from a view-projection matrix - see constructor
+	void Set( const CMatrix4x4& viewProj );
+
+
+	/*-----------------------------------------------------------------------------------------
+		Tests
+	-----------------------------------------------------------------------------------------*/
+	// See BatchCulling.h for testing many volumes at once
+
+	// Test if a point is inside the frustum
+	bool Contains( const CVector3& p ) const;
+
+	// Test a sphere against the frustum. May return kIntersecting for a sphere that is outside
+	// but near a frustum corner (the usual conservative result for plane-based tests)
+	EIntersection Test( const CSphere& sphere ) const;
+
+	// Test an axis-aligned box against the frustum, conservative as above
+	EIntersection Test( const CAABB& box ) const;
+
+	// Test an oriented box against the frustum, conservative as above
+	EIntersection Test( const COBB& box ) const;
+
+
+	/*-----------------------------------------------------------------------------------------
+		Data
+	-----------------------------------------------------------------------------------------*/
+
+	// Normalised planes with normals pointing into the frustum, indexed by EFrustumPlane
+	CPlane planes[kNumFrustumPlanes];
+};
+
+
+} // namespace gen
+
+#endif // GEN_C_FRUSTUM_H_INCLUDED
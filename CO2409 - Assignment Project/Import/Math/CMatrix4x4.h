@@ -1212,6 +1212,29 @@ public:
 };
 
 
+// 16-byte aligned version of CMatrix4x4 (equivalent to D3DXMATRIXA16), allows aligned SIMD loads
+// and stores of the rows. Use wherever a CMatrix4x4 is used. Alignment is only guaranteed for
+// globals, locals and members - heap allocated arrays need CAlignedAllocator (AlignedAllocator.h)
+// Note: cannot be passed to functions by value (the compiler can't align the parameter)
+class GEN_ALIGN(16) CMatrix4x4A16 : public CMatrix4x4
+{
+// Concrete class - public access
+public:
+	// Default constructor - leaves values uninitialised (for performance)
+	CMatrix4x4A16() {}
+
+	// Construct from an unaligned matrix
+	CMatrix4x4A16( const CMatrix4x4& m ) : CMatrix4x4( m ) {}
+
+	// Assignment from any matrix
+	CMatrix4x4A16& operator=( const CMatrix4x4& m )
+	{
+		CMatrix4x4::operator=( m );
+		return *this;
+	}
+};
+
+
 /*-----------------------------------------------------------------------------------------
 	Non-member Operators
 -----------------------------------------------------------------------------------------*/
@@ -0,0 +1,508 @@
+/*******************************************
+	COcclusionBuffer.cpp
+
+	Low resolution CPU depth buffer for
+	occlusion culling - occluder meshes are
+	rasterised into it with SIMD and bounding
+	boxes tested against it
+********************************************/
+
+#include "COcclusionBuffer.h"
+
+#include <unordered_map>
+#include <math.h>      // floorf, ceilf
+#include <xmmintrin.h> // SSE intrinsics
+
+namespace gen
+{
+
+/*---------------------------------------------------------------------------------------------
+	Occluder Meshes
+---------------------------------------------------------------------------------------------*/
+
+// Build from vertex data with a position at the start of each vertex and a list of triangles as
+// 16-bit indices. A cell size above 0 simplifies the mesh by clustering its vertices
+void COccluderMesh::Build
+(
+	const TUInt8*  pVertices,
+	const TUInt32  stride,
+	const TUInt32  numVertices,
+	const TUInt16* pIndices,
+	const TUInt32  numTriangles,
+	const TFloat32 cellSize /*= 0.0f*/
+)
+{
+	Clear();
+	if (numVertices == 0 || numTriangles == 0)
+	{
+		return;
+	}
+
+	// Cluster each vertex into a grid cell, or give each its own cluster if not simplifying
+	vector<TUInt32> clusters( numVertices );
+	if (cellSize > 0.0f)
+	{
+		CAABB bounds( *reinterpret_cast<const CVector3*>(pVertices), *reinterpret_cast<const CVector3*>(pVertices) );
+		for (TUInt32 vertex = 1; vertex < numVertices; ++vertex)
+		{
+			bounds.Expand( *reinterpret_cast<const CVector3*>(pVertices + vertex * stride) );
+		}
+
+		// Cells are keyed on their 21-bit x, y and z grid coordinates. The new vertex of each
+		// cluster is the average of the vertices in it
+		unordered_map<TUInt64, TUInt32> cells;
+		vector<TUInt32> clusterSizes;
+		const TFloat32 invCellSize = 1.0f / cellSize;
+		for (TUInt32 vertex = 0; vertex < numVertices; ++vertex)
+		{
+			const CVector3& position = *reinterpret_cast<const CVector3*>(pVertices + vertex * stride);
+			CVector3 cell = (position - bounds.minPt) * invCellSize;
+			TUInt64 key = (static_cast<TUInt64>(cell.x) & 0x1fffff) |
+			              ((static_cast<TUInt64>(cell.y) & 0x1fffff) << 21) |
+			              ((static_cast<TUInt64>(cell.z) & 0x1fffff) << 42);
+			unordered_map<TUInt64, TUInt32>::iterator found = cells.find( key );
+			if (found == cells.end())
+			{
+				found = cells.insert( make_pair( key, static_cast<TUInt32>(m_Vertices.size()) ) ).first;
+				m_Vertices.push_back( CVector3::kZero );
+				clusterSizes.push_back( 0 );
+			}
+			clusters[vertex] = found->second;
+			m_Vertices[found->second] += position;
+			++clusterSizes[found->second];
+		}
+		for (TUInt32 cluster = 0; cluster < m_Vertices.size(); ++cluster)
+		{
+			m_Vertices[cluster] *= 1.0f / static_cast<TFloat32>(clusterSizes[cluster]);
+		}
+	}
+	else
+	{
+		m_Vertices.resize( numVertices );
+		for (TUInt32 vertex = 0; vertex < numVertices; ++vertex)
+		{
+			m_Vertices[vertex] = *reinterpret_cast<const CVector3*>(pVertices + vertex * stride);
+			clusters[vertex] = vertex;
+		}
+	}
+
+	// Keep the triangles whose corners are still in different clusters
+	m_Indices.reserve( numTriangles * 3 );
+	for (TUInt32 triangle = 0; triangle < numTriangles; ++triangle)
+	{
+		TUInt32 i0 = clusters[pIndices[triangle * 3]];
+		TUInt32 i1 = clusters[pIndices[triangle * 3 + 1]];
+		TUInt32 i2 = clusters[pIndices[triangle * 3 + 2]];
+		if (i0 != i1 && i1 != i2 && i2 != i0)
+		{
+			m_Indices.push_back( i0 );
+			m_Indices.push_back( i1 );
+			m_Indices.push_back( i2 );
+		}
+	}
+}
+
+// Remove the mesh
+void COccluderMesh::Clear()
+{
+	m_Vertices.clear();
+	m_Indices.clear();
+}
+
+
+/*---------------------------------------------------------------------------------------------
+	Occlusion Buffer
+---------------------------------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------------------
+	Constructors
+-----------------------------------------------------------------------------------------*/
+
+// Construct with the given size in pixels, rounded up to a whole number of tiles
+COcclusionBuffer::COcclusionBuffer( const TUInt32 width /*= 256*/, const TUInt32 height /*= 128*/ )
+{
+	m_NumOccluders = 0;
+	m_ViewProj = CMatrix4x4::kIdentity;
+	SetSize( width, height );
+}
+
+// Change the size of the buffer, rounded up to a whole number of tiles. Clears the buffer
+void COcclusionBuffer::SetSize( const TUInt32 width, const TUInt32 height )
+{
+	m_TilesX = (width + kTileWidth - 1) / kTileWidth;
+	m_TilesY = (height + kTileHeight - 1) / kTileHeight;
+	if (m_TilesX == 0) m_TilesX = 1;
+	if (m_TilesY == 0) m_TilesY = 1;
+	m_Width = m_TilesX * kTileWidth;
+	m_Height = m_TilesY * kTileHeight;
+	m_Depths.assign( m_Width * m_Height, 1.0f );
+	m_TileDepths.assign( m_TilesX * m_TilesY, 1.0f );
+}
+
+
+/*-----------------------------------------------------------------------------------------
+	Rasterising
+-----------------------------------------------------------------------------------------*/
+
+// Start a new frame: clear the buffer to the far plane and remove the occluders
+void COcclusionBuffer::Begin( const CMatrix4x4& viewProj )
+{
+	m_ViewProj = viewProj;
+	m_Depths.assign( m_Depths.size(), 1.0f );
+	m_TileDepths.assign( m_TileDepths.size(), 1.0f );
+	m_NumOccluders = 0;
+	m_Stats.Occluders = 0;
+	m_Stats.OccluderTriangles = 0;
+	m_Stats.TrianglesRasterised = 0;
+}
+
+// Add an occluder to rasterise, with its world matrix
+void COcclusionBuffer::AddOccluder
+(
+	const COccluderMesh* pMesh,
+	const CMatrix4x4&    worldMatrix
+)
+{
+	if (!pMesh || pMesh->IsEmpty())
+	{
+		return;
+	}
+	if (m_NumOccluders == m_Occluders.size())
+	{
+		m_Occluders.push_back( SOccluder() );
+	}
+	SOccluder& occluder = m_Occluders[m_NumOccluders++];
+	occluder.pMesh = pMesh;
+	occluder.worldViewProj = worldMatrix * m_ViewProj;
+	occluder.triangles.clear();
+
+	++m_Stats.Occluders;
+	m_Stats.OccluderTriangles += pMesh->GetNumTriangles();
+}
+
+// Transform, clip and rasterise the occluders added since Begin
+void COcclusionBuffer::Rasterise( CJobSystem* pJobs /*= 0*/ )
+{
+	if (pJobs)
+	{
+		// All triangles must be set up before any band is rasterised
+		pJobs->ParallelFor( m_NumOccluders, 1, [this]( TUInt32 first, TUInt32 end )
+		{
+			for (TUInt32 i = first; i < end; ++i)
+			{
+				SetupTriangles( m_Occluders[i] );
+			}
+		} );
+		pJobs->ParallelFor( m_TilesY, 1, [this]( TUInt32 first, TUInt32 end )
+		{
+			RasteriseTileRows( first, end );
+		} );
+	}
+	else
+	{
+		for (TUInt32 i = 0; i < m_NumOccluders; ++i)
+		{
+			SetupTriangles( m_Occluders[i] );
+		}
+		RasteriseTileRows( 0, m_TilesY );
+	}
+
+	for (TUInt32 i = 0; i < m_NumOccluders; ++i)
+	{
+		m_Stats.TrianglesRasterised += static_cast<TUInt32>(m_Occluders[i].triangles.size());
+	}
+}
+
+
+// Point where the edge from a to b crosses the near clip plane (clip space z = 0)
+inline CVector4 ClipToNearPlane( const CVector4& a, const CVector4& b )
+{
+	TFloat32 t = a.z / (a.z - b.z);
+	return CVector4( a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, 0.0f, a.w + (b.w - a.w) * t );
+}
+
+// Transform and clip an occluder's triangles into screen space triangles
+void COcclusionBuffer::SetupTriangles( SOccluder& occluder )
+{
+	const COccluderMesh& mesh = *occluder.pMesh;
+	const CMatrix4x4& m = occluder.worldViewProj;
+	occluder.triangles.clear();
+
+	// Transform every vertex to clip space
+	const TUInt32 numVertices = mesh.GetNumVertices();
+	occluder.clipVertices.resize( numVertices );
+	const CVector3* pVertices = mesh.GetVertices();
+	for (TUInt32 vertex = 0; vertex < numVertices; ++vertex)
+	{
+		const CVector3& v = pVertices[vertex];
+		occluder.clipVertices[vertex] = CVector4( v.x * m.e00 + v.y * m.e10 + v.z * m.e20 + m.e30,
+		                                          v.x * m.e01 + v.y * m.e11 + v.z * m.e21 + m.e31,
+		                                          v.x * m.e02 + v.y * m.e12 + v.z * m.e22 + m.e32,
+		                                          v.x * m.e03 + v.y * m.e13 + v.z * m.e23 + m.e33 );
+	}
+
+	const TUInt32* pIndices = mesh.GetIndices();
+	const TUInt32 numTriangles = mesh.GetNumTriangles();
+	for (TUInt32 triangle = 0; triangle < numTriangles; ++triangle)
+	{
+		const CVector4& v0 = occluder.clipVertices[pIndices[triangle * 3]];
+		const CVector4& v1 = occluder.clipVertices[pIndices[triangle * 3 + 1]];
+		const CVector4& v2 = occluder.clipVertices[pIndices[triangle * 3 + 2]];
+
+		// Skip triangles entirely outside one of the side or far planes
+		if ((v0.x >  v0.w && v1.x >  v1.w && v2.x >  v2.w) || (v0.x < -v0.w && v1.x < -v1.w && v2.x < -v2.w) ||
+		    (v0.y >  v0.w && v1.y >  v1.w && v2.y >  v2.w) || (v0.y < -v0.w && v1.y < -v1.w && v2.y < -v2.w) ||
+		    (v0.z >  v0.w && v1.z >  v1.w && v2.z >  v2.w))
+		{
+			continue;
+		}
+
+		// Clip against the near plane, giving a polygon of up to four vertices
+		const CVector4* corners[3] = { &v0, &v1, &v2 };
+		CVector4 polygon[4];
+		TUInt32 numPolygon = 0;
+		for (TUInt32 corner = 0; corner < 3; ++corner)
+		{
+			const CVector4& a = *corners[corner];
+			const CVector4& b = *corners[(corner + 1) % 3];
+			if (a.z >= 0.0f)
+			{
+				polygon[numPolygon++] = a;
+			}
+			if ((a.z >= 0.0f) != (b.z >= 0.0f))
+			{
+				polygon[numPolygon++] = ClipToNearPlane( a, b );
+			}
+		}
+		for (TUInt32 corner = 2; corner < numPolygon; ++corner)
+		{
+			AddTriangle( polygon[0], polygon[corner - 1], polygon[corner], occluder.triangles );
+		}
+	}
+}
+
+// Add a clip space triangle (already clipped against the near plane) to a list, if it is front
+// facing and covers any pixel centres
+void COcclusionBuffer::AddTriangle
+(
+	const CVector4&    v0,
+	const CVector4&    v1,
+	const CVector4&    v2,
+	vector<STriangle>& triangles
+)
+{
+	// Screen space, y down, pixel centres at half-pixel coordinates
+	const TFloat32 halfWidth = 0.5f * static_cast<TFloat32>(m_Width);
+	const TFloat32 halfHeight = 0.5f * static_cast<TFloat32>(m_Height);
+	const TFloat32 invW0 = 1.0f / v0.w, invW1 = 1.0f / v1.w, invW2 = 1.0f / v2.w;
+	const TFloat32 x0 = (v0.x * invW0 + 1.0f) * halfWidth, y0 = (1.0f - v0.y * invW0) * halfHeight, z0 = v0.z * invW0;
+	const TFloat32 x1 = (v1.x * invW1 + 1.0f) * halfWidth, y1 = (1.0f - v1.y * invW1) * halfHeight, z1 = v1.z * invW1;
+	const TFloat32 x2 = (v2.x * invW2 + 1.0f) * halfWidth, y2 = (1.0f - v2.y * invW2) * halfHeight, z2 = v2.z * invW2;
+
+	// Front faces are clockwise on screen, which with y down gives a positive area
+	const TFloat32 area = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+	if (area <= 0.0f)
+	{
+		return;
+	}
+
+	// Pixels whose centres are inside the triangle's bounds
+	STriangle t;
+	TFloat32 minX = Min( x0, Min( x1, x2 ) ), maxX = Max( x0, Max( x1, x2 ) );
+	TFloat32 minY = Min( y0, Min( y1, y2 ) ), maxY = Max( y0, Max( y1, y2 ) );
+	t.minX = static_cast<TInt32>(Max( ceilf( minX - 0.5f ), 0.0f ));
+	t.maxX = static_cast<TInt32>(Min( floorf( maxX - 0.5f ), static_cast<TFloat32>(m_Width - 1) ));
+	t.minY = static_cast<TInt32>(Max( ceilf( minY - 0.5f ), 0.0f ));
+	t.maxY = static_cast<TInt32>(Min( floorf( maxY - 0.5f ), static_cast<TFloat32>(m_Height - 1) ));
+	if (t.minX > t.maxX || t.minY > t.maxY)
+	{
+		return;
+	}
+
+	// Edge from a to b is positive on the inside: (bx - ax)(y - ay) - (by - ay)(x - ax)
+	const TFloat32 xs[3] = { x0, x1, x2 };
+	const TFloat32 ys[3] = { y0, y1, y2 };
+	for (TUInt32 edge = 0; edge < 3; ++edge)
+	{
+		TUInt32 next = (edge + 1) % 3;
+		t.edgeA[edge] = ys[edge] - ys[next];
+		t.edgeB[edge] = xs[next] - xs[edge];
+		t.edgeC[edge] = (ys[next] - ys[edge]) * xs[edge] - (xs[next] - xs[edge]) * ys[edge];
+	}
+
+	// Depth is linear in screen space
+	const TFloat32 invArea = 1.0f / area;
+	t.depthA = ((z1 - z0) * (y2 - y0) - (z2 - z0) * (y1 - y0)) * invArea;
+	t.depthB = ((x1 - x0) * (z2 - z0) - (x2 - x0) * (z1 - z0)) * invArea;
+	t.depthC = z0 - t.depthA * x0 - t.depthB * y0;
+
+	triangles.push_back( t );
+}
+
+// Rasterise every triangle into the rows of tiles [firstTileRow, endTileRow), then update the
+// farthest depth of each of those tiles
+void COcclusionBuffer::RasteriseTileRows( const TUInt32 firstTileRow, const TUInt32 endTileRow )
+{
+	const TInt32 firstRow = firstTileRow * kTileHeight;
+	const TInt32 lastRow = endTileRow * kTileHeight - 1;
+	const __m128 columnOffsets = _mm_setr_ps( 0.5f, 1.5f, 2.5f, 3.5f ); // Pixel centres of four columns
+	const __m128 zero = _mm_setzero_ps();
+
+	for (TUInt32 occluder = 0; occluder < m_NumOccluders; ++occluder)
+	{
+		const vector<STriangle>& triangles = m_Occluders[occluder].triangles;
+		for (TUInt32 triangle = 0; triangle < triangles.size(); ++triangle)
+		{
+			const STriangle& t = triangles[triangle];
+			const TInt32 startY = Max( t.minY, firstRow );
+			const TInt32 endY = Min( t.maxY, lastRow );
+			if (startY > endY)
+			{
+				continue;
+			}
+			const TInt32 startX = t.minX & ~3; // Whole groups of four, rows are aligned
+			const TInt32 endX = t.maxX;
+
+			const __m128 edgeA0 = _mm_set1_ps( t.edgeA[0] );
+			const __m128 edgeA1 = _mm_set1_ps( t.edgeA[1] );
+			const __m128 edgeA2 = _mm_set1_ps( t.edgeA[2] );
+			const __m128 depthA = _mm_set1_ps( t.depthA );
+
+			for (TInt32 y = startY; y <= endY; ++y)
+			{
+				// Parts of the edge and depth functions that are constant along the row
+				const TFloat32 pixelY = static_cast<TFloat32>(y) + 0.5f;
+				const __m128 rowEdge0 = _mm_set1_ps( t.edgeB[0] * pixelY + t.edgeC[0] );
+				const __m128 rowEdge1 = _mm_set1_ps( t.edgeB[1] * pixelY + t.edgeC[1] );
+				const __m128 rowEdge2 = _mm_set1_ps( t.edgeB[2] * pixelY + t.edgeC[2] );
+				const __m128 rowDepth = _mm_set1_ps( t.depthB * pixelY + t.depthC );
+
+				TFloat32* pRow = &m_Depths[y * m_Width];
+				for (TInt32 x = startX; x <= endX; x += 4)
+				{
+					__m128 pixelX = _mm_add_ps( _mm_set1_ps( static_cast<TFloat32>(x) ), columnOffsets );
+
+					// Inside if all three edge functions are non-negative
+					__m128 inside = _mm_cmpge_ps( _mm_add_ps( _mm_mul_ps( edgeA0, pixelX ), rowEdge0 ), zero );
+					inside = _mm_and_ps( inside, _mm_cmpge_ps( _mm_add_ps( _mm_mul_ps( edgeA1, pixelX ), rowEdge1 ), zero ) );
+					inside = _mm_and_ps( inside, _mm_cmpge_ps( _mm_add_ps( _mm_mul_ps( edgeA2, pixelX ), rowEdge2 ), zero ) );
+
+					// Keep the nearer depth where inside, the old depth elsewhere
+					__m128 depth = _mm_add_ps( _mm_mul_ps( depthA, pixelX ), rowDepth );
+					__m128 old = _mm_load_ps( pRow + x );
+					__m128 nearer = _mm_min_ps( old, depth );
+					_mm_store_ps( pRow + x, _mm_or_ps( _mm_and_ps( inside, nearer ), _mm_andnot_ps( inside, old ) ) );
+				}
+			}
+		}
+	}
+
+	// Farthest depth in each tile of the band
+	for (TUInt32 tileY = firstTileRow; tileY < endTileRow; ++tileY)
+	{
+		for (TUInt32 tileX = 0; tileX < m_TilesX; ++tileX)
+		{
+			const TFloat32* pTile = &m_Depths[tileY * kTileHeight * m_Width + tileX * kTileWidth];
+			__m128 farthest = zero;
+			for (TUInt32 row = 0; row < kTileHeight; ++row)
+			{
+				farthest = _mm_max_ps( farthest, _mm_load_ps( pTile + row * m_Width ) );
+				farthest = _mm_max_ps( farthest, _mm_load_ps( pTile + row * m_Width + 4 ) );
+			}
+			TFloat32 lanes[4];
+			_mm_storeu_ps( lanes, farthest );
+			m_TileDepths[tileY * m_TilesX + tileX] = Max( Max( lanes[0], lanes[1] ), Max( lanes[2], lanes[3] ) );
+		}
+	}
+}
+
+
+/*-----------------------------------------------------------------------------------------
+	Tests
+-----------------------------------------------------------------------------------------*/
+
+// Test a world space box against the buffer. Returns false if it is certainly hidden by the
+// occluders, true if any of it may be visible
+bool COcclusionBuffer::IsVisible( const CAABB& box ) const
+{
+	// Project the corners, finding the screen rectangle and nearest depth of the box
+	const CMatrix4x4& m = m_ViewProj;
+	TFloat32 minX = static_cast<TFloat32>(m_Width), maxX = 0.0f;
+	TFloat32 minY = static_cast<TFloat32>(m_Height), maxY = 0.0f;
+	TFloat32 minDepth = 1.0f;
+	for (TUInt32 corner = 0; corner < 8; ++corner)
+	{
+		const TFloat32 x = (corner & 1) ? box.maxPt.x : box.minPt.x;
+		const TFloat32 y = (corner & 2) ? box.maxPt.y : box.minPt.y;
+		const TFloat32 z = (corner & 4) ? box.maxPt.z : box.minPt.z;
+		const TFloat32 clipX = x * m.e00 + y * m.e10 + z * m.e20 + m.e30;
+		const TFloat32 clipY = x * m.e01 + y * m.e11 + z * m.e21 + m.e31;
+		const TFloat32 clipZ = x * m.e02 + y * m.e12 + z * m.e22 + m.e32;
+		const TFloat32 clipW = x * m.e03 + y * m.e13 + z * m.e23 + m.e33;
+
+		// A box reaching in front of the near plane can't be tested
+		if (clipZ < 0.0f || clipW <= 0.0f)
+		{
+			return true;
+		}
+		const TFloat32 invW = 1.0f / clipW;
+		const TFloat32 screenX = (clipX * invW + 1.0f) * 0.5f * static_cast<TFloat32>(m_Width);
+		const TFloat32 screenY = (1.0f - clipY * invW) * 0.5f * static_cast<TFloat32>(m_Height);
+		minX = Min( minX, screenX );
+		maxX = Max( maxX, screenX );
+		minY = Min( minY, screenY );
+		maxY = Max( maxY, screenY );
+		minDepth = Min( minDepth, clipZ * invW );
+	}
+
+	// Every pixel the rectangle touches, clamped to the buffer. Nothing to test if it is off screen
+	const TInt32 startX = static_cast<TInt32>(Max( floorf( minX ), 0.0f ));
+	const TInt32 endX = static_cast<TInt32>(Min( ceilf( maxX ) - 1.0f, static_cast<TFloat32>(m_Width - 1) ));
+	const TInt32 startY = static_cast<TInt32>(Max( floorf( minY ), 0.0f ));
+	const TInt32 endY = static_cast<TInt32>(Min( ceilf( maxY ) - 1.0f, static_cast<TFloat32>(m_Height - 1) ));
+	if (startX > endX || startY > endY)
+	{
+		return true;
+	}
+
+	// Visible if any pixel in the rectangle is at or behind the nearest point of the box. Tiles
+	// that are entirely nearer are skipped without looking at their pixels
+	const __m128 boxDepth = _mm_set1_ps( minDepth );
+	const __m128 columnOffsets = _mm_setr_ps( 0.0f, 1.0f, 2.0f, 3.0f );
+	const __m128 firstColumn = _mm_set1_ps( static_cast<TFloat32>(startX) );
+	const __m128 lastColumn = _mm_set1_ps( static_cast<TFloat32>(endX) );
+	for (TInt32 tileY = startY / kTileHeight; tileY <= endY / static_cast<TInt32>(kTileHeight); ++tileY)
+	{
+		for (TInt32 tileX = startX / kTileWidth; tileX <= endX / static_cast<TInt32>(kTileWidth); ++tileX)
+		{
+			if (m_TileDepths[tileY * m_TilesX + tileX] < minDepth)
+			{
+				continue;
+			}
+
+			// Part of the rectangle in this tile
+			const TInt32 tileStartX = Max( startX, tileX * static_cast<TInt32>(kTileWidth) );
+			const TInt32 tileEndX = Min( endX, (tileX + 1) * static_cast<TInt32>(kTileWidth) - 1 );
+			const TInt32 tileStartY = Max( startY, tileY * static_cast<TInt32>(kTileHeight) );
+			const TInt32 tileEndY = Min( endY, (tileY + 1) * static_cast<TInt32>(kTileHeight) - 1 );
+			for (TInt32 y = tileStartY; y <= tileEndY; ++y)
+			{
+				const TFloat32* pRow = &m_Depths[y * m_Width];
+				for (TInt32 x = tileStartX & ~3; x <= tileEndX; x += 4)
+				{
+					__m128 column = _mm_add_ps( _mm_set1_ps( static_cast<TFloat32>(x) ), columnOffsets );
+					__m128 inRectangle = _mm_and_ps( _mm_cmpge_ps( column, firstColumn ), _mm_cmple_ps( column, lastColumn ) );
+					__m128 behind = _mm_cmpge_ps( _mm_load_ps( pRow + x ), boxDepth );
+					if (_mm_movemask_ps( _mm_and_ps( inRectangle, behind ) ))
+					{
+						return true;
+					}
+				}
+			}
+		}
+	}
+	return false;
+}
+
+
+} // namespace gen
@@ -0,0 +1,256 @@
+/*******************************************
+	COcclusionBuffer.h
+
+	Low resolution CPU depth buffer for
+	occlusion culling - occluder meshes are
+	rasterised into it with SIMD and bounding
+	boxes tested against it
+********************************************/
+
+// Large objects (walls, terrain, buildings) hide much of a scene, but frustum culling still draws
+// everything behind them. Each frame a few occluders are rasterised into a small depth buffer on
+// the CPU, then the bounding box of each object is tested against it. If every pixel the box
+// covers already holds something nearer than the nearest point of the box, the object is hidden.
+//
+// The buffer is hierarchical: as well as the depth of each pixel, the farthest depth in each
+// 8x8 tile is kept. Most boxes can then be accepted or rejected a tile at a time, only checking
+// pixels in tiles that are partly covered.
+//
+// Rasterising uses SSE to process four pixels of a row at once. With a job system the occluders
+// are transformed and clipped in parallel (one job per occluder), then the buffer is rasterised in
+// parallel in horizontal bands of tile rows, each job drawing every triangle that touches its
+// band. Tests only read the buffer, so many can run at once after rasterising.
+//
+// Depths are clip space z / w (0 at the near clip plane, 1 at the far). Coverage is sampled at
+// pixel centres and back faces (anticlockwise on screen) are culled, as the GPU does, so an
+// occluder only hides what its visible faces would. Boxes crossing the near plane are always
+// visible. At low resolution an occluder's edge pixels may hide a sliver of what lies behind -
+// use occluder meshes that sit just inside the rendered geometry
+
+#ifndef GEN_C_OCCLUSION_BUFFER_H_INCLUDED
+#define GEN_C_OCCLUSION_BUFFER_H_INCLUDED
+
+#include <vector>
+using namespace std;
+
+#include "GenDefines.h"
+#include "AlignedAllocator.h"
+#include "CVector3.h"
+#include "CVector4.h"
+#include "CMatrix4x4.h"
+#include "BoundingVolumes.h"
+#include "CJobSystem.h"
+
+namespace gen
+{
+
+/*---------------------------------------------------------------------------------------------
+	Occluder Meshes
+---------------------------------------------------------------------------------------------*/
+
+// Positions and triangles of an occluder in model space. Can be simplified by vertex clustering
+// when built: vertices are grouped by a grid of the given cell size, each group is replaced by
+// its average position and triangles that collapse are dropped. Keep the cell size small compared
+// to the occluder so the simplified surface stays close to the original
+class COccluderMesh
+{
+// Concrete class - public access
+public:
+	COccluderMesh() {}
+
+	// Build from vertex data with a position (three floats) at the start of each vertex, vertices
+	// being stride bytes apart, and a list of triangles as 16-bit indices. A cell size of 0 keeps
+	// the mesh as it is
+	void Build
+	(
+		const TUInt8*  pVertices,
+		const TUInt32  stride,
+		const TUInt32  numVertices,
+		const TUInt16* pIndices,
+		const TUInt32  numTriangles,
+		const TFloat32 cellSize = 0.0f
+	);
+
+	// Remove the mesh
+	void Clear();
+
+	bool IsEmpty() const
+	{
+		return m_Indices.empty();
+	}
+	TUInt32 GetNumVertices() const
+	{
+		return static_cast<TUInt32>(m_Vertices.size());
+	}
+	TUInt32 GetNumTriangles() const
+	{
+		return static_cast<TUInt32>(m_Indices.size() / 3);
+	}
+	const CVector3* GetVertices() const
+	{
+		return m_Vertices.data();
+	}
+	const TUInt32* GetIndices() const
+	{
+		return m_Indices.data();
+	}
+
+private:
+	vector<CVector3> m_Vertices;
+	vector<TUInt32>  m_Indices;
+};
+
+
+/*---------------------------------------------------------------------------------------------
+	Occlusion Buffer
+---------------------------------------------------------------------------------------------*/
+
+// Counts for the last frame
+struct SOcclusionStats
+{
+	TUInt32 Occluders;           // Occluders added
+	TUInt32 OccluderTriangles;   // Triangles in the occluders added
+	TUInt32 TrianglesRasterised; // Triangles left after clipping and back face culling
+};
+
+class COcclusionBuffer
+{
+// Concrete class - public access
+public:
+	/*-----------------------------------------------------------------------------------------
+		Constructors
+	-----------------------------------------------------------------------------------------*/
+
+	// Size of the hierarchical tiles in pixels
+	static const TUInt32 kTileWidth = 8;
+	static const TUInt32 kTileHeight = 8;
+
+	// Construct with the given size in pixels, rounded up to a whole number of tiles
+	COcclusionBuffer( const TUInt32 width = 256, const TUInt32 height = 128 );
+
+	// Change the size of the buffer, rounded up to a whole number of tiles. Clears the buffer
+	void SetSize( const TUInt32 width, const TUInt32 height );
+
+	TUInt32 GetWidth() const
+	{
+		return m_Width;
+	}
+	TUInt32 GetHeight() const
+	{
+		return m_Height;
+	}
+
+
+	/*-----------------------------------------------------------------------------------------
+		Rasterising
+	-----------------------------------------------------------------------------------------*/
+
+	// Start a new frame: clear the buffer to the far plane and remove the occluders. The view-
+	// projection matrix uses DirectX conventions (row vectors, clip space z from 0 to w)
+	void Begin( const CMatrix4x4& viewProj );
+
+	// Add an occluder to rasterise, with its world matrix. The mesh must stay in place until
+	// Rasterise has finished
+	void AddOccluder
+	(
+		const COccluderMesh* pMesh,
+		const CMatrix4x4&    worldMatrix
+	);
+
+	// Transform, clip and rasterise the occluders added since Begin. Uses the job system if one
+	// is given, otherwise runs on the calling thread
+	void Rasterise( CJobSystem* pJobs = 0 );
+
+
+	/*-----------------------------------------------------------------------------------------
+		Tests
+	-----------------------------------------------------------------------------------------*/
+
+	// Test a world space box against the buffer. Returns false if it is certainly hidden by the
+	// occluders, true if any of it may be visible (including boxes off screen or crossing the near
+	// clip plane). Only reads the buffer, so can be called from several threads at once
+	bool IsVisible( const CAABB& box ) const;
+
+
+	/*-----------------------------------------------------------------------------------------
+		Data access
+	-----------------------------------------------------------------------------------------*/
+
+	// Counts for the current frame
+	const SOcclusionStats& GetStats() const
+	{
+		return m_Stats;
+	}
+
+	// Depth of each pixel, row by row from the top of the screen (for viewing the buffer)
+	const TFloat32* GetDepths() const
+	{
+		return m_Depths.data();
+	}
+
+
+/*-----------------------------------------------------------------------------------------
+	Private types / functions
+-----------------------------------------------------------------------------------------*/
+private:
+
+	// A screen space triangle ready to rasterise: its pixel bounds, the three edge functions
+	// (positive inside) and the depth plane, all as a * x + b * y + c for pixel centre x, y
+	struct STriangle
+	{
+		TInt32   minX, maxX, minY, maxY; // Inclusive pixel bounds, clamped to the buffer
+		TFloat32 edgeA[3], edgeB[3], edgeC[3];
+		TFloat32 depthA, depthB, depthC;
+	};
+
+	// Occluder added this frame, with the triangles it produced
+	struct SOccluder
+	{
+		const COccluderMesh* pMesh;
+		CMatrix4x4           worldViewProj;
+		vector<STriangle>    triangles;
+		vector<CVector4>     clipVertices; // Temporary space for the transformed vertices
+	};
+
+	// Transform and clip an occluder's triangles into screen space triangles
+	void SetupTriangles( SOccluder& occluder );
+
+	// Add a clip space triangle (already clipped against the near plane) to a list, if it is
+	// front facing and covers any pixel centres
+	void AddTriangle
+	(
+		const CVector4&    v0,
+		const CVector4&    v1,
+		const CVector4&    v2,
+		vector<STriangle>& triangles
+	);
+
+	// Rasterise every triangle into the rows of tiles [firstTileRow, endTileRow), then update the
+	// farthest depth of each of those tiles
+	void RasteriseTileRows( const TUInt32 firstTileRow, const TUInt32 endTileRow );
+
+
+	typedef vector<TFloat32, CAlignedAllocator<TFloat32> > TDepths;
+
+	TUInt32 m_Width;
+	TUInt32 m_Height;
+	TUInt32 m_TilesX;
+	TUInt32 m_TilesY;
+
+	CMatrix4x4 m_ViewProj;
+
+	TDepths m_Depths;     // Depth of each pixel, 16-byte aligned rows (width is a multiple of 8)
+	TDepths m_TileDepths; // Farthest depth in each tile
+
+	// Occluders added this frame. The list keeps its entries between frames so their triangle
+	// arrays don't need reallocating
+	vector<SOccluder> m_Occluders;
+	TUInt32           m_NumOccluders;
+
+	SOcclusionStats m_Stats;
+};
+
+
+} // namespace gen
+
+#endif // GEN_C_OCCLUSION_BUFFER_H_INCLUDED
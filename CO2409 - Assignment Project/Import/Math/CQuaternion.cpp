@@ -182,6 +182,85 @@ CVector3 CQuaternion::Rotate
 }
 
 
+/*---------------------------------------------------------------------------------------------
+	Rotation Quaternions
+---------------------------------------------------------------------------------------------*/
+
+// Return a quaternion that is an X-axis rotation by the given angle (radians)
+CQuaternion QuaternionRotationX( const TFloat32 x )
+{
+	TFloat32 s, c;
+	SinCos( x * 0.5f, &s, &c );
+	return CQuaternion( c, s, 0.0f, 0.0f );
+}
+
+// Return a quaternion that is a Y-axis rotation by the given angle (radians)
+CQuaternion QuaternionRotationY( const TFloat32 y )
+{
+	TFloat32 s, c;
+	SinCos( y * 0.5f, &s, &c );
+	return CQuaternion( c, 0.0f, s, 0.0f );
+}
+
+// Return a quaternion that is a Z-axis rotation by the given angle (radians)
+CQuaternion QuaternionRotationZ( const TFloat32 z )
+{
+	TFloat32 s, c;
+	SinCos( z * 0.5f, &s, &c );
+	return CQuaternion( c, 0.0f, 0.0f, s );
+}
+
+// Return a quaternion that is a combined rotation around the X, Y & Z axes by the given angles
+// (radians), applied in the order specified
+CQuaternion QuaternionRotation
+(
+	const CVector3       angles,
+	const ERotationOrder eRotOrder /*= kZXY*/
+)
+{
+	GEN_GUARD;
+
+	CQuaternion qX = QuaternionRotationX( angles.x );
+	CQuaternion qY = QuaternionRotationY( angles.y );
+	CQuaternion qZ = QuaternionRotationZ( angles.z );
+
+	// Quaternions combine in the same order as matrices (see header)
+	switch (eRotOrder)
+	{
+		case kXYZ: return qX * qY * qZ;
+		case kXZY: return qX * qZ * qY;
+		case kYZX: return qY * qZ * qX;
+		case kYXZ: return qY * qX * qZ;
+		case kZXY: return qZ * qX * qY;
+		case kZYX: return qZ * qY * qX;
+
+		default:
+			GEN_ERROR( "Invalid parameter" );
+	}
+
+	GEN_ENDGUARD;
+}
+
+// Return a quaternion that is a rotation around the given axis by the given angle (radians)
+CQuaternion QuaternionRotation
+(
+	const CVector3& axis,
+	const TFloat32  fAngle
+)
+{
+	GEN_GUARD;
+
+	CVector3 axisNorm = Normalise( axis );
+	GEN_ASSERT( !axisNorm.IsZero(), "Zero length axis" );
+
+	TFloat32 s, c;
+	SinCos( fAngle * 0.5f, &s, &c );
+	return CQuaternion( c, s * axisNorm );
+
+	GEN_ENDGUARD;
+}
+
+
 /*---------------------------------------------------------------------------------------------
 	Interpolation
 ---------------------------------------------------------------------------------------------*/
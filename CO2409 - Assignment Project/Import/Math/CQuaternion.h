@@ -564,6 +564,38 @@ CQuaternion Normalise
 );
 
 
+/*---------------------------------------------------------------------------------------------
+	Rotation Quaternions
+---------------------------------------------------------------------------------------------*/
+// Quaternion equivalents of the rotation matrix functions in CMatrix4x4.h, using the same
+// conventions, e.g. CMatrix4x4( QuaternionRotationX( a ) ) == MatrixRotationX( a ). Combining
+// quaternions also follows the matrix order: the rotation q1*q2 applies q1 then q2
+
+// Return a quaternion that is an X-axis rotation by the given angle (radians)
+CQuaternion QuaternionRotationX( const TFloat32 x );
+
+// Return a quaternion that is a Y-axis rotation by the given angle (radians)
+CQuaternion QuaternionRotationY( const TFloat32 y );
+
+// Return a quaternion that is a Z-axis rotation by the given angle (radians)
+CQuaternion QuaternionRotationZ( const TFloat32 z );
+
+// Return a quaternion that is a combined rotation around the X, Y & Z axes by the given angles
+// (radians), applied in the order specified
+CQuaternion QuaternionRotation
+(
+	const CVector3       angles,
+	const ERotationOrder eRotOrder = kZXY
+);
+
+// Return a quaternion that is a rotation around the given axis by the given angle (radians)
+CQuaternion QuaternionRotation
+(
+	const CVector3& axis,
+	const TFloat32  fAngle
+);
+
+
 /*---------------------------------------------------------------------------------------------
 	Interpolation
 ---------------------------------------------------------------------------------------------*/
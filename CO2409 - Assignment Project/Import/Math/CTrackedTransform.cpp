@@ -0,0 +1,315 @@
+/*******************************************
+	CTrackedTransform.cpp
+
+	A 4x4 transformation matrix that records
+	which kinds of operation were used to
+	build it, so the cheapest correct inverse,
+	normal matrix or decomposition can be used
+********************************************/
+
+#include "CTrackedTransform.h"
+
+#include "Error.h"
+
+namespace gen
+{
+
+/*-----------------------------------------------------------------------------------------
+	Getters
+-----------------------------------------------------------------------------------------*/
+
+// Return the flags needed to describe the given scale
+TTransformFlags CTrackedTransform::ScaleFlags( const CVector3& scale )
+{
+	if (scale.x == scale.y && scale.x == scale.z)
+	{
+		return (scale.x == 1.0f) ? 0 : kTransformUniformScale;
+	}
+	return kTransformScale;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+	Construction
+-----------------------------------------------------------------------------------------*/
+
+// Make an identity transform
+void CTrackedTransform::MakeIdentity()
+{
+	m_Matrix.MakeIdentity();
+	m_Flags = 0;
+}
+
+// Make a translation
+void CTrackedTransform::MakeTranslation( const CVector3& translate )
+{
+	m_Matrix.MakeTranslation( translate );
+	m_Flags = kTransformTranslation;
+}
+
+// Make a combined rotation around the X, Y & Z axes by the given angles (radians), applied in
+// the order specified
+void CTrackedTransform::MakeRotation
+(
+	const CVector3       angles,
+	const ERotationOrder eRotOrder /*= kZXY*/
+)
+{
+	m_Matrix.MakeRotation( angles, eRotOrder );
+	m_Flags = kTransformRotation;
+}
+
+// Make a rotation from a quaternion
+void CTrackedTransform::MakeRotation( const CQuaternion& quat )
+{
+	m_Matrix = CMatrix4x4( quat );
+	m_Flags = kTransformRotation;
+}
+
+// Make a scaling in X, Y and Z - flagged as uniform if all three values are the same
+void CTrackedTransform::MakeScaling( const CVector3& scale )
+{
+	m_Matrix.MakeScaling( scale );
+	m_Flags = ScaleFlags( scale );
+}
+
+// Make a uniform scaling
+void CTrackedTransform::MakeScaling( const TFloat32 fScale )
+{
+	m_Matrix.MakeScaling( fScale );
+	m_Flags = (fScale == 1.0f) ? 0 : kTransformUniformScale;
+}
+
+// Make an affine transformation from position, Euler angles and scale
+void CTrackedTransform::MakeAffineEuler
+(
+	const CVector3&      position,
+	const CVector3&      angles,
+	const ERotationOrder eRotOrder /*= kZXY*/,
+	const CVector3&      scale /*= CVector3::kOne*/
+)
+{
+	m_Matrix.MakeAffineEuler( position, angles, eRotOrder, scale );
+	m_Flags = kTransformRigid | ScaleFlags( scale );
+}
+
+// Make an affine transformation from quaternion, position and scale
+void CTrackedTransform::MakeAffineQuaternion
+(
+	const CQuaternion& quat,
+	const CVector3&    position /*= CVector3::kOrigin*/,
+	const CVector3&    scale /*= CVector3::kOne*/
+)
+{
+	m_Matrix.MakeAffineQuaternion( quat, position, scale );
+	m_Flags = kTransformRigid | ScaleFlags( scale );
+}
+
+
+/*-----------------------------------------------------------------------------------------
+	Combination
+-----------------------------------------------------------------------------------------*/
+
+// Combine with another transform - this transform is applied first
+CTrackedTransform& CTrackedTransform::operator*=
+(
+	const CTrackedTransform& t
+)
+{
+	// Just use binary operator*
+	*this = *this * t;
+	return *this;
+}
+
+// Combine two transforms - t1 is applied first then t2
+CTrackedTransform operator*
+(
+	const CTrackedTransform& t1,
+	const CTrackedTransform& t2
+)
+{
+	TTransformFlags flags = t1.m_Flags | t2.m_Flags;
+
+	// A non-uniform scale applied after a rotation (or shear) scales along axes that are not the
+	// local axes, which introduces shear. Other orderings keep the Scale*Rotation*Translation form
+	if ((t1.m_Flags & (kTransformRotation | kTransformShear)) && (t2.m_Flags & kTransformScale))
+	{
+		flags |= kTransformShear;
+	}
+
+	// Product of two affine matrices is affine - use the cheaper multiply where possible
+	if ((flags & kTransformProjective) == 0)
+	{
+		return CTrackedTransform( MultiplyAffine( t1.m_Matrix, t2.m_Matrix ), flags );
+	}
+	return CTrackedTransform( t1.m_Matrix * t2.m_Matrix, flags );
+}
+
+
+/*-----------------------------------------------------------------------------------------
+	Inverse / Normal Matrix / Decomposition
+-----------------------------------------------------------------------------------------*/
+
+// Set this transform to its inverse, using the cheapest routine valid for its flags
+void CTrackedTransform::Invert()
+{
+	*this = Inverse();
+}
+
+// Return the inverse of this transform, using the cheapest routine valid for its flags
+CTrackedTransform CTrackedTransform::Inverse() const
+{
+	GEN_GUARD_OPT;
+
+	CTrackedTransform inverse;
+	inverse.m_Flags = m_Flags;
+	if (m_Flags == 0)
+	{
+		inverse.m_Matrix = CMatrix4x4::kIdentity;
+	}
+	else if (m_Flags == kTransformTranslation)
+	{
+		inverse.m_Matrix = MatrixTranslation( -m_Matrix.GetPosition() );
+	}
+	else if (IsRigid())
+	{
+		inverse.m_Matrix = InverseRotTrans( m_Matrix );
+	}
+	else if (IsRotTransScale())
+	{
+		inverse.m_Matrix = InverseRotTransScale( m_Matrix );
+
+		// Inverse of Scale*Rotation is Rotation*Scale - a non-uniform scale now follows the
+		// rotation, so the result is no longer in the form InverseRotTransScale requires
+		if ((m_Flags & kTransformRotation) && (m_Flags & kTransformScale))
+		{
+			inverse.m_Flags |= kTransformShear;
+		}
+	}
+	else if (IsAffine())
+	{
+		inverse.m_Matrix = InverseAffine( m_Matrix );
+	}
+	else
+	{
+		inverse.m_Matrix = gen::Inverse( m_Matrix );
+	}
+
+#ifdef _DEBUG
+	VerifyInverse( inverse.m_Matrix );
+#endif
+	return inverse;
+
+	GEN_ENDGUARD_OPT;
+}
+
+// Return the matrix used to transform normals by this transform (inverse transpose of the
+// upper-left 3x3), with translation removed
+CMatrix4x4 CTrackedTransform::NormalMatrix() const
+{
+	CMatrix4x4 normalMatrix = m_Matrix;
+	normalMatrix.SetPosition( CVector3::kOrigin );
+
+	if (IsRigid())
+	{
+		// Inverse transpose of a rotation is the rotation itself
+	}
+	else if (IsRotTransScale())
+	{
+		// Inverse transpose of Scale*Rotation is Scale^-1 * Rotation, i.e. each axis (row)
+		// divided by its scale squared. A uniform scale doesn't change normal directions, so
+		// only needs this for non-uniform scale
+		if (m_Flags & kTransformScale)
+		{
+			for (TUInt32 row = 0; row < 3; ++row)
+			{
+				CVector4& axis = normalMatrix[row];
+				TFloat32 invScaleSq = 1.0f / (axis.x*axis.x + axis.y*axis.y + axis.z*axis.z);
+				axis.x *= invScaleSq;
+				axis.y *= invScaleSq;
+				axis.z *= invScaleSq;
+			}
+		}
+	}
+	else
+	{
+		// General case - invert and transpose the upper-left 3x3
+		normalMatrix.e03 = normalMatrix.e13 = normalMatrix.e23 = 0.0f;
+		normalMatrix.e33 = 1.0f;
+		normalMatrix = Transpose( InverseAffine( normalMatrix ) );
+	}
+	return normalMatrix;
+}
+
+// Decompose into position, quaternion and scale. Pass NULL for any unneeded parameters.
+// Returns false if the transform contains shear or projection, which cannot be decomposed
+bool CTrackedTransform::DecomposeQuaternion
+(
+	CVector3*    pPosition,
+	CQuaternion* pQuat,
+	CVector3*    pScale
+) const
+{
+	if (!IsRotTransScale())
+	{
+		return false;
+	}
+
+	if (IsRigid())
+	{
+		// No scale to remove - read the rotation straight from the matrix
+		if (pPosition) *pPosition = m_Matrix.GetPosition();
+		if (pQuat)     *pQuat = CQuaternion( m_Matrix );
+		if (pScale)    *pScale = CVector3::kOne;
+	}
+	else
+	{
+		m_Matrix.DecomposeAffineQuaternion( pPosition, pQuat, pScale );
+	}
+	return true;
+}
+
+// Decompose into position, Euler angles and scale. Pass NULL for any unneeded parameters.
+// Returns false if the transform contains shear or projection, which cannot be decomposed
+bool CTrackedTransform::DecomposeEuler
+(
+	CVector3*            pPosition,
+	CVector3*            pAngles,
+	CVector3*            pScale,
+	const ERotationOrder eRotOrder /*= kZXY*/
+) const
+{
+	if (!IsRotTransScale())
+	{
+		return false;
+	}
+
+	m_Matrix.DecomposeAffineEuler( pPosition, pAngles, pScale, eRotOrder );
+	return true;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+	Private functions
+-----------------------------------------------------------------------------------------*/
+
+#ifdef _DEBUG
+// Debug builds only: check that the given matrix really is the inverse of this transform
+void CTrackedTransform::VerifyInverse( const CMatrix4x4& inverse ) const
+{
+	// Product should be the identity. Compare with a loose tolerance - the point is to catch
+	// wrong flags (which give grossly wrong results), not float rounding
+	const TFloat32 kTolerance = 0.001f;
+	CMatrix4x4 product = m_Matrix * inverse;
+	const TFloat32* pElts = &product.e00;
+	for (TUInt32 elt = 0; elt < 16; ++elt)
+	{
+		TFloat32 expected = (elt % 5 == 0) ? 1.0f : 0.0f; // Diagonal elements are 0, 5, 10 & 15
+		GEN_ASSERT( AreEqualAbsolute( pElts[elt], expected, kTolerance ),
+		            "Transform flags do not match matrix contents" );
+	}
+}
+#endif
+
+
+} // namespace gen
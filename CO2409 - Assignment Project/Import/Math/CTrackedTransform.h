@@ -0,0 +1,258 @@
+/*******************************************
+	CTrackedTransform.h
+
+	A 4x4 transformation matrix that records
+	which kinds of operation were used to
+	build it, so the cheapest correct inverse,
+	normal matrix or decomposition can be used
+********************************************/
+
+// CMatrix4x4 offers several inverse functions (InverseRotTrans, InverseRotTransScale,
+// InverseAffine and Inverse) but the caller must know which one is valid for a given matrix.
+// This class carries that knowledge alongside the matrix: each builder function sets flags for
+// the operations it used, and combining transforms merges the flags. The flags are conservative
+// - they may describe a more general transform than the matrix actually is, but never a more
+// specific one. Debug builds verify each inverse against the original matrix
+
+#ifndef GEN_C_TRACKED_TRANSFORM_H_INCLUDED
+#define GEN_C_TRACKED_TRANSFORM_H_INCLUDED
+
+#include "GenDefines.h"
+#include "CVector3.h"
+#include "CVector4.h"
+#include "CMatrix4x4.h"
+#include "CQuaternion.h"
+
+namespace gen
+{
+
+// Classification flags for the operations that make up a transform. A transform with no flags
+// is the identity
+enum ETransformFlags
+{
+	kTransformTranslation  = 0x01,
+	kTransformRotation     = 0x02,
+	kTransformUniformScale = 0x04,
+	kTransformScale        = 0x08, // Non-uniform scale
+	kTransformShear        = 0x10, // General affine - axes no longer at right angles
+	kTransformProjective   = 0x20, // Last column not (0,0,0,1)
+
+	// Useful combinations
+	kTransformRigid        = kTransformTranslation | kTransformRotation,
+	kTransformAnyScale     = kTransformUniformScale | kTransformScale,
+	kTransformAffine       = kTransformRigid | kTransformAnyScale | kTransformShear
+};
+typedef TUInt32 TTransformFlags;
+
+
+// Transformation matrix with classification flags
+class CTrackedTransform
+{
+// Concrete class - public access
+public:
+	/*-----------------------------------------------------------------------------------------
+		Constructors/Destructors
+	-----------------------------------------------------------------------------------------*/
+
+	// Default constructor - identity transform
+	CTrackedTransform() : m_Matrix( CMatrix4x4::kIdentity ), m_Flags( 0 ) {}
+
+	// Construct from an existing matrix with caller supplied flags. If the flags are not known
+	// the default treats the matrix as a general projective matrix (always correct, but slowest)
+	explicit CTrackedTransform
+	(
+		const CMatrix4x4&     m,
+		const TTransformFlags flags = kTransformAffine | kTransformProjective
+	) : m_Matrix( m ), m_Flags( flags ) {}
+
+	// Copy constructor
+	CTrackedTransform
+	(
+		const CTrackedTransform& src
+	) : m_Matrix( src.m_Matrix ), m_Flags( src.m_Flags ) {}
+
+	// Assignment operator
+	CTrackedTransform& operator=
+	(
+		const CTrackedTransform& src
+	)
+	{
+		if ( this != &src )
+		{
+			m_Matrix = src.m_Matrix;
+			m_Flags = src.m_Flags;
+		}
+		return *this;
+	}
+
+	// Destructor
+	~CTrackedTransform() {}
+
+
+/*-----------------------------------------------------------------------------------------
+	Public functions
+-----------------------------------------------------------------------------------------*/
+public:
+
+	/*-----------------------------------------------------------------------------------------
+		Getters
+	-----------------------------------------------------------------------------------------*/
+
+	const CMatrix4x4& GetMatrix() const
+	{
+		return m_Matrix;
+	}
+
+	TTransformFlags GetFlags() const
+	{
+		return m_Flags;
+	}
+
+	// Transform contains rotation and translation only
+	bool IsRigid() const
+	{
+		return (m_Flags & ~kTransformRigid) == 0;
+	}
+
+	// Transform contains rotation, translation and (possibly non-uniform) scale, but no shear
+	bool IsRotTransScale() const
+	{
+		return (m_Flags & (kTransformShear | kTransformProjective)) == 0;
+	}
+
+	// Transform is affine (no projection)
+	bool IsAffine() const
+	{
+		return (m_Flags & kTransformProjective) == 0;
+	}
+
+	// Return the flags needed to describe the given scale - for use when constructing from an
+	// existing matrix whose scale is known
+	static TTransformFlags ScaleFlags( const CVector3& scale );
+
+
+	/*-----------------------------------------------------------------------------------------
+		Construction
+	-----------------------------------------------------------------------------------------*/
+
+	// Make an identity transform
+	void MakeIdentity();
+
+	// Make a translation
+	void MakeTranslation( const CVector3& translate );
+
+	// Make a combined rotation around the X, Y & Z axes by the given angles (radians), applied in
+	// the order specified
+	void MakeRotation
+	(
+		const CVector3       angles,
+		const ERotationOrder eRotOrder = kZXY
+	);
+
+	// Make a rotation from a quaternion
+	void MakeRotation( const CQuaternion& quat );
+
+	// Make a scaling in X, Y and Z - flagged as uniform if all three values are the same
+	void MakeScaling( const CVector3& scale );
+
+	// Make a uniform scaling
+	void MakeScaling( const TFloat32 fScale );
+
+	// Make an affine transformation from position, Euler angles and scale, built in the order
+	// M = Scale*Rotation*Translation - see CMatrix4x4::MakeAffineEuler
+	void MakeAffineEuler
+	(
+		const CVector3&      position,
+		const CVector3&      angles,
+		const ERotationOrder eRotOrder = kZXY,
+		const CVector3&      scale = CVector3::kOne
+	);
+
+	// Make an affine transformation from quaternion, position and scale, built in the order
+	// M = Scale*Rotation*Translation - see CMatrix4x4::MakeAffineQuaternion
+	void MakeAffineQuaternion
+	(
+		const CQuaternion& quat,
+		const CVector3&    position = CVector3::kOrigin,
+		const CVector3&    scale = CVector3::kOne
+	);
+
+
+	/*-----------------------------------------------------------------------------------------
+		Combination
+	-----------------------------------------------------------------------------------------*/
+
+	// Combine with another transform - this transform is applied first, as with CMatrix4x4
+	CTrackedTransform& operator*=
+	(
+		const CTrackedTransform& t
+	);
+
+	// Combine two transforms - t1 is applied first then t2
+	friend CTrackedTransform operator*
+	(
+		const CTrackedTransform& t1,
+		const CTrackedTransform& t2
+	);
+
+
+	/*-----------------------------------------------------------------------------------------
+		Inverse / Normal Matrix / Decomposition
+	-----------------------------------------------------------------------------------------*/
+
+	// Set this transform to its inverse, using the cheapest routine valid for its flags
+	void Invert();
+
+	// Return the inverse of this transform, using the cheapest routine valid for its flags
+	CTrackedTransform Inverse() const;
+
+	// Return the matrix used to transform normals by this transform (inverse transpose of the
+	// upper-left 3x3), with translation removed. Normals transformed by this matrix will need to
+	// be renormalised if the transform contains any scale
+	CMatrix4x4 NormalMatrix() const;
+
+	// Decompose into position, quaternion and scale. Pass NULL for any unneeded parameters.
+	// Returns false if the transform contains shear or projection, which cannot be decomposed
+	bool DecomposeQuaternion
+	(
+		CVector3*    pPosition,
+		CQuaternion* pQuat,
+		CVector3*    pScale
+	) const;
+
+	// Decompose into position, Euler angles and scale. Pass NULL for any unneeded parameters.
+	// Returns false if the transform contains shear or projection, which cannot be decomposed
+	bool DecomposeEuler
+	(
+		CVector3*            pPosition,
+		CVector3*            pAngles,
+		CVector3*            pScale,
+		const ERotationOrder eRotOrder = kZXY
+	) const;
+
+
+/*-----------------------------------------------------------------------------------------
+	Private functions
+-----------------------------------------------------------------------------------------*/
+private:
+
+#ifdef _DEBUG
+	// Debug builds only: check that the given matrix really is the inverse of this transform -
+	// catches flags that don't match the matrix contents
+	void VerifyInverse( const CMatrix4x4& inverse ) const;
+#endif
+
+
+/*-----------------------------------------------------------------------------------------
+	Data
+-----------------------------------------------------------------------------------------*/
+private:
+
+	CMatrix4x4      m_Matrix;
+	TTransformFlags m_Flags;
+};
+
+
+} // namespace gen
+
+#endif // GEN_C_TRACKED_TRANSFORM_H_INCLUDED
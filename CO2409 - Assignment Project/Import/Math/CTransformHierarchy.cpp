@@ -0,0 +1,338 @@
+/*******************************************
+	CTransformHierarchy.cpp
+
+	Hierarchy of transforms stored as a flat
+	array in parent-before-child order, with
+	world matrices updated in a linear sweep
+********************************************/
+
+#include "CTransformHierarchy.h"
+
+#include <atomic>
+
+#include "Error.h"
+#include "CJobSystem.h"
+
+namespace gen
+{
+
+/*---------------------------------------------------------------------------------------------
+	Constants
+---------------------------------------------------------------------------------------------*/
+
+// Changed nodes per job when an update is split over a job system - fewer are not worth queuing
+const TUInt32 kNodesPerJob = 2048;
+
+
+/*---------------------------------------------------------------------------------------------
+	Structure
+---------------------------------------------------------------------------------------------*/
+
+// Add a node with the given local matrix and parent node, returns the handle of the new node
+TUInt32 CTransformHierarchy::AddNode
+(
+	const CMatrix4x4& localMatrix,
+	const TUInt32     parent /*= kNoParent*/
+)
+{
+	GEN_GUARD_OPT;
+	GEN_ASSERT_OPT( parent == kNoParent || parent < GetNumNodes(), "Invalid parent node" );
+
+	// New nodes always go at the end of the arrays, so parents still come before children
+	TUInt32 node = GetNumNodes();
+	TUInt32 slot = static_cast<TUInt32>(m_Nodes.size());
+	TUInt32 parentSlot = (parent == kNoParent) ? kNoParent : m_Slots[parent];
+
+	m_Slots.push_back( slot );
+	m_ParentNodes.push_back( parent );
+	m_Nodes.push_back( node );
+	m_Parents.push_back( parentSlot );
+	m_SubtreeEnds.push_back( slot + 1 );
+	m_LocalMatrices.push_back( localMatrix );
+	m_WorldMatrices.push_back( localMatrix ); // Correct for roots, others wait for the update
+	m_Versions.push_back( 0 );
+	m_LocalDirty.push_back( 0 );
+	m_SubtreeDirty.push_back( 0 );
+
+	// The order is still depth-first if the parent's subtree ended at the end of the arrays.
+	// In that case every ancestor's subtree also ended there and now includes the new node
+	if (parentSlot != kNoParent && !m_LayoutDirty)
+	{
+		if (m_SubtreeEnds[parentSlot] == slot)
+		{
+			for (TUInt32 ancestor = parentSlot; ancestor != kNoParent; ancestor = m_Parents[ancestor])
+			{
+				m_SubtreeEnds[ancestor] = slot + 1;
+			}
+		}
+		else
+		{
+			m_LayoutDirty = true;
+		}
+	}
+
+	MarkDirty( slot );
+	return node;
+
+	GEN_ENDGUARD_OPT;
+}
+
+// Remove all nodes
+void CTransformHierarchy::Clear()
+{
+	m_Slots.clear();
+	m_ParentNodes.clear();
+	m_Nodes.clear();
+	m_Parents.clear();
+	m_SubtreeEnds.clear();
+	m_LocalMatrices.clear();
+	m_WorldMatrices.clear();
+	m_Versions.clear();
+	m_LocalDirty.clear();
+	m_SubtreeDirty.clear();
+	m_LayoutDirty = false;
+	m_NumUpdated = 0;
+}
+
+
+/*---------------------------------------------------------------------------------------------
+	Local Matrices
+---------------------------------------------------------------------------------------------*/
+
+// Change the local matrix of a node, marking it and its subtree for update
+void CTransformHierarchy::SetLocalMatrix
+(
+	const TUInt32     node,
+	const CMatrix4x4& localMatrix
+)
+{
+	TUInt32 slot = m_Slots[node];
+	m_LocalMatrices[slot] = localMatrix;
+	MarkDirty( slot );
+}
+
+// Mark the node in the given slot as changed, and flag its ancestors as having a change in their
+// subtree. Stops at the first ancestor already flagged - its own ancestors must be flagged too
+void CTransformHierarchy::MarkDirty( const TUInt32 slot )
+{
+	m_LocalDirty[slot] = 1;
+	for (TUInt32 ancestor = slot; ancestor != kNoParent && !m_SubtreeDirty[ancestor]; ancestor = m_Parents[ancestor])
+	{
+		m_SubtreeDirty[ancestor] = 1;
+	}
+}
+
+
+/*---------------------------------------------------------------------------------------------
+	World Matrices
+---------------------------------------------------------------------------------------------*/
+
+// Recalculate the world matrices of all nodes that have changed since the last update. With a job
+// system the changed root subtrees are shared out as jobs, each taking a run of roots covering
+// roughly kNodesPerJob nodes
+TUInt32 CTransformHierarchy::Update( CJobSystem* pJobs /*= 0*/ )
+{
+	if (m_LayoutDirty)
+	{
+		Relayout();
+	}
+
+	// The root subtrees with changes are independent so can be updated in parallel. Only worth
+	// doing if there is enough work
+	vector<TUInt32> roots;
+	TUInt32 numChanged = 0;
+	if (pJobs && pJobs->GetNumThreads() > 1)
+	{
+		numChanged = FindChangedRoots( roots );
+	}
+	if (numChanged < 2 * kNodesPerJob)
+	{
+		m_NumUpdated = UpdateRange( 0, static_cast<TUInt32>(m_Nodes.size()) );
+		return m_NumUpdated;
+	}
+
+	TUInt32 numRoots = static_cast<TUInt32>(roots.size());
+	TUInt32 rootsPerJob = static_cast<TUInt32>((static_cast<TUInt64>(numRoots) * kNodesPerJob) / numChanged);
+	atomic<TUInt32> numUpdated( 0 );
+	pJobs->ParallelFor( numRoots, rootsPerJob, [&]( TUInt32 first, TUInt32 end )
+	{
+		TUInt32 count = 0;
+		for (TUInt32 root = first; root < end; ++root)
+		{
+			count += UpdateRange( roots[root], m_SubtreeEnds[roots[root]] );
+		}
+		numUpdated += count;
+	} );
+	m_NumUpdated = numUpdated.load();
+	return m_NumUpdated;
+}
+
+// Collect the slots of the root nodes whose subtrees contain changes, returns the total size of
+// those subtrees (an upper bound on the work - only changed branches are visited)
+TUInt32 CTransformHierarchy::FindChangedRoots( vector<TUInt32>& roots ) const
+{
+	TUInt32 numSlots = static_cast<TUInt32>(m_Nodes.size());
+	TUInt32 numChanged = 0;
+	for (TUInt32 slot = 0; slot < numSlots; slot = m_SubtreeEnds[slot])
+	{
+		if (m_SubtreeDirty[slot])
+		{
+			roots.push_back( slot );
+			numChanged += m_SubtreeEnds[slot] - slot;
+		}
+	}
+	return numChanged;
+}
+
+// Update the world matrices of the changed nodes in the slots [first, end), which must be a set
+// of whole subtrees. Returns the number of matrices recalculated
+TUInt32 CTransformHierarchy::UpdateRange
+(
+	TUInt32       first,
+	const TUInt32 end
+)
+{
+	TUInt32 numUpdated = 0;
+	TUInt32 slot = first;
+	while (slot < end)
+	{
+		if (!m_SubtreeDirty[slot])
+		{
+			// Nothing changed in this branch - skip the whole subtree
+			slot = m_SubtreeEnds[slot];
+		}
+		else if (m_LocalDirty[slot])
+		{
+			// This node changed so every node in its subtree has a new world matrix. Parents are
+			// always earlier in the arrays, so each parent's world matrix is ready when needed
+			TUInt32 subtreeEnd = m_SubtreeEnds[slot];
+			for (TUInt32 node = slot; node < subtreeEnd; ++node)
+			{
+				TUInt32 parent = m_Parents[node];
+				if (parent == kNoParent)
+				{
+					m_WorldMatrices[node] = m_LocalMatrices[node];
+				}
+				else
+				{
+					m_WorldMatrices[node] = MultiplyAffine( m_LocalMatrices[node], m_WorldMatrices[parent] );
+				}
+				++m_Versions[node];
+				m_LocalDirty[node] = 0;
+				m_SubtreeDirty[node] = 0;
+			}
+			numUpdated += subtreeEnd - slot;
+			slot = subtreeEnd;
+		}
+		else
+		{
+			// A descendant changed but this node didn't - step into its children
+			m_SubtreeDirty[slot] = 0;
+			++slot;
+		}
+	}
+	return numUpdated;
+}
+
+// Put the nodes back into depth-first order and mark them all for update
+void CTransformHierarchy::Relayout()
+{
+	TUInt32 numNodes = GetNumNodes();
+
+	// List the children of each node (by handle) in the order they were added
+	vector<TUInt32> firstChild( numNodes + 1, 0 );
+	for (TUInt32 node = 0; node < numNodes; ++node)
+	{
+		if (m_ParentNodes[node] != kNoParent)
+		{
+			++firstChild[m_ParentNodes[node] + 1];
+		}
+	}
+	for (TUInt32 node = 0; node < numNodes; ++node)
+	{
+		firstChild[node + 1] += firstChild[node];
+	}
+	vector<TUInt32> children( numNodes );
+	vector<TUInt32> nextChild( firstChild.begin(), firstChild.end() - 1 );
+	for (TUInt32 node = 0; node < numNodes; ++node)
+	{
+		if (m_ParentNodes[node] != kNoParent)
+		{
+			children[nextChild[m_ParentNodes[node]]++] = node;
+		}
+	}
+
+	// Depth-first walk from each root, with an explicit stack of nodes still to visit (children
+	// pushed in reverse so they come off in order)
+	vector<TUInt32> order;
+	order.reserve( numNodes );
+	vector<TUInt32> stack;
+	for (TUInt32 root = 0; root < numNodes; ++root)
+	{
+		if (m_ParentNodes[root] != kNoParent)
+		{
+			continue;
+		}
+		stack.push_back( root );
+		while (!stack.empty())
+		{
+			TUInt32 node = stack.back();
+			stack.pop_back();
+			order.push_back( node );
+			for (TUInt32 child = firstChild[node + 1]; child > firstChild[node]; --child)
+			{
+				stack.push_back( children[child - 1] );
+			}
+		}
+	}
+
+	// Rebuild the slot arrays in the new order
+	TMatrices localMatrices( numNodes );
+	TMatrices worldMatrices( numNodes );
+	vector<TUInt32> versions( numNodes );
+	for (TUInt32 slot = 0; slot < numNodes; ++slot)
+	{
+		TUInt32 oldSlot = m_Slots[order[slot]];
+		localMatrices[slot] = m_LocalMatrices[oldSlot];
+		worldMatrices[slot] = m_WorldMatrices[oldSlot];
+		versions[slot] = m_Versions[oldSlot];
+	}
+	m_LocalMatrices.swap( localMatrices );
+	m_WorldMatrices.swap( worldMatrices );
+	m_Versions.swap( versions );
+	m_Nodes = order;
+	for (TUInt32 slot = 0; slot < numNodes; ++slot)
+	{
+		m_Slots[order[slot]] = slot;
+	}
+	for (TUInt32 slot = 0; slot < numNodes; ++slot)
+	{
+		TUInt32 parent = m_ParentNodes[order[slot]];
+		m_Parents[slot] = (parent == kNoParent) ? kNoParent : m_Slots[parent];
+	}
+
+	// Subtree ends, working backwards so children are finished before their parents
+	for (TUInt32 slot = 0; slot < numNodes; ++slot)
+	{
+		m_SubtreeEnds[slot] = slot + 1;
+	}
+	for (TUInt32 slot = numNodes; slot-- > 0; )
+	{
+		TUInt32 parent = m_Parents[slot];
+		if (parent != kNoParent && m_SubtreeEnds[slot] > m_SubtreeEnds[parent])
+		{
+			m_SubtreeEnds[parent] = m_SubtreeEnds[slot];
+		}
+	}
+
+	// Simplest to recalculate everything after a change of structure
+	for (TUInt32 slot = 0; slot < numNodes; ++slot)
+	{
+		m_LocalDirty[slot] = 1;
+		m_SubtreeDirty[slot] = 1;
+	}
+	m_LayoutDirty = false;
+}
+
+
+} // namespace gen
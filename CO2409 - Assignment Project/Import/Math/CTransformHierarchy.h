@@ -0,0 +1,177 @@
+/*******************************************
+	CTransformHierarchy.h
+
+	Hierarchy of transforms stored as a flat
+	array in parent-before-child order, with
+	world matrices updated in a linear sweep
+********************************************/
+
+// Each node has a local matrix relative to its parent (or to the world for root nodes). Nodes are
+// stored depth-first, so every subtree is a contiguous range of the arrays starting at its root.
+// Update calculates world matrices in a single forward pass - a parent's world matrix is always
+// ready before its children need it. Changing a local matrix marks the node dirty and flags its
+// ancestors, so the update skips any branch that contains no changes and only recalculates the
+// subtrees below changed nodes.
+//
+// Nodes are identified by handles returned from AddNode, which stay valid when the nodes are
+// reordered internally. Adding a child to a node that isn't at the end of the arrays breaks the
+// depth-first order, which is restored at the next update (a one-off full recalculation)
+
+#ifndef GEN_C_TRANSFORM_HIERARCHY_H_INCLUDED
+#define GEN_C_TRANSFORM_HIERARCHY_H_INCLUDED
+
+#include <vector>
+using namespace std;
+
+#include "GenDefines.h"
+#include "AlignedAllocator.h"
+#include "CMatrix4x4.h"
+
+namespace gen
+{
+
+class CJobSystem;
+
+class CTransformHierarchy
+{
+// Concrete class - public access
+public:
+	// Parent value used for root nodes
+	static const TUInt32 kNoParent = 0xffffffff;
+
+
+	/*-----------------------------------------------------------------------------------------
+		Constructors
+	-----------------------------------------------------------------------------------------*/
+
+	// Default constructor - empty hierarchy
+	CTransformHierarchy() : m_LayoutDirty( false ), m_NumUpdated( 0 ) {}
+
+
+	/*-----------------------------------------------------------------------------------------
+		Structure
+	-----------------------------------------------------------------------------------------*/
+
+	// Add a node with the given local matrix (which must be affine) and parent node, returns the
+	// handle of the new node. The world matrix of the new node is valid after the next Update
+	TUInt32 AddNode
+	(
+		const CMatrix4x4& localMatrix,
+		const TUInt32     parent = kNoParent
+	);
+
+	// Remove all nodes
+	void Clear();
+
+	TUInt32 GetNumNodes() const
+	{
+		return static_cast<TUInt32>(m_Slots.size());
+	}
+
+	TUInt32 GetParent( const TUInt32 node ) const
+	{
+		return m_ParentNodes[node];
+	}
+
+
+	/*-----------------------------------------------------------------------------------------
+		Local Matrices
+	-----------------------------------------------------------------------------------------*/
+
+	const CMatrix4x4& GetLocalMatrix( const TUInt32 node ) const
+	{
+		return m_LocalMatrices[m_Slots[node]];
+	}
+
+	// Change the local matrix of a node (must be affine), marking it and its subtree for update
+	void SetLocalMatrix
+	(
+		const TUInt32     node,
+		const CMatrix4x4& localMatrix
+	);
+
+
+	/*-----------------------------------------------------------------------------------------
+		World Matrices
+	-----------------------------------------------------------------------------------------*/
+
+	// Recalculate the world matrices of all nodes whose local matrix, or any ancestor's local
+	// matrix, has changed since the last update. If a job system is given, separate root subtrees
+	// are shared out as jobs, so a hierarchy with a single root always updates on the calling
+	// thread. Returns the number of world matrices recalculated
+	TUInt32 Update( CJobSystem* pJobs = 0 );
+
+	// World matrix of a node as calculated by the last update
+	const CMatrix4x4& GetWorldMatrix( const TUInt32 node ) const
+	{
+		return m_WorldMatrices[m_Slots[node]];
+	}
+
+	// Increases each time the world matrix of a node is recalculated - compare with an earlier
+	// value to see if the node has moved
+	TUInt32 GetVersion( const TUInt32 node ) const
+	{
+		return m_Versions[m_Slots[node]];
+	}
+
+	// Number of world matrices recalculated by the last update
+	TUInt32 GetNumUpdated() const
+	{
+		return m_NumUpdated;
+	}
+
+
+/*-----------------------------------------------------------------------------------------
+	Private functions
+-----------------------------------------------------------------------------------------*/
+private:
+
+	// Mark the node in the given slot as changed, and flag its ancestors as having a change
+	// in their subtree
+	void MarkDirty( const TUInt32 slot );
+
+	// Put the nodes back into depth-first order and mark them all for update
+	void Relayout();
+
+	// Collect the slots of the root nodes whose subtrees contain changes, returns the total size of
+	// those subtrees
+	TUInt32 FindChangedRoots( vector<TUInt32>& roots ) const;
+
+	// Update the world matrices of the changed nodes in the slots [first, end), which must be a
+	// set of whole subtrees. Returns the number of matrices recalculated
+	TUInt32 UpdateRange
+	(
+		TUInt32       first,
+		const TUInt32 end
+	);
+
+
+/*-----------------------------------------------------------------------------------------
+	Data
+-----------------------------------------------------------------------------------------*/
+private:
+
+	typedef vector<CMatrix4x4, CAlignedAllocator<CMatrix4x4> > TMatrices;
+
+	// Indexed by node handle
+	vector<TUInt32> m_Slots;       // Current position of each node in the arrays below
+	vector<TUInt32> m_ParentNodes; // Handle of each node's parent
+
+	// Indexed by slot, depth-first order
+	vector<TUInt32> m_Nodes;        // Handle of the node in each slot
+	vector<TUInt32> m_Parents;      // Slot of parent, always less than the slot of the child
+	vector<TUInt32> m_SubtreeEnds;  // One past the last slot in the node's subtree
+	TMatrices       m_LocalMatrices;
+	TMatrices       m_WorldMatrices;
+	vector<TUInt32> m_Versions;
+	vector<TUInt8>  m_LocalDirty;   // Local matrix changed since last update
+	vector<TUInt8>  m_SubtreeDirty; // Node or a descendant changed since last update
+
+	bool            m_LayoutDirty;  // Nodes are not in depth-first order, m_SubtreeEnds not valid
+	TUInt32         m_NumUpdated;
+};
+
+
+} // namespace gen
+
+#endif // GEN_C_TRANSFORM_HIERARCHY_H_INCLUDED
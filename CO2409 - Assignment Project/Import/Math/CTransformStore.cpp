@@ -0,0 +1,492 @@
+/*******************************************
+	CTransformStore.cpp
+
+	Structure-of-arrays store of object
+	transforms and bounds, indexed by stable
+	handles, for whole-scene update passes
+********************************************/
+
+#include "CTransformStore.h"
+
+#include <atomic>
+
+#include "Error.h"
+#include "CJobSystem.h"
+
+namespace gen
+{
+
+/*---------------------------------------------------------------------------------------------
+	Constants
+---------------------------------------------------------------------------------------------*/
+
+const TUInt32 CTransformStore::kNoNode;
+
+// Transforms per job in parallel updates - most are usually clean and cost only a flag test
+const TUInt32 kTransformsPerJob = 4096;
+
+
+/*---------------------------------------------------------------------------------------------
+	Transforms
+---------------------------------------------------------------------------------------------*/
+
+// Add a transform with the given position, Euler angles and scale, returns its handle
+TUInt32 CTransformStore::Add
+(
+	const CVector3& position /*= CVector3::kOrigin*/,
+	const CVector3& rotation /*= CVector3::kZero*/,
+	const CVector3& scale /*= CVector3::kOne*/
+)
+{
+	TUInt32 handle = AddEntry();
+	m_Positions.push_back( position );
+	m_Rotations.push_back( rotation );
+	m_Orientations.push_back( QuaternionRotation( rotation, kZXY ) );
+	m_Scales.push_back( scale );
+	m_Matrices.push_back( CMatrix4x4::kIdentity );
+	m_Versions.push_back( 0 );
+	m_Flags.push_back( kMatrixDirty | kBoundsDirty );
+	m_Nodes.push_back( kNoNode );
+	m_BoundsNodes.push_back( kNoNode );
+	m_LocalBoxes.push_back( CAABB( CVector3::kOrigin, CVector3::kOrigin ) );
+	m_LocalSpheres.push_back( CSphere( CVector3::kOrigin, 0.0f ) );
+	m_WorldBoxes.push_back( CAABB( CVector3::kOrigin, CVector3::kOrigin ) );
+	m_WorldSpheres.push_back( CSphere( CVector3::kOrigin, 0.0f ) );
+	m_BoundsVersions.push_back( 0 );
+	return handle;
+}
+
+// Add a copy of an existing transform (not including its hierarchy link), returns its handle
+TUInt32 CTransformStore::Copy( const TUInt32 handle )
+{
+	GEN_GUARD_OPT;
+	GEN_ASSERT_OPT( handle < m_Indices.size() && m_Indices[handle] < GetCount(), "Invalid transform handle" );
+
+	// Take copies of the source values first - adding to the arrays may move them
+	TUInt32 index = m_Indices[handle];
+	CVector3    position    = m_Positions[index];
+	CVector3    rotation    = m_Rotations[index];
+	CQuaternion orientation = m_Orientations[index];
+	CVector3    scale       = m_Scales[index];
+	CMatrix4x4  matrix      = m_Matrices[index];
+	TUInt8      flags       = m_Flags[index];
+	CAABB       localBox    = m_LocalBoxes[index];
+	CSphere     localSphere = m_LocalSpheres[index];
+
+	TUInt32 copy = Add( position, rotation, scale );
+	TUInt32 copyIndex = m_Indices[copy];
+	m_Orientations[copyIndex] = orientation;
+	m_Matrices[copyIndex] = matrix;
+	m_Flags[copyIndex] = flags | kMatrixDirty | kBoundsDirty;
+	m_LocalBoxes[copyIndex] = localBox;
+	m_LocalSpheres[copyIndex] = localSphere;
+	return copy;
+
+	GEN_ENDGUARD_OPT;
+}
+
+// Remove a transform, moving the last transform into its place to keep the arrays dense
+void CTransformStore::Remove( const TUInt32 handle )
+{
+	GEN_GUARD_OPT;
+	GEN_ASSERT_OPT( handle < m_Indices.size() && m_Indices[handle] < GetCount(), "Invalid transform handle" );
+
+	TUInt32 index = m_Indices[handle];
+	TUInt32 last = GetCount() - 1;
+	if (index != last)
+	{
+		m_Handles[index]        = m_Handles[last];
+		m_Positions[index]      = m_Positions[last];
+		m_Rotations[index]      = m_Rotations[last];
+		m_Orientations[index]   = m_Orientations[last];
+		m_Scales[index]         = m_Scales[last];
+		m_Matrices[index]       = m_Matrices[last];
+		m_Versions[index]       = m_Versions[last];
+		m_Flags[index]          = m_Flags[last];
+		m_Nodes[index]          = m_Nodes[last];
+		m_BoundsNodes[index]    = m_BoundsNodes[last];
+		m_LocalBoxes[index]     = m_LocalBoxes[last];
+		m_LocalSpheres[index]   = m_LocalSpheres[last];
+		m_WorldBoxes[index]     = m_WorldBoxes[last];
+		m_WorldSpheres[index]   = m_WorldSpheres[last];
+		m_BoundsVersions[index] = m_BoundsVersions[last];
+		m_Indices[m_Handles[index]] = index;
+	}
+
+	m_Handles.pop_back();
+	m_Positions.pop_back();
+	m_Rotations.pop_back();
+	m_Orientations.pop_back();
+	m_Scales.pop_back();
+	m_Matrices.pop_back();
+	m_Versions.pop_back();
+	m_Flags.pop_back();
+	m_Nodes.pop_back();
+	m_BoundsNodes.pop_back();
+	m_LocalBoxes.pop_back();
+	m_LocalSpheres.pop_back();
+	m_WorldBoxes.pop_back();
+	m_WorldSpheres.pop_back();
+	m_BoundsVersions.pop_back();
+
+	m_Indices[handle] = kNoNode; // Catch use of a removed handle
+	m_FreeHandles.push_back( handle );
+
+	GEN_ENDGUARD_OPT;
+}
+
+// Make space for the given total number of transforms
+void CTransformStore::Reserve( const TUInt32 count )
+{
+	m_Indices.reserve( count );
+	m_Handles.reserve( count );
+	m_Positions.reserve( count );
+	m_Rotations.reserve( count );
+	m_Orientations.reserve( count );
+	m_Scales.reserve( count );
+	m_Matrices.reserve( count );
+	m_Versions.reserve( count );
+	m_Flags.reserve( count );
+	m_Nodes.reserve( count );
+	m_BoundsNodes.reserve( count );
+	m_LocalBoxes.reserve( count );
+	m_LocalSpheres.reserve( count );
+	m_WorldBoxes.reserve( count );
+	m_WorldSpheres.reserve( count );
+	m_BoundsVersions.reserve( count );
+}
+
+// Allocate a handle for a new entry at the end of the arrays, returns the handle
+TUInt32 CTransformStore::AddEntry()
+{
+	TUInt32 index = GetCount();
+	TUInt32 handle;
+	if (m_FreeHandles.empty())
+	{
+		handle = static_cast<TUInt32>(m_Indices.size());
+		m_Indices.push_back( index );
+	}
+	else
+	{
+		handle = m_FreeHandles.back();
+		m_FreeHandles.pop_back();
+		m_Indices[handle] = index;
+	}
+	m_Handles.push_back( handle );
+	return handle;
+}
+
+
+/*---------------------------------------------------------------------------------------------
+	Hierarchy
+---------------------------------------------------------------------------------------------*/
+
+// Link a transform to a hierarchy node, with a possibly different node for its bounds
+void CTransformStore::SetHierarchyNode
+(
+	const TUInt32 handle,
+	const TUInt32 node,
+	const TUInt32 boundsNode
+)
+{
+	GEN_GUARD_OPT;
+	GEN_ASSERT_OPT( m_pHierarchy || node == kNoNode, "No hierarchy set" );
+
+	TUInt32 index = m_Indices[handle];
+	m_Nodes[index] = node;
+	m_BoundsNodes[index] = boundsNode;
+	m_Flags[index] |= kBoundsDirty; // Versions now come from a different counter
+
+	GEN_ENDGUARD_OPT;
+}
+
+
+/*---------------------------------------------------------------------------------------------
+	Local Transform
+---------------------------------------------------------------------------------------------*/
+
+// Exact comparison of two vectors. The CVector3 operators allow a few units of rounding error,
+// which would drop a very small change while keeping the old value, so an object moved in small
+// steps would never move at all
+inline bool IsChanged( const CVector3& v1, const CVector3& v2 )
+{
+	return v1.x != v2.x || v1.y != v2.y || v1.z != v2.z;
+}
+
+void CTransformStore::SetPosition
+(
+	const TUInt32   handle,
+	const CVector3& position
+)
+{
+	TUInt32 index = m_Indices[handle];
+	if (IsChanged( position, m_Positions[index] ))
+	{
+		m_Positions[index] = position;
+		m_Flags[index] |= kMatrixDirty;
+	}
+}
+
+// Set Euler angles. Also sets the quaternion if the transform is using one
+void CTransformStore::SetRotation
+(
+	const TUInt32   handle,
+	const CVector3& rotation
+)
+{
+	TUInt32 index = m_Indices[handle];
+	m_Rotations[index] = rotation;
+	if (m_Flags[index] & kUseQuaternion)
+	{
+		m_Orientations[index] = QuaternionRotation( rotation, kZXY );
+	}
+	m_Flags[index] |= kMatrixDirty;
+}
+
+// Set the quaternion, also switches the transform to use it
+void CTransformStore::SetOrientation
+(
+	const TUInt32      handle,
+	const CQuaternion& orientation
+)
+{
+	TUInt32 index = m_Indices[handle];
+	m_Orientations[index] = orientation;
+	m_Flags[index] |= kUseQuaternion | kMatrixDirty;
+}
+
+// Switch between Euler angles and quaternion, converting the current rotation
+void CTransformStore::SetUseQuaternion
+(
+	const TUInt32 handle,
+	const bool    useQuaternion
+)
+{
+	TUInt32 index = m_Indices[handle];
+	if (useQuaternion == ((m_Flags[index] & kUseQuaternion) != 0))
+	{
+		return;
+	}
+
+	// Convert the current orientation to the new representation so the transform doesn't jump
+	if (useQuaternion)
+	{
+		m_Orientations[index] = QuaternionRotation( m_Rotations[index], kZXY );
+		m_Flags[index] |= kUseQuaternion;
+	}
+	else
+	{
+		UpdateMatrix( handle );
+		m_Matrices[index].DecomposeAffineEuler( 0, &m_Rotations[index], 0 );
+		m_Flags[index] &= ~kUseQuaternion;
+	}
+	m_Flags[index] |= kMatrixDirty; // Same orientation, but rebuilding from the new representation may differ by rounding
+}
+
+void CTransformStore::SetScale
+(
+	const TUInt32   handle,
+	const CVector3& scale
+)
+{
+	TUInt32 index = m_Indices[handle];
+	if (IsChanged( scale, m_Scales[index] ))
+	{
+		m_Scales[index] = scale;
+		m_Flags[index] |= kMatrixDirty;
+	}
+}
+
+
+/*---------------------------------------------------------------------------------------------
+	Matrices
+---------------------------------------------------------------------------------------------*/
+
+// World matrix, from the hierarchy if linked to a node
+const CMatrix4x4& CTransformStore::GetWorldMatrix( const TUInt32 handle ) const
+{
+	TUInt32 index = m_Indices[handle];
+	TUInt32 node = m_Nodes[index];
+	return (node != kNoNode) ? m_pHierarchy->GetWorldMatrix( node ) : m_Matrices[index];
+}
+
+// Increases whenever the world matrix changes
+TUInt32 CTransformStore::GetVersion( const TUInt32 handle ) const
+{
+	TUInt32 index = m_Indices[handle];
+	TUInt32 node = m_Nodes[index];
+	return (node != kNoNode) ? m_pHierarchy->GetVersion( node ) : m_Versions[index];
+}
+
+// Rebuild the matrix of one transform if dirty. Returns true if it was rebuilt
+bool CTransformStore::UpdateMatrix( const TUInt32 handle )
+{
+	TUInt32 index = m_Indices[handle];
+	if (!(m_Flags[index] & kMatrixDirty))
+	{
+		return false;
+	}
+	BuildMatrix( index );
+	if (m_Nodes[index] != kNoNode)
+	{
+		m_pHierarchy->SetLocalMatrix( m_Nodes[index], m_Matrices[index] );
+	}
+	return true;
+}
+
+// Rebuild the matrices of all dirty transforms in one pass, returns the number rebuilt
+TUInt32 CTransformStore::UpdateMatrices( CJobSystem* pJobs /*= 0*/ )
+{
+	TUInt32 count = GetCount();
+	TUInt32 numUpdated;
+	if (pJobs)
+	{
+		atomic<TUInt32> jobsUpdated( 0 );
+		pJobs->ParallelFor( count, kTransformsPerJob, [&]( TUInt32 first, TUInt32 end )
+		{
+			jobsUpdated += UpdateMatrixRange( first, end );
+		} );
+		numUpdated = jobsUpdated.load();
+	}
+	else
+	{
+		numUpdated = UpdateMatrixRange( 0, count );
+	}
+
+	// Passing matrices to the hierarchy changes flags shared between nodes, so is done afterwards on
+	// this thread rather than in the jobs
+	if (numUpdated > 0 && m_pHierarchy)
+	{
+		for (TUInt32 index = 0; index < count; ++index)
+		{
+			if (m_Flags[index] & kNodeDirty)
+			{
+				m_pHierarchy->SetLocalMatrix( m_Nodes[index], m_Matrices[index] );
+				m_Flags[index] &= ~kNodeDirty;
+			}
+		}
+	}
+	return numUpdated;
+}
+
+// Rebuild the dirty matrices in the indices [first, end). Matrices of transforms linked to the
+// hierarchy are flagged to be passed on later. Only the flags are read for clean transforms - one
+// byte each, so a cache line covers 64
+TUInt32 CTransformStore::UpdateMatrixRange
+(
+	const TUInt32 first,
+	const TUInt32 end
+)
+{
+	TUInt32 numUpdated = 0;
+	for (TUInt32 index = first; index < end; ++index)
+	{
+		if (m_Flags[index] & kMatrixDirty)
+		{
+			BuildMatrix( index );
+			if (m_Nodes[index] != kNoNode)
+			{
+				m_Flags[index] |= kNodeDirty;
+			}
+			++numUpdated;
+		}
+	}
+	return numUpdated;
+}
+
+// Build the matrix at the given index
+void CTransformStore::BuildMatrix( const TUInt32 index )
+{
+	// Build the matrix directly into place rather than multiplying separate matrices together. The
+	// result is the same as Scaling * ZRot * XRot * YRot * Translation
+	if (m_Flags[index] & kUseQuaternion)
+	{
+		m_Matrices[index].MakeAffineQuaternion( m_Orientations[index], m_Positions[index], m_Scales[index] );
+	}
+	else
+	{
+		m_Matrices[index].MakeAffineEuler( m_Positions[index], m_Rotations[index], kZXY, m_Scales[index] );
+	}
+	m_Flags[index] &= ~kMatrixDirty;
+	++m_Versions[index];
+}
+
+
+/*---------------------------------------------------------------------------------------------
+	Bounds
+---------------------------------------------------------------------------------------------*/
+
+// Set the bounding volumes of a transform's geometry in model space
+void CTransformStore::SetLocalBounds
+(
+	const TUInt32  handle,
+	const CAABB&   box,
+	const CSphere& sphere
+)
+{
+	TUInt32 index = m_Indices[handle];
+	m_LocalBoxes[index] = box;
+	m_LocalSpheres[index] = sphere;
+	m_Flags[index] |= kBoundsDirty;
+}
+
+// Recalculate the world bounds of one transform if out of date
+bool CTransformStore::UpdateBounds( const TUInt32 handle )
+{
+	return UpdateBoundsAt( m_Indices[handle] );
+}
+
+// Recalculate all out of date world bounds in one pass, returns the number recalculated
+TUInt32 CTransformStore::UpdateBounds( CJobSystem* pJobs /*= 0*/ )
+{
+	// Each transform only writes its own bounds and reads the hierarchy, so jobs never overlap
+	if (!pJobs)
+	{
+		return UpdateBoundsRange( 0, GetCount() );
+	}
+	atomic<TUInt32> numUpdated( 0 );
+	pJobs->ParallelFor( GetCount(), kTransformsPerJob, [&]( TUInt32 first, TUInt32 end )
+	{
+		numUpdated += UpdateBoundsRange( first, end );
+	} );
+	return numUpdated.load();
+}
+
+// Recalculate the out of date world bounds in the indices [first, end)
+TUInt32 CTransformStore::UpdateBoundsRange
+(
+	const TUInt32 first,
+	const TUInt32 end
+)
+{
+	TUInt32 numUpdated = 0;
+	for (TUInt32 index = first; index < end; ++index)
+	{
+		if (UpdateBoundsAt( index ))
+		{
+			++numUpdated;
+		}
+	}
+	return numUpdated;
+}
+
+// Recalculate the world bounds at the given index if the matrix they depend on has a new version
+bool CTransformStore::UpdateBoundsAt( const TUInt32 index )
+{
+	TUInt32 boundsNode = m_BoundsNodes[index];
+	TUInt32 version = (boundsNode != kNoNode) ? m_pHierarchy->GetVersion( boundsNode ) : m_Versions[index];
+	if (!(m_Flags[index] & kBoundsDirty) && m_BoundsVersions[index] == version)
+	{
+		return false;
+	}
+
+	const CMatrix4x4& matrix = (boundsNode != kNoNode) ? m_pHierarchy->GetWorldMatrix( boundsNode ) : m_Matrices[index];
+	m_WorldBoxes[index] = m_LocalBoxes[index].Transform( matrix );
+	m_WorldSpheres[index] = m_LocalSpheres[index].Transform( matrix );
+	m_BoundsVersions[index] = version;
+	m_Flags[index] &= ~kBoundsDirty;
+	return true;
+}
+
+
+} // namespace gen
@@ -0,0 +1,346 @@
+/*******************************************
+	CTransformStore.h
+
+	Structure-of-arrays store of object
+	transforms and bounds, indexed by stable
+	handles, for whole-scene update passes
+********************************************/
+
+// Per-frame work on a scene (updating matrices, recalculating bounds, culling, sorting) only needs
+// a small part of each object - position, rotation, scale, matrix and bounds. Keeping that data in
+// separate contiguous arrays, rather than inside each (large, separately allocated) object, means
+// these passes stream linearly through memory and each cache line fetched is full of useful data.
+//
+// Each transform is identified by a handle returned from Add, which stays valid until Remove. The
+// arrays are kept dense: removing a transform moves the last one into its place, so array indexes
+// (GetIndex) can change while handles never do.
+//
+// Rotations are held either as Euler angles (in ZXY order) or as a quaternion, as selected for
+// each transform. Setters mark the transform dirty and UpdateMatrices rebuilds only the dirty
+// matrices. A transform may be linked to a node of a transform hierarchy, in which case its matrix
+// is the local matrix of that node and world data comes from the hierarchy
+
+#ifndef GEN_C_TRANSFORM_STORE_H_INCLUDED
+#define GEN_C_TRANSFORM_STORE_H_INCLUDED
+
+#include <vector>
+using namespace std;
+
+#include "GenDefines.h"
+#include "AlignedAllocator.h"
+#include "CVector3.h"
+#include "CQuaternion.h"
+#include "CMatrix4x4.h"
+#include "BoundingVolumes.h"
+#include "CTransformHierarchy.h"
+
+namespace gen
+{
+
+class CJobSystem;
+
+class CTransformStore
+{
+// Concrete class - public access
+public:
+	// Value used for "no hierarchy node"
+	static const TUInt32 kNoNode = CTransformHierarchy::kNoParent;
+
+
+	/*-----------------------------------------------------------------------------------------
+		Constructors
+	-----------------------------------------------------------------------------------------*/
+
+	// Default constructor - empty store, not linked to a hierarchy
+	CTransformStore() : m_pHierarchy( 0 ) {}
+
+
+	/*-----------------------------------------------------------------------------------------
+		Transforms
+	-----------------------------------------------------------------------------------------*/
+
+	// Add a transform with the given position, Euler angles and scale, returns its handle. The
+	// matrix is valid after the next update
+	TUInt32 Add
+	(
+		const CVector3& position = CVector3::kOrigin,
+		const CVector3& rotation = CVector3::kZero,
+		const CVector3& scale = CVector3::kOne
+	);
+
+	// Add a copy of an existing transform (not including its hierarchy link), returns its handle
+	TUInt32 Copy( const TUInt32 handle );
+
+	// Remove a transform. Its handle may be reused by a later Add
+	void Remove( const TUInt32 handle );
+
+	// Make space for the given total number of transforms, so adding many at once (e.g. loading a
+	// scene) doesn't reallocate the arrays as they grow
+	void Reserve( const TUInt32 count );
+
+	// Number of transforms in the store
+	TUInt32 GetCount() const
+	{
+		return static_cast<TUInt32>(m_Handles.size());
+	}
+
+	// Current array index of a transform, and the handle of the transform at an array index
+	TUInt32 GetIndex( const TUInt32 handle ) const
+	{
+		return m_Indices[handle];
+	}
+	TUInt32 GetHandle( const TUInt32 index ) const
+	{
+		return m_Handles[index];
+	}
+
+
+	/*-----------------------------------------------------------------------------------------
+		Hierarchy
+	-----------------------------------------------------------------------------------------*/
+
+	// Link the store to a transform hierarchy (or unlink with 0). Transforms linked to nodes of
+	// this hierarchy pass their matrices to it, and take their world matrices from it
+	void SetHierarchy( CTransformHierarchy* pHierarchy )
+	{
+		m_pHierarchy = pHierarchy;
+	}
+	CTransformHierarchy* GetHierarchy() const
+	{
+		return m_pHierarchy;
+	}
+
+	// Link a transform to a hierarchy node. The world bounds use the world matrix of boundsNode,
+	// which may be a descendant of the transform's node (e.g. the frame holding some geometry)
+	void SetHierarchyNode
+	(
+		const TUInt32 handle,
+		const TUInt32 node,
+		const TUInt32 boundsNode
+	);
+
+	TUInt32 GetHierarchyNode( const TUInt32 handle ) const
+	{
+		return m_Nodes[m_Indices[handle]];
+	}
+	TUInt32 GetBoundsNode( const TUInt32 handle ) const
+	{
+		return m_BoundsNodes[m_Indices[handle]];
+	}
+
+
+	/*-----------------------------------------------------------------------------------------
+		Local Transform
+	-----------------------------------------------------------------------------------------*/
+
+	const CVector3& GetPosition( const TUInt32 handle ) const
+	{
+		return m_Positions[m_Indices[handle]];
+	}
+	void SetPosition
+	(
+		const TUInt32   handle,
+		const CVector3& position
+	);
+
+	// Euler angles - not kept up to date when using a quaternion
+	const CVector3& GetRotation( const TUInt32 handle ) const
+	{
+		return m_Rotations[m_Indices[handle]];
+	}
+	// Set Euler angles. Also sets the quaternion if the transform is using one
+	void SetRotation
+	(
+		const TUInt32   handle,
+		const CVector3& rotation
+	);
+
+	const CQuaternion& GetOrientation( const TUInt32 handle ) const
+	{
+		return m_Orientations[m_Indices[handle]];
+	}
+	// Set the quaternion, also switches the transform to use it
+	void SetOrientation
+	(
+		const TUInt32      handle,
+		const CQuaternion& orientation
+	);
+
+	bool UsesQuaternion( const TUInt32 handle ) const
+	{
+		return (m_Flags[m_Indices[handle]] & kUseQuaternion) != 0;
+	}
+	// Switch between Euler angles and quaternion, converting the current rotation. Switching
+	// back to Euler angles recovers the angles from the matrix
+	void SetUseQuaternion
+	(
+		const TUInt32 handle,
+		const bool    useQuaternion
+	);
+
+	const CVector3& GetScale( const TUInt32 handle ) const
+	{
+		return m_Scales[m_Indices[handle]];
+	}
+	void SetScale
+	(
+		const TUInt32   handle,
+		const CVector3& scale
+	);
+
+	// Mark a transform as changed after altering its data directly
+	void SetDirty( const TUInt32 handle )
+	{
+		m_Flags[m_Indices[handle]] |= kMatrixDirty;
+	}
+
+
+	/*-----------------------------------------------------------------------------------------
+		Matrices
+	-----------------------------------------------------------------------------------------*/
+
+	// Matrix built from position, rotation and scale - world matrix if not linked to a node
+	const CMatrix4x4& GetMatrix( const TUInt32 handle ) const
+	{
+		return m_Matrices[m_Indices[handle]];
+	}
+
+	// World matrix, from the hierarchy if linked to a node (valid after the hierarchy's update)
+	const CMatrix4x4& GetWorldMatrix( const TUInt32 handle ) const;
+
+	// Increases whenever the world matrix changes
+	TUInt32 GetVersion( const TUInt32 handle ) const;
+
+	// Rebuild the matrix of one transform if dirty. Returns true if it was rebuilt
+	bool UpdateMatrix( const TUInt32 handle );
+
+	// Rebuild the matrices of all dirty transforms in one pass, returns the number rebuilt. If a
+	// job system is given the pass is split into parallel jobs
+	TUInt32 UpdateMatrices( CJobSystem* pJobs = 0 );
+
+
+	/*-----------------------------------------------------------------------------------------
+		Bounds
+	-----------------------------------------------------------------------------------------*/
+
+	// Set the bounding volumes of a transform's geometry in model space
+	void SetLocalBounds
+	(
+		const TUInt32  handle,
+		const CAABB&   box,
+		const CSphere& sphere
+	);
+
+	// Bounding volumes in model space
+	const CAABB& GetLocalBox( const TUInt32 handle ) const
+	{
+		return m_LocalBoxes[m_Indices[handle]];
+	}
+	const CSphere& GetLocalSphere( const TUInt32 handle ) const
+	{
+		return m_LocalSpheres[m_Indices[handle]];
+	}
+
+	// World bounding volumes (valid after UpdateBounds)
+	const CAABB& GetWorldBox( const TUInt32 handle ) const
+	{
+		return m_WorldBoxes[m_Indices[handle]];
+	}
+	const CSphere& GetWorldSphere( const TUInt32 handle ) const
+	{
+		return m_WorldSpheres[m_Indices[handle]];
+	}
+
+	// Recalculate the world bounds of one transform if its world matrix or local bounds have
+	// changed. Returns true if they were recalculated
+	bool UpdateBounds( const TUInt32 handle );
+
+	// Recalculate all out of date world bounds in one pass, returns the number recalculated. If a
+	// job system is given the pass is split into parallel jobs
+	TUInt32 UpdateBounds( CJobSystem* pJobs = 0 );
+
+	// World bounds arrays in index order, for passes over all transforms
+	const CAABB* GetWorldBoxes() const
+	{
+		return m_WorldBoxes.empty() ? 0 : &m_WorldBoxes[0];
+	}
+	const CSphere* GetWorldSpheres() const
+	{
+		return m_WorldSpheres.empty() ? 0 : &m_WorldSpheres[0];
+	}
+
+
+/*-----------------------------------------------------------------------------------------
+	Private types / functions
+-----------------------------------------------------------------------------------------*/
+private:
+
+	// Values for m_Flags
+	enum
+	{
+		kMatrixDirty   = 0x01,
+		kBoundsDirty   = 0x02,
+		kUseQuaternion = 0x04,
+		kNodeDirty     = 0x08, // Matrix rebuilt by a parallel update, not yet passed to the hierarchy
+	};
+
+	typedef vector<CMatrix4x4, CAlignedAllocator<CMatrix4x4> > TMatrices;
+
+	// Allocate a handle and space at the end of the arrays, returns the handle
+	TUInt32 AddEntry();
+
+	// Build the matrix at the given index (does not pass it on to the hierarchy)
+	void BuildMatrix( const TUInt32 index );
+
+	// Rebuild the dirty matrices in the indices [first, end), returns the number rebuilt
+	TUInt32 UpdateMatrixRange
+	(
+		const TUInt32 first,
+		const TUInt32 end
+	);
+
+	// Recalculate the out of date world bounds in the indices [first, end), returns the number
+	// recalculated
+	TUInt32 UpdateBoundsRange
+	(
+		const TUInt32 first,
+		const TUInt32 end
+	);
+
+	// Recalculate the world bounds at the given index if out of date
+	bool UpdateBoundsAt( const TUInt32 index );
+
+
+/*-----------------------------------------------------------------------------------------
+	Data
+-----------------------------------------------------------------------------------------*/
+private:
+
+	// Indexed by handle
+	vector<TUInt32>      m_Indices;     // Array index of each handle
+	vector<TUInt32>      m_FreeHandles; // Removed handles available for reuse
+
+	// Indexed by array index
+	vector<TUInt32>      m_Handles;
+	vector<CVector3>     m_Positions;
+	vector<CVector3>     m_Rotations;    // Euler angles
+	vector<CQuaternion>  m_Orientations;
+	vector<CVector3>     m_Scales;
+	TMatrices            m_Matrices;
+	vector<TUInt32>      m_Versions;     // Matrix rebuild count (not used when linked to a node)
+	vector<TUInt8>       m_Flags;
+	vector<TUInt32>      m_Nodes;        // Hierarchy node, or kNoNode
+	vector<TUInt32>      m_BoundsNodes;  // Hierarchy node used for world bounds, or kNoNode
+	vector<CAABB>        m_LocalBoxes;
+	vector<CSphere>      m_LocalSpheres;
+	vector<CAABB>        m_WorldBoxes;
+	vector<CSphere>      m_WorldSpheres;
+	vector<TUInt32>      m_BoundsVersions; // World matrix version the world bounds were built from
+
+	CTransformHierarchy* m_pHierarchy;
+};
+
+
+} // namespace gen
+
+#endif // GEN_C_TRANSFORM_STORE_H_INCLUDED
@@ -352,6 +352,39 @@ public:
 };
 
 
+// 16-byte aligned version of CVector4 (matches a SIMD register), allows aligned SIMD loads and
+// stores. Use wherever a CVector4 is used. Alignment is only guaranteed for globals, locals and
+// members - heap allocated arrays need CAlignedAllocator (AlignedAllocator.h)
+// Note: cannot be passed to functions by value (the compiler can't align the parameter)
+class GEN_ALIGN(16) CVector4A16 : public CVector4
+{
+// Concrete class - public access
+public:
+	// Default constructor - leaves values uninitialised (for performance)
+	CVector4A16() {}
+
+	// Construct by value
+	CVector4A16
+	(
+		const TFloat32 xIn,
+		const TFloat32 yIn,
+		const TFloat32 zIn,
+		const TFloat32 wIn
+	) : CVector4( xIn, yIn, zIn, wIn )
+	{}
+
+	// Construct from an unaligned vector
+	CVector4A16( const CVector4& v ) : CVector4( v ) {}
+
+	// Assignment from any vector
+	CVector4A16& operator=( const CVector4& v )
+	{
+		CVector4::operator=( v );
+		return *this;
+	}
+};
+
+
 /*-----------------------------------------------------------------------------------------
 	Non-member Operators
 -----------------------------------------------------------------------------------------*/
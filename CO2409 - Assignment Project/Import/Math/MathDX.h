@@ -22,20 +22,22 @@
 #ifndef GEN_C_MATHDX_H_INCLUDED
 #define GEN_C_MATHDX_H_INCLUDED
 
+#include <cstddef> // offsetof
 #include <d3d10.h>
 #include <d3dx10.h>
 
 #include "GenDefines.h"
+#include "CVector2.h"
+#include "CVector3.h"
+#include "CVector4.h"
+#include "CMatrix4x4.h"
+#include "CQuaternion.h"
 
 namespace gen
 {
 
-// Forward declaration of classes, includes not necessary (using pointers and not using class data)
-class CVector2;
-class CVector3;
-class CVector4;
-class CMatrix4x4;
-class CQuaternion;
+// Full class definitions are included (rather than forward declared) so that the layout checks at
+// the end of this file can be made
 
 /*---------------------------------------------------------------------------------------------
 	Vector Conversions
@@ -161,6 +163,84 @@ inline const D3DXQUATERNION* ToD3DXQUATERNIONPtr( const CQuaternion* pQ )
 }
 
 
+/*---------------------------------------------------------------------------------------------
+	Conversions from DirectX Types
+---------------------------------------------------------------------------------------------*/
+// The reverse of the above, allows math class functions to work directly on DirectX data
+// Note: D3DXQUATERNION stores x,y,z,w but CQuaternion stores w,x,y,z - no conversion provided
+
+// Reinterpret a D3DXVECTOR3 as a CVector3 - in various forms (const & ptr)
+inline CVector3& ToCVector3( D3DXVECTOR3& v )
+{
+	return *reinterpret_cast<CVector3*>(&v);
+}
+
+inline const CVector3& ToCVector3( const D3DXVECTOR3& v )
+{
+	return *reinterpret_cast<const CVector3*>(&v);
+}
+
+inline CVector3* ToCVector3Ptr( D3DXVECTOR3* pV )
+{
+	return reinterpret_cast<CVector3*>(pV);
+}
+
+inline const CVector3* ToCVector3Ptr( const D3DXVECTOR3* pV )
+{
+	return reinterpret_cast<const CVector3*>(pV);
+}
+
+
+// Reinterpret a D3DXMATRIX as a CMatrix4x4 - in various forms (const & ptr)
+inline CMatrix4x4& ToCMatrix4x4( D3DXMATRIX& m )
+{
+	return *reinterpret_cast<CMatrix4x4*>(&m);
+}
+
+inline const CMatrix4x4& ToCMatrix4x4( const D3DXMATRIX& m )
+{
+	return *reinterpret_cast<const CMatrix4x4*>(&m);
+}
+
+inline CMatrix4x4* ToCMatrix4x4Ptr( D3DXMATRIX* pM )
+{
+	return reinterpret_cast<CMatrix4x4*>(pM);
+}
+
+inline const CMatrix4x4* ToCMatrix4x4Ptr( const D3DXMATRIX* pM )
+{
+	return reinterpret_cast<const CMatrix4x4*>(pM);
+}
+
+
+/*---------------------------------------------------------------------------------------------
+	Layout Checks
+---------------------------------------------------------------------------------------------*/
+// The casts above rely on the math classes having exactly the same memory layout as the DirectX
+// types - check at compile time so that any change to either side fails the build
+
+static_assert( sizeof(CVector2) == sizeof(D3DXVECTOR2), "CVector2 layout differs from D3DXVECTOR2" );
+static_assert( sizeof(CVector3) == sizeof(D3DXVECTOR3), "CVector3 layout differs from D3DXVECTOR3" );
+static_assert( sizeof(CVector4) == sizeof(D3DXVECTOR4), "CVector4 layout differs from D3DXVECTOR4" );
+static_assert( offsetof(CVector4, x) == offsetof(D3DXVECTOR4, x) && offsetof(CVector4, w) == offsetof(D3DXVECTOR4, w),
+               "CVector4 layout differs from D3DXVECTOR4" );
+
+static_assert( sizeof(CMatrix4x4) == sizeof(D3DXMATRIX), "CMatrix4x4 layout differs from D3DXMATRIX" );
+static_assert( offsetof(CMatrix4x4, e00) == offsetof(D3DXMATRIX, _11) && offsetof(CMatrix4x4, e03) == offsetof(D3DXMATRIX, _14) &&
+               offsetof(CMatrix4x4, e30) == offsetof(D3DXMATRIX, _41) && offsetof(CMatrix4x4, e33) == offsetof(D3DXMATRIX, _44),
+               "CMatrix4x4 layout differs from D3DXMATRIX" );
+
+// Storage order differs (see above), but sizes must match for the pointer conversions
+static_assert( sizeof(CQuaternion) == sizeof(D3DXQUATERNION), "CQuaternion size differs from D3DXQUATERNION" );
+
+// Aligned types must add alignment only, no padding, so arrays of them can be handed directly to
+// DirectX (e.g. as shader constant arrays)
+static_assert( sizeof(CMatrix4x4A16) == sizeof(D3DXMATRIXA16) && __alignof(CMatrix4x4A16) == 16,
+               "CMatrix4x4A16 layout differs from D3DXMATRIXA16" );
+static_assert( sizeof(CVector4A16) == sizeof(D3DXVECTOR4) && __alignof(CVector4A16) == 16,
+               "CVector4A16 is not a 16-byte aligned D3DXVECTOR4" );
+
+
 } // namespace gen
 
 #endif // GEN_C_MATHDX_H_INCLUDED
@@ -0,0 +1,159 @@
+//--------------------------------------------------------------------------------------
+//	InputLayoutCache.cpp
+//
+//	The input layout cache creates each combination of vertex format and shader input
+//	signature once, so models switching technique share layouts instead of creating them
+//--------------------------------------------------------------------------------------
+
+#include <string.h> // memcmp, memset, strcmp
+
+#include "InputLayoutCache.h"	// Declaration of this class
+
+
+///////////////////////////////
+// Constructors / Destructors
+
+// Constructor - optionally give the device to create layouts with (can be set later)
+CInputLayoutCache::CInputLayoutCache(ID3D10Device* device /*= NULL*/)
+{
+	m_Device = device;
+	memset(&m_Stats, 0, sizeof(m_Stats));
+}
+
+CInputLayoutCache::~CInputLayoutCache()
+{
+	Release();
+}
+
+
+/////////////////////////////
+// Setup
+
+// Set the device to create layouts with. Releases any layouts created with the previous device
+void CInputLayoutCache::SetDevice(ID3D10Device* device)
+{
+	if (device != m_Device)
+	{
+		Release();
+	}
+	m_Device = device;
+}
+
+// Release all the layouts held by the cache and reset the statistics. Layouts still referenced by models stay alive until they
+// are released there
+void CInputLayoutCache::Release()
+{
+	for (map<gen::TUInt64, vector<SLayoutEntry*>>::iterator hashEntries = m_Entries.begin(); hashEntries != m_Entries.end(); ++hashEntries)
+	{
+		for (unsigned int i = 0; i < hashEntries->second.size(); i++)
+		{
+			SAFE_RELEASE( hashEntries->second[i]->Layout );
+			delete hashEntries->second[i];
+		}
+	}
+	m_Entries.clear();
+	memset(&m_Stats, 0, sizeof(m_Stats));
+}
+
+
+/////////////////////////////
+// Lookup
+
+// Get the layout of the given vertex elements for an input signature, creating it if it isn't in the cache. Returns a new
+// reference (release it when finished), or NULL if the device can't create the layout
+ID3D10InputLayout* CInputLayoutCache::GetLayout(const D3D10_INPUT_ELEMENT_DESC* elements, unsigned int numElements,
+                                                const void* signature, SIZE_T signatureSize)
+{
+	gen::TUInt64 hash = Hash(elements, numElements, signature, signatureSize);
+
+	// Look for the layout among the entries with the same hash
+	vector<SLayoutEntry*>& hashEntries = m_Entries[hash];
+	for (unsigned int i = 0; i < hashEntries.size(); i++)
+	{
+		if (Matches(hashEntries[i], elements, numElements, signature, signatureSize))
+		{
+			m_Stats.Hits++;
+			ID3D10InputLayout* layout = hashEntries[i]->Layout;
+			if (layout) layout->AddRef();
+			return layout;
+		}
+	}
+
+	// Not found, create the layout and add it - even if creation failed, so the failure is remembered
+	SLayoutEntry* entry = new SLayoutEntry;
+	entry->SemanticNames.resize(numElements);
+	entry->Elements.assign(elements, elements + numElements);
+	for (unsigned int i = 0; i < numElements; i++)
+	{
+		entry->SemanticNames[i] = elements[i].SemanticName;
+		entry->Elements[i].SemanticName = entry->SemanticNames[i].c_str();
+	}
+	const unsigned char* signatureBytes = static_cast<const unsigned char*>(signature);
+	entry->Signature.assign(signatureBytes, signatureBytes + signatureSize);
+	entry->Layout = NULL;
+	if (!m_Device || FAILED( m_Device->CreateInputLayout( elements, numElements, signature, signatureSize, &entry->Layout ) ))
+	{
+		entry->Layout = NULL;
+		m_Stats.Failures++;
+	}
+	hashEntries.push_back(entry);
+	m_Stats.Misses++;
+	m_Stats.Layouts++;
+
+	if (entry->Layout) entry->Layout->AddRef();
+	return entry->Layout;
+}
+
+// As above, taking the input signature from the first pass of an effect technique
+ID3D10InputLayout* CInputLayoutCache::GetLayout(const D3D10_INPUT_ELEMENT_DESC* elements, unsigned int numElements,
+                                                ID3D10EffectTechnique* technique)
+{
+	D3D10_PASS_DESC PassDesc;
+	technique->GetPassByIndex( 0 )->GetDesc( &PassDesc );
+	return GetLayout(elements, numElements, PassDesc.pIAInputSignature, PassDesc.IAInputSignatureSize);
+}
+
+
+/////////////////////////////
+// Private member functions
+
+// Hash of a layout key. The semantic names are hashed by their characters, as the same name may be held in different places
+gen::TUInt64 CInputLayoutCache::Hash(const D3D10_INPUT_ELEMENT_DESC* elements, unsigned int numElements,
+                                     const void* signature, SIZE_T signatureSize)
+{
+	gen::TUInt64 hash = HashStart;
+	for (unsigned int i = 0; i < numElements; i++)
+	{
+		const D3D10_INPUT_ELEMENT_DESC& element = elements[i];
+		hash = HashBytes(hash, element.SemanticName, strlen(element.SemanticName));
+		hash = HashBytes(hash, &element.SemanticIndex, sizeof(element.SemanticIndex));
+		hash = HashBytes(hash, &element.Format, sizeof(element.Format));
+		hash = HashBytes(hash, &element.InputSlot, sizeof(element.InputSlot));
+		hash = HashBytes(hash, &element.AlignedByteOffset, sizeof(element.AlignedByteOffset));
+		hash = HashBytes(hash, &element.InputSlotClass, sizeof(element.InputSlotClass));
+		hash = HashBytes(hash, &element.InstanceDataStepRate, sizeof(element.InstanceDataStepRate));
+	}
+	return HashBytes(hash, signature, signatureSize);
+}
+
+// Check if an entry was created from the given key
+bool CInputLayoutCache::Matches(const SLayoutEntry* entry, const D3D10_INPUT_ELEMENT_DESC* elements, unsigned int numElements,
+                                const void* signature, SIZE_T signatureSize)
+{
+	if (entry->Elements.size() != numElements || entry->Signature.size() != signatureSize)
+	{
+		return false;
+	}
+	for (unsigned int i = 0; i < numElements; i++)
+	{
+		const D3D10_INPUT_ELEMENT_DESC& a = entry->Elements[i];
+		const D3D10_INPUT_ELEMENT_DESC& b = elements[i];
+		if (a.SemanticIndex != b.SemanticIndex || a.Format != b.Format || a.InputSlot != b.InputSlot ||
+		    a.AlignedByteOffset != b.AlignedByteOffset || a.InputSlotClass != b.InputSlotClass ||
+		    a.InstanceDataStepRate != b.InstanceDataStepRate || strcmp(a.SemanticName, b.SemanticName) != 0)
+		{
+			return false;
+		}
+	}
+	return signatureSize == 0 || memcmp(&entry->Signature[0], signature, signatureSize) == 0;
+}
@@ -0,0 +1,121 @@
+//--------------------------------------------------------------------------------------
+//	InputLayoutCache.h
+//
+//	The input layout cache creates each combination of vertex format and shader input
+//	signature once, so models switching technique share layouts instead of creating them
+//--------------------------------------------------------------------------------------
+
+#ifndef INPUT_LAYOUT_CACHE_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define INPUT_LAYOUT_CACHE_H_INCLUDED
+
+#include <vector>
+#include <map>
+#include <string>
+using namespace std;
+
+#include "Defines.h"
+#include "MSDefines.h" // TUInt64
+
+// An input layout depends only on the vertex elements and the input signature of the vertex shader it is used with - many models
+// have the same vertex format and many techniques share a vertex shader. Layouts are looked up by a hash of the elements and the
+// signature bytes, then compared in full so a hash collision can never return the wrong layout. A lookup makes no allocations, so
+// switching technique costs a search of the cache rather than creating a layout. Combinations the device rejects are cached too
+// (as NULL), so a model that can't be drawn with a technique doesn't retry each time
+//
+// The cache keeps a reference to every layout until Release, and GetLayout returns a new reference for the caller to release
+
+// Lookups since the cache was created or released
+struct SInputLayoutCacheStats
+{
+	unsigned int Hits;     // Lookups that found a cached layout
+	unsigned int Misses;   // Lookups that created a layout
+	unsigned int Failures; // Misses where the layout could not be created (included in Misses)
+	unsigned int Layouts;  // Entries in the cache
+};
+
+class CInputLayoutCache
+{
+/////////////////////////////
+// Private member variables
+private:
+
+	ID3D10Device* m_Device;
+
+	// A cached layout with the key it was created from. Semantic names are held as strings, the element copies point into them
+	struct SLayoutEntry
+	{
+		vector<D3D10_INPUT_ELEMENT_DESC> Elements;
+		vector<string>                   SemanticNames;
+		vector<unsigned char>            Signature;
+		ID3D10InputLayout*               Layout;
+	};
+
+	// Entries by hash of their key - usually one entry for each hash
+	map<gen::TUInt64, vector<SLayoutEntry*>> m_Entries;
+
+	SInputLayoutCacheStats m_Stats;
+
+	// Layouts are owned by the cache, so it is not copied
+	CInputLayoutCache(const CInputLayoutCache&);
+	CInputLayoutCache& operator=(const CInputLayoutCache&);
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	///////////////////////////////
+	// Constructors / Destructors
+
+	// Constructor - optionally give the device to create layouts with (can be set later)
+	CInputLayoutCache(ID3D10Device* device = NULL);
+	~CInputLayoutCache();
+
+
+	/////////////////////////////
+	// Setup
+
+	// Set the device to create layouts with. Releases any layouts created with the previous device
+	void SetDevice(ID3D10Device* device);
+
+	// Release all the layouts held by the cache and reset the statistics. Layouts still referenced by models stay alive until they
+	// are released there
+	void Release();
+
+	const SInputLayoutCacheStats& GetStats()
+	{
+		return m_Stats;
+	}
+
+
+	/////////////////////////////
+	// Lookup
+
+	// Get the layout of the given vertex elements for an input signature, creating it if it isn't in the cache. Returns a new
+	// reference (release it when finished), or NULL if the device can't create the layout
+	ID3D10InputLayout* GetLayout(const D3D10_INPUT_ELEMENT_DESC* elements, unsigned int numElements,
+	                             const void* signature, SIZE_T signatureSize);
+
+	// As above, taking the input signature from the first pass of an effect technique
+	ID3D10InputLayout* GetLayout(const D3D10_INPUT_ELEMENT_DESC* elements, unsigned int numElements,
+	                             ID3D10EffectTechnique* technique);
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	// Hash of a layout key
+	static gen::TUInt64 Hash(const D3D10_INPUT_ELEMENT_DESC* elements, unsigned int numElements,
+	                         const void* signature, SIZE_T signatureSize);
+
+	// Check if an entry was created from the given key
+	static bool Matches(const SLayoutEntry* entry, const D3D10_INPUT_ELEMENT_DESC* elements, unsigned int numElements,
+	                    const void* signature, SIZE_T signatureSize);
+};
+
+// Single input layout cache used for all models - declared in GraphicsAssign1.cpp
+extern CInputLayoutCache g_InputLayoutCache;
+
+
+#endif // End of header guard - see top of file
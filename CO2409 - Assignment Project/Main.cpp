@@ -6,6 +6,8 @@
 
 #include <windows.h>
 #include <windowsx.h>
+#include <stdlib.h> // _wtoi
+#include <string.h> // wcsstr, wcslen
 #include "resource.h"
 #include "CTimer.h" // Timer class - not DirectX
 #include "Input.h"  // Input functions - not DirectX
@@ -31,7 +33,22 @@ bool InitDevice(HWND hWnd); // hWnd is the handle (identifier) of the window to
 void ReleaseResources();
 bool LoadEffectFile();
 bool InitScene();
+void CullScene();
 void RenderScene();
+void GetCullingStatsText(wchar_t* text, unsigned int maxLength);
+void ExportDrawStats();
+void SetDrawAssertions(bool assertNoDuplicates);
+unsigned int GetNumDuplicateDraws();
+bool RunOcclusionTest(const char* fileName);
+bool RunCullingBenchmark(const char* fileName);
+bool RunQuaternionBenchmark(const char* fileName);
+bool RunBVHBenchmark(const char* fileName);
+bool RunHierarchyBenchmark(const char* fileName);
+bool RunTransformBenchmark(const char* fileName);
+bool RunJobBenchmark(const char* fileName);
+bool RunHeadless(unsigned int frames);
+bool RunSoftwareRender(unsigned int frames);
+bool ConvertScene();
 void UpdateScene(float updateTime);
 bool InitWindow(HINSTANCE hInstance, int nCmdShow);
 LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
@@ -42,6 +59,84 @@ LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
 //--------------------------------------------------------------------------------------
 int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLine, int nCmdShow)
 {
+	// "-occlusiontest" on the command line runs the headless occlusion culling test instead of the application: it times rasterising
+	// the scene's occluders and testing boxes against them, writes the results to a text file and quits. No window or device is
+	// created. The exit code is 1 if the test failed
+	if (wcsstr(lpCmdLine, L"-occlusiontest"))
+	{
+		return RunOcclusionTest("OcclusionTest.txt") ? 0 : 1;
+	}
+
+	// "-cullbenchmark" times frustum and cone culling of random spheres and boxes, one volume at a time and with the batch tests,
+	// writes the results to a text file and quits. The exit code is 1 if the two methods found different visible volumes
+	if (wcsstr(lpCmdLine, L"-cullbenchmark"))
+	{
+		return RunCullingBenchmark("CullBenchmark.txt") ? 0 : 1;
+	}
+
+	// "-quatbenchmark" times NLerp, Slerp and matrix conversion of random quaternions with the scalar functions and the batch functions,
+	// with and without the job system, writes the results to a text file and quits. The exit code is 1 if the results differed
+	if (wcsstr(lpCmdLine, L"-quatbenchmark"))
+	{
+		return RunQuaternionBenchmark("QuaternionBenchmark.txt") ? 0 : 1;
+	}
+
+	// "-bvhbenchmark" times building and refitting a bounding volume hierarchy over random boxes and compares culling the tree with
+	// testing every box, writes the results to a text file and quits. The exit code is 1 if the two culls found different boxes
+	if (wcsstr(lpCmdLine, L"-bvhbenchmark"))
+	{
+		return RunBVHBenchmark("BVHBenchmark.txt") ? 0 : 1;
+	}
+
+	// "-hierarchybenchmark" times full updates, updates after a few edits and updates with no changes of a large transform hierarchy,
+	// with and without the job system, writes the results to a text file and quits. The exit code is 1 if any world matrix was wrong
+	if (wcsstr(lpCmdLine, L"-hierarchybenchmark"))
+	{
+		return RunHierarchyBenchmark("HierarchyBenchmark.txt") ? 0 : 1;
+	}
+
+	// "-transformbenchmark" times the matrix, bounds and culling passes over separately allocated objects and over the transform
+	// store, writes the results to a text file and quits. The exit code is 1 if the two layouts gave different results
+	if (wcsstr(lpCmdLine, L"-transformbenchmark"))
+	{
+		return RunTransformBenchmark("TransformBenchmark.txt") ? 0 : 1;
+	}
+
+	// "-jobbenchmark" times the matrix, hierarchy and bounds passes of a large scene without jobs and with job systems of one thread
+	// upwards, writes the results to a text file and quits. The exit code is 1 if any thread count gave different results
+	if (wcsstr(lpCmdLine, L"-jobbenchmark"))
+	{
+		return RunJobBenchmark("JobBenchmark.txt") ? 0 : 1;
+	}
+
+	// "-headless <frames>" updates and renders that many frames through the recording backend instead of a device, writes a report of
+	// the frame time and the commands given to the backend, and quits. No window or device is created. The exit code is 1 if the scene
+	// could not be set up or did not release everything it created
+	const wchar_t* headlessOption = wcsstr(lpCmdLine, L"-headless");
+	if (headlessOption)
+	{
+		int frames = _wtoi(headlessOption + wcslen(L"-headless"));
+		return RunHeadless((frames > 0) ? frames : 1) ? 0 : 1;
+	}
+
+	// "-softrender <frames>" updates and renders that many frames on the CPU through the software backend, writes the last frame and
+	// the shadow map to image files, times the frame again on one and on all threads, writes a report and quits. No window or device
+	// is created. The exit code is 1 if the scene could not be set up, a file could not be written, or the frame differs from the
+	// reference image
+	const wchar_t* softRenderOption = wcsstr(lpCmdLine, L"-softrender");
+	if (softRenderOption)
+	{
+		int frames = _wtoi(softRenderOption + wcslen(L"-softrender"));
+		return RunSoftwareRender((frames > 0) ? frames : 1) ? 0 : 1;
+	}
+
+	// "-convertscene" converts the text scene file to the binary one, which is then loaded in its place, and quits. The exit code is 1
+	// if the conversion failed
+	if (wcsstr(lpCmdLine, L"-convertscene"))
+	{
+		return ConvertScene() ? 0 : 1;
+	}
+
 	// Initialise everything in turn
 	if (!InitWindow(hInstance, nCmdShow))
 	{
@@ -56,6 +151,18 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 	// Initialise simple input functions (in Input.cpp) - not DirectX
 	InitInput();
 
+	// "-drawcheck <frames>" on the command line runs a scripted check: render that many frames with duplicate draw assertions on,
+	// export the draw statistics for the last frame and quit. The exit code is 1 if any model was drawn more than once in a pass
+	unsigned int drawCheckFrames = 0;
+	bool drawCheckFailed = false;
+	const wchar_t* drawCheckOption = wcsstr(lpCmdLine, L"-drawcheck");
+	if (drawCheckOption)
+	{
+		int frames = _wtoi(drawCheckOption + wcslen(L"-drawcheck"));
+		drawCheckFrames = (frames > 0) ? frames : 1;
+		SetDrawAssertions(true);
+	}
+
 	// Initialise a timer class (in CTimer.h/.cpp, not part of DirectX). It's like a stopwatch - start it counting now
 	CTimer Timer;
 	Timer.Start();
@@ -74,13 +181,34 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 		}
 		else // Otherwise render
 		{
+			// Cull the scene against the camera (using the state from the last update) then render what is visible
+			CullScene();
 			RenderScene();
 
+			// End a scripted draw check after the requested number of frames
+			if (drawCheckFrames > 0 && --drawCheckFrames == 0)
+			{
+				ExportDrawStats();
+				drawCheckFailed = (GetNumDuplicateDraws() > 0);
+				DestroyWindow(g_hWnd);
+			}
+
 			// Get the time passed since the last frame (since the last time this line was reached) - used so the rendering and update can be
 			// synchronised to real time and won't be dependent on machine speed
 			float frameTime = Timer.GetLapTime();
 			UpdateScene(frameTime);
 
+			// Show the culling counters in the window title a couple of times a second
+			static float statsTimer = 0.0f;
+			statsTimer += frameTime;
+			if (statsTimer > 0.5f)
+			{
+				wchar_t statsText[1024];
+				GetCullingStatsText(statsText, 1024);
+				SetWindowText(g_hWnd, statsText);
+				statsTimer = 0.0f;
+			}
+
 			// Allow user to quit with escape key
 			if (KeyHit(Key_Escape)) 
 			{
@@ -92,7 +220,7 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 	// Release all the DirectX resources before leaving
 	ReleaseResources();
 
-	return (int)msg.wParam;
+	return drawCheckFailed ? 1 : (int)msg.wParam;
 }
 
 
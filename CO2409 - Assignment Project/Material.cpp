@@ -1,22 +1,20 @@
 #include "Material.h"
+#include "StateCache.h" // Drops repeated sets of the same textures
+#include "ShaderConstants.h" // Per-material constants buffer
 
-ID3D10EffectShaderResourceVariable* CMaterial::m_DiffSpecMapVar = NULL;
-ID3D10EffectScalarVariable*			CMaterial::m_SpecularPowerVar = NULL;
-ID3D10EffectShaderResourceVariable* CMaterial::m_NormalMapVar = NULL;
-ID3D10EffectScalarVariable*			CMaterial::m_ParallaxDepthVar = NULL;
-ID3D10EffectShaderResourceVariable*	CMaterial::m_CelGradientVar = NULL;
-ID3D10EffectScalarVariable*			CMaterial::m_OutlineThicknessVar = NULL;
+unsigned int CMaterial::m_NextSortId = 0;
 
 
-CMaterial::CMaterial(ID3D10ShaderResourceView* diffSpecMap, float specularPower,
-	ID3D10ShaderResourceView* normalMap, float parallaxDepth,
-	ID3D10ShaderResourceView* CelGradient, float outlineThickness) :
+CMaterial::CMaterial(TTextureHandle diffSpecMap, float specularPower,
+	TTextureHandle normalMap, float parallaxDepth,
+	TTextureHandle CelGradient, float outlineThickness) :
 	m_DiffSpecMap(diffSpecMap),
 	m_SpecularPower(specularPower),
 	m_NormalMap(normalMap),
 	m_ParallaxDepth(parallaxDepth),
 	m_CelGradient(CelGradient),
-	m_OutlineThickness(outlineThickness)
+	m_OutlineThickness(outlineThickness),
+	m_SortId(m_NextSortId++)
 {
 }
 
@@ -25,19 +23,25 @@ CMaterial::~CMaterial()
 	Release();
 }
 
-bool CMaterial::LoadDiffSpecMap(wchar_t* mapName)
+bool CMaterial::LoadDiffSpecMap(const string& mapName)
 {
-	return !FAILED(D3DX10CreateShaderResourceViewFromFile(g_pd3dDevice, mapName, NULL, NULL, &m_DiffSpecMap, NULL));
+	BACKEND_RELEASE(m_DiffSpecMap);
+	m_DiffSpecMap = g_RenderBackend->LoadTexture(mapName);
+	return m_DiffSpecMap != NULL;
 }
 
-bool CMaterial::LoadNormalMap(wchar_t* mapName)
+bool CMaterial::LoadNormalMap(const string& mapName)
 {
-	return !FAILED(D3DX10CreateShaderResourceViewFromFile(g_pd3dDevice, mapName, NULL, NULL, &m_NormalMap, NULL));
+	BACKEND_RELEASE(m_NormalMap);
+	m_NormalMap = g_RenderBackend->LoadTexture(mapName);
+	return m_NormalMap != NULL;
 }
 
-bool CMaterial::LoadCelGradient(wchar_t* mapName)
+bool CMaterial::LoadCelGradient(const string& mapName)
 {
-	return !FAILED(D3DX10CreateShaderResourceViewFromFile(g_pd3dDevice, mapName, NULL, NULL, &m_CelGradient, NULL));
+	BACKEND_RELEASE(m_CelGradient);
+	m_CelGradient = g_RenderBackend->LoadTexture(mapName);
+	return m_CelGradient != NULL;
 }
 
 void CMaterial::SetSpecularPower(float specularPower)
@@ -57,97 +61,51 @@ void CMaterial::SetOutlineThickness(float outlineThickness)
 
 bool CMaterial::HasNormals()
 {
-	return m_NormalMap;
+	return m_NormalMap != NULL;
 }
 
 void CMaterial::Release()
 {
-	if (m_DiffSpecMap)
-	{
-		m_DiffSpecMap->Release();
-		m_DiffSpecMap = NULL;
-	}
-	if (m_NormalMap)
-	{
-		m_NormalMap->Release();
-		m_NormalMap = NULL;
-	}
-	if (m_CelGradient)
-	{
-		m_CelGradient->Release();
-		m_CelGradient = NULL;
-	}
+	BACKEND_RELEASE(m_DiffSpecMap);
+	BACKEND_RELEASE(m_NormalMap);
+	BACKEND_RELEASE(m_CelGradient);
 }
 
-ID3D10ShaderResourceView* CMaterial::GetDiffSpecMap()
+TTextureHandle CMaterial::GetDiffSpecMap()
 {
 	return m_DiffSpecMap;
 }
 
-ID3D10ShaderResourceView* CMaterial::GetNormalMap()
+TTextureHandle CMaterial::GetNormalMap()
 {
 	return m_NormalMap;
 }
 
-ID3D10ShaderResourceView* CMaterial::GetCelGradient()
+TTextureHandle CMaterial::GetCelGradient()
 {
 	return m_CelGradient;
 }
 
+// Textures are sent through the state cache, so those the shader already has from the previous material are skipped. The other
+// values go in the per-material constants, which are only uploaded if they differ from the previous material's
 void CMaterial::SendToShader()
 {
-	if (m_DiffSpecMap && m_DiffSpecMapVar)
-	{
-		m_DiffSpecMapVar->SetResource(m_DiffSpecMap);
-	}
-	if (m_SpecularPowerVar)
-	{
-		m_SpecularPowerVar->SetFloat(m_SpecularPower);
-	}
-	if (m_NormalMap && m_NormalMapVar)
-	{
-		m_NormalMapVar->SetResource(m_NormalMap);
-	}
-	if (m_ParallaxDepthVar)
+	if (m_DiffSpecMap)
 	{
-		m_ParallaxDepthVar->SetFloat(m_ParallaxDepth);
+		g_StateCache.SetTexture(TextureDiffuseSpecular, m_DiffSpecMap);
 	}
-	if (m_CelGradient && m_CelGradientVar)
+	if (m_NormalMap)
 	{
-		m_CelGradientVar->SetResource(m_CelGradient);
+		g_StateCache.SetTexture(TextureNormalMap, m_NormalMap);
 	}
-	if (m_OutlineThicknessVar)
+	if (m_CelGradient)
 	{
-		m_OutlineThicknessVar->SetFloat(m_OutlineThickness);
+		g_StateCache.SetTexture(TextureCelGradient, m_CelGradient);
 	}
-}
-
-void CMaterial::SetDiffuseSpecularShaderVariable(ID3D10EffectShaderResourceVariable* mapVar)
-{
-	m_DiffSpecMapVar = mapVar;
-}
-
-void CMaterial::SetSpecularPowerShaderVariable(ID3D10EffectScalarVariable* specularPowerVar)
-{
-	m_SpecularPowerVar = specularPowerVar;
-}
-
-void CMaterial::SetNormalMapShaderVariable(ID3D10EffectShaderResourceVariable* mapVar)
-{
-	m_NormalMapVar = mapVar;
-}
-
-void CMaterial::SetParallaxDepthShaderVariable(ID3D10EffectScalarVariable* parallaxDepthVar)
-{
-	m_ParallaxDepthVar = parallaxDepthVar;
-}
 
-void CMaterial::SetCelGradientShaderVariable(ID3D10EffectShaderResourceVariable* CelGradientVar)
-{
-	m_CelGradientVar = CelGradientVar;
-}
-
-void CMaterial::SetOutlineThicknessShaderVariable(ID3D10EffectScalarVariable* outlineThicknessVar)
-{
-	m_OutlineThicknessVar = outlineThicknessVar;
+	SPerMaterialConstants& constants = g_ShaderConstants.Material();
+	constants.SpecularPower = m_SpecularPower;
+	constants.ParallaxDepth = m_ParallaxDepth;
+	constants.OutlineThickness = m_OutlineThickness;
+	g_ShaderConstants.UploadMaterial();
 }
\ No newline at end of file
@@ -5,33 +5,41 @@
 //	also manages it's positioning with a world matrix
 //--------------------------------------------------------------------------------------
 
+#include <string.h> // strcmp
+
 #include "Defines.h"	// General definitions shared by all source files
 #include "Model.h"		// Declaration of this class
 #include "Technique.h"
+#include "StateCache.h"      // Drops repeated binds of the same state
+#include "ShaderConstants.h" // Per-model constants buffer
+#include "RenderBackend.h"     // Buffers, layouts and draws
+#include "DrawStats.h"       // Counts draws and checks for duplicates
 
 #include "CImportXFile.h"    // Class to load meshes (taken from a full graphics engine)
+#include "MathDX.h"          // Conversions between math classes and DirectX types
+#include "MeshData.h"        // Mesh frame hierarchy
 
 
-ID3D10EffectMatrixVariable* CModel::m_MatrixVar = NULL;
-
-ID3D10EffectVectorVariable* CModel::m_ColourVar = NULL;
-
 CTechnique* CModel::m_ShadowRenderTechnique = NULL;
 
 vector<CMaterial*>			CModel::m_MaterialList = vector<CMaterial*>();
-vector<CTechnique*>			CModel::m_TechniqueList= vector<CTechnique*>();
 
+gen::CTransformStore		CModel::m_Transforms;
 
+unsigned int				CModel::m_NextGeometryId = 0;
+vector<CModel::SSharedGeometry> CModel::m_SharedGeometry;
 
-void CModel::SetMatrixShaderVariable(ID3D10EffectMatrixVariable* matrixVar)
+// Instance data elements, in the second vertex buffer slot and stepping once per instance. The matrix is passed as four rows
+const D3D10_INPUT_ELEMENT_DESC CModel::m_InstanceElts[CModel::NUM_INSTANCE_ELTS] =
 {
-	m_MatrixVar = matrixVar;
-}
+	{ "WORLD",          0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1,  0, D3D10_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "WORLD",          1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D10_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "WORLD",          2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32, D3D10_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "WORLD",          3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 48, D3D10_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "INSTANCECOLOUR", 0, DXGI_FORMAT_R32G32B32_FLOAT,    1, 64, D3D10_INPUT_PER_INSTANCE_DATA, 1 },
+};
+
 
-void CModel::SetColourShaderVariable(ID3D10EffectVectorVariable* colourVar)
-{
-	m_ColourVar = colourVar;
-}
 
 void CModel::SetShadowRenderTechnique(CTechnique* shadowTechnique)
 {
@@ -46,9 +54,7 @@ CModel::CModel( D3DXVECTOR3 position, D3DXVECTOR3 rotation, float scale, D3DXVEC
 {
 	m_RenderTechnique = NULL;
 
-	m_Position = position;
-	m_Rotation = rotation;
-	SetScale( scale );
+	m_Transform = m_Transforms.Add( gen::ToCVector3(position), gen::ToCVector3(rotation), gen::CVector3(scale, scale, scale) );
 	UpdateMatrix();
 
 	// Good practice to ensure all private data is sensibly initialised
@@ -56,11 +62,21 @@ CModel::CModel( D3DXVECTOR3 position, D3DXVECTOR3 rotation, float scale, D3DXVEC
 	m_NumVertices = 0;
 	m_VertexSize = 0;
 	m_VertexLayout = NULL;
+	m_InstancedLayout = NULL;
 
 	m_IndexBuffer = NULL;
 	m_NumIndices = 0;
+	m_SharedGeometryIndex = kNoSharedGeometry;
+
+	m_BoundingSphere = gen::CSphere(gen::CVector3::kOrigin, 0.0f);
+	m_IsStationary = false;
+	m_IsOccluder = false;
+	m_OccluderCellSize = 0.0f;
+
+	m_MeshFrame = 0;
 
 	m_HasGeometry = false;
+	m_GeometryId = 0;
 
 	//Initialise the texture variable to NULL
 	m_ModelMaterial = NULL;
@@ -75,15 +91,18 @@ CModel::CModel( D3DXVECTOR3 position, D3DXVECTOR3 rotation, float scale, D3DXVEC
 CModel::~CModel()
 {
 	ReleaseResources();
+	m_Transforms.Remove( m_Transform );
 }
 
 // Release resources used by model
 void CModel::ReleaseResources()
 {
 	// Release resources
-	SAFE_RELEASE( m_IndexBuffer );  // Using a DirectX helper macro to simplify code here - look it up in Defines.h
-	SAFE_RELEASE( m_VertexBuffer );
-	SAFE_RELEASE( m_VertexLayout );
+	BACKEND_RELEASE( m_IndexBuffer );  // Using a helper macro to simplify code here - look it up in RenderBackend.h
+	BACKEND_RELEASE( m_VertexBuffer );
+	m_VertexLayout = NULL; // Layouts are owned by the backend
+	m_InstancedLayout = NULL;
+	m_SharedGeometryIndex = kNoSharedGeometry;
 	m_HasGeometry = false;
 }
 
@@ -191,50 +210,368 @@ bool CModel::Load( const string& fileName, CTechnique* exampleTechnique) // The
 	// Save the number of elements of the subMesh so that the render technique can be recreated later on
 	m_NumElements = numElts;
 
-	// Given the vertex element list, pass it to DirectX to create a vertex layout. We also need to pass an example of a technique that will
-	// render this model. We will only be able to render this model with techniques that have the same vertex input as the example we use here
-	D3D10_PASS_DESC PassDesc;
-	exampleTechnique->GetTechnique()->GetPassByIndex( 0 )->GetDesc( &PassDesc );
-	g_pd3dDevice->CreateInputLayout( m_VertexElts, numElts, PassDesc.pIAInputSignature, PassDesc.IAInputSignatureSize, &m_VertexLayout );
+	// Given the vertex element list, get a vertex layout for it. We also need to pass an example of a technique that will render this
+	// model. We will only be able to render this model with techniques that have the same vertex input as the example we use here
+	SetLayouts( exampleTechnique );
 
 
-	// Create the vertex buffer and fill it with the loaded vertex data
+	// Models loading the same file with the same vertex data share the buffers created by the first one
 	m_NumVertices = subMesh.numVertices;
-	D3D10_BUFFER_DESC bufferDesc;
-	bufferDesc.BindFlags = D3D10_BIND_VERTEX_BUFFER;
-	bufferDesc.Usage = D3D10_USAGE_DEFAULT; // Not a dynamic buffer
-	bufferDesc.ByteWidth = m_NumVertices * m_VertexSize; // Buffer size
-	bufferDesc.CPUAccessFlags = 0;   // Indicates that CPU won't access this buffer at all after creation
-	bufferDesc.MiscFlags = 0;
-	D3D10_SUBRESOURCE_DATA initData; // Initial data
-	initData.pSysMem = subMesh.vertices;   
-	if (FAILED( g_pd3dDevice->CreateBuffer( &bufferDesc, &initData, &m_VertexBuffer )))
+	m_NumIndices = static_cast<unsigned int>(subMesh.numFaces) * 3;
+	for (unsigned int i = 0; i < m_SharedGeometry.size(); ++i)
 	{
-		return false;
+		if (m_SharedGeometry[i].FileName == fileName && m_SharedGeometry[i].Tangents == subMesh.hasTangents)
+		{
+			m_VertexBuffer = m_SharedGeometry[i].VertexBuffer;
+			g_RenderBackend->AddRef(m_VertexBuffer);
+			m_IndexBuffer = m_SharedGeometry[i].IndexBuffer;
+			g_RenderBackend->AddRef(m_IndexBuffer);
+			m_GeometryId = m_SharedGeometry[i].GeometryId;
+			m_SharedGeometryIndex = i;
+			break;
+		}
+	}
+	if (!m_VertexBuffer)
+	{
+		// Create the vertex buffer and fill it with the loaded vertex data
+		m_VertexBuffer = g_RenderBackend->CreateBuffer( BufferVertex, m_NumVertices * m_VertexSize, subMesh.vertices );
+		if (!m_VertexBuffer)
+		{
+			return false;
+		}
+
+		// Create the index buffer - assuming 2-byte (WORD) index data
+		m_IndexBuffer = g_RenderBackend->CreateBuffer( BufferIndex, m_NumIndices * sizeof(WORD), subMesh.faces );
+		if (!m_IndexBuffer)
+		{
+			return false;
+		}
+
+		// New buffers get a new id for the render queue
+		m_GeometryId = m_NextGeometryId++;
+
+		SSharedGeometry shared;
+		shared.FileName = fileName;
+		shared.Tangents = subMesh.hasTangents;
+		shared.VertexBuffer = m_VertexBuffer;
+		g_RenderBackend->AddRef(shared.VertexBuffer);
+		shared.IndexBuffer = m_IndexBuffer;
+		g_RenderBackend->AddRef(shared.IndexBuffer);
+		shared.GeometryId = m_GeometryId;
+		shared.Vertices.assign(subMesh.vertices, subMesh.vertices + m_NumVertices * m_VertexSize);
+		shared.Indices.assign(&subMesh.faces[0].aiVertex[0], &subMesh.faces[0].aiVertex[0] + m_NumIndices);
+		m_SharedGeometryIndex = static_cast<unsigned int>(m_SharedGeometry.size());
+		m_SharedGeometry.push_back(shared);
 	}
 
-	// Create the index buffer - assuming 2-byte (WORD) index data
-	m_NumIndices = static_cast<unsigned int>(subMesh.numFaces) * 3;
-	bufferDesc.BindFlags = D3D10_BIND_INDEX_BUFFER;
-	bufferDesc.Usage = D3D10_USAGE_DEFAULT;
-	bufferDesc.ByteWidth = m_NumIndices * sizeof(WORD);
-	bufferDesc.CPUAccessFlags = 0;
-	bufferDesc.MiscFlags = 0;
-	initData.pSysMem = subMesh.faces;   
-	if (FAILED( g_pd3dDevice->CreateBuffer( &bufferDesc, &initData, &m_IndexBuffer )))
+	// Calculate a bounding sphere and box for culling
+	CalculateBounds(subMesh.vertices, subMesh.numVertices);
+
+	// Keep a copy of the geometry for occlusion culling if requested
+	m_OccluderMesh.Clear();
+	if (m_IsOccluder)
 	{
-		return false;
+		m_OccluderMesh.Build(subMesh.vertices, subMesh.vertexSize, subMesh.numVertices, &subMesh.faces[0].aiVertex[0], subMesh.numFaces,
+		                     m_OccluderCellSize);
+	}
+
+	// Keep the mesh's frame hierarchy - only used if the model is put in a transform hierarchy. The importer lists the frames
+	// depth-first, so parents always come before their children
+	m_FrameMatrices.resize(mesh.GetNumNodes());
+	m_FrameParents.resize(mesh.GetNumNodes());
+	for (unsigned int frame = 0; frame < mesh.GetNumNodes(); ++frame)
+	{
+		gen::SMeshNode node;
+		mesh.GetNode(frame, &node);
+		m_FrameMatrices[frame] = node.positionMatrix;
+		m_FrameParents[frame] = (frame == 0) ? gen::CTransformHierarchy::kNoParent : node.parent;
+	}
+	m_MeshFrame = subMesh.node;
+	unsigned int node = m_Transforms.GetHierarchyNode(m_Transform);
+	if (node != gen::CTransformStore::kNoNode && m_Transforms.GetBoundsNode(m_Transform) == node)
+	{
+		AddFrameNodes();
 	}
 
 	//Set the render technique for later rendering
 	m_RenderTechnique = exampleTechnique;
 	m_FileName = fileName;
 
+	m_HasGeometry = true;
+	return true;
+}
+
+
+// Share the geometry of a model that has already been loaded rather than reading its file again. The model keeps its own position,
+// material and colour
+bool CModel::LoadInstance(CModel* source)
+{
+	ReleaseResources();
+	if (!source->m_HasGeometry)
+	{
+		return false;
+	}
+
+	// Vertex format and layouts - the layouts are owned by the backend, so are simply shared
+	for (unsigned int i = 0; i < source->m_NumElements; ++i)
+	{
+		m_VertexElts[i] = source->m_VertexElts[i];
+	}
+	m_NumElements = source->m_NumElements;
+	m_VertexSize = source->m_VertexSize;
+	m_VertexLayout = source->m_VertexLayout;
+	m_InstancedLayout = source->m_InstancedLayout;
+
+	// Buffers
+	m_VertexBuffer = source->m_VertexBuffer;
+	g_RenderBackend->AddRef(m_VertexBuffer);
+	m_NumVertices = source->m_NumVertices;
+	m_IndexBuffer = source->m_IndexBuffer;
+	g_RenderBackend->AddRef(m_IndexBuffer);
+	m_NumIndices = source->m_NumIndices;
+	m_GeometryId = source->m_GeometryId;
+	m_SharedGeometryIndex = source->m_SharedGeometryIndex;
+
+	// Bounds, occluder mesh and frames
+	m_BoundingSphere = source->m_BoundingSphere;
+	m_Transforms.SetLocalBounds(m_Transform, m_Transforms.GetLocalBox(source->m_Transform), m_BoundingSphere);
+	m_IsOccluder = source->m_IsOccluder;
+	m_OccluderCellSize = source->m_OccluderCellSize;
+	m_OccluderMesh = source->m_OccluderMesh;
+	m_FrameMatrices = source->m_FrameMatrices;
+	m_FrameParents = source->m_FrameParents;
+	m_MeshFrame = source->m_MeshFrame;
+	unsigned int node = m_Transforms.GetHierarchyNode(m_Transform);
+	if (node != gen::CTransformStore::kNoNode && m_Transforms.GetBoundsNode(m_Transform) == node)
+	{
+		AddFrameNodes();
+	}
+
+	m_RenderTechnique = source->m_RenderTechnique;
+	m_FileName = source->m_FileName;
 
 	m_HasGeometry = true;
 	return true;
 }
 
+// Create the model's geometry from vertex and index data that is already in world space, with the vertex format, material, colour
+// and technique of an example model. Used for static batches - the model stays at the origin with no rotation or scaling
+bool CModel::CreateFromWorldGeometry(CModel* example, const vector<unsigned char>& vertices, const vector<WORD>& indices)
+{
+	ReleaseResources();
+	if (vertices.empty() || indices.empty() || !example->m_RenderTechnique)
+	{
+		return false;
+	}
+
+	// Same vertex format, material, colour and technique as the example
+	for (unsigned int i = 0; i < example->m_NumElements; ++i)
+	{
+		m_VertexElts[i] = example->m_VertexElts[i];
+	}
+	m_NumElements = example->m_NumElements;
+	m_VertexSize = example->m_VertexSize;
+	m_ModelMaterial = example->m_ModelMaterial;
+	m_Colour = example->m_Colour;
+	if (!SetRenderTechnique(example->m_RenderTechnique))
+	{
+		return false;
+	}
+
+	// The buffers belong to this model alone, they are not in the shared list
+	m_NumVertices = static_cast<unsigned int>(vertices.size()) / m_VertexSize;
+	m_NumIndices = static_cast<unsigned int>(indices.size());
+	m_VertexBuffer = g_RenderBackend->CreateBuffer( BufferVertex, m_NumVertices * m_VertexSize, &vertices[0] );
+	if (!m_VertexBuffer)
+	{
+		return false;
+	}
+	m_IndexBuffer = g_RenderBackend->CreateBuffer( BufferIndex, m_NumIndices * sizeof(WORD), &indices[0] );
+	if (!m_IndexBuffer)
+	{
+		return false;
+	}
+	m_GeometryId = m_NextGeometryId++;
+
+	CalculateBounds(&vertices[0], m_NumVertices);
+	m_FrameMatrices.clear();
+	m_FrameParents.clear();
+	m_MeshFrame = 0;
+	m_FileName = example->m_FileName + " (static batch)";
+
+	m_HasGeometry = true;
+	return true;
+}
+
+// Release the list's references to the buffers shared between models. Call when no more models will be loaded
+void CModel::ReleaseSharedGeometry()
+{
+	for (unsigned int i = 0; i < m_SharedGeometry.size(); ++i)
+	{
+		BACKEND_RELEASE( m_SharedGeometry[i].VertexBuffer );
+		BACKEND_RELEASE( m_SharedGeometry[i].IndexBuffer );
+	}
+	m_SharedGeometry.clear();
+}
+
+// Make space for the given number of new models in the transform store
+void CModel::ReserveModels(unsigned int numModels)
+{
+	m_Transforms.Reserve(m_Transforms.GetCount() + numModels);
+}
+
+// Calculate the bounding sphere and box of the geometry in model space from its vertices. Position is always the first element of each
+// vertex. The sphere is centred on the middle of the bounding box, with a radius that just reaches the furthest vertex (tighter than
+// enclosing the box's corners)
+void CModel::CalculateBounds(const unsigned char* vertices, unsigned int numVertices)
+{
+	gen::CAABB bounds(*reinterpret_cast<const gen::CVector3*>(vertices), *reinterpret_cast<const gen::CVector3*>(vertices));
+	for (unsigned int vertex = 1; vertex < numVertices; ++vertex)
+	{
+		bounds.Expand(*reinterpret_cast<const gen::CVector3*>(vertices + vertex * m_VertexSize));
+	}
+	gen::CVector3 centre = bounds.GetCentre();
+	float maxDistanceSq = 0.0f;
+	for (unsigned int vertex = 0; vertex < numVertices; ++vertex)
+	{
+		float distanceSq = gen::DistanceSquared(centre, *reinterpret_cast<const gen::CVector3*>(vertices + vertex * m_VertexSize));
+		if (distanceSq > maxDistanceSq)
+		{
+			maxDistanceSq = distanceSq;
+		}
+	}
+	m_BoundingSphere = gen::CSphere(centre, sqrtf(maxDistanceSq));
+	m_Transforms.SetLocalBounds(m_Transform, bounds, m_BoundingSphere);
+}
+
+// Select the technique to render with, returns false if it isn't compatible with the model's material. The vertex layouts for
+// the technique are shared by the backend, so switching between techniques doesn't create them again
+bool CModel::SetRenderTechnique(CTechnique* renderTechnique)
+{
+	if (renderTechnique && renderTechnique->IsCompatible(m_ModelMaterial))	//First check that the new technique and this models texture are compatible
+	{
+		SetLayouts(renderTechnique);
+		m_RenderTechnique = renderTechnique;
+		return true;
+	}
+	// Have not returned yet must have failed the if statement
+	return false;
+}
+
+// Get the layouts of the vertex elements for the given technique and its instanced version (if it has one) from the backend. The
+// instance data elements follow the model's vertex elements
+void CModel::SetLayouts(CTechnique* technique)
+{
+	m_InstancedLayout = NULL;
+	m_VertexLayout = g_RenderBackend->GetInputLayout( m_VertexElts, m_NumElements, technique, false );
+
+	if (!technique->HasInstancedTechnique() || m_NumElements + NUM_INSTANCE_ELTS > MAX_VERTEX_ELTS)
+	{
+		return;
+	}
+
+	D3D10_INPUT_ELEMENT_DESC elts[MAX_VERTEX_ELTS];
+	for (unsigned int i = 0; i < m_NumElements; ++i)
+	{
+		elts[i] = m_VertexElts[i];
+	}
+	for (unsigned int i = 0; i < NUM_INSTANCE_ELTS; ++i)
+	{
+		elts[m_NumElements + i] = m_InstanceElts[i];
+	}
+
+	// Fails (leaving the layout NULL) if the model doesn't have the vertex data the instanced shaders need - the model is then
+	// always drawn on its own
+	m_InstancedLayout = g_RenderBackend->GetInputLayout( elts, m_NumElements + NUM_INSTANCE_ELTS, technique, true );
+}
+
+
+/////////////////////////////
+// Static batching
+
+// Check if two models have the same vertex elements, so their vertices can go in one buffer
+bool CModel::HasSameVertexFormat(CModel* other)
+{
+	if (m_NumElements != other->m_NumElements || m_VertexSize != other->m_VertexSize)
+	{
+		return false;
+	}
+	for (unsigned int i = 0; i < m_NumElements; ++i)
+	{
+		if (strcmp(m_VertexElts[i].SemanticName, other->m_VertexElts[i].SemanticName) != 0 ||
+		    m_VertexElts[i].Format != other->m_VertexElts[i].Format || m_VertexElts[i].AlignedByteOffset != other->m_VertexElts[i].AlignedByteOffset)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Append the model's geometry, transformed into world space by its current world matrix, to vertex and index lists in the model's
+// vertex format. Positions are transformed by the world matrix, normals by its inverse transpose and tangents by its rotation and
+// scaling, then renormalised. A mirroring world matrix reverses the triangles' winding, so their order is swapped back
+bool CModel::AppendWorldGeometry(vector<unsigned char>& vertices, vector<WORD>& indices)
+{
+	if (!m_HasGeometry || m_SharedGeometryIndex == kNoSharedGeometry)
+	{
+		return false;
+	}
+	const SSharedGeometry& geometry = m_SharedGeometry[m_SharedGeometryIndex];
+
+	D3DXMATRIX worldMatrix = GetMeshWorldMatrix();
+	D3DXMATRIX normalMatrix;
+	float determinant;
+	D3DXMatrixInverse(&normalMatrix, &determinant, &worldMatrix);
+	D3DXMatrixTranspose(&normalMatrix, &normalMatrix);
+
+	// Find the normal and tangent elements
+	unsigned int normalOffset = 0, tangentOffset = 0;
+	bool hasNormals = false, hasTangents = false;
+	for (unsigned int i = 0; i < m_NumElements; ++i)
+	{
+		if (strcmp(m_VertexElts[i].SemanticName, "NORMAL") == 0)
+		{
+			hasNormals = true;
+			normalOffset = m_VertexElts[i].AlignedByteOffset;
+		}
+		else if (strcmp(m_VertexElts[i].SemanticName, "TANGENT") == 0)
+		{
+			hasTangents = true;
+			tangentOffset = m_VertexElts[i].AlignedByteOffset;
+		}
+	}
+
+	unsigned int firstVertex = static_cast<unsigned int>(vertices.size()) / m_VertexSize;
+	vertices.insert(vertices.end(), geometry.Vertices.begin(), geometry.Vertices.end());
+	for (unsigned int vertex = firstVertex; vertex < firstVertex + m_NumVertices; ++vertex)
+	{
+		unsigned char* data = &vertices[vertex * m_VertexSize];
+		D3DXVECTOR3* position = reinterpret_cast<D3DXVECTOR3*>(data);
+		D3DXVec3TransformCoord(position, position, &worldMatrix);
+		if (hasNormals)
+		{
+			D3DXVECTOR3* normal = reinterpret_cast<D3DXVECTOR3*>(data + normalOffset);
+			D3DXVec3TransformNormal(normal, normal, &normalMatrix);
+			D3DXVec3Normalize(normal, normal);
+		}
+		if (hasTangents)
+		{
+			D3DXVECTOR3* tangent = reinterpret_cast<D3DXVECTOR3*>(data + tangentOffset);
+			D3DXVec3TransformNormal(tangent, tangent, &worldMatrix);
+			D3DXVec3Normalize(tangent, tangent);
+		}
+	}
+
+	bool mirrored = (D3DXMatrixDeterminant(&worldMatrix) < 0.0f);
+	for (unsigned int i = 0; i < m_NumIndices; i += 3)
+	{
+		indices.push_back(static_cast<WORD>(firstVertex + geometry.Indices[i]));
+		indices.push_back(static_cast<WORD>(firstVertex + geometry.Indices[mirrored ? i + 2 : i + 1]));
+		indices.push_back(static_cast<WORD>(firstVertex + geometry.Indices[mirrored ? i + 1 : i + 2]));
+	}
+	return true;
+}
+
 
 /////////////////////////////
 // Model Usage
@@ -250,76 +587,173 @@ bool CModel::UseTangents()
 	return false;
 }
 
-// Update the world matrix of the model from its position, rotation and scaling
+// Select whether the model's orientation is held as Euler angles (default) or a quaternion
+void CModel::SetUseQuaternion(bool useQuaternion)
+{
+	m_Transforms.SetUseQuaternion(m_Transform, useQuaternion);
+}
+
+// Update the matrix of the model from its position, rotation and scaling
 void CModel::UpdateMatrix()
 {
-	// Make a matrix for position and scaling, and one each for X, Y & Z rotations
-	D3DXMATRIX matrixXRot, matrixYRot, matrixZRot, matrixTranslation, matrixScaling;
-	D3DXMatrixRotationX( &matrixXRot, m_Rotation.x );
-	D3DXMatrixRotationY( &matrixYRot, m_Rotation.y );
-	D3DXMatrixRotationZ( &matrixZRot, m_Rotation.z );
-	D3DXMatrixTranslation( &matrixTranslation, m_Position.x, m_Position.y, m_Position.z );
-	D3DXMatrixScaling( &matrixScaling, m_Scale.x, m_Scale.y, m_Scale.z );
-
-	// Multiply above matrices together to get the effect of them all combined - this makes the world matrix for the rendering pipeline
-	// Order of multiplication is important, get slightly different control mechanism depending on order
-	m_WorldMatrix = matrixScaling * matrixZRot * matrixXRot * matrixYRot * matrixTranslation;
+	if (m_Transforms.UpdateMatrix(m_Transform))
+	{
+		g_TransformStats.ModelMatrices.Updated++;
+	}
+	else
+	{
+		g_TransformStats.ModelMatrices.Skipped++;
+	}
+}
+
+// Update the matrices of all models that have changed, in one pass over the transform store
+void CModel::UpdateAllMatrices(gen::CJobSystem* jobs /*= NULL*/)
+{
+	unsigned int numUpdated = m_Transforms.UpdateMatrices(jobs);
+	g_TransformStats.ModelMatrices.Updated += numUpdated;
+	g_TransformStats.ModelMatrices.Skipped += m_Transforms.GetCount() - numUpdated;
+}
+
+// Recalculate the world bounding volumes of all models that have moved, in one pass over the transform store
+void CModel::UpdateAllBounds(gen::CJobSystem* jobs /*= NULL*/)
+{
+	unsigned int numUpdated = m_Transforms.UpdateBounds(jobs);
+	g_TransformStats.ModelBounds.Updated += numUpdated;
+	g_TransformStats.ModelBounds.Skipped += m_Transforms.GetCount() - numUpdated;
+}
+
+// Add the model, and the frames of its mesh, to a transform hierarchy as a child of the given model (or as a root if NULL).
+// All models share one transform store, so must all use the same hierarchy
+void CModel::AttachToHierarchy(gen::CTransformHierarchy* hierarchy, CModel* parent /*= NULL*/)
+{
+	unsigned int parentNode = parent ? parent->GetHierarchyNode() : gen::CTransformHierarchy::kNoParent;
+	m_Transforms.SetHierarchy(hierarchy);
+	unsigned int node = hierarchy->AddNode(m_Transforms.GetMatrix(m_Transform), parentNode);
+	m_Transforms.SetHierarchyNode(m_Transform, node, node);
+	AddFrameNodes();
+}
+
+// Add the mesh's frames to the hierarchy below the model's node. Frame parents are earlier in the list, so their nodes already exist
+void CModel::AddFrameNodes()
+{
+	if (m_FrameMatrices.empty())
+	{
+		return; // Not loaded yet, Load will add them
+	}
+	gen::CTransformHierarchy* hierarchy = m_Transforms.GetHierarchy();
+	unsigned int node = m_Transforms.GetHierarchyNode(m_Transform);
+	vector<unsigned int> frameNodes(m_FrameMatrices.size());
+	for (unsigned int frame = 0; frame < m_FrameMatrices.size(); ++frame)
+	{
+		unsigned int parentNode = (m_FrameParents[frame] == gen::CTransformHierarchy::kNoParent) ? node : frameNodes[m_FrameParents[frame]];
+		frameNodes[frame] = hierarchy->AddNode(m_FrameMatrices[frame], parentNode);
+	}
+	m_Transforms.SetHierarchyNode(m_Transform, node, frameNodes[m_MeshFrame]); // Bounds follow the frame holding the geometry
 }
 
-// Make the model face a given point
+// World matrix with flags describing how it was built - always rotation, translation and scale. A parent in a hierarchy may add
+// any affine transform
+gen::CTrackedTransform CModel::GetWorldTransform()
+{
+	unsigned int node = m_Transforms.GetHierarchyNode(m_Transform);
+	if (node != gen::CTransformStore::kNoNode && m_Transforms.GetHierarchy()->GetParent(node) != gen::CTransformHierarchy::kNoParent)
+	{
+		return gen::CTrackedTransform( gen::ToCMatrix4x4(GetWorldMatrix()), gen::kTransformAffine );
+	}
+	return gen::CTrackedTransform( gen::ToCMatrix4x4(GetWorldMatrix()),
+	                               gen::kTransformRigid | gen::CTrackedTransform::ScaleFlags(m_Transforms.GetScale(m_Transform)) );
+}
+
+// Make the model face a given point (in the parent's space if the model is in a hierarchy)
 void CModel::FacePoint(D3DXVECTOR3 point)
 {
-	using gen::CVector3;
-	using gen::CMatrix4x4;
+	// Method: With no roll, facing a direction only needs a rotation around the X axis (pitch) followed by a rotation
+	// around the Y axis (yaw). Both angles can be read straight from the direction vector, no need to build a
+	// facing matrix and decompose it again
+	D3DXVECTOR3 facing = point - GetPosition();
+	if (facing.x == 0.0f && facing.y == 0.0f && facing.z == 0.0f)
+	{
+		return; // Already at the point, no direction to face
+	}
+	float yaw   = atan2f( facing.x, facing.z );
+	float pitch = atan2f( -facing.y, sqrtf( facing.x * facing.x + facing.z * facing.z ) );
 
-	// Method: Make a (world) matrix that faces a particular direction - just force the z-axis 
-	// that way and put the other axes at right angles. Then extract the position and rotations from that matrix
-	CMatrix4x4 facingMatrix = MatrixFaceTarget(CVector3(m_Position), CVector3(point));
-	facingMatrix.DecomposeAffineEuler((CVector3*)&m_Position, (CVector3*)&m_Rotation, 0);
+	if (UsesQuaternion())
+	{
+		SetOrientation( gen::QuaternionRotationX( pitch ) * gen::QuaternionRotationY( yaw ) );
+	}
+	else
+	{
+		SetRotation( D3DXVECTOR3( pitch, yaw, 0.0f ) );
+	}
 }
 
 // Control the model's position and rotation using keys provided. Amount of motion performed depends on frame time
 void CModel::Control( float frameTime, EKeyCode turnUp, EKeyCode turnDown, EKeyCode turnLeft, EKeyCode turnRight,  
 					  EKeyCode turnCW, EKeyCode turnCCW, EKeyCode moveForward, EKeyCode moveBackward )
 {
+	// Amount of rotation around each axis this frame
+	D3DXVECTOR3 rotation( 0.0f, 0.0f, 0.0f );
 	if (KeyHeld( turnDown ))
 	{
-		m_Rotation.x += RotSpeed * frameTime;
+		rotation.x += RotSpeed * frameTime;
 	}
 	if (KeyHeld( turnUp ))
 	{
-		m_Rotation.x -= RotSpeed * frameTime;
+		rotation.x -= RotSpeed * frameTime;
 	}
 	if (KeyHeld( turnRight ))
 	{
-		m_Rotation.y += RotSpeed * frameTime;
+		rotation.y += RotSpeed * frameTime;
 	}
 	if (KeyHeld( turnLeft ))
 	{
-		m_Rotation.y -= RotSpeed * frameTime;
+		rotation.y -= RotSpeed * frameTime;
 	}
 	if (KeyHeld( turnCW ))
 	{
-		m_Rotation.z += RotSpeed * frameTime;
+		rotation.z += RotSpeed * frameTime;
 	}
 	if (KeyHeld( turnCCW ))
 	{
-		m_Rotation.z -= RotSpeed * frameTime;
+		rotation.z -= RotSpeed * frameTime;
+	}
+
+	if (rotation.x != 0.0f || rotation.y != 0.0f || rotation.z != 0.0f)
+	{
+		if (UsesQuaternion())
+		{
+			// Quaternion orientation rotates around the model's local axes - pre-multiply by the rotation for this frame.
+			// Renormalise to prevent drift building up over many frames
+			gen::CQuaternion orientation = GetOrientation();
+			if (rotation.x != 0.0f) orientation = gen::QuaternionRotationX( rotation.x ) * orientation;
+			if (rotation.y != 0.0f) orientation = gen::QuaternionRotationY( rotation.y ) * orientation;
+			if (rotation.z != 0.0f) orientation = gen::QuaternionRotationZ( rotation.z ) * orientation;
+			orientation.Normalise();
+			SetOrientation( orientation );
+		}
+		else
+		{
+			SetRotation( GetRotation() + rotation );
+		}
 	}
 
-	// Local Z movement - move in the direction of the Z axis, get axis from world matrix
+	// Local Z movement - move in the direction of the Z axis, get axis from the model matrix
+	const gen::CMatrix4x4& matrix = m_Transforms.GetMatrix( m_Transform );
+	D3DXVECTOR3 position = GetPosition();
 	if (KeyHeld( moveForward ))
 	{
-		m_Position.x += m_WorldMatrix._31 * MoveSpeed * frameTime;
-		m_Position.y += m_WorldMatrix._32 * MoveSpeed * frameTime;
-		m_Position.z += m_WorldMatrix._33 * MoveSpeed * frameTime;
+		position.x += matrix.e20 * MoveSpeed * frameTime;
+		position.y += matrix.e21 * MoveSpeed * frameTime;
+		position.z += matrix.e22 * MoveSpeed * frameTime;
 	}
 	if (KeyHeld( moveBackward ))
 	{
-		m_Position.x -= m_WorldMatrix._31 * MoveSpeed * frameTime;
-		m_Position.y -= m_WorldMatrix._32 * MoveSpeed * frameTime;
-		m_Position.z -= m_WorldMatrix._33 * MoveSpeed * frameTime;
+		position.x -= matrix.e20 * MoveSpeed * frameTime;
+		position.y -= matrix.e21 * MoveSpeed * frameTime;
+		position.z -= matrix.e22 * MoveSpeed * frameTime;
 	}
+	SetPosition( position ); // Only marks the matrix dirty if it has moved
 }
 
 
@@ -333,36 +767,70 @@ void CModel::Render()
 	}
 
 	//Provide values for effect variables - texture, model colour, matrix
-	if (m_MatrixVar)	//Set the matrix (if the m_MatrixVar is valid)
-	{
-		m_MatrixVar->SetMatrix((float*)GetWorldMatrix());
-	}
 	if (m_ModelMaterial)	//Set the texture (if the model has a texture and the texture is valid)
 	{
 		m_ModelMaterial->SendToShader();
 	}
-	if (m_ColourVar)
-	{
-		m_ColourVar->SetRawValue(m_Colour, 0, sizeof(D3DXVECTOR3));
-	}
+	SetObjectVariables();
 
-	// Select vertex and index buffer - assuming all data will be as triangle lists
-	UINT offset = 0;
-	g_pd3dDevice->IASetVertexBuffers( 0, 1, &m_VertexBuffer, &m_VertexSize, &offset );
-	g_pd3dDevice->IASetInputLayout( m_VertexLayout );
-	g_pd3dDevice->IASetIndexBuffer( m_IndexBuffer, DXGI_FORMAT_R16_UINT, 0 );
-	g_pd3dDevice->IASetPrimitiveTopology( D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
+	// Select vertex and index buffer - assuming all data will be as triangle lists. The state cache skips any already selected
+	g_StateCache.IASetVertexBuffer( m_VertexBuffer, m_VertexSize );
+	g_StateCache.IASetInputLayout( m_VertexLayout );
+	g_StateCache.IASetIndexBuffer( m_IndexBuffer, DXGI_FORMAT_R16_UINT );
+	g_StateCache.IASetPrimitiveTopology( D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
 
 	// Render the model. All the data and shader variables are prepared, now select the technique to use and draw.
 	// The loop is for advanced techniques that need multiple passes - we will only use techniques with one pass
-	D3D10_TECHNIQUE_DESC techDesc;
-	m_RenderTechnique->GetTechnique()->GetDesc(&techDesc);
-	for( UINT p = 0; p < techDesc.Passes; ++p )
+	for( UINT p = 0; p < m_RenderTechnique->GetNumPasses(); ++p )
 	{
-		m_RenderTechnique->GetTechnique()->GetPassByIndex(p)->Apply(0);
-		g_pd3dDevice->DrawIndexed( m_NumIndices, 0, 0 );
+		g_RenderBackend->ApplyPass(m_RenderTechnique, p, false);
+		g_DrawStats.RecordApply(m_RenderTechnique, p);
+		g_ShaderConstants.RecordApply();
+		g_RenderBackend->DrawIndexed( m_NumIndices );
+		g_DrawStats.RecordDraw(this, m_NumIndices);
 	}
-	g_pd3dDevice->DrawIndexed( m_NumIndices, 0, 0 );
+}
+
+// Provide the per-model shader constants - matrix and colour. Used by the render queue, which sets the technique, material and
+// geometry itself only when they change between models
+void CModel::SetObjectVariables()
+{
+	SPerObjectConstants& constants = g_ShaderConstants.Object();
+	constants.WorldMatrix = GetMeshWorldMatrix();
+	constants.Colour = m_Colour;
+	g_ShaderConstants.UploadObject();
+}
+
+// Select the model's vertex buffer, vertex layout and index buffer. The primitive topology is left to the caller
+void CModel::SetGeometry()
+{
+	g_StateCache.IASetVertexBuffer( m_VertexBuffer, m_VertexSize );
+	g_StateCache.IASetInputLayout( m_VertexLayout );
+	g_StateCache.IASetIndexBuffer( m_IndexBuffer, DXGI_FORMAT_R16_UINT );
+}
+
+// Draw the geometry selected by SetGeometry with the current effect pass
+void CModel::DrawGeometry()
+{
+	g_RenderBackend->DrawIndexed( m_NumIndices );
+	g_DrawStats.RecordDraw(this, m_NumIndices);
+}
+
+// Select the geometry with the instanced layout and a buffer of SInstanceData in the second vertex buffer slot
+void CModel::SetInstancedGeometry(TBufferHandle instanceBuffer)
+{
+	g_StateCache.IASetVertexBuffer( m_VertexBuffer, m_VertexSize );
+	g_StateCache.IASetVertexBuffer( instanceBuffer, sizeof(SInstanceData), 0, 1 );
+	g_StateCache.IASetInputLayout( m_InstancedLayout );
+	g_StateCache.IASetIndexBuffer( m_IndexBuffer, DXGI_FORMAT_R16_UINT );
+}
+
+// Draw instances of the geometry selected by SetInstancedGeometry with the current effect pass. The caller records the model drawn
+// by each instance in the draw statistics
+void CModel::DrawGeometryInstanced(unsigned int numInstances)
+{
+	g_RenderBackend->DrawIndexedInstanced( m_NumIndices, numInstances );
+	g_DrawStats.RecordDrawCall();
 }
 
 void CModel::ShadowRender()
@@ -372,27 +840,25 @@ void CModel::ShadowRender()
 	{
 		return;
 	}
-	//Provide values for effect variables - texture, model colour, matrix
-	if (m_MatrixVar)	//Set the matrix (if the m_MatrixVar is valid)
-	{
-		m_MatrixVar->SetMatrix((float*)GetWorldMatrix());
-	}
+	//Provide the matrix to the shader, the colour is not used by the depth only technique
+	g_ShaderConstants.Object().WorldMatrix = GetMeshWorldMatrix();
+	g_ShaderConstants.UploadObject();
 
-	// Select vertex and index buffer - assuming all data will be as triangle lists
-	UINT offset = 0;
-	g_pd3dDevice->IASetVertexBuffers(0, 1, &m_VertexBuffer, &m_VertexSize, &offset);
-	g_pd3dDevice->IASetInputLayout(m_VertexLayout);
-	g_pd3dDevice->IASetIndexBuffer(m_IndexBuffer, DXGI_FORMAT_R16_UINT, 0);
-	g_pd3dDevice->IASetPrimitiveTopology(D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	// Select vertex and index buffer - assuming all data will be as triangle lists. The state cache skips any already selected
+	g_StateCache.IASetVertexBuffer(m_VertexBuffer, m_VertexSize);
+	g_StateCache.IASetInputLayout(m_VertexLayout);
+	g_StateCache.IASetIndexBuffer(m_IndexBuffer, DXGI_FORMAT_R16_UINT);
+	g_StateCache.IASetPrimitiveTopology(D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
 	// Render the model. All the data and shader variables are prepared, now select the technique to use and draw.
 	// The loop is for advanced techniques that need multiple passes - we will only use techniques with one pass
-	D3D10_TECHNIQUE_DESC techDesc;
-	m_ShadowRenderTechnique->GetTechnique()->GetDesc(&techDesc);
-	for (UINT p = 0; p < techDesc.Passes; ++p)
+	for (UINT p = 0; p < m_ShadowRenderTechnique->GetNumPasses(); ++p)
 	{
-		m_ShadowRenderTechnique->GetTechnique()->GetPassByIndex(p)->Apply(0);
-		g_pd3dDevice->DrawIndexed(m_NumIndices, 0, 0);
+		g_RenderBackend->ApplyPass(m_ShadowRenderTechnique, p, false);
+		g_DrawStats.RecordApply(m_ShadowRenderTechnique, p);
+		g_ShaderConstants.RecordApply();
+		g_RenderBackend->DrawIndexed(m_NumIndices);
+		g_DrawStats.RecordDraw(this, m_NumIndices);
 	}
 
 }
\ No newline at end of file
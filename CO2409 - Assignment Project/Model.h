@@ -15,10 +15,25 @@ using namespace std;
 #include <d3dx10.h>
 #include "Input.h"
 #include "Material.h"
+#include "RenderBackend.h"
 #include "Technique.h"
+#include "CQuaternion.h"
+#include "CTrackedTransform.h"
+#include "BoundingVolumes.h"
+#include "CTransformStore.h"
+#include "COcclusionBuffer.h"
+#include "MathDX.h"
 
 #include <vector>
 
+// Per-instance data for instanced rendering, one per model drawn - matches the WORLD0-3 and INSTANCECOLOUR elements of
+// VS_INSTANCED_INPUT in the .fx file
+struct SInstanceData
+{
+	D3DXMATRIX  WorldMatrix;
+	D3DXVECTOR3 Colour;
+};
+
 class CModel
 {
 /////////////////////////////
@@ -27,14 +42,12 @@ private:
 	//-----------------
 	// Postioning
 
-	// Positions, rotations and scaling for the model
-	D3DXVECTOR3   m_Position;
-	D3DXVECTOR3   m_Rotation;
-	D3DXVECTOR3   m_Scale;
-
-	// World matrix for the model - built from the above
-	D3DXMATRIX m_WorldMatrix;
-
+	// Position, rotation, scale, matrix and world bounds of every model are held together in a store of contiguous arrays, so
+	// the per-frame passes over the scene (updating matrices and bounds, culling) stream through memory rather than visiting
+	// each model in turn. The model itself only keeps its handle in the store. Setters mark the matrix dirty, so only models
+	// that have moved are rebuilt. If the model is attached to a transform hierarchy its matrix is relative to the parent
+	static gen::CTransformStore m_Transforms;
+	unsigned int                m_Transform;
 	
 	//-----------------
 	// Geometry data
@@ -43,19 +56,64 @@ private:
 	bool                     m_HasGeometry;
 
 	// Vertex data for the model stored in a vertex buffer and the number of the vertices in the buffer
-	ID3D10Buffer*            m_VertexBuffer;
+	TBufferHandle            m_VertexBuffer;
 	unsigned int             m_NumVertices;
 
 	// Description of the elements in a single vertex (position, normal, UVs etc.)
 	static const int         MAX_VERTEX_ELTS = 64;
 	D3D10_INPUT_ELEMENT_DESC m_VertexElts[MAX_VERTEX_ELTS];
-	ID3D10InputLayout*       m_VertexLayout; // Layout of a vertex (derived from above)
+	TLayoutHandle            m_VertexLayout; // Layout of a vertex (derived from above, owned and shared by the render backend)
 	unsigned int             m_VertexSize;   // Size of vertex calculated from contained elements
 
+	// Layout for the instanced version of the render technique - the vertex elements above plus the instance data elements from a
+	// second vertex buffer. NULL if the technique has no instanced version
+	TLayoutHandle            m_InstancedLayout;
+	static const D3D10_INPUT_ELEMENT_DESC m_InstanceElts[];
+	static const unsigned int NUM_INSTANCE_ELTS = 5;
+
 	// Index data for the model stored in a index buffer and the number of indices in the buffer
-	ID3D10Buffer*            m_IndexBuffer;
+	TBufferHandle            m_IndexBuffer;
 	unsigned int             m_NumIndices;
 
+	// Number identifying the buffers above in render queue sort keys. Models sharing buffers have the same id
+	unsigned int             m_GeometryId;
+	static unsigned int      m_NextGeometryId;
+
+	// Buffers already created for each file loaded, so that models loading the same file share them (and so can be drawn together
+	// with instancing). The list holds its own reference to each buffer until ReleaseSharedGeometry
+	// A copy of the vertex and index data is also kept in system memory, to merge into static batches
+	struct SSharedGeometry
+	{
+		string                FileName;
+		bool                  Tangents;
+		TBufferHandle         VertexBuffer;
+		TBufferHandle         IndexBuffer;
+		unsigned int          GeometryId;
+		vector<unsigned char> Vertices;
+		vector<WORD>          Indices;
+	};
+	static vector<SSharedGeometry> m_SharedGeometry;
+	unsigned int                   m_SharedGeometryIndex; // Entry in the list for this model's buffers, kNoSharedGeometry if none
+	static const unsigned int      kNoSharedGeometry = 0xffffffff;
+
+	// Frame hierarchy from the mesh file - local matrix and parent of each frame, parent-before-child (root frames have parent
+	// gen::CTransformHierarchy::kNoParent). The geometry is held in one frame
+	vector<gen::CMatrix4x4>  m_FrameMatrices;
+	vector<unsigned int>     m_FrameParents;
+	unsigned int             m_MeshFrame;
+
+	// Sphere enclosing the geometry in model space (the world space volumes used for culling are held in the transform store)
+	gen::CSphere             m_BoundingSphere;
+
+	// Set for models that never move - allows them to go in the static culling tree
+	bool                     m_IsStationary;
+
+	// Models that hide large parts of the scene keep a copy of their geometry (optionally simplified) to rasterise into the
+	// occlusion buffer. Built by Load if the model has been marked as an occluder
+	bool                     m_IsOccluder;
+	float                    m_OccluderCellSize;
+	gen::COccluderMesh       m_OccluderMesh;
+
 	//---------------
 	// Render data
 
@@ -67,14 +125,6 @@ private:
 	//Technique change variables
 	string m_FileName;
 
-	//--------------
-	// Render effect variables
-	
-	//Effect variable to pass matrix to shader
-	static ID3D10EffectMatrixVariable* m_MatrixVar;
-	//Effect variable to pass colour to shader
-	static ID3D10EffectVectorVariable* m_ColourVar;
-
 	//Render technique for rendering shadow maps
 	static CTechnique* m_ShadowRenderTechnique;
 
@@ -85,17 +135,27 @@ private:
 
 	unsigned int m_NumElements;
 
+	// Add the mesh's frames to the hierarchy below the model's node
+	void AddFrameNodes();
+
+	// Calculate the bounding sphere and box of the geometry in model space from its vertices
+	void CalculateBounds(const unsigned char* vertices, unsigned int numVertices);
+
+	// Get the layouts of the vertex elements for the given technique and its instanced version (if it has one) from the input
+	// layout cache, releasing the previous layouts
+	void SetLayouts(CTechnique* technique);
+
+	// Models own GPU resources and a transform store entry, so are not copied
+	CModel(const CModel&);
+	CModel& operator=(const CModel&);
+
 public:
 	//Static data members
 	static vector<CMaterial*> m_MaterialList;
-	static vector<CTechnique*> m_TechniqueList;
 
 /////////////////////////////
 // Public member functions
 
-	static void SetMatrixShaderVariable(ID3D10EffectMatrixVariable* matrixVar);
-	static void SetColourShaderVariable(ID3D10EffectVectorVariable* colourVar);
-
 	static void SetShadowRenderTechnique(CTechnique* shadowTechnique);
 
 	///////////////////////////////
@@ -116,69 +176,172 @@ public:
 	// Getters
 	D3DXVECTOR3 GetPosition()
 	{
-		return m_Position;
+		return gen::ToD3DXVECTOR(m_Transforms.GetPosition(m_Transform));
 	}
-	D3DXVECTOR3 GetFacingVector()
+	D3DXVECTOR3 GetWorldPosition() // Same as GetPosition unless the model has a parent in a hierarchy
+	{
+		const D3DXMATRIX& worldMatrix = GetWorldMatrix();
+		return D3DXVECTOR3(worldMatrix._41, worldMatrix._42, worldMatrix._43);
+	}
+	D3DXVECTOR3 GetFacingVector() // In world space
 	{
 		D3DXVECTOR3 facing;
-		D3DXVec3Normalize(&facing, &D3DXVECTOR3(&m_WorldMatrix(2, 0)));
+		const D3DXMATRIX& worldMatrix = GetWorldMatrix();
+		D3DXVec3Normalize(&facing, &D3DXVECTOR3(worldMatrix._31, worldMatrix._32, worldMatrix._33));
 		return facing;
 	}
-	D3DXVECTOR3 GetRotation()
+	D3DXVECTOR3 GetRotation() // Euler angles - not kept up to date when using a quaternion orientation
+	{
+		return gen::ToD3DXVECTOR(m_Transforms.GetRotation(m_Transform));
+	}
+	gen::CQuaternion GetOrientation()
+	{
+		return m_Transforms.GetOrientation(m_Transform);
+	}
+	bool UsesQuaternion()
 	{
-		return m_Rotation;
+		return m_Transforms.UsesQuaternion(m_Transform);
 	}
 	D3DXVECTOR3 GetScale()
 	{
-		return m_Scale;
+		return gen::ToD3DXVECTOR(m_Transforms.GetScale(m_Transform));
 	}
-	D3DXMATRIX GetWorldMatrix()
+	// World matrix of the model. If the model is in a hierarchy this is only up to date after the hierarchy's update
+	const D3DXMATRIX& GetWorldMatrix()
 	{
-		return m_WorldMatrix;
+		return gen::ToD3DXMATRIX(m_Transforms.GetWorldMatrix(m_Transform));
+	}
+	// World matrix used to render the geometry - includes the mesh's frame matrices if the model is in a hierarchy
+	const D3DXMATRIX& GetMeshWorldMatrix()
+	{
+		unsigned int meshNode = m_Transforms.GetBoundsNode(m_Transform);
+		return (meshNode != gen::CTransformStore::kNoNode) ? gen::ToD3DXMATRIX(m_Transforms.GetHierarchy()->GetWorldMatrix(meshNode))
+		                                                   : GetWorldMatrix();
+	}
+	// Increases each time the world matrix changes - compare with an earlier value to see if the model has moved
+	unsigned int GetMatrixVersion()
+	{
+		return m_Transforms.GetVersion(m_Transform);
+	}
+	// Hierarchy node of the model, or gen::CTransformHierarchy::kNoParent if it is not in a hierarchy
+	unsigned int GetHierarchyNode()
+	{
+		return m_Transforms.GetHierarchyNode(m_Transform);
+	}
+	// World matrix with flags describing how it was built - allows the cheapest inverse to be used
+	gen::CTrackedTransform GetWorldTransform();
+	bool HasGeometry()
+	{
+		return m_HasGeometry;
+	}
+	// Bounding sphere of the geometry in model space
+	gen::CSphere GetBoundingSphere()
+	{
+		return m_BoundingSphere;
+	}
+	// Bounding sphere of the geometry in world space (from the current world matrix)
+	const gen::CSphere& GetWorldBoundingSphere()
+	{
+		m_Transforms.UpdateBounds(m_Transform); // Normally already done by UpdateAllBounds
+		return m_Transforms.GetWorldSphere(m_Transform);
+	}
+	// Axis-aligned box enclosing the geometry in world space (from the current world matrix)
+	const gen::CAABB& GetWorldBoundingBox()
+	{
+		m_Transforms.UpdateBounds(m_Transform);
+		return m_Transforms.GetWorldBox(m_Transform);
+	}
+	bool IsStationary()
+	{
+		return m_IsStationary;
+	}
+	bool IsOccluder()
+	{
+		return m_IsOccluder && !m_OccluderMesh.IsEmpty();
+	}
+	const gen::COccluderMesh* GetOccluderMesh()
+	{
+		return &m_OccluderMesh;
+	}
+	CTechnique* GetRenderTechnique()
+	{
+		return m_RenderTechnique;
+	}
+	CMaterial* GetMaterial()
+	{
+		return m_ModelMaterial;
+	}
+	unsigned int GetGeometryId()
+	{
+		return m_GeometryId;
+	}
+	TLayoutHandle GetInstancedLayout()
+	{
+		return m_InstancedLayout;
+	}
+	unsigned int GetNumVertices()
+	{
+		return m_NumVertices;
+	}
+	unsigned int GetNumIndices()
+	{
+		return m_NumIndices;
+	}
+
+	// File the model's geometry was loaded from, used to identify it in statistics
+	const string& GetFileName()
+	{
+		return m_FileName;
+	}
+	D3DXVECTOR3 GetColour()
+	{
+		return m_Colour;
 	}
 
 
 	// Setters
 	void SetPosition( D3DXVECTOR3 position )
 	{
-		m_Position = position;
+		m_Transforms.SetPosition(m_Transform, gen::ToCVector3(position));
 	}
-	void SetRotation( D3DXVECTOR3 rotation )
+	void SetRotation( D3DXVECTOR3 rotation ) // Also sets the quaternion if it is in use
 	{
-		m_Rotation = rotation;
+		m_Transforms.SetRotation(m_Transform, gen::ToCVector3(rotation));
+	}
+	void SetOrientation( const gen::CQuaternion& orientation ) // Also switches the model to quaternion orientation
+	{
+		m_Transforms.SetOrientation(m_Transform, orientation);
 	}
 	void SetScale( D3DXVECTOR3 scale ) // Overloaded setter, two versions: this one sets x,y,z scale separately, the next sets all to the same value
 	{
-		m_Scale = scale;
+		m_Transforms.SetScale(m_Transform, gen::ToCVector3(scale));
 	}
 	void SetScale( float scale )
 	{
-		m_Scale = D3DXVECTOR3( scale, scale, scale );
+		SetScale( D3DXVECTOR3( scale, scale, scale ) );
 	}
 	void SetMaterial(CMaterial* material)
 	{
 		m_ModelMaterial = material;
 	}
-	bool SetRenderTechnique(CTechnique* renderTechnique)
-	{
-		if (renderTechnique->IsCompatible(m_ModelMaterial))	//First check that the new technique and this models texture are compatible
-		{
-			// Given the vertex element list, pass it to DirectX to create a vertex layout. We also need to pass an example of a technique that will
-			// render this model. We will only be able to render this model with techniques that have the same vertex input as the example we use here
-			D3D10_PASS_DESC PassDesc;
-			renderTechnique->GetTechnique()->GetPassByIndex(0)->GetDesc(&PassDesc);
-			g_pd3dDevice->CreateInputLayout(m_VertexElts, m_NumElements, PassDesc.pIAInputSignature, PassDesc.IAInputSignatureSize, &m_VertexLayout);
-
-			m_RenderTechnique = renderTechnique;
-			return true;
-		}
-		// Have not returned yet must have failed the if statement
-		return false;
-	}
+	// Select the technique to render with, returns false if it isn't compatible with the model's material. The vertex layouts for
+	// the technique come from the input layout cache, so switching between techniques doesn't create them again
+	bool SetRenderTechnique(CTechnique* renderTechnique);
 	void SetColour(D3DXVECTOR3 colour)
 	{
 		m_Colour = colour;
 	}
+	void SetIsStationary(bool isStationary) // Promise that the model won't move (or the culling trees must be rebuilt)
+	{
+		m_IsStationary = isStationary;
+	}
+	// Mark the model as an occluder, hiding the models behind it. Call before Load. The occluder mesh is simplified by merging
+	// vertices within cells of the given size (in model space, 0 to use the geometry as it is)
+	void SetOccluder(bool isOccluder, float simplifyCellSize = 0.0f)
+	{
+		m_IsOccluder = isOccluder;
+		m_OccluderCellSize = simplifyCellSize;
+	}
 	
 	/////////////////////////////
 	// Model Loading
@@ -189,6 +352,34 @@ public:
 	// Returns true if the load was successful
 	bool Load( const string& fileName, CTechnique* shaderCode );
 
+	// Share the geometry of a model that has already been loaded rather than reading its file again - the buffers, vertex layouts,
+	// bounds, mesh frames and occluder mesh, and the technique it was loaded with. The model keeps its own position, material and
+	// colour. Returns false if the source has no geometry
+	bool LoadInstance(CModel* source);
+
+	// Create the model's geometry from vertex and index data that is already in world space, with the vertex format, material, colour
+	// and technique of an example model. Used for static batches - the model stays at the origin with no rotation or scaling.
+	// Returns true if the buffers were created
+	bool CreateFromWorldGeometry(CModel* example, const vector<unsigned char>& vertices, const vector<WORD>& indices);
+
+	// Release the list's references to the buffers shared between models. Call when no more models will be loaded
+	static void ReleaseSharedGeometry();
+
+	// Make space for the given number of new models in the transform store, before creating many models at once
+	static void ReserveModels(unsigned int numModels);
+
+
+	/////////////////////////////
+	// Static batching
+
+	// Check if two models have the same vertex elements, so their vertices can go in one buffer
+	bool HasSameVertexFormat(CModel* other);
+
+	// Append the model's geometry, transformed into world space by its current world matrix, to vertex and index lists in the model's
+	// vertex format. Indices are offset by the number of vertices already in the list. Returns false if the model has no system
+	// memory copy of its geometry
+	bool AppendWorldGeometry(vector<unsigned char>& vertices, vector<WORD>& indices);
+
 
 	/////////////////////////////
 	// Model Usage
@@ -196,9 +387,26 @@ public:
 	// Check if the models texture supports normals (and therefore needs tangents)
 	bool UseTangents();
 
-	// Update the world matrix of the model from its position, rotation and scaling
+	// Select whether the model's orientation is held as Euler angles (default) or a quaternion. Switching from quaternion
+	// back to Euler angles recovers the angles from the current model matrix
+	void SetUseQuaternion(bool useQuaternion);
+
+	// Update the matrix of the model from its position, rotation and scaling. Does nothing if none of them have changed since the
+	// last update. If the model is in a hierarchy this sets its local matrix - the world matrix changes at the hierarchy's update
 	void UpdateMatrix();
-	
+
+	// Update the matrices of all models that have changed, in one pass over the transform store. Call before updating the
+	// hierarchy. If a job system is given the pass is split into parallel jobs
+	static void UpdateAllMatrices(gen::CJobSystem* jobs = NULL);
+
+	// Recalculate the world bounding volumes of all models whose world matrix or geometry has changed, in one pass over the
+	// transform store. Call after updating the hierarchy. If a job system is given the pass is split into parallel jobs
+	static void UpdateAllBounds(gen::CJobSystem* jobs = NULL);
+
+	// Add the model, and the frames of its mesh, to a transform hierarchy as a child of the given model (or as a root if NULL). The
+	// parent must already be in the same hierarchy. From now on the model's position, rotation and scale are relative to the parent
+	void AttachToHierarchy(gen::CTransformHierarchy* hierarchy, CModel* parent = NULL);
+
 	// Make the model face a certain point in world space
 	void FacePoint(D3DXVECTOR3 point);
 
@@ -210,6 +418,17 @@ public:
 	void Render();
 
 	void ShadowRender();
+
+	// Render in separate steps, for the render queue which only changes the technique, material and geometry between models when
+	// they differ. Set the object constants (matrix, colour) and geometry, then apply each pass of the technique and draw
+	void SetObjectVariables();
+	void SetGeometry();
+	void DrawGeometry();
+
+	// Instanced rendering, also for the render queue. Select the geometry with the instanced layout and a buffer of SInstanceData,
+	// then apply each pass of the instanced technique and draw the given number of instances from the buffer
+	void SetInstancedGeometry(TBufferHandle instanceBuffer);
+	void DrawGeometryInstanced(unsigned int numInstances);
 };
 
 
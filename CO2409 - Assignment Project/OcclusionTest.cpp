@@ -0,0 +1,212 @@
+//--------------------------------------------------------------------------------------
+//	OcclusionTest.cpp
+//
+//	Headless test of the occlusion culling - rasterises the scene's occluders into the
+//	occlusion buffer and tests a field of boxes against it, timing each stage, without
+//	creating a window or device
+//--------------------------------------------------------------------------------------
+
+#include <fstream>
+#include <vector>
+using namespace std;
+
+#include "Defines.h"			// General definitions shared by all source files
+#include "Camera.h"
+#include "CTimer.h"
+#include "COcclusionBuffer.h"
+#include "CJobSystem.h"
+#include "CImportXFile.h"		// Class to load meshes (taken from a full graphics engine)
+#include "MathDX.h"				// Conversions between math classes and DirectX types
+#include "SceneFile.h"
+
+// The occluders are the instances of the occluder meshes in the text scene file, placed as the application places them
+const char* OcclusionSceneFile = "Scene.txt";
+
+// The boxes tested are a grid over the ground, with the camera low down behind the cube and container so a good part of the grid
+// is hidden. Times are averaged over many repeats
+const unsigned int TestGridSize = 64;
+const float        TestGridSpacing = 8.0f;
+const float        TestBoxSize = 4.0f;
+const unsigned int TestRepeats = 200;
+const unsigned int TestBufferWidth = 256;
+const unsigned int TestBufferHeight = 192;
+
+// Boxes that must be found hidden and visible whatever the grid: one inside the cube, behind its front faces, and one on the ground
+// in the open just in front of the camera
+const gen::CAABB KnownHiddenBox(gen::CVector3(-1.0f, 9.0f, -1.0f), gen::CVector3(1.0f, 11.0f, 1.0f));
+const gen::CAABB KnownVisibleBox(gen::CVector3(-12.0f, 0.0f, -60.0f), gen::CVector3(-8.0f, 4.0f, -56.0f));
+
+// Load the first sub-mesh of an X file into an occluder mesh. Returns false if the file could not be loaded
+bool LoadOccluderMesh(const char* fileName, float simplifyCellSize, gen::COccluderMesh& occluderMesh)
+{
+	gen::CImportXFile mesh;
+	gen::SSubMesh subMesh;
+	if (mesh.ImportFile(fileName) != gen::kSuccess || mesh.GetSubMesh(0, &subMesh) != gen::kSuccess)
+	{
+		return false;
+	}
+	occluderMesh.Build(subMesh.vertices, subMesh.vertexSize, subMesh.numVertices, &subMesh.faces[0].aiVertex[0], subMesh.numFaces,
+	                   simplifyCellSize);
+	return true;
+}
+
+// Rasterise the occluders and test the boxes against them, adding the times taken for each stage (in milliseconds). Returns the
+// number of boxes hidden
+unsigned int RunOcclusionPass(gen::COcclusionBuffer& buffer, const gen::CMatrix4x4& viewProj,
+                              const vector<const gen::COccluderMesh*>& occluders, const vector<gen::CMatrix4x4>& worldMatrices,
+                              const vector<gen::CAABB>& boxes, vector<unsigned char>& hidden, gen::CJobSystem* jobs,
+                              float& rasteriseTime, float& testTime)
+{
+	CTimer timer;
+	timer.Start();
+	buffer.Begin(viewProj);
+	for (unsigned int i = 0; i < occluders.size(); i++)
+	{
+		buffer.AddOccluder(occluders[i], worldMatrices[i]);
+	}
+	buffer.Rasterise(jobs);
+	rasteriseTime += timer.GetLapTime() * 1000.0f;
+
+	const unsigned int numBoxes = static_cast<unsigned int>(boxes.size());
+	auto testBoxes = [&](gen::TUInt32 first, gen::TUInt32 end)
+	{
+		for (unsigned int i = first; i < end; i++)
+		{
+			hidden[i] = !buffer.IsVisible(boxes[i]);
+		}
+	};
+	if (jobs)
+	{
+		jobs->ParallelFor(numBoxes, 64, testBoxes);
+	}
+	else
+	{
+		testBoxes(0, numBoxes);
+	}
+	testTime += timer.GetLapTime() * 1000.0f;
+
+	unsigned int numHidden = 0;
+	for (unsigned int i = 0; i < numBoxes; i++)
+	{
+		numHidden += hidden[i];
+	}
+	return numHidden;
+}
+
+// Load the scene file's occluders - each occluder mesh is loaded once, however many instances use it. Returns false if the scene or
+// a mesh could not be loaded
+bool LoadSceneOccluders(const char* sceneFileName, vector<gen::COccluderMesh>& meshes, vector<const gen::COccluderMesh*>& occluders,
+                        vector<gen::CMatrix4x4>& worldMatrices)
+{
+	CSceneFile scene;
+	if (!scene.Open(sceneFileName))
+	{
+		return false;
+	}
+	const vector<SSceneMesh>& sceneMeshes = scene.GetMeshes();
+	meshes.resize(sceneMeshes.size());
+	vector<bool> loaded(sceneMeshes.size(), false);
+
+	SSceneInstance instance;
+	while (scene.ReadInstances(&instance, 1) > 0)
+	{
+		const SSceneMesh& sceneMesh = sceneMeshes[instance.Mesh];
+		if (!sceneMesh.IsOccluder)
+		{
+			continue;
+		}
+		if (!loaded[instance.Mesh])
+		{
+			if (!LoadOccluderMesh(sceneMesh.FileName.c_str(), sceneMesh.OccluderCellSize, meshes[instance.Mesh]))
+			{
+				return false;
+			}
+			loaded[instance.Mesh] = true;
+		}
+		gen::CMatrix4x4 worldMatrix;
+		gen::CVector3 angles(ToRadians(instance.Rotation.x), ToRadians(instance.Rotation.y), ToRadians(instance.Rotation.z));
+		worldMatrix.MakeAffineEuler(instance.Position, angles, gen::kZXY, gen::CVector3(instance.Scale, instance.Scale, instance.Scale));
+		occluders.push_back(&meshes[instance.Mesh]);
+		worldMatrices.push_back(worldMatrix);
+	}
+	return scene.GetError().empty();
+}
+
+// Run the headless occlusion test, writing the results to the given text file. Returns false if the scene, meshes or file could
+// not be loaded or written, the single thread and job system runs differ, or one of the known boxes is wrongly hidden or shown
+bool RunOcclusionTest(const char* fileName)
+{
+	// Occluders
+	vector<gen::COccluderMesh> meshes;
+	vector<const gen::COccluderMesh*> occluders;
+	vector<gen::CMatrix4x4> worldMatrices;
+	if (!LoadSceneOccluders(OcclusionSceneFile, meshes, occluders, worldMatrices))
+	{
+		return false;
+	}
+
+	// Boxes to test, centred on the cube
+	vector<gen::CAABB> boxes;
+	const float gridStart = -0.5f * TestGridSpacing * (TestGridSize - 1);
+	for (unsigned int z = 0; z < TestGridSize; z++)
+	{
+		for (unsigned int x = 0; x < TestGridSize; x++)
+		{
+			gen::CVector3 minPt(gridStart + TestGridSpacing * x, 0.0f, gridStart + TestGridSpacing * z);
+			boxes.push_back(gen::CAABB(minPt, minPt + gen::CVector3(TestBoxSize, TestBoxSize, TestBoxSize)));
+		}
+	}
+	const unsigned int knownHidden = static_cast<unsigned int>(boxes.size());
+	boxes.push_back(KnownHiddenBox);
+	const unsigned int knownVisible = static_cast<unsigned int>(boxes.size());
+	boxes.push_back(KnownVisibleBox);
+	vector<unsigned char> hidden(boxes.size());
+
+	// Camera down at ground level, in front of the cube and container, looking at the hills
+	CCamera camera(D3DXVECTOR3(-10.0f, 5.0f, -80.0f), D3DXVECTOR3(0.0f, ToRadians(5.0f), 0.0f));
+	camera.UpdateMatrices();
+	gen::CMatrix4x4 viewProj = gen::ToCMatrix4x4(camera.GetViewProjectionMatrix());
+
+	// Run on this thread alone, then with the job system
+	gen::COcclusionBuffer buffer(TestBufferWidth, TestBufferHeight);
+	gen::CJobSystem jobs;
+	float serialRasterise = 0.0f, serialTest = 0.0f;
+	float jobsRasterise = 0.0f, jobsTest = 0.0f;
+	unsigned int serialHidden = 0, jobsHidden = 0;
+	for (unsigned int repeat = 0; repeat < TestRepeats; repeat++)
+	{
+		serialHidden = RunOcclusionPass(buffer, viewProj, occluders, worldMatrices, boxes, hidden, NULL, serialRasterise, serialTest);
+	}
+	for (unsigned int repeat = 0; repeat < TestRepeats; repeat++)
+	{
+		jobsHidden = RunOcclusionPass(buffer, viewProj, occluders, worldMatrices, boxes, hidden, &jobs, jobsRasterise, jobsTest);
+	}
+	const gen::SOcclusionStats& stats = buffer.GetStats();
+
+	ofstream file(fileName);
+	if (!file)
+	{
+		return false;
+	}
+	file << "Occlusion buffer: " << buffer.GetWidth() << " x " << buffer.GetHeight() << "\n";
+	file << "Occluders: " << stats.Occluders << "  triangles after simplifying: " << stats.OccluderTriangles
+	     << "  rasterised: " << stats.TrianglesRasterised << "\n";
+	file << "Boxes tested: " << boxes.size() << "  hidden: " << jobsHidden << "\n";
+	file << "Average times over " << TestRepeats << " runs (ms)\n";
+	file << "  single thread   rasterise: " << serialRasterise / TestRepeats << "  test: " << serialTest / TestRepeats << "\n";
+	file << "  " << jobs.GetNumThreads() << " threads       rasterise: " << jobsRasterise / TestRepeats << "  test: "
+	     << jobsTest / TestRepeats << "\n";
+	if (serialHidden != jobsHidden)
+	{
+		file << "ERROR: single thread and job system runs hid different numbers of boxes (" << serialHidden << ")\n";
+	}
+	if (!hidden[knownHidden])
+	{
+		file << "ERROR: box inside the cube was not hidden\n";
+	}
+	if (hidden[knownVisible])
+	{
+		file << "ERROR: box in the open in front of the camera was hidden\n";
+	}
+	return !file.fail() && serialHidden == jobsHidden && hidden[knownHidden] && !hidden[knownVisible];
+}
@@ -1,23 +1,16 @@
 #include "PositionalLight.h"
 
-void CPositionalLight::SetDiffuseColourVar(ID3D10EffectVectorVariable* colourVar)
+void CPositionalLight::SetConstants(SPointLightConstants* constants)
 {
-	m_DiffuseColourVar = colourVar;
-}
-void CPositionalLight::SetSpecularColourVar(ID3D10EffectVectorVariable* colourVar)
-{
-	m_SpecularColourVar = colourVar;
-}
-void CPositionalLight::SetPositionVar(ID3D10EffectVectorVariable* positionVar)
-{
-	m_PositionVar = positionVar;
+	m_Constants = constants;
 }
 
 CPositionalLight::CPositionalLight(D3DXVECTOR3 diffuseColour, D3DXVECTOR3 specularColour, D3DXVECTOR3 position, float scale, bool isStationary) :
 		m_DiffuseColour(diffuseColour),
 		m_SpecularColour(specularColour),
-		m_Model(CModel(position, D3DXVECTOR3(0.0f, 0.0f, 0.0f), scale, m_DiffuseColour)),
-		m_IsStationary(isStationary)
+		m_Model(position, D3DXVECTOR3(0.0f, 0.0f, 0.0f), scale, m_DiffuseColour),
+		m_IsStationary(isStationary),
+		m_Constants(NULL)
 {
 }
 
@@ -40,6 +33,11 @@ void CPositionalLight::UpdateMatrix()	//Call model update matrix
 	m_Model.UpdateMatrix();
 }
 
+void CPositionalLight::AttachToHierarchy(gen::CTransformHierarchy* hierarchy, CModel* parent)
+{
+	m_Model.AttachToHierarchy(hierarchy, parent);
+}
+
 void CPositionalLight::LightRender()
 {
 	LightRender(m_DiffuseColour, m_SpecularColour);
@@ -47,9 +45,9 @@ void CPositionalLight::LightRender()
 
 void CPositionalLight::LightRender(D3DXVECTOR3 diffuseColour, D3DXVECTOR3 specularColour)
 {
-	m_DiffuseColourVar->SetRawValue(diffuseColour, 0, sizeof(D3DXVECTOR3));
-	m_SpecularColourVar->SetRawValue(specularColour, 0, sizeof(D3DXVECTOR3));
-	m_PositionVar->SetRawValue(m_Model.GetPosition(), 0, sizeof(D3DXVECTOR3));
+	m_Constants->DiffuseColour = diffuseColour;
+	m_Constants->SpecularColour = specularColour;
+	m_Constants->Position = m_Model.GetWorldPosition();
 }
 
 void CPositionalLight::ModelRender(D3DXVECTOR3 colour)			//Call model render
@@ -58,6 +56,12 @@ void CPositionalLight::ModelRender(D3DXVECTOR3 colour)			//Call model render
 	m_Model.Render();
 }
 
+void CPositionalLight::QueueModel(CRenderQueue& queue, D3DXVECTOR3 colour)	//Add model to a render queue
+{
+	m_Model.SetColour(colour); // Used when the queue is rendered
+	queue.Add(&m_Model);
+}
+
 void CPositionalLight::Control(float frameTime, EKeyCode turnUp, EKeyCode turnDown, EKeyCode turnLeft, EKeyCode turnRight,
 	EKeyCode turnCW, EKeyCode turnCCW, EKeyCode moveForward, EKeyCode moveBackward)
 {
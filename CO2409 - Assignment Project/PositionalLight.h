@@ -12,6 +12,8 @@
 
 #include "Model.h"
 #include "Technique.h"
+#include "RenderQueue.h"
+#include "ShaderConstants.h"
 
 class CPositionalLight
 {
@@ -20,17 +22,14 @@ private:
 	D3DXVECTOR3 m_SpecularColour;
 	bool m_IsStationary;
 
-	ID3D10EffectVectorVariable* m_DiffuseColourVar;
-	ID3D10EffectVectorVariable* m_SpecularColourVar;
-	ID3D10EffectVectorVariable* m_PositionVar;
+	// The light's place in the light set constants, written by LightRender
+	SPointLightConstants* m_Constants;
 
 protected:
 	CModel m_Model;
 
 public:
-	void SetDiffuseColourVar(ID3D10EffectVectorVariable* colourVar);
-	void SetSpecularColourVar(ID3D10EffectVectorVariable* colourVar);
-	void SetPositionVar(ID3D10EffectVectorVariable* positionVar);
+	void SetConstants(SPointLightConstants* constants);
 
 	CPositionalLight(D3DXVECTOR3 diffuseColour = D3DXVECTOR3(0.0f, 0.0f, 0.0f), D3DXVECTOR3 specularColour = D3DXVECTOR3(0.0f, 0.0f, 0.0f), 
 		D3DXVECTOR3 position = D3DXVECTOR3(0.0f, 0.0f, 0.0f), float scale = 0.0f, bool isStationary = false);
@@ -45,10 +44,14 @@ public:
 	{
 		return m_SpecularColour;
 	}
-	D3DXVECTOR3 GetPosition()
+	D3DXVECTOR3 GetPosition() // Relative to the parent if the light is in a hierarchy
 	{
 		return m_Model.GetPosition();
 	}
+	D3DXVECTOR3 GetWorldPosition()
+	{
+		return m_Model.GetWorldPosition();
+	}
 	bool IsStationary()
 	{
 		return m_IsStationary;
@@ -57,10 +60,22 @@ public:
 	{
 		return m_Model.GetScale();
 	}
-	D3DXMATRIX GetWorldMatrix()
+	const D3DXMATRIX& GetWorldMatrix()
 	{
 		return m_Model.GetWorldMatrix();
 	}
+	unsigned int GetMatrixVersion() // Increases each time the light's model moves
+	{
+		return m_Model.GetMatrixVersion();
+	}
+	const gen::CSphere& GetWorldBoundingSphere() // Bounds of the light's model, for culling
+	{
+		return m_Model.GetWorldBoundingSphere();
+	}
+	const gen::CAABB& GetWorldBoundingBox()
+	{
+		return m_Model.GetWorldBoundingBox();
+	}
 
 	// Setters
 	void SetDiffuseColour(D3DXVECTOR3 diffuseColour)
@@ -93,12 +108,17 @@ public:
 
 	void SetMaterial(CMaterial* texture);
 
-	void UpdateMatrix();								//Call model update matrix
+	void UpdateMatrix();								//Call model update matrix (does nothing if the light hasn't moved)
+
+	// Add the light's model to a transform hierarchy, optionally as a child of another model so the light moves with it
+	void AttachToHierarchy(gen::CTransformHierarchy* hierarchy, CModel* parent = NULL);
 
+	// Write the light's values into its light set constants, uploaded once all the lights are written
 	void LightRender();	//Uses the member value of diffuse and specular light
 	void LightRender(D3DXVECTOR3 diffuseColour, D3DXVECTOR3 specularColour);		
 	
 	void ModelRender(D3DXVECTOR3 colour = D3DXVECTOR3(0.0f, 0.0f, 0.0f));		//Call model render
+	void QueueModel(CRenderQueue& queue, D3DXVECTOR3 colour = D3DXVECTOR3(0.0f, 0.0f, 0.0f));	//Add model to a render queue
 
 	void Control(float frameTime, EKeyCode turnUp, EKeyCode turnDown, EKeyCode turnLeft, EKeyCode turnRight,
 		EKeyCode turnCW, EKeyCode turnCCW, EKeyCode moveForward, EKeyCode moveBackward);
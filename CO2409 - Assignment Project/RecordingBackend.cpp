@@ -0,0 +1,338 @@
+//--------------------------------------------------------------------------------------
+//	RecordingBackend.cpp
+//
+//	The recording backend draws nothing - it counts and records the commands it is given,
+//	so the frame can be updated and rendered headless, without a device
+//--------------------------------------------------------------------------------------
+
+#include <stdio.h>  // fopen_s
+#include <string.h> // memset, strlen
+#include <fstream>
+
+#include "RecordingBackend.h"	// Declaration of this class
+#include "Technique.h"
+
+// Name of each command, in the order of ERenderCommand
+const char* RenderCommandNames[NumRenderCommands] =
+{
+	"SetVertexBuffer", "SetInputLayout", "SetIndexBuffer", "SetTopology", "SetTexture", "ApplyPass", "UpdateConstants",
+	"SetRenderTarget", "SetViewport", "ClearColour", "ClearDepth", "DrawIndexed", "DrawIndexedInstanced", "Present"
+};
+
+
+///////////////////////////////
+// Constructors / Destructors
+
+CRecordingBackend::CRecordingBackend()
+{
+	m_NextBufferId = 1;
+	m_NextTextureId = 1;
+	m_NumBuffers = 0;
+	m_NumTextures = 0;
+	m_Recording = false;
+	Reset();
+}
+
+// Buffers and textures still referenced are left to the code holding them
+CRecordingBackend::~CRecordingBackend()
+{
+	for (map<gen::TUInt64, SLayout*>::iterator layout = m_Layouts.begin(); layout != m_Layouts.end(); ++layout)
+	{
+		delete layout->second;
+	}
+}
+
+
+/////////////////////////////
+// Counts and recording
+
+// Reset the counts and clear the recorded list
+void CRecordingBackend::Reset()
+{
+	memset(&m_FrameCounts, 0, sizeof(m_FrameCounts));
+	memset(&m_LastFrameCounts, 0, sizeof(m_LastFrameCounts));
+	memset(&m_TotalCounts, 0, sizeof(m_TotalCounts));
+	m_NumFrames = 0;
+	m_Recorded.clear();
+}
+
+// Write the recorded commands to a text file, one per line. Returns false if the file can't be written
+bool CRecordingBackend::WriteRecordedCommands(const char* fileName)
+{
+	ofstream file(fileName);
+	if (!file)
+	{
+		return false;
+	}
+	for (unsigned int i = 0; i < m_Recorded.size(); i++)
+	{
+		const SRenderCommand& command = m_Recorded[i];
+		file << RenderCommandNames[command.Type] << " " << command.Object << " " << command.Params[0] << " "
+		     << command.Params[1] << " " << command.Params[2] << "\n";
+	}
+	return !file.fail();
+}
+
+// Name of a command, for reports
+const char* CRecordingBackend::GetCommandName(ERenderCommand command)
+{
+	return RenderCommandNames[command];
+}
+
+
+/////////////////////////////
+// Buffers
+
+TBufferHandle CRecordingBackend::CreateBuffer(EBufferType type, unsigned int size, const void* /*data*/)
+{
+	SBuffer* buffer = new SBuffer;
+	buffer->Id = m_NextBufferId++;
+	buffer->Type = type;
+	buffer->Size = size;
+	buffer->RefCount = 1;
+	if (type == BufferInstance)
+	{
+		buffer->Contents.resize(size);
+	}
+	m_NumBuffers++;
+	return reinterpret_cast<TBufferHandle>(buffer);
+}
+
+void CRecordingBackend::AddRef(TBufferHandle buffer)
+{
+	reinterpret_cast<SBuffer*>(buffer)->RefCount++;
+}
+
+void CRecordingBackend::Release(TBufferHandle buffer)
+{
+	SBuffer* recordedBuffer = reinterpret_cast<SBuffer*>(buffer);
+	if (--recordedBuffer->RefCount == 0)
+	{
+		delete recordedBuffer;
+		m_NumBuffers--;
+	}
+}
+
+void* CRecordingBackend::Map(TBufferHandle buffer)
+{
+	vector<char>& contents = reinterpret_cast<SBuffer*>(buffer)->Contents;
+	return contents.empty() ? NULL : &contents[0];
+}
+
+void CRecordingBackend::Unmap(TBufferHandle /*buffer*/)
+{
+}
+
+
+/////////////////////////////
+// Textures
+
+// The file is only checked, so a missing texture is reported as it would be with a device
+TTextureHandle CRecordingBackend::LoadTexture(const string& fileName)
+{
+	FILE* file;
+	if (fopen_s(&file, fileName.c_str(), "rb") != 0)
+	{
+		return NULL;
+	}
+	fclose(file);
+
+	STexture* texture = new STexture;
+	texture->Id = m_NextTextureId++;
+	texture->FileName = fileName;
+	texture->Width = 0;
+	texture->Height = 0;
+	texture->RefCount = 1;
+	m_NumTextures++;
+	return reinterpret_cast<TTextureHandle>(texture);
+}
+
+TTextureHandle CRecordingBackend::CreateDepthTexture(unsigned int width, unsigned int height)
+{
+	STexture* texture = new STexture;
+	texture->Id = m_NextTextureId++;
+	texture->Width = width;
+	texture->Height = height;
+	texture->RefCount = 1;
+	m_NumTextures++;
+	return reinterpret_cast<TTextureHandle>(texture);
+}
+
+void CRecordingBackend::AddRef(TTextureHandle texture)
+{
+	reinterpret_cast<STexture*>(texture)->RefCount++;
+}
+
+void CRecordingBackend::Release(TTextureHandle texture)
+{
+	STexture* recordedTexture = reinterpret_cast<STexture*>(texture);
+	if (--recordedTexture->RefCount == 0)
+	{
+		delete recordedTexture;
+		m_NumTextures--;
+	}
+}
+
+
+/////////////////////////////
+// Pipeline state
+
+// Layouts are numbered in the order first asked for. A technique without an instanced version has no instanced layout, as with a
+// device
+TLayoutHandle CRecordingBackend::GetInputLayout(const D3D10_INPUT_ELEMENT_DESC* elements, unsigned int numElements,
+                                                CTechnique* technique, bool instanced)
+{
+	if (instanced && !technique->HasInstancedTechnique())
+	{
+		return NULL;
+	}
+
+	// Semantic names are hashed by their characters rather than their pointers
+	gen::TUInt64 key = HashStart;
+	for (unsigned int i = 0; i < numElements; i++)
+	{
+		const D3D10_INPUT_ELEMENT_DESC& element = elements[i];
+		key = HashBytes(key, element.SemanticName, strlen(element.SemanticName) + 1);
+		key = HashBytes(key, &element.SemanticIndex, sizeof(element.SemanticIndex));
+		key = HashBytes(key, &element.Format, sizeof(element.Format));
+		key = HashBytes(key, &element.InputSlot, sizeof(element.InputSlot));
+		key = HashBytes(key, &element.AlignedByteOffset, sizeof(element.AlignedByteOffset));
+		key = HashBytes(key, &element.InputSlotClass, sizeof(element.InputSlotClass));
+		key = HashBytes(key, &element.InstanceDataStepRate, sizeof(element.InstanceDataStepRate));
+	}
+	unsigned int features = technique->GetFeatures();
+	key = HashBytes(key, &features, sizeof(features));
+	key = HashBytes(key, &instanced, sizeof(instanced));
+
+	SLayout*& layout = m_Layouts[key];
+	if (!layout)
+	{
+		layout = new SLayout;
+		layout->Id = static_cast<unsigned int>(m_Layouts.size());
+	}
+	return reinterpret_cast<TLayoutHandle>(layout);
+}
+
+void CRecordingBackend::SetVertexBuffer(TBufferHandle buffer, unsigned int stride, unsigned int offset, unsigned int slot)
+{
+	Record(CommandSetVertexBuffer, GetId(buffer), stride, offset, slot);
+}
+
+void CRecordingBackend::SetInputLayout(TLayoutHandle layout)
+{
+	Record(CommandSetInputLayout, GetId(layout));
+}
+
+void CRecordingBackend::SetIndexBuffer(TBufferHandle buffer, DXGI_FORMAT format, unsigned int offset)
+{
+	Record(CommandSetIndexBuffer, GetId(buffer), format, offset);
+}
+
+void CRecordingBackend::SetTopology(D3D10_PRIMITIVE_TOPOLOGY topology)
+{
+	Record(CommandSetTopology, 0, topology);
+}
+
+void CRecordingBackend::SetTexture(ETextureSlot slot, TTextureHandle texture)
+{
+	Record(CommandSetTexture, GetId(texture), slot);
+}
+
+void CRecordingBackend::ApplyPass(CTechnique* technique, unsigned int pass, bool instanced)
+{
+	Record(CommandApplyPass, technique->GetFeatures(), pass, instanced ? 1 : 0);
+}
+
+
+/////////////////////////////
+// Constants
+
+bool CRecordingBackend::UpdateConstants(EConstantGroup group, const void* /*data*/, unsigned int size)
+{
+	Record(CommandUpdateConstants, group, size);
+	m_FrameCounts.ConstantBytes += size;
+	m_TotalCounts.ConstantBytes += size;
+	return true;
+}
+
+
+/////////////////////////////
+// Render targets and draws
+
+void CRecordingBackend::SetRenderTarget(TTextureHandle depthTexture)
+{
+	Record(CommandSetRenderTarget, GetId(depthTexture));
+}
+
+void CRecordingBackend::SetViewport(unsigned int width, unsigned int height)
+{
+	Record(CommandSetViewport, 0, width, height);
+}
+
+void CRecordingBackend::ClearColour(const float /*colour*/[4])
+{
+	Record(CommandClearColour);
+}
+
+void CRecordingBackend::ClearDepth()
+{
+	Record(CommandClearDepth);
+}
+
+void CRecordingBackend::DrawIndexed(unsigned int numIndices)
+{
+	Record(CommandDrawIndexed, 0, numIndices);
+	m_FrameCounts.Indices += numIndices;
+	m_TotalCounts.Indices += numIndices;
+}
+
+void CRecordingBackend::DrawIndexedInstanced(unsigned int numIndices, unsigned int numInstances)
+{
+	Record(CommandDrawIndexedInstanced, 0, numIndices, numInstances);
+	m_FrameCounts.Indices += numIndices * numInstances;
+	m_TotalCounts.Indices += numIndices * numInstances;
+	m_FrameCounts.Instances += numInstances;
+	m_TotalCounts.Instances += numInstances;
+}
+
+// Ends the frame's counts
+void CRecordingBackend::Present()
+{
+	Record(CommandPresent);
+	m_LastFrameCounts = m_FrameCounts;
+	memset(&m_FrameCounts, 0, sizeof(m_FrameCounts));
+	m_NumFrames++;
+}
+
+
+/////////////////////////////
+// Private member functions
+
+// Count a command and add it to the recorded list if recording
+void CRecordingBackend::Record(ERenderCommand type, unsigned int object /*= 0*/, unsigned int param0 /*= 0*/,
+                               unsigned int param1 /*= 0*/, unsigned int param2 /*= 0*/)
+{
+	m_FrameCounts.Commands[type]++;
+	m_TotalCounts.Commands[type]++;
+	if (m_Recording)
+	{
+		SRenderCommand command = { type, object, { param0, param1, param2 } };
+		m_Recorded.push_back(command);
+	}
+}
+
+// Number of a resource, 0 for NULL
+unsigned int CRecordingBackend::GetId(TBufferHandle buffer)
+{
+	return buffer ? reinterpret_cast<SBuffer*>(buffer)->Id : 0;
+}
+
+unsigned int CRecordingBackend::GetId(TTextureHandle texture)
+{
+	return texture ? reinterpret_cast<STexture*>(texture)->Id : 0;
+}
+
+unsigned int CRecordingBackend::GetId(TLayoutHandle layout)
+{
+	return layout ? reinterpret_cast<SLayout*>(layout)->Id : 0;
+}
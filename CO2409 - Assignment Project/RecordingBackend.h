@@ -0,0 +1,240 @@
+//--------------------------------------------------------------------------------------
+//	RecordingBackend.h
+//
+//	The recording backend draws nothing - it counts and records the commands it is given,
+//	so the frame can be updated and rendered headless, without a device
+//--------------------------------------------------------------------------------------
+
+#ifndef RECORDING_BACKEND_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define RECORDING_BACKEND_H_INCLUDED
+
+#include <vector>
+#include <map>
+#include <string>
+using namespace std;
+
+#include "Defines.h"
+#include "RenderBackend.h"
+
+// Every command is counted, for the current frame (ended by Present) and over the whole run. In recording mode each command is also
+// added to a list, which can be written to a text file one command per line. Resources are numbered in the order they are created,
+// and commands refer to them by number, so two runs of the same scene give the same list and can be compared line by line
+//
+// Buffers and textures only hold their description (instance buffers also have memory for Map to return), and loading a texture only
+// checks the file can be read. Layouts are shared the way the device's would be - one for each vertex format and technique input
+// (a technique's features and whether it is instanced). With techniques created without a device (see CTechniqueLibrary::Create)
+// nothing in the frame needs a device or the effect file
+
+// Commands counted and recorded - resource creation is not included
+enum ERenderCommand
+{
+	CommandSetVertexBuffer,
+	CommandSetInputLayout,
+	CommandSetIndexBuffer,
+	CommandSetTopology,
+	CommandSetTexture,
+	CommandApplyPass,
+	CommandUpdateConstants,
+	CommandSetRenderTarget,
+	CommandSetViewport,
+	CommandClearColour,
+	CommandClearDepth,
+	CommandDrawIndexed,
+	CommandDrawIndexedInstanced,
+	CommandPresent,
+	NumRenderCommands
+};
+
+// A recorded command. Object is the number of the buffer, layout or texture used (0 for none), the technique's features for
+// ApplyPass or the group for UpdateConstants. The parameters are the values passed, in the order of the backend function
+struct SRenderCommand
+{
+	ERenderCommand Type;
+	unsigned int   Object;
+	unsigned int   Params[3];
+};
+
+// Commands counted for a frame or a run
+struct SRenderCommandCounts
+{
+	unsigned int Commands[NumRenderCommands];
+	unsigned int Indices;   // Indices drawn, instanced draws counting each instance
+	unsigned int Instances; // Instances drawn by instanced draws
+	unsigned int ConstantBytes;
+};
+
+class CRecordingBackend : public CRenderBackend
+{
+/////////////////////////////
+// Private member variables
+private:
+
+	// Resources - each numbered from 1 in order of creation
+	struct SBuffer
+	{
+		unsigned int Id;
+		EBufferType  Type;
+		unsigned int Size;
+		unsigned int RefCount;
+		vector<char> Contents; // Instance buffers only, for Map
+	};
+	struct STexture
+	{
+		unsigned int Id;
+		string       FileName; // Empty for depth textures
+		unsigned int Width;
+		unsigned int Height;
+		unsigned int RefCount;
+	};
+	struct SLayout
+	{
+		unsigned int Id;
+	};
+	unsigned int m_NextBufferId;
+	unsigned int m_NextTextureId;
+	unsigned int m_NumBuffers;  // Buffers and textures not yet released
+	unsigned int m_NumTextures;
+
+	// Layouts by hash of their vertex elements and technique input, owned by the backend
+	map<gen::TUInt64, SLayout*> m_Layouts;
+
+	SRenderCommandCounts m_FrameCounts;     // Current frame
+	SRenderCommandCounts m_LastFrameCounts; // Last frame ended by Present
+	SRenderCommandCounts m_TotalCounts;     // Since the backend was created or Reset
+	unsigned int         m_NumFrames;       // Frames ended by Present
+
+	bool                   m_Recording;
+	vector<SRenderCommand> m_Recorded;
+
+	// Layouts are owned by the backend, so it is not copied
+	CRecordingBackend(const CRecordingBackend&);
+	CRecordingBackend& operator=(const CRecordingBackend&);
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	///////////////////////////////
+	// Constructors / Destructors
+
+	CRecordingBackend();
+	~CRecordingBackend();
+
+
+	/////////////////////////////
+	// Counts and recording
+
+	// Reset the counts and clear the recorded list
+	void Reset();
+
+	const SRenderCommandCounts& GetFrameCounts()
+	{
+		return m_LastFrameCounts;
+	}
+	const SRenderCommandCounts& GetTotalCounts()
+	{
+		return m_TotalCounts;
+	}
+	unsigned int GetNumFrames()
+	{
+		return m_NumFrames;
+	}
+
+	// Buffers and textures created and not yet released - both should be zero after the scene has been released
+	unsigned int GetNumBuffers()
+	{
+		return m_NumBuffers;
+	}
+	unsigned int GetNumTextures()
+	{
+		return m_NumTextures;
+	}
+
+	// Select whether commands are added to the recorded list
+	void SetRecording(bool recording)
+	{
+		m_Recording = recording;
+	}
+	const vector<SRenderCommand>& GetRecordedCommands()
+	{
+		return m_Recorded;
+	}
+	void ClearRecordedCommands()
+	{
+		m_Recorded.clear();
+	}
+
+	// Write the recorded commands to a text file, one per line. Returns false if the file can't be written
+	bool WriteRecordedCommands(const char* fileName);
+
+	// Name of a command, for reports
+	static const char* GetCommandName(ERenderCommand command);
+
+
+	/////////////////////////////
+	// Buffers
+
+	TBufferHandle CreateBuffer(EBufferType type, unsigned int size, const void* data);
+	void AddRef(TBufferHandle buffer);
+	void Release(TBufferHandle buffer);
+	void* Map(TBufferHandle buffer);
+	void Unmap(TBufferHandle buffer);
+
+
+	/////////////////////////////
+	// Textures
+
+	TTextureHandle LoadTexture(const string& fileName);
+	TTextureHandle CreateDepthTexture(unsigned int width, unsigned int height);
+	void AddRef(TTextureHandle texture);
+	void Release(TTextureHandle texture);
+
+
+	/////////////////////////////
+	// Pipeline state
+
+	TLayoutHandle GetInputLayout(const D3D10_INPUT_ELEMENT_DESC* elements, unsigned int numElements, CTechnique* technique,
+	                             bool instanced);
+	void SetVertexBuffer(TBufferHandle buffer, unsigned int stride, unsigned int offset, unsigned int slot);
+	void SetInputLayout(TLayoutHandle layout);
+	void SetIndexBuffer(TBufferHandle buffer, DXGI_FORMAT format, unsigned int offset);
+	void SetTopology(D3D10_PRIMITIVE_TOPOLOGY topology);
+	void SetTexture(ETextureSlot slot, TTextureHandle texture);
+	void ApplyPass(CTechnique* technique, unsigned int pass, bool instanced);
+
+
+	/////////////////////////////
+	// Constants
+
+	bool UpdateConstants(EConstantGroup group, const void* data, unsigned int size);
+
+
+	/////////////////////////////
+	// Render targets and draws
+
+	void SetRenderTarget(TTextureHandle depthTexture);
+	void SetViewport(unsigned int width, unsigned int height);
+	void ClearColour(const float colour[4]);
+	void ClearDepth();
+	void DrawIndexed(unsigned int numIndices);
+	void DrawIndexedInstanced(unsigned int numIndices, unsigned int numInstances);
+	void Present();
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	// Count a command and add it to the recorded list if recording
+	void Record(ERenderCommand type, unsigned int object = 0, unsigned int param0 = 0, unsigned int param1 = 0,
+	            unsigned int param2 = 0);
+
+	// Number of a resource, 0 for NULL
+	static unsigned int GetId(TBufferHandle buffer);
+	static unsigned int GetId(TTextureHandle texture);
+	static unsigned int GetId(TLayoutHandle layout);
+};
+
+
+#endif // End of header guard - see top of file
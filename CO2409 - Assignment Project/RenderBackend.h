@@ -0,0 +1,145 @@
+//--------------------------------------------------------------------------------------
+//	RenderBackend.h
+//
+//	The render backend is the interface the rendering code creates its resources and
+//	draws through, so that models, materials and lights never use a device directly
+//--------------------------------------------------------------------------------------
+
+#ifndef RENDER_BACKEND_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define RENDER_BACKEND_H_INCLUDED
+
+#include <string>
+using namespace std;
+
+#include "Defines.h"
+#include "ShaderConstants.h" // EConstantGroup
+
+class CTechnique;
+
+// The interface is kept narrow - buffers, textures, pipeline state, constant updates and draws - and covers everything the frame
+// does, so any backend can run it. CD3D10Backend (D3D10Backend.h) renders with Direct3D 10. CRecordingBackend (RecordingBackend.h)
+// has no device at all: it records the commands it is given, so the update and render of a frame can run headless, for CPU
+// profiling and to compare command counts between runs
+//
+// Resources are referred to by handles, which are only meaningful to the backend that made them. Buffers and textures are
+// reference counted like DirectX objects: the creator holds one reference, AddRef takes another and Release gives one up. Input
+// layouts are owned by the backend and live until it is released. Vertex elements, formats and topologies are described with the
+// D3D10 structs and enums, which are plain data
+//
+// Calls are passed straight on - the state cache (StateCache.h) drops repeated state changes before they reach the backend
+
+// Handles to backend resources - the structs are never defined, each backend casts handles to its own types
+struct SBackendBuffer;
+struct SBackendTexture;
+struct SBackendLayout;
+typedef SBackendBuffer*  TBufferHandle;
+typedef SBackendTexture* TTextureHandle;
+typedef SBackendLayout*  TLayoutHandle;
+
+// Kinds of buffer
+enum EBufferType
+{
+	BufferVertex,   // Vertex data, fixed after creation
+	BufferIndex,    // Index data, fixed after creation
+	BufferInstance, // Per-instance vertex data, rewritten with Map / Unmap
+};
+
+// Textures the techniques sample, each set separately
+enum ETextureSlot
+{
+	TextureDiffuseSpecular,
+	TextureNormalMap,
+	TextureCelGradient,
+	TextureShadowMap,
+	NumTextureSlots
+};
+
+class CRenderBackend
+{
+/////////////////////////////
+// Public member functions
+public:
+
+	virtual ~CRenderBackend() {}
+
+
+	/////////////////////////////
+	// Buffers
+
+	// Create a buffer of the given size in bytes, filled from data (may be NULL for instance buffers). Returns NULL on failure
+	virtual TBufferHandle CreateBuffer(EBufferType type, unsigned int size, const void* data) = 0;
+
+	virtual void AddRef(TBufferHandle buffer) = 0;
+	virtual void Release(TBufferHandle buffer) = 0;
+
+	// Get memory to write the whole contents of an instance buffer into, the previous contents are discarded. Call Unmap when done.
+	// Returns NULL on failure
+	virtual void* Map(TBufferHandle buffer) = 0;
+	virtual void Unmap(TBufferHandle buffer) = 0;
+
+
+	/////////////////////////////
+	// Textures
+
+	// Load a texture from a file. Returns NULL if the file can't be loaded
+	virtual TTextureHandle LoadTexture(const string& fileName) = 0;
+
+	// Create a texture that can be rendered to as a depth buffer and then sampled, for shadow maps. Returns NULL on failure
+	virtual TTextureHandle CreateDepthTexture(unsigned int width, unsigned int height) = 0;
+
+	virtual void AddRef(TTextureHandle texture) = 0;
+	virtual void Release(TTextureHandle texture) = 0;
+
+
+	/////////////////////////////
+	// Pipeline state
+
+	// Get the layout of the given vertex elements for a technique (or its instanced version). Returns NULL if the elements don't
+	// suit the technique's vertex shader
+	virtual TLayoutHandle GetInputLayout(const D3D10_INPUT_ELEMENT_DESC* elements, unsigned int numElements, CTechnique* technique,
+	                                     bool instanced) = 0;
+
+	virtual void SetVertexBuffer(TBufferHandle buffer, unsigned int stride, unsigned int offset, unsigned int slot) = 0;
+	virtual void SetInputLayout(TLayoutHandle layout) = 0;
+	virtual void SetIndexBuffer(TBufferHandle buffer, DXGI_FORMAT format, unsigned int offset) = 0;
+	virtual void SetTopology(D3D10_PRIMITIVE_TOPOLOGY topology) = 0;
+	virtual void SetTexture(ETextureSlot slot, TTextureHandle texture) = 0;
+
+	// Select the shaders and states of one pass of a technique (or its instanced version) for the following draws. The constants
+	// and textures set so far are used
+	virtual void ApplyPass(CTechnique* technique, unsigned int pass, bool instanced) = 0;
+
+
+	/////////////////////////////
+	// Constants
+
+	// Write the whole of a group's constants (see ShaderConstants.h). Returns false on failure
+	virtual bool UpdateConstants(EConstantGroup group, const void* data, unsigned int size) = 0;
+
+
+	/////////////////////////////
+	// Render targets and draws
+
+	// Render to a depth texture alone, or to the back buffer and main depth buffer if NULL
+	virtual void SetRenderTarget(TTextureHandle depthTexture) = 0;
+	virtual void SetViewport(unsigned int width, unsigned int height) = 0;
+
+	// Clear the colour of the render target (if it has colour), or its depth
+	virtual void ClearColour(const float colour[4]) = 0;
+	virtual void ClearDepth() = 0;
+
+	virtual void DrawIndexed(unsigned int numIndices) = 0;
+	virtual void DrawIndexedInstanced(unsigned int numIndices, unsigned int numInstances) = 0;
+
+	// Show the back buffer - the end of a frame
+	virtual void Present() = 0;
+};
+
+// Release a buffer or texture handle if it is not NULL and set it to NULL, as SAFE_RELEASE does for DirectX pointers
+#define BACKEND_RELEASE(h) { if(h) { g_RenderBackend->Release(h); (h) = NULL; } }
+
+// Backend used for all rendering - declared in GraphicsAssign1.cpp
+extern CRenderBackend* g_RenderBackend;
+
+
+#endif // End of header guard - see top of file
@@ -0,0 +1,340 @@
+//--------------------------------------------------------------------------------------
+//	RenderQueue.cpp
+//
+//	The render queue collects the models to draw in a frame, sorts them by a packed key
+//	and draws them in that order, changing render state only when it differs
+//--------------------------------------------------------------------------------------
+
+#include "Defines.h"		// General definitions shared by all source files
+#include "RenderQueue.h"	// Declaration of this class
+#include "StateCache.h"		// Drops repeated binds of the same state
+#include "DrawStats.h"		// Counts draws and checks for duplicates
+#include "ShaderConstants.h"	// Counts the constant uploads each pass would have made with one buffer
+#include "RenderBackend.h"	// Instance buffer and technique passes
+
+// Sizes of the fields in the sort keys (see RenderQueue.h for the layout). Ids larger than their field wrap around - the queue
+// still draws correctly, models just share a group with others
+const unsigned int LayerBits     = 2;
+const unsigned int TechniqueBits = 10;
+const unsigned int MaterialBits  = 10;
+const unsigned int GeometryBits  = 12;
+const unsigned int DepthBits     = 24;
+
+// Values of the layer field
+const gen::TUInt64 OpaqueLayer  = 0;
+const gen::TUInt64 BlendedLayer = 1;
+
+// Number of models per job when building keys in parallel
+const unsigned int KeysPerJob = 1024;
+
+// Return the lowest bits of a value, as used in a key field
+inline gen::TUInt64 KeyField(gen::TUInt64 value, unsigned int bits)
+{
+	return value & ((static_cast<gen::TUInt64>(1) << bits) - 1);
+}
+
+
+///////////////////////////////
+// Constructors / Destructors
+
+CRenderQueue::CRenderQueue()
+{
+	m_InstanceBuffer = NULL;
+	Clear();
+}
+
+CRenderQueue::~CRenderQueue()
+{
+	ReleaseResources();
+}
+
+// Release the instance buffer
+void CRenderQueue::ReleaseResources()
+{
+	BACKEND_RELEASE( m_InstanceBuffer );
+}
+
+
+/////////////////////////////
+// Queue usage
+
+// Empty the queue for a new frame and reset the counts
+void CRenderQueue::Clear()
+{
+	m_Models.clear();
+	m_Centres.clear();
+	m_Items.clear();
+
+	SRenderQueueStats clearStats = { 0, 0, 0, 0, 0, 0 };
+	m_Stats = clearStats;
+}
+
+// Add a model to draw this frame. Models without geometry or a technique are ignored
+void CRenderQueue::Add(CModel* model)
+{
+	if (!model->HasGeometry() || !model->GetRenderTechnique())
+	{
+		return;
+	}
+	m_Models.push_back(model);
+
+	// Get the bounds here rather than in the key building jobs, getting them may update the transform store
+	m_Centres.push_back(model->GetWorldBoundingSphere().centre);
+}
+
+// Build the sort key of each model using its distance along the view direction, then sort. If a job system is given the keys
+// are built in parallel jobs
+void CRenderQueue::Sort(const D3DXMATRIX& viewMatrix, float farClip, gen::CJobSystem* jobs /*= NULL*/)
+{
+	unsigned int numModels = GetNumModels();
+	m_Items.resize(numModels);
+	if (jobs)
+	{
+		jobs->ParallelFor(numModels, KeysPerJob, [&](gen::TUInt32 first, gen::TUInt32 end)
+		{
+			BuildKeys(viewMatrix, farClip, first, end);
+		});
+	}
+	else
+	{
+		BuildKeys(viewMatrix, farClip, 0, numModels);
+	}
+	RadixSort();
+}
+
+// Draw the models in key order. The camera, light and other shared effect variables must already be set
+void CRenderQueue::Render()
+{
+	// All models are triangle lists
+	g_StateCache.IASetPrimitiveTopology( D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
+
+	// State set by the previous model. A model without a material uses whatever material was last sent to the shader (as
+	// when models were rendered individually)
+	CTechnique* technique = NULL;
+	CMaterial* material = NULL;
+	CModel* geometryModel = NULL;
+
+	unsigned int numItems = static_cast<unsigned int>(m_Items.size());
+	unsigned int i = 0;
+	while (i < numItems)
+	{
+		CModel* model = m_Models[m_Items[i].Index];
+
+		if (model->GetRenderTechnique() != technique)
+		{
+			technique = model->GetRenderTechnique();
+			m_Stats.TechniqueChanges++;
+		}
+		if (model->GetMaterial() && model->GetMaterial() != material)
+		{
+			material = model->GetMaterial();
+			material->SendToShader();
+			m_Stats.MaterialChanges++;
+		}
+
+		// Find the following models that can be drawn in the same instanced call
+		unsigned int end = i + 1;
+		if (technique->HasInstancedTechnique() && model->GetInstancedLayout())
+		{
+			while (end < numItems && CanInstanceTogether(model, m_Models[m_Items[end].Index]))
+			{
+				end++;
+			}
+		}
+		if (end - i > 1)
+		{
+			// Instanced drawing uses a different vertex layout, even if it fails part way. Any models it didn't draw are drawn
+			// individually below
+			unsigned int numDrawn = RenderInstanced(i, end);
+			geometryModel = NULL;
+			if (numDrawn > 0)
+			{
+				i += numDrawn;
+				continue;
+			}
+		}
+
+		if (!geometryModel || model->GetGeometryId() != geometryModel->GetGeometryId())
+		{
+			geometryModel = model;
+			model->SetGeometry();
+			m_Stats.GeometryChanges++;
+		}
+
+		// Per-model constants are uploaded to their own small buffer
+		model->SetObjectVariables();
+		for (UINT p = 0; p < technique->GetNumPasses(); ++p)
+		{
+			g_RenderBackend->ApplyPass(technique, p, false);
+			g_DrawStats.RecordApply(technique, p);
+			g_ShaderConstants.RecordApply();
+			model->DrawGeometry();
+			m_Stats.DrawCalls++;
+		}
+		m_Stats.Draws++;
+		i++;
+	}
+}
+
+
+/////////////////////////////
+// Private member functions
+
+// Build the sort keys for the items [first, end)
+void CRenderQueue::BuildKeys(const D3DXMATRIX& viewMatrix, float farClip, unsigned int first, unsigned int end)
+{
+	const float maxDepth = static_cast<float>((1 << DepthBits) - 1);
+	for (unsigned int i = first; i < end; i++)
+	{
+		CModel* model = m_Models[i];
+
+		// Depth of the bounds centre in camera space (third column of the view matrix), as a fraction of the far clip distance
+		const gen::CVector3& centre = m_Centres[i];
+		float viewZ = centre.x * viewMatrix._13 + centre.y * viewMatrix._23 + centre.z * viewMatrix._33 + viewMatrix._43;
+		float depthFraction = viewZ / farClip;
+		if (depthFraction < 0.0f) depthFraction = 0.0f;
+		if (depthFraction > 1.0f) depthFraction = 1.0f;
+		gen::TUInt64 depth = static_cast<gen::TUInt64>(depthFraction * maxDepth);
+
+		gen::TUInt64 techniqueId = KeyField(model->GetRenderTechnique()->GetSortId(), TechniqueBits);
+		gen::TUInt64 materialId = model->GetMaterial() ? KeyField(model->GetMaterial()->GetSortId(), MaterialBits) : 0;
+		gen::TUInt64 geometryId = KeyField(model->GetGeometryId(), GeometryBits);
+		gen::TUInt64 state = (((techniqueId << MaterialBits) | materialId) << GeometryBits) | geometryId;
+
+		// Layer in the top bits, the rest as described in the header. Any unused low bits are left as zero
+		const unsigned int stateBits = TechniqueBits + MaterialBits + GeometryBits;
+		const unsigned int layerShift = 64 - LayerBits;
+		gen::TUInt64 key;
+		if (model->GetRenderTechnique()->IsBlended())
+		{
+			gen::TUInt64 invertedDepth = static_cast<gen::TUInt64>(maxDepth) - depth; // Far models first
+			key = (BlendedLayer << layerShift) | (invertedDepth << (layerShift - DepthBits)) | (state << (layerShift - DepthBits - stateBits));
+		}
+		else
+		{
+			key = (OpaqueLayer << layerShift) | (state << (layerShift - stateBits)) | (depth << (layerShift - stateBits - DepthBits));
+		}
+		m_Items[i].Key = key;
+		m_Items[i].Index = i;
+	}
+}
+
+// Sort m_Items on their keys with a least significant byte first radix sort. Counts for all eight bytes are gathered in one pass
+// over the keys, and a byte that is the same in every key (e.g. the unused low bits) needs no pass of its own
+void CRenderQueue::RadixSort()
+{
+	unsigned int numItems = static_cast<unsigned int>(m_Items.size());
+	if (numItems < 2)
+	{
+		return;
+	}
+
+	unsigned int counts[8][256] = {};
+	for (unsigned int i = 0; i < numItems; i++)
+	{
+		gen::TUInt64 key = m_Items[i].Key;
+		for (unsigned int byte = 0; byte < 8; byte++)
+		{
+			counts[byte][(key >> (byte * 8)) & 0xff]++;
+		}
+	}
+
+	m_SortBuffer.resize(numItems);
+	SSortItem* source = &m_Items[0];
+	SSortItem* dest = &m_SortBuffer[0];
+	for (unsigned int byte = 0; byte < 8; byte++)
+	{
+		unsigned int shift = byte * 8;
+		if (counts[byte][(source[0].Key >> shift) & 0xff] == numItems)
+		{
+			continue;
+		}
+
+		// Turn the counts into the starting position of each value, then copy each item to its position. Items with the same
+		// byte keep their order, so the result of earlier passes is kept within each value
+		unsigned int offsets[256];
+		unsigned int total = 0;
+		for (unsigned int value = 0; value < 256; value++)
+		{
+			offsets[value] = total;
+			total += counts[byte][value];
+		}
+		for (unsigned int i = 0; i < numItems; i++)
+		{
+			dest[offsets[(source[i].Key >> shift) & 0xff]++] = source[i];
+		}
+		SSortItem* swap = source;
+		source = dest;
+		dest = swap;
+	}
+
+	// An odd number of passes leaves the result in the temporary buffer
+	if (source != &m_Items[0])
+	{
+		m_Items.swap(m_SortBuffer);
+	}
+}
+
+// Check if two models can be drawn in the same instanced call
+bool CRenderQueue::CanInstanceTogether(CModel* model1, CModel* model2)
+{
+	return model1->GetRenderTechnique() == model2->GetRenderTechnique() && model1->GetMaterial() == model2->GetMaterial() &&
+	       model1->GetGeometryId() == model2->GetGeometryId();
+}
+
+// Draw the models for the sorted items [first, end) with the instanced version of their technique. The material must already be set.
+// Returns the number of items drawn, which is fewer than requested if the instance buffer could not be created or mapped - the items
+// drawn are always the first ones
+unsigned int CRenderQueue::RenderInstanced(unsigned int first, unsigned int end)
+{
+	if (!m_InstanceBuffer)
+	{
+		// Rewritten for each instanced draw
+		m_InstanceBuffer = g_RenderBackend->CreateBuffer( BufferInstance, MaxInstances * sizeof(SInstanceData), NULL );
+		if (!m_InstanceBuffer)
+		{
+			return 0;
+		}
+	}
+
+	// All the models share geometry, so the first one selects it
+	CModel* firstModel = m_Models[m_Items[first].Index];
+	CTechnique* technique = firstModel->GetRenderTechnique();
+	firstModel->SetInstancedGeometry(m_InstanceBuffer);
+	m_Stats.GeometryChanges++;
+
+	for (unsigned int batch = first; batch < end; batch += MaxInstances)
+	{
+		unsigned int numInstances = (end - batch < MaxInstances) ? end - batch : MaxInstances;
+
+		// Discarding the previous contents lets the driver give a fresh buffer while the GPU may still be reading the last batch
+		SInstanceData* instances = static_cast<SInstanceData*>(g_RenderBackend->Map( m_InstanceBuffer ));
+		if (!instances)
+		{
+			return batch - first;
+		}
+		for (unsigned int i = 0; i < numInstances; i++)
+		{
+			CModel* model = m_Models[m_Items[batch + i].Index];
+			instances[i].WorldMatrix = model->GetMeshWorldMatrix();
+			instances[i].Colour = model->GetColour();
+		}
+		g_RenderBackend->Unmap( m_InstanceBuffer );
+
+		for (UINT p = 0; p < technique->GetNumPasses(); ++p)
+		{
+			g_RenderBackend->ApplyPass(technique, p, true);
+			g_DrawStats.RecordApply(technique, p);
+			g_ShaderConstants.RecordApply();
+			firstModel->DrawGeometryInstanced(numInstances);
+			for (unsigned int i = 0; i < numInstances; i++)
+			{
+				g_DrawStats.RecordDraw(m_Models[m_Items[batch + i].Index], firstModel->GetNumIndices(), false);
+			}
+			m_Stats.DrawCalls++;
+		}
+		m_Stats.Draws += numInstances;
+		m_Stats.InstancedDraws += numInstances;
+	}
+	return end - first;
+}
@@ -0,0 +1,134 @@
+//--------------------------------------------------------------------------------------
+//	RenderQueue.h
+//
+//	The render queue collects the models to draw in a frame, sorts them by a packed key
+//	and draws them in that order, changing render state only when it differs
+//--------------------------------------------------------------------------------------
+
+#ifndef RENDER_QUEUE_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define RENDER_QUEUE_H_INCLUDED
+
+#include <vector>
+using namespace std;
+
+#include "Defines.h"
+#include "Model.h"
+#include "CJobSystem.h"
+
+// Each queued model gets a 64-bit sort key, and the queue is sorted on these keys before drawing. From the most significant bits:
+//   Opaque models:  layer (0) | technique | material | geometry | depth
+//   Blended models: layer (1) | inverted depth | technique | material | geometry
+// So all opaque models are drawn first, grouped by technique, then material, then geometry, so that consecutive models share as much
+// state as possible - within a group they go front to back to help early depth rejection. Blended models (additive / alpha cutout
+// techniques) are drawn afterwards from back to front so they composite correctly, with state only used to break ties.
+//
+// When drawing, the technique, material and geometry are only set up when they change from the previous model. The per-model matrix
+// and colour are always set, and each effect pass is still applied per model - D3D10 effects only send changed variables to the GPU
+// when a pass is applied.
+//
+// Consecutive models in the sorted order with the same technique, material and geometry are drawn together with hardware instancing
+// if the technique has an instanced version: their world matrices and colours are copied into a dynamic per-instance vertex buffer
+// and drawn with a single DrawIndexedInstanced call (per pass). The order of the models is unchanged, so blended models are still
+// drawn back to front
+
+// Per-frame counts for the queue - models drawn, draw calls made (one per instanced group), models drawn with instancing and how
+// often each kind of state was set
+struct SRenderQueueStats
+{
+	unsigned int Draws;
+	unsigned int DrawCalls;
+	unsigned int InstancedDraws;
+	unsigned int TechniqueChanges;
+	unsigned int MaterialChanges;
+	unsigned int GeometryChanges;
+};
+
+class CRenderQueue
+{
+/////////////////////////////
+// Private member variables
+private:
+
+	// Queued models with the world space centre of their bounds (for the depth part of the key), and their sort keys. Sorting
+	// reorders a list of (key, index) pairs rather than the models
+	struct SSortItem
+	{
+		gen::TUInt64 Key;
+		unsigned int Index;
+	};
+	vector<CModel*>       m_Models;
+	vector<gen::CVector3> m_Centres;
+	vector<SSortItem>     m_Items;
+	vector<SSortItem>     m_SortBuffer; // Temporary space for the radix sort
+
+	// Dynamic vertex buffer of SInstanceData for instanced drawing, created on first use. Larger groups are drawn in several calls
+	static const unsigned int MaxInstances = 256;
+	TBufferHandle         m_InstanceBuffer;
+
+	SRenderQueueStats     m_Stats;
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	///////////////////////////////
+	// Constructors / Destructors
+
+	CRenderQueue();
+	~CRenderQueue();
+
+	// Release the instance buffer
+	void ReleaseResources();
+
+
+	/////////////////////////////
+	// Data access
+
+	unsigned int GetNumModels()
+	{
+		return static_cast<unsigned int>(m_Models.size());
+	}
+	const SRenderQueueStats& GetStats()
+	{
+		return m_Stats;
+	}
+
+
+	/////////////////////////////
+	// Queue usage
+
+	// Empty the queue for a new frame and reset the counts
+	void Clear();
+
+	// Add a model to draw this frame. Models without geometry or a technique are ignored
+	void Add(CModel* model);
+
+	// Build the sort key of each model using its distance along the view direction, then sort. The view matrix and far clip
+	// distance come from the camera. If a job system is given the keys are built in parallel jobs
+	void Sort(const D3DXMATRIX& viewMatrix, float farClip, gen::CJobSystem* jobs = NULL);
+
+	// Draw the models in key order. The camera, light and other shared effect variables must already be set
+	void Render();
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	// Build the sort keys for the items [first, end)
+	void BuildKeys(const D3DXMATRIX& viewMatrix, float farClip, unsigned int first, unsigned int end);
+
+	// Sort m_Items on their keys with a radix sort, one byte per pass
+	void RadixSort();
+
+	// Check if two models can be drawn in the same instanced call
+	bool CanInstanceTogether(CModel* model1, CModel* model2);
+
+	// Draw the models for the sorted items [first, end) with the instanced version of their technique. The material must already be
+	// set. Returns the number of items drawn, fewer than requested if the instance buffer could not be created or mapped
+	unsigned int RenderInstanced(unsigned int first, unsigned int end);
+};
+
+
+#endif // End of header guard - see top of file
@@ -0,0 +1,596 @@
+//--------------------------------------------------------------------------------------
+//	SceneFile.cpp
+//
+//	The scene file class reads descriptions of a scene - camera, materials, meshes, lights
+//	and model instances - from text or binary scene files, and writes the binary form
+//--------------------------------------------------------------------------------------
+
+#include <sstream>
+#include <map>
+#include <algorithm> // min, copy
+
+#include "SceneFile.h" // Declaration of this class
+
+// Binary scene files start with this id, followed by the version of the format
+const char         SceneFileId[4] = { 'S', 'C', 'N', 'B' };
+const gen::TUInt32 SceneFileVersion = 1;
+
+// Counts of each table in a binary scene file, after the id and version
+struct SSceneFileCounts
+{
+	gen::TUInt32 Techniques;
+	gen::TUInt32 Materials;
+	gen::TUInt32 Meshes;
+	gen::TUInt32 Lights;
+	gen::TUInt32 Instances;
+};
+
+// Instances are read and written this many at a time when converting
+const unsigned int SceneInstanceBlockSize = 4096;
+
+// Longest string accepted from a binary file - anything longer means the file is damaged
+const gen::TUInt32 MaxSceneStringLength = 1024;
+
+// Most entries accepted in each of a binary file's technique, material, mesh and light tables - more means the file is damaged
+const gen::TUInt32 MaxSceneTableSize = 65536;
+
+// Smallest size of an entry in each table of a binary file, with all its strings empty (a string is at least its length)
+const gen::TUInt64 MinSceneTechniqueSize = sizeof(gen::TUInt32);
+const gen::TUInt64 MinSceneMaterialSize = 4 * sizeof(gen::TUInt32) + 3 * sizeof(float);
+const gen::TUInt64 MinSceneMeshSize = 3 * sizeof(gen::TUInt32) + sizeof(float);
+const gen::TUInt64 MinSceneLightSize = 6 * sizeof(gen::TUInt32) + 5 * sizeof(gen::CVector3) + 2 * sizeof(float);
+
+static_assert(sizeof(SSceneInstance) == 56, "Scene instances are read straight from binary files, so must have no padding");
+
+
+//--------------------------------------------------------------------------------------
+// Binary file helpers
+//--------------------------------------------------------------------------------------
+
+template <class T> void WriteValue(ofstream& file, const T& value)
+{
+	file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <class T> bool ReadValue(ifstream& file, T& value)
+{
+	return !file.read(reinterpret_cast<char*>(&value), sizeof(T)).fail();
+}
+
+// Strings are written as their length followed by their characters
+void WriteString(ofstream& file, const string& text)
+{
+	WriteValue(file, static_cast<gen::TUInt32>(text.size()));
+	file.write(text.data(), text.size());
+}
+
+bool ReadString(ifstream& file, string& text)
+{
+	gen::TUInt32 length;
+	if (!ReadValue(file, length) || length > MaxSceneStringLength)
+	{
+		return false;
+	}
+	text.resize(length);
+	return length == 0 || !file.read(&text[0], length).fail();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Text file helpers
+//--------------------------------------------------------------------------------------
+
+bool ReadVector(istringstream& line, gen::CVector3& vector)
+{
+	return !(line >> vector.x >> vector.y >> vector.z).fail();
+}
+
+// Read "static" or "dynamic", returns false if the word is neither
+bool ReadStationary(istringstream& line, bool& isStationary)
+{
+	string word;
+	line >> word;
+	isStationary = (word == "static");
+	return isStationary || word == "dynamic";
+}
+
+// Texture names are "-" for none
+string TextureName(const string& name)
+{
+	return (name == "-") ? "" : name;
+}
+
+// Find the index of a name declared earlier in a text scene, returns false if the name has not been declared
+bool FindName(const map<string, unsigned int>& names, const string& name, unsigned int& index)
+{
+	map<string, unsigned int>::const_iterator found = names.find(name);
+	if (found == names.end())
+	{
+		return false;
+	}
+	index = found->second;
+	return true;
+}
+
+// Find the index of a technique name, adding it to the table if this is its first use
+unsigned int FindTechnique(map<string, unsigned int>& names, vector<string>& techniques, const string& name)
+{
+	map<string, unsigned int>::iterator found = names.find(name);
+	if (found != names.end())
+	{
+		return found->second;
+	}
+	unsigned int index = static_cast<unsigned int>(techniques.size());
+	names[name] = index;
+	techniques.push_back(name);
+	return index;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Scene file class
+//--------------------------------------------------------------------------------------
+
+CSceneFile::CSceneFile()
+{
+	Close();
+}
+
+CSceneFile::~CSceneFile()
+{
+	Close();
+}
+
+// Open a text or binary scene file, reading everything except a binary file's instances
+bool CSceneFile::Open(const string& fileName)
+{
+	Close();
+
+	// Binary files are recognised by their id
+	char id[sizeof(SceneFileId)] = { 0 };
+	{
+		ifstream file(fileName.c_str(), ios::binary);
+		if (!file)
+		{
+			m_Error = "Cannot open scene file " + fileName;
+			return false;
+		}
+		file.read(id, sizeof(id));
+	}
+	bool opened = equal(id, id + sizeof(id), SceneFileId) ? ReadBinaryTables(fileName) : ReadText(fileName);
+	if (!opened)
+	{
+		string error = m_Error;
+		Close();
+		m_Error = error;
+	}
+	return opened;
+}
+
+// Close the file and clear the scene
+void CSceneFile::Close()
+{
+	m_CameraPosition = gen::CVector3::kOrigin;
+	m_CameraRotation = gen::CVector3::kZero;
+	m_AmbientColour = gen::CVector3::kZero;
+	m_Techniques.clear();
+	m_Materials.clear();
+	m_Meshes.clear();
+	m_Lights.clear();
+	m_NumInstances = 0;
+	m_NextInstance = 0;
+	m_TextInstances.clear();
+	if (m_BinaryFile.is_open())
+	{
+		m_BinaryFile.close();
+	}
+	m_BinaryFile.clear();
+	m_Error.clear();
+}
+
+// Read up to the given number of the next instances into an array, returns the number read
+unsigned int CSceneFile::ReadInstances(SSceneInstance* instances, unsigned int maxInstances)
+{
+	unsigned int count = min(maxInstances, m_NumInstances - m_NextInstance);
+	if (count == 0 || !m_Error.empty())
+	{
+		return 0;
+	}
+
+	if (m_BinaryFile.is_open())
+	{
+		// One read for the whole block, straight into the caller's array
+		if (m_BinaryFile.read(reinterpret_cast<char*>(instances), count * sizeof(SSceneInstance)).fail())
+		{
+			m_Error = "Scene file ends before its last instance";
+			return 0;
+		}
+		for (unsigned int i = 0; i < count; i++)
+		{
+			if (!IsValid(instances[i]))
+			{
+				ostringstream error;
+				error << "Scene instance " << m_NextInstance + i << " uses a mesh, material or technique the scene does not have";
+				m_Error = error.str();
+				return 0;
+			}
+		}
+	}
+	else
+	{
+		copy(m_TextInstances.begin() + m_NextInstance, m_TextInstances.begin() + m_NextInstance + count, instances);
+	}
+	m_NextInstance += count;
+	return count;
+}
+
+// Write the open scene to a binary file. Call straight after Open
+bool CSceneFile::WriteBinary(const string& fileName)
+{
+	ofstream file(fileName.c_str(), ios::binary);
+	if (!file)
+	{
+		m_Error = "Cannot create scene file " + fileName;
+		return false;
+	}
+
+	file.write(SceneFileId, sizeof(SceneFileId));
+	WriteValue(file, SceneFileVersion);
+	SSceneFileCounts counts;
+	counts.Techniques = static_cast<gen::TUInt32>(m_Techniques.size());
+	counts.Materials = static_cast<gen::TUInt32>(m_Materials.size());
+	counts.Meshes = static_cast<gen::TUInt32>(m_Meshes.size());
+	counts.Lights = static_cast<gen::TUInt32>(m_Lights.size());
+	counts.Instances = m_NumInstances - m_NextInstance;
+	WriteValue(file, counts);
+
+	WriteValue(file, m_CameraPosition);
+	WriteValue(file, m_CameraRotation);
+	WriteValue(file, m_AmbientColour);
+	for (unsigned int i = 0; i < m_Techniques.size(); i++)
+	{
+		WriteString(file, m_Techniques[i]);
+	}
+	for (unsigned int i = 0; i < m_Materials.size(); i++)
+	{
+		const SSceneMaterial& material = m_Materials[i];
+		WriteString(file, material.Name);
+		WriteString(file, material.DiffuseSpecularMap);
+		WriteString(file, material.NormalMap);
+		WriteString(file, material.CelGradient);
+		WriteValue(file, material.SpecularPower);
+		WriteValue(file, material.ParallaxDepth);
+		WriteValue(file, material.OutlineThickness);
+	}
+	for (unsigned int i = 0; i < m_Meshes.size(); i++)
+	{
+		const SSceneMesh& mesh = m_Meshes[i];
+		WriteString(file, mesh.Name);
+		WriteString(file, mesh.FileName);
+		WriteValue(file, static_cast<gen::TUInt32>(mesh.IsOccluder));
+		WriteValue(file, mesh.OccluderCellSize);
+	}
+	for (unsigned int i = 0; i < m_Lights.size(); i++)
+	{
+		const SSceneLight& light = m_Lights[i];
+		WriteValue(file, static_cast<gen::TUInt32>(light.Type));
+		WriteValue(file, static_cast<gen::TUInt32>(light.Number));
+		WriteValue(file, static_cast<gen::TUInt32>(light.Mesh));
+		WriteValue(file, static_cast<gen::TUInt32>(light.Material));
+		WriteValue(file, static_cast<gen::TUInt32>(light.Technique));
+		WriteValue(file, light.Position);
+		WriteValue(file, light.Rotation);
+		WriteValue(file, light.FacePoint);
+		WriteValue(file, light.ConeAngle);
+		WriteValue(file, light.Scale);
+		WriteValue(file, light.DiffuseColour);
+		WriteValue(file, light.SpecularColour);
+		WriteValue(file, static_cast<gen::TUInt32>(light.IsStationary));
+	}
+
+	// Instances go through in blocks, so converting a large binary file doesn't need them all in memory
+	vector<SSceneInstance> block(SceneInstanceBlockSize);
+	unsigned int numRead;
+	while ((numRead = ReadInstances(&block[0], SceneInstanceBlockSize)) > 0)
+	{
+		file.write(reinterpret_cast<const char*>(&block[0]), numRead * sizeof(SSceneInstance));
+	}
+	if (!m_Error.empty())
+	{
+		return false;
+	}
+	if (file.fail())
+	{
+		m_Error = "Cannot write scene file " + fileName;
+		return false;
+	}
+	return true;
+}
+
+
+/////////////////////////////
+// Private functions
+
+// Read a scene from a text file
+bool CSceneFile::ReadText(const string& fileName)
+{
+	ifstream file(fileName.c_str());
+	if (!file)
+	{
+		m_Error = "Cannot open scene file " + fileName;
+		return false;
+	}
+
+	// Names declared so far, with their table index
+	map<string, unsigned int> materialNames;
+	map<string, unsigned int> meshNames;
+	map<string, unsigned int> techniqueNames;
+
+	string text;
+	unsigned int lineNumber = 0;
+	while (getline(file, text))
+	{
+		lineNumber++;
+		string::size_type comment = text.find('#');
+		if (comment != string::npos)
+		{
+			text.erase(comment);
+		}
+		istringstream line(text);
+		string item;
+		if (!(line >> item))
+		{
+			continue; // Blank line
+		}
+
+		// Each item sets valid to false if its values are missing or wrong, or sets error if there is a more specific problem
+		bool valid = true;
+		string error;
+		if (item == "camera")
+		{
+			valid = ReadVector(line, m_CameraPosition) && ReadVector(line, m_CameraRotation);
+		}
+		else if (item == "ambient")
+		{
+			valid = ReadVector(line, m_AmbientColour);
+		}
+		else if (item == "material")
+		{
+			SSceneMaterial material;
+			valid = !(line >> material.Name >> material.DiffuseSpecularMap >> material.NormalMap >> material.CelGradient
+			               >> material.SpecularPower >> material.ParallaxDepth >> material.OutlineThickness).fail();
+			if (valid && materialNames.count(material.Name))
+			{
+				error = "material " + material.Name + " is declared twice";
+			}
+			else if (valid)
+			{
+				material.DiffuseSpecularMap = TextureName(material.DiffuseSpecularMap);
+				material.NormalMap = TextureName(material.NormalMap);
+				material.CelGradient = TextureName(material.CelGradient);
+				materialNames[material.Name] = static_cast<unsigned int>(m_Materials.size());
+				m_Materials.push_back(material);
+			}
+		}
+		else if (item == "mesh")
+		{
+			SSceneMesh mesh;
+			string cellSize;
+			valid = !(line >> mesh.Name >> mesh.FileName >> cellSize).fail();
+			mesh.IsOccluder = (cellSize != "-");
+			mesh.OccluderCellSize = 0.0f;
+			if (valid && mesh.IsOccluder)
+			{
+				istringstream cellSizeText(cellSize);
+				valid = !(cellSizeText >> mesh.OccluderCellSize).fail() && mesh.OccluderCellSize >= 0.0f;
+			}
+			if (valid && meshNames.count(mesh.Name))
+			{
+				error = "mesh " + mesh.Name + " is declared twice";
+			}
+			else if (valid)
+			{
+				meshNames[mesh.Name] = static_cast<unsigned int>(m_Meshes.size());
+				m_Meshes.push_back(mesh);
+			}
+		}
+		else if (item == "instance")
+		{
+			SSceneInstance instance;
+			string mesh, material, technique;
+			bool isStationary;
+			valid = !(line >> mesh >> material >> technique).fail() && ReadVector(line, instance.Position) &&
+			        ReadVector(line, instance.Rotation) && !(line >> instance.Scale).fail() && ReadVector(line, instance.Colour) &&
+			        ReadStationary(line, isStationary);
+			if (valid)
+			{
+				if (!FindName(meshNames, mesh, instance.Mesh))
+				{
+					error = "mesh " + mesh + " has not been declared";
+				}
+				else if (!FindName(materialNames, material, instance.Material))
+				{
+					error = "material " + material + " has not been declared";
+				}
+				else
+				{
+					instance.Technique = FindTechnique(techniqueNames, m_Techniques, technique);
+					instance.Flags = isStationary ? kSceneInstanceStationary : 0;
+					m_TextInstances.push_back(instance);
+				}
+			}
+		}
+		else if (item == "light" || item == "spotlight")
+		{
+			SSceneLight light;
+			string mesh, material, technique;
+			light.Type = (item == "light") ? SceneLightPoint : SceneLightSpot;
+			light.Rotation = gen::CVector3::kZero;
+			light.FacePoint = gen::CVector3::kZero;
+			light.ConeAngle = 0.0f;
+			valid = !(line >> light.Number >> mesh >> material >> technique).fail() && ReadVector(line, light.Position);
+			if (light.Type == SceneLightPoint)
+			{
+				valid = valid && ReadVector(line, light.Rotation);
+			}
+			else
+			{
+				valid = valid && ReadVector(line, light.FacePoint) && !(line >> light.ConeAngle).fail();
+			}
+			valid = valid && !(line >> light.Scale).fail() && ReadVector(line, light.DiffuseColour) &&
+			        ReadVector(line, light.SpecularColour) && ReadStationary(line, light.IsStationary);
+			if (valid)
+			{
+				if (!FindName(meshNames, mesh, light.Mesh))
+				{
+					error = "mesh " + mesh + " has not been declared";
+				}
+				else if (!FindName(materialNames, material, light.Material))
+				{
+					error = "material " + material + " has not been declared";
+				}
+				else
+				{
+					light.Technique = FindTechnique(techniqueNames, m_Techniques, technique);
+					m_Lights.push_back(light);
+				}
+			}
+		}
+		else
+		{
+			error = "unknown item " + item;
+		}
+
+		string extra;
+		if (valid && error.empty() && line >> extra)
+		{
+			error = "unexpected " + extra + " after the " + item;
+		}
+		if (!valid || !error.empty())
+		{
+			ostringstream message;
+			message << fileName << " line " << lineNumber << ": " << (valid ? error : "missing or invalid values for " + item);
+			m_Error = message.str();
+			return false;
+		}
+	}
+
+	m_NumInstances = static_cast<unsigned int>(m_TextInstances.size());
+	return true;
+}
+
+// Read the tables from a binary file, leaving the file open at the first instance
+bool CSceneFile::ReadBinaryTables(const string& fileName)
+{
+	m_BinaryFile.open(fileName.c_str(), ios::binary);
+	m_BinaryFile.seekg(0, ios::end);
+	gen::TUInt64 fileSize = static_cast<gen::TUInt64>(m_BinaryFile.tellg());
+	m_BinaryFile.seekg(sizeof(SceneFileId));
+	gen::TUInt32 version;
+	if (!ReadValue(m_BinaryFile, version) || version != SceneFileVersion)
+	{
+		m_Error = fileName + " is from a different version of the scene format";
+		return false;
+	}
+
+	SSceneFileCounts counts;
+	bool valid = ReadValue(m_BinaryFile, counts) && ReadValue(m_BinaryFile, m_CameraPosition) &&
+	             ReadValue(m_BinaryFile, m_CameraRotation) && ReadValue(m_BinaryFile, m_AmbientColour);
+	if (!valid)
+	{
+		m_Error = fileName + " is not a valid scene file";
+		return false;
+	}
+
+	// A damaged file can give huge counts, so check the tables and instances could fit in the rest of the file before making space
+	// for any of them
+	gen::TUInt64 minSize = counts.Techniques * MinSceneTechniqueSize + counts.Materials * MinSceneMaterialSize +
+	                       counts.Meshes * MinSceneMeshSize + counts.Lights * MinSceneLightSize +
+	                       static_cast<gen::TUInt64>(counts.Instances) * sizeof(SSceneInstance);
+	gen::TUInt64 position = static_cast<gen::TUInt64>(m_BinaryFile.tellg());
+	if (counts.Techniques > MaxSceneTableSize || counts.Materials > MaxSceneTableSize || counts.Meshes > MaxSceneTableSize ||
+	    counts.Lights > MaxSceneTableSize || position > fileSize || minSize > fileSize - position)
+	{
+		m_Error = fileName + " is damaged - its table sizes do not fit in the file";
+		return false;
+	}
+
+	m_Techniques.resize(counts.Techniques);
+	for (unsigned int i = 0; valid && i < m_Techniques.size(); i++)
+	{
+		valid = ReadString(m_BinaryFile, m_Techniques[i]);
+	}
+	m_Materials.resize(valid ? counts.Materials : 0);
+	for (unsigned int i = 0; valid && i < m_Materials.size(); i++)
+	{
+		SSceneMaterial& material = m_Materials[i];
+		valid = ReadString(m_BinaryFile, material.Name) && ReadString(m_BinaryFile, material.DiffuseSpecularMap) &&
+		        ReadString(m_BinaryFile, material.NormalMap) && ReadString(m_BinaryFile, material.CelGradient) &&
+		        ReadValue(m_BinaryFile, material.SpecularPower) && ReadValue(m_BinaryFile, material.ParallaxDepth) &&
+		        ReadValue(m_BinaryFile, material.OutlineThickness);
+	}
+	m_Meshes.resize(valid ? counts.Meshes : 0);
+	for (unsigned int i = 0; valid && i < m_Meshes.size(); i++)
+	{
+		SSceneMesh& mesh = m_Meshes[i];
+		gen::TUInt32 isOccluder;
+		valid = ReadString(m_BinaryFile, mesh.Name) && ReadString(m_BinaryFile, mesh.FileName) && ReadValue(m_BinaryFile, isOccluder) &&
+		        ReadValue(m_BinaryFile, mesh.OccluderCellSize);
+		mesh.IsOccluder = (isOccluder != 0);
+	}
+	m_Lights.resize(valid ? counts.Lights : 0);
+	for (unsigned int i = 0; valid && i < m_Lights.size(); i++)
+	{
+		SSceneLight& light = m_Lights[i];
+		gen::TUInt32 type, number, mesh, material, technique, isStationary;
+		valid = ReadValue(m_BinaryFile, type) && ReadValue(m_BinaryFile, number) && ReadValue(m_BinaryFile, mesh) &&
+		        ReadValue(m_BinaryFile, material) && ReadValue(m_BinaryFile, technique) && ReadValue(m_BinaryFile, light.Position) &&
+		        ReadValue(m_BinaryFile, light.Rotation) && ReadValue(m_BinaryFile, light.FacePoint) &&
+		        ReadValue(m_BinaryFile, light.ConeAngle) && ReadValue(m_BinaryFile, light.Scale) &&
+		        ReadValue(m_BinaryFile, light.DiffuseColour) && ReadValue(m_BinaryFile, light.SpecularColour) &&
+		        ReadValue(m_BinaryFile, isStationary) && type <= SceneLightSpot;
+		light.Type = static_cast<ESceneLightType>(type);
+		light.Number = number;
+		light.Mesh = mesh;
+		light.Material = material;
+		light.Technique = technique;
+		light.IsStationary = (isStationary != 0);
+		valid = valid && IsValid(light);
+	}
+	if (!valid)
+	{
+		m_Error = fileName + " is not a valid scene file";
+		return false;
+	}
+
+	m_NumInstances = counts.Instances;
+	return true;
+}
+
+// Check the table indices of a light or instance are in range
+bool CSceneFile::IsValid(const SSceneLight& light)
+{
+	return light.Mesh < m_Meshes.size() && light.Material < m_Materials.size() && light.Technique < m_Techniques.size();
+}
+
+bool CSceneFile::IsValid(const SSceneInstance& instance)
+{
+	return instance.Mesh < m_Meshes.size() && instance.Material < m_Materials.size() && instance.Technique < m_Techniques.size();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Conversion
+//--------------------------------------------------------------------------------------
+
+// Convert a text scene file to a binary one
+bool ConvertSceneFile(const string& textFileName, const string& binaryFileName, string& error)
+{
+	CSceneFile scene;
+	if (!scene.Open(textFileName) || !scene.WriteBinary(binaryFileName))
+	{
+		error = scene.GetError();
+		return false;
+	}
+	return true;
+}
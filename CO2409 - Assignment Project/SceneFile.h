@@ -0,0 +1,203 @@
+//--------------------------------------------------------------------------------------
+//	SceneFile.h
+//
+//	The scene file class reads descriptions of a scene - camera, materials, meshes, lights
+//	and model instances - from text or binary scene files, and writes the binary form
+//--------------------------------------------------------------------------------------
+
+#ifndef SCENE_FILE_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define SCENE_FILE_H_INCLUDED
+
+#include <fstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "CVector3.h"
+
+// Scenes are authored as text, one item per line, with '#' starting a comment. Names are single words and items must be declared
+// before they are used. Texture names are "-" for none. Angles are in degrees, rotations are Euler angles in ZXY order as for models:
+//
+//   camera    <position x y z> <rotation x y z>
+//   ambient   <colour r g b>
+//   material  <name> <diffuse specular map> <normal map> <cel gradient> <specular power> <parallax depth> <outline thickness>
+//   mesh      <name> <file> <occluder simplify cell size, or "-" if the mesh is not an occluder>
+//   instance  <mesh> <material> <technique> <position x y z> <rotation x y z> <scale> <colour r g b> static|dynamic
+//   light     <number> <mesh> <material> <technique> <position x y z> <rotation x y z> <scale> <diffuse r g b> <specular r g b>
+//             static|dynamic
+//   spotlight <number> <mesh> <material> <technique> <position x y z> <face point x y z> <cone angle> <scale> <diffuse r g b>
+//             <specular r g b> static|dynamic
+//
+// Techniques are named as in the effect file. Lights are numbered from 0 and set up the application's existing point and spot lights
+//
+// The binary form holds the same tables with names resolved to indices, then the instances as fixed size records. It is read in
+// two steps: Open reads the small tables, then ReadInstances streams the instance records in blocks straight from the file, so a
+// large scene never needs all its instances in memory at once and loading is a few large reads. Text scenes are parsed completely
+// by Open and ReadInstances hands out the parsed instances in the same way, so the same loading code works for both. Converting
+// text to binary (WriteBinary) is done once after editing
+
+// Values for SSceneInstance::Flags
+const gen::TUInt32 kSceneInstanceStationary = 0x01; // The model never moves
+
+struct SSceneMaterial
+{
+	string Name;
+	string DiffuseSpecularMap; // Texture file names, empty if not used
+	string NormalMap;
+	string CelGradient;
+	float  SpecularPower;
+	float  ParallaxDepth;
+	float  OutlineThickness;
+};
+
+struct SSceneMesh
+{
+	string Name;
+	string FileName;
+	bool   IsOccluder;
+	float  OccluderCellSize; // Cell size to simplify the occluder mesh by (0 to use the geometry as it is)
+};
+
+enum ESceneLightType
+{
+	SceneLightPoint,
+	SceneLightSpot
+};
+
+struct SSceneLight
+{
+	ESceneLightType Type;
+	unsigned int    Number;    // Which of the application's point or spot lights this sets up
+	unsigned int    Mesh;      // Light model, as indices into the mesh, material and technique tables
+	unsigned int    Material;
+	unsigned int    Technique;
+	gen::CVector3   Position;
+	gen::CVector3   Rotation;  // Point lights only (degrees)
+	gen::CVector3   FacePoint; // Spot lights only - the light faces this point
+	float           ConeAngle; // Spot lights only (degrees)
+	float           Scale;
+	gen::CVector3   DiffuseColour;
+	gen::CVector3   SpecularColour;
+	bool            IsStationary;
+};
+
+// One model in the scene. Stored in binary files exactly as laid out here
+struct SSceneInstance
+{
+	gen::TUInt32  Mesh;      // Indices into the mesh, material and technique tables
+	gen::TUInt32  Material;
+	gen::TUInt32  Technique;
+	gen::TUInt32  Flags;     // Combination of kSceneInstance... values
+	gen::CVector3 Position;
+	gen::CVector3 Rotation;  // Degrees
+	float         Scale;
+	gen::CVector3 Colour;
+};
+
+class CSceneFile
+{
+/////////////////////////////
+// Private member variables
+private:
+	// Scene tables
+	gen::CVector3          m_CameraPosition;
+	gen::CVector3          m_CameraRotation;
+	gen::CVector3          m_AmbientColour;
+	vector<string>         m_Techniques;
+	vector<SSceneMaterial> m_Materials;
+	vector<SSceneMesh>     m_Meshes;
+	vector<SSceneLight>    m_Lights;
+
+	// Number of instances in the scene and the number handed out by ReadInstances so far
+	unsigned int           m_NumInstances;
+	unsigned int           m_NextInstance;
+
+	// Instances of a text scene, parsed by Open. Binary scenes read their instances from the file as they are asked for
+	vector<SSceneInstance> m_TextInstances;
+	ifstream               m_BinaryFile;
+
+	// Description of the last error
+	string                 m_Error;
+
+	// Read a scene from a text file, or the tables from a binary file
+	bool ReadText(const string& fileName);
+	bool ReadBinaryTables(const string& fileName);
+
+	// Check the table indices of a light or instance are in range
+	bool IsValid(const SSceneLight& light);
+	bool IsValid(const SSceneInstance& instance);
+
+	// Scene files hold a stream, so are not copied
+	CSceneFile(const CSceneFile&);
+	CSceneFile& operator=(const CSceneFile&);
+
+/////////////////////////////
+// Public member functions
+public:
+	// Constructor / Destructor
+	CSceneFile();
+	~CSceneFile();
+
+	// Open a text or binary scene file (the kind is found from the file's contents), reading everything except a binary file's
+	// instances. Returns false if the file could not be read or is not a valid scene - GetError describes the problem
+	bool Open(const string& fileName);
+
+	// Close the file and clear the scene
+	void Close();
+
+	// Read up to the given number of the next instances into an array, returns the number read - 0 when all have been read or on
+	// an error (GetError is not empty if there was an error)
+	unsigned int ReadInstances(SSceneInstance* instances, unsigned int maxInstances);
+
+	// Write the open scene to a binary file. Call straight after Open - the instances are read through ReadInstances. Returns false
+	// if the file could not be written
+	bool WriteBinary(const string& fileName);
+
+
+	/////////////////////////////
+	// Data access
+
+	const gen::CVector3& GetCameraPosition()
+	{
+		return m_CameraPosition;
+	}
+	const gen::CVector3& GetCameraRotation() // Degrees
+	{
+		return m_CameraRotation;
+	}
+	const gen::CVector3& GetAmbientColour()
+	{
+		return m_AmbientColour;
+	}
+	const vector<string>& GetTechniques() // Technique names used by the scene
+	{
+		return m_Techniques;
+	}
+	const vector<SSceneMaterial>& GetMaterials()
+	{
+		return m_Materials;
+	}
+	const vector<SSceneMesh>& GetMeshes()
+	{
+		return m_Meshes;
+	}
+	const vector<SSceneLight>& GetLights()
+	{
+		return m_Lights;
+	}
+	unsigned int GetNumInstances()
+	{
+		return m_NumInstances;
+	}
+	const string& GetError()
+	{
+		return m_Error;
+	}
+};
+
+// Convert a text scene file to a binary one. Returns false if the text file could not be read or the binary file written, with
+// a description of the problem in error
+bool ConvertSceneFile(const string& textFileName, const string& binaryFileName, string& error);
+
+
+#endif // End of header guard - see top of file
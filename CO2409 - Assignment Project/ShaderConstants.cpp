@@ -0,0 +1,116 @@
+//--------------------------------------------------------------------------------------
+//	ShaderConstants.cpp
+//
+//	The shader constants hold the effect file's constant buffers, grouped by how often
+//	they change, and upload each one whole from a packed struct when its contents change
+//--------------------------------------------------------------------------------------
+
+#include <string.h> // memcmp, memcpy, memset
+
+#include "ShaderConstants.h"	// Declaration of this class
+#include "RenderBackend.h"
+
+// Size of each group's struct, in the order of EConstantGroup
+const unsigned int CShaderConstants::m_Sizes[NumConstantGroups] =
+{
+	sizeof(SPerFrameConstants),
+	sizeof(SPerLightSetConstants),
+	sizeof(SPerMaterialConstants),
+	sizeof(SPerObjectConstants)
+};
+
+
+///////////////////////////////
+// Constructors / Destructors
+
+CShaderConstants::CShaderConstants()
+{
+	memset(&m_Frame, 0, sizeof(m_Frame));
+	memset(&m_LightSet, 0, sizeof(m_LightSet));
+	memset(&m_Material, 0, sizeof(m_Material));
+	memset(&m_Object, 0, sizeof(m_Object));
+	m_Constants[ConstantsPerFrame] = &m_Frame;
+	m_Constants[ConstantsPerLightSet] = &m_LightSet;
+	m_Constants[ConstantsPerMaterial] = &m_Material;
+	m_Constants[ConstantsPerObject] = &m_Object;
+	m_Backend = NULL;
+
+	for (unsigned int group = 0; group < NumConstantGroups; group++)
+	{
+		m_Contents[group] = new unsigned char[m_Sizes[group]];
+		memset(m_Contents[group], 0, m_Sizes[group]);
+		m_ContentsValid[group] = false;
+	}
+	m_ChangedSinceApply = false;
+	BeginFrame();
+}
+
+CShaderConstants::~CShaderConstants()
+{
+	for (unsigned int group = 0; group < NumConstantGroups; group++)
+	{
+		delete[] m_Contents[group];
+	}
+}
+
+
+/////////////////////////////
+// Setup / frame control
+
+// Set the backend the constants are uploaded through, the next update of each group is always uploaded. Without a backend (NULL)
+// uploads are only counted
+void CShaderConstants::SetBackend(CRenderBackend* backend)
+{
+	m_Backend = backend;
+	for (unsigned int group = 0; group < NumConstantGroups; group++)
+	{
+		m_ContentsValid[group] = false;
+	}
+}
+
+// Start counting uploads for a new frame
+void CShaderConstants::BeginFrame()
+{
+	memset(&m_Counts, 0, sizeof(m_Counts));
+}
+
+// An effect pass has been applied - counts the old single buffer upload that the pass would have caused
+void CShaderConstants::RecordApply()
+{
+	if (m_ChangedSinceApply)
+	{
+		for (unsigned int group = 0; group < NumConstantGroups; group++)
+		{
+			m_Counts.GlobalsBytes += m_Sizes[group];
+		}
+		m_ChangedSinceApply = false;
+	}
+}
+
+
+/////////////////////////////
+// Private member functions
+
+// Upload a group's constants to its buffer, unless they are the same as the last upload
+void CShaderConstants::Upload(EConstantGroup group)
+{
+	const void* contents = m_Constants[group];
+	unsigned int size = m_Sizes[group];
+	if (m_ContentsValid[group] && memcmp(m_Contents[group], contents, size) == 0)
+	{
+		m_Counts.Elided[group]++;
+		return;
+	}
+	memcpy(m_Contents[group], contents, size);
+	m_ContentsValid[group] = true;
+
+	if (m_Backend && !m_Backend->UpdateConstants(group, contents, size))
+	{
+		m_ContentsValid[group] = false; // Try again next time
+		return;
+	}
+
+	m_Counts.Uploads[group]++;
+	m_Counts.BytesUploaded += size;
+	m_ChangedSinceApply = true;
+}
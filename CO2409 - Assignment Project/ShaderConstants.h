@@ -0,0 +1,227 @@
+//--------------------------------------------------------------------------------------
+//	ShaderConstants.h
+//
+//	The shader constants hold the effect file's constant buffers, grouped by how often
+//	they change, and upload each one whole from a packed struct when its contents change
+//--------------------------------------------------------------------------------------
+
+#ifndef SHADER_CONSTANTS_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define SHADER_CONSTANTS_H_INCLUDED
+
+#include <stddef.h> // offsetof
+
+#include "Defines.h"
+
+class CRenderBackend;
+
+// Each struct here matches a cbuffer in GraphicsAssign1.fx exactly. HLSL packs constants into 16 byte registers and never lets a
+// vector cross from one register to the next, so a float3 followed by another vector takes a whole register - the structs have
+// explicit padding in these places. The sizes and some offsets are checked below, but a change to a cbuffer must be made to its
+// struct by hand
+//
+// Each buffer is written whole through the render backend (the D3D10 backend gives its buffers to the effect in place of the ones it
+// would manage itself). Previously every constant was a loose global in the implicit $Globals buffer, which the effect re-uploaded
+// whole whenever any one value in it had changed - so setting the world matrix for each model also re-sent the camera and all the
+// lights. Now a change only uploads its own buffer, and an upload with the same contents as the last is dropped.
+//
+// Uploads are counted each frame. For comparison the bytes the same frame would have uploaded with the old single buffer are also
+// counted - the size of all the buffers together for each effect pass applied after any constant changed. If no backend is set the
+// uploads are only counted
+
+// Buffers by update frequency
+enum EConstantGroup
+{
+	ConstantsPerFrame,    // Camera - also changed for each shadow map
+	ConstantsPerLightSet, // All the lights, once a frame
+	ConstantsPerMaterial, // When the material changes
+	ConstantsPerObject,   // For each model drawn
+	NumConstantGroups
+};
+
+struct SPerFrameConstants
+{
+	D3DXMATRIX  ViewMatrix;
+	D3DXMATRIX  ProjMatrix;
+	D3DXMATRIX  ViewProjMatrix;
+	D3DXVECTOR3 CameraPosition;
+	float       Wiggle;
+};
+
+struct SPointLightConstants
+{
+	D3DXVECTOR3 DiffuseColour;
+	float       Pad0;
+	D3DXVECTOR3 SpecularColour;
+	float       Pad1;
+	D3DXVECTOR3 Position;
+	float       Pad2;
+};
+
+struct SSpotLightConstants
+{
+	SPointLightConstants Light;
+	D3DXVECTOR3          FacingVector;
+	float                CosHalfAngle;
+	D3DXMATRIX           ViewMatrix;
+	D3DXMATRIX           ProjMatrix;
+	D3DXMATRIX           ViewProjMatrix;
+};
+
+// Room for lights in the light set - the techniques are compiled for NO_OF_LIGHTS and NO_OF_SPOT_LIGHTS, which must fit (checked in
+// GraphicsAssign1.cpp where they are defined)
+const unsigned int kNumPointLightConstants = 3;
+const unsigned int kNumSpotLightConstants = 1;
+
+struct SPerLightSetConstants
+{
+	SPointLightConstants PointLights[kNumPointLightConstants];
+	SSpotLightConstants  SpotLights[kNumSpotLightConstants];
+	D3DXVECTOR3          AmbientColour;
+	float                Pad0;
+};
+
+struct SPerMaterialConstants
+{
+	float SpecularPower;
+	float ParallaxDepth;
+	float OutlineThickness;
+	float Pad0;
+};
+
+struct SPerObjectConstants
+{
+	D3DXMATRIX  WorldMatrix;
+	D3DXVECTOR3 Colour;
+	float       Pad0;
+};
+
+static_assert(sizeof(SPerFrameConstants) == 208, "SPerFrameConstants must match the PerFrame cbuffer");
+static_assert(sizeof(SPointLightConstants) == 48, "SPointLightConstants must match the light constants in PerLightSet");
+static_assert(offsetof(SSpotLightConstants, ViewMatrix) == 64, "SSpotLightConstants must match the spotlight constants in PerLightSet");
+static_assert(sizeof(SPerLightSetConstants) == 416, "SPerLightSetConstants must match the PerLightSet cbuffer");
+static_assert(sizeof(SPerMaterialConstants) == 16, "SPerMaterialConstants must match the PerMaterial cbuffer");
+static_assert(sizeof(SPerObjectConstants) == 80, "SPerObjectConstants must match the PerObject cbuffer");
+
+// Uploads in the current frame
+struct SConstantCounts
+{
+	unsigned int Uploads[NumConstantGroups]; // Uploads passed on to each buffer
+	unsigned int Elided[NumConstantGroups];  // Uploads dropped because the contents had not changed
+	unsigned int BytesUploaded;              // Bytes written to the buffers
+	unsigned int GlobalsBytes;               // Bytes the frame would have uploaded with all the constants in one buffer
+};
+
+class CShaderConstants
+{
+/////////////////////////////
+// Private member variables
+private:
+
+	// Constants being written for each group
+	SPerFrameConstants    m_Frame;
+	SPerLightSetConstants m_LightSet;
+	SPerMaterialConstants m_Material;
+	SPerObjectConstants   m_Object;
+
+	CRenderBackend* m_Backend;
+
+	// The constants written above for each group, and the contents last uploaded. A group is uploaded at its first update even if
+	// the contents happen to match the initial ones
+	const void*               m_Constants[NumConstantGroups];
+	unsigned char*            m_Contents[NumConstantGroups];
+	bool                      m_ContentsValid[NumConstantGroups];
+	static const unsigned int m_Sizes[NumConstantGroups];
+
+	SConstantCounts m_Counts;
+	bool            m_ChangedSinceApply; // A buffer has been uploaded since the last effect pass was applied
+
+	// Constants are shared, so not copied
+	CShaderConstants(const CShaderConstants&);
+	CShaderConstants& operator=(const CShaderConstants&);
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	///////////////////////////////
+	// Constructors / Destructors
+
+	CShaderConstants();
+	~CShaderConstants();
+
+
+	/////////////////////////////
+	// Setup / frame control
+
+	// Set the backend the constants are uploaded through, the next update of each group is always uploaded. Without a backend
+	// (NULL) uploads are only counted
+	void SetBackend(CRenderBackend* backend);
+
+	// Start counting uploads for a new frame
+	void BeginFrame();
+
+	// An effect pass has been applied - counts the old single buffer upload that the pass would have caused
+	void RecordApply();
+
+	// Counts for the current frame
+	const SConstantCounts& GetCounts()
+	{
+		return m_Counts;
+	}
+
+
+	/////////////////////////////
+	// Constants
+
+	// The constants for each group, filled in by the rendering code and then passed to the matching Upload function. They start
+	// as zero (padding included) and keep the values last written, so only the values that change need writing each time
+
+	SPerFrameConstants& Frame()
+	{
+		return m_Frame;
+	}
+	SPerLightSetConstants& LightSet()
+	{
+		return m_LightSet;
+	}
+	SPerMaterialConstants& Material()
+	{
+		return m_Material;
+	}
+	SPerObjectConstants& Object()
+	{
+		return m_Object;
+	}
+
+	// Upload a group's constants to its buffer, unless they are the same as the last upload
+	void UploadFrame()
+	{
+		Upload(ConstantsPerFrame);
+	}
+	void UploadLightSet()
+	{
+		Upload(ConstantsPerLightSet);
+	}
+	void UploadMaterial()
+	{
+		Upload(ConstantsPerMaterial);
+	}
+	void UploadObject()
+	{
+		Upload(ConstantsPerObject);
+	}
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	void Upload(EConstantGroup group);
+};
+
+// Single set of shader constants used for all rendering - declared in GraphicsAssign1.cpp
+extern CShaderConstants g_ShaderConstants;
+
+
+#endif // End of header guard - see top of file
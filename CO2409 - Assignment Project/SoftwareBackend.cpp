@@ -0,0 +1,1275 @@
+//--------------------------------------------------------------------------------------
+//	SoftwareBackend.cpp
+//
+//	The software backend renders the frame on the CPU - a tiled rasteriser running the
+//	core techniques of GraphicsAssign1.fx in C++, for reference images and CPU timings
+//	on machines without a GPU
+//--------------------------------------------------------------------------------------
+
+#include <string.h>    // memcpy, strcmp, strlen
+#include <math.h>      // floorf, ceilf, cosf, powf
+#include <algorithm>   // min, max, swap, fill
+#include <xmmintrin.h> // SSE intrinsics
+
+#include "SoftwareBackend.h"	// Declaration of this class
+#include "Technique.h"
+#include "CTimer.h"
+
+// Triangles set up by each job of a draw
+const unsigned int SetupJobSize = 1024;
+
+// Vertices shaded by each job of a draw
+const unsigned int VertexJobSize = 256;
+
+// Bits set in each 4-bit lane mask
+const unsigned int LaneCounts[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+
+//-----------------------------------------------------------------------------
+// Helper functions
+//-----------------------------------------------------------------------------
+
+// Round a size in pixels up to whole tiles
+inline unsigned int RoundUpToTiles(unsigned int size)
+{
+	return (size + kSoftwareTileSize - 1) / kSoftwareTileSize * kSoftwareTileSize;
+}
+
+// Multiply a row vector by a matrix, as mul(v, m) does in HLSL
+inline void Transform(const D3DXMATRIX& m, float x, float y, float z, float w, float out[4])
+{
+	for (unsigned int c = 0; c < 4; c++)
+	{
+		out[c] = x * m.m[0][c] + y * m.m[1][c] + z * m.m[2][c] + w * m.m[3][c];
+	}
+}
+
+// Plane a * x + b * y + c through the values of an attribute at the three corners of a screen space triangle
+inline void ComputePlane(const float xs[3], const float ys[3], float a0, float a1, float a2, float invArea, float* a, float* b,
+                         float* c)
+{
+	*a = ((a1 - a0) * (ys[2] - ys[0]) - (a2 - a0) * (ys[1] - ys[0])) * invArea;
+	*b = ((xs[1] - xs[0]) * (a2 - a0) - (xs[2] - xs[0]) * (a1 - a0)) * invArea;
+	*c = a0 - *a * xs[0] - *b * ys[0];
+}
+
+// Convert a colour channel from 0-1 to 0-255 as a UNORM render target does
+inline unsigned int ToUNorm8(float value)
+{
+	value = (value > 0.0f) ? ((value < 1.0f) ? value : 1.0f) : 0.0f; // Also turns NaN into 0
+	return static_cast<unsigned int>(value * 255.0f + 0.5f);
+}
+
+inline unsigned int PackColour(const float colour[4])
+{
+	return ToUNorm8(colour[0]) | (ToUNorm8(colour[1]) << 8) | (ToUNorm8(colour[2]) << 16) | (ToUNorm8(colour[3]) << 24);
+}
+
+inline float Saturate(float value)
+{
+	return (value > 0.0f) ? ((value < 1.0f) ? value : 1.0f) : 0.0f;
+}
+
+// Add the diffuse and specular light from one light to the totals, as AddLight does in the effect file. The light direction is
+// normalised, the distance attenuates the light
+inline void AddLight(const SPointLightConstants& light, const D3DXVECTOR3& lightDir, float lightDist, const D3DXVECTOR3& worldNormal,
+                     const D3DXVECTOR3& cameraDir, float specularPower, D3DXVECTOR3* diffuseLight, D3DXVECTOR3* specularLight)
+{
+	D3DXVECTOR3 halfwayNormal = lightDir + cameraDir;
+	D3DXVec3Normalize(&halfwayNormal, &halfwayNormal);
+	float diffuseLevel = Saturate(D3DXVec3Dot(&worldNormal, &lightDir));
+	float specularLevel = powf(Saturate(D3DXVec3Dot(&worldNormal, &halfwayNormal)), specularPower);
+	*diffuseLight += light.DiffuseColour * diffuseLevel / lightDist;
+	*specularLight += light.SpecularColour * specularLevel / lightDist;
+}
+
+
+///////////////////////////////
+// Constructors / Destructors
+
+CSoftwareBackend::CSoftwareBackend()
+{
+	m_Width = 0;
+	m_Height = 0;
+	m_Pitch = 0;
+	m_Jobs = NULL;
+
+	for (unsigned int slot = 0; slot < 2; slot++)
+	{
+		m_VertexBuffers[slot] = NULL;
+		m_VertexStrides[slot] = 0;
+		m_VertexOffsets[slot] = 0;
+	}
+	m_Layout = NULL;
+	m_IndexBuffer = NULL;
+	m_IndexFormat = DXGI_FORMAT_UNKNOWN;
+	m_IndexOffset = 0;
+	m_Topology = D3D10_PRIMITIVE_TOPOLOGY_UNDEFINED;
+	for (unsigned int slot = 0; slot < NumTextureSlots; slot++)
+	{
+		m_Textures[slot] = NULL;
+	}
+	memset(&m_Shader, 0, sizeof(m_Shader));
+
+	memset(&m_Frame, 0, sizeof(m_Frame));
+	memset(&m_LightSet, 0, sizeof(m_LightSet));
+	memset(&m_Material, 0, sizeof(m_Material));
+	memset(&m_Object, 0, sizeof(m_Object));
+	m_PixelConstantsChanged = true;
+
+	m_TargetTexture = NULL;
+	memset(&m_Target, 0, sizeof(m_Target));
+	m_ViewportWidth = 0;
+	m_ViewportHeight = 0;
+	m_RasterWidth = 0;
+	m_RasterHeight = 0;
+	m_TilesX = 0;
+	m_TilesY = 0;
+
+	ResetStats();
+}
+
+// Buffers and textures still referenced are left to the code holding them
+CSoftwareBackend::~CSoftwareBackend()
+{
+	Release();
+}
+
+// Create the back buffer and depth buffer of the given size and the worker threads, and select the back buffer for rendering
+bool CSoftwareBackend::Create(unsigned int width, unsigned int height, unsigned int numThreads /*= 0*/)
+{
+	if (width == 0 || height == 0)
+	{
+		return false;
+	}
+	m_Width = width;
+	m_Height = height;
+	m_Pitch = RoundUpToTiles(width);
+	m_BackBuffer.assign(m_Pitch * RoundUpToTiles(height), 0);
+	m_DepthBuffer.assign(m_Pitch * RoundUpToTiles(height), 1.0f);
+	m_Jobs = new gen::CJobSystem(numThreads);
+
+	SelectTarget(NULL);
+	m_ViewportWidth = width;
+	m_ViewportHeight = height;
+	UpdateRasterArea();
+	return true;
+}
+
+// Release everything created by the backend, after the rendering code has released its buffers and textures. Draws not yet
+// rasterised are dropped
+void CSoftwareBackend::Release()
+{
+	m_Triangles.clear();
+	m_Bins.clear();
+	m_DrawStates.clear();
+	m_PixelConstants.clear();
+	m_TilesX = 0;
+	m_TilesY = 0;
+
+	for (map<gen::TUInt64, SLayout*>::iterator layout = m_Layouts.begin(); layout != m_Layouts.end(); ++layout)
+	{
+		delete layout->second;
+	}
+	m_Layouts.clear();
+	m_Layout = NULL;
+
+	delete m_Jobs;
+	m_Jobs = NULL;
+
+	m_TargetTexture = NULL;
+	memset(&m_Target, 0, sizeof(m_Target));
+	m_BackBuffer.clear();
+	m_DepthBuffer.clear();
+}
+
+
+/////////////////////////////
+// Threads, stats and output
+
+// Change the number of threads rendering (0 = one per hardware thread). Waiting draws are finished with the old threads
+void CSoftwareBackend::SetNumThreads(unsigned int numThreads)
+{
+	Flush();
+	delete m_Jobs;
+	m_Jobs = new gen::CJobSystem(numThreads);
+}
+
+void CSoftwareBackend::ResetStats()
+{
+	memset(&m_Stats, 0, sizeof(m_Stats));
+}
+
+// Copy the back buffer into an image, finishing any draws first
+void CSoftwareBackend::GetBackBuffer(SImage* image)
+{
+	Flush();
+	image->Width = m_Width;
+	image->Height = m_Height;
+	image->Pixels.resize(m_Width * m_Height);
+	for (unsigned int y = 0; y < m_Height; y++)
+	{
+		memcpy(&image->Pixels[y * m_Width], &m_BackBuffer[y * m_Pitch], m_Width * sizeof(unsigned int));
+	}
+}
+
+bool CSoftwareBackend::WriteBackBuffer(const string& fileName)
+{
+	SImage image;
+	GetBackBuffer(&image);
+	return WriteImageFile(fileName, image);
+}
+
+// Depths from 0 to 1 are written from black to white
+bool CSoftwareBackend::WriteDepthTexture(TTextureHandle texture, const string& fileName)
+{
+	Flush();
+	const STexture& depthTexture = *reinterpret_cast<STexture*>(texture);
+	if (depthTexture.Depths.empty())
+	{
+		return false;
+	}
+	SImage image;
+	image.Width = depthTexture.Width;
+	image.Height = depthTexture.Height;
+	image.Pixels.resize(image.Width * image.Height);
+	for (unsigned int y = 0; y < image.Height; y++)
+	{
+		for (unsigned int x = 0; x < image.Width; x++)
+		{
+			unsigned int grey = ToUNorm8(depthTexture.Depths[y * depthTexture.DepthPitch + x]);
+			image.Pixels[y * image.Width + x] = grey | (grey << 8) | (grey << 16) | 0xff000000;
+		}
+	}
+	return WriteImageFile(fileName, image);
+}
+
+
+/////////////////////////////
+// Buffers
+
+TBufferHandle CSoftwareBackend::CreateBuffer(EBufferType type, unsigned int size, const void* data)
+{
+	SBuffer* buffer = new SBuffer;
+	buffer->Type = type;
+	buffer->Contents.resize(size);
+	if (data && size > 0)
+	{
+		memcpy(&buffer->Contents[0], data, size);
+	}
+	buffer->RefCount = 1;
+	return reinterpret_cast<TBufferHandle>(buffer);
+}
+
+void CSoftwareBackend::AddRef(TBufferHandle buffer)
+{
+	reinterpret_cast<SBuffer*>(buffer)->RefCount++;
+}
+
+// Draws have read their buffers by the time they return, so a buffer can go at once
+void CSoftwareBackend::Release(TBufferHandle buffer)
+{
+	SBuffer* softwareBuffer = reinterpret_cast<SBuffer*>(buffer);
+	if (--softwareBuffer->RefCount == 0)
+	{
+		for (unsigned int slot = 0; slot < 2; slot++)
+		{
+			if (m_VertexBuffers[slot] == softwareBuffer)  m_VertexBuffers[slot] = NULL;
+		}
+		if (m_IndexBuffer == softwareBuffer)  m_IndexBuffer = NULL;
+		delete softwareBuffer;
+	}
+}
+
+void* CSoftwareBackend::Map(TBufferHandle buffer)
+{
+	vector<unsigned char>& contents = reinterpret_cast<SBuffer*>(buffer)->Contents;
+	return contents.empty() ? NULL : &contents[0];
+}
+
+void CSoftwareBackend::Unmap(TBufferHandle /*buffer*/)
+{
+}
+
+
+/////////////////////////////
+// Textures
+
+TTextureHandle CSoftwareBackend::LoadTexture(const string& fileName)
+{
+	SImage image;
+	if (!LoadImageFile(fileName, &image) || image.Width == 0 || image.Height == 0)
+	{
+		return NULL;
+	}
+
+	STexture* texture = new STexture;
+	texture->Width = image.Width;
+	texture->Height = image.Height;
+	texture->Texels.swap(image.Pixels);
+	texture->DepthPitch = 0;
+	texture->RefCount = 1;
+	return reinterpret_cast<TTextureHandle>(texture);
+}
+
+TTextureHandle CSoftwareBackend::CreateDepthTexture(unsigned int width, unsigned int height)
+{
+	if (width == 0 || height == 0)
+	{
+		return NULL;
+	}
+	STexture* texture = new STexture;
+	texture->Width = width;
+	texture->Height = height;
+	texture->DepthPitch = RoundUpToTiles(width);
+	texture->Depths.assign(texture->DepthPitch * RoundUpToTiles(height), 1.0f);
+	texture->RefCount = 1;
+	return reinterpret_cast<TTextureHandle>(texture);
+}
+
+void CSoftwareBackend::AddRef(TTextureHandle texture)
+{
+	reinterpret_cast<STexture*>(texture)->RefCount++;
+}
+
+// Draws waiting to be rasterised may sample the texture or render to it, so they are finished first
+void CSoftwareBackend::Release(TTextureHandle texture)
+{
+	STexture* softwareTexture = reinterpret_cast<STexture*>(texture);
+	if (--softwareTexture->RefCount == 0)
+	{
+		Flush();
+		if (m_TargetTexture == softwareTexture)
+		{
+			SelectTarget(NULL);
+			UpdateRasterArea();
+		}
+		for (unsigned int slot = 0; slot < NumTextureSlots; slot++)
+		{
+			if (m_Textures[slot] == softwareTexture)  m_Textures[slot] = NULL;
+		}
+		delete softwareTexture;
+	}
+}
+
+
+/////////////////////////////
+// Pipeline state
+
+// Layouts only record where the vertex shader's inputs are. As with a device, the layout fails if an input the technique's vertex
+// shader reads is missing or of a different format, or for an instanced layout if the technique has no instanced version
+TLayoutHandle CSoftwareBackend::GetInputLayout(const D3D10_INPUT_ELEMENT_DESC* elements, unsigned int numElements,
+                                               CTechnique* technique, bool instanced)
+{
+	if (instanced && !technique->HasInstancedTechnique())
+	{
+		return NULL;
+	}
+	bool needsTangent = (technique->GetFeatures() & FeatureNormalMap) != 0;
+
+	// Semantic names are hashed by their characters rather than their pointers
+	gen::TUInt64 key = HashStart;
+	for (unsigned int i = 0; i < numElements; i++)
+	{
+		const D3D10_INPUT_ELEMENT_DESC& element = elements[i];
+		key = HashBytes(key, element.SemanticName, strlen(element.SemanticName) + 1);
+		key = HashBytes(key, &element.SemanticIndex, sizeof(element.SemanticIndex));
+		key = HashBytes(key, &element.Format, sizeof(element.Format));
+		key = HashBytes(key, &element.InputSlot, sizeof(element.InputSlot));
+		key = HashBytes(key, &element.AlignedByteOffset, sizeof(element.AlignedByteOffset));
+	}
+	key = HashBytes(key, &instanced, sizeof(instanced));
+	key = HashBytes(key, &needsTangent, sizeof(needsTangent));
+	map<gen::TUInt64, SLayout*>::iterator found = m_Layouts.find(key);
+	if (found != m_Layouts.end())
+	{
+		return reinterpret_cast<TLayoutHandle>(found->second);
+	}
+
+	// Find each input, a bit for each one found
+	SLayout layout;
+	memset(&layout, 0, sizeof(layout));
+	layout.Instanced = instanced;
+	unsigned int foundInputs = 0;
+	for (unsigned int i = 0; i < numElements; i++)
+	{
+		const D3D10_INPUT_ELEMENT_DESC& element = elements[i];
+		if (element.InputSlot == 0 && element.SemanticIndex == 0)
+		{
+			if (strcmp(element.SemanticName, "POSITION") == 0 && element.Format == DXGI_FORMAT_R32G32B32_FLOAT)
+			{
+				layout.PositionOffset = element.AlignedByteOffset;
+				foundInputs |= 1;
+			}
+			else if (strcmp(element.SemanticName, "NORMAL") == 0 && element.Format == DXGI_FORMAT_R32G32B32_FLOAT)
+			{
+				layout.NormalOffset = element.AlignedByteOffset;
+				foundInputs |= 2;
+			}
+			else if (strcmp(element.SemanticName, "TEXCOORD") == 0 && element.Format == DXGI_FORMAT_R32G32_FLOAT)
+			{
+				layout.UVOffset = element.AlignedByteOffset;
+				foundInputs |= 4;
+			}
+			else if (strcmp(element.SemanticName, "TANGENT") == 0 && element.Format == DXGI_FORMAT_R32G32B32_FLOAT)
+			{
+				foundInputs |= 8;
+			}
+		}
+		else if (element.InputSlot == 1 && instanced)
+		{
+			if (strcmp(element.SemanticName, "WORLD") == 0 && element.SemanticIndex < 4 &&
+			    element.Format == DXGI_FORMAT_R32G32B32A32_FLOAT)
+			{
+				layout.WorldOffsets[element.SemanticIndex] = element.AlignedByteOffset;
+				foundInputs |= 16 << element.SemanticIndex;
+			}
+			else if (strcmp(element.SemanticName, "INSTANCECOLOUR") == 0 && element.SemanticIndex == 0 &&
+			         element.Format == DXGI_FORMAT_R32G32B32_FLOAT)
+			{
+				layout.ColourOffset = element.AlignedByteOffset;
+				foundInputs |= 256;
+			}
+		}
+	}
+	unsigned int neededInputs = 1 | 2 | 4 | (needsTangent ? 8 : 0) | (instanced ? (16 | 32 | 64 | 128 | 256) : 0);
+	if ((foundInputs & neededInputs) != neededInputs)
+	{
+		return NULL;
+	}
+
+	SLayout* newLayout = new SLayout(layout);
+	m_Layouts[key] = newLayout;
+	return reinterpret_cast<TLayoutHandle>(newLayout);
+}
+
+void CSoftwareBackend::SetVertexBuffer(TBufferHandle buffer, unsigned int stride, unsigned int offset, unsigned int slot)
+{
+	if (slot < 2)
+	{
+		m_VertexBuffers[slot] = reinterpret_cast<SBuffer*>(buffer);
+		m_VertexStrides[slot] = stride;
+		m_VertexOffsets[slot] = offset;
+	}
+}
+
+void CSoftwareBackend::SetInputLayout(TLayoutHandle layout)
+{
+	m_Layout = reinterpret_cast<SLayout*>(layout);
+}
+
+void CSoftwareBackend::SetIndexBuffer(TBufferHandle buffer, DXGI_FORMAT format, unsigned int offset)
+{
+	m_IndexBuffer = reinterpret_cast<SBuffer*>(buffer);
+	m_IndexFormat = format;
+	m_IndexOffset = offset;
+}
+
+void CSoftwareBackend::SetTopology(D3D10_PRIMITIVE_TOPOLOGY topology)
+{
+	m_Topology = topology;
+}
+
+void CSoftwareBackend::SetTexture(ETextureSlot slot, TTextureHandle texture)
+{
+	m_Textures[slot] = reinterpret_cast<STexture*>(texture);
+}
+
+// The shader follows the technique's features as the effect file's #if blocks do (see the top of GraphicsAssign1.fx)
+void CSoftwareBackend::ApplyPass(CTechnique* technique, unsigned int pass, bool /*instanced*/)
+{
+	unsigned int features = technique->GetFeatures();
+	bool colour = !(features & FeatureDepthOnly);
+	m_Shader.Draw = !technique->IsOutlinePass(pass);
+	m_Shader.DepthOnly = !colour;
+	m_Shader.Texture = colour && (features & FeatureTexture) != 0;
+	m_Shader.ModelColour = colour && ((features & FeatureTint) || !(features & FeatureTexture));
+	m_Shader.Lighting = colour && (features & FeaturePixelLighting) != 0;
+	m_Shader.Shadows = m_Shader.Lighting && (features & FeatureShadows) != 0;
+	m_Shader.Wiggle = (features & FeatureWiggle) != 0;
+	m_Shader.AlphaCutout = m_Shader.Texture && (features & FeatureAlphaCutout) != 0;
+	m_Shader.Additive = (features & FeatureAdditive) != 0;
+}
+
+
+/////////////////////////////
+// Constants
+
+// Vertices are shaded as they are drawn, so take the constants as they are. Pixels are shaded later, so draws keep a copy of the
+// constants the pixel shader reads, made when they have changed
+bool CSoftwareBackend::UpdateConstants(EConstantGroup group, const void* data, unsigned int size)
+{
+	void* constants;
+	unsigned int constantsSize;
+	switch (group)
+	{
+		case ConstantsPerFrame:    constants = &m_Frame;    constantsSize = sizeof(m_Frame);    break;
+		case ConstantsPerLightSet: constants = &m_LightSet; constantsSize = sizeof(m_LightSet); break;
+		case ConstantsPerMaterial: constants = &m_Material; constantsSize = sizeof(m_Material); break;
+		case ConstantsPerObject:   constants = &m_Object;   constantsSize = sizeof(m_Object);   break;
+		default: return false;
+	}
+	if (size != constantsSize)
+	{
+		return false;
+	}
+	memcpy(constants, data, size);
+	if (group != ConstantsPerObject)
+	{
+		m_PixelConstantsChanged = true;
+	}
+	return true;
+}
+
+
+/////////////////////////////
+// Render targets and draws
+
+void CSoftwareBackend::SetRenderTarget(TTextureHandle depthTexture)
+{
+	Flush();
+	SelectTarget(reinterpret_cast<STexture*>(depthTexture));
+	UpdateRasterArea();
+}
+
+void CSoftwareBackend::SetViewport(unsigned int width, unsigned int height)
+{
+	if (width != m_ViewportWidth || height != m_ViewportHeight)
+	{
+		Flush();
+		m_ViewportWidth = width;
+		m_ViewportHeight = height;
+		UpdateRasterArea();
+	}
+}
+
+// The whole target is cleared, padding included
+void CSoftwareBackend::ClearColour(const float colour[4])
+{
+	if (m_Target.Colour)
+	{
+		Flush();
+		fill(m_BackBuffer.begin(), m_BackBuffer.end(), PackColour(colour));
+	}
+}
+
+void CSoftwareBackend::ClearDepth()
+{
+	Flush();
+	if (m_Target.Depth)
+	{
+		fill(m_Target.Depth, m_Target.Depth + m_Target.Pitch * RoundUpToTiles(m_Target.Height), 1.0f);
+	}
+}
+
+void CSoftwareBackend::DrawIndexed(unsigned int numIndices)
+{
+	Draw(numIndices, 1, false);
+}
+
+void CSoftwareBackend::DrawIndexedInstanced(unsigned int numIndices, unsigned int numInstances)
+{
+	Draw(numIndices, numInstances, true);
+}
+
+// Ends the frame - there is no window, the image stays in the back buffer to be read
+void CSoftwareBackend::Present()
+{
+	Flush();
+	m_Stats.Frames++;
+}
+
+
+/////////////////////////////
+// Private member functions
+
+// Shade the vertices and set up and bin the triangles of a draw. Draws the backend can't render (other topologies or index formats,
+// or missing buffers or layout) are skipped, as are the passes only the effect file has
+void CSoftwareBackend::Draw(unsigned int numIndices, unsigned int numInstances, bool instanced)
+{
+	SBuffer* vertexBuffer = m_VertexBuffers[0];
+	SBuffer* instanceBuffer = m_VertexBuffers[1];
+	if (!m_Shader.Draw || !m_Layout || m_Layout->Instanced != instanced || !vertexBuffer || m_VertexStrides[0] == 0 ||
+	    !m_IndexBuffer || m_IndexFormat != DXGI_FORMAT_R16_UINT || m_Topology != D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST ||
+	    (instanced && (!instanceBuffer || m_VertexStrides[1] == 0)) || numInstances == 0 || m_RasterWidth == 0 || m_RasterHeight == 0)
+	{
+		return;
+	}
+	CTimer timer;
+	timer.Start();
+
+	// Indices and instances must lie within their buffers
+	unsigned int indexBytes = static_cast<unsigned int>(m_IndexBuffer->Contents.size());
+	if (m_IndexOffset >= indexBytes)
+	{
+		return;
+	}
+	numIndices = min(numIndices, (indexBytes - m_IndexOffset) / 2);
+	numIndices -= numIndices % 3;
+	const unsigned short* indices = reinterpret_cast<const unsigned short*>(&m_IndexBuffer->Contents[m_IndexOffset]);
+	const unsigned char* instances = NULL;
+	if (instanced)
+	{
+		unsigned int instanceBytes = static_cast<unsigned int>(instanceBuffer->Contents.size());
+		if (m_VertexOffsets[1] >= instanceBytes)
+		{
+			return;
+		}
+		numInstances = min(numInstances, (instanceBytes - m_VertexOffsets[1]) / m_VertexStrides[1]);
+		instances = &instanceBuffer->Contents[m_VertexOffsets[1]];
+	}
+
+	// Only the vertices up to the highest index are shaded, and they must all be in the buffer
+	unsigned int numVertices = 0;
+	for (unsigned int i = 0; i < numIndices; i++)
+	{
+		numVertices = max(numVertices, static_cast<unsigned int>(indices[i]) + 1);
+	}
+	unsigned int vertexBytes = static_cast<unsigned int>(vertexBuffer->Contents.size());
+	if (numIndices == 0 || numInstances == 0 || m_VertexOffsets[0] + numVertices * m_VertexStrides[0] > vertexBytes)
+	{
+		return;
+	}
+	const unsigned char* vertices = &vertexBuffer->Contents[m_VertexOffsets[0]];
+
+	// Pixel state of the draw. A missing texture samples as white, a missing shadow map shadows nothing
+	if (m_PixelConstantsChanged || m_PixelConstants.empty())
+	{
+		SPixelConstants constants = { m_Frame, m_LightSet, m_Material };
+		m_PixelConstants.push_back(constants);
+		m_PixelConstantsChanged = false;
+	}
+	SDrawState drawState;
+	drawState.Shader = m_Shader;
+	drawState.DiffuseMap = m_Textures[TextureDiffuseSpecular];
+	drawState.ShadowMap = m_Textures[TextureShadowMap];
+	if (!m_Shader.Texture || (drawState.DiffuseMap && drawState.DiffuseMap->Texels.empty()))  drawState.DiffuseMap = NULL;
+	if (!m_Shader.Shadows || (drawState.ShadowMap && drawState.ShadowMap->Depths.empty()))  drawState.ShadowMap = NULL;
+	drawState.Constants = &m_PixelConstants.back();
+	unsigned int draw = static_cast<unsigned int>(m_DrawStates.size());
+	m_DrawStates.push_back(drawState);
+
+	// Shade every vertex of every instance
+	unsigned int vertexStride = m_VertexStrides[0];
+	unsigned int instanceStride = m_VertexStrides[1];
+	unsigned int totalVertices = numVertices * numInstances;
+	m_ShadedVertices.resize(totalVertices);
+	m_Jobs->ParallelFor(totalVertices, VertexJobSize, [&](gen::TUInt32 first, gen::TUInt32 end)
+	{
+		for (gen::TUInt32 i = first; i < end; i++)
+		{
+			unsigned int instance = i / numVertices;
+			unsigned int vertex = i - instance * numVertices;
+			ShadeVertex(vertices + vertex * vertexStride, instanced ? instances + instance * instanceStride : NULL,
+			            &m_ShadedVertices[i]);
+		}
+	});
+
+	// Set up the triangles in parallel, each job into its own list
+	unsigned int numTriangles = numIndices / 3;
+	unsigned int totalTriangles = numTriangles * numInstances;
+	unsigned int numSetupJobs = (totalTriangles + SetupJobSize - 1) / SetupJobSize;
+	if (m_SetupTriangles.size() < numSetupJobs)
+	{
+		m_SetupTriangles.resize(numSetupJobs);
+	}
+	m_Jobs->ParallelFor(numSetupJobs, 1, [&](gen::TUInt32 first, gen::TUInt32 end)
+	{
+		for (gen::TUInt32 job = first; job < end; job++)
+		{
+			vector<STriangle>& triangles = m_SetupTriangles[job];
+			triangles.clear();
+			unsigned int endTriangle = min((job + 1) * SetupJobSize, totalTriangles);
+			for (unsigned int triangle = job * SetupJobSize; triangle < endTriangle; triangle++)
+			{
+				unsigned int instance = triangle / numTriangles;
+				const unsigned short* corners = indices + (triangle - instance * numTriangles) * 3;
+				const SShadedVertex* instanceVertices = &m_ShadedVertices[instance * numVertices];
+				SetupTriangle(instanceVertices[corners[0]], instanceVertices[corners[1]], instanceVertices[corners[2]], draw,
+				              triangles);
+			}
+		}
+	});
+
+	// Bin in the order given, so each tile draws its triangles in order
+	for (unsigned int job = 0; job < numSetupJobs; job++)
+	{
+		const vector<STriangle>& triangles = m_SetupTriangles[job];
+		for (unsigned int i = 0; i < triangles.size(); i++)
+		{
+			m_Triangles.push_back(triangles[i]);
+			BinTriangle(static_cast<unsigned int>(m_Triangles.size() - 1));
+		}
+	}
+
+	m_Stats.Draws++;
+	m_Stats.Vertices += totalVertices;
+	m_Stats.Triangles += totalTriangles;
+	m_Stats.GeometryTime += timer.GetTime();
+}
+
+// Run the vertex shader on one vertex of a draw, as TransformVertex does in the effect file. The instance data is NULL for draws that
+// are not instanced, which use the object constants
+void CSoftwareBackend::ShadeVertex(const unsigned char* vertex, const unsigned char* instance, SShadedVertex* shaded)
+{
+	const SLayout& layout = *m_Layout;
+	const D3DXMATRIX* worldMatrix = &m_Object.WorldMatrix;
+	float colour[3] = { m_Object.Colour.x, m_Object.Colour.y, m_Object.Colour.z };
+	D3DXMATRIX instanceMatrix;
+	if (instance)
+	{
+		for (unsigned int row = 0; row < 4; row++)
+		{
+			memcpy(instanceMatrix.m[row], instance + layout.WorldOffsets[row], 4 * sizeof(float));
+		}
+		worldMatrix = &instanceMatrix;
+		memcpy(colour, instance + layout.ColourOffset, 3 * sizeof(float));
+	}
+
+	float modelPos[3];
+	memcpy(modelPos, vertex + layout.PositionOffset, sizeof(modelPos));
+	float worldPos[4];
+	Transform(*worldMatrix, modelPos[0], modelPos[1], modelPos[2], 1.0f, worldPos);
+	if (m_Shader.Wiggle)
+	{
+		worldPos[0] += cosf(modelPos[2] + m_Frame.Wiggle) * 0.15f;
+		worldPos[1] += cosf(modelPos[0] + m_Frame.Wiggle) * 0.15f;
+		worldPos[2] += cosf(modelPos[1] + m_Frame.Wiggle) * 0.15f;
+	}
+	Transform(m_Frame.ViewProjMatrix, worldPos[0], worldPos[1], worldPos[2], worldPos[3], shaded->Clip);
+	if (m_Shader.DepthOnly)
+	{
+		return;
+	}
+
+	float modelNormal[3];
+	memcpy(modelNormal, vertex + layout.NormalOffset, sizeof(modelNormal));
+	float worldNormal[4];
+	Transform(*worldMatrix, modelNormal[0], modelNormal[1], modelNormal[2], 0.0f, worldNormal);
+	float normalLength = sqrtf(worldNormal[0] * worldNormal[0] + worldNormal[1] * worldNormal[1] + worldNormal[2] * worldNormal[2]);
+	float invNormalLength = (normalLength > 0.0f) ? 1.0f / normalLength : 0.0f;
+
+	float* varyings = shaded->Varyings;
+	memcpy(&varyings[VaryingU], vertex + layout.UVOffset, 2 * sizeof(float));
+	for (unsigned int i = 0; i < 3; i++)
+	{
+		varyings[VaryingColourR + i] = colour[i];
+		varyings[VaryingWorldX + i] = worldPos[i];
+		varyings[VaryingNormalX + i] = worldNormal[i] * invNormalLength;
+	}
+}
+
+// Clip a triangle against the near plane and add what is left to a list
+void CSoftwareBackend::SetupTriangle(const SShadedVertex& v0, const SShadedVertex& v1, const SShadedVertex& v2, unsigned int draw,
+                                     vector<STriangle>& triangles)
+{
+	// Skip triangles entirely outside one of the side or far planes
+	const float* c0 = v0.Clip;
+	const float* c1 = v1.Clip;
+	const float* c2 = v2.Clip;
+	if ((c0[0] >  c0[3] && c1[0] >  c1[3] && c2[0] >  c2[3]) || (c0[0] < -c0[3] && c1[0] < -c1[3] && c2[0] < -c2[3]) ||
+	    (c0[1] >  c0[3] && c1[1] >  c1[3] && c2[1] >  c2[3]) || (c0[1] < -c0[3] && c1[1] < -c1[3] && c2[1] < -c2[3]) ||
+	    (c0[2] >  c0[3] && c1[2] >  c1[3] && c2[2] >  c2[3]))
+	{
+		return;
+	}
+	if (c0[2] >= 0.0f && c1[2] >= 0.0f && c2[2] >= 0.0f)
+	{
+		AddTriangle(&v0, &v1, &v2, draw, triangles);
+		return;
+	}
+
+	// Clip against the near plane, giving a polygon of up to four vertices. Depth only draws have no varyings to clip
+	const SShadedVertex* corners[3] = { &v0, &v1, &v2 };
+	SShadedVertex polygon[4];
+	unsigned int numPolygon = 0;
+	for (unsigned int corner = 0; corner < 3; corner++)
+	{
+		const SShadedVertex& a = *corners[corner];
+		const SShadedVertex& b = *corners[(corner + 1) % 3];
+		if (a.Clip[2] >= 0.0f)
+		{
+			polygon[numPolygon++] = a;
+		}
+		if ((a.Clip[2] >= 0.0f) != (b.Clip[2] >= 0.0f))
+		{
+			// Point where the edge from a to b crosses the plane
+			SShadedVertex& clipped = polygon[numPolygon++];
+			float t = a.Clip[2] / (a.Clip[2] - b.Clip[2]);
+			for (unsigned int i = 0; i < 4; i++)
+			{
+				clipped.Clip[i] = a.Clip[i] + (b.Clip[i] - a.Clip[i]) * t;
+			}
+			for (unsigned int i = 0; i < NumVaryings && !m_Shader.DepthOnly; i++)
+			{
+				clipped.Varyings[i] = a.Varyings[i] + (b.Varyings[i] - a.Varyings[i]) * t;
+			}
+		}
+	}
+	for (unsigned int corner = 2; corner < numPolygon; corner++)
+	{
+		AddTriangle(&polygon[0], &polygon[corner - 1], &polygon[corner], draw, triangles);
+	}
+}
+
+// Add a clip space triangle (already clipped against the near plane) to a list, if it faces the right way and covers any pixel
+// centres. Front faces are clockwise on screen, which with y down gives a positive area. Additive draws show both sides, so back
+// faces are turned round
+void CSoftwareBackend::AddTriangle(const SShadedVertex* v0, const SShadedVertex* v1, const SShadedVertex* v2, unsigned int draw,
+                                   vector<STriangle>& triangles)
+{
+	// Screen space, y down, pixel centres at half-pixel coordinates
+	const float halfWidth = 0.5f * static_cast<float>(m_ViewportWidth);
+	const float halfHeight = 0.5f * static_cast<float>(m_ViewportHeight);
+	const SShadedVertex* corners[3] = { v0, v1, v2 };
+	float xs[3], ys[3], zs[3], invWs[3];
+	for (unsigned int corner = 0; corner < 3; corner++)
+	{
+		const float* clip = corners[corner]->Clip;
+		invWs[corner] = 1.0f / clip[3];
+		xs[corner] = (clip[0] * invWs[corner] + 1.0f) * halfWidth;
+		ys[corner] = (1.0f - clip[1] * invWs[corner]) * halfHeight;
+		zs[corner] = clip[2] * invWs[corner];
+	}
+	float area = (xs[1] - xs[0]) * (ys[2] - ys[0]) - (xs[2] - xs[0]) * (ys[1] - ys[0]);
+	if (!(area < 0.0f) && !(area > 0.0f)) // Also catches NaN
+	{
+		return;
+	}
+	if (area < 0.0f)
+	{
+		if (!m_Shader.Additive)
+		{
+			return;
+		}
+		swap(corners[1], corners[2]);
+		swap(xs[1], xs[2]);
+		swap(ys[1], ys[2]);
+		swap(zs[1], zs[2]);
+		swap(invWs[1], invWs[2]);
+		area = -area;
+	}
+
+	// Pixels whose centres are inside the triangle's bounds
+	STriangle t;
+	float minX = min(xs[0], min(xs[1], xs[2])), maxX = max(xs[0], max(xs[1], xs[2]));
+	float minY = min(ys[0], min(ys[1], ys[2])), maxY = max(ys[0], max(ys[1], ys[2]));
+	t.MinX = static_cast<int>(max(ceilf(minX - 0.5f), 0.0f));
+	t.MaxX = static_cast<int>(min(floorf(maxX - 0.5f), static_cast<float>(m_RasterWidth - 1)));
+	t.MinY = static_cast<int>(max(ceilf(minY - 0.5f), 0.0f));
+	t.MaxY = static_cast<int>(min(floorf(maxY - 0.5f), static_cast<float>(m_RasterHeight - 1)));
+	if (t.MinX > t.MaxX || t.MinY > t.MaxY)
+	{
+		return;
+	}
+
+	// Edge from a to b is positive on the inside: (bx - ax)(y - ay) - (by - ay)(x - ax). Pixel centres exactly on an edge belong to
+	// the triangle if it is a left edge (inside increases with x) or a top edge (horizontal, inside below), so triangles sharing an
+	// edge draw each pixel once
+	for (unsigned int edge = 0; edge < 3; edge++)
+	{
+		unsigned int next = (edge + 1) % 3;
+		t.EdgeA[edge] = ys[edge] - ys[next];
+		t.EdgeB[edge] = xs[next] - xs[edge];
+		t.EdgeC[edge] = (ys[next] - ys[edge]) * xs[edge] - (xs[next] - xs[edge]) * ys[edge];
+		t.EdgeInclusive[edge] = t.EdgeA[edge] > 0.0f || (t.EdgeA[edge] == 0.0f && t.EdgeB[edge] > 0.0f);
+	}
+
+	// Depth and 1 / w are linear in screen space, as is each varying divided by w
+	const float invArea = 1.0f / area;
+	ComputePlane(xs, ys, zs[0], zs[1], zs[2], invArea, &t.DepthA, &t.DepthB, &t.DepthC);
+	ComputePlane(xs, ys, invWs[0], invWs[1], invWs[2], invArea, &t.InvWA, &t.InvWB, &t.InvWC);
+	if (!m_Shader.DepthOnly)
+	{
+		for (unsigned int i = 0; i < NumVaryings; i++)
+		{
+			ComputePlane(xs, ys, corners[0]->Varyings[i] * invWs[0], corners[1]->Varyings[i] * invWs[1],
+			             corners[2]->Varyings[i] * invWs[2], invArea, &t.VaryingA[i], &t.VaryingB[i], &t.VaryingC[i]);
+		}
+	}
+	t.Draw = draw;
+	triangles.push_back(t);
+}
+
+// Add a triangle to the bins of the tiles it touches - a tile is skipped if all its pixel centres are outside one of the edges
+void CSoftwareBackend::BinTriangle(unsigned int triangle)
+{
+	const STriangle& t = m_Triangles[triangle];
+	for (unsigned int tileY = t.MinY / kSoftwareTileSize; tileY <= t.MaxY / kSoftwareTileSize; tileY++)
+	{
+		float top = static_cast<float>(tileY * kSoftwareTileSize) + 0.5f;
+		float bottom = static_cast<float>(min((tileY + 1) * kSoftwareTileSize, m_RasterHeight)) - 0.5f;
+		for (unsigned int tileX = t.MinX / kSoftwareTileSize; tileX <= t.MaxX / kSoftwareTileSize; tileX++)
+		{
+			float left = static_cast<float>(tileX * kSoftwareTileSize) + 0.5f;
+			float right = static_cast<float>(min((tileX + 1) * kSoftwareTileSize, m_RasterWidth)) - 0.5f;
+			bool outside = false;
+			for (unsigned int edge = 0; edge < 3 && !outside; edge++)
+			{
+				// Pixel centre of the tile furthest inside the edge
+				float x = (t.EdgeA[edge] >= 0.0f) ? right : left;
+				float y = (t.EdgeB[edge] >= 0.0f) ? bottom : top;
+				outside = t.EdgeA[edge] * x + t.EdgeB[edge] * y + t.EdgeC[edge] < 0.0f;
+			}
+			if (!outside)
+			{
+				m_Bins[tileY * m_TilesX + tileX].push_back(triangle);
+				m_Stats.TrianglesBinned++;
+			}
+		}
+	}
+}
+
+// Rasterise the triangles waiting in the bins, one job per tile, then empty them
+void CSoftwareBackend::Flush()
+{
+	if (!m_Triangles.empty())
+	{
+		CTimer timer;
+		timer.Start();
+		unsigned int numTiles = m_TilesX * m_TilesY;
+		m_TilePixels.assign(numTiles, 0);
+		m_Jobs->ParallelFor(numTiles, 1, [this](gen::TUInt32 first, gen::TUInt32 end)
+		{
+			for (gen::TUInt32 tile = first; tile < end; tile++)
+			{
+				RasteriseTile(tile);
+			}
+		});
+		for (unsigned int tile = 0; tile < numTiles; tile++)
+		{
+			m_Stats.PixelsShaded += m_TilePixels[tile];
+			m_Bins[tile].clear();
+		}
+		m_Triangles.clear();
+		m_Stats.RasteriseTime += timer.GetTime();
+	}
+	m_DrawStates.clear();
+	m_PixelConstants.clear();
+	m_PixelConstantsChanged = true;
+}
+
+// Rasterise the triangles in one tile's bin in order. Four pixels of a row are tested against the edges and depth at once, then
+// those passing are shaded one at a time
+void CSoftwareBackend::RasteriseTile(unsigned int tile)
+{
+	const int tileLeft = static_cast<int>((tile % m_TilesX) * kSoftwareTileSize);
+	const int tileTop = static_cast<int>((tile / m_TilesX) * kSoftwareTileSize);
+	const int tileRight = min(tileLeft + static_cast<int>(kSoftwareTileSize), static_cast<int>(m_RasterWidth)) - 1;
+	const int tileBottom = min(tileTop + static_cast<int>(kSoftwareTileSize), static_cast<int>(m_RasterHeight)) - 1;
+
+	const __m128 columnOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f); // Pixel centres of four columns
+	const __m128 columnIndices = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+	const __m128 zero = _mm_setzero_ps();
+	gen::TUInt64 pixelsShaded = 0;
+
+	const vector<unsigned int>& bin = m_Bins[tile];
+	for (unsigned int i = 0; i < bin.size(); i++)
+	{
+		const STriangle& t = m_Triangles[bin[i]];
+		const SDrawState& draw = m_DrawStates[t.Draw];
+		const bool depthWrite = !draw.Shader.Additive;
+		const int minX = max(t.MinX, tileLeft), maxX = min(t.MaxX, tileRight);
+		const int minY = max(t.MinY, tileTop), maxY = min(t.MaxY, tileBottom);
+		if (minX > maxX || minY > maxY)
+		{
+			continue;
+		}
+
+		// Rows are processed in groups of four columns from a multiple of four, the columns outside the triangle's bounds masked
+		const int startX = minX & ~3;
+		const __m128 firstColumn = _mm_set1_ps(static_cast<float>(minX));
+		const __m128 lastColumn = _mm_set1_ps(static_cast<float>(maxX));
+		const __m128 edgeA0 = _mm_set1_ps(t.EdgeA[0]);
+		const __m128 edgeA1 = _mm_set1_ps(t.EdgeA[1]);
+		const __m128 edgeA2 = _mm_set1_ps(t.EdgeA[2]);
+		const __m128 depthA = _mm_set1_ps(t.DepthA);
+		for (int y = minY; y <= maxY; y++)
+		{
+			const float pixelY = static_cast<float>(y) + 0.5f;
+			const __m128 rowEdge0 = _mm_set1_ps(t.EdgeB[0] * pixelY + t.EdgeC[0]);
+			const __m128 rowEdge1 = _mm_set1_ps(t.EdgeB[1] * pixelY + t.EdgeC[1]);
+			const __m128 rowEdge2 = _mm_set1_ps(t.EdgeB[2] * pixelY + t.EdgeC[2]);
+			const __m128 rowDepth = _mm_set1_ps(t.DepthB * pixelY + t.DepthC);
+			float* depthRow = m_Target.Depth + y * m_Target.Pitch;
+			unsigned int* colourRow = m_Target.Colour ? m_Target.Colour + y * m_Target.Pitch : NULL;
+
+			for (int x = startX; x <= maxX; x += 4)
+			{
+				const __m128 column = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), columnIndices);
+				const __m128 pixelX = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), columnOffsets);
+				__m128 pass = _mm_and_ps(_mm_cmpge_ps(column, firstColumn), _mm_cmple_ps(column, lastColumn));
+
+				// Inside all three edges, pixel centres on an edge only counting for top and left edges
+				__m128 edge = _mm_add_ps(_mm_mul_ps(edgeA0, pixelX), rowEdge0);
+				pass = _mm_and_ps(pass, t.EdgeInclusive[0] ? _mm_cmpge_ps(edge, zero) : _mm_cmpgt_ps(edge, zero));
+				edge = _mm_add_ps(_mm_mul_ps(edgeA1, pixelX), rowEdge1);
+				pass = _mm_and_ps(pass, t.EdgeInclusive[1] ? _mm_cmpge_ps(edge, zero) : _mm_cmpgt_ps(edge, zero));
+				edge = _mm_add_ps(_mm_mul_ps(edgeA2, pixelX), rowEdge2);
+				pass = _mm_and_ps(pass, t.EdgeInclusive[2] ? _mm_cmpge_ps(edge, zero) : _mm_cmpgt_ps(edge, zero));
+				if (!_mm_movemask_ps(pass))
+				{
+					continue;
+				}
+
+				// Nearer than the depth buffer
+				const __m128 depth = _mm_add_ps(_mm_mul_ps(depthA, pixelX), rowDepth);
+				const __m128 oldDepth = _mm_load_ps(depthRow + x);
+				pass = _mm_and_ps(pass, _mm_cmplt_ps(depth, oldDepth));
+				const int mask = _mm_movemask_ps(pass);
+				if (!mask)
+				{
+					continue;
+				}
+				pixelsShaded += LaneCounts[mask];
+
+				// Depth only into a depth texture needs no pixel shader
+				if (draw.Shader.DepthOnly && !colourRow)
+				{
+					if (depthWrite)
+					{
+						_mm_store_ps(depthRow + x, _mm_or_ps(_mm_and_ps(pass, depth), _mm_andnot_ps(pass, oldDepth)));
+					}
+					continue;
+				}
+
+				float depths[4];
+				_mm_storeu_ps(depths, depth);
+				for (int lane = 0; lane < 4; lane++)
+				{
+					if (!(mask & (1 << lane)))
+					{
+						continue;
+					}
+
+					// Perspective correct varyings from their planes divided by the plane of 1 / w
+					float colour[4];
+					if (draw.Shader.DepthOnly)
+					{
+						colour[0] = colour[1] = colour[2] = colour[3] = depths[lane];
+					}
+					else
+					{
+						const float px = static_cast<float>(x + lane) + 0.5f;
+						const float w = 1.0f / (t.InvWA * px + t.InvWB * pixelY + t.InvWC);
+						float varyings[NumVaryings];
+						for (unsigned int v = 0; v < NumVaryings; v++)
+						{
+							varyings[v] = (t.VaryingA[v] * px + t.VaryingB[v] * pixelY + t.VaryingC[v]) * w;
+						}
+						if (!ShadePixel(draw, varyings, colour))
+						{
+							continue;
+						}
+					}
+
+					if (depthWrite)
+					{
+						depthRow[x + lane] = depths[lane];
+					}
+					if (colourRow)
+					{
+						unsigned int& pixel = colourRow[x + lane];
+						if (draw.Shader.Additive)
+						{
+							// Source and destination added, as AdditiveBlending - alpha is the source's
+							for (unsigned int c = 0; c < 3; c++)
+							{
+								colour[c] += static_cast<float>((pixel >> (c * 8)) & 0xff) / 255.0f;
+							}
+						}
+						pixel = PackColour(colour);
+					}
+				}
+			}
+		}
+	}
+	m_TilePixels[tile] = pixelsShaded;
+}
+
+// Run the pixel shader for one pixel, as MainPixel does in the effect file. Returns false if the pixel is discarded
+bool CSoftwareBackend::ShadePixel(const SDrawState& draw, const float* varyings, float colour[4])
+{
+	const SShader& shader = draw.Shader;
+	const SPixelConstants& constants = *draw.Constants;
+
+	float u = varyings[VaryingU];
+	float v = varyings[VaryingV];
+	if (shader.Wiggle)
+	{
+		u += constants.Frame.Wiggle / 200;
+		v += constants.Frame.Wiggle / 200;
+	}
+
+	float textureColour[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	if (draw.DiffuseMap)
+	{
+		SampleTexture(*draw.DiffuseMap, u, v, textureColour);
+		if (shader.AlphaCutout && textureColour[3] < 0.5f)
+		{
+			return false;
+		}
+	}
+
+	if (shader.Lighting)
+	{
+		D3DXVECTOR3 worldPos(varyings[VaryingWorldX], varyings[VaryingWorldY], varyings[VaryingWorldZ]);
+		D3DXVECTOR3 worldNormal(varyings[VaryingNormalX], varyings[VaryingNormalY], varyings[VaryingNormalZ]);
+		D3DXVec3Normalize(&worldNormal, &worldNormal);
+		D3DXVECTOR3 cameraDir = constants.Frame.CameraPosition - worldPos;
+		D3DXVec3Normalize(&cameraDir, &cameraDir);
+
+		D3DXVECTOR3 diffuseLight = constants.LightSet.AmbientColour;
+		D3DXVECTOR3 specularLight(0.0f, 0.0f, 0.0f);
+		float specularPower = constants.Material.SpecularPower;
+		for (unsigned int i = 0; i < kNumPointLightConstants; i++)
+		{
+			const SPointLightConstants& light = constants.LightSet.PointLights[i];
+			D3DXVECTOR3 lightDir = light.Position - worldPos;
+			float lightDist = D3DXVec3Length(&lightDir);
+			AddLight(light, lightDir / lightDist, lightDist, worldNormal, cameraDir, specularPower, &diffuseLight, &specularLight);
+		}
+
+		for (unsigned int j = 0; j < kNumSpotLightConstants; j++)
+		{
+			const SSpotLightConstants& spotLight = constants.LightSet.SpotLights[j];
+			D3DXVECTOR3 lightDir = spotLight.Light.Position - worldPos;
+			float lightDist = D3DXVec3Length(&lightDir);
+			lightDir /= lightDist;
+
+			// Only pixels inside the cone of the spotlight are lit by it
+			D3DXVECTOR3 facing;
+			D3DXVec3Normalize(&facing, &spotLight.FacingVector);
+			D3DXVECTOR3 toPixel = -lightDir;
+			if (spotLight.CosHalfAngle < D3DXVec3Dot(&facing, &toPixel))
+			{
+				// In shadow if something nearer to the light is in its shadow map - texture coordinates and depth worked out exactly
+				// as InShadow does
+				bool inShadow = false;
+				if (draw.ShadowMap)
+				{
+					float lightViewPos[4], lightProjPos[4];
+					Transform(spotLight.ViewMatrix, worldPos.x, worldPos.y, worldPos.z, 1.0f, lightViewPos);
+					Transform(spotLight.ProjMatrix, lightViewPos[0], lightViewPos[1], lightViewPos[2], lightViewPos[3], lightProjPos);
+					float shadowU = 0.5f * lightProjPos[0] / (lightProjPos[3] + 0.5f);
+					float shadowV = 1.0f - 0.5f * lightProjPos[1] / (lightProjPos[3] + 0.5f);
+					float depthFromLight = lightProjPos[2] / lightProjPos[3] - 0.0005f;
+					inShadow = depthFromLight >= SampleDepth(*draw.ShadowMap, shadowU, shadowV);
+				}
+				if (!inShadow)
+				{
+					AddLight(spotLight.Light, lightDir, lightDist, worldNormal, cameraDir, specularPower, &diffuseLight,
+					         &specularLight);
+				}
+			}
+		}
+
+		// Specular material in the texture's alpha channel
+		colour[0] = textureColour[0] * diffuseLight.x + textureColour[3] * specularLight.x;
+		colour[1] = textureColour[1] * diffuseLight.y + textureColour[3] * specularLight.y;
+		colour[2] = textureColour[2] * diffuseLight.z + textureColour[3] * specularLight.z;
+		colour[3] = 1.0f;
+	}
+	else
+	{
+		// Texture colour, or white for the model colour alone
+		for (unsigned int c = 0; c < 4; c++)
+		{
+			colour[c] = textureColour[c];
+		}
+	}
+
+	if (shader.ModelColour)
+	{
+		colour[0] *= varyings[VaryingColourR];
+		colour[1] *= varyings[VaryingColourG];
+		colour[2] *= varyings[VaryingColourB];
+	}
+	if (shader.AlphaCutout)
+	{
+		for (unsigned int c = 0; c < 4; c++)
+		{
+			colour[c] *= 0.5f;
+		}
+	}
+	return true;
+}
+
+// Sample a texture bilinearly with wrapping - texel centres are at half-texel coordinates
+void CSoftwareBackend::SampleTexture(const STexture& texture, float u, float v, float colour[4])
+{
+	float x = u * static_cast<float>(texture.Width) - 0.5f;
+	float y = v * static_cast<float>(texture.Height) - 0.5f;
+	if (!(x == x) || !(y == y)) // NaN
+	{
+		x = y = 0.0f;
+	}
+	float floorX = floorf(x), floorY = floorf(y);
+	float fracX = x - floorX, fracY = y - floorY;
+	int width = static_cast<int>(texture.Width), height = static_cast<int>(texture.Height);
+	int x0 = static_cast<int>(fmodf(floorX, static_cast<float>(width)));
+	int y0 = static_cast<int>(fmodf(floorY, static_cast<float>(height)));
+	if (x0 < 0)  x0 += width;
+	if (y0 < 0)  y0 += height;
+	int x1 = (x0 + 1 < width) ? x0 + 1 : 0;
+	int y1 = (y0 + 1 < height) ? y0 + 1 : 0;
+
+	unsigned int texels[4] = { texture.Texels[y0 * width + x0], texture.Texels[y0 * width + x1],
+	                           texture.Texels[y1 * width + x0], texture.Texels[y1 * width + x1] };
+	float weights[4] = { (1.0f - fracX) * (1.0f - fracY), fracX * (1.0f - fracY), (1.0f - fracX) * fracY, fracX * fracY };
+	for (unsigned int c = 0; c < 4; c++)
+	{
+		float value = 0.0f;
+		for (unsigned int texel = 0; texel < 4; texel++)
+		{
+			value += weights[texel] * static_cast<float>((texels[texel] >> (c * 8)) & 0xff);
+		}
+		colour[c] = value / 255.0f;
+	}
+}
+
+// Point sample the depth of a depth texture with clamping
+float CSoftwareBackend::SampleDepth(const STexture& texture, float u, float v)
+{
+	float x = u * static_cast<float>(texture.Width);
+	float y = v * static_cast<float>(texture.Height);
+	x = (x > 0.0f) ? min(x, static_cast<float>(texture.Width - 1)) : 0.0f; // Also turns NaN into 0
+	y = (y > 0.0f) ? min(y, static_cast<float>(texture.Height - 1)) : 0.0f;
+	return texture.Depths[static_cast<unsigned int>(y) * texture.DepthPitch + static_cast<unsigned int>(x)];
+}
+
+// Select the back buffer or a depth texture as the target rendered to
+void CSoftwareBackend::SelectTarget(STexture* depthTexture)
+{
+	m_TargetTexture = depthTexture;
+	if (depthTexture && !depthTexture->Depths.empty())
+	{
+		m_Target.Width = depthTexture->Width;
+		m_Target.Height = depthTexture->Height;
+		m_Target.Pitch = depthTexture->DepthPitch;
+		m_Target.Colour = NULL;
+		m_Target.Depth = &depthTexture->Depths[0];
+	}
+	else if (!depthTexture && !m_BackBuffer.empty())
+	{
+		m_Target.Width = m_Width;
+		m_Target.Height = m_Height;
+		m_Target.Pitch = m_Pitch;
+		m_Target.Colour = &m_BackBuffer[0];
+		m_Target.Depth = &m_DepthBuffer[0];
+	}
+	else
+	{
+		memset(&m_Target, 0, sizeof(m_Target));
+	}
+}
+
+// The viewport within the target, in whole tiles. Only call with no triangles waiting
+void CSoftwareBackend::UpdateRasterArea()
+{
+	m_RasterWidth = min(m_ViewportWidth, m_Target.Width);
+	m_RasterHeight = min(m_ViewportHeight, m_Target.Height);
+	m_TilesX = (m_RasterWidth + kSoftwareTileSize - 1) / kSoftwareTileSize;
+	m_TilesY = (m_RasterHeight + kSoftwareTileSize - 1) / kSoftwareTileSize;
+	m_Bins.resize(m_TilesX * m_TilesY);
+}
@@ -0,0 +1,360 @@
+//--------------------------------------------------------------------------------------
+//	SoftwareBackend.h
+//
+//	The software backend renders the frame on the CPU - a tiled rasteriser running the
+//	core techniques of GraphicsAssign1.fx in C++, for reference images and CPU timings
+//	on machines without a GPU
+//--------------------------------------------------------------------------------------
+
+#ifndef SOFTWARE_BACKEND_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define SOFTWARE_BACKEND_H_INCLUDED
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+using namespace std;
+
+#include "Defines.h"
+#include "RenderBackend.h"
+#include "ShaderConstants.h"
+#include "ImageFile.h"
+#include "CJobSystem.h"
+#include "AlignedAllocator.h"
+
+// The shaders of GraphicsAssign1.fx are followed line by line for the plain colour, texture, tint, wiggle, additive, alpha cutout
+// and pixel lighting features - the three point lights and the spotlight, with its shadow map compared exactly as InShadow does -
+// and for the depth only technique used for shadow maps. Normal and parallax mapping and cel and noir shading are lit with the
+// vertex normal as PixDiffSpec is, and the outline pass is skipped, so techniques using them give an approximate image
+//
+// Each draw is processed as it is given: its vertices are shaded in parallel (instanced draws read the instance buffer then, so it
+// can be mapped again for the next batch), then its triangles are clipped against the near plane, culled and set up in parallel,
+// and finally binned in order into 64x64 pixel tiles. Pixels are only rasterised when the render target is needed - before it is
+// changed, cleared, read, or presented, or a texture in use is released - with one job per tile. Each tile draws its triangles in
+// the order given, so blending and equal depths come out as on a GPU, and no two jobs touch the same pixels. Within a tile, edge
+// functions and the depth test are evaluated four pixels at a time with SSE, as in COcclusionBuffer; pixels passing are shaded one
+// by one with perspective correct attributes
+//
+// Textures are decoded from the same files as the D3D10 backend loads (see ImageFile.h) and sampled bilinearly with wrapping, from
+// the top mip level only - minified textures shimmer where a GPU would use the mip chain. The back buffer is RGBA with 8 bits per
+// channel and a float depth buffer, both padded to whole tiles
+
+// Size of the tiles triangles are binned into
+const unsigned int kSoftwareTileSize = 64;
+
+// Counts and times since the backend was created or the stats were reset
+struct SSoftwareRenderStats
+{
+	unsigned int Frames;           // Frames ended by Present
+	unsigned int Draws;            // Draw calls rendered (outline passes are not)
+	unsigned int Vertices;         // Vertices shaded, each instance counted
+	unsigned int Triangles;        // Triangles given to setup
+	unsigned int TrianglesBinned;  // Triangles added to tiles, a triangle counted once for each tile it touches
+	gen::TUInt64 PixelsShaded;     // Pixels passing the depth test, including discarded ones
+	float        GeometryTime;     // Seconds spent in vertex shading, setup and binning
+	float        RasteriseTime;    // Seconds spent rasterising and shading pixels
+};
+
+class CSoftwareBackend : public CRenderBackend
+{
+/////////////////////////////
+// Private types
+private:
+
+	// Values interpolated across triangles, in the order of the pixel shader inputs
+	enum EVarying
+	{
+		VaryingU, VaryingV,
+		VaryingColourR, VaryingColourG, VaryingColourB,
+		VaryingWorldX, VaryingWorldY, VaryingWorldZ,
+		VaryingNormalX, VaryingNormalY, VaryingNormalZ,
+		NumVaryings
+	};
+
+	struct SBuffer
+	{
+		EBufferType           Type;
+		vector<unsigned char> Contents;
+		unsigned int          RefCount;
+	};
+
+	// Image textures hold RGBA texels, depth textures hold depths and are rendered to, with a size padded to whole tiles
+	struct STexture
+	{
+		unsigned int Width;
+		unsigned int Height;
+		vector<unsigned int> Texels;
+		vector<float, gen::CAlignedAllocator<float> > Depths;
+		unsigned int         DepthPitch; // Floats from one row of depths to the next
+		unsigned int         RefCount;
+	};
+
+	// Byte offsets of the vertex elements the vertex shader reads, in the vertex buffer and (if instanced) the instance buffer
+	struct SLayout
+	{
+		unsigned int PositionOffset;
+		unsigned int NormalOffset;
+		unsigned int UVOffset;
+		bool         Instanced;
+		unsigned int WorldOffsets[4];
+		unsigned int ColourOffset;
+	};
+
+	// What a technique pass does, from its features
+	struct SShader
+	{
+		bool Draw;        // False for passes not rendered in software (outlines)
+		bool DepthOnly;
+		bool Texture;
+		bool ModelColour; // Colour multiplied by the model or instance colour
+		bool Lighting;
+		bool Shadows;
+		bool Wiggle;
+		bool AlphaCutout;
+		bool Additive;    // Additive blending, both sides drawn, no depth writes
+	};
+
+	// Pixel shader constants, copied for each draw they are used by since pixels are shaded after the constants have moved on
+	struct SPixelConstants
+	{
+		SPerFrameConstants    Frame;
+		SPerLightSetConstants LightSet;
+		SPerMaterialConstants Material;
+	};
+
+	// Everything the pixels of a draw need
+	struct SDrawState
+	{
+		SShader                Shader;
+		const STexture*        DiffuseMap;
+		const STexture*        ShadowMap;
+		const SPixelConstants* Constants;
+	};
+
+	// A vertex after the vertex shader - clip space position and the values to interpolate
+	struct SShadedVertex
+	{
+		float Clip[4];
+		float Varyings[NumVaryings];
+	};
+
+	// A screen space triangle ready to rasterise: its pixel bounds, the three edge functions (positive inside), and planes for z / w,
+	// 1 / w and each varying / w, all as a * x + b * y + c for pixel centre x, y. Varying planes are not set for depth only draws
+	struct STriangle
+	{
+		int          MinX, MaxX, MinY, MaxY;
+		float        EdgeA[3], EdgeB[3], EdgeC[3];
+		bool         EdgeInclusive[3]; // Top and left edges own the pixel centres exactly on them
+		float        DepthA, DepthB, DepthC;
+		float        InvWA, InvWB, InvWC;
+		float        VaryingA[NumVaryings], VaryingB[NumVaryings], VaryingC[NumVaryings];
+		unsigned int Draw; // Index into the draw states
+	};
+
+	// The current render target - the back buffer or a depth texture, as memory padded to whole tiles
+	struct STarget
+	{
+		unsigned int  Width;
+		unsigned int  Height;
+		unsigned int  Pitch;  // Pixels from one row to the next
+		unsigned int* Colour; // NULL for depth textures
+		float*        Depth;
+	};
+
+
+/////////////////////////////
+// Private member variables
+private:
+
+	unsigned int m_Width;
+	unsigned int m_Height;
+	unsigned int m_Pitch;
+	vector<unsigned int>                          m_BackBuffer;
+	vector<float, gen::CAlignedAllocator<float> > m_DepthBuffer;
+
+	gen::CJobSystem* m_Jobs;
+
+	// Layouts by hash of their vertex elements and whether they are instanced, owned by the backend
+	map<gen::TUInt64, SLayout*> m_Layouts;
+
+	// Current pipeline state
+	SBuffer*     m_VertexBuffers[2]; // Vertex data in slot 0, instance data in slot 1
+	unsigned int m_VertexStrides[2];
+	unsigned int m_VertexOffsets[2];
+	SLayout*     m_Layout;
+	SBuffer*     m_IndexBuffer;
+	DXGI_FORMAT  m_IndexFormat;
+	unsigned int m_IndexOffset;
+	D3D10_PRIMITIVE_TOPOLOGY m_Topology;
+	STexture*    m_Textures[NumTextureSlots];
+	SShader      m_Shader;
+
+	// Current constants, and copies of the pixel constants for the draws waiting to be rasterised (a deque so they never move)
+	SPerFrameConstants      m_Frame;
+	SPerLightSetConstants   m_LightSet;
+	SPerMaterialConstants   m_Material;
+	SPerObjectConstants     m_Object;
+	deque<SPixelConstants>  m_PixelConstants;
+	bool                    m_PixelConstantsChanged; // Since the last copy
+
+	// Render target and viewport
+	STexture*    m_TargetTexture; // NULL for the back buffer
+	STarget      m_Target;
+	unsigned int m_ViewportWidth;
+	unsigned int m_ViewportHeight;
+	unsigned int m_RasterWidth;  // Pixels rendered to - the viewport within the target
+	unsigned int m_RasterHeight;
+
+	// Work for the current draw, kept to reuse the memory
+	vector<SShadedVertex>     m_ShadedVertices;
+	vector<vector<STriangle> > m_SetupTriangles; // One list for each setup job
+
+	// Triangles waiting to be rasterised, the list of triangles touching each tile, and the pixels shaded by each tile's job
+	vector<SDrawState>           m_DrawStates;
+	vector<STriangle>            m_Triangles;
+	unsigned int                 m_TilesX;
+	unsigned int                 m_TilesY;
+	vector<vector<unsigned int> > m_Bins;
+	vector<gen::TUInt64>         m_TilePixels;
+
+	SSoftwareRenderStats m_Stats;
+
+	// Layouts and the job system are owned by the backend, so it is not copied
+	CSoftwareBackend(const CSoftwareBackend&);
+	CSoftwareBackend& operator=(const CSoftwareBackend&);
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	///////////////////////////////
+	// Constructors / Destructors
+
+	CSoftwareBackend();
+	~CSoftwareBackend();
+
+	// Create the back buffer and depth buffer of the given size and the worker threads (0 = one per hardware thread), and select
+	// the back buffer for rendering. Returns false on failure
+	bool Create(unsigned int width, unsigned int height, unsigned int numThreads = 0);
+
+	// Release everything created by the backend, after the rendering code has released its buffers and textures
+	void Release();
+
+
+	/////////////////////////////
+	// Threads, stats and output
+
+	// Change the number of threads rendering (0 = one per hardware thread), for comparing timings
+	void SetNumThreads(unsigned int numThreads);
+	unsigned int GetNumThreads()
+	{
+		return m_Jobs ? m_Jobs->GetNumThreads() : 0;
+	}
+
+	const SSoftwareRenderStats& GetStats()
+	{
+		return m_Stats;
+	}
+	void ResetStats();
+
+	// Copy the back buffer into an image, finishing any draws first
+	void GetBackBuffer(SImage* image);
+
+	// Write the back buffer, or a depth texture as greyscale, to a BMP file. Returns false if the file can't be written
+	bool WriteBackBuffer(const string& fileName);
+	bool WriteDepthTexture(TTextureHandle texture, const string& fileName);
+
+
+	/////////////////////////////
+	// Buffers
+
+	TBufferHandle CreateBuffer(EBufferType type, unsigned int size, const void* data);
+	void AddRef(TBufferHandle buffer);
+	void Release(TBufferHandle buffer);
+	void* Map(TBufferHandle buffer);
+	void Unmap(TBufferHandle buffer);
+
+
+	/////////////////////////////
+	// Textures
+
+	TTextureHandle LoadTexture(const string& fileName);
+	TTextureHandle CreateDepthTexture(unsigned int width, unsigned int height);
+	void AddRef(TTextureHandle texture);
+	void Release(TTextureHandle texture);
+
+
+	/////////////////////////////
+	// Pipeline state
+
+	TLayoutHandle GetInputLayout(const D3D10_INPUT_ELEMENT_DESC* elements, unsigned int numElements, CTechnique* technique,
+	                             bool instanced);
+	void SetVertexBuffer(TBufferHandle buffer, unsigned int stride, unsigned int offset, unsigned int slot);
+	void SetInputLayout(TLayoutHandle layout);
+	void SetIndexBuffer(TBufferHandle buffer, DXGI_FORMAT format, unsigned int offset);
+	void SetTopology(D3D10_PRIMITIVE_TOPOLOGY topology);
+	void SetTexture(ETextureSlot slot, TTextureHandle texture);
+	void ApplyPass(CTechnique* technique, unsigned int pass, bool instanced);
+
+
+	/////////////////////////////
+	// Constants
+
+	bool UpdateConstants(EConstantGroup group, const void* data, unsigned int size);
+
+
+	/////////////////////////////
+	// Render targets and draws
+
+	void SetRenderTarget(TTextureHandle depthTexture);
+	void SetViewport(unsigned int width, unsigned int height);
+	void ClearColour(const float colour[4]);
+	void ClearDepth();
+	void DrawIndexed(unsigned int numIndices);
+	void DrawIndexedInstanced(unsigned int numIndices, unsigned int numInstances);
+	void Present();
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	// Shade the vertices and set up and bin the triangles of a draw
+	void Draw(unsigned int numIndices, unsigned int numInstances, bool instanced);
+
+	// Run the vertex shader on one vertex of a draw
+	void ShadeVertex(const unsigned char* vertex, const unsigned char* instance, SShadedVertex* shaded);
+
+	// Clip a triangle against the near plane and add what is left to a list, if it faces the right way and covers any pixel centres
+	// Front faces are clockwise on screen. Used by several jobs at once, so only reads the backend's state
+	void SetupTriangle(const SShadedVertex& v0, const SShadedVertex& v1, const SShadedVertex& v2, unsigned int draw,
+	                   vector<STriangle>& triangles);
+	void AddTriangle(const SShadedVertex* v0, const SShadedVertex* v1, const SShadedVertex* v2, unsigned int draw,
+	                 vector<STriangle>& triangles);
+
+	// Add a triangle to the bins of the tiles it touches
+	void BinTriangle(unsigned int triangle);
+
+	// Rasterise the triangles waiting in the bins, then empty them
+	void Flush();
+	void RasteriseTile(unsigned int tile);
+
+	// Run the pixel shader for one pixel. Returns false if the pixel is discarded
+	static bool ShadePixel(const SDrawState& draw, const float* varyings, float colour[4]);
+
+	// Sample a texture bilinearly with wrapping, as TrilinearWrap does at the top mip level, giving RGBA from 0 to 1
+	static void SampleTexture(const STexture& texture, float u, float v, float colour[4]);
+
+	// Point sample the depth of a depth texture with clamping, as PointSampleClamp does
+	static float SampleDepth(const STexture& texture, float u, float v);
+
+	// Select the back buffer or a depth texture as the target rendered to
+	void SelectTarget(STexture* depthTexture);
+
+	// Work out the pixels and tiles rendered to from the target and viewport. Only call with no triangles waiting
+	void UpdateRasterArea();
+};
+
+
+#endif // End of header guard - see top of file
@@ -1,132 +1,139 @@
 #include "SpotLight.h"
+#include "MathDX.h" // Conversions between math classes and DirectX types
 
 unsigned int CSpotLight::m_ShadowMapSize = 1024;
 
 CSpotLight::CSpotLight(D3DXVECTOR3 diffuseColour, D3DXVECTOR3 specularColour,
 	D3DXVECTOR3 position, float coneAngle, float scale) :
 	CPositionalLight(diffuseColour, specularColour, position, scale, false),
-	m_ConeAngleVar(NULL),
-	m_FacingVectorVar(NULL),
-	m_ViewMatrixVar(NULL),
-	m_ProjMatrixVar(NULL),
-	m_ViewProjMatrixVar(NULL),
-	m_ShadowMapVar(NULL),
-	m_ShadowMapTexture(NULL),
-	m_ShadowMapDepthView(NULL),
-	m_ShadowMap(NULL)
+	m_ConeAngle(coneAngle),
+	m_SpotConstants(NULL),
+	m_ViewMatrixVersion(0),
+	m_ViewDirty(true),
+	m_ProjDirty(true),
+	m_ShadowMap(NULL),
+	m_ShadowMapValid(false),
+	m_ShadowMapSkipped(false)
 {
 }
 
-void CSpotLight::SetConeAngleVar(ID3D10EffectScalarVariable* coneAngleVar)
+void CSpotLight::SetConstants(SSpotLightConstants* constants)
 {
-	m_ConeAngleVar = coneAngleVar;
-}
-void CSpotLight::SetFacingVectorVar(ID3D10EffectVectorVariable* facingVectorVar)
-{
-	m_FacingVectorVar = facingVectorVar;
-}
-void CSpotLight::SetViewMatrixVar(ID3D10EffectMatrixVariable* viewMatrixVar)
-{
-	m_ViewMatrixVar = viewMatrixVar;
-}
-void CSpotLight::SetProjMatrixVar(ID3D10EffectMatrixVariable*  projMatrixVar)
-{
-	m_ProjMatrixVar = projMatrixVar;
-}
-void CSpotLight::SetViewProjMatrixVar(ID3D10EffectMatrixVariable* viewProjMatrixVar)
-{
-	m_ViewProjMatrixVar = viewProjMatrixVar;
-}
-void CSpotLight::SetShadowMapVar(ID3D10EffectShaderResourceVariable* shadowMapVar)
-{
-	m_ShadowMapVar = shadowMapVar;
+	CPositionalLight::SetConstants(&constants->Light);
+	m_SpotConstants = constants;
 }
 
 CSpotLight::~CSpotLight()
 {
-	if (m_ShadowMap)			m_ShadowMap->Release();
-	if (m_ShadowMapDepthView)	m_ShadowMapDepthView->Release();
-	if (m_ShadowMapTexture)		m_ShadowMapTexture->Release();
+	BACKEND_RELEASE(m_ShadowMap);
 }
 
-bool CSpotLight::CreateShadowMap(ID3D10Device* Device)
+bool CSpotLight::CreateShadowMap()
 {
-	D3D10_TEXTURE2D_DESC texDesc;
-	texDesc.Width = m_ShadowMapSize; // Size of the shadow map determines quality / resolution of shadows
-	texDesc.Height = m_ShadowMapSize;
-	texDesc.MipLevels = 1; // 1 level, means just the main texture, no additional mip-maps. Usually don't use mip-maps when rendering to textures (or we would have to render every level)
-	texDesc.ArraySize = 1;
-	texDesc.Format = DXGI_FORMAT_R32_TYPELESS; // The shadow map contains a single 32-bit value [tech gotcha: have to say typeless because depth buffer and texture see things slightly differently]
-	texDesc.SampleDesc.Count = 1;
-	texDesc.SampleDesc.Quality = 0;
-	texDesc.Usage = D3D10_USAGE_DEFAULT;
-	texDesc.BindFlags = D3D10_BIND_DEPTH_STENCIL | D3D10_BIND_SHADER_RESOURCE; // Indicate we will use texture as render target, and will also pass it to shaders
-	texDesc.CPUAccessFlags = 0;
-	texDesc.MiscFlags = 0;
-	if (FAILED(Device->CreateTexture2D(&texDesc, NULL, &m_ShadowMapTexture))) return false;
-
-	// Create the depth stencil view, i.e. indicate that the texture just created is to be used as a depth buffer
-	D3D10_DEPTH_STENCIL_VIEW_DESC descDSV;
-	descDSV.Format = DXGI_FORMAT_D32_FLOAT; // See "tech gotcha" above
-	descDSV.ViewDimension = D3D10_DSV_DIMENSION_TEXTURE2D;
-	descDSV.Texture2D.MipSlice = 0;
-	if (FAILED(Device->CreateDepthStencilView(m_ShadowMapTexture, &descDSV, &m_ShadowMapDepthView))) return false;
-
-	// We also need to send this texture (a GPU memory resource) to the shaders. To do that we must create a shader-resource "view"	
-	D3D10_SHADER_RESOURCE_VIEW_DESC srDesc;
-	srDesc.Format = DXGI_FORMAT_R32_FLOAT; // See "tech gotcha" above
-	srDesc.ViewDimension = D3D10_SRV_DIMENSION_TEXTURE2D;
-	srDesc.Texture2D.MostDetailedMip = 0;
-	srDesc.Texture2D.MipLevels = 1;
-	if (FAILED(Device->CreateShaderResourceView(m_ShadowMapTexture, &srDesc, &m_ShadowMap))) return false;
-
-	//Not returned yet, return true
-	return true;
+	// Size of the shadow map determines quality / resolution of shadows
+	m_ShadowMap = g_RenderBackend->CreateDepthTexture(m_ShadowMapSize, m_ShadowMapSize);
+	return m_ShadowMap != NULL;
 }
 
-void CSpotLight::RenderShadowMap(ID3D10Device* Device, vector<CModel*> &models, ID3D10EffectMatrixVariable* camViewProjMatrixVar, bool useNewRenderTarget)
+void CSpotLight::RenderShadowMap(vector<CModel*> &models, bool useNewRenderTarget)
 {
+	// Only the models inside the light's cone need to be rendered
+	CullShadowCasters(models);
+
+	//Get the viewProj matrix of the spotlight
+	UpdateMatrices();
+	const D3DXMATRIX& viewProjMatrix = m_ShadowViewProjMatrix;
+
 	if (useNewRenderTarget)
 	{
+		// If no caster has moved (and neither has the light) then the existing shadow map is still correct
+		if (m_ShadowMapValid && !ShadowMapChanged(viewProjMatrix))
+		{
+			m_ShadowMapSkipped = true;
+			return;
+		}
+		m_ShadowMapSkipped = false;
+
+		// Record the state this shadow map is rendered with
+		m_RenderedCasters = m_ShadowCasters;
+		m_RenderedCasterVersions.resize(m_ShadowCasters.size());
+		for (unsigned int i = 0; i < m_ShadowCasters.size(); i++)
+		{
+			m_RenderedCasterVersions[i] = m_ShadowCasters[i]->GetMatrixVersion();
+		}
+		m_RenderedViewProjMatrix = viewProjMatrix;
+		m_ShadowMapValid = true;
+
 		// Setup the viewport - defines which part of the shadow map we will render to (usually all of it)
-		D3D10_VIEWPORT vp;
-		vp.Width = m_ShadowMapSize;
-		vp.Height = m_ShadowMapSize;
-		vp.MinDepth = 0.0f;
-		vp.MaxDepth = 1.0f;
-		vp.TopLeftX = 0;
-		vp.TopLeftY = 0;
-		Device->RSSetViewports(1, &vp);
+		g_RenderBackend->SetViewport(m_ShadowMapSize, m_ShadowMapSize);
 
 		// Rendering a single shadow map for a light
 		// 1. Select the shadow map texture as the current depth buffer. We will not be rendering any pixel colours
 		// 2. Clear the shadow map texture (as a depth buffer)
 		// 3. Render everything from point of view of light 0
-		Device->OMSetRenderTargets(0, 0, m_ShadowMapDepthView);
-		Device->ClearDepthStencilView(m_ShadowMapDepthView, D3D10_CLEAR_DEPTH, 1.0f, 0);
+		g_RenderBackend->SetRenderTarget(m_ShadowMap);
+		g_RenderBackend->ClearDepth();
 	}
 
 	//Send the relevant values to the shader (common settings ViewProjMatrix and model matrices)
 
-	//Send the viewProj matrix of the spotlight to the shader
-	D3DXMATRIX matrix = m_Model.GetWorldMatrix();
-	D3DXMATRIX viewMatrix;
-	D3DXMatrixInverse(&viewMatrix, NULL, &matrix);
-	D3DXMATRIX projMatrix;
-	D3DXMatrixPerspectiveFovLH(&projMatrix, ToRadians(m_ConeAngle), 1, 1.0f, 1000.0f);
-	D3DXMATRIX viewProjMatrix = viewMatrix * projMatrix;
+	//Send the viewProj matrix of the spotlight to the shader in place of the camera's
+	g_ShaderConstants.Frame().ViewProjMatrix = viewProjMatrix;
+	g_ShaderConstants.UploadFrame();
 
-	camViewProjMatrixVar->SetMatrix(viewProjMatrix);
+	for (unsigned int i = 0; i < m_ShadowCasters.size(); i++)
+	{
+		m_ShadowCasters[i]->ShadowRender(/*DepthOnlyTechnique*/);
+	}
+}
 
+void CSpotLight::CullShadowCasters(vector<CModel*> &models)
+{
+	// Test the world bounding sphere of each model against the light's cone, all at once
+	m_CasterSpheres.Clear();
 	for (unsigned int i = 0; i < models.size(); i++)
 	{
-		models[i]->ShadowRender(/*DepthOnlyTechnique*/);
+		m_CasterSpheres.Add(models[i]->GetWorldBoundingSphere());
+	}
+	m_CasterIndices.resize(m_CasterSpheres.Size());
+	unsigned int numCasters = 0;
+	if (m_CasterSpheres.Size() > 0)
+	{
+		numCasters = gen::CullSpheres(GetCone(), m_CasterSpheres, &m_CasterIndices[0]);
+	}
+
+	m_ShadowCasters.clear();
+	for (unsigned int i = 0; i < numCasters; i++)
+	{
+		m_ShadowCasters.push_back(models[m_CasterIndices[i]]);
+	}
+}
+
+bool CSpotLight::ShadowMapChanged(const D3DXMATRIX& viewProjMatrix)
+{
+	// Changed if the light has moved, a model has entered or left the cone, or any caster has moved. Models count their matrix
+	// rebuilds, so a caster has moved if its count differs from when the shadow map was rendered
+	if (viewProjMatrix != m_RenderedViewProjMatrix || m_ShadowCasters != m_RenderedCasters)
+	{
+		return true;
 	}
+	for (unsigned int i = 0; i < m_ShadowCasters.size(); i++)
+	{
+		if (m_ShadowCasters[i]->GetMatrixVersion() != m_RenderedCasterVersions[i])
+		{
+			return true;
+		}
+	}
+	return false;
 }
 
 void CSpotLight::SetConeAngle(float coneAngle)
 {
-	m_ConeAngle = coneAngle;
+	if (coneAngle != m_ConeAngle)
+	{
+		m_ConeAngle = coneAngle;
+		m_ProjDirty = true;
+	}
 }
 
 void CSpotLight::FacePoint(D3DXVECTOR3 point)
@@ -137,26 +144,69 @@ void CSpotLight::FacePoint(D3DXVECTOR3 point)
 	}
 }
 
-D3DXMATRIX CSpotLight::GetViewMatrix()
+void CSpotLight::UpdateMatrices()
 {
-	D3DXMATRIX viewMatrix;
+	if (m_ViewMatrixVersion != GetMatrixVersion())
+	{
+		m_ViewDirty = true;
+	}
+	if (!m_ViewDirty && !m_ProjDirty)
+	{
+		g_TransformStats.SpotLightMatrices.Skipped++;
+		return;
+	}
 
-	// Get the world matrix of the light model and invert it to get the view matrix (that is more-or-less the definition of a view matrix)
-	// We don't always have a physical model for a light, in which case we would need to store this data along with the light colour etc.
-	D3DXMATRIXA16 worldMatrix = m_Model.GetWorldMatrix();
-	D3DXMatrixInverse(&viewMatrix, NULL, &worldMatrix);
+	if (m_ViewDirty)
+	{
+		// Get the world matrix of the light model and invert it to get the view matrix (that is more-or-less the definition of a view matrix)
+		// We don't always have a physical model for a light, in which case we would need to store this data along with the light colour etc.
+		// The model's world matrix only holds rotation, translation and scale, so the tracked transform can use a much cheaper inverse than
+		// a general matrix inverse
+		gen::CTrackedTransform viewTransform = m_Model.GetWorldTransform().Inverse();
+		m_ViewMatrix = gen::ToD3DXMATRIX(viewTransform.GetMatrix());
+		m_ViewMatrixVersion = GetMatrixVersion();
+	}
 
-	return viewMatrix;
+	if (m_ProjDirty)
+	{
+		// Create a projection matrix for the light. Use the spotlight cone angle as an FOV, just set default values for everything else.
+		D3DXMatrixPerspectiveFovLH(&m_ProjMatrix, ToRadians(m_ConeAngle), 1, 0.1f, 1000.0f);
+		D3DXMatrixPerspectiveFovLH(&m_ShadowProjMatrix, ToRadians(m_ConeAngle), 1, 1.0f, 1000.0f);
+		m_CosHalfConeAngle = cosf(ToRadians(m_ConeAngle * 0.5f));
+	}
+
+	m_ViewProjMatrix = m_ViewMatrix * m_ProjMatrix;
+	m_ShadowViewProjMatrix = m_ViewMatrix * m_ShadowProjMatrix;
+
+	m_ViewDirty = false;
+	m_ProjDirty = false;
+	g_TransformStats.SpotLightMatrices.Updated++;
 }
 
-D3DXMATRIX CSpotLight::GetProjectionMatrix()
+const D3DXMATRIX& CSpotLight::GetViewMatrix()
 {
-	D3DXMATRIX projMatrix;
+	UpdateMatrices();
+	return m_ViewMatrix;
+}
 
-	// Create a projection matrix for the light. Use the spotlight cone angle as an FOV, just set default values for everything else.
-	D3DXMatrixPerspectiveFovLH(&projMatrix, ToRadians(m_ConeAngle), 1, 0.1f, 1000.0f);
+const D3DXMATRIX& CSpotLight::GetProjectionMatrix()
+{
+	UpdateMatrices();
+	return m_ProjMatrix;
+}
 
-	return projMatrix;
+const D3DXMATRIX& CSpotLight::GetViewProjectionMatrix()
+{
+	UpdateMatrices();
+	return m_ViewProjMatrix;
+}
+
+gen::CCone CSpotLight::GetCone()
+{
+	// The cone angle is the full angle of the light, the cone uses the half-angle. The range matches the far plane of the projection.
+	// The view matrix is the inverse of the model's world matrix, so the model's scale stretches the projection's depth range too
+	return gen::CCone(gen::ToCVector3(GetWorldPosition()), gen::ToCVector3(m_Model.GetFacingVector()), ToRadians(m_ConeAngle * 0.5f),
+	                  1000.0f * GetScale().z);
 }
 
 void CSpotLight::LightRender()
@@ -169,28 +219,22 @@ void CSpotLight::LightRender(D3DXVECTOR3 diffuseColour, D3DXVECTOR3 specularColo
 	//Call parent light render (to send the typical values)
 	CPositionalLight::LightRender(diffuseColour, specularColour);
 
+	UpdateMatrices();
+
 	//Send the cone angle to the shader
-	float halfCosAngle = cosf(ToRadians(m_ConeAngle * 0.5f));
-	m_ConeAngleVar->SetFloat(halfCosAngle);
+	m_SpotConstants->CosHalfAngle = m_CosHalfConeAngle;
 
 	//Send the facing vector of the spotlight to the shader
-	m_FacingVectorVar->SetRawValue(m_Model.GetFacingVector(), 0, sizeof(D3DXVECTOR3));
+	m_SpotConstants->FacingVector = m_Model.GetFacingVector();
 
 	//Send the viewProj matrix of the spotlight to the shader
-	D3DXMATRIX matrix = m_Model.GetWorldMatrix();
-	D3DXMATRIX viewMatrix;
-	D3DXMatrixInverse(&viewMatrix, NULL, &matrix);
-	D3DXMATRIX projMatrix;
-	D3DXMatrixPerspectiveFovLH(&projMatrix, ToRadians(m_ConeAngle), 1, 0.1f, 1000.0f);
-	D3DXMATRIX viewProjMatrix = viewMatrix * projMatrix;
-
-	m_ViewMatrixVar->SetMatrix(viewMatrix);
-	m_ProjMatrixVar->SetMatrix(projMatrix);
-	m_ViewProjMatrixVar->SetMatrix(viewProjMatrix);
+	m_SpotConstants->ViewMatrix = m_ViewMatrix;
+	m_SpotConstants->ProjMatrix = m_ProjMatrix;
+	m_SpotConstants->ViewProjMatrix = m_ViewProjMatrix;
 
 
 	//Send the shadow map to the shader
-	m_ShadowMapVar->SetResource(m_ShadowMap);
+	g_RenderBackend->SetTexture(TextureShadowMap, m_ShadowMap);
 
 }
 
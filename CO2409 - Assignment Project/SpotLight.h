@@ -2,48 +2,98 @@
 #define SPOT_LIGHT_H_INCLUDED
 
 #include "PositionalLight.h"
+#include "CCone.h"
+#include "BatchCulling.h"
+#include "RenderBackend.h"
 
 class CSpotLight : public CPositionalLight
 {
 private:
 	float m_ConeAngle;
-	ID3D10EffectScalarVariable* m_ConeAngleVar;
-	ID3D10EffectVectorVariable* m_FacingVectorVar;
-	ID3D10EffectMatrixVariable* m_ViewMatrixVar;
-	ID3D10EffectMatrixVariable* m_ProjMatrixVar;
-	ID3D10EffectMatrixVariable* m_ViewProjMatrixVar;
-	ID3D10EffectShaderResourceVariable* m_ShadowMapVar;
+	SSpotLightConstants* m_SpotConstants; // The light's place in the light set constants, written by LightRender
+
+	// Matrices for the light, only rebuilt when the light's model has moved or the cone angle has changed. The shadow map is
+	// rendered with a different near clip distance, so has its own view-projection matrix
+	D3DXMATRIX   m_ViewMatrix;
+	D3DXMATRIX   m_ProjMatrix;
+	D3DXMATRIX   m_ViewProjMatrix;
+	D3DXMATRIX   m_ShadowProjMatrix;
+	D3DXMATRIX   m_ShadowViewProjMatrix;
+	float        m_CosHalfConeAngle;
+	unsigned int m_ViewMatrixVersion; // Version of the model's world matrix that the view matrix was built from
+	bool         m_ViewDirty;
+	bool         m_ProjDirty;
+
+	// Rebuild any of the matrices above that are out of date
+	void UpdateMatrices();
 
+	static unsigned int m_ShadowMapSize;
 
+	TTextureHandle m_ShadowMap; // Depth texture, rendered to and then sampled
 
-	static unsigned int m_ShadowMapSize;
+	// Shadow casters - the models inside the light's cone, found each time the shadow map is rendered. Models outside the cone
+	// can only cast shadows onto areas this light doesn't illuminate
+	gen::CSphereList     m_CasterSpheres; // World bounding spheres of all the models passed to RenderShadowMap
+	vector<unsigned int> m_CasterIndices; // Indices of the models that passed culling
+	vector<CModel*>      m_ShadowCasters;
+
+	// The state the current shadow map was rendered with. If none of it has changed the shadow map can be reused
+	vector<CModel*>      m_RenderedCasters;
+	vector<unsigned int> m_RenderedCasterVersions; // World matrix version of each caster
+	D3DXMATRIX           m_RenderedViewProjMatrix;
+	bool                 m_ShadowMapValid;
+	bool                 m_ShadowMapSkipped;
 
-	ID3D10Texture2D*          m_ShadowMapTexture;
-	ID3D10DepthStencilView*   m_ShadowMapDepthView;
-	ID3D10ShaderResourceView* m_ShadowMap;
+	// Check if the shadow casters or the light have changed since the shadow map was last rendered
+	bool ShadowMapChanged(const D3DXMATRIX& viewProjMatrix);
 
 public:
 	CSpotLight(D3DXVECTOR3 diffuseColour = D3DXVECTOR3(0.0f, 0.0f, 0.0f), D3DXVECTOR3 specularColour = D3DXVECTOR3(0.0f, 0.0f, 0.0f),
 		D3DXVECTOR3 position = D3DXVECTOR3(0.0f, 0.0f, 0.0f), float coneAngle = 90.0f, float scale = 0.0f);
 	~CSpotLight();
 
-	bool CreateShadowMap(ID3D10Device* Device);
+	bool CreateShadowMap();
 	
-	void RenderShadowMap(ID3D10Device* Device, vector<CModel*> &models, ID3D10EffectMatrixVariable* viewProjMatrixVar, bool useNewRenderTarget = true);
-
-	void SetConeAngleVar(ID3D10EffectScalarVariable* coneAngleVar);
-	void SetFacingVectorVar(ID3D10EffectVectorVariable* facingVectorVar);
-	void SetViewMatrixVar(ID3D10EffectMatrixVariable* viewMatrixVar);
-	void SetProjMatrixVar(ID3D10EffectMatrixVariable* projMatrixVar);
-	void SetViewProjMatrixVar(ID3D10EffectMatrixVariable* viewProjMatrixVar);
-	void SetShadowMapVar(ID3D10EffectShaderResourceVariable* shadowMapVar);
+	// Render the shadow map from the given models. Uploads the light's view-projection matrix in the per-frame constants, so the
+	// camera's must be uploaded again before rendering the scene
+	void RenderShadowMap(vector<CModel*> &models, bool useNewRenderTarget = true);
+
+	// Find the models that can cast shadows from this light (those inside its cone) - called by RenderShadowMap
+	void CullShadowCasters(vector<CModel*> &models);
+
+	// The models found by the last call to CullShadowCasters
+	const vector<CModel*>& GetShadowCasters()
+	{
+		return m_ShadowCasters;
+	}
+	// True if the last call to RenderShadowMap reused the existing shadow map because no caster (or the light) had moved
+	bool WasShadowMapSkipped()
+	{
+		return m_ShadowMapSkipped;
+	}
+	// Depth texture the shadow map is rendered to
+	TTextureHandle GetShadowMap()
+	{
+		return m_ShadowMap;
+	}
+	// Force the shadow map to be rendered again next time, e.g. after changing the geometry of a model
+	void InvalidateShadowMap()
+	{
+		m_ShadowMapValid = false;
+	}
+
+	void SetConstants(SSpotLightConstants* constants);
 
 	void SetConeAngle(float coneAngle = 90.0f);
 
 	void FacePoint(D3DXVECTOR3 point);
 
-	D3DXMATRIX GetViewMatrix();
-	D3DXMATRIX GetProjectionMatrix();
+	const D3DXMATRIX& GetViewMatrix();
+	const D3DXMATRIX& GetProjectionMatrix();
+	const D3DXMATRIX& GetViewProjectionMatrix();
+
+	// The volume lit by the spotlight, for culling shadow casters and lit objects
+	gen::CCone GetCone();
 
 	void LightRender();
 	void LightRender(D3DXVECTOR3 diffuseColour, D3DXVECTOR3 specularColour);
@@ -0,0 +1,196 @@
+//--------------------------------------------------------------------------------------
+//	StateCache.cpp
+//
+//	The state cache sits between the rendering code and the render backend, remembering
+//	the last value set so that repeated binds of the same state are dropped
+//--------------------------------------------------------------------------------------
+
+#include <string.h> // memset
+
+#include "StateCache.h"	// Declaration of this class
+
+
+///////////////////////////////
+// Constructors / Destructors
+
+// Constructor - optionally give the backend to pass calls on to (can be set later)
+CStateCache::CStateCache(CRenderBackend* backend /*= NULL*/)
+{
+	m_Backend = backend;
+	m_Recording = false;
+	BeginFrame();
+}
+
+
+/////////////////////////////
+// Setup / frame control
+
+// Set the backend calls are passed on to. NULL to only count and record calls
+void CStateCache::SetBackend(CRenderBackend* backend)
+{
+	m_Backend = backend;
+	Invalidate();
+}
+
+// Start counting calls for a new frame. Also forgets all state, as other code may have changed it since the last frame
+void CStateCache::BeginFrame()
+{
+	memset(&m_Counts, 0, sizeof(m_Counts));
+	Invalidate();
+}
+
+// Forget all remembered state, so the next call of each kind is always passed on
+void CStateCache::Invalidate()
+{
+	for (UINT slot = 0; slot < MaxVertexSlots; slot++)
+	{
+		m_VertexBuffers[slot] = NULL;
+		m_VertexStrides[slot] = 0;
+		m_VertexOffsets[slot] = 0;
+	}
+	m_InputLayout = NULL;
+	m_IndexBuffer = NULL;
+	m_IndexFormat = DXGI_FORMAT_UNKNOWN;
+	m_IndexOffset = 0;
+	m_Topology = D3D10_PRIMITIVE_TOPOLOGY_UNDEFINED;
+	for (unsigned int slot = 0; slot < NumTextureSlots; slot++)
+	{
+		m_Textures[slot] = NULL;
+		m_TexturesValid[slot] = false;
+	}
+}
+
+unsigned int CStateCache::GetTotalIssued()
+{
+	unsigned int total = 0;
+	for (unsigned int i = 0; i < NumStateCalls; i++)
+	{
+		total += m_Counts.Issued[i];
+	}
+	return total;
+}
+
+unsigned int CStateCache::GetTotalElided()
+{
+	unsigned int total = 0;
+	for (unsigned int i = 0; i < NumStateCalls; i++)
+	{
+		total += m_Counts.Elided[i];
+	}
+	return total;
+}
+
+
+/////////////////////////////
+// Input assembler
+
+// Nothing is remembered after Invalidate (NULL / undefined), so each kind of state is passed on the first time it is set. Setting
+// NULL is always passed on
+void CStateCache::IASetVertexBuffer(TBufferHandle buffer, UINT stride, UINT offset /*= 0*/, UINT slot /*= 0*/)
+{
+	// Slots beyond those tracked are always passed on
+	if (slot < MaxVertexSlots)
+	{
+		if (m_VertexBuffers[slot] && buffer == m_VertexBuffers[slot] && stride == m_VertexStrides[slot] && offset == m_VertexOffsets[slot])
+		{
+			m_Counts.Elided[StateVertexBuffer]++;
+			return;
+		}
+		m_VertexBuffers[slot] = buffer;
+		m_VertexStrides[slot] = stride;
+		m_VertexOffsets[slot] = offset;
+	}
+	if (m_Backend)
+	{
+		m_Backend->SetVertexBuffer(buffer, stride, offset, slot);
+	}
+	Issue(StateVertexBuffer, buffer, stride, offset, slot);
+}
+
+void CStateCache::IASetInputLayout(TLayoutHandle layout)
+{
+	if (m_InputLayout && layout == m_InputLayout)
+	{
+		m_Counts.Elided[StateInputLayout]++;
+		return;
+	}
+	m_InputLayout = layout;
+	if (m_Backend)
+	{
+		m_Backend->SetInputLayout(layout);
+	}
+	Issue(StateInputLayout, layout);
+}
+
+void CStateCache::IASetIndexBuffer(TBufferHandle buffer, DXGI_FORMAT format, UINT offset /*= 0*/)
+{
+	if (m_IndexBuffer && buffer == m_IndexBuffer && format == m_IndexFormat && offset == m_IndexOffset)
+	{
+		m_Counts.Elided[StateIndexBuffer]++;
+		return;
+	}
+	m_IndexBuffer = buffer;
+	m_IndexFormat = format;
+	m_IndexOffset = offset;
+	if (m_Backend)
+	{
+		m_Backend->SetIndexBuffer(buffer, format, offset);
+	}
+	Issue(StateIndexBuffer, buffer, format, offset);
+}
+
+void CStateCache::IASetPrimitiveTopology(D3D10_PRIMITIVE_TOPOLOGY topology)
+{
+	if (m_Topology != D3D10_PRIMITIVE_TOPOLOGY_UNDEFINED && topology == m_Topology)
+	{
+		m_Counts.Elided[StateTopology]++;
+		return;
+	}
+	m_Topology = topology;
+	if (m_Backend)
+	{
+		m_Backend->SetTopology(topology);
+	}
+	Issue(StateTopology, NULL, topology);
+}
+
+
+/////////////////////////////
+// Textures
+
+void CStateCache::SetTexture(ETextureSlot slot, TTextureHandle texture)
+{
+	if (m_TexturesValid[slot] && texture == m_Textures[slot])
+	{
+		m_Counts.Elided[StateTexture]++;
+		return;
+	}
+	m_Textures[slot] = texture;
+	m_TexturesValid[slot] = true;
+	if (m_Backend)
+	{
+		m_Backend->SetTexture(slot, texture);
+	}
+	Issue(StateTexture, texture, 0, 0, slot);
+}
+
+
+/////////////////////////////
+// Private member functions
+
+// Count an issued call and add it to the recorded list if recording
+void CStateCache::Issue(EStateCall type, const void* object, unsigned int param /*= 0*/, unsigned int offset /*= 0*/,
+                        unsigned int slot /*= 0*/)
+{
+	m_Counts.Issued[type]++;
+	if (m_Recording)
+	{
+		SStateCall call;
+		call.Type = type;
+		call.Object = object;
+		call.Param = param;
+		call.Offset = offset;
+		call.Slot = slot;
+		m_Recorded.push_back(call);
+	}
+}
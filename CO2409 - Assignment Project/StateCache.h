@@ -0,0 +1,161 @@
+//--------------------------------------------------------------------------------------
+//	StateCache.h
+//
+//	The state cache sits between the rendering code and the render backend, remembering
+//	the last value set so that repeated binds of the same state are dropped
+//--------------------------------------------------------------------------------------
+
+#ifndef STATE_CACHE_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define STATE_CACHE_H_INCLUDED
+
+#include <vector>
+using namespace std;
+
+#include "Defines.h"
+#include "RenderBackend.h"
+
+// Input assembler state and textures that go through the cache are only passed on to the backend when they differ from the last
+// value passed on. Anything that sets the same state directly (not through the cache) must call Invalidate afterwards, or the cache
+// may wrongly drop the next bind.
+//
+// Each call is counted as issued (passed on) or elided (dropped). In recording mode each issued call is also added to a list. If
+// no backend is set the calls are only counted and recorded, never passed on - so the cache can be used with dummy handles, without
+// a backend, to check the sequence of state changes some rendering code makes
+
+// Kinds of state change made through the cache
+enum EStateCall
+{
+	StateVertexBuffer,
+	StateInputLayout,
+	StateIndexBuffer,
+	StateTopology,
+	StateTexture,
+	NumStateCalls
+};
+
+// A call passed on by the cache, as stored in recording mode. Object is the buffer, layout or texture handle. Param holds the stride,
+// index format or topology, Slot the vertex buffer or texture slot
+struct SStateCall
+{
+	EStateCall   Type;
+	const void*  Object;
+	unsigned int Param;
+	unsigned int Offset;
+	unsigned int Slot;
+};
+
+// Calls issued and elided in the current frame for each kind of state
+struct SStateCounts
+{
+	unsigned int Issued[NumStateCalls];
+	unsigned int Elided[NumStateCalls];
+};
+
+class CStateCache
+{
+/////////////////////////////
+// Private member variables
+private:
+
+	CRenderBackend* m_Backend;
+
+	// Input assembler state last passed on. NULL / undefined at first and after Invalidate. Only the first vertex buffer slots are
+	// used (geometry in slot 0, instance data in slot 1)
+	static const UINT        MaxVertexSlots = 2;
+	TBufferHandle            m_VertexBuffers[MaxVertexSlots];
+	UINT                     m_VertexStrides[MaxVertexSlots];
+	UINT                     m_VertexOffsets[MaxVertexSlots];
+	TLayoutHandle            m_InputLayout;
+	TBufferHandle            m_IndexBuffer;
+	DXGI_FORMAT              m_IndexFormat;
+	UINT                     m_IndexOffset;
+	D3D10_PRIMITIVE_TOPOLOGY m_Topology;
+
+	// Texture last passed on to each slot, and whether there has been one since Invalidate (NULL is a valid texture to set)
+	TTextureHandle m_Textures[NumTextureSlots];
+	bool           m_TexturesValid[NumTextureSlots];
+
+	SStateCounts m_Counts;
+
+	bool               m_Recording;
+	vector<SStateCall> m_Recorded;
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	///////////////////////////////
+	// Constructors / Destructors
+
+	// Constructor - optionally give the backend to pass calls on to (can be set later)
+	CStateCache(CRenderBackend* backend = NULL);
+
+
+	/////////////////////////////
+	// Setup / frame control
+
+	// Set the backend calls are passed on to. NULL to only count and record calls
+	void SetBackend(CRenderBackend* backend);
+
+	// Start counting calls for a new frame. Also forgets all state, as other code may have changed it since the last frame
+	void BeginFrame();
+
+	// Forget all remembered state, so the next call of each kind is always passed on
+	void Invalidate();
+
+	// Counts for the current frame
+	const SStateCounts& GetCounts()
+	{
+		return m_Counts;
+	}
+	unsigned int GetTotalIssued();
+	unsigned int GetTotalElided();
+
+
+	/////////////////////////////
+	// Recording
+
+	// Select whether issued calls are added to the recorded list
+	void SetRecording(bool recording)
+	{
+		m_Recording = recording;
+	}
+	const vector<SStateCall>& GetRecordedCalls()
+	{
+		return m_Recorded;
+	}
+	void ClearRecordedCalls()
+	{
+		m_Recorded.clear();
+	}
+
+
+	/////////////////////////////
+	// Input assembler
+
+	void IASetVertexBuffer(TBufferHandle buffer, UINT stride, UINT offset = 0, UINT slot = 0);
+	void IASetInputLayout(TLayoutHandle layout);
+	void IASetIndexBuffer(TBufferHandle buffer, DXGI_FORMAT format, UINT offset = 0);
+	void IASetPrimitiveTopology(D3D10_PRIMITIVE_TOPOLOGY topology);
+
+
+	/////////////////////////////
+	// Textures
+
+	void SetTexture(ETextureSlot slot, TTextureHandle texture);
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	// Count an issued call and add it to the recorded list if recording
+	void Issue(EStateCall type, const void* object, unsigned int param = 0, unsigned int offset = 0, unsigned int slot = 0);
+};
+
+// Single state cache used for all rendering - declared in GraphicsAssign1.cpp
+extern CStateCache g_StateCache;
+
+
+#endif // End of header guard - see top of file
@@ -0,0 +1,153 @@
+//--------------------------------------------------------------------------------------
+//	StaticBatcher.cpp
+//
+//	The static batcher merges models that never move and share a technique, material and
+//	colour into a few models with combined, pre-transformed geometry
+//--------------------------------------------------------------------------------------
+
+#include <map>
+#include <algorithm> // sort, binary_search
+#include <math.h>    // floorf
+
+#include "Defines.h"		// General definitions shared by all source files
+#include "StaticBatcher.h"	// Declaration of these functions
+
+// Largest number of vertices in one chunk - indices are 16-bit
+const unsigned int MaxChunkVertices = 65536;
+
+// Check if a model can be merged into a static batch
+bool IsBatchable(CModel* model)
+{
+	return model->IsStationary() && model->HasGeometry() && model->GetRenderTechnique() && !model->GetRenderTechnique()->IsBlended() &&
+	       !model->IsOccluder() && model->GetHierarchyNode() == gen::CTransformStore::kNoNode;
+}
+
+// Check if two models are drawn the same way, so can be merged into one batch
+bool CanBatchTogether(CModel* model1, CModel* model2)
+{
+	return model1->GetRenderTechnique() == model2->GetRenderTechnique() && model1->GetMaterial() == model2->GetMaterial() &&
+	       model1->GetColour() == model2->GetColour() && model1->HasSameVertexFormat(model2);
+}
+
+// Merge a list of models drawn the same way into one chunk model, added to the list of chunks. Returns false if the buffers could not
+// be created
+bool BuildChunk(const vector<CModel*>& chunkModels, vector<CModel*>& chunks, SStaticBatchStats& stats)
+{
+	vector<unsigned char> vertices;
+	vector<WORD> indices;
+	for (unsigned int i = 0; i < chunkModels.size(); i++)
+	{
+		chunkModels[i]->AppendWorldGeometry(vertices, indices);
+	}
+
+	CModel* chunk = new CModel;
+	if (!chunk->CreateFromWorldGeometry(chunkModels[0], vertices, indices))
+	{
+		delete chunk;
+		return false;
+	}
+	chunk->SetIsStationary(true);
+	chunks.push_back(chunk);
+
+	stats.ModelsMerged += static_cast<unsigned int>(chunkModels.size());
+	stats.Chunks++;
+	stats.Vertices += chunk->GetNumVertices();
+	return true;
+}
+
+// Merge the stationary models in the list that are drawn the same way into chunk models, removing the merged models from the list
+// (and deleting them) and adding the chunks at the end. The order of the other models is kept. World matrices must be up to date
+bool BuildStaticBatches(vector<CModel*>& models, float chunkSize, SStaticBatchStats* stats /*= NULL*/)
+{
+	SStaticBatchStats counts = { 0, 0, 0 };
+
+	// Group the models that can be merged, each group in the order of the list
+	vector<vector<CModel*>> groups;
+	for (unsigned int i = 0; i < models.size(); i++)
+	{
+		if (!IsBatchable(models[i]) || models[i]->GetNumVertices() > MaxChunkVertices)
+		{
+			continue;
+		}
+		unsigned int group = 0;
+		while (group < groups.size() && !CanBatchTogether(groups[group][0], models[i]))
+		{
+			group++;
+		}
+		if (group == groups.size())
+		{
+			groups.push_back(vector<CModel*>());
+		}
+		groups[group].push_back(models[i]);
+	}
+
+	// Split each group into cells by the centre of each model's bounds, then merge the models in each cell into as few chunks as
+	// their vertices allow
+	vector<CModel*> merged;
+	vector<CModel*> chunks;
+	bool succeeded = true;
+	for (unsigned int group = 0; group < groups.size(); group++)
+	{
+		map<pair<int, int>, vector<CModel*>> cells;
+		for (unsigned int i = 0; i < groups[group].size(); i++)
+		{
+			CModel* model = groups[group][i];
+			gen::CVector3 centre = model->GetWorldBoundingBox().GetCentre();
+			pair<int, int> cell(static_cast<int>(floorf(centre.x / chunkSize)), static_cast<int>(floorf(centre.z / chunkSize)));
+			cells[cell].push_back(model);
+		}
+
+		for (map<pair<int, int>, vector<CModel*>>::iterator cell = cells.begin(); cell != cells.end(); ++cell)
+		{
+			const vector<CModel*>& cellModels = cell->second;
+			unsigned int first = 0;
+			while (first < cellModels.size())
+			{
+				// Take models until the next would overflow the indices
+				unsigned int end = first;
+				unsigned int numVertices = 0;
+				while (end < cellModels.size() && numVertices + cellModels[end]->GetNumVertices() <= MaxChunkVertices)
+				{
+					numVertices += cellModels[end]->GetNumVertices();
+					end++;
+				}
+				if (end - first > 1)
+				{
+					vector<CModel*> chunkModels(cellModels.begin() + first, cellModels.begin() + end);
+					if (BuildChunk(chunkModels, chunks, counts))
+					{
+						merged.insert(merged.end(), chunkModels.begin(), chunkModels.end());
+					}
+					else
+					{
+						succeeded = false;
+					}
+				}
+				first = end;
+			}
+		}
+	}
+
+	// Replace the merged models with the chunks. The merged list is sorted so large scenes aren't searched linearly for each model
+	sort(merged.begin(), merged.end());
+	unsigned int numKept = 0;
+	for (unsigned int i = 0; i < models.size(); i++)
+	{
+		if (!binary_search(merged.begin(), merged.end(), models[i]))
+		{
+			models[numKept++] = models[i];
+		}
+		else
+		{
+			delete models[i];
+		}
+	}
+	models.resize(numKept);
+	models.insert(models.end(), chunks.begin(), chunks.end());
+
+	if (stats)
+	{
+		*stats = counts;
+	}
+	return succeeded;
+}
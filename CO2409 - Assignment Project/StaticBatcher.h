@@ -0,0 +1,44 @@
+//--------------------------------------------------------------------------------------
+//	StaticBatcher.h
+//
+//	The static batcher merges models that never move and share a technique, material and
+//	colour into a few models with combined, pre-transformed geometry
+//--------------------------------------------------------------------------------------
+
+#ifndef STATIC_BATCHER_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define STATIC_BATCHER_H_INCLUDED
+
+#include <vector>
+using namespace std;
+
+#include "Defines.h"
+#include "Model.h"
+
+// Each stationary model normally has its own matrix upload and draw call every frame. At load time the batcher groups the stationary
+// models that are drawn the same way (technique, material, colour and vertex format) and copies their geometry, transformed into
+// world space, into combined vertex and index buffers. Each combined buffer is an ordinary model at the origin, so it is culled,
+// sorted, shadowed and has its technique switched like any other.
+//
+// So that culling still works, a group is split spatially into chunks: the ground is divided into square cells of a given size and
+// each model goes in the chunk of the cell holding the centre of its bounds. A chunk also ends when its vertices would no longer fit
+// 16-bit indices. A chunk with a single model gains nothing, so that model is left as it is.
+//
+// Models that are not merged: those that may move, occluders (they keep their own occluder mesh) and models with blended techniques
+// (they are sorted back to front individually). The merged models are deleted - their geometry is fixed once merged, so a stationary
+// model must not move after batching
+
+// Counts for the batches built
+struct SStaticBatchStats
+{
+	unsigned int ModelsMerged; // Models replaced by chunks
+	unsigned int Chunks;       // Models created
+	unsigned int Vertices;     // Vertices in all the chunks
+};
+
+// Merge the stationary models in the list that are drawn the same way into chunk models, removing the merged models from the list
+// (and deleting them) and adding the chunks at the end. The order of the other models is kept. World matrices must be up to date.
+// Returns false if a chunk's buffers could not be created
+bool BuildStaticBatches(vector<CModel*>& models, float chunkSize, SStaticBatchStats* stats = NULL);
+
+
+#endif // End of header guard - see top of file
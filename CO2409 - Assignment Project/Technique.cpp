@@ -1,17 +1,55 @@
 #include "Technique.h"
 
+unsigned int CTechnique::m_NextSortId = 0;
 
-CTechnique::CTechnique(ID3D10EffectTechnique* technique, bool diffuseMap, bool bumpMap, bool CelGradient) :
-	m_Technique(technique),
-	m_RequiresDiffuseMap(diffuseMap),
-	m_RequiresBumpMap(bumpMap),
-	m_RequiresCelGradient(CelGradient)
+CTechnique::CTechnique(ID3D10Effect* effect, unsigned int features, const string& name) :
+	m_Effect(effect),
+	m_Technique(NULL),
+	m_NumPasses(0),
+	m_Features(features),
+	m_Name(name),
+	m_InstancedTechnique(NULL),
+	m_HasInstancedTechnique(false),
+	m_SortId(m_NextSortId++)
 {
+	// The maps needed follow from the features - all lit and textured features sample the diffuse map
+	m_RequiresDiffuseMap = (features & (FeatureTexture | FeaturePixelLighting)) != 0;
+	m_RequiresBumpMap = (features & (FeatureNormalMap | FeatureParallax)) != 0;
+	m_RequiresCelGradient = (features & (FeatureCelShading | FeatureNoirShading)) != 0;
+	m_IsBlended = (features & FeatureAdditive) != 0;
+
+	// As in the effect file: the outline is an extra pass, drawn before the model by the cel and noir shading without normal maps (as
+	// the original techniques were written) and after it otherwise
+	bool outlineFirst = (features & (FeatureCelShading | FeatureNoirShading)) && !(features & FeatureNormalMap);
+	m_OutlinePass = ((features & FeatureOutline) && outlineFirst) ? 0 : 1; // 1 is past the only pass without an outline
+
+	if (!effect)
+	{
+		// Also as in the effect file, there is no instanced version where the world matrix is needed outside the vertex shader, or for
+		// shadow maps
+		m_NumPasses = (features & FeatureOutline) ? 2 : 1;
+		m_HasInstancedTechnique = (features & (FeatureNormalMap | FeatureOutline | FeatureDepthOnly)) == 0;
+		return;
+	}
+
+	m_Technique = effect->GetTechniqueByName("Main");
+	D3D10_TECHNIQUE_DESC techDesc;
+	m_Technique->GetDesc(&techDesc);
+	m_NumPasses = techDesc.Passes;
+
+	// The effect returns an invalid technique rather than NULL for names it doesn't have
+	ID3D10EffectTechnique* instancedTechnique = effect->GetTechniqueByName("MainInstanced");
+	if (instancedTechnique && instancedTechnique->IsValid())
+	{
+		m_InstancedTechnique = instancedTechnique;
+		m_HasInstancedTechnique = true;
+	}
 }
 
 
 CTechnique::~CTechnique()
 {
+	if (m_Effect)  m_Effect->Release();
 }
 
 bool CTechnique::IsCompatible(CMaterial* material)
@@ -1,27 +1,115 @@
 #ifndef TECHNIQUE_H_INCLUDED
 #define TECHNIQUE_H_INCLUDED
 
+#include <string>
+using namespace std;
+
 #include "Defines.h"
 #include "Material.h"
 
+// Features a technique combines, as a bitmask. Each combination used is compiled from the effect file with a FEATURE_ define for
+// each of its features (see CTechniqueLibrary and the top of GraphicsAssign1.fx)
+enum EShaderFeature
+{
+	FeatureTexture       = 1 << 0,  // Diffuse map, with the specular map in its alpha channel
+	FeatureTint          = 1 << 1,  // Colour multiplied by the model colour
+	FeaturePixelLighting = 1 << 2,  // Per-pixel lighting from all the lights
+	FeatureNormalMap     = 1 << 3,  // Normals from the normal map
+	FeatureParallax      = 1 << 4,  // Parallax mapping from the normal map's alpha channel
+	FeatureCelShading    = 1 << 5,  // Light levels stepped by the cel gradient
+	FeatureNoirShading   = 1 << 6,  // Black and white light and material stepped by the cel gradient
+	FeatureOutline       = 1 << 7,  // Black outline drawn in a second pass
+	FeatureShadows       = 1 << 8,  // Spotlights use their shadow maps
+	FeatureWiggle        = 1 << 9,  // Wiggling vertices and scrolling texture
+	FeatureAdditive      = 1 << 10, // Additive blending, both sides, no depth writes
+	FeatureAlphaCutout   = 1 << 11, // Pixels with low texture alpha discarded
+	FeatureDepthOnly     = 1 << 12, // Depth only, for shadow maps
+	NumShaderFeatures    = 13
+};
+
 class CTechnique
 {
 private:
+	// The effect compiled for this technique's features, owned by the technique. NULL for a technique created without a device,
+	// which only carries its features (see CTechniqueLibrary::Create)
+	ID3D10Effect* m_Effect;
 	ID3D10EffectTechnique* m_Technique;
+	unsigned int m_NumPasses;
+	unsigned int m_OutlinePass; // Index of the pass drawing the outline, m_NumPasses if there is none
+
+	unsigned int m_Features;
+	string m_Name;
+
+	// Material maps the features sample, worked out from the features
 	bool m_RequiresDiffuseMap;
 	bool m_RequiresBumpMap;
 	bool m_RequiresCelGradient;
 
+	// Blended techniques draw over what is already in the back buffer, so are rendered after the opaque ones, back to front
+	bool m_IsBlended;
+
+	// Version of the technique taking the world matrix and colour from per-instance data (VS_INSTANCED_INPUT in the .fx file), so the
+	// render queue can draw many models sharing geometry and material in one call. NULL if there is no instanced version
+	ID3D10EffectTechnique* m_InstancedTechnique;
+	bool m_HasInstancedTechnique;
+
+	// Small number identifying the technique in render queue sort keys
+	unsigned int m_SortId;
+	static unsigned int m_NextSortId;
+
+	// Techniques own their effect, so are not copied
+	CTechnique(const CTechnique&);
+	CTechnique& operator=(const CTechnique&);
+
 public:
-	CTechnique(ID3D10EffectTechnique* technique, bool diffuseMap = false, bool bumpMap = false, bool CelGradient = false);
+	// Create a technique from an effect compiled for the given features, taking over the effect. The techniques are "Main" and
+	// (if the effect has one) "MainInstanced". The effect may be NULL, then the passes and instanced version are worked out from
+	// the features as the effect file would give them
+	CTechnique(ID3D10Effect* effect, unsigned int features, const string& name);
 	~CTechnique();
 
+	// The effect techniques, only used by the D3D10 backend - the rendering code uses the technique through the backend
 	ID3D10EffectTechnique* GetTechnique()
 	{
 		return m_Technique;
 	}
+	ID3D10EffectTechnique* GetInstancedTechnique()
+	{
+		return m_InstancedTechnique;
+	}
+
+	unsigned int GetNumPasses()
+	{
+		return m_NumPasses;
+	}
+	// Check if a pass draws the outline rather than the model
+	bool IsOutlinePass(unsigned int pass)
+	{
+		return pass == m_OutlinePass;
+	}
+	bool HasInstancedTechnique()
+	{
+		return m_HasInstancedTechnique;
+	}
+	// Name of the technique, for scene files, statistics and messages
+	const char* GetName()
+	{
+		return m_Name.c_str();
+	}
+	unsigned int GetFeatures()
+	{
+		return m_Features;
+	}
+	bool IsBlended()
+	{
+		return m_IsBlended;
+	}
+	unsigned int GetSortId()
+	{
+		return m_SortId;
+	}
 
 	bool IsCompatible(CMaterial* material);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,429 @@
+//--------------------------------------------------------------------------------------
+//	TechniqueLibrary.cpp
+//
+//	The technique library compiles the effect file once for each combination of shader
+//	features that is used, and looks techniques up by their features or name
+//--------------------------------------------------------------------------------------
+
+#include <string.h> // memset
+#include <sstream>
+
+#include "TechniqueLibrary.h"	// Declaration of this class
+
+// Name of each feature, and the define for it in the effect file, in bit order of EShaderFeature
+const char* FeatureNames[NumShaderFeatures] =
+{
+	"Texture", "Tint", "PixelLighting", "NormalMap", "Parallax", "CelShading", "NoirShading", "Outline", "Shadows", "Wiggle",
+	"Additive", "AlphaCutout", "DepthOnly"
+};
+const char* FeatureDefines[NumShaderFeatures] =
+{
+	"FEATURE_TEXTURE", "FEATURE_TINT", "FEATURE_PIXEL_LIGHTING", "FEATURE_NORMAL_MAP", "FEATURE_PARALLAX", "FEATURE_CEL_SHADING",
+	"FEATURE_NOIR_SHADING", "FEATURE_OUTLINE", "FEATURE_SHADOWS", "FEATURE_WIGGLE", "FEATURE_ADDITIVE", "FEATURE_ALPHA_CUTOUT",
+	"FEATURE_DEPTH_ONLY"
+};
+
+// The techniques that were written out by hand in the effect file, by the names scene files use for them. Features added by
+// Normalise are left out
+struct SNamedTechnique
+{
+	const char*  Name;
+	unsigned int Features;
+};
+const SNamedTechnique NamedTechniques[] =
+{
+	{ "PlainColour",              0 },
+	{ "DiffuseTex",               FeatureTexture },
+	{ "WiggleAndScroll",          FeatureTint | FeatureWiggle },
+	{ "PixDiffSpec",              FeaturePixelLighting },
+	{ "NormalMapping",            FeatureNormalMap },
+	{ "ParallaxMapping",          FeatureParallax },
+	{ "NoireShading",             FeatureNoirShading | FeatureOutline },
+	{ "ParallaxNoireShaded",      FeatureParallax | FeatureNoirShading | FeatureOutline },
+	{ "CelShading",               FeatureCelShading | FeatureOutline },
+	{ "ParallaxCelShading",       FeatureParallax | FeatureCelShading | FeatureOutline },
+	{ "ParallaxOutlined",         FeatureParallax | FeatureOutline },
+	{ "PixelLitOutlined",         FeaturePixelLighting | FeatureOutline },
+	{ "ShadowMappingPixelLit",    FeatureShadows },
+	{ "ShadowMappingParallaxLit", FeatureParallax | FeatureShadows },
+	{ "AdditiveTexTint",          FeatureTint | FeatureAdditive },
+	{ "AlphaCutout",              FeatureAlphaCutout | FeatureAdditive },
+	{ "DepthOnly",                FeatureDepthOnly },
+};
+const unsigned int NumNamedTechniques = sizeof(NamedTechniques) / sizeof(NamedTechniques[0]);
+
+
+///////////////////////////////
+// Constructors / Destructors
+
+CTechniqueLibrary::CTechniqueLibrary()
+{
+	m_Device = NULL;
+	m_Pool = NULL;
+	memset(&m_Stats, 0, sizeof(m_Stats));
+}
+
+CTechniqueLibrary::~CTechniqueLibrary()
+{
+	Release();
+}
+
+
+/////////////////////////////
+// Setup
+
+// Create the effect pool of the variables shared by every permutation of the given effect file. The light counts are defined for
+// each permutation. Compiled code is kept in the given folder, or not kept if it is NULL. Returns false on error (see GetError).
+// Without a device (NULL) nothing is compiled and the techniques have no effects
+bool CTechniqueLibrary::Create(ID3D10Device* device, const wchar_t* fileName, unsigned int numLights, unsigned int numSpotLights,
+                               UINT shaderFlags /*= 0*/, const wchar_t* cacheFolder /*= NULL*/)
+{
+	Release();
+	m_Device = device;
+	if (!m_Device)
+	{
+		return true;
+	}
+	if (!m_Cache.SetSource(fileName, shaderFlags, cacheFolder))
+	{
+		m_Error = "Cannot read the FX file. Ensure it is in the same folder as this executable.";
+		return false;
+	}
+
+	ostringstream lights, spotLights;
+	lights << numLights;
+	spotLights << numSpotLights;
+	m_NumLights = lights.str();
+	m_NumSpotLights = spotLights.str();
+
+	// The pool is the same file with only the shared variables
+	D3D10_SHADER_MACRO defines[] = { { "EFFECT_POOL", "1" }, { NULL, NULL } };
+	TEffectCode code;
+	string error;
+	bool fromCache;
+	if (!m_Cache.GetCode(defines, 0, &code, &error, &fromCache))
+	{
+		m_Error = "Error compiling the shared variables of the FX file:\n" + error;
+		return false;
+	}
+	if (FAILED( D3D10CreateEffectPoolFromMemory( &code[0], code.size(), 0, m_Device, &m_Pool ) ))
+	{
+		// Code from the cache may be from a different compiler, try once more with fresh code
+		if (!fromCache || !m_Cache.Compile(defines, 0, &code, &error) ||
+		    FAILED( D3D10CreateEffectPoolFromMemory( &code[0], code.size(), 0, m_Device, &m_Pool ) ))
+		{
+			m_Pool = NULL;
+			m_Error = "Error creating the shared variables of the FX file";
+			return false;
+		}
+	}
+	return true;
+}
+
+// Release all the techniques and the pool
+void CTechniqueLibrary::Release()
+{
+	for (map<unsigned int, CTechnique*>::iterator technique = m_Techniques.begin(); technique != m_Techniques.end(); ++technique)
+	{
+		delete technique->second;
+	}
+	m_Techniques.clear();
+	m_Precompiled.clear();
+	SAFE_RELEASE( m_Pool );
+}
+
+
+/////////////////////////////
+// Lookup
+
+// Get the technique for a combination of features, compiling it if this is the first request. Returns NULL if the permutation
+// doesn't compile (see GetError)
+CTechnique* CTechniqueLibrary::GetTechnique(unsigned int features)
+{
+	m_Stats.Lookups++;
+	features = Normalise(features);
+	map<unsigned int, CTechnique*>::iterator found = m_Techniques.find(features);
+	if (found != m_Techniques.end())
+	{
+		return found->second;
+	}
+
+	// Not compiled yet - the result is remembered even if it fails. Without a device there is nothing to compile
+	CTechnique* technique = NULL;
+	if (!m_Device)
+	{
+		technique = new CTechnique(NULL, features, GetName(features));
+		m_Stats.Created++;
+	}
+	else
+	{
+		ID3D10Effect* effect = CreateEffect(features);
+		if (effect)
+		{
+			technique = new CTechnique(effect, features, GetName(features));
+		}
+	}
+	m_Techniques[features] = technique;
+	return technique;
+}
+
+// Get a technique by name - one of the named techniques, or features joined with '+'. Returns NULL for an unknown name or if the
+// permutation doesn't compile
+CTechnique* CTechniqueLibrary::GetTechnique(const string& name)
+{
+	unsigned int features;
+	if (!ParseName(name, &features))
+	{
+		m_Error = "Unknown technique " + name;
+		return NULL;
+	}
+	return GetTechnique(features);
+}
+
+// Get the code for the given combinations of features ready for when they are requested, compiling those not in the cache in
+// parallel on the job system (if given). Failures are left to be reported when the technique is requested
+void CTechniqueLibrary::Precompile(const vector<unsigned int>& featureSets, gen::CJobSystem* jobs /*= NULL*/)
+{
+	if (!m_Device)
+	{
+		return;
+	}
+
+	// Each combination once, leaving out those already created or precompiled
+	struct SPrecompile
+	{
+		unsigned int Features;
+		TEffectCode  Code;
+		bool         Succeeded;
+		bool         FromCache;
+	};
+	vector<SPrecompile> precompiles;
+	for (unsigned int i = 0; i < featureSets.size(); i++)
+	{
+		unsigned int features = Normalise(featureSets[i]);
+		bool needed = m_Techniques.find(features) == m_Techniques.end() && m_Precompiled.find(features) == m_Precompiled.end();
+		for (unsigned int j = 0; needed && j < precompiles.size(); j++)
+		{
+			needed = precompiles[j].Features != features;
+		}
+		if (needed)
+		{
+			SPrecompile precompile = { features, TEffectCode(), false, false };
+			precompiles.push_back(precompile);
+		}
+	}
+
+	// Each job gets the code for one combination - the cache is safe to use from several threads, and each combination has its
+	// own entry. The device is only used back on this thread, when the techniques are created
+	gen::TJobKernel kernel = [&](gen::TUInt32 first, gen::TUInt32 end)
+	{
+		for (gen::TUInt32 i = first; i < end; i++)
+		{
+			vector<D3D10_SHADER_MACRO> defines;
+			GetDefines(precompiles[i].Features, &defines);
+			string error;
+			precompiles[i].Succeeded = m_Cache.GetCode(&defines[0], D3D10_EFFECT_COMPILE_CHILD_EFFECT, &precompiles[i].Code, &error,
+			                                           &precompiles[i].FromCache);
+		}
+	};
+	gen::TUInt32 count = static_cast<gen::TUInt32>(precompiles.size());
+	if (jobs)
+	{
+		jobs->ParallelFor(count, 1, kernel);
+	}
+	else
+	{
+		kernel(0, count);
+	}
+
+	for (unsigned int i = 0; i < precompiles.size(); i++)
+	{
+		if (precompiles[i].Succeeded)
+		{
+			SPrecompiled& precompiled = m_Precompiled[precompiles[i].Features];
+			precompiled.Code.swap(precompiles[i].Code);
+			precompiled.FromCache = precompiles[i].FromCache;
+			if (precompiles[i].FromCache)  m_Stats.Loaded++;
+			else                           m_Stats.Compiled++;
+		}
+	}
+}
+
+
+/////////////////////////////
+// Features
+
+// Add the features that the given ones depend on, and drop those replaced by others, so each distinct technique has a single
+// bitmask
+unsigned int CTechniqueLibrary::Normalise(unsigned int features)
+{
+	features &= (1 << NumShaderFeatures) - 1;
+
+	// A shadow map only needs depth
+	if (features & FeatureDepthOnly)
+	{
+		return FeatureDepthOnly;
+	}
+
+	// Noir shading is a form of cel shading, and replaces it
+	if (features & FeatureNoirShading)
+	{
+		features &= ~FeatureCelShading;
+	}
+
+	if (features & FeatureParallax)
+	{
+		features |= FeatureNormalMap;
+	}
+	if (features & (FeatureNormalMap | FeatureCelShading | FeatureNoirShading | FeatureShadows))
+	{
+		features |= FeaturePixelLighting;
+	}
+	if (features & (FeaturePixelLighting | FeatureTint | FeatureWiggle | FeatureAlphaCutout))
+	{
+		features |= FeatureTexture;
+	}
+	return features;
+}
+
+// Name of a combination of features - the named technique with those features if there is one, otherwise the feature names
+// joined with '+'
+string CTechniqueLibrary::GetName(unsigned int features)
+{
+	features = Normalise(features);
+	for (unsigned int i = 0; i < NumNamedTechniques; i++)
+	{
+		if (Normalise(NamedTechniques[i].Features) == features)
+		{
+			return NamedTechniques[i].Name;
+		}
+	}
+
+	string name;
+	for (unsigned int i = 0; i < NumShaderFeatures; i++)
+	{
+		if (features & (1 << i))
+		{
+			if (!name.empty())  name += '+';
+			name += FeatureNames[i];
+		}
+	}
+	return name;
+}
+
+// Get the features of a technique name as described above. Returns false if the name isn't recognised
+bool CTechniqueLibrary::ParseName(const string& name, unsigned int* features)
+{
+	for (unsigned int i = 0; i < NumNamedTechniques; i++)
+	{
+		if (name == NamedTechniques[i].Name)
+		{
+			*features = Normalise(NamedTechniques[i].Features);
+			return true;
+		}
+	}
+
+	// Feature names joined with '+'
+	*features = 0;
+	string::size_type start = 0;
+	while (start <= name.size())
+	{
+		string::size_type end = name.find('+', start);
+		if (end == string::npos)  end = name.size();
+
+		string featureName = name.substr(start, end - start);
+		unsigned int feature = 0;
+		while (feature < NumShaderFeatures && featureName != FeatureNames[feature])
+		{
+			feature++;
+		}
+		if (feature == NumShaderFeatures)
+		{
+			return false;
+		}
+		*features |= 1 << feature;
+		start = end + 1;
+	}
+	*features = Normalise(*features);
+	return true;
+}
+
+
+/////////////////////////////
+// Private member functions
+
+// Create the effect for the given (normalised) features, from precompiled code, the cache, or compiling. Returns NULL on error
+ID3D10Effect* CTechniqueLibrary::CreateEffect(unsigned int features)
+{
+	if (!m_Pool)
+	{
+		m_Error = "The technique library has not been created";
+		m_Stats.Failures++;
+		return NULL;
+	}
+
+	vector<D3D10_SHADER_MACRO> defines;
+	GetDefines(features, &defines);
+
+	// Take the precompiled code if there is some, otherwise get it now
+	TEffectCode code;
+	bool fromCache;
+	map<unsigned int, SPrecompiled>::iterator precompiled = m_Precompiled.find(features);
+	if (precompiled != m_Precompiled.end())
+	{
+		code.swap(precompiled->second.Code);
+		fromCache = precompiled->second.FromCache;
+		m_Precompiled.erase(precompiled);
+	}
+	else
+	{
+		string error;
+		if (!m_Cache.GetCode(&defines[0], D3D10_EFFECT_COMPILE_CHILD_EFFECT, &code, &error, &fromCache))
+		{
+			m_Error = "Error compiling technique " + GetName(features) + ":\n" + error;
+			m_Stats.Failures++;
+			return NULL;
+		}
+		if (fromCache)  m_Stats.Loaded++;
+		else            m_Stats.Compiled++;
+	}
+
+	// Created as a child of the pool, so the shared variables are the pool's
+	ID3D10Effect* effect = NULL;
+	if (FAILED( D3D10CreateEffectFromMemory( &code[0], code.size(), D3D10_EFFECT_COMPILE_CHILD_EFFECT, m_Device, m_Pool, &effect ) ))
+	{
+		// Code that came from the cache may not suit this runtime, so compile it fresh before giving up
+		string error;
+		effect = NULL;
+		if (!fromCache || !m_Cache.Compile(&defines[0], D3D10_EFFECT_COMPILE_CHILD_EFFECT, &code, &error) ||
+		    FAILED( D3D10CreateEffectFromMemory( &code[0], code.size(), D3D10_EFFECT_COMPILE_CHILD_EFFECT, m_Device, m_Pool,
+		                                         &effect ) ))
+		{
+			m_Error = "Error creating technique " + GetName(features) + (error.empty() ? "" : ":\n" + error);
+			m_Stats.Failures++;
+			return NULL;
+		}
+		m_Stats.Compiled++;
+	}
+	m_Stats.Created++;
+	return effect;
+}
+
+// Get the defines for the given features and the light counts, ending with an empty entry
+void CTechniqueLibrary::GetDefines(unsigned int features, vector<D3D10_SHADER_MACRO>* defines)
+{
+	defines->clear();
+	for (unsigned int i = 0; i < NumShaderFeatures; i++)
+	{
+		if (features & (1 << i))
+		{
+			D3D10_SHADER_MACRO define = { FeatureDefines[i], "1" };
+			defines->push_back(define);
+		}
+	}
+	D3D10_SHADER_MACRO lightDefines[] =
+	{
+		{ "NO_OF_LIGHTS", m_NumLights.c_str() }, { "NO_OF_SPOT_LIGHTS", m_NumSpotLights.c_str() }, { NULL, NULL }
+	};
+	defines->insert(defines->end(), lightDefines, lightDefines + 3);
+}
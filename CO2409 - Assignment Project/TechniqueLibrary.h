@@ -0,0 +1,170 @@
+//--------------------------------------------------------------------------------------
+//	TechniqueLibrary.h
+//
+//	The technique library compiles the effect file once for each combination of shader
+//	features that is used, and looks techniques up by their features or name
+//--------------------------------------------------------------------------------------
+
+#ifndef TECHNIQUE_LIBRARY_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define TECHNIQUE_LIBRARY_H_INCLUDED
+
+#include <map>
+#include <vector>
+#include <string>
+using namespace std;
+
+#include "Defines.h"
+#include "CJobSystem.h"
+#include "Technique.h"
+#include "EffectCache.h"
+
+// Rather than a hand-written technique for each combination of features, the effect file is written once with each feature in
+// #if blocks. A technique is asked for by a bitmask of EShaderFeature, and the first request for a combination compiles the file
+// with a define for each of its features - so only the combinations actually used are compiled, each once, and code for features
+// a combination doesn't have is not in its shaders at all (e.g. shadow tests, or a light loop with no lights). The maps a
+// technique needs from a material follow from its features
+//
+// Each permutation is a separate effect, so the constant buffers and textures are declared shared in the effect file and held by
+// an effect pool that every permutation is a child of. They are set once through the pool's effect (GetSharedEffect) and seen by
+// all the permutations
+//
+// The techniques the scene files used before are still found by their old names, which stand for a set of features. Other
+// combinations are named by their features joined with '+', e.g. "PixelLighting+Shadows"
+//
+// Compiled code is kept in an effect cache (see EffectCache.h) and effects are created from it in memory, so a run only compiles
+// what has changed since the last. Precompile gets the code for a list of combinations up front, compiling those not in the cache
+// in parallel on the job system. Anything it didn't cover is still compiled when first requested
+//
+// Created without a device, the library compiles nothing and its techniques have no effect - they carry their features, passes and
+// whether they have an instanced version, which is all that rendering through the recording backend needs (see RecordingBackend.h)
+
+// Lookups and compiles since the library was created
+struct STechniqueLibraryStats
+{
+	unsigned int Lookups;  // Requests for a technique
+	unsigned int Created;  // Permutations created from compiled code
+	unsigned int Loaded;   // Permutations whose code was loaded from the effect cache
+	unsigned int Compiled; // Permutations compiled, because the effect cache didn't have them
+	unsigned int Failures; // Permutations that failed to compile or be created
+};
+
+class CTechniqueLibrary
+{
+/////////////////////////////
+// Private member variables
+private:
+
+	ID3D10Device*     m_Device;
+	ID3D10EffectPool* m_Pool;
+	CEffectCache      m_Cache;
+
+	// Light counts defined for every permutation
+	string m_NumLights;
+	string m_NumSpotLights;
+
+	// Techniques by their features (after Normalise) - NULL for a combination that failed to compile, so it isn't compiled again
+	map<unsigned int, CTechnique*> m_Techniques;
+
+	// Code from Precompile for techniques not yet created, by their features, and whether it was loaded from the effect cache (so
+	// is worth compiling again if an effect can't be created from it)
+	struct SPrecompiled
+	{
+		TEffectCode Code;
+		bool        FromCache;
+	};
+	map<unsigned int, SPrecompiled> m_Precompiled;
+
+	string                 m_Error;
+	STechniqueLibraryStats m_Stats;
+
+	// Techniques and the pool are owned by the library, so it is not copied
+	CTechniqueLibrary(const CTechniqueLibrary&);
+	CTechniqueLibrary& operator=(const CTechniqueLibrary&);
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	///////////////////////////////
+	// Constructors / Destructors
+
+	CTechniqueLibrary();
+	~CTechniqueLibrary();
+
+
+	/////////////////////////////
+	// Setup
+
+	// Create the effect pool of the variables shared by every permutation of the given effect file. The light counts are defined
+	// for each permutation. Compiled code is kept in the given folder, or not kept if it is NULL. Returns false on error (see
+	// GetError). Without a device (NULL) nothing is compiled and the techniques have no effects
+	bool Create(ID3D10Device* device, const wchar_t* fileName, unsigned int numLights, unsigned int numSpotLights,
+	            UINT shaderFlags = 0, const wchar_t* cacheFolder = NULL);
+
+	// Release all the techniques and the pool
+	void Release();
+
+	// The effect holding the shared variables - set them here and every permutation sees the new values. NULL without a device
+	ID3D10Effect* GetSharedEffect()
+	{
+		return m_Pool ? m_Pool->AsEffect() : NULL;
+	}
+
+	// Description of the last error
+	const string& GetError()
+	{
+		return m_Error;
+	}
+
+	const STechniqueLibraryStats& GetStats()
+	{
+		return m_Stats;
+	}
+
+
+	/////////////////////////////
+	// Lookup
+
+	// Get the technique for a combination of features, compiling it if this is the first request. Returns NULL if the permutation
+	// doesn't compile (see GetError)
+	CTechnique* GetTechnique(unsigned int features);
+
+	// Get a technique by name - one of the named techniques, or features joined with '+'. Returns NULL for an unknown name or if
+	// the permutation doesn't compile
+	CTechnique* GetTechnique(const string& name);
+
+	// Get the code for the given combinations of features ready for when they are requested, compiling those not in the cache in
+	// parallel on the job system (if given). Failures are left to be reported when the technique is requested
+	void Precompile(const vector<unsigned int>& featureSets, gen::CJobSystem* jobs = NULL);
+
+
+	/////////////////////////////
+	// Features
+
+	// Add the features that the given ones depend on, and drop those replaced by others, so each distinct technique has a single
+	// bitmask. E.g. parallax mapping needs the normal map, which needs lighting, which needs the diffuse map
+	static unsigned int Normalise(unsigned int features);
+
+	// Name of a combination of features - the named technique with those features if there is one, otherwise the feature names
+	// joined with '+'
+	static string GetName(unsigned int features);
+
+	// Get the features of a technique name as described above. Returns false if the name isn't recognised
+	static bool ParseName(const string& name, unsigned int* features);
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	// Create the effect for the given (normalised) features, from precompiled code, the cache, or compiling. Returns NULL on error
+	ID3D10Effect* CreateEffect(unsigned int features);
+
+	// Get the defines for the given features and the light counts, ending with an empty entry
+	void GetDefines(unsigned int features, vector<D3D10_SHADER_MACRO>* defines);
+
+};
+
+
+#endif // End of header guard - see top of file